@@ -0,0 +1,211 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the output arena of fastq-dump: records are kept until the
+* arena is full or flushed, a record larger than the arena grows it
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <klib/out.h>
+
+#include <string>
+
+#include <stdint.h>
+
+/* the arena is compiled into the test, it needs no other part of fastq-dump */
+#include "../../tools/fastq-dump/outarena.cpp"
+
+using namespace std;
+
+TEST_SUITE(OutArenaTestSuite);
+
+/* everything the arena writes ends up here */
+static string g_out;
+static size_t g_writes;
+
+static rc_t CC CaptureWriter ( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
+{
+    g_out . append ( buffer, bufsize );
+    ++ g_writes;
+    * num_writ = bufsize;
+    return 0;
+}
+
+class OutArenaFixture
+{
+public:
+    OutArenaFixture ()
+    {
+        g_out . clear ();
+        g_writes = 0;
+        KOutHandlerSet ( CaptureWriter, NULL );
+    }
+
+    /* a record of 'size' bytes, all of them 'ch' */
+    static void Put ( AOutArena & arena, char ch, size_t size )
+    {
+        char * at = arena . reserve ( size );
+        for ( size_t i = 0; i < size; ++ i )
+            at = AOutArena :: putChar ( at, ch );
+        arena . commit ( at );
+    }
+
+    static string Uint ( uint64_t value )
+    {
+        char buf [ AOutArena :: _sM_maxIntChars ];
+        return string ( buf, AOutArena :: putUint ( buf, value ) - buf );
+    }
+
+    static string Int ( int64_t value )
+    {
+        char buf [ AOutArena :: _sM_maxIntChars + 1 ];
+        return string ( buf, AOutArena :: putInt ( buf, value ) - buf );
+    }
+};
+
+FIXTURE_TEST_CASE ( OutArena_KeepsUntilFlush, OutArenaFixture )
+{
+    AOutArena arena ( 16 );
+    Put ( arena, 'a', 5 );
+    Put ( arena, 'b', 5 );
+    REQUIRE_EQ ( g_writes, ( size_t ) 0 );
+    arena . flush ();
+    REQUIRE_EQ ( g_out, string ( "aaaaabbbbb" ) );
+    REQUIRE_EQ ( g_writes, ( size_t ) 1 );
+
+    /* nothing to write */
+    arena . flush ();
+    REQUIRE_EQ ( g_writes, ( size_t ) 1 );
+}
+
+/* a flush starts over at the beginning of the buffer */
+FIXTURE_TEST_CASE ( OutArena_Reset, OutArenaFixture )
+{
+    AOutArena arena ( 16 );
+    char * start = arena . reserve ( 1 );
+    Put ( arena, 'a', 7 );
+    arena . flush ();
+    REQUIRE ( arena . reserve ( 1 ) == start );
+    Put ( arena, 'b', 16 );
+    REQUIRE ( arena . reserve ( 0 ) == start + 16 );
+    arena . flush ();
+    REQUIRE ( arena . reserve ( 16 ) == start );
+    REQUIRE_EQ ( g_out, string ( 7, 'a' ) + string ( 16, 'b' ) );
+}
+
+/* a record which does not fit into what is left writes out the ones before it */
+FIXTURE_TEST_CASE ( OutArena_FlushWhenFull, OutArenaFixture )
+{
+    AOutArena arena ( 16 );
+    Put ( arena, 'a', 10 );
+    Put ( arena, 'b', 10 );
+    REQUIRE_EQ ( g_out, string ( 10, 'a' ) );
+    Put ( arena, 'c', 6 );
+    REQUIRE_EQ ( g_out, string ( 10, 'a' ) );
+    arena . flush ();
+    REQUIRE_EQ ( g_out, string ( 10, 'a' ) + string ( 10, 'b' ) + string ( 6, 'c' ) );
+}
+
+/* a record larger than the arena writes out the ones before it and doubles the
+   arena until the record fits; the larger arena is kept */
+FIXTURE_TEST_CASE ( OutArena_Grow, OutArenaFixture )
+{
+    AOutArena arena ( 16 );
+    Put ( arena, 'a', 3 );
+    Put ( arena, 'b', 100 );
+    REQUIRE_EQ ( g_out, string ( 3, 'a' ) );
+
+    /* 128 bytes now, 28 of them free */
+    Put ( arena, 'c', 28 );
+    REQUIRE_EQ ( g_out, string ( 3, 'a' ) );
+    Put ( arena, 'd', 1 );
+    REQUIRE_EQ ( g_out, string ( 3, 'a' ) + string ( 100, 'b' ) + string ( 28, 'c' ) );
+
+    /* the whole arena in one record, no growth */
+    Put ( arena, 'e', 127 );
+    arena . flush ();
+    REQUIRE_EQ ( g_out, string ( 3, 'a' ) + string ( 100, 'b' ) + string ( 28, 'c' )
+                        + string ( 1, 'd' ) + string ( 127, 'e' ) );
+}
+
+/* the destructor writes what is left */
+FIXTURE_TEST_CASE ( OutArena_FlushOnDestruction, OutArenaFixture )
+{
+    {
+        AOutArena arena ( 16 );
+        Put ( arena, 'a', 40 );
+        REQUIRE_EQ ( g_writes, ( size_t ) 0 );
+    }
+    REQUIRE_EQ ( g_out, string ( 40, 'a' ) );
+}
+
+FIXTURE_TEST_CASE ( OutArena_Integers, OutArenaFixture )
+{
+    REQUIRE_EQ ( Uint ( 0 ), string ( "0" ) );
+    REQUIRE_EQ ( Uint ( 9 ), string ( "9" ) );
+    REQUIRE_EQ ( Uint ( 10 ), string ( "10" ) );
+    REQUIRE_EQ ( Uint ( 99 ), string ( "99" ) );
+    REQUIRE_EQ ( Uint ( 100 ), string ( "100" ) );
+    REQUIRE_EQ ( Uint ( 1000000007 ), string ( "1000000007" ) );
+    REQUIRE_EQ ( Uint ( ~ ( uint64_t ) 0 ), string ( "18446744073709551615" ) );
+    REQUIRE_EQ ( Int ( -1 ), string ( "-1" ) );
+    REQUIRE_EQ ( Int ( 42 ), string ( "42" ) );
+    REQUIRE_EQ ( Int ( - ( int64_t ) 9223372036854775807LL - 1 ), string ( "-9223372036854775808" ) );
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-outarena";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=OutArenaTestSuite(argc, argv);
+    return rc;
+}
+
+}
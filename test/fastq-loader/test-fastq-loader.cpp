@@ -30,6 +30,9 @@
 
 #include <cstring>
 #include <ctime>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
 
 #include <ktst/unit_test.hpp>
 
@@ -51,6 +54,7 @@ extern "C" {
 #include <loader/alignment-writer.h>
 #include "../../tools/fastq-loader/fastq-reader.h"
 #include "../../tools/fastq-loader/fastq-parse.h"
+#include "../../tools/fastq-loader/fastq-pipe.h"
 }
 
 using namespace std;
@@ -178,6 +182,138 @@ FIXTURE_TEST_CASE(CommonWriterOneFile, TempFileFixture)
     //TODO: open and validate database 
 }
 
+///////////////////////////////////////////////// FastqPipeReaderFile
+class PipeFixture
+{
+public:
+    PipeFixture()
+    :   wd(0), rf(0)
+    {
+        if ( KDirectoryNativeDir ( & wd ) != 0 )
+            FAIL("KDirectoryNativeDir failed");
+    }
+    ~PipeFixture()
+    {
+        if ( rf != 0 && ReaderFileRelease( rf ) != 0)
+            FAIL("ReaderFileRelease failed");
+        for ( vector < string > :: const_iterator i = files.begin(); i != files.end(); ++i )
+            KDirectoryRemove(wd, true, i->c_str());
+        if ( wd && KDirectoryRelease ( wd ) != 0 )
+            FAIL("KDirectoryRelease failed");
+    }
+    void CreateFile(const string& p_filename, const string& contents)
+    {
+        KFile* file;
+        if ( KDirectoryCreateFile(wd, &file, true, 0664, kcmInit, p_filename.c_str()) != 0 )
+            throw logic_error("CreateFile: KDirectoryCreateFile failed");
+        size_t num_writ=0;
+        rc_t rc = KFileWrite(file, 0, contents.data(), contents.size(), &num_writ);
+        KFileRelease(file);
+        if ( rc != 0 )
+            throw logic_error("CreateFile: KFileWrite failed");
+        files.push_back(p_filename);
+    }
+    void MakePipe()
+    {
+        const ReaderFile* inputs[2];
+        for ( size_t i = 0; i != files.size(); ++i )
+        {
+            if ( FastqReaderFileMake(&inputs[i], wd, files[i].c_str(), FASTQphred33, 0, false) != 0 )
+                throw logic_error("MakePipe: FastqReaderFileMake failed");
+        }
+        if ( FastqPipeReaderFileMake(&rf, inputs, (unsigned)files.size()) != 0 )
+            throw logic_error("MakePipe: FastqPipeReaderFileMake failed");
+    }
+    /* spot names of all records, in the order the pipe returns them */
+    string Names()
+    {
+        string res;
+        const Record* record;
+        while ( ReaderFileGetRecord(rf, &record) == 0 && record != 0 )
+        {
+            const Sequence* seq;
+            const char* name;
+            size_t length;
+            if ( RecordGetSequence(record, &seq) != 0 || SequenceGetSpotName(seq, &name, &length) != 0 )
+                throw logic_error("Names: no spot name");
+            res += string(name, length) + " ";
+            SequenceRelease(seq);
+            RecordRelease(record);
+        }
+        return res;
+    }
+    static string Fastq(const string& names)
+    {   /* one short record per name in a space-separated list */
+        string res;
+        size_t from = 0;
+        while ( from < names.size() )
+        {
+            size_t to = names.find(' ', from);
+            if ( to == string::npos )
+                to = names.size();
+            res += "@" + names.substr(from, to - from) + "\nGATT\n+\n!''*\n";
+            from = to + 1;
+        }
+        return res;
+    }
+
+    KDirectory* wd;
+    vector < string > files;
+    const ReaderFile* rf;
+};
+
+FIXTURE_TEST_CASE(PipeMatesInterleaved, PipeFixture)
+{
+    CreateFile(string(GetName()) + "_1.fastq", Fastq("a b c"));
+    CreateFile(string(GetName()) + "_2.fastq", Fastq("a b c"));
+    MakePipe();
+    REQUIRE_EQ(string("a a b b c c "), Names());
+}
+
+FIXTURE_TEST_CASE(PipeMatesReadNumbersInName, PipeFixture)
+{   /* PacBio names keep "/1", "/2" in the spot name */
+    const string name1 = "m101210_094054_00126_c000028442550000000115022402181134_s1_p0";
+    const string name2 = "m101210_094054_00126_c000028442550000000115022402181134_s1_p1";
+    CreateFile(string(GetName()) + "_1.fastq",
+               "@" + name1 + "/1 ccs\nGATT\n+\n!''*\n" "@" + name2 + "/1 ccs\nGATT\n+\n!''*\n");
+    CreateFile(string(GetName()) + "_2.fastq",
+               "@" + name1 + "/2 ccs\nGATT\n+\n!''*\n" "@" + name2 + "/2 ccs\nGATT\n+\n!''*\n");
+    MakePipe();
+    REQUIRE_EQ(name1 + "/1 " + name1 + "/2 " + name2 + "/1 " + name2 + "/2 ", Names());
+}
+
+FIXTURE_TEST_CASE(PipeNotMatesInFileOrder, PipeFixture)
+{
+    CreateFile(string(GetName()) + "_1.fastq", Fastq("a b c"));
+    CreateFile(string(GetName()) + "_2.fastq", Fastq("x y z"));
+    MakePipe();
+    REQUIRE_EQ(string("a b c x y z "), Names());
+}
+
+FIXTURE_TEST_CASE(PipeSingleInput, PipeFixture)
+{
+    CreateFile(string(GetName()) + ".fastq", Fastq("a b c"));
+    MakePipe();
+    REQUIRE_EQ(string("a b c "), Names());
+}
+
+FIXTURE_TEST_CASE(PipeManyBatches, PipeFixture)
+{   /* more records than fit into the queue at once */
+    string names;
+    for ( int i = 0; i != 10000; ++i )
+    {
+        char buf[16];
+        sprintf(buf, "r%d ", i);
+        names += buf;
+    }
+    CreateFile(string(GetName()) + "_1.fastq", Fastq(names));
+    CreateFile(string(GetName()) + "_2.fastq", Fastq(names));
+    MakePipe();
+    string res = Names();
+    REQUIRE_EQ(string("r0 r0 r1 r1 r2 r2 "), res.substr(0, 18));
+    REQUIRE_EQ(string("r9999 r9999 "), res.substr(res.size() - 12));
+}
+
 //////////////////////////////////////////// Main
 #include <kapp/args.h>
 #include <kfg/config.h>
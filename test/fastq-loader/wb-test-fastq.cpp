@@ -1308,6 +1308,67 @@ FIXTURE_TEST_CASE ( AnotherUnexpectedEOLreported, LoaderFixture )
     REQUIRE(SequenceIsSecond(seq));
 }
 
+////////////////// records bypassing the parser (fastq-scan.c)
+FIXTURE_TEST_CASE ( Scanned_ThenParsed, LoaderFixture )
+{   // the first 3 records are recognized by the scanner, the parser takes over at the 4th
+    REQUIRE_RC(CreateFile(GetName(),
+        "@r1/1\nACGT\n+\nIIII\n"
+        "@HWI-ST:8:1101:1234:5678#ACGT/2\nACGT\n+\nIIII\n"
+        "@EAS139:136:FC706VJ:2:2104:15343:197393 1:Y:18:ATCACG\nACGT\n+\nIIII\n"
+        "@bad!\nACGT\n+\nIIII\n"
+        "@r2\nACGT\n+\nIIII\n"
+    ));
+
+    REQUIRE(GetRecord());
+    REQUIRE_RC(RecordGetSequence(record, &seq));
+    REQUIRE_RC(SequenceGetSpotName(seq, &name, &length));
+    REQUIRE_EQ(string("r1/1"), string(name, length));
+    REQUIRE(SequenceIsFirst(seq));
+
+    REQUIRE(GetRecord());
+    REQUIRE_RC(RecordGetSequence(record, &seq));
+    REQUIRE_RC(SequenceGetSpotName(seq, &name, &length));
+    REQUIRE_EQ(string("HWI-ST:8:1101:1234:5678"), string(name, length));
+    REQUIRE_RC(SequenceGetSpotGroup(seq, &name, &length));
+    REQUIRE_EQ(string("ACGT"), string(name, length));
+    REQUIRE(SequenceIsSecond(seq));
+
+    REQUIRE(GetRecord());
+    REQUIRE_RC(RecordGetSequence(record, &seq));
+    REQUIRE_RC(SequenceGetSpotName(seq, &name, &length));
+    REQUIRE_EQ(string("EAS139:136:FC706VJ:2:2104:15343:197393"), string(name, length));
+    REQUIRE_RC(SequenceGetSpotGroup(seq, &name, &length));
+    REQUIRE_EQ(string("ATCACG"), string(name, length));
+    REQUIRE(SequenceIsFirst(seq));
+    REQUIRE(SequenceIsLowQuality(seq));
+
+    REQUIRE(GetRecord());
+    REQUIRE(GetRejected());
+    REQUIRE(!fatal);
+    REQUIRE_EQ(errorLine, (uint64_t)13);
+
+    REQUIRE(GetRecord());
+    REQUIRE(!GetRejected());
+    REQUIRE_RC(RecordGetSequence(record, &seq));
+    REQUIRE_RC(SequenceGetSpotName(seq, &name, &length));
+    REQUIRE_EQ(string("r2"), string(name, length));
+}
+
+FIXTURE_TEST_CASE ( Scanned_OutlivesReader, LoaderFixture )
+{   // scanned records point into the reader's input buffers
+    REQUIRE_RC(CreateFile(GetName(), "@r1\nACGT\n+\nIIII\n@r2\nAC\n+\nII\n"));
+    REQUIRE(GetRecord());
+    REQUIRE_RC(ReaderFileRelease(rf));
+    rf = 0;
+
+    REQUIRE_RC(RecordGetSequence(record, &seq));
+    REQUIRE_RC(SequenceGetSpotName(seq, &name, &length));
+    REQUIRE_EQ(string("r1"), string(name, length));
+    REQUIRE(MakeReadBuffer());
+    REQUIRE_RC(SequenceGetRead(seq, read));
+    REQUIRE_EQ(string("ACGT"), string(read, readLength));
+}
+
 
 
 // FIXTURE_TEST_CASE(Pacbio, LoaderFixture)
@@ -66,6 +66,34 @@ public:
     NGS_Pileup::Settings ps;
 };
 
+/* no position is repeated or goes back within a reference */
+static
+bool
+PositionsIncrease ( const string & output )
+{
+    istringstream in ( output );
+    string line;
+    string prevRef;
+    long long prevPos = 0;
+    while ( getline ( in, line ) )
+    {
+        istringstream fields ( line );
+        string ref;
+        long long pos;
+        if ( ! getline ( fields, ref, '\t' ) || ! ( fields >> pos ) )
+        {
+            return false;
+        }
+        if ( ref == prevRef && pos <= prevPos )
+        {
+            return false;
+        }
+        prevRef = ref;
+        prevPos = pos;
+    }
+    return true;
+}
+
 FIXTURE_TEST_CASE ( NoInput, NGSPileupFixture )
 {
     Run ();
@@ -114,6 +142,41 @@ FIXTURE_TEST_CASE ( SingleReference_Slice, NGSPileupFixture )
     REQUIRE_EQ ( expected, Run () );
 }
 
+FIXTURE_TEST_CASE ( SingleReference_Slices_Merged, NGSPileupFixture )
+{
+    ps . AddInput ( "ERR247027" );
+    ps . AddReferenceSlice ( "AL844509.2", 1212492, 12 ); /* the union of the slices below */
+    string single = Run ();
+    REQUIRE ( ! single . empty () );
+
+    NGS_Pileup::Settings merged;
+    ostringstream str;
+    merged . output = & str;
+    merged . AddInput ( "ERR247027" );
+    merged . AddReferenceSlice ( "AL844509.2", 1212494, 10 );
+    merged . AddReferenceSlice ( "AL844509.2", 1212492, 3 );  /* overlaps the first one */
+    merged . chunk_size = 4; /* slice boundaries inside and between chunks */
+    merged . num_threads = 4;
+    NGS_Pileup ( merged ) . Run ();
+
+    REQUIRE_EQ ( single, str . str () );
+    REQUIRE ( PositionsIncrease ( str . str () ) );
+}
+
+FIXTURE_TEST_CASE ( Threads_SameOutput, NGSPileupFixture )
+{
+    ps . AddInput ( "SRR833251" );
+    string single = Run ();
+
+    ostringstream str;
+    ps . output = & str;
+    ps . num_threads = 4;
+    ps . chunk_size = 64 * 1024; /* the reference is about 3.9M: many chunks at once */
+    NGS_Pileup ( ps ) . Run ();
+    REQUIRE_EQ ( single, str . str () );
+    REQUIRE ( PositionsIncrease ( str . str () ) );
+}
+
 #if 0
 FIXTURE_TEST_CASE ( MultipleReferences, NGSPileupFixture )
 {   
@@ -0,0 +1,285 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the ranged http download of prefetch, remote files are
+* served by range-server.py
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <kfs/directory.h>
+#include <kns/manager.h>
+
+#include <sysalloc.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "wb-download-ranges.h"
+#include "../../tools/prefetch/download-ranges.h"
+
+using namespace std;
+
+TEST_SUITE(DownloadRangesTestSuite);
+
+static string g_dir; /* served by range server */
+static string g_url;
+static string g_log; /* GET requests served: "<path> <first> <last>" */
+
+/* 3 full ranges and a short one */
+static const uint64_t FILE_SIZE = 3 * ( uint64_t ) RANGES_CHUNK_SIZE + 12345;
+
+class DownloadRangesFixture
+{
+public:
+    DownloadRangesFixture() : m_dir ( 0 ), m_kns ( 0 )
+    {
+        if ( KDirectoryNativeDir ( & m_dir ) != 0 )
+            throw logic_error ( "DownloadRangesFixture: KDirectoryNativeDir failed" );
+        if ( KNSManagerMake ( & m_kns ) != 0 )
+            throw logic_error ( "DownloadRangesFixture: KNSManagerMake failed" );
+    }
+    ~DownloadRangesFixture()
+    {
+        if ( ! m_to . empty () )
+        {
+            remove ( m_to . c_str () );
+            remove ( ( m_to + ".ranges" ) . c_str () );
+        }
+        KNSManagerRelease ( m_kns );
+        KDirectoryRelease ( m_dir );
+    }
+
+    /* remote file of that name, "seed" makes its content */
+    void Serve ( const string & name, int seed )
+    {
+        m_name = name;
+        m_url = g_url + name;
+        m_to = g_dir + "../" + name;
+        m_data . resize ( FILE_SIZE );
+        for ( uint64_t i = 0; i < FILE_SIZE; ++ i )
+            m_data [ i ] = ( char ) ( ( i * 131 + i / 4093 + seed ) % 251 );
+        WriteFile ( g_dir + name, 0, & m_data [ 0 ], FILE_SIZE );
+    }
+
+    static void WriteFile ( const string & path, uint64_t offset, const void * data, size_t size )
+    {
+        FILE * f = fopen ( path . c_str (), offset == 0 ? "wb" : "r+b" );
+        if ( f == 0
+            || fseek ( f, ( long ) offset, SEEK_SET ) != 0
+            || fwrite ( data, 1, size, f ) != size
+            || fclose ( f ) != 0 )
+            throw logic_error ( "DownloadRangesFixture::WriteFile failed: " + path );
+    }
+
+    static bool Exists ( const string & path )
+    {
+        struct stat st;
+        return stat ( path . c_str (), & st ) == 0;
+    }
+
+    bool Downloaded () const
+    {
+        vector < char > content;
+        FILE * f = fopen ( m_to . c_str (), "rb" );
+        if ( f != 0 )
+        {
+            char buf [ 65536 ];
+            size_t num;
+            while ( ( num = fread ( buf, 1, sizeof buf, f ) ) != 0 )
+                content . insert ( content . end (), buf, buf + num );
+            fclose ( f );
+        }
+        return content == m_data;
+    }
+
+    static void ClearLog ()
+    {
+        FILE * f = fopen ( g_log . c_str (), "w" );
+        if ( f != 0 )
+            fclose ( f );
+    }
+
+    /* bytes of the remote file served since ClearLog */
+    uint64_t Fetched ( uint32_t * requests = 0 ) const
+    {
+        uint64_t bytes = 0;
+        uint32_t count = 0;
+        FILE * f = fopen ( g_log . c_str (), "r" );
+        if ( f != 0 )
+        {
+            char path [ 4096 ];
+            unsigned long long first, last;
+            while ( fscanf ( f, "%4095s %llu %llu", path, & first, & last ) == 3 )
+            {
+                if ( string ( path ) == "/" + m_name )
+                {
+                    bytes += last - first + 1;
+                    ++ count;
+                }
+            }
+            fclose ( f );
+        }
+        if ( requests != 0 )
+            * requests = count;
+        return bytes;
+    }
+
+    rc_t Download ( uint32_t connections )
+    {
+        return DownloadRanges ( m_dir, m_kns, m_url . c_str (), FILE_SIZE, m_to . c_str (), connections, NULL );
+    }
+
+    rc_t Interrupted ( uint32_t first, uint32_t count )
+    {
+        return WbDownloadRangesPartial ( m_dir, m_kns, m_url . c_str (), FILE_SIZE, m_to . c_str (), first, count );
+    }
+
+    KDirectory * m_dir;
+    KNSManager * m_kns;
+    string m_name;
+    string m_url;
+    string m_to;
+    vector < char > m_data;
+};
+
+FIXTURE_TEST_CASE ( Ranges_Fetch, DownloadRangesFixture )
+{
+    Serve ( GetName (), 0 );
+    ClearLog ();
+    REQUIRE_RC ( Download ( 4 ) );
+    REQUIRE ( Downloaded () );
+    REQUIRE ( ! Exists ( m_to + ".ranges" ) );
+
+    uint32_t requests = 0;
+    REQUIRE ( Fetched ( & requests ) >= FILE_SIZE );
+    REQUIRE ( requests >= 4 );
+}
+
+FIXTURE_TEST_CASE ( Ranges_Sequential, DownloadRangesFixture )
+{
+    Serve ( GetName (), 1 );
+    REQUIRE_RC ( Download ( 1 ) );
+    REQUIRE ( Downloaded () );
+}
+
+FIXTURE_TEST_CASE ( Ranges_Interrupted, DownloadRangesFixture )
+{
+    Serve ( GetName (), 2 );
+    REQUIRE_RC ( Interrupted ( 0, 2 ) );
+    REQUIRE ( Exists ( m_to + ".ranges" ) );
+    REQUIRE ( ! Downloaded () );
+}
+
+FIXTURE_TEST_CASE ( Ranges_Resume, DownloadRangesFixture )
+{   /* ranges 0 and 1 are not fetched again */
+    Serve ( GetName (), 3 );
+    REQUIRE_RC ( Interrupted ( 0, 2 ) );
+    ClearLog ();
+    REQUIRE_RC ( Download ( 4 ) );
+    REQUIRE ( Downloaded () );
+    REQUIRE ( ! Exists ( m_to + ".ranges" ) );
+
+    uint64_t fetched = Fetched ();
+    REQUIRE ( fetched >= FILE_SIZE - 2 * RANGES_CHUNK_SIZE );
+    REQUIRE ( fetched < FILE_SIZE - RANGES_CHUNK_SIZE );
+}
+
+FIXTURE_TEST_CASE ( Ranges_DamagedRefetched, DownloadRangesFixture )
+{   /* all ranges are in, one of them is damaged on disk */
+    Serve ( GetName (), 4 );
+    REQUIRE_RC ( Interrupted ( 0, 4 ) );
+    WriteFile ( m_to, 2 * ( uint64_t ) RANGES_CHUNK_SIZE + 100, "XXXX", 4 );
+    ClearLog ();
+    REQUIRE_RC ( Download ( 4 ) );
+    REQUIRE ( Downloaded () );
+
+    uint64_t fetched = Fetched ();
+    REQUIRE ( fetched >= RANGES_CHUNK_SIZE );
+    REQUIRE ( fetched < 2 * RANGES_CHUNK_SIZE );
+}
+
+FIXTURE_TEST_CASE ( Ranges_ChangedNotResumed, DownloadRangesFixture )
+{   /* same size, other content: the ranges already in are of the old one */
+    Serve ( GetName (), 5 );
+    REQUIRE_RC ( Interrupted ( 0, 2 ) );
+    Serve ( GetName (), 6 );
+    ClearLog ();
+    REQUIRE_RC ( Download ( 4 ) );
+    REQUIRE ( Downloaded () );
+    REQUIRE ( Fetched () >= FILE_SIZE );
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-download-ranges";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    const char * dir = getenv ( "RANGE_SERVER_DIR" );
+    const char * url = getenv ( "RANGE_SERVER_URL" );
+    const char * log = getenv ( "RANGE_SERVER_LOG" );
+    if ( dir == NULL || url == NULL || log == NULL )
+    {
+        fprintf ( stderr, "run under with-range-server.sh\n" );
+        return 1;
+    }
+    g_dir = string ( dir ) + "/";
+    g_url = url;
+    g_log = log;
+
+    KConfigDisableUserSettings();
+    rc_t rc=DownloadRangesTestSuite(argc, argv);
+    return rc;
+}
+
+}
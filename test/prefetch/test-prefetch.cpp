@@ -0,0 +1,287 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the job scheduler of prefetch
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <kproc/thread.h>
+#include <klib/time.h>
+
+#include <sysalloc.h>
+
+#include <stdexcept>
+
+#include "wb-prefetch.h"
+#include "../../tools/prefetch/rate-limit.h"
+
+using namespace std;
+
+TEST_SUITE(PrefetchTestSuite);
+
+class PrefetchFixture
+{
+public:
+    PrefetchFixture() : m_main ( 0 )
+    {
+    }
+    ~PrefetchFixture()
+    {
+        WbMainWhack ( m_main );
+    }
+    void Make ( uint32_t jobs )
+    {
+        if ( WbMainMake ( & m_main, jobs ) != 0 )
+            throw logic_error ( "PrefetchFixture::Make WbMainMake failed" );
+    }
+
+    WbMain * m_main;
+};
+
+//////////////////////////////////////////// refseq claims
+
+FIXTURE_TEST_CASE ( Refseq_ClaimedOnce, PrefetchFixture )
+{
+    Make ( 4 );
+    bool claimed, pending;
+
+    REQUIRE_RC ( WbClaimRefseq ( m_main, "NC_000001", false, & claimed, & pending ) );
+    REQUIRE ( claimed );
+    REQUIRE ( ! pending );
+
+    REQUIRE_RC ( WbClaimRefseq ( m_main, "NC_000001", false, & claimed, & pending ) );
+    REQUIRE ( ! claimed );
+    REQUIRE ( pending );
+
+    WbRefseqDone ( m_main, "NC_000001", true );
+
+    REQUIRE_RC ( WbClaimRefseq ( m_main, "NC_000001", true, & claimed, & pending ) );
+    REQUIRE ( ! claimed );
+    REQUIRE ( ! pending );
+}
+
+FIXTURE_TEST_CASE ( Refseq_ClaimedAgainAfterFailure, PrefetchFixture )
+{
+    Make ( 4 );
+    bool claimed, pending;
+
+    REQUIRE_RC ( WbClaimRefseq ( m_main, "NC_000002", false, & claimed, & pending ) );
+    REQUIRE ( claimed );
+    WbRefseqDone ( m_main, "NC_000002", false );
+
+    REQUIRE_RC ( WbClaimRefseq ( m_main, "NC_000002", false, & claimed, & pending ) );
+    REQUIRE ( claimed );
+    REQUIRE ( ! pending );
+}
+
+struct Waiter
+{
+    WbMain * main;
+    bool claimed;
+    bool pending;
+};
+
+static rc_t CC WaitForRefseq ( const KThread *, void * data )
+{
+    Waiter * w = ( Waiter * ) data;
+    return WbClaimRefseq ( w -> main, "NC_000003", true, & w -> claimed, & w -> pending );
+}
+
+FIXTURE_TEST_CASE ( Refseq_WaiterTakesOverFailedDownload, PrefetchFixture )
+{
+    Make ( 4 );
+    bool claimed, pending;
+    REQUIRE_RC ( WbClaimRefseq ( m_main, "NC_000003", false, & claimed, & pending ) );
+    REQUIRE ( claimed );
+
+    Waiter w = { m_main, false, false };
+    KThread * t;
+    REQUIRE_RC ( KThreadMake ( & t, WaitForRefseq, & w ) );
+    KSleepMs ( 50 );
+    WbRefseqDone ( m_main, "NC_000003", false );
+
+    rc_t rc = 0;
+    REQUIRE_RC ( KThreadWait ( t, & rc ) );
+    REQUIRE_RC ( KThreadRelease ( t ) );
+    REQUIRE_RC ( rc );
+    REQUIRE ( w . claimed );
+    REQUIRE ( ! w . pending );
+}
+
+//////////////////////////////////////////// scheduler
+
+FIXTURE_TEST_CASE ( Jobs_SingleThread, PrefetchFixture )
+{
+    Make ( 1 );
+    uint32_t done, maxRunning;
+    REQUIRE_RC ( WbRunJobs ( m_main, 10, 0, 10, false, & done, & maxRunning ) );
+    REQUIRE_EQ ( done, ( uint32_t ) 10 );
+    REQUIRE_EQ ( maxRunning, ( uint32_t ) 1 );
+    REQUIRE_EQ ( WbBusy ( m_main ), ( uint32_t ) 1 );
+}
+
+FIXTURE_TEST_CASE ( Jobs_LimitRespected, PrefetchFixture )
+{
+    Make ( 4 );
+    uint32_t done, maxRunning;
+    REQUIRE_RC ( WbRunJobs ( m_main, 40, 0, 40, false, & done, & maxRunning ) );
+    REQUIRE_EQ ( done, ( uint32_t ) 40 );
+    REQUIRE ( maxRunning > 1 );
+    REQUIRE ( maxRunning <= 4 );
+    REQUIRE_EQ ( WbBusy ( m_main ), ( uint32_t ) 1 );
+}
+
+FIXTURE_TEST_CASE ( Jobs_NestedShareLimit, PrefetchFixture )
+{   /* dependencies of items run as nested jobs and take threads from the same pool */
+    Make ( 3 );
+    uint32_t done, maxRunning;
+    REQUIRE_RC ( WbRunJobs ( m_main, 6, 5, 6, false, & done, & maxRunning ) );
+    REQUIRE_EQ ( done, ( uint32_t ) 30 );
+    REQUIRE ( maxRunning <= 3 );
+    REQUIRE_EQ ( WbBusy ( m_main ), ( uint32_t ) 1 );
+}
+
+FIXTURE_TEST_CASE ( Jobs_FailureReported, PrefetchFixture )
+{
+    Make ( 4 );
+    uint32_t done, maxRunning;
+    REQUIRE_RC_FAIL ( WbRunJobs ( m_main, 20, 0, 3, true, & done, & maxRunning ) );
+    REQUIRE ( done < 20 );
+    REQUIRE_EQ ( WbBusy ( m_main ), ( uint32_t ) 1 );
+}
+
+FIXTURE_TEST_CASE ( Jobs_RefseqDownloadedOnce, PrefetchFixture )
+{
+    Make ( 8 );
+    uint32_t downloads [ 4 ];
+    REQUIRE_RC ( WbRunRefseqJobs ( m_main, 64, 4, false, downloads ) );
+    for ( uint32_t i = 0; i < 4; ++ i )
+        REQUIRE_EQ ( downloads [ i ], ( uint32_t ) 1 );
+}
+
+FIXTURE_TEST_CASE ( Jobs_FailedRefseqRetried, PrefetchFixture )
+{
+    Make ( 8 );
+    uint32_t downloads [ 4 ];
+    REQUIRE_RC ( WbRunRefseqJobs ( m_main, 64, 4, true, downloads ) );
+    for ( uint32_t i = 0; i < 4; ++ i )
+        REQUIRE_EQ ( downloads [ i ], ( uint32_t ) 2 );
+}
+
+//////////////////////////////////////////// --max-rate
+
+struct Taker
+{
+    RateLimit * rate;
+    uint32_t count;
+    uint64_t bytes;
+};
+
+static rc_t CC Take ( const KThread *, void * data )
+{
+    Taker * t = ( Taker * ) data;
+    rc_t rc = 0;
+    for ( uint32_t i = 0; rc == 0 && i < t -> count; ++ i )
+        rc = RateLimitTake ( t -> rate, t -> bytes );
+    return rc;
+}
+
+TEST_CASE ( RateLimit_SharedByThreads )
+{   /* 4 threads take 1MB at 1MB/s: the last take waits for all but itself */
+    RateLimit * rate;
+    REQUIRE_RC ( RateLimitMake ( & rate, 1024 * 1024 ) );
+    Taker t = { rate, 8, 32 * 1024 };
+
+    KTimeMs_t start = KTimeMsStamp ();
+    KThread * th [ 4 ];
+    for ( int i = 0; i < 4; ++ i )
+        REQUIRE_RC ( KThreadMake ( & th [ i ], Take, & t ) );
+    for ( int i = 0; i < 4; ++ i )
+    {
+        rc_t rc = 0;
+        REQUIRE_RC ( KThreadWait ( th [ i ], & rc ) );
+        REQUIRE_RC ( rc );
+        REQUIRE_RC ( KThreadRelease ( th [ i ] ) );
+    }
+    KTimeMs_t elapsed = KTimeMsStamp () - start;
+
+    REQUIRE ( elapsed >= 900 );
+    REQUIRE ( elapsed < 3000 );
+    REQUIRE_RC ( RateLimitRelease ( rate ) );
+}
+
+TEST_CASE ( RateLimit_SmallReads )
+{   /* 3 bytes at 10000 bytes/s are less than a millisecond each */
+    RateLimit * rate;
+    REQUIRE_RC ( RateLimitMake ( & rate, 10000 ) );
+    Taker t = { rate, 2000, 3 };
+
+    KTimeMs_t start = KTimeMsStamp ();
+    REQUIRE_RC ( Take ( NULL, & t ) );
+    KTimeMs_t elapsed = KTimeMsStamp () - start;
+
+    REQUIRE ( elapsed >= 550 );
+    REQUIRE_RC ( RateLimitRelease ( rate ) );
+}
+
+TEST_CASE ( RateLimit_None )
+{
+    REQUIRE_RC ( RateLimitTake ( NULL, 1024 * 1024 * 1024 ) );
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-prefetch";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=PrefetchTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -0,0 +1,67 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* compiled into the tests, together with prefetch.c into test-prefetch */
+#include "../../tools/prefetch/download-ranges.c"
+
+#include "wb-download-ranges.h"
+
+rc_t WbDownloadRangesPartial(KDirectory *dir, KNSManager *kns,
+    const char *url, uint64_t size, const char *to,
+    uint32_t first, uint32_t count)
+{
+    rc_t rc = 0;
+    rc_t rc2 = 0;
+    uint32_t i = 0;
+    Ranges self;
+
+    rc = RangesInit(&self, dir, kns, url, size, to, NULL);
+    if (rc == 0) {
+        /* the others are left alone */
+        uint8_t *status = malloc(self.count);
+        if (status == NULL) {
+            rc = RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+        }
+        else {
+            memmove(status, self.status, self.count);
+            for (i = 0; i < self.count; ++i) {
+                if (i < first || i >= first + count) {
+                    self.status[i] = eRangeDone;
+                }
+            }
+            rc = RangesRun(&self, 2);
+            for (i = 0; i < self.count; ++i) {
+                if (i < first || i >= first + count) {
+                    self.status[i] = status[i];
+                }
+            }
+            free(status);
+        }
+    }
+
+    rc2 = RangesFini(&self);
+    return rc != 0 ? rc : rc2;
+}
@@ -0,0 +1,52 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_test_prefetch_wb_download_ranges_
+#define _h_test_prefetch_wb_download_ranges_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct KDirectory;
+struct KNSManager;
+
+/* white box access to DownloadRanges: an interrupted download, it fetches
+   ranges first .. first + count - 1 only and keeps "<to>.ranges" the way an
+   interrupted download leaves it: nothing is read back */
+rc_t WbDownloadRangesPartial ( struct KDirectory *dir, struct KNSManager *kns,
+    const char *url, uint64_t size, const char *to,
+    uint32_t first, uint32_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_test_prefetch_wb_download_ranges_ */
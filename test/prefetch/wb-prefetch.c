@@ -0,0 +1,247 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* the tool is compiled into the test, its entry points are renamed
+   to leave room for the ones of the test */
+#define KMain PrefetchKMain
+#define KAppVersion PrefetchKAppVersion
+#define Usage PrefetchUsage
+#define UsageSummary PrefetchUsageSummary
+#define UsageDefaultName PrefetchUsageDefaultName
+
+#include "../../tools/prefetch/prefetch.c"
+
+#include "wb-prefetch.h"
+
+#include <klib/time.h> /* KSleepMs */
+
+#define WB_MAX_REFSEQS 64
+
+struct WbMain {
+    Main main;
+
+    /* of the jobs run now */
+    uint32_t nested;
+    uint32_t fail;
+    uint32_t refseqs;
+    bool failFirst;
+
+    uint32_t done;
+    uint32_t running;
+    uint32_t maxRunning;
+    uint32_t downloads[WB_MAX_REFSEQS];
+};
+
+/* process functions of Jobs do not get any context */
+static WbMain *g_wb = NULL;
+
+rc_t WbMainMake(WbMain **self, uint32_t jobs) {
+    rc_t rc = 0;
+    WbMain *p = NULL;
+
+    assert(self);
+
+    p = calloc(1, sizeof *p);
+    if (p == NULL) {
+        return RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    p->main.jobs = jobs;
+    p->main.busy = 1; /* the main thread */
+    BSTreeInit(&p->main.downloaded);
+    BSTreeInit(&p->main.refseqs);
+
+    rc = KLockMake(&p->main.lock);
+    if (rc == 0) {
+        rc = KConditionMake(&p->main.refseqDone);
+    }
+
+    if (rc == 0) {
+        *self = p;
+    }
+    else {
+        WbMainWhack(p);
+    }
+
+    return rc;
+}
+
+void WbMainWhack(WbMain *self) {
+    if (self != NULL) {
+        BSTreeWhack(&self->main.refseqs, bstWhack, NULL);
+        BSTreeWhack(&self->main.downloaded, bstWhack, NULL);
+        KConditionRelease(self->main.refseqDone);
+        KLockRelease(self->main.lock);
+        free(self);
+    }
+}
+
+rc_t WbClaimRefseq(WbMain *self, const char *seq_id, bool wait,
+    bool *claimed, bool *pending)
+{
+    assert(self);
+    return MainClaimRefseq(&self->main, seq_id, wait, claimed, pending);
+}
+
+void WbRefseqDone(WbMain *self, const char *seq_id, bool ok) {
+    assert(self);
+    MainRefseqDone(&self->main, seq_id, ok);
+}
+
+uint32_t WbBusy(const WbMain *self) {
+    assert(self);
+    return self->main.busy;
+}
+
+static rc_t WbRun(WbMain *self, uint32_t count,
+    rc_t (*process)(Item *item, int32_t row), bool stopOnError)
+{
+    rc_t rc = 0;
+    uint32_t i = 0;
+    Jobs jobs;
+    Job *job = calloc(count, sizeof *job);
+    if (job == NULL) {
+        return RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    for (i = 0; i < count; ++i) {
+        job[i].row = i;
+    }
+
+    JobsInit(&jobs, &self->main, job, count, process, stopOnError);
+    rc = JobsRun(&jobs);
+
+    free(job);
+    return rc;
+}
+
+static rc_t WbLeafProcess(Item *item, int32_t row) {
+    WbMain *self = g_wb;
+
+    if (KLockAcquire(self->main.lock) == 0) {
+        ++self->done;
+        if (++self->running > self->maxRunning) {
+            self->maxRunning = self->running;
+        }
+        KLockUnlock(self->main.lock);
+    }
+
+    KSleepMs(2);
+
+    if (KLockAcquire(self->main.lock) == 0) {
+        --self->running;
+        KLockUnlock(self->main.lock);
+    }
+
+    return 0;
+}
+
+static rc_t WbItemProcess(Item *item, int32_t row) {
+    WbMain *self = g_wb;
+    rc_t rc = 0;
+
+    if ((uint32_t)row == self->fail) {
+        return RC(rcExe, rcFile, rcCopying, rcTransfer, rcIncomplete);
+    }
+
+    if (self->nested == 0) {
+        rc = WbLeafProcess(item, row);
+    }
+    else {
+        rc = WbRun(self, self->nested, WbLeafProcess, false);
+    }
+
+    return rc;
+}
+
+rc_t WbRunJobs(WbMain *self, uint32_t count, uint32_t nested, uint32_t fail,
+    bool stopOnError, uint32_t *done, uint32_t *maxRunning)
+{
+    rc_t rc = 0;
+
+    assert(self && done && maxRunning);
+
+    g_wb = self;
+    self->nested = nested;
+    self->fail = fail;
+    self->done = self->running = self->maxRunning = 0;
+
+    rc = WbRun(self, count, WbItemProcess, stopOnError);
+
+    *done = self->done;
+    *maxRunning = self->maxRunning;
+    g_wb = NULL;
+
+    return rc;
+}
+
+static rc_t WbRefseqProcess(Item *item, int32_t row) {
+    WbMain *self = g_wb;
+    rc_t rc = 0;
+    uint32_t r = row % self->refseqs;
+    char seq_id[32] = "";
+    bool claimed = false;
+    bool pending = false;
+
+    rc = string_printf(seq_id, sizeof seq_id, NULL, "NC_%06u", r);
+    if (rc == 0) {
+        rc = MainClaimRefseq(&self->main, seq_id, true, &claimed, &pending);
+    }
+
+    if (rc == 0 && claimed) {
+        uint32_t n = 0;
+        if (KLockAcquire(self->main.lock) == 0) {
+            n = ++self->downloads[r];
+            KLockUnlock(self->main.lock);
+        }
+
+        KSleepMs(5);
+
+        MainRefseqDone(&self->main, seq_id, !(self->failFirst && n == 1));
+    }
+
+    return rc;
+}
+
+rc_t WbRunRefseqJobs(WbMain *self, uint32_t count, uint32_t refseqs,
+    bool failFirst, uint32_t *downloads)
+{
+    rc_t rc = 0;
+
+    assert(self && downloads && refseqs > 0 && refseqs <= WB_MAX_REFSEQS);
+
+    g_wb = self;
+    self->refseqs = refseqs;
+    self->failFirst = failFirst;
+    memset(self->downloads, 0, sizeof self->downloads);
+
+    rc = WbRun(self, count, WbRefseqProcess, false);
+
+    memmove(downloads, self->downloads, refseqs * sizeof *downloads);
+    g_wb = NULL;
+
+    return rc;
+}
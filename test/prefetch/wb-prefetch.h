@@ -0,0 +1,70 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_test_prefetch_wb_prefetch_
+#define _h_test_prefetch_wb_prefetch_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* white box access to the job scheduler of prefetch */
+typedef struct WbMain WbMain;
+
+/* a Main object with only what the scheduler needs: up to "jobs" threads */
+rc_t WbMainMake ( WbMain **self, uint32_t jobs );
+void WbMainWhack ( WbMain *self );
+
+/* MainClaimRefseq, MainRefseqDone */
+rc_t WbClaimRefseq ( WbMain *self, const char *seq_id, bool wait,
+    bool *claimed, bool *pending );
+void WbRefseqDone ( WbMain *self, const char *seq_id, bool ok );
+
+/* runs "count" jobs through JobsRun; every job runs "nested" jobs of its own
+   the way items run their dependencies. job number "fail" fails, none when
+   it is not below "count". "done" is the number of leaf jobs processed,
+   "maxRunning" the most leaf jobs seen running at once */
+rc_t WbRunJobs ( WbMain *self, uint32_t count, uint32_t nested, uint32_t fail,
+    bool stopOnError, uint32_t *done, uint32_t *maxRunning );
+
+/* runs "count" jobs, job "row" depends on refseq row % "refseqs" and downloads
+   it when it gets to claim it. when "failFirst" is set the first download of
+   every refseq fails. "downloads" receives number of downloads of every refseq */
+rc_t WbRunRefseqJobs ( WbMain *self, uint32_t count, uint32_t refseqs,
+    bool failFirst, uint32_t *downloads );
+
+/* the number of threads downloading now, the main thread included */
+uint32_t WbBusy ( const WbMain *self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_test_prefetch_wb_prefetch_ */
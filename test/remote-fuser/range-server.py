@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+# ===========================================================================
+#
+#                            PUBLIC DOMAIN NOTICE
+#               National Center for Biotechnology Information
+#
+#  This software/database is a "United States Government Work" under the
+#  terms of the United States Copyright Act.  It was written as part of
+#  the author's official duties as a United States Government employee and
+#  thus cannot be copyrighted.  This software/database is freely available
+#  to the public for use. The National Library of Medicine and the U.S.
+#  Government have not placed any restriction on its use or reproduction.
+#
+#  Although all reasonable efforts have been taken to ensure the accuracy
+#  and reliability of the software and data, the NLM and the U.S.
+#  Government do not and cannot warrant the performance or results that
+#  may be obtained by using this software or data. The NLM and the U.S.
+#  Government disclaim all warranties, express or implied, including
+#  warranties of performance, merchantability or fitness for any particular
+#  purpose.
+#
+#  Please cite the author in any work or product based on this material.
+#
+# ===========================================================================
+"""Local stand-in of a remote HTTP server for the tests.
+
+Usage: range-server.py <root directory> <port file> [ <request log> ]
+
+Serves files of the root directory on a free port of localhost, and
+writes that port to the port file once it is listening. HEAD and GET
+are answered with ETag and Last-Modified of the file, GET honors a
+single "Range: bytes=first-last" header. Every GET is appended to the
+request log as "<path> <first> <last>".
+"""
+
+import email.utils
+import http.server
+import os
+import re
+import sys
+import threading
+
+ROOT = None
+LOG = None
+LOG_LOCK = threading.Lock()
+
+
+class RangeHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        pass
+
+    def _file(self):
+        path = os.path.join(ROOT, self.path.split("?")[0].lstrip("/"))
+        if not os.path.isfile(path):
+            self.send_response(404)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return None, None
+        return path, os.stat(path)
+
+    def _headers(self, st):
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("ETag", '"%x-%x"' % (st.st_mtime_ns, st.st_size))
+        self.send_header("Last-Modified",
+                         email.utils.formatdate(st.st_mtime, usegmt=True))
+
+    def do_HEAD(self):
+        path, st = self._file()
+        if path is None:
+            return
+        self.send_response(200)
+        self._headers(st)
+        self.send_header("Content-Length", str(st.st_size))
+        self.end_headers()
+
+    def do_GET(self):
+        path, st = self._file()
+        if path is None:
+            return
+        size = st.st_size
+        first, last = 0, size - 1
+        status = 200
+        m = re.match(r"bytes=(\d*)-(\d*)$", self.headers.get("Range", ""))
+        if m and (m.group(1) or m.group(2)):
+            if m.group(1):
+                first = int(m.group(1))
+                if m.group(2):
+                    last = min(int(m.group(2)), size - 1)
+            else:
+                first = max(size - int(m.group(2)), 0)
+            if first >= size or first > last:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % size)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            status = 206
+
+        if LOG is not None:
+            with LOG_LOCK:
+                with open(LOG, "a") as log:
+                    log.write("%s %d %d\n" % (self.path, first, last))
+
+        self.send_response(status)
+        self._headers(st)
+        if status == 206:
+            self.send_header("Content-Range",
+                             "bytes %d-%d/%d" % (first, last, size))
+        self.send_header("Content-Length", str(last - first + 1))
+        self.end_headers()
+        with open(path, "rb") as f:
+            f.seek(first)
+            self.wfile.write(f.read(last - first + 1))
+
+
+def main():
+    global ROOT, LOG
+    if len(sys.argv) < 3:
+        sys.stderr.write(__doc__)
+        return 1
+    ROOT = sys.argv[1]
+    if len(sys.argv) > 3:
+        LOG = sys.argv[3]
+
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), RangeHandler)
+    server.daemon_threads = True
+    with open(sys.argv[2] + ".tmp", "w") as f:
+        f.write("%d\n" % server.server_address[1])
+    os.rename(sys.argv[2] + ".tmp", sys.argv[2])
+    server.serve_forever()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,395 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the block cache and read-ahead of remote-fuser, remote
+* files are served by range-server.py
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <klib/text.h>
+#include <klib/time.h>
+
+#include <sysalloc.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "wb-remote-cache.h"
+
+extern "C" {
+#include "../../tools/fuse/remote-cache.h"
+#include "../../tools/fuse/read-ahead.h"
+}
+
+using namespace std;
+
+TEST_SUITE(RemoteCacheTestSuite);
+
+static string g_dir; /* served by range server */
+static string g_url;
+
+/* 40 full blocks and a short one, bitmap takes 2 words */
+static const uint32_t BLOCK_SIZE = 4096;
+static const uint64_t BLOCK_QTY = 41;
+static const uint64_t FILE_SIZE = BLOCK_SIZE * ( BLOCK_QTY - 1 ) + 123;
+static const uint64_t BITMAP_SIZE = 2 * sizeof ( uint32_t );
+static const uint64_t TAIL_SIZE = sizeof ( uint64_t ) + sizeof ( uint32_t );
+
+class RemoteCacheFixture
+{
+public:
+    RemoteCacheFixture() : m_entry ( 0 )
+    {
+    }
+    ~RemoteCacheFixture()
+    {
+        if ( m_entry != 0 )
+            RCacheEntryRelease ( m_entry );
+        RemoteCacheDispose ();
+    }
+
+    /* remote file of that name, every block has other content */
+    void Open ( const char * name )
+    {
+        m_data . resize ( FILE_SIZE );
+        for ( uint64_t i = 0; i < FILE_SIZE; ++ i )
+            m_data [ i ] = ( char ) ( ( i * 131 + i / BLOCK_SIZE ) % 251 );
+        WriteFile ( g_dir + name, 0, & m_data [ 0 ], FILE_SIZE );
+
+        RemoteCacheSetHttpBlockSize ( BLOCK_SIZE );
+        string cache = g_dir + "../cache-" + name;
+        if ( RemoteCacheInitialize ( cache . c_str () ) != 0
+            || RemoteCacheCreate () != 0
+            || RemoteCacheFindOrCreateEntry ( ( g_url + name ) . c_str (), & m_entry ) != 0 )
+            throw logic_error ( "RemoteCacheFixture::Open failed" );
+
+        char path [ 4096 ];
+        if ( WbEntryPath ( m_entry, path, sizeof path ) != 0 )
+            throw logic_error ( "RemoteCacheFixture::Open WbEntryPath failed" );
+        m_path = path;
+        m_store = m_path + ".cache";
+    }
+
+    static void WriteFile ( const string & path, uint64_t offset, const void * data, size_t size )
+    {
+        FILE * f = fopen ( path . c_str (), offset == 0 ? "wb" : "r+b" );
+        if ( f == 0
+            || fseek ( f, ( long ) offset, SEEK_SET ) != 0
+            || fwrite ( data, 1, size, f ) != size
+            || fclose ( f ) != 0 )
+            throw logic_error ( "RemoteCacheFixture::WriteFile failed: " + path );
+    }
+
+    /* Store the way it is left by a session which fetched "blocks" */
+    void WriteStore ( const vector < uint64_t > & blocks, uint32_t blockSize )
+    {
+        vector < char > store ( FILE_SIZE + BITMAP_SIZE + TAIL_SIZE, 0 );
+        uint32_t bitmap [ 2 ] = { 0, 0 };
+        for ( size_t i = 0; i < blocks . size (); ++ i )
+        {
+            uint64_t b = blocks [ i ];
+            uint64_t size = b == BLOCK_QTY - 1 ? FILE_SIZE - b * BLOCK_SIZE : BLOCK_SIZE;
+            memmove ( & store [ b * BLOCK_SIZE ], & m_data [ b * BLOCK_SIZE ], size );
+            bitmap [ b >> 5 ] |= 1U << ( b & 31 );
+        }
+        memmove ( & store [ FILE_SIZE ], bitmap, BITMAP_SIZE );
+        memmove ( & store [ FILE_SIZE + BITMAP_SIZE ], & FILE_SIZE, sizeof FILE_SIZE );
+        memmove ( & store [ FILE_SIZE + BITMAP_SIZE + sizeof FILE_SIZE ], & blockSize, sizeof blockSize );
+        WriteFile ( m_store, 0, & store [ 0 ], store . size () );
+    }
+
+    vector < char > ReadFile ( const string & path )
+    {
+        vector < char > content;
+        FILE * f = fopen ( path . c_str (), "rb" );
+        if ( f != 0 )
+        {
+            char buf [ 4096 ];
+            size_t num;
+            while ( ( num = fread ( buf, 1, sizeof buf, f ) ) != 0 )
+                content . insert ( content . end (), buf, buf + num );
+            fclose ( f );
+        }
+        return content;
+    }
+
+    static bool Exists ( const string & path )
+    {
+        struct stat st;
+        return stat ( path . c_str (), & st ) == 0;
+    }
+
+    /* reads one block through the cache, true if it has the right content */
+    bool ReadBlock ( uint64_t block )
+    {
+        char buf [ BLOCK_SIZE ];
+        size_t num = 0;
+        uint64_t offset = block * BLOCK_SIZE;
+        uint64_t size = block == BLOCK_QTY - 1 ? FILE_SIZE - offset : BLOCK_SIZE;
+        if ( RCacheEntryRead ( m_entry, buf, sizeof buf, offset, & num ) != 0 )
+            return false;
+        return num == size && memcmp ( buf, & m_data [ offset ], num ) == 0;
+    }
+
+    static RCacheStats Stats ()
+    {
+        RCacheStats stats;
+        RemoteCacheGetStats ( & stats );
+        return stats;
+    }
+
+    struct RCacheEntry * m_entry;
+    vector < char > m_data;
+    string m_path;
+    string m_store;
+};
+
+FIXTURE_TEST_CASE ( RemoteCache_FetchAll, RemoteCacheFixture )
+{
+    Open ( "fetch-all" );
+    RCacheStats before = Stats ();
+
+    vector < char > read;
+    char buf [ 10000 ];
+    size_t num = 0;
+    do
+    {
+        REQUIRE_RC ( RCacheEntryRead ( m_entry, buf, sizeof buf, read . size (), & num ) );
+        read . insert ( read . end (), buf, buf + num );
+    }
+    while ( num != 0 );
+
+    REQUIRE ( read == m_data );
+    REQUIRE_EQ ( Stats () . Misses - before . Misses, BLOCK_QTY );
+
+    /* completed cache file is the remote file, without block map */
+    REQUIRE ( ! Exists ( m_store ) );
+    REQUIRE ( ReadFile ( m_path ) == m_data );
+}
+
+FIXTURE_TEST_CASE ( RemoteCache_BitmapIsWritten, RemoteCacheFixture )
+{
+    Open ( "bitmap" );
+
+    REQUIRE ( ReadBlock ( 0 ) );
+    REQUIRE ( ReadBlock ( 5 ) );
+    REQUIRE ( ReadBlock ( 33 ) );
+
+    vector < char > store = ReadFile ( m_store );
+    REQUIRE_EQ ( ( uint64_t ) store . size (), FILE_SIZE + BITMAP_SIZE + TAIL_SIZE );
+
+    uint32_t bitmap [ 2 ];
+    uint64_t fileSize;
+    uint32_t blockSize;
+    memmove ( bitmap, & store [ FILE_SIZE ], BITMAP_SIZE );
+    memmove ( & fileSize, & store [ FILE_SIZE + BITMAP_SIZE ], sizeof fileSize );
+    memmove ( & blockSize, & store [ FILE_SIZE + BITMAP_SIZE + sizeof fileSize ], sizeof blockSize );
+    REQUIRE_EQ ( bitmap [ 0 ], ( uint32_t ) ( 1U | 1U << 5 ) );
+    REQUIRE_EQ ( bitmap [ 1 ], ( uint32_t ) ( 1U << 1 ) );
+    REQUIRE_EQ ( fileSize, FILE_SIZE );
+    REQUIRE_EQ ( blockSize, BLOCK_SIZE );
+
+    REQUIRE ( memcmp ( & store [ 5 * BLOCK_SIZE ], & m_data [ 5 * BLOCK_SIZE ], BLOCK_SIZE ) == 0 );
+}
+
+FIXTURE_TEST_CASE ( RemoteCache_Resume, RemoteCacheFixture )
+{
+    Open ( "resume" );
+
+    vector < uint64_t > blocks;
+    blocks . push_back ( 1 );
+    blocks . push_back ( 2 );
+    blocks . push_back ( BLOCK_QTY - 1 );
+    WriteStore ( blocks, BLOCK_SIZE );
+
+    RCacheStats before = Stats ();
+    REQUIRE ( ReadBlock ( 1 ) );
+    REQUIRE ( ReadBlock ( 2 ) );
+    REQUIRE ( ReadBlock ( BLOCK_QTY - 1 ) );
+    REQUIRE_EQ ( Stats () . Hits - before . Hits, ( uint64_t ) 3 );
+    REQUIRE_EQ ( Stats () . Misses - before . Misses, ( uint64_t ) 0 );
+
+    REQUIRE ( ReadBlock ( 3 ) );
+    REQUIRE_EQ ( Stats () . Misses - before . Misses, ( uint64_t ) 1 );
+}
+
+FIXTURE_TEST_CASE ( RemoteCache_ResumeOtherBlockSize, RemoteCacheFixture )
+{   /* Store of other block size is started from scratch */
+    Open ( "stale" );
+
+    vector < uint64_t > blocks;
+    blocks . push_back ( 1 );
+    WriteStore ( blocks, BLOCK_SIZE * 2 );
+
+    RCacheStats before = Stats ();
+    REQUIRE ( ReadBlock ( 1 ) );
+    REQUIRE_EQ ( Stats () . Hits - before . Hits, ( uint64_t ) 0 );
+    REQUIRE_EQ ( Stats () . Misses - before . Misses, ( uint64_t ) 1 );
+}
+
+FIXTURE_TEST_CASE ( RemoteCache_Prefetch, RemoteCacheFixture )
+{
+    Open ( "prefetch" );
+    REQUIRE ( ReadBlock ( 0 ) );
+
+    RCacheStats before = Stats ();
+    REQUIRE_RC ( RCacheEntryPrefetch ( m_entry, BLOCK_SIZE, 4 * BLOCK_SIZE ) );
+    for ( int i = 0; i < 1000 && Stats () . Prefetched - before . Prefetched < 4; ++ i )
+        KSleepMs ( 10 );
+    REQUIRE_EQ ( Stats () . Prefetched - before . Prefetched, ( uint64_t ) 4 );
+
+    for ( uint64_t b = 1; b <= 4; ++ b )
+        REQUIRE ( ReadBlock ( b ) );
+    REQUIRE_EQ ( Stats () . PrefetchHits - before . PrefetchHits, ( uint64_t ) 4 );
+    REQUIRE_EQ ( Stats () . Misses - before . Misses, ( uint64_t ) 0 );
+}
+
+///////////////////////////////////////////// ReadAhead
+
+static const uint64_t BIG = ( uint64_t ) 1 << 40;
+
+TEST_CASE ( ReadAhead_Sequential )
+{   /* window starts small and doubles on every sequential read */
+    ReadAhead ra;
+    memset ( & ra, 0, sizeof ra );
+    uint64_t from, to;
+
+    REQUIRE ( ReadAhead_Update ( & ra, 0, 4096, BIG, & from, & to ) );
+    REQUIRE_EQ ( from, ( uint64_t ) 4096 );
+    REQUIRE_EQ ( to, ( uint64_t ) 4096 + REMOTE_READ_AHEAD_MIN );
+
+    /* what was requested already is not requested again */
+    REQUIRE ( ReadAhead_Update ( & ra, 4096, 4096, BIG, & from, & to ) );
+    REQUIRE_EQ ( from, ( uint64_t ) 4096 + REMOTE_READ_AHEAD_MIN );
+    REQUIRE_EQ ( to, ( uint64_t ) 8192 + 2 * REMOTE_READ_AHEAD_MIN );
+}
+
+TEST_CASE ( ReadAhead_WindowIsLimited )
+{
+    ReadAhead ra;
+    memset ( & ra, 0, sizeof ra );
+    uint64_t from, to, offset = 0;
+
+    for ( int i = 0; i < 20; ++ i, offset += 4096 )
+        ReadAhead_Update ( & ra, offset, 4096, BIG, & from, & to );
+    REQUIRE_EQ ( ra . window, ( uint64_t ) REMOTE_READ_AHEAD_MAX );
+    REQUIRE_EQ ( ra . ahead, offset + REMOTE_READ_AHEAD_MAX );
+}
+
+TEST_CASE ( ReadAhead_Random )
+{   /* a jump drops the window, next sequential read starts it again */
+    ReadAhead ra;
+    memset ( & ra, 0, sizeof ra );
+    uint64_t from, to;
+
+    REQUIRE ( ReadAhead_Update ( & ra, 0, 4096, BIG, & from, & to ) );
+    REQUIRE ( ! ReadAhead_Update ( & ra, 1000000000, 4096, BIG, & from, & to ) );
+    REQUIRE_EQ ( ra . window, ( uint64_t ) 0 );
+    REQUIRE ( ! ReadAhead_Update ( & ra, 5000, 4096, BIG, & from, & to ) );
+
+    REQUIRE ( ReadAhead_Update ( & ra, 9096, 4096, BIG, & from, & to ) );
+    REQUIRE_EQ ( from, ( uint64_t ) 13192 );
+    REQUIRE_EQ ( to, ( uint64_t ) 13192 + REMOTE_READ_AHEAD_MIN );
+}
+
+TEST_CASE ( ReadAhead_NearlySequential )
+{   /* reads out of order inside the window keep it as it is */
+    ReadAhead ra;
+    memset ( & ra, 0, sizeof ra );
+    uint64_t from, to;
+
+    REQUIRE ( ReadAhead_Update ( & ra, 0, 4096, BIG, & from, & to ) );
+    REQUIRE ( ReadAhead_Update ( & ra, 4096, 4096, BIG, & from, & to ) );
+    uint64_t window = ra . window;
+
+    REQUIRE ( ReadAhead_Update ( & ra, 16384, 4096, BIG, & from, & to ) );
+    REQUIRE_EQ ( ra . window, window );
+    REQUIRE_EQ ( to, ( uint64_t ) 20480 + window );
+    REQUIRE ( ! ReadAhead_Update ( & ra, 12288, 4096, BIG, & from, & to ) );
+    REQUIRE_EQ ( ra . window, window );
+}
+
+TEST_CASE ( ReadAhead_EndOfFile )
+{   /* nothing is requested past the end of file */
+    ReadAhead ra;
+    memset ( & ra, 0, sizeof ra );
+    uint64_t from, to;
+
+    REQUIRE ( ReadAhead_Update ( & ra, 0, 4096, 10000, & from, & to ) );
+    REQUIRE_EQ ( from, ( uint64_t ) 4096 );
+    REQUIRE_EQ ( to, ( uint64_t ) 10000 );
+    REQUIRE ( ! ReadAhead_Update ( & ra, 4096, 4096, 10000, & from, & to ) );
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-remote-cache";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    const char * dir = getenv ( "RANGE_SERVER_DIR" );
+    const char * url = getenv ( "RANGE_SERVER_URL" );
+    if ( dir == NULL || url == NULL )
+    {
+        fprintf ( stderr, "run under with-range-server.sh\n" );
+        return 1;
+    }
+    g_dir = string ( dir ) + "/";
+    g_url = url;
+
+    KConfigDisableUserSettings();
+    rc_t rc=RemoteCacheTestSuite(argc, argv);
+    return rc;
+}
+
+}
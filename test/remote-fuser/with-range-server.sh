@@ -0,0 +1,73 @@
+#!/bin/bash
+# ===========================================================================
+#
+#                            PUBLIC DOMAIN NOTICE
+#               National Center for Biotechnology Information
+#
+#  This software/database is a "United States Government Work" under the
+#  terms of the United States Copyright Act.  It was written as part of
+#  the author's official duties as a United States Government employee and
+#  thus cannot be copyrighted.  This software/database is freely available
+#  to the public for use. The National Library of Medicine and the U.S.
+#  Government have not placed any restriction on its use or reproduction.
+#
+#  Although all reasonable efforts have been taken to ensure the accuracy
+#  and reliability of the software and data, the NLM and the U.S.
+#  Government do not and cannot warrant the performance or results that
+#  may be obtained by using this software or data. The NLM and the U.S.
+#  Government disclaim all warranties, express or implied, including
+#  warranties of performance, merchantability or fitness for any particular
+#  purpose.
+#
+#  Please cite the author in any work or product based on this material.
+#
+# ===========================================================================
+
+# $1 - work directory, files under $1/www are served
+# $2, $3, ... - command to run while the server is up
+#
+# The command gets RANGE_SERVER_DIR (served directory), RANGE_SERVER_URL
+# (URL of that directory, ends with '/') and RANGE_SERVER_LOG (requests
+# served so far) in its environment.
+#
+# The server needs python3; without it the command is skipped.
+#
+# return codes:
+# 1 - server did not start
+# otherwise - return code of the command
+
+WORKDIR=$1
+shift 1
+
+if ! command -v python3 >/dev/null 2>&1 ; then
+    echo "python3 not found, skipping $*"
+    exit 0
+fi
+
+mkdir -p $WORKDIR/www
+rm -f $WORKDIR/port $WORKDIR/requests
+
+python3 $(dirname $0)/range-server.py $WORKDIR/www $WORKDIR/port $WORKDIR/requests &
+SERVER=$!
+
+for i in $(seq 50) ; do
+    [ -f $WORKDIR/port ] && break
+    sleep 0.1
+done
+if [ ! -f $WORKDIR/port ] ; then
+    kill $SERVER 2>/dev/null
+    echo "range server did not start"
+    exit 1
+fi
+
+export RANGE_SERVER_DIR=$WORKDIR/www
+export RANGE_SERVER_URL=http://127.0.0.1:$(cat $WORKDIR/port)/
+export RANGE_SERVER_LOG=$WORKDIR/requests
+
+"$@"
+RC=$?
+
+kill $SERVER
+wait $SERVER 2>/dev/null
+
+exit $RC
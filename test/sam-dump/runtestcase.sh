@@ -0,0 +1,135 @@
+#!/bin/bash
+# ===========================================================================
+#
+#                            PUBLIC DOMAIN NOTICE
+#               National Center for Biotechnology Information
+#
+#  This software/database is a "United States Government Work" under the
+#  terms of the United States Copyright Act.  It was written as part of
+#  the author's official duties as a United States Government employee and
+#  thus cannot be copyrighted.  This software/database is freely available
+#  to the public for use. The National Library of Medicine and the U.S.
+#  Government have not placed any restriction on its use or reproduction.
+#
+#  Although all reasonable efforts have been taken to ensure the accuracy
+#  and reliability of the software and data, the NLM and the U.S.
+#  Government do not and cannot warrant the performance or results that
+#  may be obtained by using this software or data. The NLM and the U.S.
+#  Government disclaim all warranties, express or implied, including
+#  warranties of performance, merchantability or fitness for any particular
+#  purpose.
+#
+#  Please cite the author in any work or product based on this material.
+#
+# ===========================================================================
+#echo "$0 $*"
+
+# $1 - path to sra tools (sam-dump)
+# $2 - work directory (actual results and temporaries created under actual/)
+# $3 - test case ID
+# $4 - run to dump
+# $5 - expected return code of sam-dump --bam
+# $6 - region to query through the BAI-index
+# $7, $8, ... - other command line options for sam-dump
+#
+# return codes:
+# 0 - passed
+# 1 - could not create temp dir
+# 2 - sam-dump (SAM-text) failed
+# 3 - sam-dump --bam returned an unexpected code
+# 4 - samtools failed (checks needing samtools are skipped if it is not installed)
+# 5 - header or records of the BAM differ from the SAM-text
+# 6 - idxstats does not count every record
+# 7 - region query through our index differs from samtools' index
+
+BINDIR=$1
+WORKDIR=$2
+CASEID=$3
+RUN=$4
+EXPECTED=$5
+REGION=$6
+shift 6
+CMDLINE=$*
+
+DUMP="$BINDIR/sam-dump"
+TEMPDIR=$WORKDIR/actual/$CASEID
+
+printf "running $CASEID: "
+
+mkdir -p $TEMPDIR
+rm -rf $TEMPDIR/*
+if [ "$?" != "0" ] ; then
+    exit 1
+fi
+
+CMD="$DUMP $CMDLINE --bam --bam-index --output-file $TEMPDIR/out.bam $RUN 1>$TEMPDIR/bam.stdout 2>$TEMPDIR/bam.stderr"
+printf "bam... "
+eval "$CMD"
+RC=$?
+if [ "$EXPECTED" == "0" ] && [ "$RC" != "0" ] || [ "$EXPECTED" != "0" ] && [ "$RC" == "0" ] ; then
+    echo "sam-dump returned $RC, expected $EXPECTED. Command executed:"
+    echo $CMD
+    cat $TEMPDIR/bam.stderr
+    exit 3
+fi
+if [ "$EXPECTED" != "0" ] ; then
+    printf "failed as expected\n"
+    rm -rf $TEMPDIR
+    exit 0
+fi
+
+CMD="$DUMP $CMDLINE $RUN 1>$TEMPDIR/text.sam 2>$TEMPDIR/text.stderr"
+printf "text... "
+eval "$CMD"
+if [ "$?" != "0" ] ; then
+    echo "sam-dump failed. Command executed:"
+    echo $CMD
+    cat $TEMPDIR/text.stderr
+    exit 2
+fi
+
+if ! command -v samtools >/dev/null 2>&1 ; then
+    printf "samtools not found, skipping view, idxstats and region\n"
+    rm -rf $TEMPDIR
+    exit 0
+fi
+
+printf "view... "
+grep '^@' $TEMPDIR/text.sam >$TEMPDIR/text.header
+grep -v '^@' $TEMPDIR/text.sam >$TEMPDIR/text.records
+samtools view -H $TEMPDIR/out.bam >$TEMPDIR/bam.header || exit 4
+samtools view $TEMPDIR/out.bam >$TEMPDIR/bam.records || exit 4
+for PART in header records ; do
+    diff $TEMPDIR/text.$PART $TEMPDIR/bam.$PART >$TEMPDIR/diff
+    if [ "$?" != "0" ] ; then
+        head $TEMPDIR/diff
+        echo "$PART of the BAM differ from the SAM-text, command executed:"
+        echo $CMD
+        exit 5
+    fi
+done
+
+printf "idxstats... "
+MAPPED=$(samtools idxstats $TEMPDIR/out.bam | awk '{ n += $3 } END { print n }')
+COUNT=$(samtools view -c -F 4 $TEMPDIR/out.bam)
+if [ -z "$COUNT" ] || [ "$MAPPED" != "$COUNT" ] ; then
+    echo "idxstats counts '$MAPPED' mapped records instead of '$COUNT'"
+    exit 6
+fi
+
+printf "region... "
+cp $TEMPDIR/out.bam $TEMPDIR/ref.bam
+samtools index $TEMPDIR/ref.bam || exit 4
+samtools view $TEMPDIR/out.bam $REGION >$TEMPDIR/out.region || exit 4
+samtools view $TEMPDIR/ref.bam $REGION >$TEMPDIR/ref.region || exit 4
+diff $TEMPDIR/ref.region $TEMPDIR/out.region >$TEMPDIR/diff
+if [ "$?" != "0" ] || [ ! -s $TEMPDIR/out.region ] ; then
+    head $TEMPDIR/diff
+    echo "query of $REGION through the written index differs from samtools' index"
+    exit 7
+fi
+
+printf "done\n"
+rm -rf $TEMPDIR
+
+exit 0
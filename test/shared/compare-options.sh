@@ -0,0 +1,110 @@
+#!/bin/bash
+# ===========================================================================
+#
+#                            PUBLIC DOMAIN NOTICE
+#               National Center for Biotechnology Information
+#
+#  This software/database is a "United States Government Work" under the
+#  terms of the United States Copyright Act.  It was written as part of
+#  the author's official duties as a United States Government employee and
+#  thus cannot be copyrighted.  This software/database is freely available
+#  to the public for use. The National Library of Medicine and the U.S.
+#  Government have not placed any restriction on its use or reproduction.
+#
+#  Although all reasonable efforts have been taken to ensure the accuracy
+#  and reliability of the software and data, the NLM and the U.S.
+#  Government do not and cannot warrant the performance or results that
+#  may be obtained by using this software or data. The NLM and the U.S.
+#  Government disclaim all warranties, express or implied, including
+#  warranties of performance, merchantability or fitness for any particular
+#  purpose.
+#
+#  Please cite the author in any work or product based on this material.
+#
+# ===========================================================================
+#echo "$0 $*"
+
+# runs a tool with two sets of options, the outputs must not differ
+#
+# $1 - work directory (actual results and temporaries created under actual/)
+# $2 - test case ID
+# $3 - options of the first run
+# $4 - options of the second run
+# $5 - command printing an output as text, {} stands for the output
+# $6, $7, ... - command to run, {opts} stands for the options,
+#               {} for the output
+#
+# If CHECK is set, it is a command run after the second run, {}.stdout and
+# {}.stderr stand for what it printed; it has to succeed ( e.g. to make sure
+# the options took the path to be tested ).
+#
+# return codes:
+# 0 - passed
+# 1 - could not create temp dir
+# 2 - first run failed
+# 3 - second run failed
+# 4 - printing an output failed
+# 5 - outputs differ
+# 6 - CHECK failed
+
+WORKDIR=$1
+CASEID=$2
+OPTS_A=$3
+OPTS_B=$4
+PRINT=$5
+shift 5
+CMDLINE=$*
+
+TEMPDIR=$WORKDIR/actual/$CASEID
+
+printf "running $CASEID: "
+
+mkdir -p $TEMPDIR
+rm -rf $TEMPDIR/*
+if [ "$?" != "0" ] ; then
+    exit 1
+fi
+
+# $1 - name of the output, $2 - options, $3 - return code on failure
+run()
+{
+    CMD=${CMDLINE//\{opts\}/$2}
+    CMD="${CMD//\{\}/$TEMPDIR/$1} 1>$TEMPDIR/$1.stdout 2>$TEMPDIR/$1.stderr"
+    printf "'$2'... "
+    eval "$CMD"
+    if [ "$?" != "0" ] ; then
+        echo "failed. Command executed:"
+        echo $CMD
+        cat $TEMPDIR/$1.stderr
+        exit $3
+    fi
+}
+
+run a "$OPTS_A" 2
+run b "$OPTS_B" 3
+
+if [ -n "$CHECK" ] ; then
+    eval "${CHECK//\{\}/$TEMPDIR/b}" >/dev/null
+    if [ "$?" != "0" ] ; then
+        echo "check failed: $CHECK"
+        cat $TEMPDIR/b.stderr
+        exit 6
+    fi
+fi
+
+printf "diff... "
+for RUN in a b ; do
+    eval "${PRINT//\{\}/$TEMPDIR/$RUN}" 1>$TEMPDIR/$RUN.print 2>>$TEMPDIR/$RUN.stderr || exit 4
+done
+diff $TEMPDIR/a.print $TEMPDIR/b.print >$TEMPDIR/diff
+if [ "$?" != "0" ] ; then
+    head $TEMPDIR/diff
+    echo "printed outputs differ, command executed:"
+    echo $CMD
+    exit 5
+fi
+
+printf "done\n"
+rm -rf $TEMPDIR
+
+exit 0
@@ -0,0 +1,111 @@
+#!/bin/bash
+# ===========================================================================
+#
+#                            PUBLIC DOMAIN NOTICE
+#               National Center for Biotechnology Information
+#
+#  This software/database is a "United States Government Work" under the
+#  terms of the United States Copyright Act.  It was written as part of
+#  the author's official duties as a United States Government employee and
+#  thus cannot be copyrighted.  This software/database is freely available
+#  to the public for use. The National Library of Medicine and the U.S.
+#  Government have not placed any restriction on its use or reproduction.
+#
+#  Although all reasonable efforts have been taken to ensure the accuracy
+#  and reliability of the software and data, the NLM and the U.S.
+#  Government do not and cannot warrant the performance or results that
+#  may be obtained by using this software or data. The NLM and the U.S.
+#  Government disclaim all warranties, express or implied, including
+#  warranties of performance, merchantability or fitness for any particular
+#  purpose.
+#
+#  Please cite the author in any work or product based on this material.
+#
+# ===========================================================================
+#echo "$0 $*"
+
+# runs a tool with a single thread and with several, outputs must not differ
+#
+# $1 - work directory (actual results and temporaries created under actual/)
+# $2 - test case ID
+# $3 - number of threads to compare against a single thread
+# $4 - command printing an output as text, {} stands for the output;
+#      "-" compares stdout and the outputs as they are
+# $5, $6, ... - command to run, {threads} stands for the number of threads,
+#               {} for the output
+#
+# If EXPECTED names a directory, outputs compared as they are must not
+# differ from it either.
+#
+# return codes:
+# 0 - passed
+# 1 - could not create temp dir
+# 2 - single threaded run failed
+# 3 - multi threaded run failed
+# 4 - printing an output failed
+# 5 - outputs differ
+
+WORKDIR=$1
+CASEID=$2
+THREADS=$3
+PRINT=$4
+shift 4
+CMDLINE=$*
+
+TEMPDIR=$WORKDIR/actual/$CASEID
+
+printf "running $CASEID: "
+
+mkdir -p $TEMPDIR
+rm -rf $TEMPDIR/*
+if [ "$?" != "0" ] ; then
+    exit 1
+fi
+
+# $1 - name of the output, $2 - number of threads, $3 - return code on failure
+run()
+{
+    CMD=${CMDLINE//\{threads\}/$2}
+    CMD="${CMD//\{\}/$TEMPDIR/$1} 1>$TEMPDIR/$1.stdout 2>$TEMPDIR/$1.stderr"
+    printf "$2 thread(s)... "
+    eval "$CMD"
+    if [ "$?" != "0" ] ; then
+        echo "failed. Command executed:"
+        echo $CMD
+        cat $TEMPDIR/$1.stderr
+        exit $3
+    fi
+}
+
+differ()
+{
+    head $TEMPDIR/diff
+    echo "$1, command executed:"
+    echo $CMD
+    exit 5
+}
+
+run st 1 2
+run mt $THREADS 3
+
+printf "diff... "
+if [ "$PRINT" == "-" ] ; then
+    cmp $TEMPDIR/st.stdout $TEMPDIR/mt.stdout >$TEMPDIR/diff || differ "stdout differs"
+    if [ -n "$EXPECTED" ] ; then
+        for RUN in st mt ; do
+            diff -r $EXPECTED $TEMPDIR/$RUN >$TEMPDIR/diff || differ "output of $RUN differs from $EXPECTED"
+        done
+    elif [ -e $TEMPDIR/st ] || [ -e $TEMPDIR/mt ] ; then
+        diff -r $TEMPDIR/st $TEMPDIR/mt >$TEMPDIR/diff || differ "outputs differ"
+    fi
+else
+    for RUN in st mt ; do
+        eval "${PRINT//\{\}/$TEMPDIR/$RUN}" 1>$TEMPDIR/$RUN.print 2>>$TEMPDIR/$RUN.stderr || exit 4
+    done
+    diff $TEMPDIR/st.print $TEMPDIR/mt.print >$TEMPDIR/diff || differ "printed outputs differ"
+fi
+
+printf "done\n"
+rm -rf $TEMPDIR
+
+exit 0
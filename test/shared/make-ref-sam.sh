@@ -0,0 +1,77 @@
+#!/bin/bash
+# ===========================================================================
+#
+#                            PUBLIC DOMAIN NOTICE
+#               National Center for Biotechnology Information
+#
+#  This software/database is a "United States Government Work" under the
+#  terms of the United States Copyright Act.  It was written as part of
+#  the author's official duties as a United States Government employee and
+#  thus cannot be copyrighted.  This software/database is freely available
+#  to the public for use. The National Library of Medicine and the U.S.
+#  Government have not placed any restriction on its use or reproduction.
+#
+#  Although all reasonable efforts have been taken to ensure the accuracy
+#  and reliability of the software and data, the NLM and the U.S.
+#  Government do not and cannot warrant the performance or results that
+#  may be obtained by using this software or data. The NLM and the U.S.
+#  Government disclaim all warranties, express or implied, including
+#  warranties of performance, merchantability or fitness for any particular
+#  purpose.
+#
+#  Please cite the author in any work or product based on this material.
+#
+# ===========================================================================
+#echo "$0 $*"
+
+# generates a random reference and reads copied from it,
+# the same arguments give the same files
+#
+# $1 - reference to write, FASTA of one sequence "chrT"
+# $2 - SAM-text to write, sorted by coordinate
+# $3 - length of the reference
+# $4 - number of reads (of pairs if $6 is given), less of them if the reference ends before
+# $5 - largest step between the starts of neighbouring reads
+# $6 - optional: largest distance of mates, makes the reads paired; the second
+#      mate of every 50th pair is unaligned
+
+REF=$1
+SAM=$2
+REF_LEN=$3
+READS=$4
+STEP=$5
+MATE_DIST=${6:-0}
+
+awk -v n=$REF_LEN 'BEGIN { b = "ACGT"; srand( 1 ); printf( ">chrT\n" );
+    for ( i = 0; i < n; i++ ) { printf( "%s", substr( b, int( rand() * 4 ) + 1, 1 ) );
+        if ( i % 70 == 69 ) printf( "\n" ) } printf( "\n" ) }' >$REF || exit 1
+
+# lines of 70 bases are kept apart, joining millions of bases is slow in some awks
+awk -v n=$READS -v len=$REF_LEN -v step=$STEP -v dist=$MATE_DIST '
+    function bases( pos, l,    s, k ) {
+        s = ""; for ( k = int( ( pos - 1 ) / 70 ); length( s ) < ( pos - 1 ) % 70 + l; k++ ) s = s line[ k ];
+        return substr( s, ( pos - 1 ) % 70 + 1, l ) }
+    function qual( i, l,    q, j ) {
+        q = ""; for ( j = 0; j < l; j++ ) q = q sprintf( "%c", 35 + ( i + j ) % 40 );
+        return q }
+    NR > 1 { line[ NR - 2 ] = $0 }
+    END { srand( 2 ); printf( "@HD\tVN:1.3\tSO:coordinate\n@SQ\tSN:chrT\tLN:%d\n", len );
+        pos = 1; for ( i = 1; i <= n; i++ ) { pos += int( rand() * step ); l = 50 + i % 51;
+            if ( pos + l > len ) break;
+            if ( dist == 0 ) {
+                printf( "r%d\t0\tchrT\t%d\t30\t%dM\t*\t0\t0\t%s\t%s\n", i, pos, l, bases( pos, l ), qual( i, l ) );
+                continue }
+            m = 50 + ( i * 7 ) % 51; mpos = pos + int( rand() * dist );
+            if ( mpos + m > len ) mpos = len - m;
+            if ( i % 50 == 0 ) {
+                printf( "p%d\t73\tchrT\t%d\t30\t%dM\t=\t%d\t0\t%s\t%s\n", i, pos, l, pos, bases( pos, l ), qual( i, l ) );
+                printf( "p%d\t133\tchrT\t%d\t0\t*\t=\t%d\t0\t%s\t%s\n", i, pos, pos, bases( mpos, m ), qual( i + 1, m ) );
+                continue }
+            printf( "p%d\t99\tchrT\t%d\t30\t%dM\t=\t%d\t%d\t%s\t%s\n", i, pos, l, mpos, mpos + m - pos, bases( pos, l ), qual( i, l ) );
+            printf( "p%d\t147\tchrT\t%d\t30\t%dM\t=\t%d\t%d\t%s\t%s\n", i, mpos, m, pos, pos - mpos - m, bases( mpos, m ), qual( i + 1, m ) ) } }' \
+    $REF >$SAM.unsorted || exit 1
+
+# second mates come out of coordinate order
+grep '^@' $SAM.unsorted >$SAM
+grep -v '^@' $SAM.unsorted | sort -s -n -k4,4 >>$SAM
+rm -f $SAM.unsorted
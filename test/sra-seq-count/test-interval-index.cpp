@@ -0,0 +1,232 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the interval index of sra-seq-count: every query has to
+* find the features the linear lookup over the outer ranges found before
+*/
+
+#include <ktst/unit_test.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "../../tools/sra-seq-count/range.hpp"
+#include "../../tools/sra-seq-count/interval_index.hpp"
+
+using namespace std;
+using namespace seq_ranges;
+
+TEST_SUITE(IntervalIndexTestSuite);
+
+class IntervalIndexFixture
+{
+public:
+    IntervalIndexFixture () : m_seed ( 1 )
+    {
+    }
+
+    void Add ( long start, long end )
+    {
+        m_index . add ( start, end );
+        m_ranges . push_back ( range ( start, end ) );
+    }
+
+    /* features of random length, some of them spanning many others */
+    void AddRandom ( size_t count, long ref_len )
+    {
+        for ( size_t i = 0; i < count; ++ i )
+        {
+            long start = 1 + Random () % ref_len;
+            long len = Random () % 17 == 0 ? Random () % ( ref_len / 4 + 1 ) : Random () % 300;
+            Add ( start, start + len );
+        }
+    }
+
+    /* the ids of the features intersecting [ start .. end ] in the order of their start,
+       as the window over the features of the gtf-file found them */
+    vector < size_t > Linear ( long start, long end ) const
+    {
+        vector < size_t > order;
+        for ( size_t i = 0; i < m_ranges . size (); ++ i )
+            order . push_back ( i );
+        stable_sort ( order . begin (), order . end (), ByStart ( m_ranges ) );
+
+        vector < size_t > hits;
+        range al ( start, end );
+        for ( size_t i = 0; i < order . size (); ++ i )
+        {
+            if ( m_ranges [ order [ i ] ] . intersect ( al ) )
+                hits . push_back ( order [ i ] );
+        }
+        return hits;
+    }
+
+    vector < size_t > Query ( long start, long end ) const
+    {
+        vector < size_t > hits;
+        m_index . query ( start, end, hits );
+        return hits;
+    }
+
+    /* the number of queries which had hits */
+    size_t Compare ( size_t queries, long ref_len )
+    {
+        size_t found = 0;
+        m_index . build ();
+        for ( size_t i = 0; i < queries; ++ i )
+        {
+            long start = 1 + Random () % ref_len;
+            long end = start + Random () % 150;
+            vector < size_t > expected = Linear ( start, end );
+            if ( Query ( start, end ) != expected )
+            {
+                ostringstream s;
+                s << "query [ " << start << " .. " << end << " ] of " << m_ranges . size () << " features";
+                throw logic_error ( s . str () );
+            }
+            if ( ! expected . empty () )
+                ++ found;
+        }
+        return found;
+    }
+
+    long Random ()
+    {
+        m_seed = m_seed * 1103515245 + 12345;
+        return ( long ) ( ( m_seed >> 16 ) & 0x7fffffff );
+    }
+
+    interval_index m_index;
+    vector < range > m_ranges;
+    uint64_t m_seed;
+
+private:
+    struct ByStart
+    {
+        const vector < range > & r;
+        ByStart ( const vector < range > & r_ ) : r ( r_ ) {}
+        bool operator () ( size_t a, size_t b ) const { return r [ a ] . get_start () < r [ b ] . get_start (); }
+    };
+};
+
+FIXTURE_TEST_CASE ( IntervalIndex_Empty, IntervalIndexFixture )
+{
+    m_index . build ();
+    REQUIRE ( Query ( 1, 1000 ) . empty () );
+}
+
+FIXTURE_TEST_CASE ( IntervalIndex_NotBuilt, IntervalIndexFixture )
+{
+    Add ( 10, 20 );
+    REQUIRE ( Query ( 1, 1000 ) . empty () );
+}
+
+FIXTURE_TEST_CASE ( IntervalIndex_Touching, IntervalIndexFixture )
+{
+    Add ( 10, 20 );
+    Add ( 21, 30 );
+    m_index . build ();
+    REQUIRE ( Query ( 1, 9 ) . empty () );
+    REQUIRE ( Query ( 1, 10 ) == Linear ( 1, 10 ) );
+    REQUIRE_EQ ( Query ( 20, 21 ) . size (), ( size_t ) 2 );
+    REQUIRE ( Query ( 31, 40 ) . empty () );
+}
+
+/* equal starts are reported in the order of the gtf-file */
+FIXTURE_TEST_CASE ( IntervalIndex_EqualStarts, IntervalIndexFixture )
+{
+    Add ( 50, 60 );
+    Add ( 10, 100 );
+    Add ( 50, 55 );
+    Add ( 50, 500 );
+    m_index . build ();
+    vector < size_t > hits = Query ( 58, 58 );
+    REQUIRE_EQ ( hits . size (), ( size_t ) 3 );
+    REQUIRE_EQ ( hits [ 0 ], ( size_t ) 1 );
+    REQUIRE_EQ ( hits [ 1 ], ( size_t ) 0 );
+    REQUIRE_EQ ( hits [ 2 ], ( size_t ) 3 );
+}
+
+/* a feature spanning the whole reference is found from any leaf */
+FIXTURE_TEST_CASE ( IntervalIndex_Spanning, IntervalIndexFixture )
+{
+    for ( long i = 0; i < 100; ++ i )
+        Add ( 100 + i * 10, 105 + i * 10 );
+    Add ( 1, 100000 );
+    REQUIRE_EQ ( Compare ( 1000, 2000 ), ( size_t ) 1000 );
+}
+
+/* complete and incomplete trees, the last node's parent out of range */
+FIXTURE_TEST_CASE ( IntervalIndex_Sizes, IntervalIndexFixture )
+{
+    const size_t sizes [] = { 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 33, 100, 1000, 4097 };
+    for ( size_t i = 0; i < sizeof sizes / sizeof sizes [ 0 ]; ++ i )
+    {
+        IntervalIndexFixture f;
+        f . m_seed = i + 1;
+        f . AddRandom ( sizes [ i ], ( long ) sizes [ i ] * 50 );
+        REQUIRE_GT ( f . Compare ( 2000, ( long ) sizes [ i ] * 50 ), ( size_t ) 0 );
+    }
+}
+
+//////////////////////////////////////////// Main
+extern "C"
+{
+
+#include <kapp/args.h>
+#include <kfg/config.h>
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+rc_t CC UsageSummary (const char * progname)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-interval-index";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=IntervalIndexTestSuite(argc, argv);
+    return rc;
+}
+
+}
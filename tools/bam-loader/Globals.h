@@ -32,6 +32,13 @@ enum LoaderModes {
     mode_Analysis
 };
 
+/* how the id2value store is mapped */
+enum IdMapModes {
+    idmap_File,     /* one file-backed mapping per subchunk, faulted in on first touch */
+    idmap_Reserved, /* file-backed, placed in reserved address space, prefaulted and prefetched */
+    idmap_Memory    /* as idmap_Reserved but anonymous memory with transparent huge pages */
+};
+
 typedef struct globals
 {
     char const *inpath;
@@ -61,9 +68,12 @@ typedef struct globals
     unsigned maxWarnCount_NoMatch;
     unsigned maxWarnCount_DupConflict;
     unsigned pid;
+    unsigned inflateThreads;
+    unsigned parseQueueDepth;
     unsigned minMatchCount; /* minimum number of matches to count as an alignment */
     int minMapQual;
     enum LoaderModes mode;
+    enum IdMapModes idMapMode;
     uint32_t maxSeqLen;
     bool omit_aligned_reads;
     bool omit_reference_reads;
@@ -85,6 +95,7 @@ typedef struct globals
     bool noSecondary;
     bool hasTI;
     bool acceptHardClip;
+    bool useNameHash; /* in-memory read name index; spills to KBTree */
 } Globals;
 
 extern Globals G;
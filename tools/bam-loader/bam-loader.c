@@ -80,6 +80,10 @@ static char const option_ref_file[] = "ref-file";
 static char const option_TI[] = "TI";
 static char const option_max_warn_dup_flag[] = "max-warning-dup-flag";
 static char const option_accept_hard_clip[] = "accept-hard-clip";
+static char const option_inflate_threads[] = "inflate-threads";
+static char const option_parse_queue_depth[] = "parse-queue-depth";
+static char const option_btree_names[] = "btree-names";
+static char const option_id_map[] = "id-map";
 
 #define OPTION_INPUT option_input
 #define OPTION_OUTPUT option_output
@@ -102,6 +106,10 @@ static char const option_accept_hard_clip[] = "accept-hard-clip";
 #define OPTION_TI option_TI
 #define OPTION_MAX_WARN_DUP_FLAG option_max_warn_dup_flag
 #define OPTION_ACCEPT_HARD_CLIP option_accept_hard_clip
+#define OPTION_INFLATE_THREADS option_inflate_threads
+#define OPTION_PARSE_QUEUE_DEPTH option_parse_queue_depth
+#define OPTION_BTREE_NAMES option_btree_names
+#define OPTION_ID_MAP option_id_map
 
 #define ALIAS_INPUT  "i"
 #define ALIAS_OUTPUT "o"
@@ -329,6 +337,37 @@ char const * use_accept_hard_clip[] =
     NULL
 };
 
+static
+char const * use_inflate_threads[] = 
+{
+    "number of threads used to decompress BAM input, from 0 to 64, 0 or 1 to decompress on the main thread (default 4)",
+    NULL
+};
+
+static
+char const * use_parse_queue_depth[] = 
+{
+    "number of batches of parsed records to queue ahead of the loader, from 0 to 256, 0 to parse on the main thread (default 8)",
+    NULL
+};
+
+static
+char const * use_btree_names[] = 
+{
+    "index read names with disk-backed B-trees instead of in-memory hash tables",
+    NULL
+};
+
+static
+char const * use_id_map[] = 
+{
+    "how to map the temporary per-spot store:",
+    "'file': map file-backed chunks on demand;",
+    "'reserved' (default): reserve address space up front, prefault and prefetch file-backed chunks;",
+    "'memory': as 'reserved' but in anonymous memory with transparent huge pages instead of files in tmpfs",
+    NULL
+};
+
 OptDef Options[] = 
 {
     /* order here is same as in param array below!!! */
@@ -361,7 +400,11 @@ OptDef Options[] =
     { OPTION_REF_FILE, ALIAS_REF_FILE, NULL, use_ref_file, 0, true, false },
     { OPTION_TI, NULL, NULL, use_TI, 1, false, false },
     { OPTION_MAX_WARN_DUP_FLAG, NULL, NULL, use_max_dup_warnings, 1, true, false },
-    { OPTION_ACCEPT_HARD_CLIP, NULL, NULL, use_accept_hard_clip, 1, false, false }
+    { OPTION_ACCEPT_HARD_CLIP, NULL, NULL, use_accept_hard_clip, 1, false, false },
+    { OPTION_INFLATE_THREADS, NULL, NULL, use_inflate_threads, 1, true, false },
+    { OPTION_PARSE_QUEUE_DEPTH, NULL, NULL, use_parse_queue_depth, 1, true, false },
+    { OPTION_BTREE_NAMES, NULL, NULL, use_btree_names, 1, false, false },
+    { OPTION_ID_MAP, NULL, NULL, use_id_map, 1, true, false }
 };
 
 const char* OptHelpParam[] =
@@ -396,7 +439,11 @@ const char* OptHelpParam[] =
     "path-to-file",		/* reference fasta file */
     NULL,				/* use XT->TI */
     "count",			/* max. duplicate warning count */
-    NULL				/* allow hard clipping */
+    NULL,				/* allow hard clipping */
+    "count",			/* inflate threads */
+    "count",			/* parse queue depth */
+    NULL,				/* B-tree name index */
+    "mode"				/* id2value mapping */
 };
 
 rc_t UsageSummary (char const * progname)
@@ -472,6 +519,21 @@ static void set_pid(void)
     G.pid = getpid();
 }
 
+#define INFLATE_THREADS_MAX 64
+#define PARSE_QUEUE_DEPTH_MAX 256
+
+/* digits only, from 0 to max */
+static bool parseCount(char const *value, unsigned const max, unsigned *const result)
+{
+    char *end = NULL;
+    unsigned long const n = strtoul(value, &end, 10);
+
+    if (!isdigit((unsigned char)value[0]) || *end != '\0' || n > max)
+        return false;
+    *result = (unsigned)n;
+    return true;
+}
+
 static rc_t PathWithBasePath(char rslt[], size_t sz, char const path[], char const base[])
 {
     size_t const plen = strlen(path);
@@ -585,6 +647,9 @@ rc_t CC KMain (int argc, char * argv[])
 #endif
     G.maxErrCount = 1000;
     G.minMatchCount = 10;
+    G.inflateThreads = 4;
+    G.parseQueueDepth = 8;
+    G.idMapMode = idmap_Reserved;
     
     set_pid();
 
@@ -789,6 +854,60 @@ rc_t CC KMain (int argc, char * argv[])
             G.maxWarnCount_DupConflict = strtoul(value, &dummy, 0);
         }
         
+        rc = ArgsOptionCount (args, OPTION_INFLATE_THREADS, &pcount);
+        if (rc)
+            break;
+        if (pcount == 1)
+        {
+            rc = ArgsOptionValue (args, OPTION_INFLATE_THREADS, 0, &value);
+            if (rc)
+                break;
+            if (!parseCount(value, INFLATE_THREADS_MAX, &G.inflateThreads)) {
+                rc = RC(rcApp, rcArgv, rcAccessing, rcParam, rcIncorrect);
+                OUTMSG (("inflate-threads: bad value, must be a number from 0 to %u\n", INFLATE_THREADS_MAX));
+                MiniUsage (args);
+                break;
+            }
+        }
+        
+        rc = ArgsOptionCount (args, OPTION_PARSE_QUEUE_DEPTH, &pcount);
+        if (rc)
+            break;
+        if (pcount == 1)
+        {
+            rc = ArgsOptionValue (args, OPTION_PARSE_QUEUE_DEPTH, 0, &value);
+            if (rc)
+                break;
+            if (!parseCount(value, PARSE_QUEUE_DEPTH_MAX, &G.parseQueueDepth)) {
+                rc = RC(rcApp, rcArgv, rcAccessing, rcParam, rcIncorrect);
+                OUTMSG (("parse-queue-depth: bad value, must be a number from 0 to %u\n", PARSE_QUEUE_DEPTH_MAX));
+                MiniUsage (args);
+                break;
+            }
+        }
+        
+        rc = ArgsOptionCount (args, OPTION_ID_MAP, &pcount);
+        if (rc)
+            break;
+        if (pcount == 1)
+        {
+            rc = ArgsOptionValue (args, OPTION_ID_MAP, 0, &value);
+            if (rc)
+                break;
+            if (strcmp(value, "file") == 0)
+                G.idMapMode = idmap_File;
+            else if (strcmp(value, "reserved") == 0)
+                G.idMapMode = idmap_Reserved;
+            else if (strcmp(value, "memory") == 0)
+                G.idMapMode = idmap_Memory;
+            else {
+                rc = RC(rcApp, rcArgv, rcAccessing, rcParam, rcIncorrect);
+                OUTMSG (("id-map: bad value\n"));
+                MiniUsage (args);
+                break;
+            }
+        }
+        
         rc = ArgsOptionCount (args, option_unsorted, &pcount);
         if (rc)
             break;
@@ -867,6 +986,11 @@ rc_t CC KMain (int argc, char * argv[])
             break;
         G.acceptHardClip = pcount > 0;
         
+        rc = ArgsOptionCount (args, OPTION_BTREE_NAMES, &pcount);
+        if (rc)
+            break;
+        G.useNameHash = pcount == 0;
+        
         rc = ArgsOptionCount (args, OPTION_NOMATCH_LOG, &pcount);
         if (rc)
             break;
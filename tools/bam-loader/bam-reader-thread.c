@@ -0,0 +1,276 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#include <klib/rc.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
+#include <sysalloc.h>
+#include <atomic32.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "bam-reader-thread.h"
+
+#define BATCH_SIZE (1024u)
+
+typedef struct BAM_ReaderBatch BAM_ReaderBatch;
+struct BAM_ReaderBatch {
+    BAM_Alignment const *rec[BATCH_SIZE];
+    rc_t rc[BATCH_SIZE];    /* the result of reading rec[i]; a non-zero rc other than rcEmpty ends the stream */
+    float pos;              /* proportional file position after the last record in the batch */
+    unsigned count;
+};
+
+/* The ring is single-producer, single-consumer. The parsing thread only
+ * advances "tail" and the caller only advances "head"; each side blocks on
+ * its condition only when the ring is full (or empty), and the other side
+ * only takes the lock to wake it if it has flagged itself as waiting.
+ */
+struct BAM_Reader {
+    BAM_File const *file;
+    BAM_ReaderBatch *ring;
+    BAM_ReaderBatch *cur;   /* batch being handed out; still counted in the ring */
+    KThread *th;
+    KLock *lock;
+    KCondition *have_data;
+    KCondition *need_data;
+    uint64_t parserStalls;
+    uint64_t consumerStalls;
+    atomic32_t head;
+    atomic32_t tail;
+    atomic32_t parserWaiting;
+    atomic32_t consumerWaiting;
+    unsigned depth;
+    unsigned next;          /* next record in cur */
+    rc_t final;             /* the rc that ended the stream, once it has been returned */
+    float pos;
+    bool volatile quitting;
+    bool done;
+};
+
+static bool IsResumable(rc_t const rc)
+{
+    return rc == 0 || (GetRCObject(rc) == rcRow && GetRCState(rc) == rcEmpty);
+}
+
+static unsigned Queued(BAM_Reader const *const self)
+{
+    return (unsigned)atomic32_read(&self->tail) - (unsigned)atomic32_read(&self->head);
+}
+
+static void Wake(BAM_Reader *const self, atomic32_t *const waiting, KCondition *const cond)
+{
+    if (atomic32_read(waiting) != 0) {
+        KLockAcquire(self->lock);
+        KConditionSignal(cond);
+        KLockUnlock(self->lock);
+    }
+}
+
+static rc_t CC BAM_ReaderThreadMain(KThread const *const th, void *const vp)
+{
+    BAM_Reader *const self = vp;
+    bool done = false;
+
+    while (!done && !self->quitting) {
+        BAM_ReaderBatch *batch;
+        unsigned n;
+
+        if (Queued(self) == self->depth) {
+            KLockAcquire(self->lock);
+            atomic32_inc(&self->parserWaiting);
+            ++self->parserStalls;
+            while (Queued(self) == self->depth && !self->quitting)
+                KConditionWait(self->need_data, self->lock);
+            atomic32_dec(&self->parserWaiting);
+            KLockUnlock(self->lock);
+            if (self->quitting)
+                break;
+        }
+        batch = &self->ring[(unsigned)atomic32_read(&self->tail) % self->depth];
+        for (n = 0; n < BATCH_SIZE; ) {
+            rc_t const rc = BAM_FileReadDetached(self->file, &batch->rec[n]);
+
+            batch->rc[n++] = rc;
+            if (!IsResumable(rc)) {
+                done = true;
+                break;
+            }
+        }
+        batch->count = n;
+        batch->pos = BAM_FileGetProportionalPosition(self->file);
+
+        atomic32_inc(&self->tail);
+        Wake(self, &self->consumerWaiting, self->have_data);
+    }
+    return 0;
+}
+
+static void BAM_ReaderBatchRelease(BAM_ReaderBatch *const self, unsigned const first)
+{
+    unsigned i;
+
+    for (i = first; i < self->count; ++i) {
+        if (self->rec[i])
+            BAM_AlignmentRelease(self->rec[i]);
+    }
+    self->count = 0;
+}
+
+static void BAM_ReaderWhack(BAM_Reader *const self)
+{
+    if (self->th) {
+        KLockAcquire(self->lock);
+        self->quitting = true;
+        KConditionSignal(self->need_data);
+        KLockUnlock(self->lock);
+
+        KThreadWait(self->th, NULL);
+        KThreadRelease(self->th);
+    }
+    if (self->ring) {
+        if (self->cur) {
+            BAM_ReaderBatchRelease(self->cur, self->next);
+            atomic32_inc(&self->head);
+        }
+        while (Queued(self) != 0) {
+            BAM_ReaderBatchRelease(&self->ring[(unsigned)atomic32_read(&self->head) % self->depth], 0);
+            atomic32_inc(&self->head);
+        }
+    }
+    KConditionRelease(self->need_data);
+    KConditionRelease(self->have_data);
+    KLockRelease(self->lock);
+    free(self->ring);
+    free(self);
+}
+
+rc_t BAM_ReaderMake(BAM_Reader **const result, BAM_File const *const file, unsigned const queueDepth)
+{
+    BAM_Reader *const self = calloc(1, sizeof(*self));
+    rc_t rc;
+
+    *result = NULL;
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+
+    self->file = file;
+    self->depth = queueDepth;
+    self->pos = BAM_FileGetProportionalPosition(file);
+    if (queueDepth == 0) {
+        *result = self;
+        return 0;
+    }
+    self->ring = calloc(queueDepth, sizeof(self->ring[0]));
+    if (self->ring == NULL) {
+        free(self);
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    }
+    rc = KLockMake(&self->lock);
+    if (rc == 0)
+        rc = KConditionMake(&self->have_data);
+    if (rc == 0)
+        rc = KConditionMake(&self->need_data);
+    if (rc == 0)
+        rc = KThreadMake(&self->th, BAM_ReaderThreadMain, self);
+    if (rc == 0) {
+        *result = self;
+        return 0;
+    }
+    BAM_ReaderWhack(self);
+    return rc;
+}
+
+rc_t BAM_ReaderRelease(BAM_Reader *const self)
+{
+    if (self != NULL)
+        BAM_ReaderWhack(self);
+    return 0;
+}
+
+rc_t BAM_ReaderRead(BAM_Reader *const self, BAM_Alignment const **const result)
+{
+    if (self == NULL || result == NULL)
+        return RC(rcAlign, rcFile, rcReading, rcParam, rcNull);
+
+    *result = NULL;
+    if (self->done)
+        return self->final;
+
+    if (self->ring == NULL) {
+        rc_t const rc = BAM_FileRead2(self->file, result);
+
+        self->pos = BAM_FileGetProportionalPosition(self->file);
+        return rc;
+    }
+
+    if (self->cur && self->next == self->cur->count) {
+        self->cur->count = 0;
+        self->cur = NULL;
+        atomic32_inc(&self->head);
+        Wake(self, &self->parserWaiting, self->need_data);
+    }
+    if (self->cur == NULL) {
+        if (Queued(self) == 0) {
+            KLockAcquire(self->lock);
+            atomic32_inc(&self->consumerWaiting);
+            ++self->consumerStalls;
+            while (Queued(self) == 0)
+                KConditionWait(self->have_data, self->lock);
+            atomic32_dec(&self->consumerWaiting);
+            KLockUnlock(self->lock);
+        }
+        self->cur = &self->ring[(unsigned)atomic32_read(&self->head) % self->depth];
+        self->next = 0;
+        self->pos = self->cur->pos;
+    }
+    {
+        unsigned const i = self->next++;
+        rc_t const rc = self->cur->rc[i];
+
+        *result = self->cur->rec[i];
+        if (!IsResumable(rc)) {
+            self->done = true;
+            self->final = rc;
+        }
+        return rc;
+    }
+}
+
+float BAM_ReaderGetProportionalPosition(BAM_Reader const *const self)
+{
+    return self->pos;
+}
+
+void BAM_ReaderGetStalls(BAM_Reader const *const self, uint64_t *const parser, uint64_t *const consumer)
+{
+    *parser = self->parserStalls;
+    *consumer = self->consumerStalls;
+}
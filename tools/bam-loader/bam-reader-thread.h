@@ -0,0 +1,79 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#ifndef BAM_LOAD_BAM_READER_THREAD_H_
+#define BAM_LOAD_BAM_READER_THREAD_H_ 1
+
+#include <klib/rc.h>
+
+#include "bam.h"
+
+/*--------------------------------------------------------------------------
+ * BAM_Reader
+ *  a parsing thread adapter for BAM_File
+ *  a background thread reads and parses records in batches and hands them
+ *  over through a ring of batches; the caller gets them one at a time
+ */
+typedef struct BAM_Reader BAM_Reader;
+
+/* Make
+ *  "file" [ IN ] - the open BAM_File; it is retained by the caller and must
+ *   not be read from by the caller until the reader is released
+ *
+ *  "queueDepth" [ IN ] - number of parsed batches that can be in flight;
+ *   0 parses on the calling thread
+ */
+rc_t BAM_ReaderMake ( BAM_Reader **result, const BAM_File *file, unsigned queueDepth );
+
+/* Release
+ *  stops the parsing thread and releases any records not yet read
+ */
+rc_t BAM_ReaderRelease ( BAM_Reader *self );
+
+/* Read
+ *  read an aligment
+ *
+ *  "result" [ OUT ] - return param for BAM_Alignment object
+ *   must be released with BAM_AlignmentRelease
+ *
+ *  returns as BAM_FileRead2
+ */
+rc_t BAM_ReaderRead ( BAM_Reader *self, const BAM_Alignment **result );
+
+/* GetProportionalPosition
+ *  the proportional position in the input file as of the last record read
+ *
+ * NB - does not return rc_t
+ */
+float BAM_ReaderGetProportionalPosition ( const BAM_Reader *self );
+
+/* GetStalls
+ *  number of times the parsing thread waited on a full queue ("parser") and
+ *  the caller waited on an empty queue ("consumer")
+ */
+void BAM_ReaderGetStalls ( const BAM_Reader *self, uint64_t *parser, uint64_t *consumer );
+
+#endif /* BAM_LOAD_BAM_READER_THREAD_H_ */
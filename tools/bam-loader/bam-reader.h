@@ -45,52 +45,6 @@ rc_t CC BamReaderFileMake( const ReaderFile **self, char const headerText[], cha
 const BAMFile* ToBam(const ReaderFile *self); 
 const BAMAlignment *ToBamAlignment(const Record* record);
 
-#if 0
-#ifdef TENTATIVE
-/*--------------------------------------------------------------------------
- * BAMReader, a parsing thread adapter for BAMFile.
- * Creates a thread that does reading and parsing of BAM files, provides access to parsed data one record at a time. 
- */
-typedef struct BAMReader BAMReader;
-
-rc_t BAMReaderMake( const BAMReader **result,
-                    char const headerText[],
-                    char const path[] );
-
-/* AddRef
- * Release
- */
-rc_t BAMReaderAddRef ( const BAMReader *self );
-rc_t AMReaderRelease ( const BAMReader *self );
-
-/* GetBAMFile
- */
-const BAMFile* BAMReaderGetBAMFile ( const BAMReader *self );
-
-/* Read
- *  read an aligment
- *
- *  "result" [ OUT ] - return param for BAMAlignment object
- *   must be released with BAMAlignmentRelease
- *
- *  returns RC(..., ..., ..., rcRow, rcNotFound) at end
- */
-rc_t BAMReaderRead ( const BAMReader *self, const BAMAlignment **result );
-
-#else /*TENTATIVE*/
-
-/* use BAMFile directly, as in the earlier version */
-typedef struct BAMFile BAMReader;
-
-#define BAMReaderMake 			BAMFileMakeWithHeader
-#define BAMReaderAddRef 		BAMFileAddRef
-#define BAMReaderRelease 		BAMFileRelease
-#define BAMReaderGetBAMFile(p) 	(p)
-#define BAMReaderRead 			BAMFileRead
-
-#endif
-#endif
-
 #ifdef __cplusplus
 }
 #endif
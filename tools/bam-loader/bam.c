@@ -35,6 +35,9 @@
 #include <klib/log.h>
 #include <klib/text.h>
 #include <klib/refcount.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 #include <sysalloc.h>
 
 #include <atomic32.h>
@@ -249,9 +252,14 @@ rc_t SAMFileInit(SAMFile *self, RawFile_vt *vt)
 
 #define CG_NUM_SEGS 4
 
+typedef struct BGZThreadSlot BGZThreadSlot;
+typedef struct BGZThreadWorker BGZThreadWorker;
+typedef struct BGZThreadPool BGZThreadPool;
+
 struct BGZFile {
     BufferedFile file;
     z_stream zs;
+    BGZThreadPool *pool;    /* NULL unless blocks are being inflated on worker threads */
 };
 
 static
@@ -401,7 +409,409 @@ static rc_t BGZFileInit(BGZFile *const self, RawFile_vt *const vt)
     default:
         return RC(rcAlign, rcFile, rcConstructing, rcNoObj, rcUnexpected);
     }
-    
+
+    return 0;
+}
+
+/* MARK: BGZFile multi-threaded inflate
+ *
+ * The main thread splits the compressed stream into whole BGZF blocks (the
+ * block size is in the BC extra field) and queues them in a ring of slots;
+ * the workers inflate the queued slots in any order and the main thread
+ * hands them out in file order.
+ */
+
+enum BGZThreadSlotState {
+    slot_Empty,     /* owned by the main thread */
+    slot_Queued,    /* raw block is ready for a worker */
+    slot_Done       /* inflated (or failed); ready to be handed out */
+};
+
+struct BGZThreadSlot {
+    uint64_t fpos;          /* file position of the compressed block */
+    unsigned zsize;         /* size of the compressed block including header and trailer */
+    unsigned hsize;         /* size of the gzip header */
+    unsigned usize;         /* size of the inflated data */
+    rc_t rc;
+    int state;
+    uint8_t raw[ZLIB_BLOCK_SIZE];
+    zlib_block_t data;
+};
+
+struct BGZThreadWorker {
+    BGZThreadPool *pool;
+    KThread *th;
+    z_stream zs;
+    bool zsInit;
+};
+
+struct BGZThreadPool {
+    KLock *lock;
+    KCondition *have_work;  /* signaled when slots are queued or on shutdown */
+    KCondition *work_done;  /* signaled when a slot is inflated */
+    BGZThreadSlot *slot;
+    BGZThreadWorker *worker;
+    uint64_t pos;           /* file position of the block following the last one handed out */
+    unsigned slots;
+    unsigned threads;
+    unsigned head;          /* next slot to hand out */
+    unsigned next;          /* next slot to give to a worker */
+    unsigned tail;          /* next slot to fill */
+    rc_t last;              /* the error, if any, that stopped reading */
+    bool eof;               /* no more blocks will be queued */
+    bool quitting;
+};
+
+/* copies len bytes out of the read buffer, refilling it as needed */
+static rc_t BufferedFileCopy(BufferedFile *const self, void *const Dst, unsigned const len)
+{
+    uint8_t *const dst = Dst;
+    unsigned cur = 0;
+
+    while (cur < len) {
+        if (self->bpos == self->bmax) {
+            rc_t const rc = BufferedFileRead(self);
+            if (rc)
+                return rc;
+            if (self->bmax == 0)
+                return RC(rcAlign, rcFile, rcReading, rcData, rcInsufficient);
+        }
+        {
+            size_t const avail = self->bmax - self->bpos;
+            size_t const n = avail < len - cur ? avail : len - cur;
+
+            memcpy(&dst[cur], &((uint8_t const *)self->buf)[self->bpos], n);
+            self->bpos += n;
+            cur += (unsigned)n;
+        }
+    }
+    return 0;
+}
+
+/* reads the next whole compressed block into the slot
+ * returns (rcData, rcInsufficient) at end of file
+ */
+static rc_t BGZFileReadRawBlock(BGZFile *const self, BGZThreadSlot *const slot)
+{
+    uint8_t *const raw = slot->raw;
+    unsigned xlen;
+    unsigned bsize = 0;
+    unsigned i;
+    rc_t rc;
+
+    slot->fpos = BufferedFileGetPos(&self->file);
+    rc = BufferedFileCopy(&self->file, raw, 12);
+    if (rc) {
+        if (GetRCObject(rc) == (enum RCObject)rcData && GetRCState(rc) == rcInsufficient
+            && BufferedFileGetPos(&self->file) != slot->fpos)
+        {
+            DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("EOF in Zlib block after %lu bytes\n", slot->fpos));
+            rc = RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+        }
+        return rc;
+    }
+    if (raw[0] != 31 || raw[1] != 139 || raw[2] != Z_DEFLATED || (raw[3] & 4) == 0) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("GZIP Header not found\n"));
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    }
+    xlen = LE2HUI16(&raw[10]);
+    if (12 + xlen + 8 > sizeof(slot->raw))
+        return RC(rcAlign, rcFile, rcReading, rcFormat, rcInvalid);
+
+    rc = BufferedFileCopy(&self->file, &raw[12], xlen);
+    if (rc)
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+
+    for (i = 0; i + 4 <= xlen; ) {
+        uint8_t const *const extra = &raw[12 + i];
+        unsigned const slen = LE2HUI16(&extra[2]);
+
+        if (extra[0] == 'B' && extra[1] == 'C' && slen == 2 && i + 6 <= xlen) {
+            bsize = 1 + LE2HUI16(&extra[4]);
+            break;
+        }
+        i += slen + 4;
+    }
+    if (bsize == 0 || bsize < 12 + xlen + 8 || bsize > sizeof(slot->raw)) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("BGZF Header extra field BC not found\n"));
+        return RC(rcAlign, rcFile, rcReading, rcFormat, rcInvalid); /* not BGZF */
+    }
+    rc = BufferedFileCopy(&self->file, &raw[12 + xlen], bsize - (12 + xlen));
+    if (rc)
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+
+    slot->hsize = 12 + xlen;
+    slot->zsize = bsize;
+    return 0;
+}
+
+static rc_t BGZThreadSlotInflate(BGZThreadSlot *const slot, z_stream *const zs)
+{
+    uint8_t const *const trailer = &slot->raw[slot->zsize - 8];
+    uint32_t const crc = LE2HUI32(&trailer[0]);
+    uint32_t const isize = LE2HUI32(&trailer[4]);
+    rc_t rc = 0;
+    int zr;
+
+    slot->usize = 0;
+    if (isize > sizeof(slot->data))
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+
+    zs->next_in = (Bytef *)&slot->raw[slot->hsize];
+    zs->avail_in = slot->zsize - slot->hsize - 8;
+    zs->next_out = (Bytef *)slot->data;
+    zs->avail_out = sizeof(slot->data);
+
+    zr = inflate(zs, Z_FINISH);
+    if (zr != Z_STREAM_END) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Unexpected Zlib result %i: %s\n", zr, zs->msg ? zs->msg : "unknown"));
+        rc = RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    }
+    else if (zs->total_out != isize || crc32(crc32(0, Z_NULL, 0), slot->data, isize) != crc) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("BGZF block at %lu failed size or CRC check\n", slot->fpos));
+        rc = RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    }
+    else
+        slot->usize = isize;
+
+    zr = inflateReset(zs);
+    assert(zr == Z_OK);
+    return rc;
+}
+
+static rc_t CC BGZThreadWorkerMain(KThread const *const th, void *const vp)
+{
+    BGZThreadWorker *const self = vp;
+    BGZThreadPool *const pool = self->pool;
+
+    KLockAcquire(pool->lock);
+    for ( ; ; ) {
+        BGZThreadSlot *slot;
+
+        while (pool->next == pool->tail && !pool->quitting)
+            KConditionWait(pool->have_work, pool->lock);
+        if (pool->quitting)
+            break;
+
+        slot = &pool->slot[pool->next % pool->slots];
+        ++pool->next;
+        if (slot->state != slot_Queued) {
+            /* an EOF or already done slot; SetPos may be waiting for the queue to drain */
+            KConditionBroadcast(pool->work_done);
+            continue;
+        }
+        KLockUnlock(pool->lock);
+        {
+            rc_t const rc = BGZThreadSlotInflate(slot, &self->zs);
+
+            KLockAcquire(pool->lock);
+            slot->rc = rc;
+            slot->state = slot_Done;
+            KConditionBroadcast(pool->work_done);
+        }
+    }
+    KLockUnlock(pool->lock);
+    return 0;
+}
+
+/* queue as many raw blocks as there are free slots */
+static void BGZFileFillSlots(BGZFile *const self)
+{
+    BGZThreadPool *const pool = self->pool;
+    unsigned queued = 0;
+
+    while (!pool->eof && pool->tail - pool->head < pool->slots) {
+        BGZThreadSlot *const slot = &pool->slot[pool->tail % pool->slots];
+        rc_t const rc = BGZFileReadRawBlock(self, slot);
+
+        KLockAcquire(pool->lock);
+        if (rc == 0)
+            slot->state = slot_Queued;
+        else {
+            slot->rc = rc;
+            slot->state = slot_Done;
+            pool->eof = true;
+        }
+        ++pool->tail;
+        KLockUnlock(pool->lock);
+        ++queued;
+    }
+    if (queued) {
+        KLockAcquire(pool->lock);
+        KConditionBroadcast(pool->have_work);
+        KLockUnlock(pool->lock);
+    }
+}
+
+static
+rc_t BGZFileReadMT(BGZFile *self, zlib_block_t dst, unsigned *pNumRead)
+{
+    BGZThreadPool *const pool = self->pool;
+    BGZThreadSlot *slot;
+    rc_t rc;
+
+    *pNumRead = 0;
+    BGZFileFillSlots(self);
+    if (pool->head == pool->tail)
+        return pool->last;
+
+    slot = &pool->slot[pool->head % pool->slots];
+    KLockAcquire(pool->lock);
+    while (slot->state != slot_Done)
+        KConditionWait(pool->work_done, pool->lock);
+    KLockUnlock(pool->lock);
+
+    rc = slot->rc;
+    if (rc == 0) {
+        memcpy(dst, slot->data, slot->usize);
+        *pNumRead = slot->usize;
+        pool->pos = slot->fpos + slot->zsize;
+    }
+    else
+        pool->last = rc;
+    slot->state = slot_Empty;
+    ++pool->head;
+
+    return rc;
+}
+
+static uint64_t BGZFileGetPosMT(BGZFile const *const self)
+{
+    return self->pool->pos;
+}
+
+static float BGZFileProPosMT(BGZFile const *const self)
+{
+    return self->file.fmax == 0 ? -1.0 : (self->pool->pos / (double)self->file.fmax);
+}
+
+/* discards all read-ahead */
+static rc_t BGZFileSetPosMT(BGZFile *const self, uint64_t const pos)
+{
+    BGZThreadPool *const pool = self->pool;
+    rc_t rc;
+
+    KLockAcquire(pool->lock);
+    while (pool->next != pool->tail)
+        KConditionWait(pool->work_done, pool->lock);
+    for ( ; pool->head != pool->tail; ++pool->head) {
+        BGZThreadSlot *const slot = &pool->slot[pool->head % pool->slots];
+
+        while (slot->state == slot_Queued)
+            KConditionWait(pool->work_done, pool->lock);
+        slot->state = slot_Empty;
+    }
+    KLockUnlock(pool->lock);
+
+    rc = BufferedFileSetPos(&self->file, pos);
+    if (rc == 0) {
+        pool->pos = pos;
+        pool->last = 0;
+        pool->eof = false;
+    }
+    return rc;
+}
+
+static void BGZThreadPoolWhack(BGZThreadPool *const self)
+{
+    unsigned i;
+
+    if (self->lock) {
+        KLockAcquire(self->lock);
+        self->quitting = true;
+        if (self->have_work)
+            KConditionBroadcast(self->have_work);
+        KLockUnlock(self->lock);
+    }
+    for (i = 0; self->worker != NULL && i < self->threads; ++i) {
+        BGZThreadWorker *const worker = &self->worker[i];
+
+        if (worker->th) {
+            KThreadWait(worker->th, NULL);
+            KThreadRelease(worker->th);
+        }
+        if (worker->zsInit)
+            inflateEnd(&worker->zs);
+    }
+    KConditionRelease(self->work_done);
+    KConditionRelease(self->have_work);
+    KLockRelease(self->lock);
+    free(self->worker);
+    free(self->slot);
+    free(self);
+}
+
+static void BGZFileWhackMT(BGZFile *self)
+{
+    BGZThreadPoolWhack(self->pool);
+    self->pool = NULL;
+    BGZFileWhack(self);
+}
+
+/* switches an open BGZFile to inflating on worker threads
+ * the file must be positioned at a block boundary, i.e. only whole blocks
+ * have been consumed through BGZFileRead
+ */
+static rc_t BGZFileStartThreads(BGZFile *const self, RawFile_vt *const vt, unsigned const threads)
+{
+    static RawFile_vt const my_vt = {
+        (rc_t (*)(void *, zlib_block_t, unsigned *))BGZFileReadMT,
+        (uint64_t (*)(void const *))BGZFileGetPosMT,
+        (float (*)(void const *))BGZFileProPosMT,
+        (uint64_t (*)(void const *))BufferedFileGetSize,
+        (rc_t (*)(void *, uint64_t))BGZFileSetPosMT,
+        (void (*)(void *))BGZFileWhackMT
+    };
+    BGZThreadPool *pool;
+    rc_t rc;
+    unsigned i;
+
+    if (threads < 2)
+        return 0;
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+
+    pool->slots = 2 * threads;
+    pool->pos = BufferedFileGetPos(&self->file);
+    pool->slot = calloc(pool->slots, sizeof(pool->slot[0]));
+    pool->worker = calloc(threads, sizeof(pool->worker[0]));
+    if (pool->slot == NULL || pool->worker == NULL) {
+        BGZThreadPoolWhack(pool);
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    }
+    /* only now there are workers to be whacked */
+    pool->threads = threads;
+    rc = KLockMake(&pool->lock);
+    if (rc == 0)
+        rc = KConditionMake(&pool->have_work);
+    if (rc == 0)
+        rc = KConditionMake(&pool->work_done);
+    for (i = 0; rc == 0 && i < threads; ++i) {
+        BGZThreadWorker *const worker = &pool->worker[i];
+
+        worker->pool = pool;
+        switch (inflateInit2(&worker->zs, -MAX_WBITS)) { /* raw deflate; headers are parsed by BGZFileReadRawBlock */
+        case Z_OK:
+            worker->zsInit = true;
+            rc = KThreadMake(&worker->th, BGZThreadWorkerMain, worker);
+            break;
+        case Z_MEM_ERROR:
+            rc = RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+            break;
+        default:
+            rc = RC(rcAlign, rcFile, rcConstructing, rcNoObj, rcUnexpected);
+            break;
+        }
+    }
+    if (rc) {
+        BGZThreadPoolWhack(pool);
+        return rc;
+    }
+    DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Inflating BGZF blocks on %u threads\n", threads));
+    self->pool = pool;
+    *vt = my_vt;
     return 0;
 }
 
@@ -1548,6 +1958,7 @@ static void BAM_FileWhack(BAM_File *self) {
 /* file is retained */
 static rc_t BAM_FileMakeWithKFileAndHeader(BAM_File const **cself,
                                           KFile const *file,
+                                          unsigned inflateThreads,
                                           char const *headerText)
 {
     BAM_File *self = calloc(1, sizeof(*self));
@@ -1566,8 +1977,14 @@ static rc_t BAM_FileMakeWithKFileAndHeader(BAM_File const **cself,
     if (rc == 0) {
         rc = ProcessBAMHeader(self, headerText);
         if (rc == 0) {
-            *cself = self;
-            return 0;
+            rc = BGZFileStartThreads(&self->file.bam, &self->vt, inflateThreads);
+            if (rc == 0) {
+                *cself = self;
+                return 0;
+            }
+            BAM_FileWhack(self);
+            free(self);
+            return rc;
         }
     }
     BGZFileWhack(&self->file.bam);
@@ -1589,6 +2006,7 @@ static rc_t BAM_FileMakeWithKFileAndHeader(BAM_File const **cself,
 }
 
 rc_t BAM_FileMakeWithHeader(const BAM_File **cself,
+                            unsigned inflateThreads,
                             char const headerText[],
                             char const path[], ... )
 {
@@ -1606,7 +2024,7 @@ rc_t BAM_FileMakeWithHeader(const BAM_File **cself,
     va_start(args, path);
     rc = KDirectoryVOpenFileRead(dir, &kf, path, args);
     if (rc == 0) {
-        rc = BAM_FileMakeWithKFileAndHeader(cself, kf, headerText);
+        rc = BAM_FileMakeWithKFileAndHeader(cself, kf, inflateThreads, headerText);
         KFileRelease(kf);
     }
     va_end(args);
@@ -2730,6 +3148,56 @@ rc_t BAM_FileRead(const BAM_File *cself, const BAM_Alignment **rhs)
     return BAM_FileReadCopy(self, rhs, false);
 }
 
+/* copies the record's data out of the file's buffers */
+static rc_t BAM_AlignmentDetach(BAM_Alignment *const self)
+{
+    if (self->storage == NULL) {
+        self->storage = malloc(self->datasize);
+        if (self->storage == NULL)
+            return RC(rcAlign, rcFile, rcReading, rcMemory, rcExhausted);
+
+        memcpy(self->storage, self->data, self->datasize);
+        self->data = (bam_alignment *)&self->storage[0];
+    }
+    if (self->parent->bufLocker == self)
+        self->parent->bufLocker = NULL;
+    return 0;
+}
+
+rc_t BAM_FileReadDetached(const BAM_File *cself, const BAM_Alignment **rhs)
+{
+    BAM_File *const self = (BAM_File *)cself;
+    rc_t rc;
+
+    if (self == NULL || rhs == NULL)
+        return RC(rcAlign, rcFile, rcReading, rcParam, rcNull);
+
+    *rhs = NULL;
+
+    if (self->bufCurrent >= self->bufSize && self->eof)
+        return RC(rcAlign, rcFile, rcReading, rcRow, rcNotFound);
+
+    if (self->isSAM)
+        rc = BAM_FileReadSAM(self, rhs);
+    else {
+        rc = BAM_FileBreakLock(self);
+        if (rc)
+            return rc;
+        rc = BAM_FileReadCopy(self, rhs, true);
+        if (GetRCObject(rc) == rcRow && GetRCState(rc) == rcEmpty)
+            LOGERR(klogWarn, rc, "BAM Record contains no alignment or sequence data");
+    }
+    if (*rhs) {
+        rc_t const rc2 = BAM_AlignmentDetach((BAM_Alignment *)*rhs);
+        if (rc2) {
+            BAM_AlignmentRelease(*rhs);
+            *rhs = NULL;
+            return rc2;
+        }
+    }
+    return rc;
+}
+
 /* MARK: BAM File header info accessor */
 
 rc_t BAM_FileGetRefSeqById(const BAM_File *cself, int32_t id, const BAMRefSeq **rhs)
@@ -485,7 +485,16 @@ typedef uint64_t BAM_FilePosition;
  */
 rc_t BAM_FileMake ( const BAM_File **result, const char *path, ... );
 
+/* MakeWithHeader
+ *  as above, optionally substituting the header
+ *
+ *  "inflateThreads" [ IN ] - number of threads used to inflate BGZF blocks;
+ *   values less than 2 inflate on the calling thread
+ *
+ *  "headerText" [ IN, NULL OKAY ] - replacement SAM header text
+ */
 rc_t BAM_FileMakeWithHeader ( const BAM_File **result,
+                                            unsigned inflateThreads,
                                             char const headerText[],
                                             char const path[], ... );
 
@@ -564,6 +573,19 @@ rc_t BAM_FileRead ( const BAM_File *self, const BAM_Alignment **result );
 rc_t BAM_FileRead2 ( const BAM_File *self, const BAM_Alignment **result );
 
 
+/* ReadDetached
+ *  read an aligment
+ *
+ *  "result" [ OUT ] - return param for BAM_Alignment object
+ *   must be released with BAM_AlignmentRelease; the object does not refer
+ *   to any of the BAM_File's buffers and so remains valid across reads and
+ *   may be handed to another thread
+ *
+ *  returns as BAM_FileRead2
+ */
+rc_t BAM_FileReadDetached ( const BAM_File *self, const BAM_Alignment **result );
+
+
 /* Rewind
  *  reset the position back to the first aligment in the file
  */
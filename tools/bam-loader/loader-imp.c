@@ -63,12 +63,17 @@
 #include <kapp/log-xml.h>
 #include <kapp/progressbar.h>
 
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <kproc/thread.h>
+
 #include <sysalloc.h>
 #include <atomic32.h>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -78,11 +83,13 @@
 #include <time.h>
 
 #include "bam.h"
+#include "bam-reader-thread.h"
 #include "Globals.h"
 #include "sequence-writer.h"
 #include "reference-writer.h"
 #include "alignment-writer.h"
 #include "mem-bank.h"
+#include "name-index.h"
 
 #define NUM_ID_SPACES (256u)
 
@@ -91,14 +98,33 @@
 #define MMA_SUBCHUNK_SIZE (1u << MMA_NUM_CHUNKS_BITS)
 #define MMA_SUBCHUNK_COUNT (1u << MMA_NUM_SUBCHUNKS_BITS)
 
+#define MMA_HUGE_PAGE_SIZE ((size_t)2u << 20)
+
 typedef struct {
     int fd;
     size_t elemSize;
     off_t fsize;
     uint8_t *current;
+    enum IdMapModes mode;
+    /* the rest is used only by the reserved address space modes */
+    KLock *lock;                /* serializes mapping with the prefetch thread */
+    KCondition *prefetch_cond;
+    KCondition *mapped_cond;
+    KThread *prefetcher;
+    unsigned prefetch_bin;
+    unsigned prefetch_subbin;
+    bool prefetch_pending;
+    bool mapping;               /* a subchunk is being faulted in outside the lock */
+    bool quitting;
+    uint64_t mapCount;
+    uint64_t prefetchCount;
+    uint64_t prefetchHits;
+    struct rusage startUsage;
+    uint8_t *reserved[NUM_ID_SPACES];
+    unsigned lastSubbin[NUM_ID_SPACES];
     struct mma_map_s {
         struct mma_submap_s {
-            uint8_t *base;
+            uint8_t *volatile base;
         } submap[MMA_SUBCHUNK_COUNT];
     } map[NUM_ID_SPACES];
 } MMArray;
@@ -138,6 +164,8 @@ typedef struct FragmentInfo {
 typedef struct context_t {
     const KLoadProgressbar *progress[4];
     KBTree *key2id[NUM_ID_SPACES];
+    NameIndex *key2name[NUM_ID_SPACES]; /* used instead of key2id until spilled */
+    NameIndexPool *key2name_pool;
     char *key2id_names;
     MMArray *id2value;
     MemBank *frags;
@@ -173,20 +201,198 @@ static char const *Print_ctx_value_t(ctx_value_t const *const self)
     return buffer;
 }
 
-static rc_t MMArrayMake(MMArray **rslt, int fd, uint32_t elemSize)
+#define PERF 0
+#define PROT 0
+
+/* touches every page of a new mapping so that the faults are taken now */
+static void MMArrayPrefault(uint8_t *const base, size_t const size)
+{
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(base, size, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    {
+        size_t const pagesize = (size_t)sysconf(_SC_PAGESIZE);
+        size_t i;
+
+        for (i = 0; i < size; i += pagesize)
+            ((uint8_t volatile *)base)[i] = 0;
+    }
+}
+
+/* reserves address space for all the subchunks of a bin */
+static rc_t MMArrayReserve(MMArray *const self, unsigned const bin_no)
+{
+    size_t const chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
+    size_t const size = chunk * MMA_SUBCHUNK_COUNT + MMA_HUGE_PAGE_SIZE;
+    void *const base = mmap(NULL, size, PROT_NONE,
+                            MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+
+    if (base == MAP_FAILED) {
+        PLOGMSG(klogErr, (klogErr, "Failed to reserve address space for bin $(bin)", "bin=%u", bin_no));
+        return RC(rcExe, rcMemMap, rcConstructing, rcMemory, rcExhausted);
+    }
+    {
+        /* align the start for huge pages and give back the slack */
+        uint8_t *const start = (uint8_t *)base;
+        uint8_t *const aligned = (uint8_t *)(((size_t)start + MMA_HUGE_PAGE_SIZE - 1) & ~(MMA_HUGE_PAGE_SIZE - 1));
+        uint8_t *const end = aligned + chunk * MMA_SUBCHUNK_COUNT;
+
+        if (start != aligned)
+            munmap(start, aligned - start);
+        if (end != start + size)
+            munmap(end, (start + size) - end);
+        self->reserved[bin_no] = aligned;
+    }
+    return 0;
+}
+
+/* maps the subchunk into the bin's reserved address space
+ * caller holds the lock; it is released while the pages are faulted in
+ */
+static rc_t MMArrayMapReserved(MMArray *const self, unsigned const bin_no, unsigned const subbin)
+{
+    size_t const chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
+    uint8_t *addr;
+    void *base;
+
+    while (self->mapping)
+        KConditionWait(self->mapped_cond, self->lock);
+    if (self->map[bin_no].submap[subbin].base != NULL)
+        return 0;
+
+    if (self->reserved[bin_no] == NULL) {
+        rc_t const rc = MMArrayReserve(self, bin_no);
+        if (rc)
+            return rc;
+    }
+    addr = self->reserved[bin_no] + (size_t)subbin * chunk;
+    if (self->mode == idmap_Memory) {
+        base = mmap(addr, chunk, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED|MAP_NORESERVE, -1, 0);
+#ifdef MADV_HUGEPAGE
+        if (base != MAP_FAILED)
+            madvise(base, chunk, MADV_HUGEPAGE);
+#endif
+    }
+    else {
+        off_t const cur_fsize = self->fsize;
+        off_t const new_fsize = cur_fsize + chunk;
+
+        if (ftruncate(self->fd, new_fsize) != 0)
+            return RC(rcExe, rcFile, rcResizing, rcSize, rcExcessive);
+        self->fsize = new_fsize;
+        base = mmap(addr, chunk, PROT_READ|PROT_WRITE,
+                    MAP_FILE|MAP_SHARED|MAP_FIXED, self->fd, cur_fsize);
+#ifdef MADV_HUGEPAGE
+        if (base != MAP_FAILED)
+            madvise(base, chunk, MADV_HUGEPAGE); /* effective only on tmpfs mounted with huge pages enabled */
+#endif
+    }
+    if (base == MAP_FAILED) {
+        PLOGMSG(klogErr, (klogErr, "Failed to construct map for bin $(bin), subbin $(subbin)", "bin=%u,subbin=%u", bin_no, subbin));
+        return RC(rcExe, rcMemMap, rcConstructing, rcMemory, rcExhausted);
+    }
+    self->mapping = true;
+    KLockUnlock(self->lock);
+    MMArrayPrefault(base, chunk);
+    KLockAcquire(self->lock);
+    self->mapping = false;
+    ++self->mapCount;
+    self->map[bin_no].submap[subbin].base = base;
+    KConditionBroadcast(self->mapped_cond);
+    return 0;
+}
+
+static rc_t CC MMArrayPrefetchThread(KThread const *const th, void *const vp)
+{
+    MMArray *const self = vp;
+
+    KLockAcquire(self->lock);
+    for ( ; ; ) {
+        while (!self->prefetch_pending && !self->quitting)
+            KConditionWait(self->prefetch_cond, self->lock);
+        if (self->quitting)
+            break;
+        self->prefetch_pending = false;
+        if (self->map[self->prefetch_bin].submap[self->prefetch_subbin].base == NULL) {
+            if (MMArrayMapReserved(self, self->prefetch_bin, self->prefetch_subbin) == 0)
+                ++self->prefetchCount;
+        }
+    }
+    KLockUnlock(self->lock);
+    return 0;
+}
+
+/* asks the prefetch thread to map the subchunk after this one */
+static void MMArrayPrefetchNext(MMArray *const self, unsigned const bin_no, unsigned const subbin)
+{
+    if (subbin + 1 >= MMA_SUBCHUNK_COUNT)
+        return;
+    KLockAcquire(self->lock);
+    self->prefetch_bin = bin_no;
+    self->prefetch_subbin = subbin + 1;
+    self->prefetch_pending = true;
+    KConditionSignal(self->prefetch_cond);
+    KLockUnlock(self->lock);
+}
+
+static rc_t MMArrayMake(MMArray **rslt, int fd, uint32_t elemSize, enum IdMapModes mode)
 {
     MMArray *const self = calloc(1, sizeof(*self));
+    rc_t rc;
 
     if (self == NULL)
         return RC(rcExe, rcMemMap, rcConstructing, rcMemory, rcExhausted);
     self->elemSize = (elemSize + 3) & ~(3u); /** align to 4 byte **/
     self->fd = fd;
+    self->mode = mode;
+    getrusage(RUSAGE_SELF, &self->startUsage);
+    if (mode != idmap_File) {
+        rc = KLockMake(&self->lock);
+        if (rc == 0)
+            rc = KConditionMake(&self->prefetch_cond);
+        if (rc == 0)
+            rc = KConditionMake(&self->mapped_cond);
+        if (rc == 0)
+            rc = KThreadMake(&self->prefetcher, MMArrayPrefetchThread, self);
+        if (rc) {
+            KConditionRelease(self->mapped_cond);
+            KConditionRelease(self->prefetch_cond);
+            KLockRelease(self->lock);
+            free(self);
+            return rc;
+        }
+    }
     *rslt = self;
     return 0;
 }
 
-#define PERF 0
-#define PROT 0
+static rc_t MMArrayGetReserved(MMArray *const self, void **const value,
+                               unsigned const bin_no, unsigned const subbin, unsigned const in_bin)
+{
+    uint8_t *base = self->map[bin_no].submap[subbin].base;
+
+    if (base == NULL) {
+        rc_t rc;
+
+        KLockAcquire(self->lock);
+        rc = MMArrayMapReserved(self, bin_no, subbin);
+        KLockUnlock(self->lock);
+        if (rc)
+            return rc;
+        base = self->map[bin_no].submap[subbin].base;
+    }
+    else if (subbin > self->lastSubbin[bin_no])
+        ++self->prefetchHits;
+
+    if (subbin > self->lastSubbin[bin_no] || (subbin == 0 && self->lastSubbin[bin_no] == 0 && in_bin == 0)) {
+        self->lastSubbin[bin_no] = subbin;
+        MMArrayPrefetchNext(self, bin_no, subbin);
+    }
+    *value = &base[(size_t)in_bin * self->elemSize];
+    return 0;
+}
 
 static rc_t MMArrayGet(MMArray *const self, void **const value, uint64_t const element)
 {
@@ -198,6 +404,9 @@ static rc_t MMArrayGet(MMArray *const self, void **const value, uint64_t const e
     if (bin_no >= sizeof(self->map)/sizeof(self->map[0]))
         return RC(rcExe, rcMemMap, rcConstructing, rcId, rcExcessive);
 
+    if (self->mode != idmap_File)
+        return MMArrayGetReserved(self, value, bin_no, subbin, in_bin);
+
     if (self->map[bin_no].submap[subbin].base == NULL) {
         off_t const cur_fsize = self->fsize;
         off_t const new_fsize = cur_fsize + chunk;
@@ -219,6 +428,7 @@ static rc_t MMArrayGet(MMArray *const self, void **const value, uint64_t const e
 
                 (void)PLOGMSG(klogInfo, (klogInfo, "Number of mmaps: $(cnt)", "cnt=%u", ++mapcount));
 #endif
+                ++self->mapCount;
                 self->map[bin_no].submap[subbin].base = base;
             }
         }
@@ -278,19 +488,52 @@ static void MMArrayLock(MMArray *const self)
 #endif
 }
 
+static void MMArrayReport(MMArray const *const self)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    (void)PLOGMSG(klogInfo, (klogInfo, "id2value: $(maps) mmaps of $(size) MB; $(pref) prefetched, $(hits) used before first touch; "
+                             "process page faults since start: $(minflt) minor, $(majflt) major",
+                             "maps=%lu,size=%lu,pref=%lu,hits=%lu,minflt=%lu,majflt=%lu",
+                             (unsigned long)self->mapCount,
+                             (unsigned long)((self->mapCount * MMA_SUBCHUNK_SIZE * self->elemSize) >> 20),
+                             (unsigned long)self->prefetchCount,
+                             (unsigned long)self->prefetchHits,
+                             (unsigned long)(usage.ru_minflt - self->startUsage.ru_minflt),
+                             (unsigned long)(usage.ru_majflt - self->startUsage.ru_majflt)));
+}
+
 static void MMArrayWhack(MMArray *self)
 {
     size_t const chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
     unsigned i;
 
+    if (self->prefetcher) {
+        KLockAcquire(self->lock);
+        self->quitting = true;
+        KConditionSignal(self->prefetch_cond);
+        KLockUnlock(self->lock);
+        KThreadWait(self->prefetcher, NULL);
+        KThreadRelease(self->prefetcher);
+    }
     for (i = 0; i != sizeof(self->map)/sizeof(self->map[0]); ++i) {
-        unsigned j;
+        if (self->reserved[i]) {
+            /* the subchunks are inside the reservation */
+            munmap(self->reserved[i], chunk * MMA_SUBCHUNK_COUNT);
+        }
+        else {
+            unsigned j;
 
-        for (j = 0; j != sizeof(self->map[0].submap)/sizeof(self->map[0].submap[0]); ++j) {
-            if (self->map[i].submap[j].base)
-            	munmap(self->map[i].submap[j].base, chunk);
+            for (j = 0; j != sizeof(self->map[0].submap)/sizeof(self->map[0].submap[0]); ++j) {
+                if (self->map[i].submap[j].base)
+                    munmap(self->map[i].submap[j].base, chunk);
+            }
         }
     }
+    KConditionRelease(self->mapped_cond);
+    KConditionRelease(self->prefetch_cond);
+    KLockRelease(self->lock);
     close(self->fd);
     free(self);
 }
@@ -330,6 +573,92 @@ static rc_t OpenKBTree(KBTree **const rslt, unsigned n, unsigned max)
     return rc;
 }
 
+/* the name indices share what would have been the KBTrees' page caches */
+#define NAME_INDEX_MEMORY (G.cache_size - (G.cache_size / 2) - (G.cache_size / 8))
+
+static rc_t OpenKeyIndex(context_t *const ctx, unsigned const f)
+{
+    if (G.useNameHash) {
+        if (ctx->key2name_pool == NULL) {
+            rc_t const rc = NameIndexPoolMake(&ctx->key2name_pool, NAME_INDEX_MEMORY);
+            if (rc) return rc;
+        }
+        return NameIndexMake(&ctx->key2name[f], ctx->key2name_pool);
+    }
+    return OpenKBTree(&ctx->key2id[f], f + 1, 1);
+}
+
+static rc_t SpillKeyIndexEntry(void *const tree, char const name[], size_t const namelen, uint32_t const id)
+{
+    uint64_t tmpKey = id;
+    bool wasInserted;
+
+    return KBTreeEntry(tree, &tmpKey, &wasInserted, name, namelen);
+}
+
+/* moves the largest in-memory name index to a disk-backed KBTree */
+static rc_t SpillKeyIndex(context_t *const ctx)
+{
+    unsigned largest = ctx->key2id_count;
+    unsigned i;
+    rc_t rc;
+
+    for (i = 0; i < ctx->key2id_count; ++i) {
+        if (ctx->key2name[i] == NULL)
+            continue;
+        if (largest == ctx->key2id_count || NameIndexCount(ctx->key2name[i]) > NameIndexCount(ctx->key2name[largest]))
+            largest = i;
+    }
+    if (largest == ctx->key2id_count)
+        return RC(rcExe, rcIndex, rcInserting, rcMemory, rcExhausted);
+
+    (void)PLOGMSG(klogInfo, (klogInfo, "Moving name index $(idx) with $(count) names to disk",
+                             "idx=%u,count=%u", largest, NameIndexCount(ctx->key2name[largest])));
+    rc = OpenKBTree(&ctx->key2id[largest], largest + 1, 1);
+    if (rc == 0)
+        rc = NameIndexForEach(ctx->key2name[largest], SpillKeyIndexEntry, ctx->key2id[largest]);
+    NameIndexWhack(ctx->key2name[largest]);
+    ctx->key2name[largest] = NULL;
+    return rc;
+}
+
+static rc_t KeyIndexEntry(context_t *const ctx, unsigned const f, uint64_t *const id, bool *const wasInserted, char const name[], size_t const namelen)
+{
+    while (ctx->key2name[f] != NULL) {
+        uint32_t id32;
+        rc_t rc = NameIndexEntry(ctx->key2name[f], &id32, wasInserted, name, namelen);
+
+        if (rc == 0) {
+            *id = id32;
+            return 0;
+        }
+        if (GetRCObject(rc) != (enum RCObject)rcMemory || GetRCState(rc) != rcExhausted)
+            return rc;
+        rc = SpillKeyIndex(ctx);
+        if (rc)
+            return rc;
+    }
+    *id = ctx->idCount[f];
+    return KBTreeEntry(ctx->key2id[f], id, wasInserted, name, namelen);
+}
+
+static void ReleaseKeyIndices(context_t *const ctx)
+{
+    unsigned i;
+
+    for (i = 0; i != ctx->key2id_count; ++i) {
+        if (ctx->key2id[i]) {
+            KBTreeDropBacking(ctx->key2id[i]);
+            KBTreeRelease(ctx->key2id[i]);
+            ctx->key2id[i] = NULL;
+        }
+        NameIndexWhack(ctx->key2name[i]);
+        ctx->key2name[i] = NULL;
+    }
+    NameIndexPoolRelease(ctx->key2name_pool);
+    ctx->key2name_pool = NULL;
+}
+
 static rc_t GetKeyIDOld(context_t *const ctx, uint64_t *const rslt, bool *const wasInserted, char const key[], char const name[], unsigned const namelen)
 {
     unsigned const keylen = strlen(key);
@@ -337,14 +666,13 @@ static rc_t GetKeyIDOld(context_t *const ctx, uint64_t *const rslt, bool *const
     uint64_t tmpKey;
 
     if (ctx->key2id_count == 0) {
-        rc = OpenKBTree(&ctx->key2id[0], 1, 1);
+        rc = OpenKeyIndex(ctx, 0);
         if (rc) return rc;
         ctx->key2id_count = 1;
     }
     if (memcmp(key, name, keylen) == 0) {
         /* qname starts with read group; no append */
-        tmpKey = ctx->idCount[0];
-        rc = KBTreeEntry(ctx->key2id[0], &tmpKey, wasInserted, name, namelen);
+        rc = KeyIndexEntry(ctx, 0, &tmpKey, wasInserted, name, namelen);
     }
     else {
         char sbuf[4096];
@@ -361,8 +689,7 @@ static rc_t GetKeyIDOld(context_t *const ctx, uint64_t *const rslt, bool *const
         }
         rc = string_printf(buf, bsize, &actsize, "%s\t%.*s", key, (int)namelen, name);
 
-        tmpKey = ctx->idCount[0];
-        rc = KBTreeEntry(ctx->key2id[0], &tmpKey, wasInserted, buf, actsize);
+        rc = KeyIndexEntry(ctx, 0, &tmpKey, wasInserted, buf, actsize);
         if (hbuf)
             free(hbuf);
     }
@@ -528,8 +855,7 @@ rc_t GetKeyID(context_t *const ctx,
         }
         if (ctx->key2id_count < ctx->key2id_max) {
             unsigned const name_max = ctx->key2id_name_max + keylen + 1;
-            KBTree *tree;
-            rc_t rc = OpenKBTree(&tree, ctx->key2id_count + 1, 1); /* ctx->key2id_max); */
+            rc_t rc = OpenKeyIndex(ctx, ctx->key2id_count);
 
             if (rc) return rc;
 
@@ -557,7 +883,6 @@ rc_t GetKeyID(context_t *const ctx,
             ctx->key2id_name_max = name_max;
 
             memcpy(&ctx->key2id_names[ctx->key2id_name[f]], key, keylen + 1);
-            ctx->key2id[f] = tree;
             ctx->idCount[f] = 0;
             if ((uint8_t)ctx->key2id_hash[h] < 3) {
                 unsigned const n = (uint8_t)ctx->key2id_hash[h] + 1;
@@ -571,8 +896,7 @@ rc_t GetKeyID(context_t *const ctx,
                 ctx->key2id_hash[h] = (((ctx->key2id_hash[h] & ~(0xFFu)) | f) << 8) | 3;
             }
         GET_ID:
-            tmpKey = ctx->idCount[f];
-            rc = KBTreeEntry(ctx->key2id[f], &tmpKey, wasInserted, name, namelen);
+            rc = KeyIndexEntry(ctx, f, &tmpKey, wasInserted, name, namelen);
             if (rc == 0) {
                 *rslt = (((uint64_t)f) << 32) | tmpKey;
                 if (*wasInserted)
@@ -598,7 +922,7 @@ static rc_t OpenMMapFile(context_t *const ctx, KDirectory *const dir)
     if (fd < 0)
         return RC(rcExe, rcFile, rcCreating, rcFile, rcNotFound);
     unlink(fname);
-    return MMArrayMake(&ctx->id2value, fd, sizeof(ctx_value_t));
+    return MMArrayMake(&ctx->id2value, fd, sizeof(ctx_value_t), G.idMapMode);
 }
 
 static rc_t TmpfsDirectory(KDirectory **const rslt)
@@ -654,7 +978,10 @@ static void ContextRelease(context_t *ctx)
     KLoadProgressbar_Release(ctx->progress[1], true);
     KLoadProgressbar_Release(ctx->progress[2], true);
     KLoadProgressbar_Release(ctx->progress[3], true);
-    MMArrayWhack(ctx->id2value);
+    if (ctx->id2value) {
+        MMArrayReport(ctx->id2value);
+        MMArrayWhack(ctx->id2value);
+    }
 }
 
 static
@@ -721,7 +1048,7 @@ void COPY_READ(INSDC_dna_text D[], INSDC_dna_text const S[], unsigned const L, b
 
 static rc_t OpenBAM(const BAM_File **bam, VDatabase *db, const char bamFile[])
 {
-    rc_t rc = BAM_FileMakeWithHeader(bam, G.headerText, "%s", bamFile);
+    rc_t rc = BAM_FileMakeWithHeader(bam, G.inflateThreads, G.headerText, "%s", bamFile);
     if (rc) {
         (void)PLOGERR(klogErr, (klogErr, rc, "Failed to open '$(file)'", "file=%s", bamFile));
     }
@@ -1158,6 +1485,7 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
                        bool *had_alignments, bool *had_sequences)
 {
     const BAM_File *bam;
+    BAM_Reader *reader;
     const BAM_Alignment *rec;
     KDataBuffer buf;
     KDataBuffer fragBuf;
@@ -1232,6 +1560,13 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
     if (rc)
         return rc;
 
+    rc = BAM_ReaderMake(&reader, bam, G.parseQueueDepth);
+    if (rc) {
+        (void)LOGERR(klogErr, rc, "Failed to start BAM parsing thread");
+        BAM_FileRelease(bam);
+        return rc;
+    }
+
     if (rc == 0) {
         (void)PLOGMSG(klogInfo, (klogInfo, "Loading '$(file)'", "file=%s", bamFile));
     }
@@ -1256,7 +1591,7 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
         uint64_t ti = 0;
         uint32_t csSeqLen = 0;
 
-        rc = BAM_FileRead2(bam, &rec);
+        rc = BAM_ReaderRead(reader, &rec);
         if (rc) {
             if (GetRCModule(rc) == rcAlign && GetRCObject(rc) == rcRow && GetRCState(rc) == rcNotFound) {
                 (void)PLOGMSG(klogInfo, (klogInfo, "EOF '$(file)'; read $(read); processed $(proc)", "file=%s,read=%lu,proc=%lu", bamFile, (unsigned long)recordsRead, (unsigned long)recordsProcessed));
@@ -1276,7 +1611,7 @@ static rc_t ProcessBAM(char const bamFile[], context_t *ctx, VDatabase *db,
         ++recordsRead;
         
         {
-            float const new_value = BAM_FileGetProportionalPosition(bam) * 100.0;
+            float const new_value = BAM_ReaderGetProportionalPosition(reader) * 100.0;
             float const delta = new_value - progress;
             if (delta > 1.0) {
                 KLoadProgressbar_Process(ctx->progress[0], delta, false);
@@ -1530,7 +1865,7 @@ MIXED_BASE_AND_COLOR:
         }
         rc = GetKeyID(ctx, &keyId, &wasInserted, spotGroup, name, namelen);
         if (rc) {
-            (void)PLOGERR(klogErr, (klogErr, rc, "KBTreeEntry: failed on key '$(key)'", "key=%.*s", namelen, name));
+            (void)PLOGERR(klogErr, (klogErr, rc, "GetKeyID: failed on key '$(key)'", "key=%.*s", namelen, name));
             goto LOOP_END;
         }
         rc = MMArrayGet(ctx->id2value, (void **)&value, keyId);
@@ -2064,6 +2399,15 @@ MIXED_BASE_AND_COLOR:
                      "The file contained no records that were processed.");
         rc = RC(rcAlign, rcFile, rcReading, rcData, rcEmpty);
     }
+    if (G.parseQueueDepth > 0) {
+        uint64_t parserStalls;
+        uint64_t consumerStalls;
+
+        BAM_ReaderGetStalls(reader, &parserStalls, &consumerStalls);
+        (void)PLOGMSG(klogInfo, (klogInfo, "Parsing thread waited on a full queue $(parser) times; loader waited on an empty queue $(consumer) times",
+                                 "parser=%lu,consumer=%lu", (unsigned long)parserStalls, (unsigned long)consumerStalls));
+    }
+    BAM_ReaderRelease(reader);
     BAM_FileRelease(bam);
     MMArrayLock(ctx->id2value);
     KDataBufferWhack(&buf);
@@ -2309,11 +2653,7 @@ static rc_t ArchiveBAM(VDBManager *mgr, VDatabase *db,
         has_sequences |= this_has_sequences;
     }
 /*** No longer need memory for key2id ***/
-    for (i = 0; i != ctx.key2id_count; ++i) {
-        KBTreeDropBacking(ctx.key2id[i]);
-        KBTreeRelease(ctx.key2id[i]);
-        ctx.key2id[i] = NULL;
-    }
+    ReleaseKeyIndices(&ctx);
     free(ctx.key2id_names);
     ctx.key2id_names = NULL;
 /*******************/
@@ -0,0 +1,351 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#include <klib/rc.h>
+#include <kproc/lock.h>
+
+#include <sysalloc.h>
+#include <atomic32.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "name-index.h"
+
+#define NUM_SHARDS_BITS (6u)
+#define NUM_SHARDS (1u << NUM_SHARDS_BITS)
+#define INITIAL_SLOTS (64u)
+#define ARENA_CHUNK_SIZE (64u * 1024u)
+
+typedef struct NameIndexSlot NameIndexSlot;
+typedef struct NameIndexChunk NameIndexChunk;
+typedef struct NameIndexShard NameIndexShard;
+
+struct NameIndexSlot {
+    uint64_t fp;
+    char const *name;   /* NULL if slot is empty */
+    uint32_t id;
+    uint32_t namelen;
+};
+
+/* names are copied into a list of chunks that is only freed with the index */
+struct NameIndexChunk {
+    NameIndexChunk *next;
+    size_t used;
+    size_t size;
+    char data[1];
+};
+
+struct NameIndexShard {
+    KLock *lock;
+    NameIndexSlot *slot;
+    NameIndexChunk *arena;
+    unsigned size;      /* number of slots; power of 2 */
+    unsigned count;     /* number of occupied slots */
+};
+
+struct NameIndex {
+    NameIndexPool *pool;
+    atomic32_t nextId;
+    NameIndexShard shard[NUM_SHARDS];
+};
+
+struct NameIndexPool {
+    KLock *lock;
+    size_t max;
+    size_t used;
+};
+
+/* MARK: NameIndexPool */
+
+rc_t NameIndexPoolMake(NameIndexPool **const rslt, size_t const maxMemory)
+{
+    NameIndexPool *const self = calloc(1, sizeof(*self));
+    rc_t rc;
+
+    *rslt = NULL;
+    if (self == NULL)
+        return RC(rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted);
+
+    rc = KLockMake(&self->lock);
+    if (rc) {
+        free(self);
+        return rc;
+    }
+    self->max = maxMemory;
+    *rslt = self;
+    return 0;
+}
+
+void NameIndexPoolRelease(NameIndexPool *const self)
+{
+    if (self) {
+        KLockRelease(self->lock);
+        free(self);
+    }
+}
+
+size_t NameIndexPoolUsed(NameIndexPool const *const self)
+{
+    return self->used;
+}
+
+static bool NameIndexPoolReserve(NameIndexPool *const self, size_t const size)
+{
+    bool ok = false;
+
+    KLockAcquire(self->lock);
+    if (self->used + size <= self->max) {
+        self->used += size;
+        ok = true;
+    }
+    KLockUnlock(self->lock);
+    return ok;
+}
+
+static void NameIndexPoolReturn(NameIndexPool *const self, size_t const size)
+{
+    KLockAcquire(self->lock);
+    assert(self->used >= size);
+    self->used -= size;
+    KLockUnlock(self->lock);
+}
+
+/* MARK: NameIndex */
+
+static uint64_t Fingerprint(char const name[], size_t const namelen)
+{
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325;
+    size_t i;
+
+    for (i = 0; i < namelen; ++i)
+        h = (h ^ (uint8_t)name[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static void NameIndexShardWhack(NameIndexShard *const self, NameIndexPool *const pool)
+{
+    NameIndexChunk *chunk = self->arena;
+
+    while (chunk) {
+        NameIndexChunk *const next = chunk->next;
+
+        NameIndexPoolReturn(pool, sizeof(*chunk) + chunk->size);
+        free(chunk);
+        chunk = next;
+    }
+    if (self->slot) {
+        NameIndexPoolReturn(pool, self->size * sizeof(self->slot[0]));
+        free(self->slot);
+    }
+    KLockRelease(self->lock);
+}
+
+void NameIndexWhack(NameIndex *const self)
+{
+    if (self) {
+        unsigned i;
+
+        for (i = 0; i < NUM_SHARDS; ++i)
+            NameIndexShardWhack(&self->shard[i], self->pool);
+        free(self);
+    }
+}
+
+rc_t NameIndexMake(NameIndex **const rslt, NameIndexPool *const pool)
+{
+    NameIndex *const self = calloc(1, sizeof(*self));
+    unsigned i;
+
+    *rslt = NULL;
+    if (self == NULL)
+        return RC(rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted);
+
+    self->pool = pool;
+    for (i = 0; i < NUM_SHARDS; ++i) {
+        rc_t const rc = KLockMake(&self->shard[i].lock);
+        if (rc) {
+            NameIndexWhack(self);
+            return rc;
+        }
+    }
+    *rslt = self;
+    return 0;
+}
+
+uint32_t NameIndexCount(NameIndex const *const self)
+{
+    return (uint32_t)atomic32_read(&self->nextId);
+}
+
+static NameIndexSlot *NameIndexShardFind(NameIndexSlot *const slot, unsigned const size,
+                                         uint64_t const fp, char const name[], size_t const namelen)
+{
+    unsigned const mask = size - 1;
+    unsigned i = (unsigned)fp & mask;
+
+    for ( ; ; i = (i + 1) & mask) {
+        NameIndexSlot *const cur = &slot[i];
+
+        if (cur->name == NULL)
+            return cur;
+        if (cur->fp == fp && cur->namelen == namelen && memcmp(cur->name, name, namelen) == 0)
+            return cur;
+    }
+}
+
+static rc_t NameIndexShardGrow(NameIndexShard *const self, NameIndexPool *const pool)
+{
+    unsigned const newSize = self->size ? self->size * 2 : INITIAL_SLOTS;
+    NameIndexSlot *newSlot;
+    unsigned i;
+
+    if (!NameIndexPoolReserve(pool, newSize * sizeof(newSlot[0])))
+        return RC(rcExe, rcIndex, rcInserting, rcMemory, rcExhausted);
+
+    newSlot = calloc(newSize, sizeof(newSlot[0]));
+    if (newSlot == NULL) {
+        NameIndexPoolReturn(pool, newSize * sizeof(newSlot[0]));
+        return RC(rcExe, rcIndex, rcInserting, rcMemory, rcExhausted);
+    }
+    for (i = 0; i < self->size; ++i) {
+        NameIndexSlot const *const cur = &self->slot[i];
+
+        if (cur->name) {
+            unsigned const mask = newSize - 1;
+            unsigned j = (unsigned)cur->fp & mask;
+
+            while (newSlot[j].name != NULL)
+                j = (j + 1) & mask;
+            newSlot[j] = *cur;
+        }
+    }
+    if (self->slot) {
+        NameIndexPoolReturn(pool, self->size * sizeof(self->slot[0]));
+        free(self->slot);
+    }
+    self->slot = newSlot;
+    self->size = newSize;
+    return 0;
+}
+
+static char const *NameIndexShardCopyName(NameIndexShard *const self, NameIndexPool *const pool,
+                                          char const name[], size_t const namelen)
+{
+    NameIndexChunk *chunk = self->arena;
+
+    if (chunk == NULL || chunk->size - chunk->used < namelen) {
+        size_t const size = namelen > ARENA_CHUNK_SIZE ? namelen : ARENA_CHUNK_SIZE;
+
+        if (!NameIndexPoolReserve(pool, sizeof(*chunk) + size))
+            return NULL;
+        chunk = malloc(sizeof(*chunk) + size);
+        if (chunk == NULL) {
+            NameIndexPoolReturn(pool, sizeof(*chunk) + size);
+            return NULL;
+        }
+        chunk->next = self->arena;
+        chunk->used = 0;
+        chunk->size = size;
+        self->arena = chunk;
+    }
+    {
+        char *const dst = &chunk->data[chunk->used];
+
+        memcpy(dst, name, namelen);
+        chunk->used += namelen;
+        return dst;
+    }
+}
+
+rc_t NameIndexEntry(NameIndex *const self, uint32_t *const id, bool *const wasInserted,
+                    char const name[], size_t const namelen)
+{
+    uint64_t const fp = Fingerprint(name, namelen);
+    NameIndexShard *const shard = &self->shard[fp >> (64 - NUM_SHARDS_BITS)];
+    NameIndexSlot *slot;
+    rc_t rc = 0;
+
+    *wasInserted = false;
+    KLockAcquire(shard->lock);
+    /* keep the load factor at or below 3/4 */
+    if (shard->size == 0 || (shard->count + 1) * 4 > shard->size * 3) {
+        if (shard->size != 0) {
+            slot = NameIndexShardFind(shard->slot, shard->size, fp, name, namelen);
+            if (slot->name != NULL)
+                goto FOUND;
+        }
+        rc = NameIndexShardGrow(shard, self->pool);
+        if (rc) {
+            KLockUnlock(shard->lock);
+            return rc;
+        }
+    }
+    slot = NameIndexShardFind(shard->slot, shard->size, fp, name, namelen);
+    if (slot->name == NULL) {
+        char const *const copy = NameIndexShardCopyName(shard, self->pool, name, namelen);
+
+        if (copy == NULL) {
+            KLockUnlock(shard->lock);
+            return RC(rcExe, rcIndex, rcInserting, rcMemory, rcExhausted);
+        }
+        slot->fp = fp;
+        slot->namelen = (uint32_t)namelen;
+        slot->id = (uint32_t)atomic32_read_and_add(&self->nextId, 1);
+        slot->name = copy;
+        ++shard->count;
+        *wasInserted = true;
+    }
+FOUND:
+    *id = slot->id;
+    KLockUnlock(shard->lock);
+    return 0;
+}
+
+rc_t NameIndexForEach(NameIndex const *const self,
+                      rc_t (*const f)(void *ctx, char const name[], size_t namelen, uint32_t id),
+                      void *const ctx)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_SHARDS; ++i) {
+        NameIndexShard const *const shard = &self->shard[i];
+        unsigned j;
+
+        for (j = 0; j < shard->size; ++j) {
+            NameIndexSlot const *const slot = &shard->slot[j];
+
+            if (slot->name) {
+                rc_t const rc = f(ctx, slot->name, slot->namelen, slot->id);
+                if (rc)
+                    return rc;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#ifndef BAM_LOAD_NAME_INDEX_H_
+#define BAM_LOAD_NAME_INDEX_H_ 1
+
+#include <klib/rc.h>
+
+/*--------------------------------------------------------------------------
+ * NameIndex
+ *  an in-memory map from read name to a dense 32-bit id
+ *  open-addressing tables of 64-bit name fingerprints, sharded on the
+ *  fingerprint; each shard has its own lock so inserts may come from
+ *  several threads
+ *
+ * NameIndexPool
+ *  the memory budget shared by a set of NameIndex objects
+ */
+typedef struct NameIndex NameIndex;
+typedef struct NameIndexPool NameIndexPool;
+
+rc_t NameIndexPoolMake(NameIndexPool **rslt, size_t maxMemory);
+void NameIndexPoolRelease(NameIndexPool *self);
+size_t NameIndexPoolUsed(NameIndexPool const *self);
+
+rc_t NameIndexMake(NameIndex **rslt, NameIndexPool *pool);
+void NameIndexWhack(NameIndex *self);
+
+/* Entry
+ *  find the id of the name, inserting it with the next id if not found
+ *
+ *  returns (rcMemory, rcExhausted) without inserting if the pool's budget
+ *  would be exceeded; the caller is expected to spill the index to disk
+ */
+rc_t NameIndexEntry(NameIndex *self, uint32_t *id, bool *wasInserted,
+                    char const name[], size_t namelen);
+
+uint32_t NameIndexCount(NameIndex const *self);
+
+/* ForEach
+ *  calls f for each name in no particular order; stops on the first
+ *  non-zero return
+ *  not safe with concurrent inserts
+ */
+rc_t NameIndexForEach(NameIndex const *self,
+                      rc_t (*f)(void *ctx, char const name[], size_t namelen, uint32_t id),
+                      void *ctx);
+
+#endif /* BAM_LOAD_NAME_INDEX_H_ */
@@ -12,10 +12,12 @@
 
 #include <string.h>         /* strcmp () */
 
+#include <algorithm>
+
 #include "args.hpp"
 #include "filters.hpp"
 
-#include "koutstream"
+#include "outarena.hpp"
 
 namespace ngs {
 
@@ -473,9 +475,55 @@ setupFilters ( AFilters & Filters, const DumpArgs & TheArgs )
     }
 }   /* setupFilters () */
 
+/*)  Writes defline "<Lead><CollectionName>.<SpotId> <ReadName> length=<Length>"
+ (*/
+static inline
+char *
+putDefline (
+        char * At,
+        char Lead,
+        int64_t SpotId,
+        const ngs :: String & CollectionName,
+        const StringRef & ReadName,
+        uint64_t Length
+)
+{
+    At = AOutArena :: putChar ( At, Lead );
+    At = AOutArena :: putString ( At, CollectionName );
+    At = AOutArena :: putChar ( At, '.' );
+    At = AOutArena :: putInt ( At, SpotId );
+    At = AOutArena :: putChar ( At, ' ' );
+    At = AOutArena :: putString ( At, ReadName );
+    At = AOutArena :: putChars ( At, " length=", 8 );
+    At = AOutArena :: putUint ( At, Length );
+    At = AOutArena :: putChar ( At, '\n' );
+
+    return At;
+}   /* putDefline () */
+
+static inline
+size_t
+deflineSize (
+        const ngs :: String & CollectionName,
+        const StringRef & ReadName
+)
+{
+    return 1                /* lead */
+        + CollectionName . size ()
+        + 1                 /* '.' */
+        + AOutArena :: _sM_maxIntChars
+        + 1                 /* ' ' */
+        + ReadName . size ()
+        + 8                 /* " length=" */
+        + AOutArena :: _sM_maxIntChars
+        + 1                 /* '\n' */
+        ;
+}   /* deflineSize () */
+
 static
 void
 dumpFastQ (
+        AOutArena & Arena,
         int64_t SpotId,
         const ngs :: String & CollectionName,
         const ReadIterator & Iterator
@@ -487,48 +535,61 @@ dumpFastQ (
     StringRef Bases = Iterator . getReadBases ();
     StringRef Qualities = Iterator . getReadQualities ();
 
+    size_t DefSize = deflineSize ( CollectionName, ReadName );
+
+    char * Pos = Arena . reserve (
+                                DefSize + Bases . size () + 1
+                                + DefSize + Qualities . size () + 1
+                                );
+
         /*)  First, we are doint base header
          (*/
-    kout << "@"
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << Bases . size ()
-        << '\n'
-        ;
+    char * Defline = Pos;
+    Pos = putDefline (
+                    Pos,
+                    '@',
+                    SpotId,
+                    CollectionName,
+                    ReadName,
+                    Bases . size ()
+                    );
+    size_t DefLen = Pos - Defline;
 
         /*)  Second is going base itsefl
          (*/
-    kout << Bases
-        << '\n'
-        ;
+    Pos = AOutArena :: putString ( Pos, Bases );
+    Pos = AOutArena :: putChar ( Pos, '\n' );
 
-        /*)  Third, header for qualities
-         (*/
-    kout << '+'
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << Qualities . size ()
-        << '\n'
-        ;
+        /*)  Third, header for qualities : it is the same as for
+         /   bases, if lengths are matching
+        (*/
+    if ( Qualities . size () == Bases . size () ) {
+        Pos = AOutArena :: putChar ( Pos, '+' );
+        Pos = AOutArena :: putChars ( Pos, Defline + 1, DefLen - 1 );
+    }
+    else {
+        Pos = putDefline (
+                        Pos,
+                        '+',
+                        SpotId,
+                        CollectionName,
+                        ReadName,
+                        Qualities . size ()
+                        );
+    }
 
         /*)  Finally there are qualities
          (*/
-    kout << Qualities
-        << '\n'
-        ;
+    Pos = AOutArena :: putString ( Pos, Qualities );
+    Pos = AOutArena :: putChar ( Pos, '\n' );
+
+    Arena . commit ( Pos );
 }   /* dumpFastQ () */
 
 static
 void
 dumpFastA (
+        AOutArena & Arena,
         int64_t SpotId,
         const ngs :: String & CollectionName,
         const ReadIterator & Iterator,
@@ -541,19 +602,18 @@ dumpFastA (
     StringRef Bases = Iterator . getReadBases ();
 
     uint64_t __l = Bases . size ();
+    uint64_t __lines = ( 0 < Width ) ? ( ( __l + Width - 1 ) / Width ) : 1;
+
+    char * Pos = Arena . reserve (
+                                deflineSize ( CollectionName, ReadName )
+                                + __l
+                                + __lines
+                                + 1
+                                );
 
         /*)  First, we are doing base header
          (*/
-    kout << '>'
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << __l
-        << '\n'
-        ;
+    Pos = putDefline ( Pos, '>', SpotId, CollectionName, ReadName, __l );
 
         /*)  Second is going base itself by width
          (*/
@@ -566,15 +626,18 @@ dumpFastA (
         while ( __p < __l ) {
             uint64_t __t = std :: min ( Width, __l - __p );
 
-            kout << std :: string ( __s, ( std :: string :: size_type ) __p, ( std :: string :: size_type ) __t ) << "\n" ;
+            Pos = AOutArena :: putChars ( Pos, __s + __p, __t );
+            Pos = AOutArena :: putChar ( Pos, '\n' );
 
             __p += __t;
         }
     }
     else {
-        kout << __s << "\n" ;
+        Pos = AOutArena :: putChars ( Pos, __s, __l );
+        Pos = AOutArena :: putChar ( Pos, '\n' );
     }
 
+    Arena . commit ( Pos );
 }   /* dumpFastA () */
 
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
@@ -619,19 +682,21 @@ run ( const DumpArgs & TheArgs )
     AFilters Filters ( TheArgs . accession () );
     setupFilters ( Filters, TheArgs );
 
+    AOutArena Arena;
+
     for ( int64_t llp = TheArgs . minSpotId () ; Iterator.nextRead (); llp ++ ) {
 
         if ( Filters . checkIt ( Iterator ) ) {
             if ( TheArgs . fastaDump () ) {
-                dumpFastA ( llp, ReadCollectionName, Iterator, TheArgs . fastaDumpWidth () );
+                dumpFastA ( Arena, llp, ReadCollectionName, Iterator, TheArgs . fastaDumpWidth () );
             }
             else { 
-                dumpFastQ ( llp, ReadCollectionName, Iterator );
+                dumpFastQ ( Arena, llp, ReadCollectionName, Iterator );
             }
         }
     }
 
-    kout.flush ();
+    Arena . flush ();
 
     std :: cerr << Filters . report ( TheArgs . legacyReport () );
 
@@ -0,0 +1,211 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <sysalloc.h>
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <klib/out.h>
+#include <klib/writer.h>
+#include <klib/text.h>
+#include <klib/printf.h>
+
+#include <stdlib.h>
+
+#include "outarena.hpp"
+
+using namespace ngs;
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+/*))
+ //     Two-digit lookup table for integer formatting
+((*/
+static const char __digitPairs [ 201 ] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899"
+    ;
+
+/*))
+ //     AOutArena
+((*/
+AOutArena :: AOutArena ( size_t size )
+:   _M_buf ( NULL )
+,   _M_pos ( NULL )
+,   _M_end ( NULL )
+{
+    if ( size == 0 ) {
+        size = _sM_defaultSize;
+    }
+
+    _M_buf = ( char * ) malloc ( size );
+    if ( _M_buf == NULL ) {
+        throw ErrorMsg ( "AOutArena: out of memory" );
+    }
+
+    _M_pos = _M_buf;
+    _M_end = _M_buf + size;
+}   /* AOutArena :: AOutArena () */
+
+AOutArena :: ~AOutArena ()
+{
+    try {
+        flush ();
+    }
+    catch ( ... ) {
+        // ???? nothing to do
+    }
+
+    if ( _M_buf != NULL ) {
+        free ( _M_buf );
+    }
+
+    _M_buf = _M_pos = _M_end = NULL;
+}   /* AOutArena :: ~AOutArena () */
+
+void
+AOutArena :: flush ()
+{
+    if ( _M_buf < _M_pos ) {
+        __write ( _M_buf, _M_pos - _M_buf );
+    }
+
+    _M_pos = _M_buf;
+}   /* AOutArena :: flush () */
+
+void
+AOutArena :: __makeRoom ( size_t size )
+{
+    flush ();
+
+    size_t __capacity = _M_end - _M_buf;
+    if ( __capacity < size ) {
+            /*) Single record does not fit, growing
+             (*/
+        while ( __capacity < size ) {
+            __capacity *= 2;
+        }
+
+        char * __buf = ( char * ) realloc ( _M_buf, __capacity );
+        if ( __buf == NULL ) {
+            throw ErrorMsg ( "AOutArena: out of memory" );
+        }
+
+        _M_buf = _M_pos = __buf;
+        _M_end = __buf + __capacity;
+    }
+}   /* AOutArena :: __makeRoom () */
+
+void
+AOutArena :: __write ( const char * data, size_t size )
+{
+    rc_t __rc = 0;
+
+    KWrtWriter __writer = KOutWriterGet ();
+    if ( __writer == NULL ) {
+            /*) No writer installed, using formatted output
+             (*/
+        :: String __t;
+        StringInit ( ( & __t ), data, size, ( uint32_t ) size );
+        __rc = KOutMsg ( "%S", & __t );
+    }
+    else {
+        void * __data = KOutDataGet ();
+
+        while ( __rc == 0 && 0 < size ) {
+            size_t __writ = 0;
+
+            __rc = __writer ( __data, data, size, & __writ );
+            if ( __rc == 0 ) {
+                if ( __writ == 0 ) {
+                    throw ErrorMsg ( "AOutArena: output writer stalled" );
+                }
+
+                data += __writ;
+                size -= __writ;
+            }
+        }
+    }
+
+    if ( __rc != 0 ) {
+        char __m [ 4096 ];
+        size_t __n = 0;
+        string_printf ( __m, sizeof ( __m ), & __n, "%R", __rc );
+        throw ErrorMsg ( __m );
+    }
+}   /* AOutArena :: __write () */
+
+char *
+AOutArena :: putUint ( char * at, uint64_t value )
+{
+    char __t [ _sM_maxIntChars ];
+    char * __p = __t + sizeof ( __t );
+
+    while ( 100 <= value ) {
+        uint64_t __r = value % 100;
+        value /= 100;
+
+        __p -= 2;
+        __p [ 0 ] = __digitPairs [ __r * 2 ];
+        __p [ 1 ] = __digitPairs [ __r * 2 + 1 ];
+    }
+
+    if ( 10 <= value ) {
+        __p -= 2;
+        __p [ 0 ] = __digitPairs [ value * 2 ];
+        __p [ 1 ] = __digitPairs [ value * 2 + 1 ];
+    }
+    else {
+        * -- __p = ( char ) ( '0' + value );
+    }
+
+    size_t __l = __t + sizeof ( __t ) - __p;
+    memcpy ( at, __p, __l );
+
+    return at + __l;
+}   /* AOutArena :: putUint () */
+
+char *
+AOutArena :: putInt ( char * at, int64_t value )
+{
+    if ( value < 0 ) {
+        * at ++ = '-';
+        return putUint ( at, 0 - ( uint64_t ) value );
+    }
+
+    return putUint ( at, ( uint64_t ) value );
+}   /* AOutArena :: putInt () */
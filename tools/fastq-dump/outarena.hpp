@@ -0,0 +1,124 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_outpost_outarena_
+#define _h_outpost_outarena_
+
+#include <string.h>
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <ngs/ErrorMsg.hpp>
+#include <ngs/StringRef.hpp>
+
+/*)))   Namespace
+ (((*/
+namespace ngs {
+
+/*))
+ // Direct output arena. Records are formatted straight into one big
+ // reusable buffer, which is handed to the KOut writer in a single
+ // call when it fills up, or on flush (). There are no per-field
+ // stream calls and no allocations on the per-record path.
+ //
+ // Usage pattern : reserve () enough bytes for a whole record, write
+ // through the returned pointer with the put* helpers, and commit ()
+ // the pointer past the last byte written.
+((*/
+class AOutArena {
+public :
+    static const size_t _sM_defaultSize = 4 * 1024 * 1024;
+
+public :
+    AOutArena ( size_t size = _sM_defaultSize );
+    ~AOutArena ();
+
+        /* Returns pointer to at least 'size' contiguous free bytes.
+         * Flushes accumulated data, or grows arena if necessary
+         */
+    inline char * reserve ( size_t size )
+    {
+        if ( _M_end - _M_pos < ( ptrdiff_t ) size ) {
+            __makeRoom ( size );
+        }
+        return _M_pos;
+    };
+
+        /* Marks everything up to 'end' as written
+         */
+    inline void commit ( char * end ) { _M_pos = end; };
+
+    void flush ();
+
+        /* Formatting helpers, all of them return pointer past
+         * the last byte written
+         */
+    static inline char * putChar ( char * at, char ch )
+    {
+        * at = ch;
+        return at + 1;
+    };
+
+    static inline char * putChars ( char * at, const char * str, size_t len )
+    {
+        memcpy ( at, str, len );
+        return at + len;
+    };
+
+    static inline char * putString ( char * at, const StringRef & str )
+    {
+        return putChars ( at, str . data (), str . size () );
+    };
+
+    static inline char * putString ( char * at, const String & str )
+    {
+        return putChars ( at, str . data (), str . size () );
+    };
+
+    static char * putUint ( char * at, uint64_t value );
+    static char * putInt ( char * at, int64_t value );
+
+        /* Max number of chars putInt () and putUint () could write
+         */
+    static const size_t _sM_maxIntChars = 20;
+
+private :
+    void __makeRoom ( size_t size );
+    void __write ( const char * data, size_t size );
+
+private :
+    char * _M_buf;
+    char * _M_pos;
+    char * _M_end;
+};  /* class AOutArena */
+
+/*)))   Namespace
+ (((*/
+}; /* namespace ngs */
+
+#endif /* _h_outpost_outarena_ */
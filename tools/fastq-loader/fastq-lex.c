@@ -2836,6 +2836,17 @@ void CC FASTQScan_skip_to_eol(FASTQParseBlock* pb)
     }
 }
 
+void CC FASTQScan_set_lineno(FASTQParseBlock* pb, int line_number)
+{
+    struct yyguts_t* yyg = (struct yyguts_t*)pb->scanner;
+    if ( ! YY_CURRENT_BUFFER )
+    {   /* the same as yylex() does before reading any input */
+        FASTQ_ensure_buffer_stack(pb->scanner);
+        YY_CURRENT_BUFFER_LVALUE = FASTQ__create_buffer(yyin,YY_BUF_SIZE,pb->scanner);
+    }
+    yylineno = line_number;
+}
+
 void CC FASTQ_unlex(FASTQParseBlock* pb, FASTQToken* token)
 {
     size_t i;
@@ -81,6 +81,10 @@ struct FastqRecord
     KDataBuffer source;
     struct FastqSequence    seq;
     Rejected*               rej; 
+
+    /* records recognized by FASTQ_ScanRecord() point into a block of the input instead of source */
+    struct FastqBlock*      block;
+    struct FastqRecord*     next; /* in the free list of the pool the record came from */
 };
 
 typedef struct FASTQToken
@@ -148,6 +152,8 @@ extern void FASTQScan_inline_quality(FASTQParseBlock* pb);
 extern void FASTQScan_skip_to_eol(FASTQParseBlock* pb); /*the next token will be EOL or EOF*/
 
 extern void FASTQ_set_lineno (int line_number, void* scanner);
+/* same as FASTQ_set_lineno, also for a scanner that has not read any input yet */
+extern void FASTQScan_set_lineno(FASTQParseBlock* pb, int line_number);
 
 extern int FASTQ_lex(FASTQToken* pb, void * scanner);
 extern void FASTQ_unlex(FASTQParseBlock* pb, FASTQToken* token);
@@ -0,0 +1,454 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+typedef struct FastqPipeReaderFile FastqPipeReaderFile;
+
+#define READERFILE_IMPL FastqPipeReaderFile
+
+#include <loader/common-reader-priv.h>
+
+#include "fastq-pipe.h"
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <klib/log.h>
+#include <klib/rc.h>
+#include <klib/text.h>
+#include <kproc/queue.h>
+#include <kproc/thread.h>
+#include <kproc/timeout.h>
+
+/* records travel through the queues in batches, to keep the locking out of the way */
+#define FASTQ_PIPE_BATCH 256
+/* batches a parser may get ahead of the writer */
+#define FASTQ_PIPE_DEPTH 16
+
+typedef struct FastqPipeBatch
+{
+    uint32_t count;
+    uint32_t next;  /* the next record to hand out */
+    float position; /* of the input after the last record */
+    const Record* records [ FASTQ_PIPE_BATCH ];
+} FastqPipeBatch;
+
+typedef struct FastqPipeInput
+{
+    const ReaderFile* reader;
+    KQueue* queue;
+    KThread* thread; /* started when the first batch is needed */
+
+    const Record* first; /* read before the parser is started, handed out first */
+
+    FastqPipeBatch* batch; /* being handed out */
+    float position; /* of the batch being handed out, taken by the parser */
+    bool done;
+
+    /* statistics */
+    uint64_t records;
+    uint64_t full;  /* the parser found the queue full */
+    uint64_t empty; /* the writer found the queue empty */
+} FastqPipeInput;
+
+/*--------------------------------------------------------------------------
+ * FastqPipeReaderFile
+ */
+
+static rc_t FastqPipeReaderFileWhack( READERFILE_IMPL* self );
+static rc_t FastqPipeReaderFileGetRecord ( const READERFILE_IMPL *self, const Record** result );
+static float FastqPipeReaderFileGetProportionalPosition ( const READERFILE_IMPL *self );
+static rc_t FastqPipeReaderFileGetReferenceInfo ( const READERFILE_IMPL *self, const ReferenceInfo** result );
+
+static ReaderFile_vt_v1 FastqPipeReaderFile_vt =
+{
+    1, 0,
+    /* start minor version == 0 */
+    FastqPipeReaderFileWhack,
+    FastqPipeReaderFileGetRecord,
+    FastqPipeReaderFileGetProportionalPosition,
+    FastqPipeReaderFileGetReferenceInfo,
+    /* end minor version == 0 */
+};
+
+struct FastqPipeReaderFile
+{
+    ReaderFile dad;
+
+    unsigned count;
+    unsigned next;      /* the input to take the next record from */
+    unsigned active;    /* inputs not exhausted yet */
+    bool started;
+    bool reported;
+    bool interleave;    /* take records from the inputs in turn rather than one input after another */
+    FastqPipeInput inputs [ 1 ];
+};
+
+static void FastqPipeBatchWhack ( FastqPipeBatch* self )
+{
+    if ( self != NULL )
+    {
+        while ( self->next < self->count )
+            RecordRelease ( self->records [ self->next ++ ] );
+        free ( self );
+    }
+}
+
+/* a parsing thread: fills batches from one input */
+static rc_t CC FastqPipeParse ( const KThread* thread, void* data )
+{
+    FastqPipeInput* self = (FastqPipeInput*) data;
+    rc_t rc = 0;
+    bool eof = false;
+
+    while ( rc == 0 && ! eof )
+    {
+        FastqPipeBatch* batch = (FastqPipeBatch*) malloc ( sizeof * batch );
+        if ( batch == NULL )
+        {
+            rc = RC ( RC_MODULE, rcData, rcAllocating, rcMemory, rcExhausted );
+            break;
+        }
+        batch->count = 0;
+        batch->next = 0;
+
+        while ( batch->count < FASTQ_PIPE_BATCH )
+        {
+            const Record* record = NULL;
+            rc = ReaderFileGetRecord ( self->reader, & record );
+            if ( rc != 0 || record == NULL )
+            {
+                eof = true;
+                break;
+            }
+            batch->records [ batch->count ++ ] = record;
+        }
+        batch->position = ReaderFileGetProportionalPosition ( self->reader );
+        self->records += batch->count;
+
+        if ( batch->count == 0 )
+        {
+            free ( batch );
+            break;
+        }
+
+        {   /* see if it fits without waiting, for the statistics */
+            timeout_t tm;
+            TimeoutInit ( & tm, 0 );
+            if ( KQueuePush ( self->queue, batch, & tm ) != 0 )
+            {
+                if ( KQueueSealed ( self->queue ) )
+                {   /* the reader is being destroyed */
+                    FastqPipeBatchWhack ( batch );
+                    break;
+                }
+                ++ self->full;
+                if ( KQueuePush ( self->queue, batch, NULL ) != 0 )
+                {
+                    FastqPipeBatchWhack ( batch );
+                    break;
+                }
+            }
+        }
+    }
+
+    KQueueSeal ( self->queue );
+    return rc;
+}
+
+/* statistics of every input, once all of them are drained; shown with -v */
+static void FastqPipeReaderFileReport ( FastqPipeReaderFile* self )
+{
+    unsigned i;
+
+    if ( self->reported )
+        return;
+    self->reported = true;
+    for ( i = 0; i != self->count; ++i )
+    {
+        const FastqPipeInput* input = & self->inputs [ i ];
+        (void)PLOGMSG ( klogInfo, ( klogInfo,
+            "$(file): $(records) records; parser waited for the loader $(full) times, loader waited for the parser $(empty) times",
+            "file=%s,records=%lu,full=%lu,empty=%lu",
+            ReaderFileGetPathname ( input->reader ), input->records, input->full, input->empty ) );
+    }
+}
+
+/* makes sure there is a record at hand; self->batch is left NULL when the input is exhausted */
+static rc_t FastqPipeInputFill ( FastqPipeInput* self, unsigned* active )
+{
+    void* item;
+    timeout_t tm;
+    rc_t rc;
+
+    if ( self->batch != NULL && self->batch->next < self->batch->count )
+        return 0;
+
+    FastqPipeBatchWhack ( self->batch );
+    self->batch = NULL;
+
+    /* one input after another: only the input being read has a parser */
+    if ( self->thread == NULL )
+    {
+        rc = KThreadMake ( & self->thread, FastqPipeParse, self );
+        if ( rc != 0 )
+            return rc;
+    }
+
+    TimeoutInit ( & tm, 0 );
+    rc = KQueuePop ( self->queue, & item, & tm );
+    if ( rc != 0 && GetRCState ( rc ) != rcDone )
+    {
+        ++ self->empty;
+        rc = KQueuePop ( self->queue, & item, NULL );
+    }
+    if ( rc != 0 )
+    {
+        rc_t status = 0;
+        if ( GetRCState ( rc ) != rcDone )
+            return rc;
+        /* sealed and empty: the parser is finished */
+        self->done = true;
+        self->position = 1.0f;
+        -- * active;
+        KThreadWait ( self->thread, & status );
+        return status;
+    }
+    self->batch = (FastqPipeBatch*) item;
+    self->position = self->batch->position;
+    return 0;
+}
+
+/* spot name of a record, without a trailing read number "/1", "/2"... */
+static bool FastqPipeSpotName ( const Record* record, String* name )
+{
+    const Sequence* seq = NULL;
+    const char* text;
+    size_t length;
+    bool ok = false;
+
+    if ( RecordGetSequence ( record, & seq ) == 0 && seq != NULL )
+    {
+        if ( SequenceGetSpotName ( seq, & text, & length ) == 0 )
+        {
+            if ( length > 2 && text [ length - 2 ] == '/' && text [ length - 1 ] >= '1' && text [ length - 1 ] <= '9' )
+                length -= 2;
+            StringInit ( name, text, length, (uint32_t) length );
+            ok = true;
+        }
+        SequenceRelease ( seq );
+    }
+    return ok;
+}
+
+/* inputs are taken to be mates if their first records have the same spot name;
+   the first records are read here, no parser is started yet */
+static rc_t FastqPipeReaderFileCheckMates ( FastqPipeReaderFile* self )
+{
+    String first;
+    bool mates = true;
+    unsigned i;
+
+    for ( i = 0; i != self->count; ++i )
+    {
+        String name;
+        FastqPipeInput* input = & self->inputs [ i ];
+        rc_t rc = ReaderFileGetRecord ( input->reader, & input->first );
+        if ( rc != 0 )
+            return rc;
+        if ( input->first == NULL )
+        {   /* empty */
+            input->done = true;
+            input->position = 1.0f;
+            -- self->active;
+            mates = false;
+            continue;
+        }
+        ++ input->records;
+        if ( ! mates || ! FastqPipeSpotName ( input->first, & name ) )
+            mates = false;
+        else if ( i == 0 )
+            first = name;
+        else if ( ! StringEqual ( & first, & name ) )
+            mates = false;
+    }
+    self->interleave = mates && self->count > 1;
+    return 0;
+}
+
+rc_t FastqPipeReaderFileGetRecord ( const READERFILE_IMPL *cself, const Record** result )
+{
+    FastqPipeReaderFile* self = (FastqPipeReaderFile*) cself;
+
+    *result = NULL;
+    if ( ! self->started )
+    {
+        rc_t rc = FastqPipeReaderFileCheckMates ( self );
+        if ( rc != 0 )
+            return rc;
+        self->started = true;
+    }
+
+    while ( self->active > 0 )
+    {
+        FastqPipeInput* input = & self->inputs [ self->next ];
+        if ( ! input->done )
+        {
+            rc_t rc = 0;
+            if ( input->first == NULL )
+                rc = FastqPipeInputFill ( input, & self->active );
+            if ( rc != 0 )
+                return rc;
+            if ( input->first != NULL || input->batch != NULL )
+            {
+                if ( input->first != NULL )
+                {
+                    *result = input->first;
+                    input->first = NULL;
+                }
+                else
+                    *result = input->batch->records [ input->batch->next ++ ];
+                /* rejected records are reported with the name of the file they came from */
+                self->dad.pathname = (char*) ReaderFileGetPathname ( input->reader );
+                if ( self->interleave )
+                    self->next = ( self->next + 1 ) % self->count;
+                return 0;
+            }
+        }
+        self->next = ( self->next + 1 ) % self->count;
+    }
+    FastqPipeReaderFileReport ( self );
+    return 0;
+}
+
+rc_t FastqPipeReaderFileWhack( FastqPipeReaderFile* self )
+{
+    rc_t rc = 0;
+    unsigned i;
+
+    /* stop the parsers: they fail to push into a sealed queue */
+    for ( i = 0; i != self->count; ++i )
+    {
+        if ( self->inputs [ i ] . queue != NULL )
+            KQueueSeal ( self->inputs [ i ] . queue );
+    }
+
+    for ( i = 0; i != self->count; ++i )
+    {
+        FastqPipeInput* input = & self->inputs [ i ];
+        if ( input->thread != NULL )
+        {
+            if ( ! input->done )
+                KThreadWait ( input->thread, NULL );
+            KThreadRelease ( input->thread );
+        }
+        if ( input->first != NULL )
+            RecordRelease ( input->first );
+        FastqPipeBatchWhack ( input->batch );
+        if ( input->queue != NULL )
+        {
+            void* item;
+            timeout_t tm;
+            TimeoutInit ( & tm, 0 );
+            while ( KQueuePop ( input->queue, & item, & tm ) == 0 )
+                FastqPipeBatchWhack ( (FastqPipeBatch*) item );
+            KQueueRelease ( input->queue );
+        }
+        if ( input->reader != NULL )
+        {
+            rc_t rc2 = ReaderFileRelease ( input->reader );
+            if ( rc == 0 )
+                rc = rc2;
+        }
+    }
+
+    self->dad.pathname = NULL; /* points into an input */
+    ReaderFileWhack( &self->dad );
+
+    free ( self );
+    return rc;
+}
+
+rc_t CC FastqPipeReaderFileMake( const ReaderFile **reader,
+                                 const ReaderFile* inputs[],
+                                 unsigned count )
+{
+    rc_t rc = 0;
+    unsigned i;
+    FastqPipeReaderFile* self;
+
+    assert ( reader != NULL );
+    assert ( count > 0 );
+
+    self = (FastqPipeReaderFile*) calloc ( 1, sizeof * self + ( count - 1 ) * sizeof self->inputs [ 0 ] );
+    if ( self == NULL )
+    {
+        for ( i = 0; i != count; ++i )
+            ReaderFileRelease ( inputs [ i ] );
+        return RC ( RC_MODULE, rcFileFormat, rcAllocating, rcMemory, rcExhausted );
+    }
+
+    ReaderFileInit ( self );
+    self->dad.vt.v1 = & FastqPipeReaderFile_vt;
+    self->dad.pathname = (char*) ReaderFileGetPathname ( inputs [ 0 ] );
+    self->count = count;
+    self->active = count;
+
+    for ( i = 0; i != count; ++i )
+        self->inputs [ i ] . reader = inputs [ i ];
+
+    /* the parsers are started as their inputs are needed */
+    for ( i = 0; rc == 0 && i != count; ++i )
+        rc = KQueueMake ( & self->inputs [ i ] . queue, FASTQ_PIPE_DEPTH );
+
+    if ( rc != 0 )
+    {
+        ReaderFileRelease ( & self->dad );
+        *reader = NULL;
+        return rc;
+    }
+
+    *reader = & self->dad;
+    return 0;
+}
+
+/* the mean of the inputs, as far as their records are handed out */
+float FastqPipeReaderFileGetProportionalPosition ( const READERFILE_IMPL *self )
+{
+    float sum = 0.0f;
+    unsigned i;
+
+    for ( i = 0; i != self->count; ++i )
+        sum += self->inputs [ i ] . position;
+    return sum / self->count;
+}
+
+rc_t FastqPipeReaderFileGetReferenceInfo ( const READERFILE_IMPL *self, const ReferenceInfo** result )
+{
+    *result = NULL;
+    return 0;
+}
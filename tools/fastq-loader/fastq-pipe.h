@@ -0,0 +1,62 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_fastq_pipe_
+#define _h_fastq_pipe_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*--------------------------------------------------------------------------
+ * forwards
+ */
+struct ReaderFile;
+
+/*
+ * FastqPipeReaderFileMake
+ *  a reader over several inputs, each parsed on a thread of its own into a bounded queue.
+ *  when the first records of all inputs have the same spot name ( a trailing "/1", "/2"... aside ),
+ *  the inputs are taken to be mate files and records are returned one from each input in turn, so that mates reach the
+ *  writer close together; otherwise the inputs are returned one after another, and the parser of an input is started
+ *  only when the input before it is exhausted.
+ *  per-input record counts and queue waits are logged at klogInfo once all inputs are drained.
+ *
+ *  takes over the references to inputs[]
+ */
+rc_t CC FastqPipeReaderFileMake( const struct ReaderFile **self,
+                                 const struct ReaderFile* inputs[],
+                                 unsigned count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_fastq_pipe_ */
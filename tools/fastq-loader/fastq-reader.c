@@ -34,6 +34,7 @@ typedef struct FastqSequence    FastqSequence;
 
 #include "fastq-reader.h"
 #include "fastq-parse.h"
+#include "fastq-scan.h"
 
 #include <sysalloc.h>
 #include <stdlib.h>
@@ -44,9 +45,134 @@ typedef struct FastqSequence    FastqSequence;
 #include <kfs/directory.h>
 #include <klib/log.h>
 #include <klib/rc.h>
+#include <kproc/lock.h>
 
 static rc_t FastqSequenceInit(FastqSequence* self);
 
+/*--------------------------------------------------------------------------
+ * FastqBlock
+ *  a window of the input copied out of the KLoaderFile in one piece;
+ *  records recognized by FASTQ_ScanRecord() point into it
+ */
+#define FASTQ_BLOCK_SIZE ( 1024 * 1024 )
+
+typedef struct FastqRecordPool FastqRecordPool;
+
+typedef struct FastqBlock
+{
+    KRefcount refcount;
+    FastqRecordPool* pool;
+    struct FastqBlock* next; /* in the pool's free list */
+    size_t size;
+    char data [ FASTQ_BLOCK_SIZE ];
+} FastqBlock;
+
+/*--------------------------------------------------------------------------
+ * FastqRecordPool
+ *  recycles blocks and the records pointing into them; records may be released
+ *  after the reader is gone, and on other threads
+ */
+struct FastqRecordPool
+{
+    KRefcount refcount; /* the reader and each block in use */
+    KLock* lock;
+    FastqRecord* records; /* free lists */
+    FastqBlock* blocks;
+};
+
+static rc_t FastqRecordPoolMake ( FastqRecordPool** result )
+{
+    rc_t rc;
+    FastqRecordPool* self = (FastqRecordPool*) calloc ( 1, sizeof * self );
+    if ( self == NULL )
+        return RC ( RC_MODULE, rcData, rcAllocating, rcMemory, rcExhausted );
+
+    rc = KLockMake ( & self->lock );
+    if ( rc != 0 )
+    {
+        free ( self );
+        return rc;
+    }
+    KRefcountInit ( & self->refcount, 1, "FastqRecordPool", "Make", "" );
+    *result = self;
+    return 0;
+}
+
+static void FastqRecordPoolRelease ( FastqRecordPool* self )
+{
+    if ( self != NULL && KRefcountDrop ( & self->refcount, "FastqRecordPool" ) == krefWhack )
+    {
+        while ( self->records != NULL )
+        {
+            FastqRecord* rec = self->records;
+            self->records = rec->next;
+            free ( rec );
+        }
+        while ( self->blocks != NULL )
+        {
+            FastqBlock* block = self->blocks;
+            self->blocks = block->next;
+            free ( block );
+        }
+        KLockRelease ( self->lock );
+        free ( self );
+    }
+}
+
+static FastqBlock* FastqRecordPoolGetBlock ( FastqRecordPool* self )
+{
+    FastqBlock* block;
+
+    KLockAcquire ( self->lock );
+    block = self->blocks;
+    if ( block != NULL )
+        self->blocks = block->next;
+    KLockUnlock ( self->lock );
+
+    if ( block == NULL )
+    {
+        block = (FastqBlock*) malloc ( sizeof * block );
+        if ( block == NULL )
+            return NULL;
+    }
+    KRefcountInit ( & block->refcount, 1, "FastqBlock", "Get", "" );
+    KRefcountAdd ( & self->refcount, "FastqRecordPool" );
+    block->pool = self;
+    block->next = NULL;
+    block->size = 0;
+    return block;
+}
+
+static void FastqBlockRelease ( FastqBlock* self )
+{
+    if ( self != NULL && KRefcountDrop ( & self->refcount, "FastqBlock" ) == krefWhack )
+    {   /* back to the pool */
+        FastqRecordPool* pool = self->pool;
+
+        KLockAcquire ( pool->lock );
+        self->next = pool->blocks;
+        pool->blocks = self;
+        KLockUnlock ( pool->lock );
+
+        FastqRecordPoolRelease ( pool );
+    }
+}
+
+static FastqRecord* FastqRecordPoolGetRecord ( FastqRecordPool* self )
+{
+    FastqRecord* rec;
+
+    KLockAcquire ( self->lock );
+    rec = self->records;
+    if ( rec != NULL )
+        self->records = rec->next;
+    KLockUnlock ( self->lock );
+
+    if ( rec == NULL )
+        rec = (FastqRecord*) malloc ( sizeof * rec );
+    return rec;
+}
+
 /*--------------------------------------------------------------------------
  * FastqRecord
  */
@@ -74,6 +200,8 @@ static rc_t CC FastqRecordInit ( FastqRecord* self )
     self->dad.vt.v1 = & FastqRecord_vt; 
     KDataBufferMakeBytes ( & self->source, 0 );
     self->rej = 0;
+    self->block = NULL;
+    self->next = NULL;
     return FastqSequenceInit(& self->seq);
 }
 
@@ -90,7 +218,20 @@ static rc_t FastqRecordWhack( const FastqRecord* cself )
     else
         rc = RejectedRelease(self->rej);
         
-    free(self);    
+    if ( self->block != NULL )
+    {   /* recycle; the block goes back to the pool once no record points into it */
+        FastqBlock* block = self->block;
+        FastqRecordPool* pool = block->pool;
+
+        KLockAcquire ( pool->lock );
+        self->next = pool->records;
+        pool->records = self;
+        KLockUnlock ( pool->lock );
+
+        FastqBlockRelease ( block );
+    }
+    else
+        free(self);    
       
     return rc;
 }
@@ -488,6 +629,14 @@ struct FastqReaderFile
     size_t curPos;           /* current tokenization position relative to recordStart */
     bool lastEol;
     bool eolInserted;
+
+    /* FASTQ_ScanRecord() is used until the first record it does not recognize, the parser takes over from there */
+    bool scanning;
+    FastqRecordPool* pool;
+    FastqBlock* block;  /* the current window of the input */
+    size_t blockPos;    /* start of the next record in block */
+    int lineNo;         /* input lines consumed by the scanner */
+    uint64_t fileSize;  /* 0 if unknown */
 };
 
 rc_t FastqReaderFileWhack( FastqReaderFile* f )
@@ -496,6 +645,9 @@ rc_t FastqReaderFileWhack( FastqReaderFile* f )
 
     FASTQScan_yylex_destroy(& self->pb);
 
+    FastqBlockRelease ( self->block );
+    FastqRecordPoolRelease ( self->pool );
+
     if (self->reader)
         KLoaderFile_Release ( self->reader, true );
 
@@ -519,6 +671,84 @@ void FASTQ_ParseBlockInit ( FASTQParseBlock* pb )
     pb->qualityLength = 0;
 }
 
+/* copy the input following the current block into a new one */
+static rc_t FastqReaderFileNextBlock ( FastqReaderFile* self )
+{
+    rc_t rc;
+    const void* buf = NULL;
+    size_t length;
+
+    if ( self->block != NULL )
+    {   /* the reader is positioned at the start of the block */
+        rc = KLoaderFile_Read( self->reader, self->blockPos, 0, & buf, & length );
+        FastqBlockRelease ( self->block );
+        self->block = NULL;
+        self->blockPos = 0;
+        if ( rc != 0 )
+            return rc;
+    }
+
+    rc = KLoaderFile_Read( self->reader, 0, FASTQ_BLOCK_SIZE, & buf, & length );
+    if ( rc != 0 && GetRCState ( rc ) == rcInsufficient && buf != NULL )
+        rc = 0; /* less than a whole block is buffered */
+    if ( rc != 0 || buf == NULL || length == 0 )
+        return rc;
+
+    self->block = FastqRecordPoolGetBlock ( self->pool );
+    if ( self->block == NULL )
+        return RC ( RC_MODULE, rcData, rcAllocating, rcMemory, rcExhausted );
+    self->block->size = length < FASTQ_BLOCK_SIZE ? length : FASTQ_BLOCK_SIZE;
+    memcpy ( self->block->data, buf, self->block->size );
+    return 0;
+}
+
+/* leaves *result NULL and self->scanning false when the parser has to take over */
+static rc_t FastqReaderFileScanRecord ( FastqReaderFile* self, const Record** result )
+{
+    FASTQScannedRecord scanned;
+    FastqRecord* rec;
+    const char* text;
+
+    *result = NULL;
+    if ( self->block == NULL ||
+         ! FASTQ_ScanRecord ( & self->pb, self->block->data + self->blockPos, self->block->size - self->blockPos, & scanned ) )
+    {   /* the record may continue past the end of the block */
+        if ( FastqReaderFileNextBlock ( self ) != 0 || self->block == NULL ||
+             ! FASTQ_ScanRecord ( & self->pb, self->block->data, self->block->size, & scanned ) )
+        {   /* the reader is positioned at the unrecognized record; errors, if any, will be seen by the parser */
+            FastqBlockRelease ( self->block );
+            self->block = NULL;
+            self->scanning = false;
+            FASTQScan_set_lineno ( & self->pb, self->lineNo + 1 );
+            return 0;
+        }
+    }
+
+    rec = FastqRecordPoolGetRecord ( self->pool );
+    if ( rec == NULL )
+        return RC ( RC_MODULE, rcData, rcAllocating, rcMemory, rcExhausted );
+    FastqRecordInit ( rec );
+
+    text = self->block->data + self->blockPos;
+    StringInit( & rec->seq.spotname,    text + scanned.spotNameOffset,  scanned.spotNameLength,  (uint32_t)scanned.spotNameLength);
+    StringInit( & rec->seq.spotgroup,   text + scanned.spotGroupOffset, scanned.spotGroupLength, (uint32_t)scanned.spotGroupLength);
+    StringInit( & rec->seq.read,        text + scanned.readOffset,      scanned.readLength,      (uint32_t)scanned.readLength);
+    StringInit( & rec->seq.quality,     text + scanned.qualityOffset,   scanned.qualityLength,   (uint32_t)scanned.qualityLength);
+    rec->seq.qualityFormat = self->pb.qualityFormat;
+    rec->seq.qualityAsciiOffset = self->pb.qualityAsciiOffset = scanned.qualityAsciiOffset;
+    rec->seq.readnumber = scanned.readNumber != 0 ? scanned.readNumber : self->pb.defaultReadNumber;
+    rec->seq.lowQuality = scanned.lowQuality;
+
+    KRefcountAdd ( & self->block->refcount, "FastqBlock" );
+    rec->block = self->block;
+
+    self->blockPos += scanned.length;
+    self->lineNo += 4;
+
+    *result = (const Record*) rec;
+    return 0;
+}
+
 rc_t FastqReaderFileGetRecord ( const FastqReaderFile *f, const Record** result )
 {
     rc_t rc;
@@ -527,6 +757,13 @@ rc_t FastqReaderFileGetRecord ( const FastqReaderFile *f, const Record** result
     if (self->pb.fatalError)
         return 0;
 
+    if ( self->scanning )
+    {
+        rc = FastqReaderFileScanRecord ( self, result );
+        if ( rc != 0 || *result != NULL )
+            return rc;
+    }
+
     self->pb.record = (FastqRecord*)malloc(sizeof(FastqRecord));
     if (self->pb.record == NULL)
     {
@@ -663,6 +900,8 @@ rc_t CC FastqReaderFileMake( const ReaderFile **reader,
         else
         {
             rc = KLoaderFile_Make( & self->reader, dir, file, 0, true );
+            if ( rc == 0 && KDirectoryFileSize( dir, & self->fileSize, "%s", file ) != 0 )
+                self->fileSize = 0;
         }
         if (rc == 0)
         {
@@ -673,7 +912,13 @@ rc_t CC FastqReaderFileMake( const ReaderFile **reader,
             self->pb.secondaryReadNumber = 0;
             self->pb.ignoreSpotGroups = ignoreSpotGroups;
             
-            rc = FASTQScan_yylex_init(& self->pb, false); 
+            /* the scanner does not know PACBIO names and leaves reporting bad quality formats to the parser */
+            self->scanning = defaultReadNumber != -1 && 
+                             ( qualityFormat == FASTQphred33 || qualityFormat == FASTQphred64 || qualityFormat == FASTQlogodds );
+            
+            rc = FastqRecordPoolMake ( & self->pool );
+            if (rc == 0)
+                rc = FASTQScan_yylex_init(& self->pb, false); 
             if (rc == 0)
             {
                 *reader = (const ReaderFile *) self;
@@ -697,7 +942,12 @@ rc_t CC FastqReaderFileMake( const ReaderFile **reader,
 
 float FastqReaderFileGetProportionalPosition ( const READERFILE_IMPL *self )
 {
-    return 0.0f;
+    uint64_t offset = 0;
+
+    if ( self->fileSize == 0 || KLoaderFile_Offset( self->reader, & offset ) != 0 )
+        return 0.0f;
+    /* the offset is into the decompressed input, which may get ahead of the size of a compressed file */
+    return offset >= self->fileSize ? 1.0f : (float) offset / self->fileSize;
 }
 
 rc_t FastqReaderFileGetReferenceInfo ( const READERFILE_IMPL *self, const ReferenceInfo** result )
@@ -0,0 +1,336 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "fastq-scan.h"
+
+#include <string.h>
+
+/* the same ranges as in AddQuality() in fastq-grammar.y */
+#define MIN_PHRED_33    33
+#define MAX_PHRED_33    126
+#define MIN_PHRED_64    64
+#define MAX_PHRED_64    127
+#define MIN_LOGODDS     59
+#define MAX_LOGODDS     126
+
+/* {base} in fastq-lex.l */
+static bool IsBase(char ch)
+{
+    switch (ch)
+    {
+    case 'A': case 'C': case 'G': case 'T':
+    case 'a': case 'c': case 'g': case 't':
+    case 'N': case 'n': case '.':
+        return true;
+    }
+    return false;
+}
+
+static bool IsDigit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+/* {alphanum} in fastq-lex.l */
+static bool IsAlphanum(char ch)
+{
+    return ( ch >= 'A' && ch <= 'Z' ) || ( ch >= 'a' && ch <= 'z' ) || IsDigit(ch) || ch == '-';
+}
+
+static size_t SkipDigits(const char* text, size_t i, size_t end)
+{
+    while ( i < end && IsDigit(text[i]) )
+        ++i;
+    return i;
+}
+
+static size_t SkipAlphanum(const char* text, size_t i, size_t end)
+{
+    while ( i < end && IsAlphanum(text[i]) )
+        ++i;
+    return i;
+}
+
+static size_t SkipBases(const char* text, size_t i, size_t end)
+{
+    while ( i < end && IsBase(text[i]) )
+        ++i;
+    return i;
+}
+
+/* fqCOORDS (":{digits}:{digits}:{digits}:{digits}") at text[i]; returns its length, 0 if none */
+static size_t MatchCoords(const char* text, size_t i, size_t end)
+{
+    size_t start = i;
+    unsigned int groups;
+    for ( groups = 0; groups < 4; ++groups )
+    {
+        size_t digits;
+        if ( i == end || text[i] != ':' )
+            return 0;
+        digits = SkipDigits(text, i + 1, end);
+        if ( digits == i + 1 )
+            return 0;
+        i = digits;
+    }
+    return i - start;
+}
+
+/* SetReadNumber() in fastq-grammar.y; false where it would report an error */
+static bool ScanReadNumber(const FASTQParseBlock* pb, const char* digits, size_t length, FASTQScannedRecord* rec, uint8_t* secondary)
+{
+    if (length != 1)
+        rec->readNumber = pb->defaultReadNumber;
+    else if (digits[0] == '1')
+        rec->readNumber = 1;
+    else if (digits[0] == '0')
+        rec->readNumber = pb->defaultReadNumber;
+    else
+    {   /* all secondary read numbers should be the same across an input file */
+        uint8_t readNum = digits[0] - '0';
+        if (pb->secondaryReadNumber != 0 && pb->secondaryReadNumber != readNum)
+            return false;
+        *secondary = readNum;
+        rec->readNumber = 2;
+    }
+    return true;
+}
+
+/* SetSpotGroup() in fastq-grammar.y */
+static void ScanSpotGroup(const FASTQParseBlock* pb, const char* text, size_t offset, size_t length, FASTQScannedRecord* rec)
+{
+    if ( ! pb->ignoreSpotGroups && ( length != 1 || text[offset] != '0' ) ) /* ignore spot group 0 */
+    {
+        rec->spotGroupOffset = offset;
+        rec->spotGroupLength = length;
+    }
+}
+
+/* '/' or '.' followed by a read number, up to the end of the tag line */
+static bool ScanReadNumberSuffix(const FASTQParseBlock* pb, const char* text, size_t i, size_t end, FASTQScannedRecord* rec, uint8_t* secondary)
+{
+    size_t digits = SkipDigits(text, i + 1, end);
+    if ( digits == i + 1 || digits != end )
+        return false;
+    return ScanReadNumber(pb, text + i + 1, digits - i - 1, rec, secondary);
+}
+
+/* Casava 1.8 tail of the tag line: {ws}{digits}:{alphanum}:{digits}[:[{base}+|{digits}]] */
+static bool ScanCasava(const FASTQParseBlock* pb, const char* text, size_t i, size_t end, FASTQScannedRecord* rec, uint8_t* secondary)
+{
+    size_t readNum;
+    size_t filter;
+    size_t control;
+
+    while ( i < end && ( text[i] == ' ' || text[i] == '\t' ) )
+        ++i;
+
+    readNum = SkipDigits(text, i, end);
+    if ( readNum == i || readNum == end || text[readNum] != ':' )
+        return false;
+
+    filter = SkipAlphanum(text, readNum + 1, end);
+    if ( filter == readNum + 1 || SkipDigits(text, readNum + 1, filter) == filter ) /* all digits would be fqNUMBER */
+        return false;
+    if ( filter == end || text[filter] != ':' )
+        return false;
+
+    control = SkipDigits(text, filter + 1, end);
+    if ( control == filter + 1 )
+        return false;
+
+    if ( control != end )
+    {   /* index sequence */
+        size_t index;
+        if ( text[control] != ':' )
+            return false;
+        index = control + 1;
+        if ( index != end )
+        {
+            size_t indexEnd = IsDigit(text[index]) ? SkipDigits(text, index, end) : SkipBases(text, index, end);
+            if ( indexEnd == index || indexEnd != end )
+                return false;
+            ScanSpotGroup(pb, text, index, indexEnd - index, rec);
+        }
+    }
+
+    rec->lowQuality = ( filter == readNum + 2 && text[readNum + 1] == 'Y' );
+    return ScanReadNumber(pb, text + i, readNum - i, rec, secondary);
+}
+
+/* text[0] is '@', end is the position of the EOL */
+static bool ScanTagLine(const FASTQParseBlock* pb, const char* text, size_t end, FASTQScannedRecord* rec, uint8_t* secondary)
+{
+    size_t i;
+    size_t coords = 0;
+
+    rec->spotNameOffset = 1;
+
+    /* fqRUNDOTSPOT: [SDE]RR{digits}\.{digits} */
+    if ( end > 6 && ( text[1] == 'S' || text[1] == 'D' || text[1] == 'E' ) && text[2] == 'R' && text[3] == 'R' && IsDigit(text[4]) )
+    {
+        size_t run = SkipDigits(text, 4, end);
+        if ( run + 1 < end && text[run] == '.' && IsDigit(text[run + 1]) )
+        {
+            size_t spot = SkipDigits(text, run + 1, end);
+            rec->spotNameLength = spot - 1;
+            if ( spot == end )
+                return true;
+            if ( text[spot] != '.' && text[spot] != '/' )
+                return false;
+            return ScanReadNumberSuffix(pb, text, spot, end, rec, secondary);
+        }
+    }
+
+    /* a name made of fqALPHANUM/fqNUMBER, '_', '-' and ':', up to the coordinates if any;
+       no '.', which could start an fqRUNDOTSPOT in the middle of the name */
+    if ( end == 1 || ! IsAlphanum(text[1]) )
+        return false;
+    for ( i = 1; i < end; ++i )
+    {
+        char ch = text[i];
+        if ( ch == ':' )
+        {
+            coords = MatchCoords(text, i, end);
+            if ( coords != 0 )
+                break;
+        }
+        else if ( ! IsAlphanum(ch) && ch != '_' )
+            break;
+    }
+
+    if ( coords == 0 )
+    {   /* name[/readnumber], the read number stays a part of the spot name */
+        rec->spotNameLength = end - 1;
+        if ( i == end )
+            return true;
+        if ( text[i] != '/' )
+            return false;
+        return ScanReadNumberSuffix(pb, text, i, end, rec, secondary);
+    }
+
+    i += coords;
+    rec->spotNameLength = i - 1;
+
+    if ( i < end && text[i] == '#' )
+    {
+        size_t group = SkipAlphanum(text, i + 1, end);
+        if ( group != i + 1 )
+            ScanSpotGroup(pb, text, i + 1, group - i - 1, rec);
+        i = group;
+    }
+
+    if ( i == end )
+        return true;
+    if ( text[i] == '/' )
+        return ScanReadNumberSuffix(pb, text, i, end, rec, secondary);
+    if ( text[i] == ' ' || text[i] == '\t' )
+        return ScanCasava(pb, text, i, end, rec, secondary);
+    return false;
+}
+
+bool FASTQ_ScanRecord(FASTQParseBlock* pb, const char* text, size_t size, FASTQScannedRecord* rec)
+{
+    const char* tagEnd;
+    const char* readEnd;
+    const char* qtagEnd;
+    const char* qualEnd;
+    const char* textEnd = text + size;
+    uint8_t secondary = 0;
+    uint8_t floor;
+    uint8_t ceiling;
+    uint8_t bad = 0;
+    const char* p;
+
+    switch ( pb->qualityFormat )
+    {
+    case FASTQphred33:
+        floor   = MIN_PHRED_33;
+        ceiling = MAX_PHRED_33;
+        rec->qualityAsciiOffset = 33;
+        break;
+    case FASTQphred64:
+        floor   = MIN_PHRED_64;
+        ceiling = MAX_PHRED_64;
+        rec->qualityAsciiOffset = 64;
+        break;
+    case FASTQlogodds:
+        floor   = MIN_LOGODDS;
+        ceiling = MAX_LOGODDS;
+        rec->qualityAsciiOffset = 64;
+        break;
+    default:
+        return false;
+    }
+
+    if ( size == 0 || text[0] != '@' )
+        return false;
+
+    /* the 4 lines */
+    tagEnd = (const char*)memchr(text, '\n', size);
+    if ( tagEnd == NULL )
+        return false;
+    readEnd = (const char*)memchr(tagEnd + 1, '\n', textEnd - tagEnd - 1);
+    if ( readEnd == NULL || readEnd == tagEnd + 1 )
+        return false;
+    if ( readEnd + 1 == textEnd || readEnd[1] != '+' )
+        return false;
+    qtagEnd = (const char*)memchr(readEnd + 1, '\n', textEnd - readEnd - 1);
+    if ( qtagEnd == NULL )
+        return false;
+    qualEnd = (const char*)memchr(qtagEnd + 1, '\n', textEnd - qtagEnd - 1);
+    if ( qualEnd == NULL || qualEnd == qtagEnd + 1 )
+        return false;
+    if ( qualEnd + 1 == textEnd || qualEnd[1] != '@' ) /* the next record has to start right after */
+        return false;
+
+    rec->spotGroupOffset = 0;
+    rec->spotGroupLength = 0;
+    rec->readNumber = 0;
+    rec->lowQuality = false;
+    if ( ! ScanTagLine(pb, text, tagEnd - text, rec, & secondary) )
+        return false;
+
+    rec->readOffset = tagEnd + 1 - text;
+    rec->readLength = readEnd - tagEnd - 1;
+    if ( SkipBases(text, rec->readOffset, readEnd - text) != (size_t)(readEnd - text) )
+        return false;
+
+    if ( memchr(readEnd + 1, '\r', qtagEnd - readEnd - 1) != NULL )
+        return false;
+
+    rec->qualityOffset = qtagEnd + 1 - text;
+    rec->qualityLength = qualEnd - qtagEnd - 1;
+    for ( p = qtagEnd + 1; p != qualEnd; ++p ) /* no early exit, lets the compiler vectorize this */
+        bad |= (uint8_t)( (uint8_t)*p - floor ) > (uint8_t)( ceiling - floor );
+    if ( bad )
+        return false;
+
+    rec->length = qualEnd + 1 - text;
+    if ( secondary != 0 )
+        pb->secondaryReadNumber = secondary;
+    return true;
+}
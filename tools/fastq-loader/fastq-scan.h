@@ -0,0 +1,84 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_fastq_scan_
+#define _h_fastq_scan_
+
+#include "fastq-parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A fast path around the flex/bison parser for the common shapes of 4-line FASTQ:
+ *
+ *  @name[/1]
+ *  @name:1:2:3:4[#group][/1]
+ *  @name:1:2:3:4[#group] 1:N:0[:index]      (Casava 1.8)
+ *  @SRR123.4[.1|/1]
+ *
+ * followed by a single line of bases, a '+' line and a single line of qualities.
+ * The results are the same the parser would produce for these records; anything else
+ * (multi-line reads, colorspace, CR-LF, unusual tag lines, errors) is left to the parser.
+ */
+
+/* all offsets are relative to the start of the record (its '@') */
+typedef struct FASTQScannedRecord
+{
+    size_t length; /* of the whole record including the last EOL */
+
+    size_t spotNameOffset;
+    size_t spotNameLength;
+
+    size_t spotGroupOffset;
+    size_t spotGroupLength;
+
+    size_t readOffset;
+    size_t readLength;
+
+    size_t qualityOffset;
+    size_t qualityLength;
+    uint8_t qualityAsciiOffset;
+
+    uint8_t readNumber; /* 0 - not on the tag line */
+    bool lowQuality;
+} FASTQScannedRecord;
+
+/*
+ * FASTQ_ScanRecord
+ *  text, size - the input starting at a record;
+ *  the record is only recognized if it is followed by the start of the next one ("\n@"),
+ *  so the last record of the input is always left to the parser.
+ *  returns true and updates pb->secondaryReadNumber if the record was recognized
+ */
+extern bool FASTQ_ScanRecord(FASTQParseBlock* pb, const char* text, size_t size, FASTQScannedRecord* rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_fastq_scan_ */
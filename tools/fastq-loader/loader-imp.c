@@ -52,6 +52,7 @@
 #include <loader/reference-writer.h>
 
 #include "fastq-reader.h"
+#include "fastq-pipe.h"
 
 rc_t AcrhiveFASTQ(CommonWriterSettings* G, 
                 VDBManager *mgr, 
@@ -78,23 +79,41 @@ rc_t AcrhiveFASTQ(CommonWriterSettings* G,
         return rc;
     }
     
-    for (i = 0; i < seqFiles; ++i) {
-        const ReaderFile *reader;
-        if (G->platform == SRA_PLATFORM_PACBIO_SMRT)  
-            rc = FastqReaderFileMake(&reader, dir, seqFile[i], FASTQphred33, -1, ignoreSpotGroups); 
-        else
-            rc = FastqReaderFileMake(&reader, dir, seqFile[i], qualityFormat, defaultReadNumbers[i], ignoreSpotGroups);
+    if (seqFiles > 0) {
+        /* all inputs are parsed in parallel, taking turns feeding the writer */
+        const ReaderFile **readers = calloc(seqFiles, sizeof readers[0]);
+        if (readers == NULL)
+            rc = RC(rcApp, rcData, rcAllocating, rcMemory, rcExhausted);
         
+        for (i = 0; rc == 0 && i < seqFiles; ++i) {
+            if (G->platform == SRA_PLATFORM_PACBIO_SMRT)  
+                rc = FastqReaderFileMake(&readers[i], dir, seqFile[i], FASTQphred33, -1, ignoreSpotGroups); 
+            else
+                rc = FastqReaderFileMake(&readers[i], dir, seqFile[i], qualityFormat, defaultReadNumbers[i], ignoreSpotGroups);
+        }
         if (rc == 0) 
         {
-            rc = CommonWriterArchive( &cw, reader );
-            if (rc != 0) 
-                ReaderFileRelease(reader);
-            else
-                rc = ReaderFileRelease(reader);
+            const ReaderFile *reader;
+            rc = FastqPipeReaderFileMake(&reader, readers, seqFiles);
+            if (rc == 0)
+            {
+                rc = CommonWriterArchive( &cw, reader );
+                if (rc != 0) 
+                    ReaderFileRelease(reader);
+                else
+                    rc = ReaderFileRelease(reader);
+            }
+        }
+        else if (readers != NULL)
+        {
+            while (i > 0)
+            {
+                --i;
+                if (readers[i] != NULL)
+                    ReaderFileRelease(readers[i]);
+            }
         }
-        if (rc != 0)
-            break;
+        free(readers);
     }
     if (rc == 0)
         rc = CommonWriterComplete( &cw, Quitting() != 0, 0 );
@@ -0,0 +1,60 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+#include "read-ahead.h"
+
+/* sequential reads ramp the read-ahead window up, reads landing
+   close to the expected offset keep it, anything else drops it */
+bool ReadAhead_Update(ReadAhead* self, uint64_t offset, size_t num_read, uint64_t size, uint64_t* from, uint64_t* to)
+{
+    *from = *to = 0;
+
+    if( offset == self->next ) {
+        if( self->window == 0 ) {
+            self->window = REMOTE_READ_AHEAD_MIN;
+        } else if( self->window < REMOTE_READ_AHEAD_MAX ) {
+            self->window *= 2;
+        }
+    } else if( self->window == 0 ||
+               offset + self->window < self->next ||
+               self->next + self->window < offset ) {
+        self->window = 0;
+        self->ahead = 0;
+    }
+    self->next = offset + num_read;
+
+    if( self->window != 0 ) {
+        *from = self->ahead < self->next ? self->next : self->ahead;
+        *to = self->next + self->window;
+        if( *to > size ) {
+            *to = size;
+        }
+        if( *from < *to ) {
+            self->ahead = *to;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,46 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+#ifndef _h_sra_fuse_read_ahead_
+#define _h_sra_fuse_read_ahead_
+
+#include <klib/defs.h>
+
+/* read-ahead window, it is doubled on each sequential read */
+#define REMOTE_READ_AHEAD_MIN ( 128 * 1024 )
+#define REMOTE_READ_AHEAD_MAX ( 8 * 1024 * 1024 )
+
+/* access pattern of an open file, zeroed one is random access */
+typedef struct ReadAhead_struct {
+    uint64_t next;      /* offset where sequential read continues */
+    uint64_t window;    /* read-ahead size, 0 for random access */
+    uint64_t ahead;     /* read-ahead already requested up to that offset */
+} ReadAhead;
+
+/* takes into account read of num_read bytes at offset from a file of
+   that size, returns true if [from, to) should be read ahead */
+bool ReadAhead_Update(ReadAhead* self, uint64_t offset, size_t num_read, uint64_t size, uint64_t* from, uint64_t* to);
+
+#endif /* _h_sra_fuse_read_ahead_ */
@@ -35,13 +35,15 @@
 #include <kns/stream.h>
 #include <kfs/directory.h>
 #include <kfs/file.h>
-#include <kfs/cacheteefile.h>
 #include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <kproc/thread.h>
 #include <vfs/path.h>
 #include <vfs/manager.h>
 #include <kapp/main.h>
 
 #include <os-native.h>
+#include <atomic64.h>
 
 #include "remote-cache.h"
 
@@ -212,18 +214,105 @@ static size_t _CacheEntryNo = 0;
 static uint32_t _HttpBlockSize = 0;
 static bool _DisklessMode = false;
 
+/*))
+ //  Remote file is cached by blocks. Every block is absent, is being
+ \\  fetched, or is present in the Store file. Lock 'mutabor' guards
+ //  block map and HTTP connections, but it is never held during
+ \\  network or disk transfers : readers of cached blocks go in
+ //  parallel, and missing blocks are fetched over several connections
+ \\  at once. Readers who need the block which is being fetched wait
+ //  on 'arrived' condition instead of fetching it again.
+ \\  Once all blocks are present, Store is renamed to the name of
+ //  completed cache file, and all reads go to that file.
+ \\  Store has the layout of KCacheTeeFile : content of remote file,
+ //  bitmap of present blocks in 32 bit words, 64 bit size of content
+ \\  and 32 bit block size. Block bit is set only after block is in
+ //  Store, so the next open continues from the blocks already there.
+ \\  The tail is cut off before Store is renamed.
+((*/
+#define RCACHE_DEFAULT_BLOCK_SIZE   ( 32 * 1024 )
+#define RCACHE_MAX_FETCHERS         8
+#define RCACHE_NUM_ATTEMPTS         3
+
+#define RCACHE_BITMAP_SIZE(BlockQty) \
+            ( ( ( ( BlockQty ) + 31 ) / 32 ) * sizeof ( uint32_t ) )
+#define RCACHE_TAIL_SIZE \
+            ( sizeof ( uint64_t ) + sizeof ( uint32_t ) )
+
+enum RCacheBlockState {
+    kRCacheBlockAbsent = 0,
+    kRCacheBlockQueued,         /* absent, but prefetch is requested */
+    kRCacheBlockFetching,
+    kRCacheBlockPresent,
+
+    kRCacheBlockStateMask = 0x7F,
+    kRCacheBlockPrefetched = 0x80   /* fetched by prefetch, not read yet */
+};
+
+#define RCACHE_BLOCK_STATE(Entry,Block) \
+            ( ( Entry ) -> Blocks [ ( Block ) ] & kRCacheBlockStateMask )
+
 struct RCacheEntry {
     BSTNode AsIs;
 
     KRefcount refcount;
     KLock * mutabor;
+    KCondition * arrived;
 
     char * Name;
     char * Url;
 
+        /*) Completed cache file
+         (*/
     const KFile * File;
+
+        /*) Cache file which is filled by blocks, and block map
+         (*/
+    KFile * Store;
+    uint8_t * Blocks;
+    uint64_t BlockQty;
+    uint64_t BlocksPresent;
+    uint32_t BlockSize;
+    uint64_t FileSize;
+
+        /*) HTTP connections
+         (*/
+    const KFile * Idle [ RCACHE_MAX_FETCHERS ];
+    size_t IdleQty;
+    size_t FetcherQty;  /* idle and busy */
+};
+
+/*))
+ //  Prefetch : readers ask for blocks ahead, and these are fetched
+ \\  by few background threads. Requests which do not fit in queue
+ //  are dropped, readers will fetch these blocks by themselves.
+((*/
+#define RCACHE_PREFETCH_THREADS     4
+#define RCACHE_PREFETCH_QUEUE       256
+
+struct RCachePrefetch {
+    struct RCacheEntry * Entry;
+    uint64_t Block;
 };
 
+static KLock * _PrefetchLock = NULL;
+static KCondition * _PrefetchCond = NULL;
+static KThread * _PrefetchThreads [ RCACHE_PREFETCH_THREADS ];
+static struct RCachePrefetch _PrefetchQueue [ RCACHE_PREFETCH_QUEUE ];
+static size_t _PrefetchHead = 0;
+static size_t _PrefetchQty = 0;
+static bool _PrefetchQuit = false;
+
+/*))
+ //  Counters, see RemoteCacheGetStats ()
+((*/
+static atomic64_t _StatHits;
+static atomic64_t _StatMisses;
+static atomic64_t _StatWaits;
+static atomic64_t _StatPrefetched;
+static atomic64_t _StatPrefetchHits;
+static atomic64_t _StatPrefetchWaste;
+
 /*))
  //  Some extremely useful methods
 ((*/
@@ -583,6 +672,9 @@ _DisposeKNSManager ()
     return 0;
 }   /* _DisposeKNSManager () */
 
+static rc_t CC _RCachePrefetchStart ();
+static void CC _RCachePrefetchStop ();
+
 /*
  * Lyrics: Cache make 
  * Cache initialisation consists from two steps :
@@ -639,6 +731,9 @@ RemoteCacheCreate ()
             BSTreeInit ( & _Cache );
                 /* Initializing _CacheLock */
             RCt = KLockMake ( & _CacheLock );
+            if ( RCt == 0 ) {
+                RCt = _RCachePrefetchStart ();
+            }
         }
     }
 
@@ -679,6 +774,24 @@ RemoteCacheDispose ()
 
     RCt = 0;
 
+    _RCachePrefetchStop ();
+
+    {
+        struct RCacheStats Stats;
+
+        RemoteCacheGetStats ( & Stats );
+        PLOGMSG ( klogInfo, ( klogInfo,
+                "[RemoteCache] blocks: hits $(h), misses $(m), waits $(w), prefetched $(p), prefetch hits $(ph), prefetch waste $(pw)",
+                "h=%lu,m=%lu,w=%lu,p=%lu,ph=%lu,pw=%lu",
+                Stats . Hits,
+                Stats . Misses,
+                Stats . Waits,
+                Stats . Prefetched,
+                Stats . PrefetchHits,
+                Stats . PrefetchWaste
+                ) );
+    }
+
     if ( RemoteCacheIsDisklessMode () ) {
         _DisklessMode = false;
 
@@ -738,6 +851,22 @@ _RCacheEntryGenerateName ( char * Buffer, size_t Size )
                         );
 }   /* _RCacheEntryGenerateName () */
 
+/*))
+ //  Prefetched blocks which nobody read
+((*/
+static
+void CC
+_RCacheEntryCountWaste ( struct RCacheEntry * self )
+{
+    uint64_t llp;
+
+    for ( llp = 0; llp < self -> BlockQty; llp ++ ) {
+        if ( ( self -> Blocks [ llp ] & kRCacheBlockPrefetched ) != 0 ) {
+            atomic64_inc ( & _StatPrefetchWaste );
+        }
+    }
+}   /* _RCacheEntryCountWaste () */
+
 /*))
  //  This method will destroy CacheEntry and free all resources
 ((*/
@@ -751,6 +880,24 @@ _RCacheEntryDestroy ( struct RCacheEntry * self )
         /*)) Reverse order. I suppose it will be destoryed only
          //  in particualr cases, so no locking :|
         ((*/
+            /*) HTTP connections
+             (*/
+        while ( 0 < self -> IdleQty ) {
+            self -> IdleQty --;
+            ReleaseComplain ( KFileRelease, self -> Idle [ self -> IdleQty ] );
+            self -> Idle [ self -> IdleQty ] = NULL;
+        }
+            /*) Store and block map
+             (*/
+        if ( self -> Store != NULL ) {
+            ReleaseComplain ( KFileRelease, self -> Store );
+            self -> Store = NULL;
+        }
+        if ( self -> Blocks != NULL ) {
+            _RCacheEntryCountWaste ( self );
+            free ( self -> Blocks );
+            self -> Blocks = NULL;
+        }
             /*) File
              (*/
         if ( self -> File != NULL ) {
@@ -774,6 +921,12 @@ _RCacheEntryDestroy ( struct RCacheEntry * self )
         if ( self -> mutabor != NULL ) {
             ReleaseComplain ( KLockRelease, self -> mutabor );
             self -> mutabor = NULL;
+        }
+            /*) arrived
+             (*/
+        if ( self -> arrived != NULL ) {
+            ReleaseComplain ( KConditionRelease, self -> arrived );
+            self -> arrived = NULL;
         }
             /*) refcount 
              (*/
@@ -834,6 +987,11 @@ _RCacheEntryMake (
         /*) mutabor
          (*/
     RCt = KLockMake ( & ( Entry -> mutabor ) );
+    if ( RCt == 0 ) {
+            /*) arrived
+             (*/
+        RCt = KConditionMake ( & ( Entry -> arrived ) );
+    }
 
     if ( RCt == 0 ) {
         if ( ! RemoteCacheIsDisklessMode () ) {
@@ -1042,8 +1200,19 @@ rc_t CC
 _RCacheEntryReleaseWithoutLock ( struct RCacheEntry * self )
 {
     /*)) This method called from special place, so no NULL checks
+     //  Block map and Store are kept, so next reader will continue
+     \\  from where we were stopped
      ((*/
 
+        /*) Closing idle connections
+         (*/
+    while ( 0 < self -> IdleQty ) {
+        self -> IdleQty --;
+        ReleaseComplain ( KFileRelease, self -> Idle [ self -> IdleQty ] );
+        self -> Idle [ self -> IdleQty ] = NULL;
+        self -> FetcherQty --;
+    }
+
     if ( self -> File != NULL ) {
 /*
 RmOutMsg ( "|||<-- Releasing [%s][%s]\n", self -> Name, self -> Url );
@@ -1059,8 +1228,10 @@ rc_t CC
 RCacheEntryRelease ( struct RCacheEntry * self )
 {
     rc_t RCt;
+    bool Destroy;
 
     RCt = 0;
+    Destroy = false;
 
     if ( self != NULL ) {
         RCt = KLockAcquire ( self -> mutabor );
@@ -1072,12 +1243,7 @@ RCacheEntryRelease ( struct RCacheEntry * self )
                             ) ) {
                 case krefWhack:
                     _RCacheEntryReleaseWithoutLock ( self );
-                    if ( RemoteCacheIsDisklessMode () ) {
- /*
- RmOutMsg ( "++++++DL RELEASE [0x%p] entry\n", self );
- */
-                        _RCacheEntryDestroy ( self );
-                    }
+                    Destroy = RemoteCacheIsDisklessMode ();
                     break;
                 case krefNegative:
                     RCt = RC ( rcExe, rcFile, rcReleasing, rcRange, rcExcessive );
@@ -1086,72 +1252,125 @@ RCacheEntryRelease ( struct RCacheEntry * self )
             }
 
             KLockUnlock ( self -> mutabor );
+
+                /*) Lock should be unlocked before it is destroyed
+                 (*/
+            if ( Destroy ) {
+ /*
+ RmOutMsg ( "++++++DL RELEASE [0x%p] entry\n", self );
+ */
+                _RCacheEntryDestroy ( self );
+            }
         }
     }
 
     return RCt;
 }   /* RCacheEntryRelease () */
 
+/*))
+ //  Path to completed cache file
+((*/
 rc_t CC
-_RCacheEntryOpenFileReadRemote (
-                            struct RCacheEntry * self,
-                            const char * Path
-)
+_RCacheEntryPath ( struct RCacheEntry * self, char * Path, size_t Size )
 {
     rc_t RCt;
-    struct KDirectory * Directory;
-    const struct KFile * HttpFile, * TeeFile;
+    char Buffer [ 4096 ];
+    size_t TheSize;
 
     RCt = 0;
-    Directory = NULL;
-    HttpFile = TeeFile = NULL;
+    * Buffer = 0;
+    TheSize = 0;
 
-    if ( self == NULL ) {
-        return RC ( rcExe, rcFile, rcOpening, rcParam, rcNull );
+    RCt = _GetCachePath ( Buffer, sizeof ( Buffer ) );
+    if ( RCt == 0 ) {
+        RCt = string_printf (
+                            Path,
+                            Size,
+                            & TheSize,
+                            "%s/%s",
+                            Buffer,
+                            self -> Name
+                            );
     }
 
-    if ( ( ! RemoteCacheIsDisklessMode () ) && Path == NULL ) {
-        return RC ( rcExe, rcFile, rcOpening, rcParam, rcNull );
-    }
+    return RCt;
+}   /* _RCacheEntryPath () */
 
-/*
-RmOutMsg ( "|||<-- Opening [R] [%s][%s]\n", self -> Name, self -> Url );
-RmOutMsg ( "  |<-- Cache Entry [%s]\n", Path );
-*/
+/*))
+ //  HTTP connection for transfer. Called and returns with locked
+ \\  mutabor, but it could unlock it for waiting or connecting
+((*/
+rc_t CC
+_RCacheEntryGetFetcher (
+                    struct RCacheEntry * self,
+                    const KFile ** Fetcher
+)
+{
+    rc_t RCt;
 
-    RCt = KNSManagerMakeHttpFile (
-                                _ManagerOfKNS,
-                                & HttpFile,
-                                NULL, /* no open connections */
-                                0x01010000,
-                                self -> Url
-                                );
-    if ( RCt == 0 ) {
-        if ( RemoteCacheIsDisklessMode () ) {
-            self -> File = ( KFile * ) HttpFile;
+    RCt = 0;
+    * Fetcher = NULL;
+
+    while ( RCt == 0 ) {
+        if ( 0 < self -> IdleQty ) {
+            self -> IdleQty --;
+            * Fetcher = self -> Idle [ self -> IdleQty ];
+            self -> Idle [ self -> IdleQty ] = NULL;
+            break;
         }
-        else {
-            RCt = KDirectoryNativeDir ( & Directory );
-            if ( RCt == 0 ) {
-                RCt = KDirectoryMakeCacheTee (
-                                    Directory,
-                                    & TeeFile,
-                                    HttpFile,
-                                    _HttpBlockSize, /* blocksize */
-                                    Path
-                                    );
-                if ( RCt == 0 ) {
-                    self -> File = ( KFile * ) TeeFile;
-                }
 
-                ReleaseComplain ( KDirectoryRelease, Directory );
+        if ( self -> FetcherQty < RCACHE_MAX_FETCHERS ) {
+                /*) Slot is reserved before unlocking
+                 (*/
+            self -> FetcherQty ++;
+            KLockUnlock ( self -> mutabor );
+
+            RCt = KNSManagerMakeHttpFile (
+                                        _ManagerOfKNS,
+                                        Fetcher,
+                                        NULL, /* no open connections */
+                                        0x01010000,
+                                        self -> Url
+                                        );
+
+            KLockAcquire ( self -> mutabor );
+            if ( RCt != 0 ) {
+                self -> FetcherQty --;
+                * Fetcher = NULL;
             }
-            ReleaseComplain ( KFileRelease, HttpFile );
+            break;
         }
+
+        RCt = KConditionWait ( self -> arrived, self -> mutabor );
     }
 
     return RCt;
-}   /* _RCacneEntryOpenFileReadRemote () */
+}   /* _RCacheEntryGetFetcher () */
+
+/*))
+ //  Returns connection to pool. Broken connections are dropped.
+ \\  Called with locked mutabor
+((*/
+void CC
+_RCacheEntryPutFetcher (
+                    struct RCacheEntry * self,
+                    const KFile * Fetcher,
+                    bool Broken
+)
+{
+    if ( Fetcher != NULL ) {
+        if ( Broken ) {
+            ReleaseComplain ( KFileRelease, Fetcher );
+            self -> FetcherQty --;
+        }
+        else {
+            self -> Idle [ self -> IdleQty ] = Fetcher;
+            self -> IdleQty ++;
+        }
+
+        KConditionBroadcast ( self -> arrived );
+    }
+}   /* _RCacheEntryPutFetcher () */
 
 rc_t CC
 _RCacheEntryOpenFileReadLocal (
@@ -1189,158 +1408,939 @@ RmOutMsg ( "  |<-- Cache Entry [%s]\n", Path );
     return RCt;
 }   /* _RCacneEntryOpenFileReadLocal () */
 
-/*((
-   \\  The only way to check that cache file completed, is to check if
-    \\  it exists
-     ((*/
-bool CC
-_RCacheCheckCompleted ( const char * Path )
-{
-    uint32_t PathType;
-    KDirectory * Directory;
-
-    PathType = kptNotFound;
-    Directory = NULL;
-
-    if ( KDirectoryNativeDir ( & Directory ) == 0 ) {
-        PathType = KDirectoryPathType ( Directory, Path );
-        ReleaseComplain ( KDirectoryRelease, Directory );
-    }
-
-    return PathType == kptFile;
-}   /* _RCacheCheckCompleted () */
-
+/*))
+ //  Reads block map from the tail of Store. The map is trusted only
+ \\  if Store size, content size and block size are the same as these
+ //  were written, otherwise Store is started from scratch. Returns
+ \\  number of blocks present.
+((*/
 rc_t CC
-_RCacheEntryOpenFileRead ( struct RCacheEntry * self)
+_RCacheEntryLoadMap (
+                    KFile * Store,
+                    uint8_t * Blocks,
+                    uint32_t BlockSize,
+                    uint64_t BlockQty,
+                    uint64_t FileSize,
+                    uint64_t * BlocksPresent
+)
 {
     rc_t RCt;
-    char Buffer [ 4096 ], ThePath [ 4096 ];
-    size_t TheSize;
+    uint64_t StoreSize, BitmapSize, Block, TailFileSize;
+    uint32_t TailBlockSize;
+    uint32_t * Bitmap;
+    uint8_t Tail [ RCACHE_TAIL_SIZE ];
+    size_t NumReaded, NumWrit;
 
     RCt = 0;
-    TheSize = 0;
-    * Buffer = 0;
-    * ThePath = 0;
+    StoreSize = 0;
+    BitmapSize = RCACHE_BITMAP_SIZE ( BlockQty );
+    Bitmap = NULL;
+    NumReaded = NumWrit = 0;
+    * BlocksPresent = 0;
+
+    memset ( Blocks, kRCacheBlockAbsent, ( size_t ) BlockQty );
+
+    if ( KFileSize ( Store, & StoreSize ) == 0
+        && StoreSize == FileSize + BitmapSize + RCACHE_TAIL_SIZE
+        && BlockQty != 0
+        && KFileReadAll (
+                        Store,
+                        FileSize + BitmapSize,
+                        Tail,
+                        sizeof ( Tail ),
+                        & NumReaded
+                        ) == 0
+        && NumReaded == sizeof ( Tail )
+    ) {
+        memmove ( & TailFileSize, Tail, sizeof ( TailFileSize ) );
+        memmove (
+                & TailBlockSize,
+                Tail + sizeof ( TailFileSize ),
+                sizeof ( TailBlockSize )
+                );
 
-    if ( self == NULL ) {
-        return RC ( rcExe, rcFile, rcOpening, rcParam, rcNull );
-    }
+        if ( TailFileSize == FileSize && TailBlockSize == BlockSize ) {
+            Bitmap = ( uint32_t * ) malloc ( ( size_t ) BitmapSize );
+            if ( Bitmap == NULL ) {
+                return RC ( rcExe, rcFile, rcOpening, rcMemory, rcExhausted );
+            }
 
-    if ( self -> File != NULL ) {
-        return 0;
+            RCt = KFileReadAll (
+                                Store,
+                                FileSize,
+                                Bitmap,
+                                ( size_t ) BitmapSize,
+                                & NumReaded
+                                );
+            if ( RCt == 0 && NumReaded == BitmapSize ) {
+                for ( Block = 0; Block < BlockQty; Block ++ ) {
+                    if ( ( Bitmap [ Block >> 5 ]
+                            & ( 1U << ( Block & 31 ) ) ) != 0 ) {
+                        Blocks [ Block ] = kRCacheBlockPresent;
+                        ( * BlocksPresent ) ++;
+                    }
+                }
+
+                free ( Bitmap );
+                return 0;
+            }
+
+            free ( Bitmap );
+        }
     }
 
-        /*)  Do that before messing with disk
+        /*) Something is different : starting from scratch
          (*/
-    if ( RemoteCacheIsDisklessMode () ) {
-        RCt = _RCacheEntryOpenFileReadRemote ( self, NULL );
-    }
-    else {
+    memmove ( Tail, & FileSize, sizeof ( FileSize ) );
+    memmove ( Tail + sizeof ( FileSize ), & BlockSize, sizeof ( BlockSize ) );
 
-            /*)  First we should to make path to real cache file
-             (*/
-        RCt = _GetCachePath ( Buffer, sizeof ( Buffer ) );
-        if ( RCt == 0 ) {
-            RCt = string_printf (
-                                ThePath,
-                                sizeof ( ThePath ),
-                                & TheSize,
-                                "%s/%s",
-                                Buffer,
-                                self -> Name
-                                );
+    RCt = KFileSetSize ( Store, 0 );
+    if ( RCt == 0 ) {
+        RCt = KFileSetSize (
+                        Store,
+                        FileSize + BitmapSize + RCACHE_TAIL_SIZE
+                        );
+    }
+    if ( RCt == 0 ) {
+        RCt = KFileWriteAll (
+                            Store,
+                            FileSize + BitmapSize,
+                            Tail,
+                            sizeof ( Tail ),
+                            & NumWrit
+                            );
+        if ( RCt == 0 && NumWrit != sizeof ( Tail ) ) {
+            RCt = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
         }
+    }
 
-        if ( RCt != 0 ) {
-            return RCt;
-        }
+    return RCt;
+}   /* _RCacheEntryLoadMap () */
 
-        if ( _RCacheCheckCompleted ( ThePath ) ) {
-            RCt = _RCacheEntryOpenFileReadLocal ( self, ThePath );
-        }
-        else {
-            RCt = _RCacheEntryOpenFileReadRemote ( self, ThePath );
+/*))
+ //  Writes bitmap word of that block with block bit set. Called with
+ \\  locked mutabor.
+((*/
+static
+rc_t CC
+_RCacheEntryStoreBit ( struct RCacheEntry * self, uint64_t Block )
+{
+    rc_t RCt;
+    uint64_t First, Last, llp;
+    uint32_t Word;
+    size_t NumWrit;
+
+    RCt = 0;
+    Word = 0;
+    NumWrit = 0;
+
+    First = Block & ~ ( uint64_t ) 31;
+    Last = First + 32 < self -> BlockQty ? First + 32 : self -> BlockQty;
+
+    for ( llp = First; llp < Last; llp ++ ) {
+        if ( llp == Block
+            || RCACHE_BLOCK_STATE ( self, llp ) == kRCacheBlockPresent
+        ) {
+            Word |= 1U << ( llp & 31 );
         }
+    }
 
+    RCt = KFileWriteAll (
+                        self -> Store,
+                        self -> FileSize + ( Block >> 5 ) * sizeof ( Word ),
+                        & Word,
+                        sizeof ( Word ),
+                        & NumWrit
+                        );
+    if ( RCt == 0 && NumWrit != sizeof ( Word ) ) {
+        RCt = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
     }
 
     return RCt;
-}   /* _RCacheEntryOpenFileRead () */
+}   /* _RCacheEntryStoreBit () */
 
+/*))
+ //  Opens Store and block map, or creates them if they are not
+ \\  there. Called with locked mutabor, first connection is made
+ //  under lock, so nobody will open it twice
+((*/
 rc_t CC
-RCacheEntryRead (
-            struct RCacheEntry * self,
-            char * Buffer,
-            size_t SizeToRead,
-            uint64_t Offset,
-            size_t * NumReaded
+_RCacheEntryOpenFileReadRemote (
+                            struct RCacheEntry * self,
+                            const char * Path
 )
 {
     rc_t RCt;
-    int llp;
-    const int NumAttempts = 3;
+    struct KDirectory * Directory;
+    const struct KFile * HttpFile;
+    struct KFile * Store;
+    uint64_t FileSize;
+    uint64_t BlockQty;
+    uint64_t BlocksPresent;
+    uint32_t BlockSize;
+    uint8_t * Blocks;
 
     RCt = 0;
-    llp = 0;
+    Directory = NULL;
+    HttpFile = NULL;
+    Store = NULL;
+    FileSize = 0;
+    BlocksPresent = 0;
+    Blocks = NULL;
 
-    if ( self == NULL ) { 
-        return RC ( rcExe, rcFile, rcReading, rcParam, rcNull );
+    if ( self == NULL || Path == NULL ) {
+        return RC ( rcExe, rcFile, rcOpening, rcParam, rcNull );
     }
 
-        /*)  Here we are locking
-         (*/
-    RCt = KLockAcquire ( self -> mutabor );
+/*
+RmOutMsg ( "|||<-- Opening [R] [%s][%s]\n", self -> Name, self -> Url );
+RmOutMsg ( "  |<-- Cache Entry [%s]\n", Path );
+*/
 
-    if ( RCt == 0 ) {
+    BlockSize = _HttpBlockSize == 0
+                            ? RCACHE_DEFAULT_BLOCK_SIZE
+                            : _HttpBlockSize
+                            ;
 
-        for ( llp = 0; llp < NumAttempts; llp ++ ) {
-                /*) There could be non zero value from previous pass
-                 (*/
-            if ( RCt != 0 ) {
-PLOGMSG ( klogErr, ( klogErr, "|||<- Trying to read file $(n)$(u) at attempt $(l)", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp + 1 ) );
-                RCt = 0;
-            }
+    RCt = KNSManagerMakeHttpFile (
+                                _ManagerOfKNS,
+                                & HttpFile,
+                                NULL, /* no open connections */
+                                0x01010000,
+                                self -> Url
+                                );
+    if ( RCt == 0 ) {
+        RCt = KFileSize ( HttpFile, & FileSize );
+        if ( RCt == 0 ) {
+            BlockQty = ( FileSize + BlockSize - 1 ) / BlockSize;
 
-                /*) If error happen on previous pass file is released
-                 (*/
-            if ( self -> File == NULL ) {
-                /*)  We are opening file for read here
-                 (*/
-                RCt = _RCacheEntryOpenFileRead ( self );
-/*
-RmOutMsg ( "|||<-- Opening file [%s][%s] [A=%d]\n", self -> Name, self -> Url, RCt );
-*/
+            Blocks = ( uint8_t * ) calloc (
+                                    BlockQty == 0 ? 1 : BlockQty,
+                                    sizeof ( uint8_t )
+                                    );
+            if ( Blocks == NULL ) {
+                RCt = RC ( rcExe, rcFile, rcOpening, rcMemory, rcExhausted );
             }
+        }
 
+        if ( RCt == 0 ) {
+            RCt = KDirectoryNativeDir ( & Directory );
             if ( RCt == 0 ) {
-                RCt = KFileRead (
-                                self -> File,
-                                Offset,
-                                Buffer,
-                                SizeToRead,
-                                NumReaded
-                                );
-/*
-RmOutMsg ( "|||<-- Reading [%s][%s] [O=%d][S=%d][R=%d][A=%d]\n", self -> Name, self -> Url, Offset, SizeToRead, * NumReaded, RCt );
-*/
+                RCt = KDirectoryCreateFile (
+                                    Directory,
+                                    & Store,
+                                    true,
+                                    0664,
+                                    kcmOpen | kcmParents,
+                                    "%s.cache",
+                                    Path
+                                    );
                 if ( RCt == 0 ) {
-                    break;
+                    RCt = _RCacheEntryLoadMap (
+                                            Store,
+                                            Blocks,
+                                            BlockSize,
+                                            BlockQty,
+                                            FileSize,
+                                            & BlocksPresent
+                                            );
+                }
+
+                ReleaseComplain ( KDirectoryRelease, Directory );
+            }
+        }
+
+        if ( RCt == 0 ) {
+            self -> Store = Store;
+            self -> Blocks = Blocks;
+            self -> BlockQty = BlockQty;
+            self -> BlocksPresent = BlocksPresent;
+            self -> BlockSize = BlockSize;
+            self -> FileSize = FileSize;
+
+            self -> FetcherQty ++;
+            _RCacheEntryPutFetcher ( self, HttpFile, false );
+        }
+        else {
+            if ( Store != NULL ) {
+                ReleaseComplain ( KFileRelease, Store );
+            }
+            if ( Blocks != NULL ) {
+                free ( Blocks );
+            }
+            ReleaseComplain ( KFileRelease, HttpFile );
+        }
+    }
+
+    return RCt;
+}   /* _RCacneEntryOpenFileReadRemote () */
+
+/*((
+   \\  The only way to check that cache file completed, is to check if
+    \\  it exists
+     ((*/
+bool CC
+_RCacheCheckCompleted ( const char * Path )
+{
+    uint32_t PathType;
+    KDirectory * Directory;
+
+    PathType = kptNotFound;
+    Directory = NULL;
+
+    if ( KDirectoryNativeDir ( & Directory ) == 0 ) {
+        PathType = KDirectoryPathType ( Directory, Path );
+        ReleaseComplain ( KDirectoryRelease, Directory );
+    }
+
+    return PathType == kptFile;
+}   /* _RCacheCheckCompleted () */
+
+/*))
+ //  All blocks are present : Store becomes completed cache file.
+ \\  Called with locked mutabor. Readers which are still reading
+ //  Store are holding their own references.
+((*/
+rc_t CC
+_RCacheEntryPromote ( struct RCacheEntry * self )
+{
+    rc_t RCt;
+    char ThePath [ 4096 ], TheCache [ 4096 ];
+    size_t TheSize;
+    KDirectory * Directory;
+
+    RCt = 0;
+    * ThePath = 0;
+    * TheCache = 0;
+    TheSize = 0;
+    Directory = NULL;
+
+    RCt = _RCacheEntryPath ( self, ThePath, sizeof ( ThePath ) );
+    if ( RCt == 0 ) {
+        RCt = string_printf (
+                            TheCache,
+                            sizeof ( TheCache ),
+                            & TheSize,
+                            "%s.cache",
+                            ThePath
+                            );
+    }
+
+        /*) Cutting off block map, the rest is the remote file
+         (*/
+    if ( RCt == 0 ) {
+        RCt = KFileSetSize ( self -> Store, self -> FileSize );
+    }
+
+    if ( RCt == 0 ) {
+        RCt = KDirectoryNativeDir ( & Directory );
+        if ( RCt == 0 ) {
+            RCt = KDirectoryRename ( Directory, true, TheCache, ThePath );
+
+            ReleaseComplain ( KDirectoryRelease, Directory );
+        }
+    }
+
+    if ( RCt != 0 ) {
+        PLOGERR ( klogErr, ( klogErr, RCt, "Can not complete cache file '$(n)'", "n=%s", TheCache ) );
+    }
+
+    if ( RCt == 0 ) {
+        RCt = _RCacheEntryOpenFileReadLocal ( self, ThePath );
+        if ( RCt == 0 ) {
+            ReleaseComplain ( KFileRelease, self -> Store );
+            self -> Store = NULL;
+
+            _RCacheEntryCountWaste ( self );
+            free ( self -> Blocks );
+            self -> Blocks = NULL;
+        }
+    }
+
+    return RCt;
+}   /* _RCacheEntryPromote () */
+
+rc_t CC
+_RCacheEntryOpenFileRead ( struct RCacheEntry * self)
+{
+    rc_t RCt;
+    char ThePath [ 4096 ];
+
+    RCt = 0;
+    * ThePath = 0;
+
+    if ( self == NULL ) {
+        return RC ( rcExe, rcFile, rcOpening, rcParam, rcNull );
+    }
+
+        /*)  Diskless mode : there is nothing to open, reads are going
+         /   through connections directly
+        (*/
+    if ( RemoteCacheIsDisklessMode () ) {
+        return 0;
+    }
+
+    if ( self -> File != NULL || self -> Store != NULL ) {
+        return 0;
+    }
+
+        /*)  First we should to make path to real cache file
+         (*/
+    RCt = _RCacheEntryPath ( self, ThePath, sizeof ( ThePath ) );
+    if ( RCt != 0 ) {
+        return RCt;
+    }
+
+    if ( _RCacheCheckCompleted ( ThePath ) ) {
+        RCt = _RCacheEntryOpenFileReadLocal ( self, ThePath );
+    }
+    else {
+        RCt = _RCacheEntryOpenFileReadRemote ( self, ThePath );
+        if ( RCt == 0 && self -> BlocksPresent == self -> BlockQty ) {
+            RCt = _RCacheEntryPromote ( self );
+        }
+    }
+
+    return RCt;
+}   /* _RCacheEntryOpenFileRead () */
+
+/*))
+ //  Reads through connection, with few attempts. Called and returns
+ \\  with locked mutabor, which is unlocked for transfer
+((*/
+rc_t CC
+_RCacheEntryReadRemote (
+            struct RCacheEntry * self,
+            char * Buffer,
+            size_t SizeToRead,
+            uint64_t Offset,
+            size_t * NumReaded,
+            bool ReadAll
+)
+{
+    rc_t RCt;
+    int llp;
+    const KFile * Fetcher;
+
+    RCt = 0;
+    Fetcher = NULL;
+
+    for ( llp = 0; llp < RCACHE_NUM_ATTEMPTS; llp ++ ) {
+            /*) There could be non zero value from previous pass
+             (*/
+        if ( RCt != 0 ) {
+PLOGMSG ( klogErr, ( klogErr, "|||<- Trying to read file $(n)$(u) at attempt $(l)", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp + 1 ) );
+            RCt = 0;
+        }
+
+        RCt = _RCacheEntryGetFetcher ( self, & Fetcher );
+        if ( RCt == 0 ) {
+            KLockUnlock ( self -> mutabor );
+
+            if ( ReadAll ) {
+                RCt = KFileReadAll (
+                                Fetcher,
+                                Offset,
+                                Buffer,
+                                SizeToRead,
+                                NumReaded
+                                );
+                if ( RCt == 0 && * NumReaded != SizeToRead ) {
+                    RCt = RC ( rcExe, rcFile, rcReading, rcTransfer, rcIncomplete );
                 }
             }
+            else {
+                RCt = KFileRead (
+                                Fetcher,
+                                Offset,
+                                Buffer,
+                                SizeToRead,
+                                NumReaded
+                                );
+            }
+
+            KLockAcquire ( self -> mutabor );
+            _RCacheEntryPutFetcher ( self, Fetcher, RCt != 0 );
+        }
+
+        if ( RCt == 0 ) {
+            break;
+        }
 /*
 RmOutMsg ( "|||<- Failed to read file [%s][%s] at attempt [%d]\n", self -> Name, self -> Url, llp + 1 );
 */
-            _RCacheEntryReleaseWithoutLock ( self );
+    }
+
+    if ( RCt != 0 ) {
+PLOGMSG ( klogErr, ( klogErr, "|||<- Failed to read file $(n)$(u) after $(l) attempts", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp ) );
+    }
+
+    return RCt;
+}   /* _RCacheEntryReadRemote () */
 
+/*))
+ //  Fetches block into Store. Block should be marked as being
+ \\  fetched. Called and returns with locked mutabor.
+((*/
+rc_t CC
+_RCacheEntryFetchBlock (
+                    struct RCacheEntry * self,
+                    uint64_t Block,
+                    bool Prefetch
+)
+{
+    rc_t RCt;
+    char * Buffer;
+    uint64_t Offset;
+    size_t Size, NumReaded, NumWrit;
+
+    RCt = 0;
+    NumReaded = NumWrit = 0;
+
+    Offset = Block * self -> BlockSize;
+    Size = self -> FileSize - Offset < self -> BlockSize
+                            ? ( size_t ) ( self -> FileSize - Offset )
+                            : self -> BlockSize
+                            ;
+
+    Buffer = ( char * ) malloc ( Size );
+    if ( Buffer == NULL ) {
+        RCt = RC ( rcExe, rcFile, rcReading, rcMemory, rcExhausted );
+    }
+    else {
+        RCt = _RCacheEntryReadRemote (
+                                    self,
+                                    Buffer,
+                                    Size,
+                                    Offset,
+                                    & NumReaded,
+                                    true
+                                    );
+        if ( RCt == 0 ) {
+                /*) Nobody else is writing that block, and Store
+                 /  will not be released while block is fetching
+                (*/
+            KLockUnlock ( self -> mutabor );
+            RCt = KFileWriteAll (
+                                self -> Store,
+                                Offset,
+                                Buffer,
+                                Size,
+                                & NumWrit
+                                );
+            if ( RCt == 0 && NumWrit != Size ) {
+                RCt = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+            }
+            KLockAcquire ( self -> mutabor );
+
+                /*) Block is marked in bitmap only after it is in
+                 /  Store. Bitmap words are shared by neighbour
+                 /  blocks, so these are written under lock
+                (*/
+            if ( RCt == 0 ) {
+                RCt = _RCacheEntryStoreBit ( self, Block );
+            }
         }
 
-        if ( RCt != 0 ) {
-PLOGMSG ( klogErr, ( klogErr, "|||<- Failed to read file $(n)$(u) after $(l) attempts", PLOG_3(PLOG_S(n),PLOG_S(u),PLOG_I64(l)), self -> Name, self -> Url, llp + 1 ) );
+        free ( Buffer );
+    }
+
+    if ( RCt == 0 ) {
+        if ( Prefetch ) {
+            self -> Blocks [ Block ] = kRCacheBlockPresent
+                                    | kRCacheBlockPrefetched
+                                    ;
+            atomic64_inc ( & _StatPrefetched );
+        }
+        else {
+            self -> Blocks [ Block ] = kRCacheBlockPresent;
+        }
+        self -> BlocksPresent ++;
+    }
+    else {
+        self -> Blocks [ Block ] = kRCacheBlockAbsent;
+    }
+
+    KConditionBroadcast ( self -> arrived );
+
+    if ( RCt == 0 && self -> BlocksPresent == self -> BlockQty ) {
+        RCt = _RCacheEntryPromote ( self );
+    }
+
+    return RCt;
+}   /* _RCacheEntryFetchBlock () */
+
+/*))
+ //  Waits until block will be present, fetches it if nobody does
+ \\  Called and returns with locked mutabor.
+((*/
+rc_t CC
+_RCacheEntryWaitBlock ( struct RCacheEntry * self, uint64_t Block )
+{
+    rc_t RCt;
+    atomic64_t * Counter;
+
+    RCt = 0;
+    Counter = NULL;
+
+    while ( RCt == 0 && self -> File == NULL ) {
+        switch ( RCACHE_BLOCK_STATE ( self, Block ) ) {
+            case kRCacheBlockPresent :
+                if ( ( self -> Blocks [ Block ] & kRCacheBlockPrefetched ) != 0 ) {
+                    self -> Blocks [ Block ] &= ~ kRCacheBlockPrefetched;
+                    atomic64_inc ( & _StatPrefetchHits );
+                }
+                if ( Counter == NULL ) {
+                    atomic64_inc ( & _StatHits );
+                }
+                return 0;
+
+            case kRCacheBlockFetching :
+                if ( Counter == NULL ) {
+                    Counter = & _StatWaits;
+                    atomic64_inc ( Counter );
+                }
+                RCt = KConditionWait ( self -> arrived, self -> mutabor );
+                break;
+
+            default :
+                    /*) Queued blocks are fetched here too, prefetch
+                     /  thread will skip them
+                    (*/
+                if ( Counter == NULL ) {
+                    Counter = & _StatMisses;
+                    atomic64_inc ( Counter );
+                }
+                self -> Blocks [ Block ] = kRCacheBlockFetching;
+                RCt = _RCacheEntryFetchBlock ( self, Block, false );
+                break;
+        }
+    }
+
+    if ( RCt == 0 && Counter == NULL ) {
+        atomic64_inc ( & _StatHits );
+    }
+
+    return RCt;
+}   /* _RCacheEntryWaitBlock () */
+
+/*))
+ //  Prefetch thread : takes requests from queue, and fetches blocks
+ \\  if these are still queued
+((*/
+static
+rc_t CC
+_RCachePrefetchThread ( const KThread * Thread, void * Data )
+{
+    struct RCachePrefetch Request;
+    struct RCacheEntry * Entry;
+
+    while ( true ) {
+        if ( KLockAcquire ( _PrefetchLock ) != 0 ) {
+            break;
+        }
+
+        while ( _PrefetchQty == 0 && ! _PrefetchQuit ) {
+            KConditionWait ( _PrefetchCond, _PrefetchLock );
+        }
+
+        if ( _PrefetchQuit ) {
+            KLockUnlock ( _PrefetchLock );
+            break;
+        }
+
+        Request = _PrefetchQueue [ _PrefetchHead ];
+        _PrefetchHead = ( _PrefetchHead + 1 ) % RCACHE_PREFETCH_QUEUE;
+        _PrefetchQty --;
+
+        KLockUnlock ( _PrefetchLock );
+
+        Entry = Request . Entry;
+        if ( KLockAcquire ( Entry -> mutabor ) == 0 ) {
+            if ( Entry -> File == NULL
+                && Entry -> Blocks != NULL
+                && RCACHE_BLOCK_STATE ( Entry, Request . Block )
+                                                == kRCacheBlockQueued
+            ) {
+                Entry -> Blocks [ Request . Block ] = kRCacheBlockFetching;
+                    /*) Failed block becomes absent, and reader will
+                     /  try to fetch it again
+                    (*/
+                _RCacheEntryFetchBlock ( Entry, Request . Block, true );
+            }
+
+            KLockUnlock ( Entry -> mutabor );
+        }
+
+        RCacheEntryRelease ( Entry );
+    }
+
+    return 0;
+}   /* _RCachePrefetchThread () */
+
+static
+rc_t CC
+_RCachePrefetchStart ()
+{
+    rc_t RCt;
+    size_t llp;
+
+    RCt = 0;
+
+    _PrefetchHead = _PrefetchQty = 0;
+    _PrefetchQuit = false;
+
+    RCt = KLockMake ( & _PrefetchLock );
+    if ( RCt == 0 ) {
+        RCt = KConditionMake ( & _PrefetchCond );
+        for ( llp = 0; RCt == 0 && llp < RCACHE_PREFETCH_THREADS; llp ++ ) {
+            RCt = KThreadMake (
+                            & ( _PrefetchThreads [ llp ] ),
+                            _RCachePrefetchThread,
+                            NULL
+                            );
+            if ( RCt != 0 ) {
+                _PrefetchThreads [ llp ] = NULL;
+            }
+        }
+    }
+
+        /*) On failure threads started already are stopped and joined,
+         /  queue lock and condition are released, and error is returned,
+         |  so RemoteCacheCreate () fails and disposes the cache
+        (*/
+    if ( RCt != 0 ) {
+        LOGERR ( klogErr, RCt, "[RemoteCache] Can not start prefetch threads" );
+        _RCachePrefetchStop ();
+    }
+
+    return RCt;
+}   /* _RCachePrefetchStart () */
+
+static
+void CC
+_RCachePrefetchStop ()
+{
+    size_t llp;
+    rc_t RCt;
+    struct RCacheEntry * Entry;
+    uint64_t Block;
+
+    if ( _PrefetchLock == NULL ) {
+        return;
+    }
+
+    if ( KLockAcquire ( _PrefetchLock ) == 0 ) {
+        _PrefetchQuit = true;
+        if ( _PrefetchCond != NULL ) {
+            KConditionBroadcast ( _PrefetchCond );
+        }
+        KLockUnlock ( _PrefetchLock );
+    }
+
+    for ( llp = 0; llp < RCACHE_PREFETCH_THREADS; llp ++ ) {
+        if ( _PrefetchThreads [ llp ] != NULL ) {
+            KThreadWait ( _PrefetchThreads [ llp ], & RCt );
+            ReleaseComplain ( KThreadRelease, _PrefetchThreads [ llp ] );
+            _PrefetchThreads [ llp ] = NULL;
+        }
+    }
+
+        /*) Dropping requests left in queue
+         (*/
+    while ( 0 < _PrefetchQty ) {
+        Entry = _PrefetchQueue [ _PrefetchHead ] . Entry;
+        Block = _PrefetchQueue [ _PrefetchHead ] . Block;
+        if ( KLockAcquire ( Entry -> mutabor ) == 0 ) {
+            if ( Entry -> Blocks != NULL
+                && RCACHE_BLOCK_STATE ( Entry, Block ) == kRCacheBlockQueued
+            ) {
+                Entry -> Blocks [ Block ] = kRCacheBlockAbsent;
+            }
+            KLockUnlock ( Entry -> mutabor );
+        }
+        RCacheEntryRelease ( Entry );
+
+        _PrefetchHead = ( _PrefetchHead + 1 ) % RCACHE_PREFETCH_QUEUE;
+        _PrefetchQty --;
+    }
+
+    if ( _PrefetchCond != NULL ) {
+        ReleaseComplain ( KConditionRelease, _PrefetchCond );
+        _PrefetchCond = NULL;
+    }
+
+    ReleaseComplain ( KLockRelease, _PrefetchLock );
+    _PrefetchLock = NULL;
+}   /* _RCachePrefetchStop () */
+
+rc_t CC
+RCacheEntryPrefetch (
+            struct RCacheEntry * self,
+            uint64_t Offset,
+            size_t Size
+)
+{
+    rc_t RCt;
+    uint64_t Block, LastBlock;
+    size_t Tail;
+
+    RCt = 0;
+
+    if ( self == NULL ) {
+        return RC ( rcExe, rcFile, rcReading, rcParam, rcNull );
+    }
+
+    if ( Size == 0 || _PrefetchLock == NULL ) {
+        return 0;
+    }
+
+    RCt = KLockAcquire ( self -> mutabor );
+    if ( RCt == 0 ) {
+            /*) File is completed, or it was not opened yet
+             (*/
+        if ( self -> File == NULL
+            && self -> Blocks != NULL
+            && Offset < self -> FileSize
+        ) {
+            Block = Offset / self -> BlockSize;
+            LastBlock = ( Offset + Size - 1 ) / self -> BlockSize;
+            if ( self -> BlockQty <= LastBlock ) {
+                LastBlock = self -> BlockQty - 1;
+            }
+
+            RCt = KLockAcquire ( _PrefetchLock );
+            if ( RCt == 0 ) {
+                for ( ; Block <= LastBlock; Block ++ ) {
+                    if ( RCACHE_BLOCK_STATE ( self, Block )
+                                                != kRCacheBlockAbsent ) {
+                        continue;
+                    }
+
+                    if ( RCACHE_PREFETCH_QUEUE <= _PrefetchQty ) {
+                        break;
+                    }
+
+                    Tail = ( _PrefetchHead + _PrefetchQty )
+                                            % RCACHE_PREFETCH_QUEUE;
+                    _PrefetchQueue [ Tail ] . Entry = self;
+                    _PrefetchQueue [ Tail ] . Block = Block;
+                    _PrefetchQty ++;
+
+                        /*) Reference is dropped by prefetch thread
+                         (*/
+                    KRefcountAdd (
+                                & ( self -> refcount ),
+                                _CacheEntryClassName
+                                );
+                    self -> Blocks [ Block ] = kRCacheBlockQueued;
+                }
+
+                KConditionBroadcast ( _PrefetchCond );
+                KLockUnlock ( _PrefetchLock );
+            }
+        }
+
+        KLockUnlock ( self -> mutabor );
+    }
+
+    return RCt;
+}   /* RCacheEntryPrefetch () */
+
+void CC
+RemoteCacheGetStats ( struct RCacheStats * Stats )
+{
+    if ( Stats != NULL ) {
+        Stats -> Hits = atomic64_read ( & _StatHits );
+        Stats -> Misses = atomic64_read ( & _StatMisses );
+        Stats -> Waits = atomic64_read ( & _StatWaits );
+        Stats -> Prefetched = atomic64_read ( & _StatPrefetched );
+        Stats -> PrefetchHits = atomic64_read ( & _StatPrefetchHits );
+        Stats -> PrefetchWaste = atomic64_read ( & _StatPrefetchWaste );
+    }
+}   /* RemoteCacheGetStats () */
+
+rc_t CC
+RCacheEntryRead (
+            struct RCacheEntry * self,
+            char * Buffer,
+            size_t SizeToRead,
+            uint64_t Offset,
+            size_t * NumReaded
+)
+{
+    rc_t RCt;
+    const KFile * File;
+    uint64_t Block, BlockEnd;
+
+    RCt = 0;
+    File = NULL;
+
+    if ( self == NULL ) { 
+        return RC ( rcExe, rcFile, rcReading, rcParam, rcNull );
+    }
+
+        /*)  Here we are locking, but just for bookkeeping
+         (*/
+    RCt = KLockAcquire ( self -> mutabor );
+
+    if ( RCt == 0 ) {
+        RCt = _RCacheEntryOpenFileRead ( self );
+/*
+RmOutMsg ( "|||<-- Opening file [%s][%s] [A=%d]\n", self -> Name, self -> Url, RCt );
+*/
+        if ( RCt == 0 ) {
+            if ( RemoteCacheIsDisklessMode () ) {
+                RCt = _RCacheEntryReadRemote (
+                                            self,
+                                            Buffer,
+                                            SizeToRead,
+                                            Offset,
+                                            NumReaded,
+                                            false
+                                            );
+            }
+            else {
+                if ( self -> File == NULL ) {
+                    if ( self -> FileSize <= Offset ) {
+                        * NumReaded = 0;
+                        KLockUnlock ( self -> mutabor );
+                        return 0;
+                    }
+
+                        /*)  One block at a time, caller will ask
+                         /   for the rest
+                        (*/
+                    Block = Offset / self -> BlockSize;
+                    BlockEnd = ( Block + 1 ) * self -> BlockSize;
+                    if ( BlockEnd - Offset < SizeToRead ) {
+                        SizeToRead = ( size_t ) ( BlockEnd - Offset );
+                    }
+
+                    RCt = _RCacheEntryWaitBlock ( self, Block );
+                }
+
+                if ( RCt == 0 ) {
+                    File = self -> File != NULL
+                                    ? self -> File
+                                    : self -> Store
+                                    ;
+                    RCt = KFileAddRef ( File );
+                }
+            }
         }
 
         KLockUnlock ( self -> mutabor );
     }
 
+    if ( RCt == 0 && File != NULL ) {
+        RCt = KFileRead ( File, Offset, Buffer, SizeToRead, NumReaded );
+/*
+RmOutMsg ( "|||<-- Reading [%s][%s] [O=%d][S=%d][R=%d][A=%d]\n", self -> Name, self -> Url, Offset, SizeToRead, * NumReaded, RCt );
+*/
+        ReleaseComplain ( KFileRelease, File );
+    }
+
     return RCt;
 }   /* RCacheEntryRead () */
 
@@ -33,7 +33,7 @@
  *   1) if there -x parameter to fuser contains URL path, we suppose
  *      that fuser is working in REMOTE MODE
  *   2) REMOTE MODE required parameter cache directory, and all files
- *      will be accessed as CACHEDTEE files.
+ *      will be cached there by blocks, which are fetched on demand.
  *   3) the XML document, which describes filesystem will contain only
  *      these entries: Directory, File and another XML document.
  *   4) cached files are valid only on session time, or at the time
@@ -78,7 +78,7 @@ bool CC IsLocalPath ( const char * Path );
  * per session, which could be initialized only once
  * UPDATE: from now we allow non-cacheing or diskless mode. In that case
  *         fuzer will not create any additional files or directories and
- *         will not use cachetee file, but direct HTTP connection 
+ *         will not cache blocks, but use direct HTTP connections 
  */
 
 /* That structure will represent CacheFile
@@ -97,6 +97,30 @@ rc_t CC RCacheEntryRead (
                     uint64_t Offset,
                     size_t * NumRead
                     );
+    /*))
+     //  Asks background threads to fetch blocks of that range, if
+     \\  these are not cached yet. Does not wait. Does nothing in
+     //  diskless mode
+    ((*/
+rc_t CC RCacheEntryPrefetch (
+                    struct RCacheEntry * self,
+                    uint64_t Offset,
+                    size_t Size
+                    );
+
+    /*))
+     //  Block counters since start, all entries together
+    ((*/
+struct RCacheStats {
+    uint64_t Hits;          /* block was cached when read */
+    uint64_t Misses;        /* block was fetched by reader */
+    uint64_t Waits;         /* reader waited while block was fetched */
+    uint64_t Prefetched;    /* block was fetched by prefetch */
+    uint64_t PrefetchHits;  /* prefetched block was read */
+    uint64_t PrefetchWaste; /* prefetched block was never read */
+};
+
+void CC RemoteCacheGetStats ( struct RCacheStats * Stats );
     /*))
      //  This method will set block size for HTTP transport
      \\  If user want to use default block size value, 0 should
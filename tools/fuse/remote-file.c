@@ -29,6 +29,7 @@
 #include <kfs/directory.h>
 #include <kfs/file.h>
 #include <krypto/encfile.h>
+#include <kproc/lock.h>
 
 typedef struct RemoteFileNode RemoteFileNode;
 #define FSNODE_IMPL RemoteFileNode
@@ -38,6 +39,7 @@ typedef struct RemoteFileNode RemoteFileNode;
 #include "remote-file.h"
 #include "remote-cache.h"
 #include "kfile-accessor.h"
+#include "read-ahead.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -236,8 +238,31 @@ rc_t RemoteFileNode_Make(const KXMLNode* xml_node, FSNode** cself, char* errmsg,
 typedef struct RemoteFileAccessor_struct {
     struct RCacheEntry* rentry;
     uint64_t size;
+
+    /* access pattern of that open file */
+    KLock* lock;
+    ReadAhead ahead;
 } RemoteFileAccessor;
 
+static
+void RemoteFileAccessor_ReadAhead(RemoteFileAccessor* self, uint64_t offset, size_t num_read)
+{
+    uint64_t from = 0;
+    uint64_t to = 0;
+    bool fetch = false;
+
+    if( KLockAcquire(self->lock) != 0 ) {
+        return;
+    }
+    fetch = ReadAhead_Update(&self->ahead, offset, num_read, self->size, &from, &to);
+    KLockUnlock(self->lock);
+
+    if( fetch ) {
+        DEBUG_MSG(10, ("Read ahead from %lu %lu bytes\n", from, to - from));
+        RCacheEntryPrefetch(self->rentry, from, (size_t)(to - from));
+    }
+}
+
 static
 rc_t RemoteFileAccessor_Read(const SAccessor* cself, char* buf, size_t size, off_t offset, size_t* num_read)
 {
@@ -266,6 +291,9 @@ rc_t RemoteFileAccessor_Read(const SAccessor* cself, char* buf, size_t size, off
     } while(rc == 0 && *num_read < size);
     DEBUG_MSG(10, ("From %lu read %lu bytes\n", offset, *num_read));
 
+    if( rc == 0 && *num_read > 0 ) {
+        RemoteFileAccessor_ReadAhead(self, offset, *num_read);
+    }
     return rc;
 }
 
@@ -276,6 +304,7 @@ rc_t RemoteFileAccessor_Release(const SAccessor* cself)
     if( cself != NULL ) {
         RemoteFileAccessor* self = (RemoteFileAccessor*)cself;
         rc = RCacheEntryRelease(self->rentry);
+        ReleaseComplain(KLockRelease, self->lock);
     }
     return rc;
 }
@@ -291,10 +320,17 @@ RemoteFileAccessor_Make (
     rc_t rc = 0;
 
     if( (rc = SAccessor_Make(accessor, sizeof(RemoteFileAccessor), name, RemoteFileAccessor_Read, RemoteFileAccessor_Release)) == 0 ) {
-        ((RemoteFileAccessor*)(*accessor))->rentry = rentry;
-        ((RemoteFileAccessor*)(*accessor))->size = size;
+        RemoteFileAccessor* self = (RemoteFileAccessor*)(*accessor);
 
-        RCacheEntryAddRef ( rentry );
+        if( (rc = KLockMake(&self->lock)) == 0 ) {
+            self->rentry = rentry;
+            self->size = size;
+
+            RCacheEntryAddRef ( rentry );
+        } else {
+            SAccessor_Release(*accessor);
+            *accessor = NULL;
+        }
     }
     return rc;
 }
@@ -37,12 +37,15 @@
 #include <kfs/tar.h>
 #include <kfs/toc.h>
 #include <kfs/sra.h>
+#include <kfs/mmap.h>
+#include <kproc/thread.h>
 #include <klib/log.h>
 #include <klib/out.h>
 #include <klib/status.h>
 #include <klib/text.h>
 #include <klib/printf.h>
 #include <sysalloc.h>
+#include <atomic32.h>
 
 #include <kapp/main.h>
 #include <kapp/args.h>
@@ -69,6 +72,7 @@ KDirectory * kdir;
 #define OPTION_LONGLIST  "long-list"
 #define OPTION_DIRECTORY "directory"
 #define OPTION_ALIGN     "align"
+#define OPTION_THREADS   "threads"
 
 #define ALIAS_CREATE    "c"
 #define ALIAS_TEST      "t"
@@ -78,6 +82,10 @@ KDirectory * kdir;
 #define ALIAS_LONGLIST  "l"
 #define ALIAS_DIRECTORY "d"
 #define ALIAS_ALIGN     "a"
+#define ALIAS_THREADS   "j"
+
+#define DEFAULT_THREADS 4
+#define MAX_THREADS     64
 
 static const char * create_usage[] = { "Create a new archive.", NULL };
 static const char * extract_usage[] = { "Extract the contents of an archive into a directory.", NULL };
@@ -105,6 +113,10 @@ static const char * align_usage[] =
 static const char * longlist_usage[] =
 { "more information will be given on each file",
   "in test/list mode.", NULL };
+static const char * threads_usage[] =
+{ "number of files extracted at the same time",
+  "in extract mode",
+  "(default=4, at most 64)", NULL };
 
 OptDef Options[] = 
 {
@@ -115,7 +127,8 @@ OptDef Options[] =
     { OPTION_FORCE,     ALIAS_FORCE,     NULL, force_usage, 0, false, false },
     { OPTION_LONGLIST,  ALIAS_LONGLIST,  NULL, longlist_usage, 0, false, false },
     { OPTION_DIRECTORY, ALIAS_DIRECTORY, NULL, directory_usage, 1, true,  false },
-    { OPTION_ALIGN,     ALIAS_ALIGN,     NULL, align_usage, 1, true,  false }
+    { OPTION_ALIGN,     ALIAS_ALIGN,     NULL, align_usage, 1, true,  false },
+    { OPTION_THREADS,   ALIAS_THREADS,   NULL, threads_usage, 1, true,  false }
 };
 
 const char UsageDefaultName[] = "kar";
@@ -181,6 +194,7 @@ rc_t CC Usage (const Args * args)
     HelpOptionLine (ALIAS_FORCE, OPTION_FORCE, NULL, force_usage);
     HelpOptionLine (ALIAS_ALIGN, OPTION_ALIGN, "alignment", align_usage);
     HelpOptionLine (ALIAS_LONGLIST, OPTION_LONGLIST, NULL, longlist_usage);
+    HelpOptionLine (ALIAS_THREADS, OPTION_THREADS, "count", threads_usage);
 
     HelpOptionsStandard ();
 
@@ -228,6 +242,8 @@ static
 bool long_list;
 static
 bool force;
+static
+uint32_t num_threads;
 
 static
 KSRAFileAlignment alignment;
@@ -556,24 +572,49 @@ void remove_out_file (const char * path)
     KDirectoryRemove (kdir, true, path);
 }
 
+/* archives of cSRA runs are hundreds of GB: copy in large extents */
+#define COPY_BUFFER_SIZE ( 4 * 1024 * 1024 )
+#define COPY_BUFFER_MIN  ( 64 * 1024 )
+
+/* copy at most size bytes at inpos of fin to outpos of fout */
 static
-rc_t copy_file (const KFile * fin, KFile *fout)
+rc_t copy_file_part (const KFile * fin, uint64_t inpos, uint64_t size, KFile *fout, uint64_t outpos)
 {
     rc_t rc;
-    uint8_t	buff	[64 * 1024];
+    uint8_t *	buff;
+    size_t	bsize;
     size_t	num_read;
-    uint64_t	inpos;
-    uint64_t	outpos;
+    uint64_t	endpos;
+    uint64_t	fsize;
 
     assert (fin != NULL);
     assert (fout != NULL);
 
-    inpos = 0;
-    outpos = 0;
+    /* no need for more than the whole file */
+    if (KFileSize (fin, &fsize) == 0 && (fsize <= inpos || fsize - inpos < size))
+        size = (fsize > inpos) ? fsize - inpos : 0;
+    bsize = COPY_BUFFER_SIZE;
+    if (size < bsize)
+        bsize = (size < COPY_BUFFER_MIN) ? COPY_BUFFER_MIN : (size_t)size;
+
+    buff = malloc (bsize);
+    if (buff == NULL)
+    {
+        rc = RC (rcExe, rcFile, rcCopying, rcMemory, rcExhausted);
+        LOGERR (klogErr, rc, "Failed to allocate copy buffer");
+        return rc;
+    }
+
+    rc = 0;
+    endpos = outpos + size;
 
     do
     {
-        rc = KFileRead (fin, inpos, buff, sizeof (buff), &num_read);
+        if (endpos - outpos < bsize)
+            bsize = (size_t)(endpos - outpos);
+        if (bsize == 0)
+            break;
+        rc = KFileRead (fin, inpos, buff, bsize, &num_read);
         if (rc != 0)
         {
             PLOGERR (klogErr, (klogErr, rc,
@@ -583,35 +624,88 @@ rc_t copy_file (const KFile * fin, KFile *fout)
         }
         else if (num_read > 0)
         {
-            size_t to_write;
+            size_t num_writ;
 
             inpos += (uint64_t)num_read;
 
-            STSMSG (2, ("Read %zu bytes to %lu", num_read, inpos));
+            rc = KFileWriteAll (fout, outpos, buff, num_read, &num_writ);
+            if (rc == 0 && num_writ != num_read)
+                rc = RC (rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete);
+            if (rc != 0)
+            {
+                PLOGERR (klogErr, (klogErr, rc,
+                         "Failed to write to archive in creating archive at $(P)",
+                                   PLOG_U64(P), outpos));
+                break;
+            }
+            outpos += num_writ;
+        }
+    } while (num_read != 0);
+
+    STSMSG (2, ("Copied %lu bytes", outpos + size - endpos));
+
+    free (buff);
+    return rc;
+}
 
-/*             PLOGMSG (klogDebug10, "Read $(B) Bytes for $(T)", PLOG_2(PLOG_U64(B),PLOG_U64(T)), num_read, inpos); */
-            to_write = num_read;
-            while (to_write > 0)
+static
+rc_t copy_file (const KFile * fin, KFile *fout)
+{
+    return copy_file_part (fin, 0, (uint64_t)-1, fout, 0);
+}
+
+/* files at least this large are extracted straight from maps of the archive */
+#define MAP_MIN_SIZE ( 1024 * 1024 )
+#define MAP_EXTENT   ( 64 * 1024 * 1024 )
+
+/* copy size bytes at pos of a native file to outbase of fout without a buffer of our own */
+static
+rc_t copy_file_mapped (const KFile * fin, uint64_t pos, uint64_t size, KFile *fout, uint64_t outbase)
+{
+    rc_t rc;
+    uint64_t outpos;
+
+    assert (fin != NULL);
+    assert (fout != NULL);
+
+    rc = 0;
+    for (outpos = 0; rc == 0 && outpos < size; )
+    {
+        const KMMap * mm;
+        size_t extent;
+
+        extent = (size - outpos < MAP_EXTENT) ? (size_t)(size - outpos) : MAP_EXTENT;
+
+        rc = KMMapMakeRgnRead (&mm, fin, pos + outpos, extent);
+        if (rc == 0)
+        {
+            const void * addr;
+            size_t mapped;
+
+            rc = KMMapAddrRead (mm, &addr);
+            if (rc == 0)
+                rc = KMMapSize (mm, &mapped);
+            if (rc == 0)
             {
                 size_t num_writ;
-                rc = KFileWrite (fout, outpos, buff, num_read, &num_writ);
-                if (rc != 0)
-                {
-                    PLOGERR (klogErr, (klogErr, rc,
-                             "Failed to write to archive in creating archive at $(P)",
-                                       PLOG_U64(P), outpos));
-                    break;
-                }
+
+                if (mapped < extent)
+                    extent = mapped;
+                rc = KFileWriteAll (fout, outbase + outpos, addr, extent, &num_writ);
+                if (rc == 0 && (num_writ != extent || num_writ == 0))
+                    rc = RC (rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete);
                 outpos += num_writ;
-/*                 PLOGMSG (klogDebug10, "Wrote $(B) Bytes for $(T)", PLOG_2(PLOG_U64(B),PLOG_U64(T)), num_writ, outpos); */
-                to_write -= num_writ;
             }
+            KMMapRelease (mm);
         }
-/*         else */
-/*             PLOGMSG (klogDebug10, "Read $(B) Bytes for $(T)", PLOG_2(PLOG_U64(B),PLOG_U64(T)), num_read, inpos); */
         if (rc != 0)
-            break;
-    } while (num_read != 0);
+            PLOGERR (klogErr, (klogErr, rc,
+                     "Failed to copy from archive at $(P)",
+                               PLOG_U64(P), pos + outpos));
+    }
+
+    STSMSG (2, ("Copied %lu bytes from %lu", outpos, pos));
+
     return rc;
 }
 
@@ -820,13 +914,125 @@ rc_t	derive_directory_name (char ** dirname, const char * arcname, const char *
     return rc;
 }
 
+/* the locators of an SRA archive are relative to its first file, past the header and the TOC */
+static
+rc_t open_archive_base (const KFile * archive, uint64_t * base)
+{
+    rc_t rc;
+    KSraHeader header;
+    size_t num_read;
+    bool reverse;
+
+    rc = KFileReadAll (archive, 0, &header, sizeof header, &num_read);
+    if (rc == 0)
+        rc = SraHeaderValidate (&header, &reverse, num_read);
+    if (rc == 0)
+        *base = SraHeaderGetFileOffset (&header);
+    if (rc != 0)
+        LOGERR (klogWarn, rc, "archive header not understood: copying without maps");
+    return rc;
+}
+
+typedef struct create_adata
+{
+    const KDirectory * src;
+    KFile * fout;
+    uint64_t base;
+} create_adata;
+
+/* copies a file of the TOC from the directory archived to its place in the archive */
+static
+rc_t CC create_action (const KDirectory * dir, const char * path, void * _adata)
+{
+    rc_t rc;
+    create_adata * adata;
+    const KFile * fin;
+    uint64_t size, native_size, loc;
+
+    adata = _adata;
+
+    switch (KDirectoryPathType (dir, path))
+    {
+    case kptDir:
+        return step_through_dir (dir, path, NULL, NULL, create_action, adata);
+    case kptFile:
+        break;
+    default:
+        /* aliases are only in the TOC */
+        return 0;
+    }
+
+    rc = KDirectoryFileSize (dir, &size, path);
+    if (rc != 0 || size == 0)
+        return rc;
+    rc = KDirectoryFileLocator (dir, &loc, path);
+    if (rc == 0)
+    {
+        rc = KDirectoryVOpenFileRead (adata->src, &fin, path, NULL);
+        if (rc == 0)
+        {
+            /* changed since the TOC was made */
+            rc = KFileSize (fin, &native_size);
+            if (rc == 0 && native_size != size)
+                rc = RC (rcExe, rcFile, rcCopying, rcSize, rcUnequal);
+            if (rc == 0)
+            {
+                if (size >= MAP_MIN_SIZE)
+                    rc = copy_file_mapped (fin, 0, size, adata->fout, adata->base + loc);
+                else
+                    rc = copy_file_part (fin, 0, size, adata->fout, adata->base + loc);
+            }
+            KFileRelease (fin);
+        }
+    }
+    if (rc != 0)
+        PLOGERR (klogWarn, (klogWarn, rc, "failure to copy $(F) into the archive", PLOG_S(F), path));
+    return rc;
+}
+
+/* writes the header and the TOC, then every file from the native directory at its
+   locator: large files go out in mapped extents instead of through the TOC-file.
+   Alignment gaps are left as holes, they read as the zeros the TOC-file pads with */
+static
+rc_t create_from_native (const KDirectory * src, const KFile * toc, KFile * fout, const char * archive)
+{
+    rc_t rc;
+    const KDirectory * arc;
+    create_adata adata;
+    uint64_t fsize;
+
+    adata.src = src;
+    adata.fout = fout;
+
+    rc = KFileSize (toc, &fsize);
+    if (rc == 0)
+        rc = open_archive_base (toc, &adata.base);
+    if (rc == 0)
+        rc = KDirectoryOpenArcDirRead_silent_preopened (kdir, &arc, false, archive, tocKFile,
+                                                        (void*)toc, KArcParseSRA, NULL, NULL);
+    if (rc == 0)
+    {
+        rc = copy_file_part (toc, 0, adata.base, fout, 0);
+        if (rc == 0)
+            rc = step_through_dir (arc, ".", NULL, NULL, create_action, &adata);
+        if (rc == 0)
+            rc = KFileSetSize (fout, fsize);
+        KDirectoryRelease (arc);
+    }
+    return rc;
+}
+
 static
 rc_t	run_kar_create(const char * archive, const char * directory)
 {
     rc_t rc;
     const KFile * fin;
+    const KDirectory * src;
     KFile * fout;
+    bool copied;
 
+    src = NULL;
+    copied = false;
     rc = open_out_file (archive, &fout);
     if (rc == 0)
     {
@@ -872,6 +1078,11 @@ rc_t	run_kar_create(const char * archive, const char * directory)
                     }
 
                     rc = open_dir_as_archive ( full, & fin );
+
+                    /* the files of a native directory can be copied without the TOC-file */
+                    if ( rc == 0 && KDirectoryPathType ( kdir, full ) == kptDir &&
+                         KDirectoryOpenDirRead ( kdir, & src, false, "%s", full ) != 0 )
+                        src = NULL;
                 }
             }
             if (rc != 0)
@@ -882,8 +1093,20 @@ rc_t	run_kar_create(const char * archive, const char * directory)
                 assert (fin != NULL);
                 assert (fout != NULL);
 
-                STSMSG (4, ("start copy_file"));
-                rc = copy_file (fin, fout);
+                if (src != NULL)
+                {
+                    STSMSG (4, ("start create_from_native"));
+                    if (create_from_native (src, fin, fout, archive) == 0)
+                        copied = true;
+                    else
+                        LOGMSG (klogWarn, "copying the TOC-file instead");
+                    KDirectoryRelease (src);
+                }
+                if (!copied)
+                {
+                    STSMSG (4, ("start copy_file"));
+                    rc = copy_file (fin, fout);
+                }
                 if (rc != 0)
                     LOGERR (klogErr, rc, "failed copy file in create");
                 KFileRelease (fin);
@@ -1164,13 +1387,60 @@ rc_t run_kar_test( const char * archive )
     return rc;
 }
 
+/* a file or directory found in the archive, dealt with after the walk */
+typedef struct extract_item
+{
+    uint64_t size;
+    uint64_t loc;       /* position of the contents in the archive */
+    uint32_t access;
+    bool located;       /* contents are copied straight from loc */
+    char path [1];
+} extract_item;
+
 typedef struct extract_adata
 {
     KDirectory * dir;
     bool ( CC * filter)(const KDirectory *, const char *, void *);
     void * fdata;
+    const KFile * archive;  /* the native archive file, NULL if not available */
+    uint64_t archive_size;
+    uint64_t archive_base;  /* locators count from here: past the header and the TOC */
+    Vector files;           /* extract_item: copied by extract_files */
+    Vector dirs;            /* extract_item: in the order their access is to be set */
 } extract_adata;
 
+static
+void CC extract_item_whack (void * item, void * ignore)
+{
+    free (item);
+}
+
+static
+rc_t extract_item_push (Vector * v, const char * path, uint32_t access, extract_item ** pitem)
+{
+    rc_t rc;
+    size_t pathz;
+    extract_item * item;
+
+    pathz = strlen (path);
+    item = calloc (1, sizeof (*item) + pathz);
+    if (item == NULL)
+    {
+        rc = RC (rcExe, rcNoTarg, rcAllocating, rcMemory, rcExhausted);
+        LOGERR (klogErr, rc, "Unable to allocate memory for extracted file");
+        return rc;
+    }
+    item->access = access;
+    memcpy (item->path, path, pathz + 1);
+
+    rc = VectorAppend (v, NULL, item);
+    if (rc != 0)
+        free (item);
+    else if (pitem != NULL)
+        *pitem = item;
+    return rc;
+}
+
 static
 rc_t CC extract_action (const KDirectory * dir, const char * path, void * _adata)
 {
@@ -1217,31 +1487,17 @@ rc_t CC extract_action (const KDirectory * dir, const char * path, void * _adata
             rc = KDirectoryVAccess (dir, &access, path, NULL);
             if (rc == 0)
             {
-                const KFile * fin;
-                KFile * fout;
-                rc = KDirectoryVCreateFile (adata->dir, &fout, false, access,
-                                            kcmCreate|kcmParents,
-                                            path, NULL);
-                if (rc == 0)
+                extract_item * item;
+
+                /* copied later by extract_files */
+                rc = extract_item_push (&adata->files, path, access, &item);
+                if (rc == 0 && adata->archive != NULL &&
+                    KDirectoryFileSize (dir, &item->size, path) == 0 &&
+                    item->size >= MAP_MIN_SIZE &&
+                    KDirectoryFileLocator (dir, &item->loc, path) == 0)
                 {
-                    rc = KDirectoryVOpenFileRead (dir, &fin, path, NULL);
-                    if (rc == 0)
-                    {
-#if USE_SKEY_MD5_FIX
-                        /* KLUDGE!!!! */
-                        size_t pathz, skey_md5z;
-                        static const char skey_md5[] = "skey.md5";
-
-                        pathz = string_size (path);
-                        skey_md5z = string_size(skey_md5);
-                        if ( pathz >= skey_md5z && strcmp ( & path [ pathz - skey_md5z ], skey_md5 ) == 0 )
-                            rc = copy_file_skey_md5_kludge (fin, fout);
-                        else
-#endif
-                            rc = copy_file (fin, fout);
-                        KFileRelease (fin);
-                    }
-                    KFileRelease (fout);
+                    item->loc += adata->archive_base;
+                    item->located = item->loc + item->size <= adata->archive_size;
                 }
             }
             break;
@@ -1256,8 +1512,9 @@ rc_t CC extract_action (const KDirectory * dir, const char * path, void * _adata
                 {
                     rc = step_through_dir (dir, path, adata->filter, adata->fdata,
                                            extract_action, adata);
+                    /* set once the files in it are extracted */
                     if (rc == 0)
-                        rc = KDirectoryVSetAccess (adata->dir, false, access, 0777, path, NULL);
+                        rc = extract_item_push (&adata->dirs, path, access, NULL);
                 }
 
 
@@ -1274,6 +1531,128 @@ rc_t CC extract_action (const KDirectory * dir, const char * path, void * _adata
 
     return rc;
 }
+
+static
+rc_t extract_file (const KDirectory * din, const extract_adata * adata, const extract_item * item)
+{
+    rc_t rc;
+    const KFile * fin;
+    KFile * fout;
+
+    rc = KDirectoryVCreateFile (adata->dir, &fout, false, item->access,
+                                kcmCreate|kcmParents,
+                                item->path, NULL);
+    if (rc == 0 && item->located)
+    {
+        /* the TOC of a native archive places the contents, it has no checksum to compare */
+        rc = copy_file_mapped (adata->archive, item->loc, item->size, fout, 0);
+        KFileRelease (fout);
+    }
+    else if (rc == 0)
+    {
+        rc = KDirectoryVOpenFileRead (din, &fin, item->path, NULL);
+        if (rc == 0)
+        {
+#if USE_SKEY_MD5_FIX
+            /* KLUDGE!!!! */
+            size_t pathz, skey_md5z;
+            static const char skey_md5[] = "skey.md5";
+
+            pathz = string_size (item->path);
+            skey_md5z = string_size(skey_md5);
+            if ( pathz >= skey_md5z && strcmp ( & item->path [ pathz - skey_md5z ], skey_md5 ) == 0 )
+                rc = copy_file_skey_md5_kludge (fin, fout);
+            else
+#endif
+                rc = copy_file (fin, fout);
+            KFileRelease (fin);
+        }
+        KFileRelease (fout);
+    }
+    if (rc != 0)
+        PLOGERR (klogErr, (klogErr, rc, "failure to extract $(F)", PLOG_S(F), item->path));
+    return rc;
+}
+
+typedef struct extract_pool
+{
+    const KDirectory * din;
+    const extract_adata * adata;
+    atomic32_t next;
+    atomic32_t failed;
+} extract_pool;
+
+static
+rc_t CC extract_thread (const KThread * self, void * data)
+{
+    rc_t rc;
+    extract_pool * pool;
+
+    rc = 0;
+    pool = data;
+
+    while (rc == 0 && atomic32_read (&pool->failed) == 0)
+    {
+        uint32_t idx;
+
+        idx = atomic32_read_and_add (&pool->next, 1);
+        if (idx >= VectorLength (&pool->adata->files))
+            break;
+        rc = extract_file (pool->din, pool->adata, VectorGet (&pool->adata->files, idx));
+    }
+    if (rc != 0)
+        atomic32_set (&pool->failed, 1);
+    return rc;
+}
+
+/* the files are independent of each other: they are copied on num_threads threads */
+static
+rc_t extract_files (const KDirectory * din, const extract_adata * adata)
+{
+    rc_t rc;
+    extract_pool pool;
+    KThread * threads [MAX_THREADS];
+    uint32_t count, ix;
+
+    pool.din = din;
+    pool.adata = adata;
+    atomic32_set (&pool.next, 0);
+    atomic32_set (&pool.failed, 0);
+
+    count = num_threads;
+    assert (count <= MAX_THREADS);
+    if (count > VectorLength (&adata->files))
+        count = VectorLength (&adata->files);
+
+    STSMSG (1, ("extracting %u files on %u threads", VectorLength (&adata->files), count));
+
+    /* the calling thread is one of them */
+    for (ix = 1; ix < count; ++ix)
+    {
+        rc = KThreadMake (&threads [ix], extract_thread, &pool);
+        if (rc != 0)
+        {
+            LOGERR (klogWarn, rc, "failure to start extract thread");
+            break;
+        }
+    }
+    count = ix;
+
+    rc = extract_thread (NULL, &pool);
+
+    for (ix = 1; ix < count; ++ix)
+    {
+        rc_t status;
+        rc_t rc2 = KThreadWait (threads [ix], &status);
+        if (rc2 == 0)
+            rc2 = status;
+        if (rc == 0)
+            rc = rc2;
+        KThreadRelease (threads [ix]);
+    }
+    return rc;
+}
+
 static
 rc_t	run_kar_extract (const char * archive, const char * directory)
 {
@@ -1309,8 +1688,37 @@ rc_t	run_kar_extract (const char * archive, const char * directory)
                 adata.dir = dout;
                 adata.filter = pnamesFilter;
                 adata.fdata = NULL;
-                
+                adata.archive = NULL;
+                adata.archive_size = 0;
+                adata.archive_base = 0;
+                VectorInit (&adata.files, 0, 256);
+                VectorInit (&adata.dirs, 0, 64);
+
+                /* large files are copied straight from the archive when it is a native file */
+                if (KDirectoryVOpenFileRead (kdir, &adata.archive, archive, NULL) != 0 ||
+                    KFileSize (adata.archive, &adata.archive_size) != 0 ||
+                    open_archive_base (adata.archive, &adata.archive_base) != 0)
+                {
+                    KFileRelease (adata.archive);
+                    adata.archive = NULL;
+                }
+
                 rc = step_through_dir (din, ".", pnamesFilter, NULL, extract_action, &adata);
+                if (rc == 0)
+                    rc = extract_files (din, &adata);
+                if (rc == 0)
+                {
+                    uint32_t ix;
+                    for (ix = 0; rc == 0 && ix < VectorLength (&adata.dirs); ++ix)
+                    {
+                        const extract_item * item = VectorGet (&adata.dirs, ix);
+                        rc = KDirectoryVSetAccess (dout, false, item->access, 0777, item->path, NULL);
+                    }
+                }
+
+                VectorWhack (&adata.files, extract_item_whack, NULL);
+                VectorWhack (&adata.dirs, extract_item_whack, NULL);
+                KFileRelease (adata.archive);
                 KDirectoryRelease (dout);
             }
         }
@@ -1395,6 +1803,30 @@ rc_t CC KMain ( int argc, char *argv [] )
                 break;
             }
 
+            rc = ArgsOptionCount (args, OPTION_THREADS, &pcount);
+            if (rc)
+                break;
+            num_threads = DEFAULT_THREADS;
+            if (pcount != 0)
+            {
+                char * end;
+                unsigned long value;
+
+                rc = ArgsOptionValue (args, OPTION_THREADS, 0, &pc);
+                if (rc)
+                    break;
+                value = strtoul (pc, &end, 10);
+                if (!isdigit (pc [0]) || *end != '\0' || value == 0 || value > MAX_THREADS)
+                {
+                    rc = RC (rcExe, rcArgv, rcParsing, rcParam, rcInvalid);
+                    PLOGERR (klogFatal, (klogFatal, rc,
+                             "Parameter for threads [$(T)] is invalid: must be a number from 1 to $(M)",
+                                         PLOG_2(PLOG_S(T),PLOG_U32(M)), pc, MAX_THREADS));
+                    break;
+                }
+                num_threads = (uint32_t)value;
+            }
+
             rc = ArgsOptionCount (args, OPTION_LONGLIST, &pcount);
             if (rc)
                 break;
@@ -36,8 +36,12 @@
 
 #include <sysalloc.h>
 #include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <strtol.h>
 
 #include <iostream>
+#include <sstream>
 
 #define OPTION_REF     "aligned-region"
 #define ALIAS_REF      "r"
@@ -45,11 +49,18 @@ const char * ref_usage[] = { "Filter by position on genome.",
                              "Name can either be file specific or canonical",
                              "(ex: \"chr1\" or \"1\").",
                              "\"from\" and \"to\" are 1-based coordinates",
+                             "(ex: \"chr1:1000-2000\", can be repeated)",
                              NULL };
+
+#define OPTION_THREADS "threads"
+const char * threads_usage[] = { "How many threads pile up references / slices", 
+                                 "in parallel, from 1 to 64 (default 1)",
+                                 NULL };
                              
 OptDef options[] =
 {   /*name,           alias,         hfkt, usage-help,    maxcount, needs value, required */
     { OPTION_REF,     ALIAS_REF,     NULL, ref_usage,     0,        true,        false },
+    { OPTION_THREADS, NULL,          NULL, threads_usage, 1,        true,        false },
 };
 
 
@@ -81,6 +92,10 @@ rc_t CC Usage ( const Args * args )
     UsageSummary ( progname );
     KOutMsg ( "Options:\n" );
    
+    HelpOptionLine ( ALIAS_REF, OPTION_REF, "name[:from-to]", ref_usage );
+    HelpOptionLine ( NULL, OPTION_THREADS, "count", threads_usage );
+    KOutMsg ( "\n" );
+    
     HelpOptionsStandard ();
     HelpVersion ( fullpath, KAppVersion() );
     
@@ -97,6 +112,36 @@ ver_t CC KAppVersion ( void )
 {
     return NGS_PILEUP_VERS;
 }
+/* "name" or "name:from-to" / "name:from", from and to are 1-based and inclusive */
+static
+void AddRegion ( NGS_Pileup::Settings & settings, const char * value )
+{
+    const char * colon = strrchr ( value, ':' );
+    if ( colon == NULL || colon [ 1 ] < '0' || colon [ 1 ] > '9' )
+    {   // no positions: the name may contain a colon
+        settings . AddReference ( value );
+        return;
+    }
+    
+    std::string name ( value, colon - value );
+    char * end;
+    uint64_t from = strtou64 ( colon + 1, & end, 10 );
+    uint64_t to = 0;
+    if ( * end == '-' && end [ 1 ] != 0 )
+    {
+        to = strtou64 ( end + 1, & end, 10 );
+    }
+    else if ( * end == '-' || * end == 0 )
+    {   // open end
+        to = ( ( uint64_t ) -1 ) >> 2;
+    }
+    if ( * end != 0 || from == 0 || to < from )
+    {
+        throw ngs :: ErrorMsg ( std::string ( "invalid region: " ) + value );
+    }
+    settings . AddReferenceSlice ( name, from - 1, to - from + 1 );
+}
+
 rc_t CC KMain( int argc, char *argv [] )
 {
     Args * args;
@@ -111,19 +156,37 @@ rc_t CC KMain( int argc, char *argv [] )
             uint32_t pcount;
             
             rc = ArgsOptionCount ( args, OPTION_REF, &pcount );
-            if ( pcount > 1 )
+            for ( uint32_t i = 0; rc == 0 && i < pcount; ++i )
             {
-                throw ngs :: ErrorMsg ( "multiple positions are not supported at this point" );
+                const char * value;
+                rc = ArgsOptionValue ( args, OPTION_REF, i, & value );  
+                if ( rc != 0 )
+                {
+                    throw ngs :: ErrorMsg ( "ArgsOptionValue (" OPTION_REF ") failed" );
+                }
+                AddRegion ( settings, value );
             }
-            if ( pcount == 1 )
+            
+            rc = ArgsOptionCount ( args, OPTION_THREADS, &pcount );
+            if ( rc == 0 && pcount == 1 )
             {
                 const char * value;
-                rc = ArgsOptionValue ( args, OPTION_REF, 0, & value );  
+                rc = ArgsOptionValue ( args, OPTION_THREADS, 0, & value );  
                 if ( rc != 0 )
                 {
-                    throw ngs :: ErrorMsg ( "ArgsOptionValue (" OPTION_REF ") failed" );
+                    throw ngs :: ErrorMsg ( "ArgsOptionValue (" OPTION_THREADS ") failed" );
+                }
+                char * end;
+                unsigned long threads = strtoul ( value, & end, 10 );
+                if ( ! isdigit ( ( unsigned char ) value [ 0 ] ) || * end != 0 ||
+                     threads == 0 || threads > PILEUP_MAX_THREADS )
+                {
+                    std :: ostringstream msg;
+                    msg << "Parameter for threads [" << value
+                        << "] is invalid: must be a number from 1 to " << PILEUP_MAX_THREADS;
+                    throw ngs :: ErrorMsg ( msg . str () );
                 }
-                settings . AddReference ( value );
+                settings . num_threads = ( uint32_t ) threads;
             }
             
             rc = ArgsParamCount ( args, &pcount );
@@ -27,44 +27,66 @@
 #include "ngs-pileup.hpp"
 
 #include <iostream>
+#include <algorithm>
 
 #include <ngs/ncbi/NGS.hpp>
 #include <ngs/ReadCollection.hpp>
 #include <ngs/PileupIterator.hpp>
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
 using namespace std;
 
+/* limits memory: chunks done but not written yet per thread */
+#define PILEUP_CHUNKS_PER_THREAD 2
+
+/* limits memory: all slots together never hold more bytes than this,
+   the chunks are cut smaller for many threads */
+#define PILEUP_MAX_BUFFERED ( 256 * 1024 * 1024 )
+
+/* longest line without the reference-name: tab, position, tab, depth, newline */
+#define PILEUP_MAX_LINE_NUMBERS ( 1 + 20 + 1 + 10 + 1 )
+
 struct NGS_Pileup::TargetReference
 {
-    typedef pair < int64_t, int64_t >       Slice;
+    typedef pair < int64_t, uint64_t >      Slice;  /* 0-based start, length */
     typedef vector < Slice >                Slices;
     typedef vector < ngs :: Reference >     Targets;
-    typedef vector < ngs :: PileupIterator> Pileups;
+    typedef pair < size_t, string >         Source; /* input, common name */
+    typedef vector < Source >               Sources;
     
     string  m_canonicalName;
     Slices  m_slices;
     Targets m_targets;
-    Pileups m_pileups;
+    Sources m_sources;
     bool    m_complete;
     
-    TargetReference ( ngs :: Reference p_ref )
+    TargetReference ( ngs :: Reference p_ref, size_t p_input )
     : m_canonicalName ( p_ref . getCanonicalName() ), m_complete ( true )
     {
-        AddReference ( p_ref );
+        AddReference ( p_ref, p_input );
     }
     TargetReference ( ngs :: Reference p_ref, 
+                      size_t p_input,
                       int64_t p_first, 
-                      int64_t p_last )
+                      uint64_t p_length )
     : m_canonicalName ( p_ref . getCanonicalName() ), m_complete ( false )
     {
-        AddReference ( p_ref );
+        AddReference ( p_ref, p_input );
+        AddSlice ( p_first, p_length );
     }
     ~TargetReference ()
     {
     }
     
-    void AddSlice ( int64_t p_first, int64_t p_last )
+    void AddSlice ( int64_t p_first, uint64_t p_length )
     {
+        if ( ! m_complete )
+        {
+            m_slices . push_back ( Slice ( p_first, p_length ) );
+        }
     }
     void MakeComplete ()
     {
@@ -72,64 +94,379 @@ struct NGS_Pileup::TargetReference
         m_slices . clear();
     }
     
-    void AddReference ( ngs :: Reference p_ref )
+    void AddReference ( ngs :: Reference p_ref, size_t p_input )
     {
         m_targets. push_back ( p_ref );
+        m_sources. push_back ( Source ( p_input, p_ref . getCommonName () ) );
     }
     
-    void Process ( ostream& out )
+    /* the slices to pile up, sorted, overlapping ones merged and clipped to the reference */
+    Slices GetSlices () const
     {
-        int64_t firstPos = 0;
-        int64_t lastPos = m_targets . front () . getLength () - 1;
-
-        // create pileup iterators 
-        for ( Targets::iterator i = m_targets.begin(); i != m_targets.end(); ++i ) 
+        int64_t refLength = m_targets . front () . getLength ();
+        Slices res;
+        if ( m_complete )
         {
-            m_pileups . push_back ( i -> getPileups ( ngs::Alignment::all ) );
+            res . push_back ( Slice ( 0, refLength ) );
+            return res;
         }
         
-        int64_t curPos = firstPos;
-        while ( curPos <= lastPos ) 
+        Slices sorted ( m_slices );
+        sort ( sorted . begin (), sorted . end () );
+        for ( Slices :: const_iterator i = sorted . begin (); i != sorted . end (); ++i )
         {
-            uint32_t total_depth = 0;
-            for ( Pileups :: iterator i = m_pileups . begin (); i != m_pileups. end (); ++i )
+            int64_t first = i -> first < 0 ? 0 : i -> first;
+            if ( i -> first >= refLength )
             {
-                bool next = i -> nextPileup ();
-                assert ( next );
-                total_depth += i -> getPileupDepth ();
+                continue;
             }
-        
-            if ( total_depth > 0 )
+            int64_t end = i -> second < ( uint64_t ) ( refLength - i -> first ) ? i -> first + ( int64_t ) i -> second : refLength;
+            if ( first >= end )
             {
-                out << m_canonicalName
-                    << '\t' << ( curPos + 1 ) // convert to 1-based position to emulate samtools
-                    << '\t' << total_depth
-                    << endl;
+                continue;
+            }
+            if ( ! res . empty () && first <= res . back () . first + ( int64_t ) res . back () . second )
+            {
+                int64_t last_end = res . back () . first + ( int64_t ) res . back () . second;
+                if ( end > last_end )
+                {
+                    res . back () . second = end - res . back () . first;
+                }
+            }
+            else
+            {
+                res . push_back ( Slice ( first, end - first ) );
             }
-            
-            ++ curPos;
         }
+        return res;
     }
 };
 
 class NGS_Pileup::TargetReferences : public vector < TargetReference >
 {
 public :
-    void AddComplete ( ngs :: Reference ref )
+    TargetReference * Find ( const string & name )
     {
-        string name = ref . getCanonicalName ();
         for ( iterator i = begin(); i != end (); ++ i )
         {   
             if ( i -> m_canonicalName == name )
             {
-                i -> AddReference ( ref );
-                return;
+                return & * i;
+            }
+        }
+        return 0;
+    }
+
+    void AddComplete ( ngs :: Reference ref, size_t input )
+    {
+        TargetReference * t = Find ( ref . getCanonicalName () );
+        if ( t != 0 )
+        {
+            if ( t -> m_sources . back () . first != input )
+            {   // the same reference in another input
+                t -> AddReference ( ref, input );
             }
+            t -> MakeComplete ();
+            return;
         }
         // not found - add new reference
-        push_back ( TargetReference ( ref ) );
+        push_back ( TargetReference ( ref, input ) );
+    }
+    
+    void AddSlice ( ngs :: Reference ref, size_t input, int64_t first, uint64_t length )
+    {
+        TargetReference * t = Find ( ref . getCanonicalName () );
+        if ( t != 0 )
+        {
+            if ( t -> m_sources . back () . first != input )
+            {   // the same reference in another input
+                t -> AddReference ( ref, input );
+            }
+            t -> AddSlice ( first, length );
+            return;
+        }
+        push_back ( TargetReference ( ref, input, first, length ) );
     }
 };
+
+/* a piece of a target reference, piled up by one thread into its own buffer */
+struct NGS_Pileup::Chunk
+{
+    size_t   m_target;
+    int64_t  m_first;
+    uint64_t m_length;
+    
+    Chunk ( size_t p_target, int64_t p_first, uint64_t p_length )
+    : m_target ( p_target ), m_first ( p_first ), m_length ( p_length )
+    {
+    }
+};
+
+static
+void AppendNumber ( string & buf, uint64_t value )
+{
+    char tmp [ 24 ];
+    size_t i = sizeof tmp;
+    do
+    {
+        tmp [ -- i ] = ( char ) ( '0' + value % 10 );
+        value /= 10;
+    }
+    while ( value != 0 );
+    buf . append ( tmp + i, sizeof tmp - i );
+}
+
+/* the lines of one chunk go into buf, no flush per line */
+static
+void PileupChunk ( const string & name, 
+                   vector < ngs :: Reference > & targets, 
+                   int64_t first, 
+                   uint64_t length, 
+                   string & buf )
+{
+    vector < ngs :: PileupIterator > pileups;
+    
+    // create pileup iterators 
+    for ( vector < ngs :: Reference > :: iterator i = targets . begin (); i != targets . end (); ++i ) 
+    {
+        pileups . push_back ( i -> getPileupSlice ( first, length, ngs::Alignment::all ) );
+    }
+    
+    int64_t lastPos = first + ( int64_t ) length - 1;
+    for ( int64_t curPos = first; curPos <= lastPos; ++ curPos ) 
+    {
+        uint32_t total_depth = 0;
+        for ( vector < ngs :: PileupIterator > :: iterator i = pileups . begin (); i != pileups. end (); ++i )
+        {
+            bool next = i -> nextPileup ();
+            assert ( next );
+            total_depth += i -> getPileupDepth ();
+        }
+    
+        if ( total_depth > 0 )
+        {
+            buf . append ( name );
+            buf . push_back ( '\t' );
+            AppendNumber ( buf, curPos + 1 ); // convert to 1-based position to emulate samtools
+            buf . push_back ( '\t' );
+            AppendNumber ( buf, total_depth );
+            buf . push_back ( '\n' );
+        }
+    }
+}
+
+/* the chunks are taken by the workers in order, the calling thread writes their 
+   buffers strictly in that order, so the output is the same as with one thread */
+class NGS_Pileup::ChunkPool
+{
+public:
+    struct Slot
+    {
+        string  m_buf;      /* reused, keeps its capacity */
+        bool    m_done;
+        
+        Slot () : m_done ( false ) {}
+    };
+    
+    ChunkPool ( const Settings & p_settings, TargetReferences & p_refs, const vector < Chunk > & p_chunks, uint32_t p_threads )
+    :   m_settings ( p_settings ),
+        m_refs ( p_refs ),
+        m_chunks ( p_chunks ),
+        m_slots ( p_threads * PILEUP_CHUNKS_PER_THREAD ),
+        m_next ( 0 ),
+        m_written ( 0 ),
+        m_running ( 0 ),
+        m_quitting ( false ),
+        m_lock ( 0 ),
+        m_doneCond ( 0 ),
+        m_freeCond ( 0 )
+    {
+        if ( KLockMake ( & m_lock ) != 0 ||
+             KConditionMake ( & m_doneCond ) != 0 ||
+             KConditionMake ( & m_freeCond ) != 0 )
+        {
+            Release ();
+            throw ngs :: ErrorMsg ( "cannot create thread synchronization" );
+        }
+    }
+    ~ChunkPool ()
+    {
+        Release ();
+    }
+    
+    /* worker side: the next chunk to pile up, false if there is none */
+    bool Take ( size_t & idx )
+    {
+        bool res = false;
+        KLockAcquire ( m_lock );
+        while ( ! m_quitting && m_next < m_chunks . size () && m_next >= m_written + m_slots . size () )
+        {
+            KConditionWait ( m_freeCond, m_lock );
+        }
+        if ( ! m_quitting && m_next < m_chunks . size () )
+        {
+            idx = m_next ++;
+            res = true;
+        }
+        KLockUnlock ( m_lock );
+        return res;
+    }
+    
+    /* the slot is owned by the worker until Done() */
+    Slot & SlotOf ( size_t idx ) { return m_slots [ idx % m_slots . size () ]; }
+    
+    void Done ( size_t idx )
+    {
+        KLockAcquire ( m_lock );
+        SlotOf ( idx ) . m_done = true;
+        KConditionBroadcast ( m_doneCond );
+        KLockUnlock ( m_lock );
+    }
+    
+    /* the first error stops all workers, the writer reports it */
+    void Fail ( const string & msg )
+    {
+        KLockAcquire ( m_lock );
+        if ( m_error . empty () )
+        {
+            m_error = msg;
+        }
+        m_quitting = true;
+        KConditionBroadcast ( m_freeCond );
+        KConditionBroadcast ( m_doneCond );
+        KLockUnlock ( m_lock );
+    }
+    
+    void Started ()
+    {
+        KLockAcquire ( m_lock );
+        ++ m_running;
+        KLockUnlock ( m_lock );
+    }
+    
+    void Finished ()
+    {
+        KLockAcquire ( m_lock );
+        -- m_running;
+        KConditionBroadcast ( m_doneCond );
+        KLockUnlock ( m_lock );
+    }
+    
+    /* writer side, on the calling thread */
+    void Write ( ostream & out )
+    {
+        while ( m_written < m_chunks . size () )
+        {
+            Slot & slot = SlotOf ( m_written );
+            
+            KLockAcquire ( m_lock );
+            while ( ! slot . m_done && m_running > 0 && m_error . empty () )
+            {
+                KConditionWait ( m_doneCond, m_lock );
+            }
+            string error ( m_error );
+            bool done = slot . m_done;
+            KLockUnlock ( m_lock );
+            
+            if ( ! error . empty () )
+            {
+                throw ngs :: ErrorMsg ( error );
+            }
+            if ( ! done )
+            {
+                throw ngs :: ErrorMsg ( "pileup-threads terminated early" );
+            }
+            
+            out . write ( slot . m_buf . data (), slot . m_buf . size () );
+            slot . m_buf . clear ();
+            
+            KLockAcquire ( m_lock );
+            slot . m_done = false;
+            ++ m_written;
+            KConditionBroadcast ( m_freeCond );
+            KLockUnlock ( m_lock );
+        }
+    }
+    
+    void Quit ()
+    {
+        KLockAcquire ( m_lock );
+        m_quitting = true;
+        KConditionBroadcast ( m_freeCond );
+        KLockUnlock ( m_lock );
+    }
+    
+    const Settings &            m_settings;
+    TargetReferences &          m_refs;
+    const vector < Chunk > &    m_chunks;
+    
+private:
+    void Release ()
+    {
+        KConditionRelease ( m_freeCond );
+        KConditionRelease ( m_doneCond );
+        KLockRelease ( m_lock );
+        m_freeCond = m_doneCond = 0;
+        m_lock = 0;
+    }
+    
+    vector < Slot > m_slots;
+    string          m_error;
+    size_t          m_next;
+    size_t          m_written;
+    uint32_t        m_running;
+    bool            m_quitting;
+    KLock *         m_lock;
+    KCondition *    m_doneCond;
+    KCondition *    m_freeCond;
+};
+
+/* every worker opens the inputs itself, the ngs-objects of the calling thread are not shared */
+rc_t CC 
+NGS_Pileup::ChunkWorker ( const KThread* self, void* data )
+{
+    ChunkPool & pool = * ( ChunkPool * ) data;
+    try
+    {
+        vector < ngs :: ReadCollection > cols;
+        for ( Settings :: Inputs :: const_iterator i = pool . m_settings . inputs . begin(); 
+              i != pool . m_settings . inputs . end (); 
+              ++i )
+        {   
+            cols . push_back ( ncbi :: NGS :: openReadCollection ( *i ) );
+        }
+        
+        size_t idx;
+        size_t curTarget = pool . m_refs . size ();
+        vector < ngs :: Reference > targets;
+        while ( pool . Take ( idx ) )
+        {
+            const Chunk & chunk = pool . m_chunks [ idx ];
+            const TargetReference & ref = pool . m_refs [ chunk . m_target ];
+            if ( chunk . m_target != curTarget )
+            {
+                targets . clear ();
+                for ( TargetReference :: Sources :: const_iterator i = ref . m_sources . begin (); i != ref . m_sources . end (); ++i )
+                {
+                    targets . push_back ( cols [ i -> first ] . getReference ( i -> second ) );
+                }
+                curTarget = chunk . m_target;
+            }
+            PileupChunk ( ref . m_canonicalName, targets, chunk . m_first, chunk . m_length, pool . SlotOf ( idx ) . m_buf );
+            pool . Done ( idx );
+        }
+    }
+    catch ( ngs :: ErrorMsg & ex )
+    {
+        pool . Fail ( ex . what () );
+    }
+    catch ( ... )
+    {
+        pool . Fail ( "unknown error in pileup-thread" );
+    }
+    pool . Finished ();
+    return 0;
+}
  
 NGS_Pileup::NGS_Pileup ( const Settings& p_settings )
 : m_settings( p_settings )
@@ -137,18 +474,19 @@ NGS_Pileup::NGS_Pileup ( const Settings& p_settings )
 }
 
 static
-bool FindReference ( const NGS_Pileup :: Settings :: References & requested, const ngs :: Reference & ref )
+const NGS_Pileup :: Settings :: ReferenceSlice * 
+FindReference ( const NGS_Pileup :: Settings :: References & requested, 
+                const ngs :: Reference & ref, 
+                NGS_Pileup :: Settings :: References :: const_iterator & from )
 {
-    for ( NGS_Pileup :: Settings :: References :: const_iterator i = requested . begin(); 
-          i != requested . end (); 
-          ++i )
+    for ( ; from != requested . end (); ++from )
     {   
-        if ( i->m_name == ref . getCanonicalName () || i->m_name == ref . getCommonName () )
+        if ( from->m_name == ref . getCanonicalName () || from->m_name == ref . getCommonName () )
         {
-            return true;
+            return & * from ++;
         }
     }
-    return false;
+    return 0;
 }
     
 void 
@@ -157,11 +495,9 @@ NGS_Pileup::Run () const
     TargetReferences references;
     
     // build the set of target references
-    for ( Settings :: Inputs :: const_iterator i = m_settings . inputs . begin(); 
-          i != m_settings . inputs . end (); 
-          ++i )
+    for ( size_t input = 0; input < m_settings . inputs . size (); ++input )
     {   
-        ngs :: ReadCollection col = ncbi :: NGS :: openReadCollection ( *i );
+        ngs :: ReadCollection col = ncbi :: NGS :: openReadCollection ( m_settings . inputs [ input ] );
         ngs :: ReferenceIterator refIt = col . getReferences ();
         while ( refIt . nextReference () )
         {
@@ -169,23 +505,124 @@ NGS_Pileup::Run () const
             {
                 /* need to create a Reference object that is not attached to the iterator, so as
                     it is not invalidated on the next call to refIt.NextReference() */
-                references . AddComplete ( col . getReference ( refIt. getCommonName () ) );
+                references . AddComplete ( col . getReference ( refIt. getCommonName () ), input );
             }
-            else if ( FindReference ( m_settings . references, refIt ) )
+            else
             {
-                //TODO: handle slices
-                references . AddComplete ( col . getReference ( refIt. getCommonName () ) );
+                Settings :: References :: const_iterator from = m_settings . references . begin ();
+                const Settings :: ReferenceSlice * slice;
+                while ( ( slice = FindReference ( m_settings . references, refIt, from ) ) != 0 )
+                {
+                    if ( slice -> m_full )
+                    {
+                        references . AddComplete ( col . getReference ( refIt. getCommonName () ), input );
+                    }
+                    else
+                    {
+                        references . AddSlice ( col . getReference ( refIt. getCommonName () ), input, 
+                                                slice -> m_firstPos, slice -> m_length );
+                    }
+                }
+            }
+        }
+    }
+    
+    uint32_t threads = m_settings . num_threads;
+    if ( threads > PILEUP_MAX_THREADS )
+    {
+        threads = PILEUP_MAX_THREADS;
+    }
+    
+    // a slot holds at most one line per position of its chunk
+    uint64_t chunk_size = m_settings . chunk_size != 0 ? m_settings . chunk_size : 1;
+    if ( threads > 1 )
+    {
+        size_t max_line = 0;
+        for ( size_t t = 0; t < references . size (); ++t )
+        {
+            max_line = max ( max_line, references [ t ] . m_canonicalName . size () + PILEUP_MAX_LINE_NUMBERS );
+        }
+        uint64_t max_chunk = ( uint64_t ) PILEUP_MAX_BUFFERED / ( ( uint64_t ) threads * PILEUP_CHUNKS_PER_THREAD * max_line );
+        if ( chunk_size > max_chunk )
+        {
+            chunk_size = max_chunk != 0 ? max_chunk : 1;
+        }
+    }
+    
+    // cut the references into chunks, in output order
+    vector < Chunk > chunks;
+    for ( size_t t = 0; t < references . size (); ++t )
+    {
+        TargetReference :: Slices slices = references [ t ] . GetSlices ();
+        for ( TargetReference :: Slices :: const_iterator i = slices . begin (); i != slices . end (); ++i )
+        {
+            for ( uint64_t done = 0; done < i -> second; done += chunk_size )
+            {
+                uint64_t len = i -> second - done;
+                chunks . push_back ( Chunk ( t, i -> first + ( int64_t ) done, len > chunk_size ? chunk_size : len ) );
             }
         }
     }
     
     ostream & out ( m_settings . output != (ostream*)0 ? * m_settings . output : cout );
     
-    // walk the references and output pileups
-    for ( TargetReferences :: iterator i = references . begin(); i != references . end (); ++i )
-    {   
-        i -> Process ( out );
+    if ( threads > chunks . size () )
+    {
+        threads = ( uint32_t ) chunks . size ();
     }
+    
+    if ( threads <= 1 )
+    {
+        // walk the chunks and output pileups, through one reused buffer
+        string buf;
+        for ( vector < Chunk > :: const_iterator i = chunks . begin (); i != chunks . end (); ++i )
+        {   
+            TargetReference & ref = references [ i -> m_target ];
+            PileupChunk ( ref . m_canonicalName, ref . m_targets, i -> m_first, i -> m_length, buf );
+            out . write ( buf . data (), buf . size () );
+            buf . clear ();
+        }
+    }
+    else
+    {
+        ChunkPool pool ( m_settings, references, chunks, threads );
+        vector < KThread * > workers;
+        for ( uint32_t i = 0; i < threads; ++i )
+        {
+            KThread * t;
+            pool . Started ();
+            if ( KThreadMake ( & t, ChunkWorker, & pool ) == 0 )
+            {
+                workers . push_back ( t );
+            }
+            else
+            {
+                pool . Finished ();
+            }
+        }
+        
+        string error;
+        try
+        {
+            pool . Write ( out );
+        }
+        catch ( ngs :: ErrorMsg & ex )
+        {
+            error = ex . what ();
+        }
+        pool . Quit ();
+        for ( vector < KThread * > :: iterator i = workers . begin (); i != workers . end (); ++i )
+        {
+            rc_t rc;
+            KThreadWait ( * i, & rc );
+            KThreadRelease ( * i );
+        }
+        if ( ! error . empty () )
+        {
+            throw ngs :: ErrorMsg ( error );
+        }
+    }
+    out . flush ();
 }
 
 //// NGS_Pileup::Settings
@@ -199,8 +636,7 @@ NGS_Pileup::Settings::AddReference ( const string& commonOrCanonicalName )
 void 
 NGS_Pileup::Settings::AddReferenceSlice ( const string& commonOrCanonicalName, 
                                         int64_t firstPos, 
-                                        int64_t lastPos )
+                                        uint64_t length )
 { 
-    references . push_back ( ReferenceSlice ( commonOrCanonicalName, firstPos, lastPos ) ); 
+    references . push_back ( ReferenceSlice ( commonOrCanonicalName, firstPos, length ) ); 
 }
-
@@ -32,11 +32,16 @@
 #include <string>
 #include <vector>
 
+/* largest number of threads the references / slices are piled up on */
+#define PILEUP_MAX_THREADS 64
+
 namespace ngs
 {
     class Reference;
 }
 
+struct KThread;
+
 class NGS_Pileup
 {
 public:
@@ -47,31 +52,38 @@ public:
             ReferenceSlice( const std::string& p_name ) /* entire reference */
             :   m_name ( p_name ), 
                 m_firstPos ( 0 ),
-                m_lastPos ( 0 ),
+                m_length ( 0 ),
                 m_full ( true )
             {
             }
             ReferenceSlice( const std::string& p_name, 
                             int64_t p_firstPos, 
-                            int64_t p_lastPos )
+                            uint64_t p_length )
             :   m_name ( p_name ), 
                 m_firstPos ( p_firstPos ),
-                m_lastPos ( p_lastPos ),
+                m_length ( p_length ),
                 m_full ( false )
             {
             }
             
             std::string m_name;
-            int64_t     m_firstPos; 
-            int64_t     m_lastPos;
+            int64_t     m_firstPos; /* 0-based */
+            uint64_t    m_length;
             bool        m_full;
         };
         
+        Settings ()
+        :   output ( 0 ),
+            num_threads ( 1 ),
+            chunk_size ( 4 * 1024 * 1024 )
+        {
+        }
+        
         void AddInput ( const std::string& accession ) { inputs . push_back ( accession ); }
         void AddReference ( const std::string& commonOrCanonicalName );
         void AddReferenceSlice ( const std::string& commonOrCanonicalName, 
                                  int64_t firstPos, 
-                                 int64_t lastPos );
+                                 uint64_t length );
                                  
                                  
         typedef std::vector < std::string > Inputs;
@@ -80,6 +92,15 @@ public:
         Inputs inputs;
         std::ostream* output;
         References references;
+        
+        /* references and slices are piled up on this many threads ( at most
+           PILEUP_MAX_THREADS ), the output does not depend on it */
+        uint32_t num_threads;
+        
+        /* references ( and long slices ) are cut into chunks of this many positions, 
+           the chunks are the units of work for the threads; with more than one thread
+           they are cut smaller if the buffered output of all of them could be too big */
+        uint64_t chunk_size;
     };
     
 public:
@@ -90,6 +111,10 @@ public:
 private:
     struct TargetReference;
     class TargetReferences;
+    struct Chunk;
+    class ChunkPool;
+    
+    static rc_t CC ChunkWorker ( const KThread* self, void* data );
     
     Settings            m_settings;
 };
@@ -61,6 +61,9 @@
 
 #include <kfs/arrayfile.h>
 
+#include <kproc/thread.h>
+
+#include <atomic32.h>
 #include <sysalloc.h>
 
 #include <stdlib.h>
@@ -250,11 +253,17 @@ typedef struct seq_con_pas_met
     con_ctx consensus;      /* from pl-consensus.h */
     pas_ctx passes;         /* from pl-passes.h */
     met_ctx metrics;        /* from pl-metrics.h */
+
+    /* the tables are loaded in parallel, all but SEQUENCE report their progress on their own */
+    ld_context con_lctx;
+    ld_context pas_lctx;
+    ld_context met_lctx;
 } seq_con_pas_met;
 
 
 /* we have to pass in the first hdf5-source, because prepare of sequences needs it */
-static rc_t pacbio_prepare( VDatabase * database, seq_con_pas_met * dst, KDirectory * first_src, ld_context *lctx )
+static rc_t pacbio_prepare( context *ctx, VDatabase * database, seq_con_pas_met * dst,
+                            KDirectory * first_src, ld_context *lctx )
 {
     rc_t rc;
 
@@ -263,46 +272,138 @@ static rc_t pacbio_prepare( VDatabase * database, seq_con_pas_met * dst, KDirect
     dst->passes.cursor = NULL;
     dst->metrics.cursor = NULL;
 
+    lctx_init_side( &dst->con_lctx, lctx ); /* pl-tools.c */
+    lctx_init_side( &dst->pas_lctx, lctx );
+    lctx_init_side( &dst->met_lctx, lctx );
+    /* only one console-progressbar: the one of the sequence-table, if that is loaded */
+    dst->con_lctx.with_progress = lctx->with_progress && !ctx_ld_sequence( ctx );
+
     rc = prepare_seq( database, &dst->sequence, first_src, lctx ); /* pl-sequence.c */
     if ( rc == 0 )
-        rc = prepare_consensus( database, &dst->consensus, lctx ); /* pl-consensus.c */
+        rc = prepare_consensus( database, &dst->consensus, &dst->con_lctx ); /* pl-consensus.c */
     if ( rc == 0 )
-        rc = prepare_passes( database, &dst->passes, lctx ); /* pl-passes.c */
+        rc = prepare_passes( database, &dst->passes, &dst->pas_lctx ); /* pl-passes.c */
     if ( rc == 0 )
-        rc = prepare_metrics( database, &dst->metrics, lctx ); /* pl-metrics.c */
+        rc = prepare_metrics( database, &dst->metrics, &dst->met_lctx ); /* pl-metrics.c */
     return rc;
 }
 
 
-static rc_t pacbio_load_src( context *ctx, seq_con_pas_met * dst, KDirectory * src, bool * consensus_present )
+/* one table of one hdf5-source, loaded by a thread of its own */
+typedef struct tab_job
+{
+    KThread * thread;
+    seq_con_pas_met * dst;
+    KDirectory * src;
+    rc_t rc;
+} tab_job;
+
+
+static rc_t CC pacbio_seq_thread( const KThread * self, void * data )
+{
+    tab_job * job = data;
+    return load_seq_src( &job->dst->sequence, job->src ); /* pl-sequence.c */
+}
+
+
+static rc_t CC pacbio_consensus_thread( const KThread * self, void * data )
+{
+    tab_job * job = data;
+    return load_consensus_src( &job->dst->consensus, job->src ); /* pl-consensus.c */
+}
+
+
+static rc_t CC pacbio_passes_thread( const KThread * self, void * data )
+{
+    tab_job * job = data;
+    return load_passes_src( &job->dst->passes, job->src ); /* pl-passes.c */
+}
+
+
+static rc_t CC pacbio_metrics_thread( const KThread * self, void * data )
 {
-    rc_t rc1, rc = 0;
+    tab_job * job = data;
+    return load_metrics_src( &job->dst->metrics, job->src ); /* pl-metrics.c */
+}
 
-    if ( ctx_ld_sequence( ctx ) )
-        rc = load_seq_src( &dst->sequence, src ); /* pl-sequence.c */
 
-    if ( rc == 0 && ctx_ld_consensus( ctx ) )
+static void pacbio_start_job( tab_job * job, rc_t ( CC * run ) ( const KThread *self, void *data ),
+                              seq_con_pas_met * dst, KDirectory * src )
+{
+    job->dst = dst;
+    job->src = src;
+    job->rc = KThreadMake ( &job->thread, run, job );
+    if ( job->rc != 0 )
     {
-        rc1 = load_consensus_src( &dst->consensus, src ); /* pl-consensus.c */
-        if ( rc1 == 0 )
-            *consensus_present = true;
-        else
-            LOGMSG( klogWarn, "the consensus-group is missing" );
+        /* no thread: load the table right here */
+        job->thread = NULL;
+        job->rc = run( NULL, job );
     }
+}
+
 
-    if ( rc == 0 && ctx_ld_passes( ctx ) && *consensus_present )
+static rc_t pacbio_wait_job( tab_job * job )
+{
+    if ( job->thread != NULL )
     {
-        rc1 = load_passes_src( &dst->passes, src ); /* pl-passes.c */
-        if ( rc1 != 0 )
-            LOGMSG( klogWarn, "the passes-table is missing" );
+        rc_t rc = KThreadWait ( job->thread, &job->rc );
+        if ( rc != 0 )
+            job->rc = rc;
+        KThreadRelease ( job->thread );
+        job->thread = NULL;
     }
+    return job->rc;
+}
 
-    if ( rc == 0 && ctx_ld_metrics( ctx ) && *consensus_present )
+
+static bool pacbio_has_consensus( KDirectory * hdf5_src )
+{
+    uint32_t pt = KDirectoryPathType ( hdf5_src, "PulseData/ConsensusBaseCalls" );
+    return ( pt == kptDir );
+}
+
+
+static rc_t pacbio_load_src( context *ctx, seq_con_pas_met * dst, KDirectory * src, bool * consensus_present )
+{
+    rc_t rc = 0;
+    tab_job seq, con, pas, met;
+    bool ld_sequence = ctx_ld_sequence( ctx );
+    bool ld_consensus = ctx_ld_consensus( ctx );
+    /* passes and metrics are loaded only if there is a consensus, they are started
+       before the consensus-table is loaded: look if the source has the group */
+    bool with_consensus = *consensus_present || ( ld_consensus && pacbio_has_consensus( src ) );
+    bool ld_passes = ctx_ld_passes( ctx ) && with_consensus;
+    bool ld_metrics = ctx_ld_metrics( ctx ) && with_consensus;
+    /* the loaders raise the log-level for a message and restore it, that gets mixed up in parallel */
+    KLogLevel lvl = KLogLevelGet();
+
+    if ( ld_sequence )
+        pacbio_start_job( &seq, pacbio_seq_thread, dst, src );
+    if ( ld_consensus )
+        pacbio_start_job( &con, pacbio_consensus_thread, dst, src );
+    if ( ld_passes )
+        pacbio_start_job( &pas, pacbio_passes_thread, dst, src );
+    if ( ld_metrics )
+        pacbio_start_job( &met, pacbio_metrics_thread, dst, src );
+
+    if ( ld_sequence )
+        rc = pacbio_wait_job( &seq );
+
+    if ( ld_consensus )
     {
-        rc1 = load_metrics_src( &dst->metrics, src ); /* pl-metrics.c */
-        if ( rc1 != 0 )
-            LOGMSG( klogWarn, "the metrics-table is missing" );
+        if ( pacbio_wait_job( &con ) == 0 )
+            *consensus_present = true;
+        else
+            LOGMSG( klogWarn, "the consensus-group is missing" );
     }
+
+    if ( ld_passes && pacbio_wait_job( &pas ) != 0 )
+        LOGMSG( klogWarn, "the passes-table is missing" );
+
+    if ( ld_metrics && pacbio_wait_job( &met ) != 0 )
+        LOGMSG( klogWarn, "the metrics-table is missing" );
+
+    KLogLevelSet( lvl );
     return rc;
 }
 
@@ -316,6 +417,9 @@ static rc_t pacbio_finish( seq_con_pas_met * dst )
         rc = finish_passes( &dst->passes ); /* pl-passes.c */
     if ( rc == 0 )
         rc = finish_metrics( &dst->metrics ); /* pl-metrics.c */
+    lctx_free( &dst->con_lctx );
+    lctx_free( &dst->pas_lctx );
+    lctx_free( &dst->met_lctx );
     return rc;
 }
 
@@ -381,25 +485,109 @@ static rc_t pacbio_get_MultiParts( KDirectory * hdf5_src, VNamelist * parts )
 }
 
 
+/* reads the next part of a multipart-source while the current one is loaded,
+   for the part to be in the cache of the os by the time libhdf5 gets to it */
+typedef struct part_prefetch
+{
+    KThread * thread;
+    const struct KFile * f;
+    atomic32_t stop;
+} part_prefetch;
+
+
+#define PREFETCH_CHUNK ( 4 * 1024 * 1024 )
+
+static rc_t CC pacbio_prefetch_thread( const KThread * self, void * data )
+{
+    part_prefetch * pf = data;
+    rc_t rc = 0;
+    char * buffer = malloc( PREFETCH_CHUNK );
+    if ( buffer == NULL )
+        rc = RC( rcExe, rcNoTarg, rcAllocating, rcMemory, rcExhausted );
+    else
+    {
+        uint64_t pos = 0;
+        size_t num_read = 1;
+        while ( rc == 0 && num_read > 0 && atomic32_read( &pf->stop ) == 0 )
+        {
+            rc = KFileRead ( pf->f, pos, buffer, PREFETCH_CHUNK, &num_read );
+            pos += num_read;
+        }
+        free( buffer );
+    }
+    return rc;
+}
+
+
+static void pacbio_prefetch_start( part_prefetch * pf, KDirectory * wd, const VNamelist * path_list,
+                                   uint32_t idx, uint32_t count )
+{
+    const char * src_path;
+
+    pf->thread = NULL;
+    pf->f = NULL;
+    atomic32_set( &pf->stop, 0 );
+    if ( idx < count &&
+         VNameListGet ( path_list, idx, &src_path ) == 0 && src_path != NULL &&
+         KDirectoryOpenFileRead ( wd, &pf->f, "%s", src_path ) == 0 )
+    {
+        /* nothing lost if it does not work: the part is just read when it is loaded */
+        if ( KThreadMake ( &pf->thread, pacbio_prefetch_thread, pf ) != 0 )
+            pf->thread = NULL;
+    }
+}
+
+
+static void pacbio_prefetch_finish( part_prefetch * pf, bool cancel )
+{
+    if ( cancel )
+        atomic32_set( &pf->stop, 1 );
+    if ( pf->thread != NULL )
+    {
+        KThreadWait ( pf->thread, NULL );
+        KThreadRelease ( pf->thread );
+        pf->thread = NULL;
+    }
+    if ( pf->f != NULL )
+    {
+        KFileRelease ( pf->f );
+        pf->f = NULL;
+    }
+}
+
+
 static rc_t pacbio_load_multipart( context * ctx, KDirectory * wd, VDatabase * database,
                                    KDirectory ** hdf5_src, bool * consensus_present, 
                                    ld_context * lctx, uint32_t count )
 {
     seq_con_pas_met dst;
+    part_prefetch prefetch;
     uint32_t idx = 0;
-    /* the loop is complicated, because pacbio_prepare needs the first hdf5-src opened ! */
-    rc_t rc = pacbio_prepare( database, &dst, *hdf5_src, lctx );
-    while ( idx < count && rc == 0 )
+    /* the tables are loaded in parallel, they share libhdf5 through a lock */
+    rc_t rc = pl_locks_make(); /* pl-tools.c */
+    if ( rc == 0 )
     {
-        rc = pacbio_load_src( ctx, &dst, *hdf5_src, consensus_present );
-        idx++;
-        if ( rc == 0 && idx < count )
+        /* the loop is complicated, because pacbio_prepare needs the first hdf5-src opened ! */
+        rc = pacbio_prepare( ctx, database, &dst, *hdf5_src, lctx );
+        pacbio_prefetch_start( &prefetch, wd, ctx->src_paths, 1, count );
+        while ( idx < count && rc == 0 )
         {
-            KDirectoryRelease ( *hdf5_src );
-            rc = pacbio_get_hdf5_src( wd, ctx->src_paths, idx, hdf5_src );
+            rc = pacbio_load_src( ctx, &dst, *hdf5_src, consensus_present );
+            idx++;
+            if ( rc == 0 && idx < count )
+            {
+                /* let it read the rest of the next part, before libhdf5 opens it */
+                pacbio_prefetch_finish( &prefetch, false );
+                KDirectoryRelease ( *hdf5_src );
+                rc = pacbio_get_hdf5_src( wd, ctx->src_paths, idx, hdf5_src );
+                if ( rc == 0 )
+                    pacbio_prefetch_start( &prefetch, wd, ctx->src_paths, idx + 1, count );
+            }
         }
+        pacbio_prefetch_finish( &prefetch, true );
+        pacbio_finish( &dst );
+        pl_locks_release();
     }
-    pacbio_finish( &dst );
     KDirectoryRelease ( *hdf5_src );
     return rc;
 }
@@ -26,6 +26,7 @@
 
 #include "pl-tools.h"
 #include <klib/printf.h>
+#include <kproc/lock.h>
 #include <sysalloc.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -63,6 +64,61 @@ void lctx_free( ld_context * lctx )
 }
 
 
+void lctx_init_side( ld_context * lctx, const ld_context * src )
+{
+    *lctx = *src;
+    lctx->xml_logger = NULL;
+    lctx->xml_progress = NULL;
+    lctx->with_progress = false;
+}
+
+
+/* made only while tables are loaded in parallel, the functions below do nothing without them */
+static KLock * hdf5_lock = NULL;
+static KLock * progress_lock = NULL;
+
+
+rc_t pl_locks_make( void )
+{
+    rc_t rc = KLockMake ( &hdf5_lock );
+    if ( rc == 0 )
+    {
+        rc = KLockMake ( &progress_lock );
+        if ( rc != 0 )
+        {
+            KLockRelease ( hdf5_lock );
+            hdf5_lock = NULL;
+        }
+    }
+    if ( rc != 0 )
+        LOGERR( klogErr, rc, "cannot make locks" );
+    return rc;
+}
+
+
+void pl_locks_release( void )
+{
+    KLockRelease ( hdf5_lock );
+    hdf5_lock = NULL;
+    KLockRelease ( progress_lock );
+    progress_lock = NULL;
+}
+
+
+void hdf5_enter( void )
+{
+    if ( hdf5_lock != NULL )
+        KLockAcquire ( hdf5_lock );
+}
+
+
+void hdf5_leave( void )
+{
+    if ( hdf5_lock != NULL )
+        KLockUnlock ( hdf5_lock );
+}
+
+
 rc_t check_src_objects( const KDirectory *hdf5_dir,
                         const char ** groups, 
                         const char **tables,
@@ -72,6 +128,7 @@ rc_t check_src_objects( const KDirectory *hdf5_dir,
     uint16_t idx = 0;
     uint32_t pt;
 
+    hdf5_enter();
     if ( groups != NULL )
     {
         while ( groups[ idx ] != NULL && rc == 0 )
@@ -112,6 +169,7 @@ rc_t check_src_objects( const KDirectory *hdf5_dir,
                 idx++;
         }
     }
+    hdf5_leave();
 
     return rc;
 }
@@ -127,7 +185,7 @@ void init_array_file( af_data * af )
 }
 
 
-void free_array_file( af_data * af )
+static void release_array_file( af_data * af )
 {
     if ( af->af != NULL )
     {
@@ -152,6 +210,14 @@ void free_array_file( af_data * af )
 }
 
 
+void free_array_file( af_data * af )
+{
+    hdf5_enter();
+    release_array_file( af );
+    hdf5_leave();
+}
+
+
 static rc_t read_cache_content( af_data * af )
 {
     rc_t rc = 0;
@@ -185,14 +251,14 @@ static rc_t read_cache_content( af_data * af )
 }
 
 
-rc_t open_array_file( const KDirectory *dir,
-                      const char *name,
-                      af_data * af,
-                      const uint64_t expected_element_bits,
-                      const uint64_t expected_cols,
-                      bool disp_wrong_bitsize,
-                      bool cache_content,
-                      bool supress_err_msg )
+static rc_t open_array_file_locked( const KDirectory *dir,
+                                     const char *name,
+                                     af_data * af,
+                                     const uint64_t expected_element_bits,
+                                     const uint64_t expected_cols,
+                                     bool disp_wrong_bitsize,
+                                     bool cache_content,
+                                     bool supress_err_msg )
 {
     rc_t rc;
 
@@ -215,7 +281,7 @@ rc_t open_array_file( const KDirectory *dir,
     {
         PLOGERR( klogErr, ( klogErr, rc, "cannot open hdf5-arrayfile '$(name)'",
                             "name=%s", name ) );
-        free_array_file( af );
+        release_array_file( af );
         return rc;
     }
     /* detect the dimensionality of the array-file */
@@ -224,7 +290,7 @@ rc_t open_array_file( const KDirectory *dir,
     {
         PLOGERR( klogErr, ( klogErr, rc, "cannot retrieve dimensionality on '$(name)'",
                             "name=%s", name ) );
-        free_array_file( af );
+        release_array_file( af );
         return rc;
     }
     /* make a array to hold the extent in every dimension */
@@ -234,7 +300,7 @@ rc_t open_array_file( const KDirectory *dir,
         rc = RC ( rcApp, rcArgv, rcAccessing, rcMemory, rcExhausted );
         PLOGERR( klogErr, ( klogErr, rc, "cannot allocate enough memory for extents of '$(name)'",
                             "name=%s", name ) );
-        free_array_file( af );
+        release_array_file( af );
         return rc;
     }
     /* read the actuall extents into the created array */
@@ -243,7 +309,7 @@ rc_t open_array_file( const KDirectory *dir,
     {
         PLOGERR( klogErr, ( klogErr, rc, "cannot retrieve extents of '$(name)'",
                             "name=%s", name ) );
-        free_array_file( af );
+        release_array_file( af );
         return rc;
     }
     /* request the size of the element in bits */
@@ -252,7 +318,7 @@ rc_t open_array_file( const KDirectory *dir,
     {
         PLOGERR( klogErr, ( klogErr, rc, "cannot retrieve element-size of '$(name)'",
                             "name=%s", name ) );
-        free_array_file( af );
+        release_array_file( af );
         return rc;
     }
     /* compare the discovered bit-size with the expected one */
@@ -267,7 +333,7 @@ rc_t open_array_file( const KDirectory *dir,
             PLOGERR( klogErr, ( klogErr, rc, "unexpected element-bits of $(bsize) in '$(name)'",
                      "bsize=%lu,name=%s", af->element_bits, name ) );
 
-        free_array_file( af );
+        release_array_file( af );
         return rc;
     }
 
@@ -280,7 +346,7 @@ rc_t open_array_file( const KDirectory *dir,
             rc = RC ( rcExe, rcNoTarg, rcLoading, rcData, rcInconsistent );
             PLOGERR( klogErr, ( klogErr, rc, "unexpected dimensionality of $(dim) in '$(name)'",
                                 "dim=%lu,name=%s", af->dimensionality, name ) );
-            free_array_file( af );
+            release_array_file( af );
             return rc;
         }
     }
@@ -292,7 +358,7 @@ rc_t open_array_file( const KDirectory *dir,
             rc = RC ( rcExe, rcNoTarg, rcLoading, rcData, rcInconsistent );
             PLOGERR( klogErr, ( klogErr, rc, "unexpected dimensionality of $(dim) in '$(name)'",
                                 "dim=%lu,name=%s", af->dimensionality, name ) );
-            free_array_file( af );
+            release_array_file( af );
             return rc;
         }
         else
@@ -302,7 +368,7 @@ rc_t open_array_file( const KDirectory *dir,
                 rc = RC ( rcExe, rcNoTarg, rcLoading, rcData, rcInconsistent );
                 PLOGERR( klogErr, ( klogErr, rc, "unexpected extent[1] of $(ext) in '$(name)'",
                                     "ext=%lu,name=%s", af->extents[ 1 ], name ) );
-                free_array_file( af );
+                release_array_file( af );
                 return rc;
             }
         }
@@ -315,6 +381,24 @@ rc_t open_array_file( const KDirectory *dir,
 }
 
 
+rc_t open_array_file( const KDirectory *dir,
+                      const char *name,
+                      af_data * af,
+                      const uint64_t expected_element_bits,
+                      const uint64_t expected_cols,
+                      bool disp_wrong_bitsize,
+                      bool cache_content,
+                      bool supress_err_msg )
+{
+    rc_t rc;
+    hdf5_enter();
+    rc = open_array_file_locked( dir, name, af, expected_element_bits, expected_cols,
+                                 disp_wrong_bitsize, cache_content, supress_err_msg );
+    hdf5_leave();
+    return rc;
+}
+
+
 /* assembles the 'absolute' path to the requested array-file before opening it */
 rc_t open_element( const KDirectory *hdf5_dir, 
                    af_data *element, 
@@ -350,7 +434,11 @@ rc_t array_file_read_dim1( af_data * af, const uint64_t pos,
 {
     rc_t rc = 0;
     if ( af->content == NULL )
+    {
+        hdf5_enter();
         rc = KArrayFileRead ( af->af, 1, &pos, dst, &count, n_read );
+        hdf5_leave();
+    }
     else
     {
         if ( ( pos + count ) > af->extents[ 0 ] )
@@ -388,7 +476,9 @@ rc_t array_file_read_dim2( af_data * af, const uint64_t pos,
         pos2[ 1 ] = 0;
         count2[ 0 ] = count;
         count2[ 1 ] = ext2;
+        hdf5_enter();
         rc = KArrayFileRead ( af->af, 2, pos2, dst, count2, read2 );
+        hdf5_leave();
         if ( rc != 0 )
             LOGERR( klogErr, rc, "error reading arrayfile-data (2 dim)" );
         *n_read = read2[ 0 ];
@@ -565,6 +655,8 @@ rc_t load_table( VDatabase * database, KDirectory * hdf5_src, ld_context *lctx,
 rc_t progress_chunk( const KLoadProgressbar ** xml_progress, const uint64_t chunk )
 {
     rc_t rc;
+    if ( progress_lock != NULL )
+        KLockAcquire ( progress_lock );
     /* release the old progressbar... */
     if ( *xml_progress != NULL )
     {
@@ -576,6 +668,8 @@ rc_t progress_chunk( const KLoadProgressbar ** xml_progress, const uint64_t chun
         rc = KLoadProgressbar_Append( *xml_progress, chunk );
     else
         LOGERR( klogErr, rc, "cannot make KLoadProgressbar" );
+    if ( progress_lock != NULL )
+        KLockUnlock ( progress_lock );
 
     return rc;
 }
@@ -583,10 +677,16 @@ rc_t progress_chunk( const KLoadProgressbar ** xml_progress, const uint64_t chun
 
 rc_t progress_step( const KLoadProgressbar * xml_progress )
 {
+    rc_t rc = 0;
     if ( xml_progress != NULL )
-       return KLoadProgressbar_Process( xml_progress, 1, false );
-    else
-        return 0;
+    {
+        if ( progress_lock != NULL )
+            KLockAcquire ( progress_lock );
+        rc = KLoadProgressbar_Process( xml_progress, 1, false );
+        if ( progress_lock != NULL )
+            KLockUnlock ( progress_lock );
+    }
+    return rc;
 }
 
 
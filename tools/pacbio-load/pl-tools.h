@@ -190,6 +190,17 @@ typedef struct ld_context
 void lctx_init( ld_context * lctx );
 void lctx_free( ld_context * lctx );
 
+/* a context for a table loaded next to the sequence-table:
+   it shares the settings of src, but has its own xml-progressbar and no console-progressbar */
+void lctx_init_side( ld_context * lctx, const ld_context * src );
+
+/* libhdf5 is not thread-safe: while the tables are loaded in parallel
+   every call into it has to be made between hdf5_enter() and hdf5_leave() */
+rc_t pl_locks_make( void );
+void pl_locks_release( void );
+void hdf5_enter( void );
+void hdf5_leave( void );
+
 
 rc_t check_src_objects( const KDirectory *hdf5_dir,
                         const char ** groups, 
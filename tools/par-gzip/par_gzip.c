@@ -0,0 +1,533 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "par_gzip.h"
+
+#include <klib/log.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define PGZ_MAX_THREADS         PAR_GZIP_MAX_THREADS
+#define PGZ_SLOTS_PER_THREAD    3
+#define PGZ_GZIP_BLOCK          ( 1024 * 1024 )
+#define PGZ_BGZF_BLOCK          PAR_GZIP_BGZF_BLOCK
+#define PGZ_BGZF_PER_SLOT       16
+#define PGZ_HDR_GZIP            10
+#define PGZ_HDR_BGZF            18
+#define PGZ_TRAILER             8
+
+/* the empty block every BGZF-file ends with */
+static const uint8_t bgzf_eof[ 28 ] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+    0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00
+};
+
+/* a gzip-member of no data, written if nothing else was: an empty file is no gzip-file */
+static const uint8_t gzip_empty[ 20 ] =
+{
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xff, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00
+};
+
+enum pgz_slot_state
+{
+    pgz_free = 0,   /* producer fills it */
+    pgz_filled,     /* waits for a worker */
+    pgz_busy,       /* a worker compresses it */
+    pgz_done        /* waits to be written */
+};
+
+typedef struct pgz_slot
+{
+    uint8_t * in;
+    size_t in_len;
+    uint8_t * out;
+    size_t out_len;
+    size_t member_len[ PGZ_BGZF_PER_SLOT ];
+    uint32_t members;
+    enum pgz_slot_state state;
+    rc_t rc;
+} pgz_slot;
+
+struct par_gzip
+{
+    KFile * dst;
+    uint64_t pos;
+    enum par_gzip_framing framing;
+    size_t slot_size;
+    size_t out_size;
+
+    /* slot number n is slots[ n % num_slots ] */
+    pgz_slot * slots;
+    uint32_t num_slots;
+    uint64_t next_fill;     /* slot the producer fills */
+    uint64_t next_take;     /* slot the next worker takes */
+    uint64_t next_write;    /* slot to be written next */
+
+    KLock * lock;
+    KCondition * filled;    /* signaled when a slot is ready for a worker */
+    KCondition * done;      /* signaled when a worker is done with a slot */
+    KThread * threads[ PGZ_MAX_THREADS ];
+    uint32_t num_threads;
+    bool quit;
+    rc_t rc;                /* the first error, the stream is broken after it */
+
+    z_stream zs;            /* used if there are no worker-threads */
+    bool zs_ready;
+
+    par_gzip_on_block on_block;
+    void * on_block_data;
+};
+
+
+static void put_u16( uint8_t * dst, uint32_t value )
+{
+    dst[ 0 ] = ( uint8_t )( value & 0xff );
+    dst[ 1 ] = ( uint8_t )( ( value >> 8 ) & 0xff );
+}
+
+
+static void put_u32( uint8_t * dst, uint32_t value )
+{
+    put_u16( dst, value & 0xffff );
+    put_u16( dst + 2, value >> 16 );
+}
+
+
+static rc_t pgz_init_stream( z_stream * zs )
+{
+    memset( zs, 0, sizeof *zs );
+    /* raw deflate, headers and trailers are written here */
+    if ( deflateInit2( zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+        return RC( rcExe, rcFile, rcConstructing, rcInterface, rcUnexpected );
+    return 0;
+}
+
+
+/* compresses one gzip-member ( or BGZF-block ) into dst, returns its size */
+static rc_t pgz_member( z_stream * zs, enum par_gzip_framing framing,
+                        const uint8_t * src, size_t src_len,
+                        uint8_t * dst, size_t dst_len, size_t * written )
+{
+    size_t hdr = ( framing == pgz_bgzf ) ? PGZ_HDR_BGZF : PGZ_HDR_GZIP;
+    size_t total;
+    int zr;
+
+    if ( dst_len < hdr + PGZ_TRAILER )
+        return RC( rcExe, rcFile, rcWriting, rcBuffer, rcInsufficient );
+
+    zr = deflateReset( zs );
+    if ( zr == Z_OK )
+    {
+        zs->next_in = ( Bytef * )src;
+        zs->avail_in = ( uInt )src_len;
+        zs->next_out = ( Bytef * )( dst + hdr );
+        zs->avail_out = ( uInt )( dst_len - hdr - PGZ_TRAILER );
+        zr = deflate( zs, Z_FINISH );
+    }
+    if ( zr != Z_STREAM_END )
+        return RC( rcExe, rcFile, rcWriting, rcInterface, rcUnexpected );
+
+    total = hdr + ( dst_len - hdr - PGZ_TRAILER - zs->avail_out ) + PGZ_TRAILER;
+
+    /* ID1 ID2 CM FLG MTIME XFL OS */
+    memset( dst, 0, PGZ_HDR_GZIP );
+    dst[ 0 ] = 0x1f;
+    dst[ 1 ] = 0x8b;
+    dst[ 2 ] = Z_DEFLATED;
+    dst[ 9 ] = 0xff;
+    if ( framing == pgz_bgzf )
+    {
+        /* FEXTRA with subfield 'BC' holding the block-size - 1 */
+        dst[ 3 ] = 0x04;
+        put_u16( dst + 10, 6 );
+        dst[ 12 ] = 'B';
+        dst[ 13 ] = 'C';
+        put_u16( dst + 14, 2 );
+        put_u16( dst + 16, ( uint32_t )( total - 1 ) );
+    }
+    put_u32( dst + total - PGZ_TRAILER, ( uint32_t )crc32( crc32( 0, Z_NULL, 0 ), src, ( uInt )src_len ) );
+    put_u32( dst + total - 4, ( uint32_t )src_len );
+
+    *written = total;
+    return 0;
+}
+
+
+static rc_t pgz_compress( par_gzip * self, z_stream * zs, pgz_slot * slot )
+{
+    rc_t rc = 0;
+    size_t block = ( self->framing == pgz_bgzf ) ? PGZ_BGZF_BLOCK : slot->in_len;
+    size_t done = 0;
+
+    slot->out_len = 0;
+    slot->members = 0;
+    while ( rc == 0 && done < slot->in_len )
+    {
+        size_t len = slot->in_len - done;
+        size_t written = 0;
+        if ( len > block )
+            len = block;
+        rc = pgz_member( zs, self->framing, slot->in + done, len,
+                         slot->out + slot->out_len, self->out_size - slot->out_len, &written );
+        done += len;
+        slot->out_len += written;
+        if ( slot->members < PGZ_BGZF_PER_SLOT )
+            slot->member_len[ slot->members++ ] = written;
+    }
+    return rc;
+}
+
+
+static rc_t pgz_write_out( par_gzip * self, const void * buffer, size_t size )
+{
+    size_t num_writ;
+    rc_t rc = KFileWriteAll( self->dst, self->pos, buffer, size, &num_writ );
+    if ( rc == 0 )
+        self->pos += num_writ;
+    return rc;
+}
+
+
+/* writes the compressed members of a slot, tells the block-callback about them */
+static rc_t pgz_write_slot( par_gzip * self, const pgz_slot * slot )
+{
+    rc_t rc = pgz_write_out( self, slot->out, slot->out_len );
+    if ( self->on_block != NULL )
+    {
+        uint32_t i;
+        for ( i = 0; rc == 0 && i < slot->members; ++i )
+            rc = self->on_block( self->on_block_data, slot->member_len[ i ] );
+    }
+    return rc;
+}
+
+
+static rc_t CC pgz_worker( const KThread * thread, void * data )
+{
+    par_gzip * self = data;
+    z_stream zs;
+    rc_t rc = pgz_init_stream( &zs );
+
+    KLockAcquire( self->lock );
+    while ( true )
+    {
+        pgz_slot * slot;
+
+        while ( !self->quit && self->next_take == self->next_fill )
+            KConditionWait( self->filled, self->lock );
+        if ( self->next_take == self->next_fill )
+            break;
+
+        slot = &self->slots[ self->next_take++ % self->num_slots ];
+        slot->state = pgz_busy;
+        KLockUnlock( self->lock );
+
+        slot->rc = ( rc != 0 ) ? rc : pgz_compress( self, &zs, slot );
+
+        KLockAcquire( self->lock );
+        slot->state = pgz_done;
+        KConditionBroadcast( self->done );
+    }
+    KLockUnlock( self->lock );
+
+    if ( rc == 0 )
+        deflateEnd( &zs );
+    return rc;
+}
+
+
+/* writes compressed slots in order: waits for every slot before 'limit',
+   after that writes only slots which are already done */
+static rc_t pgz_write_done( par_gzip * self, uint64_t limit )
+{
+    rc_t rc = 0;
+
+    KLockAcquire( self->lock );
+    while ( rc == 0 && self->next_write < self->next_fill )
+    {
+        pgz_slot * slot = &self->slots[ self->next_write % self->num_slots ];
+        if ( slot->state != pgz_done )
+        {
+            if ( self->next_write >= limit )
+                break;
+            KConditionWait( self->done, self->lock );
+        }
+        else
+        {
+            KLockUnlock( self->lock );
+            rc = slot->rc;
+            if ( rc == 0 )
+                rc = pgz_write_slot( self, slot );
+            KLockAcquire( self->lock );
+            slot->in_len = 0;
+            slot->state = pgz_free;
+            self->next_write++;
+        }
+    }
+    KLockUnlock( self->lock );
+    if ( rc != 0 )
+        self->rc = rc;
+    return rc;
+}
+
+
+/* hands the slot being filled over to the workers ( or compresses it ) */
+static rc_t pgz_submit( par_gzip * self )
+{
+    pgz_slot * slot = &self->slots[ self->next_fill % self->num_slots ];
+    rc_t rc;
+
+    if ( self->num_threads == 0 )
+    {
+        rc = pgz_compress( self, &self->zs, slot );
+        if ( rc == 0 )
+            rc = pgz_write_slot( self, slot );
+        slot->in_len = 0;
+        if ( rc != 0 )
+            self->rc = rc;
+        return rc;
+    }
+
+    KLockAcquire( self->lock );
+    slot->state = pgz_filled;
+    self->next_fill++;
+    KConditionSignal( self->filled );
+    KLockUnlock( self->lock );
+
+    /* the next slot to fill has to be written out before */
+    if ( self->next_fill < self->num_slots )
+        return pgz_write_done( self, 0 );
+    return pgz_write_done( self, self->next_fill + 1 - self->num_slots );
+}
+
+
+rc_t par_gzip_write( par_gzip * self, const void * buffer, size_t size )
+{
+    rc_t rc = 0;
+    const uint8_t * src = buffer;
+
+    if ( self == NULL )
+        return RC( rcExe, rcFile, rcWriting, rcSelf, rcNull );
+    if ( self->rc != 0 )
+        return self->rc;
+
+    while ( rc == 0 && size > 0 )
+    {
+        pgz_slot * slot = &self->slots[ self->next_fill % self->num_slots ];
+        size_t len = self->slot_size - slot->in_len;
+        if ( len > size )
+            len = size;
+        memmove( slot->in + slot->in_len, src, len );
+        slot->in_len += len;
+        src += len;
+        size -= len;
+        if ( slot->in_len == self->slot_size )
+            rc = pgz_submit( self );
+    }
+    return rc;
+}
+
+
+rc_t par_gzip_set_on_block( par_gzip * self, par_gzip_on_block on_block, void * data )
+{
+    if ( self == NULL )
+        return RC( rcExe, rcFile, rcUpdating, rcSelf, rcNull );
+    self->on_block = on_block;
+    self->on_block_data = data;
+    return 0;
+}
+
+
+static void pgz_free_slots( par_gzip * self )
+{
+    uint32_t i;
+    for ( i = 0; i < self->num_slots; ++i )
+    {
+        free( self->slots[ i ].in );
+        free( self->slots[ i ].out );
+    }
+    free( self->slots );
+}
+
+
+rc_t release_par_gzip( par_gzip * self )
+{
+    rc_t rc = 0;
+    uint32_t i;
+
+    if ( self == NULL )
+        return 0;
+
+    rc = self->rc;
+    if ( rc == 0 && self->slots[ self->next_fill % self->num_slots ].in_len > 0 )
+        rc = pgz_submit( self );
+
+    if ( self->num_threads > 0 )
+    {
+        if ( rc == 0 )
+            rc = pgz_write_done( self, self->next_fill );
+
+        KLockAcquire( self->lock );
+        self->quit = true;
+        KConditionBroadcast( self->filled );
+        KLockUnlock( self->lock );
+
+        for ( i = 0; i < self->num_threads; ++i )
+        {
+            rc_t rc_thread = 0;
+            KThreadWait( self->threads[ i ], &rc_thread );
+            KThreadRelease( self->threads[ i ] );
+            if ( rc == 0 )
+                rc = rc_thread;
+        }
+    }
+
+    if ( rc == 0 && self->framing == pgz_bgzf )
+        rc = pgz_write_out( self, bgzf_eof, sizeof bgzf_eof );
+    else if ( rc == 0 && self->pos == 0 )
+        rc = pgz_write_out( self, gzip_empty, sizeof gzip_empty );
+
+    if ( self->zs_ready )
+        deflateEnd( &self->zs );
+    KConditionRelease( self->done );
+    KConditionRelease( self->filled );
+    KLockRelease( self->lock );
+    pgz_free_slots( self );
+    KFileRelease( self->dst );
+    free( self );
+    return rc;
+}
+
+
+rc_t make_par_gzip( par_gzip ** self, KFile * dst,
+                    enum par_gzip_framing framing, uint32_t threads )
+{
+    rc_t rc = 0;
+    par_gzip * o;
+
+    if ( self == NULL )
+        return RC( rcExe, rcFile, rcConstructing, rcSelf, rcNull );
+    *self = NULL;
+    if ( dst == NULL )
+        return RC( rcExe, rcFile, rcConstructing, rcParam, rcNull );
+
+    o = calloc( 1, sizeof *o );
+    if ( o == NULL )
+        return RC( rcExe, rcFile, rcConstructing, rcMemory, rcExhausted );
+
+    if ( threads > PGZ_MAX_THREADS )
+        threads = PGZ_MAX_THREADS;
+
+    o->framing = framing;
+    if ( framing == pgz_bgzf )
+    {
+        o->slot_size = PGZ_BGZF_BLOCK * PGZ_BGZF_PER_SLOT;
+        o->out_size = PGZ_BGZF_PER_SLOT * ( compressBound( PGZ_BGZF_BLOCK ) + PGZ_HDR_BGZF + PGZ_TRAILER );
+    }
+    else
+    {
+        o->slot_size = PGZ_GZIP_BLOCK;
+        o->out_size = compressBound( PGZ_GZIP_BLOCK ) + PGZ_HDR_GZIP + PGZ_TRAILER;
+    }
+
+    o->num_slots = ( threads == 0 ) ? 1 : threads * PGZ_SLOTS_PER_THREAD;
+    o->slots = calloc( o->num_slots, sizeof *o->slots );
+    if ( o->slots == NULL )
+        rc = RC( rcExe, rcFile, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        uint32_t i;
+        for ( i = 0; rc == 0 && i < o->num_slots; ++i )
+        {
+            o->slots[ i ].in = malloc( o->slot_size );
+            o->slots[ i ].out = malloc( o->out_size );
+            if ( o->slots[ i ].in == NULL || o->slots[ i ].out == NULL )
+                rc = RC( rcExe, rcFile, rcConstructing, rcMemory, rcExhausted );
+        }
+    }
+
+    if ( rc == 0 )
+        rc = KLockMake( &o->lock );
+    if ( rc == 0 )
+        rc = KConditionMake( &o->filled );
+    if ( rc == 0 )
+        rc = KConditionMake( &o->done );
+
+    if ( rc == 0 )
+    {
+        rc = KFileAddRef( dst );
+        if ( rc == 0 )
+            o->dst = dst;
+    }
+
+    if ( rc == 0 && threads == 0 )
+    {
+        rc = pgz_init_stream( &o->zs );
+        o->zs_ready = ( rc == 0 );
+    }
+
+    while ( rc == 0 && o->num_threads < threads )
+    {
+        rc = KThreadMake( &o->threads[ o->num_threads ], pgz_worker, o );
+        if ( rc == 0 )
+            o->num_threads++;
+    }
+
+    if ( rc != 0 )
+    {
+        LOGERR( klogInt, rc, "cannot create compressed output" );
+        if ( o->slots != NULL && o->lock != NULL && o->filled != NULL && o->done != NULL )
+        {
+            /* stops the threads already started, nothing is written */
+            o->rc = rc;
+            release_par_gzip( o );
+        }
+        else
+        {
+            KConditionRelease( o->done );
+            KConditionRelease( o->filled );
+            KLockRelease( o->lock );
+            if ( o->slots != NULL )
+                pgz_free_slots( o );
+            free( o );
+        }
+        return rc;
+    }
+
+    *self = o;
+    return 0;
+}
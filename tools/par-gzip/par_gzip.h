@@ -0,0 +1,80 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_par_gzip_
+#define _h_par_gzip_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/rc.h>
+#include <kfs/file.h>
+
+/* the stream is cut into blocks which are compressed independently:
+   pgz_gzip : every block of 1 MB becomes a gzip-member,
+              the concatenated members are a valid gzip-file
+   pgz_bgzf : every block of at most 65280 bytes becomes a BGZF-block,
+              the file ends with the BGZF EOF-marker ( bgzip / samtools ) */
+enum par_gzip_framing
+{
+    pgz_gzip = 0,
+    pgz_bgzf
+};
+
+#define PAR_GZIP_BGZF_BLOCK 0xff00
+
+/* number of worker-threads when the tool does not ask for another one */
+#define PAR_GZIP_DEFAULT_THREADS 4
+
+/* the tools reject more worker-threads than this */
+#define PAR_GZIP_MAX_THREADS 64
+
+typedef struct par_gzip par_gzip;
+
+/* called for every compressed block in the order they are written */
+typedef rc_t ( CC * par_gzip_on_block )( void * data, size_t comp_len );
+
+/* compresses into 'dst' ( from offset 0 ) on 'threads' worker-threads,
+   the compressed blocks are written in order by the thread calling
+   par_gzip_write(), with threads == 0 everything happens on that thread */
+rc_t make_par_gzip( par_gzip ** self, KFile * dst,
+                    enum par_gzip_framing framing, uint32_t threads );
+
+rc_t par_gzip_write( par_gzip * self, const void * buffer, size_t size );
+
+rc_t par_gzip_set_on_block( par_gzip * self, par_gzip_on_block on_block, void * data );
+
+/* compresses and writes what is left, terminates the workers */
+rc_t release_par_gzip( par_gzip * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
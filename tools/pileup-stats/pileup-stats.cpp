@@ -39,7 +39,7 @@
 #define RECORD_MATCH_COUNT 1
 #define QUANTIZE_VALUES    1
 
-#define DFLT_BUFFER_SIZE ( 32 * 1024 )
+#define DFLT_BUFFER_SIZE ( 1024 * 1024 )
 
 #if _DEBUGGING
 #define SINGLE_REFERENCE 0
@@ -54,7 +54,13 @@
 
 #include "pileup-stats.vers.h"
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
 #include <iostream>
+#include <sstream>
+#include <vector>
 #include <string.h>
 #include <ctype.h>
 
@@ -89,6 +95,8 @@ namespace ncbi
 
     static uint32_t verbosity;
 
+    static uint32_t num_threads = 1;                // pile up slices of references in parallel
+
     const bool need_write_true = false;
 
 #if QUANTIZE_VALUES
@@ -123,29 +131,75 @@ namespace ncbi
     }
 #endif
 
-    static
-    void run (
-#if USE_GENERAL_LOADER
-        GeneralWriter & out,
+    /* the rows of one slice of a reference, gathered column by column on
+       a worker thread and written by the merging stage in one go */
+    struct StatsBatch
+    {
+        enum
+        {
+            has_mismatch = 1,
+            has_inserts  = 2,
+            has_deletion = 4
+        };
+
+        // per row
+        std :: vector < uint32_t > gap;             // rows without data before the row
+        std :: vector < uint8_t > flags;
+        std :: vector < uint32_t > depth;
+#if RECORD_REF_BASE
+        std :: vector < char > ref_base;
+#endif
+        // per row with the flag set
+        std :: vector < uint32_t > mismatch_counts; // 3 + RECORD_MATCH_COUNT each
+        std :: vector < uint32_t > ins_counts;      // 4 each
+        std :: vector < uint32_t > del_cnt;
+
+#if ! USE_GENERAL_LOADER
+        std :: string text;
+#endif
+        int64_t first_pos;                          // of the first pileup, -1 if none
+        uint64_t num_pileups;
+        uint64_t tail;                              // rows without data at the end
+
+        void clear ()
+        {
+            gap . clear ();
+            flags . clear ();
+            depth . clear ();
+#if RECORD_REF_BASE
+            ref_base . clear ();
+#endif
+            mismatch_counts . clear ();
+            ins_counts . clear ();
+            del_cnt . clear ();
+#if ! USE_GENERAL_LOADER
+            text . clear ();
 #endif
-        const String & runName, const String & refName, PileupIterator & pileup )
+            first_pos = -1;
+            num_pileups = 0;
+            tail = 0;
+        }
+
+        StatsBatch ()
+        {
+            clear ();
+        }
+    };
+
+    static
+    void run ( StatsBatch & batch, const String & runName, const String & refName, PileupIterator & pileup )
     {
         int64_t ref_zpos, last_writ = 0;
-        bool need_write = false;
 
-        for ( ref_zpos = -1; pileup . nextPileup (); ++ ref_zpos, ++ zrow_id )
+        batch . clear ();
+
+        for ( ref_zpos = -1; pileup . nextPileup (); ++ ref_zpos, ++ batch . num_pileups )
         {
             if ( ref_zpos < 0 )
-            {
-                last_writ = ref_zpos = pileup . getReferencePosition ();
-#if USE_GENERAL_LOADER
-                int64_t ref_pos_trans = ref_zpos - zrow_id;
-                out . columnDefault ( column_id [ col_REF_POS_TRANS ], 64, & ref_pos_trans, 1 );
-                need_write = need_write_true;
-#endif
-            }
+                batch . first_pos = last_writ = ref_zpos = pileup . getReferencePosition ();
 
-            switch ( verbosity )
+            // with several threads the progress of one would be lost between the others
+            switch ( num_threads > 1 ? 0 : verbosity )
             {
             case 0:
                 break;
@@ -171,14 +225,6 @@ namespace ncbi
             case 'G': ref_base_idx = 2; break;
             case 'T': ref_base_idx = 3; break;
             default:
-                if ( need_write )
-                {
-#if USE_GENERAL_LOADER
-                    out . nextRow ( tbl_id );
-                    last_writ = ref_zpos + 1;
-#endif
-                    need_write = false;
-                }
                 continue;
             }
 
@@ -188,7 +234,8 @@ namespace ncbi
 #if ! USE_GENERAL_LOADER
             if ( depth > MIN_REPORT_DEPTH )
             {
-                std :: cout
+                std :: ostringstream line;
+                line
                     << runName
                     << '\t' << refName
                     << '\t' << ref_zpos + 1
@@ -196,6 +243,7 @@ namespace ncbi
                     << '\t' << depth
                     << '\n'
                     ;
+                batch . text += line . str ();
             }
 #endif
 #else
@@ -329,21 +377,32 @@ namespace ncbi
                         
                    
 #if USE_GENERAL_LOADER
-                if ( ref_zpos > last_writ )
-                    out . moveAhead ( tbl_id, ref_zpos - last_writ );
+                uint8_t flags = 0;
+                batch . gap . push_back ( ( uint32_t ) ( ref_zpos - last_writ ) );
 #if RECORD_REF_BASE
-                out . write ( column_id [ col_REF_BASE ], sizeof ref_base * 8, & ref_base, 1 );
+                batch . ref_base . push_back ( ref_base );
 #endif
-                out . write ( column_id [ col_DEPTH ], sizeof depth * 8, & depth, 1 );
+                batch . depth . push_back ( depth );
                 if ( have_mismatch )
-                    out . write ( column_id [ col_MISMATCH_COUNTS ], sizeof mismatch_counts [ 0 ] * 8, mismatch_counts, 3 + RECORD_MATCH_COUNT );
+                {
+                    batch . mismatch_counts . insert ( batch . mismatch_counts . end (),
+                        mismatch_counts, mismatch_counts + 3 + RECORD_MATCH_COUNT );
+                    flags |= StatsBatch :: has_mismatch;
+                }
                 if ( have_inserts )
-                    out . write ( column_id [ col_INSERTION_COUNTS ], sizeof ins_counts [ 0 ] * 8, ins_counts, 4 );
+                {
+                    batch . ins_counts . insert ( batch . ins_counts . end (), ins_counts, ins_counts + 4 );
+                    flags |= StatsBatch :: has_inserts;
+                }
                 if ( del_cnt != 0 )
-                    out . write ( column_id [ col_DELETION_COUNT ], sizeof del_cnt * 8, & del_cnt, 1 );
-                out . nextRow ( tbl_id );
+                {
+                    batch . del_cnt . push_back ( del_cnt );
+                    flags |= StatsBatch :: has_deletion;
+                }
+                batch . flags . push_back ( flags );
 #else
-                std :: cout
+                std :: ostringstream line;
+                line
                     << runName
                     << '\t' << refName
                     << '\t' << ref_zpos + 1
@@ -359,24 +418,16 @@ namespace ncbi
                     << "}\t" << del_cnt
                     << '\n'
                     ;
+                batch . text += line . str ();
 #endif
                 last_writ = ref_zpos + 1;
             }
-            else if ( need_write )
-            {
-#if USE_GENERAL_LOADER
-                out . nextRow ( tbl_id );
-#endif
-                need_write = false;
-            }
 
 #endif // NO_PILEUP_EVENTS
 
         }
-#if USE_GENERAL_LOADER
         if ( ref_zpos > last_writ )
-            out . moveAhead ( tbl_id, ref_zpos - last_writ );
-#endif
+            batch . tail = ref_zpos - last_writ;
     }
 
 #if USE_GENERAL_LOADER
@@ -410,6 +461,336 @@ namespace ncbi
     }
 #endif
 
+    // the references are cut into slices of this many positions,
+    // the slices are the units of work of the threads
+#define STATS_SLICE ( 2 * 1024 * 1024 )
+    // limits memory: slices done but not written yet per thread
+#define STATS_SLICES_PER_THREAD 2
+#define STATS_MAX_THREADS 64
+
+    struct StatsReference
+    {
+        String canonicalName;
+        String commonName;
+        size_t first_slice;
+        size_t num_slices;
+    };
+
+    struct StatsSlice
+    {
+        size_t ref;
+        int64_t start;
+        uint64_t len;
+    };
+
+    // one read-collection per thread, with the reference of its last slice
+    class StatsSource
+    {
+    public:
+
+        StatsSource ( const ReadCollection & p_obj, const String & p_runName,
+                      const std :: vector < StatsReference > & p_refs, Alignment :: AlignmentCategory p_cat )
+            : obj ( p_obj )
+            , runName ( p_runName )
+            , refs ( p_refs )
+            , cat ( p_cat )
+            , cur_ref ( ( size_t ) -1 )
+        {
+        }
+
+        void pileup ( StatsBatch & batch, const StatsSlice & slice )
+        {
+            if ( slice . ref != cur_ref )
+            {
+                ref . clear ();
+                ref . push_back ( obj . getReference ( refs [ slice . ref ] . commonName ) );
+                cur_ref = slice . ref;
+            }
+            PileupIterator pileup = ref [ 0 ] . getPileupSlice ( slice . start, slice . len, cat );
+            run ( batch, runName, refs [ cur_ref ] . canonicalName, pileup );
+        }
+
+    private:
+
+        ReadCollection obj;
+        String runName;
+        const std :: vector < StatsReference > & refs;
+        Alignment :: AlignmentCategory cat;
+        std :: vector < Reference > ref;
+        size_t cur_ref;
+    };
+
+    // the slices are taken by the workers in order, the merging stage
+    // writes their batches strictly in that order
+    class StatsPool
+    {
+    public:
+
+        StatsPool ( const char * p_spec, const String & p_runName, const std :: vector < StatsReference > & p_refs,
+                    const std :: vector < StatsSlice > & p_slices, Alignment :: AlignmentCategory p_cat, uint32_t p_threads )
+            : spec ( p_spec )
+            , runName ( p_runName )
+            , refs ( p_refs )
+            , slices ( p_slices )
+            , cat ( p_cat )
+            , batches ( p_threads * STATS_SLICES_PER_THREAD )
+            , done ( p_threads * STATS_SLICES_PER_THREAD, false )
+            , next ( 0 )
+            , written ( 0 )
+            , running ( 0 )
+            , quitting ( false )
+            , lock ( 0 )
+            , done_cond ( 0 )
+            , free_cond ( 0 )
+        {
+            if ( KLockMake ( & lock ) != 0 ||
+                 KConditionMake ( & done_cond ) != 0 ||
+                 KConditionMake ( & free_cond ) != 0 )
+            {
+                release ();
+                throw "cannot create thread synchronization";
+            }
+
+            for ( uint32_t i = 0; i < p_threads; ++ i )
+            {
+                KThread * t;
+                started ();
+                if ( KThreadMake ( & t, worker, this ) == 0 )
+                    threads . push_back ( t );
+                else
+                    finished ();
+            }
+        }
+
+        ~StatsPool ()
+        {
+            quit ();
+            for ( size_t i = 0; i < threads . size (); ++ i )
+            {
+                rc_t rc;
+                KThreadWait ( threads [ i ], & rc );
+                KThreadRelease ( threads [ i ] );
+            }
+            release ();
+        }
+
+        // merging stage: the batch of the next slice, valid until pop()
+        const StatsBatch & front ()
+        {
+            size_t slot = written % batches . size ();
+
+            KLockAcquire ( lock );
+            while ( ! done [ slot ] && running > 0 && error . empty () )
+                KConditionWait ( done_cond, lock );
+            std :: string msg ( error );
+            bool have = done [ slot ];
+            KLockUnlock ( lock );
+
+            if ( ! msg . empty () )
+                throw ErrorMsg ( msg );
+            if ( ! have )
+                throw "pileup threads terminated early";
+
+            return batches [ slot ];
+        }
+
+        void pop ()
+        {
+            KLockAcquire ( lock );
+            done [ written % batches . size () ] = false;
+            ++ written;
+            KConditionBroadcast ( free_cond );
+            KLockUnlock ( lock );
+        }
+
+    private:
+
+        static
+        rc_t CC worker ( const KThread * self, void * data )
+        {
+            StatsPool & pool = * ( StatsPool * ) data;
+            try
+            {
+                StatsSource src ( ncbi :: NGS :: openReadCollection ( pool . spec ), pool . runName, pool . refs, pool . cat );
+
+                size_t idx;
+                while ( pool . take ( idx ) )
+                {
+                    src . pileup ( pool . batches [ idx % pool . batches . size () ], pool . slices [ idx ] );
+                    pool . finish ( idx );
+                }
+            }
+            catch ( ErrorMsg & x )
+            {
+                pool . fail ( x . what () );
+            }
+            catch ( const char x [] )
+            {
+                pool . fail ( x );
+            }
+            catch ( ... )
+            {
+                pool . fail ( "unknown exception" );
+            }
+            pool . finished ();
+            return 0;
+        }
+
+        bool take ( size_t & idx )
+        {
+            bool res = false;
+            KLockAcquire ( lock );
+            while ( ! quitting && next < slices . size () && next >= written + batches . size () )
+                KConditionWait ( free_cond, lock );
+            if ( ! quitting && next < slices . size () )
+            {
+                idx = next ++;
+                res = true;
+            }
+            KLockUnlock ( lock );
+            return res;
+        }
+
+        void finish ( size_t idx )
+        {
+            KLockAcquire ( lock );
+            done [ idx % batches . size () ] = true;
+            KConditionBroadcast ( done_cond );
+            KLockUnlock ( lock );
+        }
+
+        // the first error stops all workers, the merging stage throws it
+        void fail ( const std :: string & msg )
+        {
+            KLockAcquire ( lock );
+            if ( error . empty () )
+                error = msg;
+            quitting = true;
+            KConditionBroadcast ( free_cond );
+            KConditionBroadcast ( done_cond );
+            KLockUnlock ( lock );
+        }
+
+        void started ()
+        {
+            KLockAcquire ( lock );
+            ++ running;
+            KLockUnlock ( lock );
+        }
+
+        void finished ()
+        {
+            KLockAcquire ( lock );
+            -- running;
+            KConditionBroadcast ( done_cond );
+            KLockUnlock ( lock );
+        }
+
+        void quit ()
+        {
+            KLockAcquire ( lock );
+            quitting = true;
+            KConditionBroadcast ( free_cond );
+            KLockUnlock ( lock );
+        }
+
+        void release ()
+        {
+            KConditionRelease ( free_cond );
+            KConditionRelease ( done_cond );
+            KLockRelease ( lock );
+        }
+
+        const char * spec;
+        String runName;
+        const std :: vector < StatsReference > & refs;
+        const std :: vector < StatsSlice > & slices;
+        Alignment :: AlignmentCategory cat;
+
+        std :: vector < StatsBatch > batches;
+        std :: vector < bool > done;
+        std :: vector < KThread * > threads;
+        std :: string error;
+        size_t next;
+        size_t written;
+        uint32_t running;
+        bool quitting;
+
+        KLock * lock;
+        KCondition * done_cond;
+        KCondition * free_cond;
+    };
+
+    // deletes the pool, and so stops its threads, on every way out of pileup_stats
+    struct StatsPoolHolder
+    {
+        StatsPoolHolder ()
+            : pool ( 0 )
+        {
+        }
+
+        ~StatsPoolHolder ()
+        {
+            delete pool;
+        }
+
+        StatsPool * pool;
+    };
+
+#if USE_GENERAL_LOADER
+    // pending: rows without data not yet written, carried across the slices of a reference
+    static
+    void write_batch ( GeneralWriter & out, const StatsBatch & batch, bool & have_pos_trans, uint64_t & pending )
+    {
+        if ( ! have_pos_trans && batch . first_pos >= 0 )
+        {
+            int64_t ref_pos_trans = batch . first_pos - zrow_id;
+            out . columnDefault ( column_id [ col_REF_POS_TRANS ], 64, & ref_pos_trans, 1 );
+            have_pos_trans = true;
+        }
+
+        const uint32_t * mismatch_counts = batch . mismatch_counts . empty () ? 0 : & batch . mismatch_counts [ 0 ];
+        const uint32_t * ins_counts = batch . ins_counts . empty () ? 0 : & batch . ins_counts [ 0 ];
+        const uint32_t * del_cnt = batch . del_cnt . empty () ? 0 : & batch . del_cnt [ 0 ];
+
+        size_t num_rows = batch . flags . size ();
+        for ( size_t row = 0; row < num_rows; ++ row )
+        {
+            pending += batch . gap [ row ];
+            if ( pending > 0 )
+            {
+                out . moveAhead ( tbl_id, pending );
+                pending = 0;
+            }
+#if RECORD_REF_BASE
+            out . write ( column_id [ col_REF_BASE ], sizeof batch . ref_base [ 0 ] * 8, & batch . ref_base [ row ], 1 );
+#endif
+            out . write ( column_id [ col_DEPTH ], sizeof batch . depth [ 0 ] * 8, & batch . depth [ row ], 1 );
+
+            uint8_t flags = batch . flags [ row ];
+            if ( ( flags & StatsBatch :: has_mismatch ) != 0 )
+            {
+                out . write ( column_id [ col_MISMATCH_COUNTS ], sizeof mismatch_counts [ 0 ] * 8, mismatch_counts, 3 + RECORD_MATCH_COUNT );
+                mismatch_counts += 3 + RECORD_MATCH_COUNT;
+            }
+            if ( ( flags & StatsBatch :: has_inserts ) != 0 )
+            {
+                out . write ( column_id [ col_INSERTION_COUNTS ], sizeof ins_counts [ 0 ] * 8, ins_counts, 4 );
+                ins_counts += 4;
+            }
+            if ( ( flags & StatsBatch :: has_deletion ) != 0 )
+            {
+                out . write ( column_id [ col_DELETION_COUNT ], sizeof del_cnt [ 0 ] * 8, del_cnt, 1 );
+                ++ del_cnt;
+            }
+            out . nextRow ( tbl_id );
+        }
+
+        pending += batch . tail;
+        zrow_id += batch . num_pileups;
+    }
+#endif
+
     static
     void run ( const char * spec, const char *outfile, const char *_remote_db, size_t buffer_size, Alignment :: AlignmentCategory cat )
     {
@@ -443,34 +824,86 @@ namespace ncbi
             prepareOutput ( out, runName );
 #endif
             std :: cerr << "# Accessing all references\n";
+            std :: vector < StatsReference > refs;
+            std :: vector < StatsSlice > slices;
             ReferenceIterator ref = obj . getReferences ();
             
             while ( ref . nextReference () )
             {
-                String refName = ref . getCanonicalName ();
-                
-                std :: cerr << "# Processing reference '" << refName << "'\n";
-#if USE_GENERAL_LOADER
-                out . columnDefault ( column_id [ col_REFERENCE_SPEC ], 8, refName . data (), refName . size () );
-#endif
+                StatsReference r;
+                r . canonicalName = ref . getCanonicalName ();
+                r . commonName = ref . getCommonName ();
+                r . first_slice = slices . size ();
 
 #if SLICE_WIDTH
-                std :: cerr << "# Accessing " << SLICE_WIDTH << " pileups starting at " << SLICE_START << "\n";
-                PileupIterator pileup = ref . getPileupSlice ( SLICE_START, SLICE_WIDTH, cat );
+                int64_t start = SLICE_START;
+                uint64_t end = SLICE_START + SLICE_WIDTH;
 #else
-                std :: cerr << "# Accessing all pileups\n";
-                PileupIterator pileup = ref . getPileups ( cat );
+                int64_t start = 0;
+                uint64_t end = ref . getLength ();
+#endif
+                StatsSlice s;
+                s . ref = refs . size ();
+                for ( s . start = start; ( uint64_t ) s . start < end; s . start += s . len )
+                {
+                    s . len = end - s . start;
+                    if ( s . len > STATS_SLICE )
+                        s . len = STATS_SLICE;
+                    slices . push_back ( s );
+                }
+                r . num_slices = slices . size () - r . first_slice;
+                refs . push_back ( r );
+#if SINGLE_REFERENCE
+                break;
 #endif
+            }
+
+            // checked by parse_threads
+            uint32_t threads = num_threads;
+            assert ( threads >= 1 && threads <= STATS_MAX_THREADS );
+            if ( threads > slices . size () )
+                threads = ( uint32_t ) slices . size ();
+
+            // with one thread the slices are piled up right here
+            StatsSource src ( obj, runName, refs, cat );
+            StatsBatch batch;
+            StatsPoolHolder holder;
+            if ( threads > 1 )
+            {
+                std :: cerr << "# Piling up on " << threads << " threads\n";
+                holder . pool = new StatsPool ( spec, runName, refs, slices, cat, threads );
+            }
+            StatsPool * pool = holder . pool;
+
+            for ( size_t r = 0; r < refs . size (); ++ r )
+            {
+                std :: cerr << "# Processing reference '" << refs [ r ] . canonicalName << "'\n";
+#if USE_GENERAL_LOADER
+                out . columnDefault ( column_id [ col_REFERENCE_SPEC ], 8, refs [ r ] . canonicalName . data (), refs [ r ] . canonicalName . size () );
+                bool have_pos_trans = false;
+                uint64_t pending = 0;
+#endif
+                for ( size_t i = 0; i < refs [ r ] . num_slices; ++ i )
+                {
+                    const StatsBatch * b = & batch;
+                    if ( pool != 0 )
+                        b = & pool -> front ();
+                    else
+                        src . pileup ( batch, slices [ refs [ r ] . first_slice + i ] );
 #if USE_GENERAL_LOADER
-                run ( out, runName, refName, pileup );
+                    write_batch ( out, * b, have_pos_trans, pending );
 #else
-                run ( runName, refName, pileup );
+                    std :: cout . write ( b -> text . data (), b -> text . size () );
 #endif
-                if ( verbosity > 1 )
-                    std :: cerr << '\n';
-#if SINGLE_REFERENCE
-                break;
+                    if ( pool != 0 )
+                        pool -> pop ();
+                }
+#if USE_GENERAL_LOADER
+                if ( pending > 0 )
+                    out . moveAhead ( tbl_id, pending );
 #endif
+                if ( verbosity > 1 && threads <= 1 )
+                    std :: cerr << '\n';
             }
 
 #if USE_GENERAL_LOADER
@@ -561,6 +994,8 @@ extern "C"
             << "  -x|--depth-cutoff                cutoff for depth <= value (default 1)\n"
             << "  -a|--align-category              the types of alignments to pile up:\n"
             << "                                   { primary, secondary, all } (default all)\n"
+            << "  -t|--threads count               pile up slices of references on this many\n"
+            << "                                   threads, from 1 to 64 (default 1)\n"
 #if USE_GENERAL_LOADER
             << "  --buffer-size bytes              size of output pipe buffer - default " << DFLT_BUFFER_SIZE/1024 << "K bytes\n"
             << "  -P|--pack-integer                pack integers in output pipe - uses less bandwidth\n"
@@ -585,6 +1020,23 @@ extern "C"
         throw ( const char * ) message;
     }
 
+    // digits only, from 1 to STATS_MAX_THREADS
+    static uint32_t parse_threads ( const char * str )
+    {
+        static char msg [ 256 ];
+
+        char * end;
+        unsigned long value = strtoul ( str, & end, 10 );
+        if ( ! isdigit ( ( unsigned char ) str [ 0 ] ) || end [ 0 ] != 0 ||
+             value == 0 || value > STATS_MAX_THREADS )
+        {
+            snprintf ( msg, sizeof msg, "Parameter for threads [%.64s] is invalid: must be a number from 1 to %u",
+                       str, STATS_MAX_THREADS );
+            throw ( const char * ) msg;
+        }
+        return ( uint32_t ) value;
+    }
+
     rc_t CC KMain ( int argc, char *argv [] )
     {
         rc_t rc = -1;
@@ -640,6 +1092,9 @@ extern "C"
                     ncbi :: integer_column_flag_bits = 1;
                     break;
 #endif
+                case 't':
+                    ncbi :: num_threads = parse_threads ( findArg ( arg, i, argc, argv ) );
+                    break;
                 case 'v':
                     ++ ncbi :: verbosity;
                     break;
@@ -697,6 +1152,10 @@ extern "C"
                         ncbi :: integer_column_flag_bits = 1;
                     }
 #endif
+                    else if ( strcmp ( arg, "threads" ) == 0 )
+                    {
+                        ncbi :: num_threads = parse_threads ( getArg ( i, argc, argv ) );
+                    }
                     else if ( strcmp ( arg, "verbose" ) == 0 )
                     {
                         ++ ncbi :: verbosity;
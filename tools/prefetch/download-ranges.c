@@ -0,0 +1,751 @@
+/*==============================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "download-ranges.h"
+#include "rate-limit.h" /* RateLimitTake */
+
+#include <kapp/main.h> /* Quitting */
+
+#include <kfs/directory.h> /* KDirectory */
+#include <kfs/file.h> /* KFile */
+
+#include <kns/http.h> /* KNSManagerMakeReliableHttpFile */
+#include <kns/manager.h> /* KNSManager */
+
+#include <kproc/lock.h> /* KLock */
+#include <kproc/thread.h> /* KThread */
+
+#include <klib/checksum.h> /* MD5State */
+#include <klib/log.h> /* PLOGERR */
+#include <klib/printf.h> /* string_printf */
+#include <klib/rc.h>
+#include <klib/status.h> /* STSMSG */
+
+#include <sysalloc.h>
+
+#include <assert.h>
+#include <stdlib.h> /* calloc */
+#include <string.h> /* memcmp */
+#include <time.h> /* time */
+
+#define STS_TOP 0
+#define STS_INFO 1
+#define STS_DBG 2
+#define STS_FIN 3
+
+#define RELEASE(type, obj) do { rc_t rc2 = type##Release(obj); \
+    if (rc2 != 0 && rc == 0) { rc = rc2; } obj = NULL; } while (false)
+
+/* a range is read in pieces of this size when the bandwidth is capped */
+#define RANGES_READ_SIZE ( 1024 * 1024 )
+
+/* how many times ranges failing verification are fetched again */
+#define RANGES_MAX_ROUNDS 2
+
+/* an interrupted download older than this is not resumed but started over */
+#define RANGES_MAX_AGE ( 7 * 24 * 60 * 60 )
+
+/* "<to>.ranges": header followed by MD5 digest of every range */
+static const char RANGES_MAGIC[8] = { 'N', 'C', 'B', 'I', 'p', 'r', 'f', '3' };
+typedef struct {
+    char magic[8];
+    uint64_t size;
+    uint64_t chunk;
+    uint8_t identity[16]; /* MD5 of ETag and Last-Modified */
+} RangesHeader;
+
+typedef enum {
+    eRangeTodo,
+    eRangeBusy,
+    eRangeDone,
+} ERange;
+
+typedef struct {
+    KDirectory *dir;
+    KNSManager *kns;
+    const char *url;
+    const char *to;
+    char state[PATH_MAX]; /* "<to>.ranges" */
+    RateLimit *rate;
+
+    uint64_t size;
+    uint32_t count; /* of ranges */
+    uint8_t identity[16];
+
+    KFile *out;
+    KFile *stateFile;
+
+    uint8_t (*digest)[16]; /* all zeros: range is not downloaded yet */
+    uint8_t *status; /* ERange */
+
+    KLock *lock; /* guards status, digest, stateFile, next and rc */
+    uint32_t next; /* the first range that could be eRangeTodo */
+    rc_t rc; /* the first worker failure */
+} Ranges;
+
+static const uint8_t NO_DIGEST[16];
+
+static uint64_t RangesPos(const Ranges *self, uint32_t i) {
+    return (uint64_t)i * RANGES_CHUNK_SIZE;
+}
+
+static size_t RangesBytes(const Ranges *self, uint32_t i) {
+    uint64_t pos = RangesPos(self, i);
+    assert(pos < self->size);
+    return self->size - pos < RANGES_CHUNK_SIZE
+        ? (size_t)(self->size - pos) : RANGES_CHUNK_SIZE;
+}
+
+static void _MD5(const void *data, size_t size, uint8_t digest[16]) {
+    MD5State md5;
+    MD5StateInit(&md5);
+    MD5StateAppend(&md5, data, size);
+    MD5StateFinish(&md5, digest);
+}
+
+/* the identity of the object now: MD5 of its ETag and Last-Modified,
+   a header the server does not send is taken to be empty.
+   the url is left out: signed urls of the same object expire and change,
+   the state file is named after the object's cache path and keeps its size */
+static rc_t RangesIdentify(const Ranges *self, uint8_t identity[16]) {
+    rc_t rc = 0;
+    KHttpRequest *req = NULL;
+    KHttpResult *rslt = NULL;
+    MD5State md5;
+
+    rc = KNSManagerMakeRequest(self->kns, &req, 0x01010000, NULL,
+        "%s", self->url);
+    if (rc == 0) {
+        rc = KHttpRequestHEAD(req, &rslt);
+    }
+    if (rc == 0) {
+        uint32_t code = 0;
+        char msg[256];
+        size_t msg_size = 0;
+        rc = KHttpResultStatus(rslt, &code, msg, sizeof msg, &msg_size);
+        if (rc == 0 && code != 200) {
+            rc = RC(rcExe, rcFile, rcValidating, rcConnection, rcUnexpected);
+        }
+    }
+    if (rc == 0) {
+        static const char *names[] = { "ETag", "Last-Modified" };
+        uint32_t i = 0;
+
+        MD5StateInit(&md5);
+        for (i = 0; i < sizeof names / sizeof names[0]; ++i) {
+            char value[1024];
+            size_t num_read = 0;
+            if (KHttpResultGetHeader(rslt,
+                names[i], value, sizeof value, &num_read) != 0)
+            {
+                num_read = 0;
+            }
+            MD5StateAppend(&md5, "\n", 1);
+            MD5StateAppend(&md5, value, num_read);
+        }
+        MD5StateFinish(&md5, identity);
+    }
+    else {
+        PLOGERR(klogInt, (klogInt, rc,
+            "cannot get the headers of $(url)", "url=%s", self->url));
+    }
+
+    RELEASE(KHttpResult, rslt);
+    RELEASE(KHttpRequest, req);
+
+    return rc;
+}
+
+static void RangesMakeHeader(const Ranges *self, RangesHeader *h) {
+    memmove(h->magic, RANGES_MAGIC, sizeof h->magic);
+    h->size = self->size;
+    h->chunk = RANGES_CHUNK_SIZE;
+    memmove(h->identity, self->identity, sizeof h->identity);
+}
+
+/* called under the lock */
+static rc_t RangesSetDigest(Ranges *self, uint32_t i, const uint8_t digest[16])
+{
+    rc_t rc = KFileWriteAll(self->stateFile,
+        sizeof(RangesHeader) + (uint64_t)i * 16, digest, 16, NULL);
+    if (rc != 0) {
+        PLOGERR(klogInt, (klogInt, rc,
+            "cannot write $(path)", "path=%s", self->state));
+    }
+    else {
+        memmove(self->digest[i], digest, 16);
+    }
+    return rc;
+}
+
+/* restores the progress of an interrupted download of the same object:
+   leaves self->out and self->stateFile NULL if there is none */
+static rc_t RangesResume(Ranges *self) {
+    rc_t rc = 0;
+    RangesHeader h;
+    size_t num_read = 0;
+    uint64_t sz = 0;
+    uint32_t i = 0;
+    uint32_t done = 0;
+
+    if (KDirectoryPathType(self->dir, "%s", self->state) != kptFile ||
+        KDirectoryPathType(self->dir, "%s", self->to) != kptFile)
+    {
+        return 0;
+    }
+
+    {
+        KTime_t date = 0;
+        if (KDirectoryDate(self->dir, &date, "%s", self->state) == 0 &&
+            time(NULL) - date > RANGES_MAX_AGE)
+        {
+            STSMSG(STS_DBG, ("%s is too old: ignored", self->state));
+            return 0;
+        }
+    }
+
+    rc = KDirectoryOpenFileWrite(self->dir,
+        &self->stateFile, true, "%s", self->state);
+    if (rc == 0) {
+        rc = KFileReadAll(self->stateFile, 0, &h, sizeof h, &num_read);
+    }
+    if (rc == 0) {
+        rc = KFileSize(self->stateFile, &sz);
+    }
+    if (rc == 0 && (num_read != sizeof h
+        || memcmp(h.magic, RANGES_MAGIC, sizeof h.magic) != 0
+        || h.size != self->size || h.chunk != RANGES_CHUNK_SIZE
+        || memcmp(h.identity, self->identity, sizeof h.identity) != 0
+        || sz != sizeof h + (uint64_t)self->count * 16))
+    {
+        STSMSG(STS_DBG, ("%s does not match %s: ignored", self->state, self->url));
+        RELEASE(KFile, self->stateFile);
+        return rc;
+    }
+    if (rc == 0) {
+        rc = KFileReadAll(self->stateFile, sizeof h,
+            self->digest, (size_t)self->count * 16, &num_read);
+    }
+    if (rc == 0) {
+        rc = KDirectoryOpenFileWrite(self->dir, &self->out, true, "%s", self->to);
+    }
+    if (rc == 0) {
+        rc = KFileSize(self->out, &sz);
+        if (rc == 0 && sz != self->size) {
+            STSMSG(STS_DBG, ("%s has unexpected size: ignored", self->to));
+            RELEASE(KFile, self->out);
+            RELEASE(KFile, self->stateFile);
+            memset(self->digest, 0, (size_t)self->count * 16);
+            return rc;
+        }
+    }
+    if (rc != 0) {
+        PLOGERR(klogWarn, (klogWarn, rc, "cannot resume download to $(path)",
+            "path=%s", self->to));
+        RELEASE(KFile, self->out);
+        RELEASE(KFile, self->stateFile);
+        memset(self->digest, 0, (size_t)self->count * 16);
+        return 0;
+    }
+
+    for (i = 0; i < self->count; ++i) {
+        if (memcmp(self->digest[i], NO_DIGEST, 16) != 0) {
+            self->status[i] = eRangeDone;
+            ++done;
+        }
+    }
+    STSMSG(STS_INFO, ("resuming %s: %u of %u ranges are already downloaded",
+        self->to, done, self->count));
+
+    return 0;
+}
+
+static rc_t RangesOpen(Ranges *self) {
+    rc_t rc = RangesResume(self);
+
+    if (rc == 0 && self->out == NULL) {
+        RangesHeader h;
+        RangesMakeHeader(self, &h);
+
+        STSMSG(STS_DBG, ("creating %s", self->to));
+        rc = KDirectoryCreateFile(self->dir, &self->out,
+            true, 0664, kcmInit | kcmParents, "%s", self->to);
+        if (rc == 0) {
+            rc = KFileSetSize(self->out, self->size);
+        }
+        if (rc != 0) {
+            PLOGERR(klogInt, (klogInt, rc,
+                "cannot create $(path)", "path=%s", self->to));
+        }
+
+        if (rc == 0) {
+            rc = KDirectoryCreateFile(self->dir, &self->stateFile,
+                true, 0664, kcmInit | kcmParents, "%s", self->state);
+            if (rc == 0) {
+                rc = KFileWriteAll(self->stateFile, 0, &h, sizeof h, NULL);
+            }
+            if (rc == 0) {
+                rc = KFileWriteAll(self->stateFile, sizeof h,
+                    self->digest, (size_t)self->count * 16, NULL);
+            }
+            if (rc != 0) {
+                PLOGERR(klogInt, (klogInt, rc,
+                    "cannot create $(path)", "path=%s", self->state));
+            }
+        }
+    }
+
+    return rc;
+}
+
+/* hands out the next range to download; false when there is none left */
+static bool RangesClaim(Ranges *self, uint32_t *range) {
+    bool found = false;
+    rc_t rc = KLockAcquire(self->lock);
+    if (rc != 0) {
+        return false;
+    }
+    if (self->rc == 0) {
+        for (; self->next < self->count; ++self->next) {
+            if (self->status[self->next] == eRangeTodo) {
+                self->status[self->next] = eRangeBusy;
+                *range = self->next++;
+                found = true;
+                break;
+            }
+        }
+    }
+    KLockUnlock(self->lock);
+    return found;
+}
+
+static rc_t RangesFetch(Ranges *self,
+    const KFile *in, uint32_t i, char *buffer)
+{
+    rc_t rc = 0;
+    uint8_t digest[16];
+    uint64_t pos = RangesPos(self, i);
+    size_t bytes = RangesBytes(self, i);
+    size_t piece = self->rate == NULL ? bytes : RANGES_READ_SIZE;
+    size_t num_read = 0;
+
+    STSMSG(STS_FIN, ("Reading %lu bytes from pos. %lu", (uint64_t)bytes, pos));
+
+    while (rc == 0 && num_read < bytes) {
+        size_t n = 0;
+        rc = KFileReadAll(in, pos + num_read, buffer + num_read,
+            bytes - num_read < piece ? bytes - num_read : piece, &n);
+        if (rc == 0) {
+            if (n == 0) {
+                break;
+            }
+            num_read += n;
+            rc = RateLimitTake(self->rate, n);
+        }
+    }
+    if (rc == 0 && num_read != bytes) {
+        rc = RC(rcExe, rcFile, rcReading, rcTransfer, rcIncomplete);
+    }
+    if (rc != 0) {
+        PLOGERR(klogInt, (klogInt, rc,
+            "cannot read $(bytes) bytes at $(pos) from $(url)",
+            "bytes=%lu,pos=%lu,url=%s", (uint64_t)bytes, pos, self->url));
+        return rc;
+    }
+
+    _MD5(buffer, bytes, digest);
+
+    rc = KFileWriteAll(self->out, pos, buffer, bytes, NULL);
+    if (rc != 0) {
+        PLOGERR(klogInt, (klogInt, rc,
+            "cannot write $(path)", "path=%s", self->to));
+        return rc;
+    }
+
+    rc = KLockAcquire(self->lock);
+    if (rc == 0) {
+        rc = RangesSetDigest(self, i, digest);
+        if (rc == 0) {
+            self->status[i] = eRangeDone;
+        }
+        KLockUnlock(self->lock);
+    }
+
+    return rc;
+}
+
+/* a connection: downloads ranges until there are none left */
+static rc_t CC RangesWorker(const KThread *t, void *data) {
+    Ranges *self = data;
+    rc_t rc = 0;
+    const KFile *in = NULL;
+    uint32_t i = 0;
+    char *buffer = malloc(RANGES_CHUNK_SIZE);
+    if (buffer == NULL) {
+        rc = RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    if (rc == 0) {
+        rc = KNSManagerMakeReliableHttpFile(self->kns,
+            &in, NULL, 0x01010000, self->url);
+        if (rc != 0) {
+            PLOGERR(klogInt, (klogInt, rc,
+                "failed to open file for $(path)", "path=%s", self->url));
+        }
+    }
+
+    while (rc == 0) {
+        rc = Quitting();
+        if (rc == 0) {
+            if (!RangesClaim(self, &i)) {
+                break;
+            }
+            rc = RangesFetch(self, in, i, buffer);
+        }
+    }
+
+    if (rc != 0 && KLockAcquire(self->lock) == 0) {
+        if (self->rc == 0) {
+            self->rc = rc;
+        }
+        KLockUnlock(self->lock);
+    }
+
+    RELEASE(KFile, in);
+    free(buffer);
+
+    return rc;
+}
+
+static rc_t RangesRun(Ranges *self, uint32_t connections) {
+    rc_t rc = 0;
+    KThread *threads[RANGES_MAX_CONNECTIONS];
+    uint32_t todo = 0;
+    uint32_t n = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < self->count; ++i) {
+        if (self->status[i] == eRangeTodo) {
+            ++todo;
+        }
+    }
+    if (todo == 0) {
+        return 0;
+    }
+
+    if (connections > RANGES_MAX_CONNECTIONS) {
+        connections = RANGES_MAX_CONNECTIONS;
+    }
+    if (connections > todo) {
+        connections = todo;
+    }
+
+    STSMSG(STS_INFO, ("downloading %u ranges of %s over %u connections",
+        todo, self->url, connections));
+
+    self->next = 0;
+    self->rc = 0;
+    for (n = 0; n < connections; ++n) {
+        rc = KThreadMake(&threads[n], RangesWorker, self);
+        if (rc != 0) {
+            break;
+        }
+    }
+
+    if (n == 0) {
+        /* no threads at all: download on this one */
+        rc = RangesWorker(NULL, self);
+    }
+    else {
+        rc = 0;
+    }
+
+    for (i = 0; i < n; ++i) {
+        rc_t status = 0;
+        rc_t rc2 = KThreadWait(threads[i], &status);
+        if (rc == 0) {
+            rc = rc2 != 0 ? rc2 : status;
+        }
+        KThreadRelease(threads[i]);
+    }
+
+    if (rc == 0) {
+        rc = self->rc;
+    }
+    if (rc == 0) {
+        for (i = 0; i < self->count; ++i) {
+            if (self->status[i] != eRangeDone) {
+                rc = RC(rcExe, rcFile, rcCopying, rcTransfer, rcIncomplete);
+                break;
+            }
+        }
+    }
+
+    return rc;
+}
+
+/* the object changed since the download started: its ranges may come from
+   both versions, they are all marked to be downloaded again */
+static rc_t RangesRestart(Ranges *self, const uint8_t identity[16]) {
+    rc_t rc = 0;
+    RangesHeader h;
+
+    memmove(self->identity, identity, sizeof self->identity);
+    memset(self->digest, 0, (size_t)self->count * 16);
+    memset(self->status, eRangeTodo, self->count);
+
+    RangesMakeHeader(self, &h);
+    rc = KFileWriteAll(self->stateFile, 0, &h, sizeof h, NULL);
+    if (rc == 0) {
+        rc = KFileWriteAll(self->stateFile, sizeof h,
+            self->digest, (size_t)self->count * 16, NULL);
+    }
+    if (rc != 0) {
+        PLOGERR(klogInt, (klogInt, rc,
+            "cannot write $(path)", "path=%s", self->state));
+    }
+    return rc;
+}
+
+/* reads back the whole file: ranges that do not match their digests
+   are marked to be downloaded again, all of them when the object changed */
+static rc_t RangesVerify(Ranges *self, uint32_t *bad, uint8_t md5[16]) {
+    rc_t rc = 0;
+    MD5State whole;
+    uint32_t i = 0;
+    uint8_t identity[16];
+    char *buffer = NULL;
+
+    assert(bad);
+    *bad = 0;
+
+    rc = RangesIdentify(self, identity);
+    if (rc != 0) {
+        return rc;
+    }
+    if (memcmp(identity, self->identity, sizeof identity) != 0) {
+        STSMSG(STS_TOP, (" %s changed during the download: restarting",
+            self->url));
+        *bad = self->count;
+        return RangesRestart(self, identity);
+    }
+
+    buffer = malloc(RANGES_CHUNK_SIZE);
+    if (buffer == NULL) {
+        return RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    MD5StateInit(&whole);
+    for (i = 0; i < self->count && rc == 0; ++i) {
+        uint8_t digest[16];
+        size_t bytes = RangesBytes(self, i);
+        size_t num_read = 0;
+
+        rc = Quitting();
+        if (rc == 0) {
+            rc = KFileReadAll(self->out,
+                RangesPos(self, i), buffer, bytes, &num_read);
+            if (rc == 0 && num_read != bytes) {
+                rc = RC(rcExe, rcFile, rcReading, rcFile, rcInsufficient);
+            }
+            if (rc != 0) {
+                PLOGERR(klogInt, (klogInt, rc,
+                    "cannot read $(path)", "path=%s", self->to));
+            }
+        }
+        if (rc == 0) {
+            _MD5(buffer, bytes, digest);
+            if (memcmp(digest, self->digest[i], 16) != 0) {
+                STSMSG(STS_DBG, ("%s: range %u is damaged", self->to, i));
+                rc = RangesSetDigest(self, i, NO_DIGEST);
+                self->status[i] = eRangeTodo;
+                ++*bad;
+            }
+            MD5StateAppend(&whole, buffer, bytes);
+        }
+    }
+    MD5StateFinish(&whole, md5);
+
+    free(buffer);
+
+    return rc;
+}
+
+/* prepares the download: a resumed one when "<to>.ranges" is of the same object */
+static rc_t RangesInit(Ranges *self, KDirectory *dir, KNSManager *kns,
+    const char *url, uint64_t size, const char *to, RateLimit *rate)
+{
+    rc_t rc = 0;
+
+    memset(self, 0, sizeof *self);
+    self->dir = dir;
+    self->kns = kns;
+    self->url = url;
+    self->to = to;
+    self->size = size;
+    self->rate = rate;
+    self->count = (uint32_t)((size + RANGES_CHUNK_SIZE - 1) / RANGES_CHUNK_SIZE);
+
+    rc = string_printf(self->state, sizeof self->state, NULL, "%s.ranges", to);
+    if (rc != 0) {
+        PLOGERR(klogInt, (klogInt, rc,
+            "cannot make state file name for $(path)", "path=%s", to));
+        return rc;
+    }
+
+    self->digest = calloc(self->count, sizeof *self->digest);
+    self->status = calloc(self->count, sizeof *self->status);
+    if (self->digest == NULL || self->status == NULL) {
+        rc = RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    if (rc == 0) {
+        rc = KLockMake(&self->lock);
+    }
+
+    if (rc == 0) {
+        rc = RangesIdentify(self, self->identity);
+    }
+
+    if (rc == 0) {
+        rc = RangesOpen(self);
+    }
+
+    return rc;
+}
+
+static rc_t RangesFini(Ranges *self) {
+    rc_t rc = 0;
+
+    RELEASE(KFile, self->stateFile);
+    RELEASE(KFile, self->out);
+    RELEASE(KLock, self->lock);
+    free(self->status);
+    free(self->digest);
+    self->status = NULL;
+    self->digest = NULL;
+
+    return rc;
+}
+
+/* number of ranges in the file, resumed ones included */
+static uint32_t RangesDone(const Ranges *self) {
+    uint32_t done = 0;
+    uint32_t i = 0;
+
+    if (self->status != NULL) {
+        for (i = 0; i < self->count; ++i) {
+            if (self->status[i] == eRangeDone) {
+                ++done;
+            }
+        }
+    }
+    return done;
+}
+
+/* removes the file and its state: there is nothing to resume */
+static void RangesRemove(const Ranges *self) {
+    if (self->state[0] != '\0' &&
+        KDirectoryPathType(self->dir, "%s", self->state) != kptNotFound)
+    {
+        STSMSG(STS_DBG, ("removing %s", self->state));
+        KDirectoryRemove(self->dir, false, "%s", self->state);
+    }
+    if (KDirectoryPathType(self->dir, "%s", self->to) != kptNotFound) {
+        STSMSG(STS_DBG, ("removing %s", self->to));
+        KDirectoryRemove(self->dir, false, "%s", self->to);
+    }
+}
+
+rc_t DownloadRanges(KDirectory *dir, KNSManager *kns,
+    const char *url, uint64_t size, const char *to, uint32_t connections,
+    RateLimit *rate, bool *fallback)
+{
+    rc_t rc = 0;
+    rc_t rc2 = 0;
+    uint32_t round = 0;
+    uint8_t md5[16];
+    bool mismatch = false;
+    Ranges self;
+
+    assert(dir && kns && url && to && size > 0 && fallback);
+
+    *fallback = false;
+
+    rc = RangesInit(&self, dir, kns, url, size, to, rate);
+
+    for (round = 0; rc == 0; ++round) {
+        uint32_t bad = 0;
+        rc = RangesRun(&self, connections);
+        if (rc == 0) {
+            rc = RangesVerify(&self, &bad, md5);
+        }
+        if (rc == 0 && bad == 0) {
+            break;
+        }
+        if (rc == 0) {
+            if (round == RANGES_MAX_ROUNDS) {
+                rc = RC(rcExe, rcFile, rcValidating, rcChecksum, rcUnequal);
+                mismatch = true;
+                PLOGERR(klogErr, (klogErr, rc,
+                    "$(path): $(n) ranges do not match after $(r) attempts",
+                    "path=%s,n=%u,r=%u", to, bad, round + 1));
+            }
+            else {
+                STSMSG(STS_TOP, (" %u ranges of %s are damaged: redownloading",
+                    bad, to));
+            }
+        }
+    }
+
+    if (rc != 0 && Quitting() == 0) {
+        /* no range came in: the server may refuse HEAD or Range requests */
+        *fallback = RangesDone(&self) == 0;
+        if (*fallback || mismatch) {
+            STSMSG(STS_DBG, ("%s cannot be resumed", to));
+        }
+    }
+
+    rc2 = RangesFini(&self);
+    if (rc == 0) {
+        rc = rc2;
+    }
+    if (rc != 0 && (*fallback || mismatch)) {
+        RangesRemove(&self);
+    }
+
+    if (rc == 0) {
+        STSMSG(STS_INFO, ("%s (%lu): md5 "
+            "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
+            to, size, md5[0], md5[1], md5[2], md5[3], md5[4], md5[5], md5[6],
+            md5[7], md5[8], md5[9], md5[10], md5[11], md5[12], md5[13], md5[14],
+            md5[15]));
+        STSMSG(STS_DBG, ("removing %s", self.state));
+        rc = KDirectoryRemove(dir, false, "%s", self.state);
+    }
+
+    return rc;
+}
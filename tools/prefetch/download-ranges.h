@@ -0,0 +1,83 @@
+/*==============================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_prefetch_download_ranges_
+#define _h_prefetch_download_ranges_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct KDirectory;
+struct KNSManager;
+struct RateLimit;
+
+/* size of a byte range fetched by one request */
+#define RANGES_CHUNK_SIZE ( 8 * 1024 * 1024 )
+
+/* files smaller than this are not worth splitting */
+#define RANGES_MIN_SIZE ( 4 * RANGES_CHUNK_SIZE )
+
+/* upper limit of concurrent connections */
+#define RANGES_MAX_CONNECTIONS 16
+
+/* DownloadRanges
+ *  download "size" bytes of "url" into "to"
+ *  fetching RANGES_CHUNK_SIZE byte ranges over "connections" concurrent connections
+ *
+ *  "to" is preallocated to its final size. the digest of every range is kept in
+ *  "<to>.ranges" as soon as the range is written, so that an interrupted download
+ *  resumes with the missing ranges. "<to>.ranges" also keeps the identity of the
+ *  object: its size, ETag and Last-Modified ( not the url, signed urls change ).
+ *  a download is resumed only when they are the same as now and "<to>.ranges"
+ *  is at most a week old.
+ *
+ *  when all ranges are in, the identity is asked for again: if the object changed
+ *  meanwhile, its ranges are mixed from two versions and all of them are fetched
+ *  again. then the file is read back: ranges that do not match their digest are
+ *  fetched again. the MD5 of the whole file is only reported, there is nothing
+ *  to compare it to. "<to>.ranges" is removed after a successful download.
+ *
+ *  "rate" is the bandwidth cap shared with other downloads, NULL for none
+ *
+ *  on failure "to" and "<to>.ranges" are kept to be resumed, unless no range
+ *  came in or the ranges kept failing verification: then both are removed.
+ *  "fallback" is set when no range came in ( e.g. the server refuses HEAD or
+ *  Range requests ): the caller may download the object as a whole instead
+ */
+rc_t DownloadRanges ( struct KDirectory *dir, struct KNSManager *kns,
+    const char *url, uint64_t size, const char *to, uint32_t connections,
+    struct RateLimit *rate, bool *fallback );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_prefetch_download_ranges_ */
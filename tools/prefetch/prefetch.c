@@ -27,6 +27,8 @@
 /********** includes **********/
 
 #include "prefetch.vers.h"
+#include "download-ranges.h" /* DownloadRanges */
+#include "rate-limit.h" /* RateLimit */
 
 #include <kapp/main.h> /* KAppVersion */
 
@@ -54,6 +56,10 @@
 #include <kfs/gzip.h> /* KFileMakeGzipForRead */
 #include <kfs/subfile.h> /* KFileMakeSubRead */
 
+#include <kproc/cond.h> /* KCondition */
+#include <kproc/lock.h> /* KLock */
+#include <kproc/thread.h> /* KThread */
+
 #include <klib/container.h> /* BSTree */
 #include <klib/data-buffer.h> /* KDataBuffer */
 #include <klib/log.h> /* PLOGERR */
@@ -63,6 +69,7 @@
 #include <klib/status.h> /* STSMSG */
 #include <klib/text.h> /* String */
 
+#include <atomic32.h>
 #include <strtol.h> /* strtou64 */
 #include <sysalloc.h>
 
@@ -125,9 +132,15 @@ typedef struct {
     const VPath *path;
     const String *str;
 } VPathStr;
+typedef enum {
+    eRefseqPending, /* being downloaded for an item */
+    eRefseqDone,
+    eRefseqFailed /* the next item that needs it downloads it again */
+} ERefseqState;
 typedef struct {
     BSTNode n;
     char *path;
+    ERefseqState state; /* in Main::refseqs only */
 } TreeNode;
 typedef struct {
     ERunType type;
@@ -189,6 +202,19 @@ typedef struct {
     size_t maxSize;
     uint64_t heartbeat;
 
+    uint32_t connections; /* for http download of large files */
+    RateLimit *rate; /* total http bandwidth cap; NULL: unlimited */
+
+    uint32_t jobs; /* maximum number of threads downloading items */
+    uint32_t busy; /* threads downloading items now */
+    BSTree refseqs; /* dependencies already taken care of */
+    KCondition *refseqDone; /* a refseq is not pending anymore */
+    BSTree downloading; /* cache paths being downloaded by a job now */
+    KCondition *downloadDone; /* a path left downloading */
+    int number; /* of the last item resolved, for messages */
+    KLock *lock; /* guards busy, downloaded, refseqs, downloading and number */
+    KLock *mgrLock; /* guards resolver of mgr from setting through its use */
+
     bool noAscp;
     bool noHttp;
 
@@ -924,17 +950,24 @@ static bool MainHasDownloaded(const Main *self, const char *local) {
 
     assert(self);
 
+    KLockAcquire(self->lock);
     sn = (TreeNode*) BSTreeFind(&self->downloaded, local, bstCmp);
+    KLockUnlock(self->lock);
 
     return sn != NULL;
 }
 
-static rc_t MainDownloaded(Main *self, const char *path) {
+/* adds path to tree unless it is there already; called under self->lock */
+static rc_t _MainTreeAdd(Main *self, BSTree *tree, const char *path,
+    bool *added)
+{
     TreeNode *sn = NULL;
 
-    assert(self);
+    assert(self && tree && added);
 
-    if (MainHasDownloaded(self, path)) {
+    *added = false;
+
+    if (BSTreeFind(tree, path, bstCmp) != NULL) {
         return 0;
     }
 
@@ -950,11 +983,153 @@ static rc_t MainDownloaded(Main *self, const char *path) {
         return RC(rcExe, rcStorage, rcAllocating, rcMemory, rcExhausted);
     }
 
-    BSTreeInsert(&self->downloaded, (BSTNode*)sn, bstSort);
+    BSTreeInsert(tree, (BSTNode*)sn, bstSort);
+    *added = true;
 
     return 0;
 }
 
+static rc_t MainDownloaded(Main *self, const char *path) {
+    rc_t rc = 0;
+    bool added = false;
+
+    assert(self);
+
+    rc = KLockAcquire(self->lock);
+    if (rc == 0) {
+        rc = _MainTreeAdd(self, &self->downloaded, path, &added);
+        KLockUnlock(self->lock);
+    }
+
+    return rc;
+}
+
+/* the first item that depends on a refseq gets to download it.
+   while it is pending the others skip it, or wait for it when wait is set;
+   after a failure the next item claims it again */
+static rc_t MainClaimRefseq(Main *self, const char *seq_id, bool wait,
+    bool *claimed, bool *pending)
+{
+    rc_t rc = 0;
+
+    assert(self && claimed && pending);
+
+    *claimed = *pending = false;
+
+    rc = KLockAcquire(self->lock);
+    if (rc != 0) {
+        return rc;
+    }
+
+    while (rc == 0) {
+        TreeNode *sn
+            = (TreeNode*) BSTreeFind(&self->refseqs, seq_id, bstCmp);
+        if (sn == NULL) {
+            rc = _MainTreeAdd(self, &self->refseqs, seq_id, claimed);
+            break;
+        }
+        else if (sn->state == eRefseqFailed) {
+            sn->state = eRefseqPending;
+            *claimed = true;
+            break;
+        }
+        else if (sn->state == eRefseqDone) {
+            break;
+        }
+        else if (!wait) {
+            *pending = true;
+            break;
+        }
+
+        rc = KConditionWait(self->refseqDone, self->lock);
+    }
+    KLockUnlock(self->lock);
+
+    return rc;
+}
+
+/* releases a refseq claimed by MainClaimRefseq */
+static void MainRefseqDone(Main *self, const char *seq_id, bool ok) {
+    assert(self);
+
+    if (KLockAcquire(self->lock) == 0) {
+        TreeNode *sn
+            = (TreeNode*) BSTreeFind(&self->refseqs, seq_id, bstCmp);
+        if (sn != NULL) {
+            sn->state = ok ? eRefseqDone : eRefseqFailed;
+        }
+        KConditionBroadcast(self->refseqDone);
+        KLockUnlock(self->lock);
+    }
+}
+
+/* duplicate kart items resolve to the same cache path: while one job
+   downloads it the others wait, then find it downloaded */
+static rc_t MainClaimDownload(Main *self, const char *path) {
+    rc_t rc = 0;
+    bool added = false;
+
+    assert(self);
+
+    rc = KLockAcquire(self->lock);
+    if (rc != 0) {
+        return rc;
+    }
+
+    while (rc == 0) {
+        rc = _MainTreeAdd(self, &self->downloading, path, &added);
+        if (rc != 0 || added) {
+            break;
+        }
+        rc = KConditionWait(self->downloadDone, self->lock);
+    }
+    KLockUnlock(self->lock);
+
+    return rc;
+}
+
+/* releases a path claimed by MainClaimDownload */
+static void MainDownloadDone(Main *self, const char *path) {
+    assert(self);
+
+    if (KLockAcquire(self->lock) == 0) {
+        BSTNode *sn = BSTreeFind(&self->downloading, path, bstCmp);
+        if (sn != NULL) {
+            BSTreeUnlink(&self->downloading, sn);
+            bstWhack(sn, NULL);
+        }
+        KConditionBroadcast(self->downloadDone);
+        KLockUnlock(self->lock);
+    }
+}
+
+/* a thread can be started to download items when it does not exceed jobs */
+static bool MainTakeSlot(Main *self) {
+    bool taken = false;
+
+    assert(self);
+
+    if (KLockAcquire(self->lock) == 0) {
+        if (self->busy < self->jobs) {
+            ++self->busy;
+            taken = true;
+        }
+        KLockUnlock(self->lock);
+    }
+
+    return taken;
+}
+
+static void MainGiveSlot(Main *self) {
+    assert(self);
+
+    if (KLockAcquire(self->lock) == 0) {
+        assert(self->busy > 0);
+        --self->busy;
+        KLockUnlock(self->lock);
+    }
+}
+
 static rc_t MainDownloadFile(Resolved *self,
     Main *main, const char *to)
 {
@@ -965,9 +1140,19 @@ static rc_t MainDownloadFile(Resolved *self,
     size_t num_writ = 0;
     uint64_t pos = 0;
     uint64_t prevPos = 0;
+    void *buffer = NULL;
 
     assert(self && main);
 
+    /* main->buffer is shared by the threads downloading items */
+    buffer = main->buffer;
+    if (main->jobs > 1) {
+        buffer = malloc(main->bsize);
+        if (buffer == NULL) {
+            return RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+        }
+    }
+
     if (rc == 0) {
         STSMSG(STS_DBG, ("creating %s", to));
         rc = KDirectoryCreateFile(main->dir, &out,
@@ -996,12 +1181,13 @@ static rc_t MainDownloadFile(Resolved *self,
                     ("Reading %lu bytes from pos. %lu", main->bsize, pos));
             }
             rc = KFileRead(self->file,
-                pos, main->buffer, main->bsize, &num_read);
+                pos, buffer, main->bsize, &num_read);
             if (rc != 0) {
                 DISP_RC2(rc, "Cannot KFileRead", self->remote.str->addr);
             }
             else {
                 pos += num_read;
+                rc = RateLimitTake(main->rate, num_read);
             }
 
             if (print) {
@@ -1010,7 +1196,7 @@ static rc_t MainDownloadFile(Resolved *self,
         }
 
         if (rc == 0 && num_read > 0) {
-            rc = KFileWrite(out, opos, main->buffer, num_read, &num_writ);
+            rc = KFileWrite(out, opos, buffer, num_read, &num_writ);
             DISP_RC2(rc, "Cannot KFileWrite", to);
             opos += num_writ;
         }
@@ -1018,6 +1204,10 @@ static rc_t MainDownloadFile(Resolved *self,
 
     RELEASE(KFile, out);
 
+    if (buffer != main->buffer) {
+        free(buffer);
+    }
+
     if (rc == 0) {
         STSMSG(STS_INFO, ("%s (%ld)", to, pos));
     }
@@ -1025,6 +1215,48 @@ static rc_t MainDownloadFile(Resolved *self,
     return rc;
 }
 
+/* downloads a large file over main->connections concurrent connections.
+   it is fetched into "<cache>.prt" that is kept between runs
+   so that an interrupted download is resumed.
+   when the ranged download cannot start it is downloaded as a whole */
+static rc_t MainDownloadRanges(Resolved *self,
+    Main *main, const char *to)
+{
+    rc_t rc = 0;
+    char partial[PATH_MAX] = "";
+    size_t num_writ = 0;
+    bool fallback = false;
+
+    assert(self && self->remote.str && self->cache && main);
+
+    rc = string_printf(partial, sizeof partial, &num_writ, "%S.prt",
+        self->cache);
+    DISP_RC2(rc, "string_printf(.prt)", self->cache->addr);
+
+    if (rc == 0) {
+        STSMSG(STS_INFO, ("%S -> %s", self->remote.str, partial));
+        rc = DownloadRanges(main->dir, main->kns, self->remote.str->addr,
+            self->remoteSz, partial, main->connections, main->rate,
+            &fallback);
+        if (rc != 0 && fallback) {
+            STSMSG(STS_TOP, (" ranged download failed: "
+                "downloading the whole file..."));
+            return MainDownloadFile(self, main, to);
+        }
+    }
+
+    if (rc == 0) {
+        STSMSG(STS_DBG, ("renaming %s -> %s", partial, to));
+        rc = KDirectoryRename(main->dir, true, partial, to);
+        if (rc != 0) {
+            PLOGERR(klogInt, (klogInt, rc, "cannot rename $(from) to $(to)",
+                "from=%s,to=%s", partial, to));
+        }
+    }
+
+    return rc;
+}
+
 /*  http://ftp-trace.ncbi.nlm.nih.gov/sra/sra-instant/reads/ByR.../SRR125365.sra
 anonftp@ftp-private.ncbi.nlm.nih.gov:/sra/sra-instant/reads/ByR.../SRR125365.sra
 */
@@ -1062,7 +1294,7 @@ static rc_t MainDownloadAscp(const Resolved *self, Main *main,
     return aspera_get(main->ascp, main->asperaKey, src, to, &opt);
 }
 
-static rc_t MainDownload(Resolved *self, Main *main) {
+static rc_t _MainDownload(Resolved *self, Main *main) {
     bool canceled = false;
     rc_t rc = 0;
     KFile *flock = NULL;
@@ -1172,7 +1404,14 @@ static rc_t MainDownload(Resolved *self, Main *main) {
                     &self->remote.path, &self->remote.str, &self->cache);
             }
             if (rc == 0) {
-                rc = MainDownloadFile(self, main, tmp);
+                if (main->connections > 1
+                    && self->remoteSz >= RANGES_MIN_SIZE)
+                {
+                    rc = MainDownloadRanges(self, main, tmp);
+                }
+                else {
+                    rc = MainDownloadFile(self, main, tmp);
+                }
             }
         }
     }
@@ -1209,6 +1448,20 @@ static rc_t MainDownload(Resolved *self, Main *main) {
     return rc;
 }
 
+static rc_t MainDownload(Resolved *self, Main *main) {
+    rc_t rc = 0;
+
+    assert(self && self->cache && self->cache->addr && main);
+
+    rc = MainClaimDownload(main, self->cache->addr);
+    if (rc == 0) {
+        rc = _MainDownload(self, main);
+        MainDownloadDone(main, self->cache->addr);
+    }
+
+    return rc;
+}
+
 static rc_t _VDBManagerSetDbGapCtx(const VDBManager *self, VResolver *resolver)
 {
     if (resolver == NULL) {
@@ -1218,7 +1471,27 @@ static rc_t _VDBManagerSetDbGapCtx(const VDBManager *self, VResolver *resolver)
     return VDBManagerSetResolver(self, resolver);
 }
 
-static rc_t MainDependenciesList(const Main *self,
+/* mgr is shared by all jobs, while the dbGaP context it resolves with belongs
+   to the item: set it and use mgr under mgrLock */
+static rc_t MainPathType(const Main *self, VResolver *resolver,
+    const char *path, KPathType *type)
+{
+    rc_t rc = 0;
+
+    assert(self && path && type);
+
+    rc = KLockAcquire(self->mgrLock);
+    if (rc == 0) {
+        rc = _VDBManagerSetDbGapCtx(self->mgr, resolver);
+        *type = VDBManagerPathType(self->mgr, "%s", path) & ~kptAlias;
+        KLockUnlock(self->mgrLock);
+    }
+
+    return rc;
+}
+
+/* called under mgrLock */
+static rc_t MainDependenciesListLocked(const Main *self,
     const Resolved *resolved, const VDBDependencies **deps)
 {
     rc_t rc = 0;
@@ -1278,6 +1551,22 @@ static rc_t MainDependenciesList(const Main *self,
     return rc;
 }
 
+static rc_t MainDependenciesList(const Main *self,
+    const Resolved *resolved, const VDBDependencies **deps)
+{
+    rc_t rc = 0;
+
+    assert(self);
+
+    rc = KLockAcquire(self->mgrLock);
+    if (rc == 0) {
+        rc = MainDependenciesListLocked(self, resolved, deps);
+        KLockUnlock(self->mgrLock);
+    }
+
+    return rc;
+}
+
 /********** Item **********/
 static rc_t ItemRelease(Item *self) {
     rc_t rc = 0;
@@ -1594,7 +1883,6 @@ static rc_t ItemInitResolved(Item *self, VResolver *resolver, KDirectory *dir,
 /* resolve: locate */
 static rc_t ItemResolve(Item *item, int32_t row) {
     Resolved *self = NULL;
-    static int n = 0;
     rc_t rc = 0;
     bool ascp = false;
 
@@ -1603,14 +1891,21 @@ static rc_t ItemResolve(Item *item, int32_t row) {
     self = &item->resolved;
     assert(self->type);
 
-    ++n;
+    /* items are resolved on several threads when jobs > 1 */
+    rc = KLockAcquire(item->main->lock);
+    if (rc != 0) {
+        return rc;
+    }
     if (row > 0 &&
         item->desc == NULL) /* desc is NULL for kart items */
     {
-        n = row;
+        item->main->number = row;
+        item->number = row;
     }
-
-    item->number = n;
+    else {
+        item->number = ++item->main->number;
+    }
+    KLockUnlock(item->main->lock);
 
     ascp = MainUseAscp(item->main);
     if (self->type == eRunTypeList) {
@@ -1762,12 +2057,200 @@ static rc_t ItemResolveResolvedAndDownloadOrProcess(Item *self, int32_t row) {
     return ItemDownload(self);
 }
 
+/********** Jobs **********/
+#define MAX_JOBS 64
+
+typedef struct {
+    Item *item;
+    int32_t row;
+    rc_t rc;
+    bool done; /* processed: not skipped after quit or failure */
+} Job;
+typedef struct {
+    Main *main;
+    Job *jobs;
+    uint32_t count;
+    rc_t (*process)(Item *item, int32_t row);
+    bool stopOnError; /* do not start new jobs after a job failed */
+    atomic32_t next;
+    atomic32_t failed;
+} Jobs;
+
+static void JobsInit(Jobs *self, Main *main, Job *jobs, uint32_t count,
+    rc_t (*process)(Item *item, int32_t row), bool stopOnError)
+{
+    assert(self);
+    memset(self, 0, sizeof *self);
+
+    self->main = main;
+    self->jobs = jobs;
+    self->count = count;
+    self->process = process;
+    self->stopOnError = stopOnError;
+    atomic32_set(&self->next, 0);
+    atomic32_set(&self->failed, 0);
+}
+
+static void JobsProcess(Jobs *self) {
+    assert(self);
+
+    while (Quitting() == 0) {
+        Job *job = NULL;
+        uint32_t i = 0;
+
+        if (self->stopOnError && atomic32_read(&self->failed) != 0) {
+            break;
+        }
+
+        i = atomic32_read_and_add(&self->next, 1);
+        if (i >= self->count) {
+            break;
+        }
+
+        job = &self->jobs[i];
+        job->rc = self->process(job->item, job->row);
+        job->done = true;
+
+        if (job->rc != 0) {
+            atomic32_set(&self->failed, 1);
+        }
+    }
+}
+
+static rc_t CC JobsThread(const KThread *t, void *data) {
+    Jobs *self = data;
+
+    assert(self);
+
+    JobsProcess(self);
+    MainGiveSlot(self->main);
+
+    return 0;
+}
+
+/* processes the jobs on this thread and on as many new ones as
+   main->jobs allows: threads of nested Jobs (dependencies of items
+   being downloaded) count against the same limit */
+static rc_t JobsRun(Jobs *self) {
+    rc_t rc = 0;
+    KThread *threads[MAX_JOBS];
+    uint32_t n = 0;
+    uint32_t i = 0;
+
+    assert(self && self->main);
+
+    for (n = 0; n + 1 < self->count && n < MAX_JOBS; ++n) {
+        if (!MainTakeSlot(self->main)) {
+            break;
+        }
+        rc = KThreadMake(&threads[n], JobsThread, self);
+        if (rc != 0) {
+            DISP_RC(rc, "KThreadMake");
+            MainGiveSlot(self->main);
+            rc = 0;
+            break;
+        }
+    }
+
+    JobsProcess(self);
+
+    for (i = 0; i < n; ++i) {
+        KThreadWait(threads[i], NULL);
+        KThreadRelease(threads[i]);
+    }
+
+    for (i = 0; i < self->count && rc == 0; ++i) {
+        rc = self->jobs[i].rc;
+    }
+    if (rc == 0) {
+        rc = Quitting();
+    }
+
+    return rc;
+}
+
+/* makes an item to download refseq seq_id */
+static rc_t ItemMakeDependency(const Item *item, const char *seq_id,
+    Item **dep)
+{
+    rc_t rc = 0;
+    size_t num_writ = 0;
+    char ncbiAcc[512] = "";
+    Item *ditem = NULL;
+
+    assert(item && seq_id && dep);
+
+    *dep = NULL;
+
+    rc = string_printf(ncbiAcc, sizeof ncbiAcc, &num_writ,
+        "ncbi-acc:%s?vdb-ctx=refseq", seq_id);
+    DISP_RC2(rc, "string_printf(?vdb-ctx=refseq)", seq_id);
+    if (rc == 0 && num_writ > sizeof ncbiAcc) {
+        rc = RC(rcExe, rcFile, rcCopying, rcBuffer, rcInsufficient);
+        PLOGERR(klogInt, (klogInt, rc,
+            "bad string_printf($(s)?vdb-ctx=refseq) result",
+            "s=%s", seq_id));
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    ditem = calloc(1, sizeof *ditem);
+    if (ditem == NULL) {
+        return RC(rcExe, rcStorage, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    ditem->desc = string_dup_measure(ncbiAcc, NULL);
+    ditem->main = item->main;
+    if (ditem->desc == NULL) {
+        RELEASE(Item, ditem);
+        return RC(rcExe, rcStorage, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    ResolvedReset(&ditem->resolved, eRunTypeDownload);
+
+    *dep = ditem;
+
+    return rc;
+}
+
+/* downloads the refseqs ids[] claimed by item concurrently,
+   then lets the items waiting for them know how it went;
+   after an error (rc != 0) the claims are only given up */
+static rc_t ItemDownloadClaimed(Item *item, Job *jobs, const char **ids,
+    uint32_t n, rc_t rc)
+{
+    uint32_t i = 0;
+
+    assert(item && item->main);
+
+    if (rc == 0 && n > 0) {
+        Jobs j;
+        JobsInit(&j, item->main, jobs, n,
+            ItemResolveResolvedAndDownloadOrProcess, true);
+        rc = JobsRun(&j);
+    }
+
+    for (i = 0; i < n; ++i) {
+        MainRefseqDone(item->main, ids[i], jobs[i].done && jobs[i].rc == 0);
+        free((char*)jobs[i].item->desc);
+        RELEASE(Item, jobs[i].item);
+    }
+
+    return rc;
+}
+
 static rc_t ItemDownloadDependencies(Item *item) {
     Resolved *resolved = NULL;
     rc_t rc = 0;
     const VDBDependencies *deps = NULL;
     uint32_t count = 0;
     uint32_t i = 0;
+    uint32_t n = 0;
+    uint32_t w = 0;
+    Job *jobs = NULL;
+    const char **ids = NULL; /* claimed by this item */
+    const char **waits = NULL; /* pending for other items */
 
     assert(item && item->main);
 
@@ -1792,8 +2275,19 @@ static rc_t ItemDownloadDependencies(Item *item) {
         }
     }
 
+    if (rc == 0 && count > 0) {
+        jobs = calloc(count, sizeof *jobs);
+        ids = calloc(count, sizeof *ids);
+        waits = calloc(count, sizeof *waits);
+        if (jobs == NULL || ids == NULL || waits == NULL) {
+            rc = RC(rcExe, rcStorage, rcAllocating, rcMemory, rcExhausted);
+        }
+    }
+
     for (i = 0; i < count && rc == 0; ++i) {
         bool local = true;
+        bool claimed = false;
+        bool pending = false;
         const char *seq_id = NULL;
 
         if (rc == 0) {
@@ -1810,40 +2304,59 @@ static rc_t ItemDownloadDependencies(Item *item) {
         }
 
         if (rc == 0) {
-            size_t num_writ = 0;
-            char ncbiAcc[512] = "";
-
             assert(seq_id);
-
-            rc = string_printf(ncbiAcc, sizeof ncbiAcc, &num_writ,
-                "ncbi-acc:%s?vdb-ctx=refseq", seq_id);
-            DISP_RC2(rc, "string_printf(?vdb-ctx=refseq)", seq_id);
-            if (rc == 0 && num_writ > sizeof ncbiAcc) {
-                rc = RC(rcExe, rcFile, rcCopying, rcBuffer, rcInsufficient);
-                PLOGERR(klogInt, (klogInt, rc,
-                    "bad string_printf($(s)?vdb-ctx=refseq) result",
-                    "s=%s", seq_id));
-            }
-    
-            if (rc == 0) {
-                Item *ditem = calloc(1, sizeof *ditem);
-                if (ditem == NULL) {
-                    return RC(rcExe,
-                        rcStorage, rcAllocating, rcMemory, rcExhausted);
+            rc = MainClaimRefseq(item->main, seq_id, false,
+                &claimed, &pending);
+            if (rc == 0 && !claimed) {
+                if (pending) {
+                    waits[w++] = seq_id;
+                }
+                else {
+                    STSMSG(STS_DBG, ("'%s' is already taken care of", seq_id));
                 }
+                continue;
+            }
+        }
 
-                ditem->desc = ncbiAcc;
-                ditem->main = item->main;
+        if (rc == 0) {
+            rc = ItemMakeDependency(item, seq_id, &jobs[n].item);
+            if (rc != 0) {
+                MainRefseqDone(item->main, seq_id, false);
+                break;
+            }
+            ids[n++] = seq_id;
+        }
+    }
 
-                ResolvedReset(&ditem->resolved, eRunTypeDownload);
+    /* download the dependencies concurrently */
+    rc = ItemDownloadClaimed(item, jobs, ids, n, rc);
 
-                rc = ItemResolveResolvedAndDownloadOrProcess(ditem, 0);
+    /* wait for the ones other items are downloading; nothing is held
+       while waiting: a refseq failed elsewhere is downloaded right away */
+    for (i = 0; i < w && rc == 0; ++i) {
+        bool claimed = false;
+        bool pending = false;
 
-                RELEASE(Item, ditem);
+        STSMSG(STS_DBG, ("waiting for '%s'", waits[i]));
+        rc = MainClaimRefseq(item->main, waits[i], true, &claimed, &pending);
+        if (rc == 0 && claimed) {
+            STSMSG(STS_INFO,
+                ("'%s' failed for another item, retrying", waits[i]));
+            memset(jobs, 0, sizeof *jobs);
+            rc = ItemMakeDependency(item, waits[i], &jobs[0].item);
+            if (rc != 0) {
+                MainRefseqDone(item->main, waits[i], false);
+            }
+            else {
+                rc = ItemDownloadClaimed(item, jobs, &waits[i], 1, rc);
             }
         }
     }
 
+    free(waits);
+    free(ids);
+    free(jobs);
+
     RELEASE(VDBDependencies, deps);
 
     return rc;
@@ -2094,22 +2607,32 @@ static rc_t ItemDownloadVdbcache(Item *item) {
     {
         bool csra = false;
         const VDatabase *db = NULL;
-        KPathType type = VDBManagerPathType
-            (item->main->mgr, "%S", resolved->path.str) & ~kptAlias;
-        if (type == kptTable) {
-            STSMSG(STS_INFO, ("'%S' is a table", resolved->path.str));
+        KPathType type = kptNotFound;
+        rc = KLockAcquire(item->main->mgrLock);
+        if (rc != 0) {
+            return rc;
         }
-        else if (type != kptDatabase) {
-            STSMSG(STS_INFO, ("'%S' is not recognized as a database or a table",
-                resolved->path.str));
+        if (_VDBManagerSetDbGapCtx(item->main->mgr, resolved->resolver) == 0) {
+            type = VDBManagerPathType
+                (item->main->mgr, "%S", resolved->path.str) & ~kptAlias;
         }
-        else {
+        if (type == kptDatabase) {
             rc_t rc = VDBManagerOpenDBRead(item->main->mgr,
                 &db, NULL, "%S", resolved->path.str);
             if (rc == 0) {
                 csra = VDatabaseIsCSRA(db);
             }
             RELEASE(VDatabase, db);
+        }
+        KLockUnlock(item->main->mgrLock);
+        if (type == kptTable) {
+            STSMSG(STS_INFO, ("'%S' is a table", resolved->path.str));
+        }
+        else if (type != kptDatabase) {
+            STSMSG(STS_INFO, ("'%S' is not recognized as a database or a table",
+                resolved->path.str));
+        }
+        else {
             if (csra) {
                 STSMSG(STS_INFO, ("'%s' is cSRA", resolved->name));
             }
@@ -2234,22 +2757,21 @@ static rc_t ItemPostDownload(Item *item, int32_t row) {
 
     if (resolved->path.str != NULL) {
         assert(item->main);
-        rc = _VDBManagerSetDbGapCtx(item->main->mgr, resolved->resolver);
-        type = VDBManagerPathType
-            (item->main->mgr, "%s", resolved->path.str->addr) & ~kptAlias;
-        if (type != kptDatabase) {
-            if (type == kptTable) {
-                 STSMSG(STS_DBG, ("...'%S' is a table", resolved->path.str));
-            }
-            else {
-                 STSMSG(STS_DBG, ("...'%S' is not recognized "
-                     "as a database or a table", resolved->path.str));
-            }
-            return rc;
-         }
-        else {
-            STSMSG(STS_DBG, ("...'%S' is a database", resolved->path.str));
-        }
+        rc = MainPathType(item->main, resolved->resolver,
+            resolved->path.str->addr, &type);
+        if (type != kptDatabase) {
+            if (type == kptTable) {
+                 STSMSG(STS_DBG, ("...'%S' is a table", resolved->path.str));
+            }
+            else {
+                 STSMSG(STS_DBG, ("...'%S' is not recognized "
+                     "as a database or a table", resolved->path.str));
+            }
+            return rc;
+         }
+        else {
+            STSMSG(STS_DBG, ("...'%S' is a database", resolved->path.str));
+        }
     }
 
     rc = ItemDownloadDependencies(item);
@@ -2284,6 +2806,17 @@ static rc_t ItemProcess(Item *item, int32_t row) {
     return rc;
 }
 
+/* download an item resolved by ItemProcess(eRunTypeGetSize) */
+static rc_t ItemDownloadResolved(Item *item, int32_t row) {
+    rc_t rc = ItemDownload(item);
+
+    if (rc == 0) {
+        rc = ItemPostDownload(item, row);
+    }
+
+    return rc;
+}
+
 /*********** Iterator **********/
 static
 rc_t IteratorInit(Iterator *self, const char *obj, const Main *main)
@@ -2418,6 +2951,49 @@ static size_t _sizeFromString(const char *val) {
     return s;
 }
 
+/* parses a decimal count in 1..max, anything else is rejected */
+static bool _countFromString(const char *val, uint32_t max, uint32_t *count) {
+    char *end = NULL;
+    uint64_t c = 0;
+
+    assert(count);
+
+    if (val == NULL || *val < '0' || *val > '9') {
+        return false;
+    }
+
+    c = strtou64(val, &end, 10);
+    if (*end != '\0' || c == 0 || c > max) {
+        return false;
+    }
+
+    *count = (uint32_t)c;
+    return true;
+}
+
+/* parses a rate: digits with an optional suffix ( KB by default ), not 0 */
+static bool _rateFromString(const char *val, size_t *rate) {
+    const char *c = val;
+
+    assert(rate);
+
+    if (val == NULL || *val < '0' || *val > '9') {
+        return false;
+    }
+
+    while (*c >= '0' && *c <= '9') {
+        ++c;
+    }
+    if (*c != '\0') {
+        if (strchr("bBkKmMgG", *c) == NULL || c[1] != '\0') {
+            return false;
+        }
+    }
+
+    *rate = _sizeFromString(val);
+    return *rate > 0;
+}
+
 #define ASCP_OPTION "ascp-path"
 #define ASCP_ALIAS  "a"
 static const char* ASCP_USAGE[] =
@@ -2471,6 +3047,26 @@ static const char* HBEAT_USAGE[] = {
     "time period in minutes to display download progress",
     "(0: no progress), default: 1", NULL };
 
+#define CONN_OPTION "connections"
+#define CONN_ALIAS  NULL
+static const char* CONN_USAGE[] = {
+    "number of concurrent http connections for large files",
+    "(1: download sequentially), default: 4, at most 16.",
+    "every range is checked against its own digest; the MD5 of the whole",
+    "file is only reported (with -v), it is not compared to anything", NULL };
+
+#define JOBS_OPTION "jobs"
+#define JOBS_ALIAS  "j"
+static const char* JOBS_USAGE[] = {
+    "number of kart items and dependencies to download concurrently",
+    "default: 1, at most 64", NULL };
+
+#define RATE_OPTION "max-rate"
+#define RATE_ALIAS  NULL
+static const char* RATE_USAGE[] = {
+    "total http download rate limit in KB per second.",
+    "K, M or G suffixes are accepted, default: unlimited", NULL };
+
 #define ROWS_OPTION "rows"
 #define ROWS_ALIAS  "R"
 static const char* ROWS_USAGE[] =
@@ -2515,6 +3111,9 @@ static OptDef Options[] = {
    ,{ ASCP_OPTION     , ASCP_ALIAS     , NULL, ASCP_USAGE  , 1, true ,false }
    ,{ ASCP_PAR_OPTION , ASCP_PAR_ALIAS , NULL, ASCP_PAR_USAGE, 1, true ,false }
    ,{ HBEAT_OPTION    , HBEAT_ALIAS    , NULL, HBEAT_USAGE , 1, true, false }
+   ,{ CONN_OPTION     , CONN_ALIAS     , NULL, CONN_USAGE  , 1, true, false }
+   ,{ JOBS_OPTION     , JOBS_ALIAS     , NULL, JOBS_USAGE  , 1, true, false }
+   ,{ RATE_OPTION     , RATE_ALIAS     , NULL, RATE_USAGE  , 1, true, false }
    ,{ FAIL_ASCP_OPTION, FAIL_ASCP_ALIAS, NULL, FAIL_ASCP_USAGE, 1, false, false}
 #ifdef _DEBUGGING
    ,{ TEXTKART_OPTION , NULL           , NULL, TEXTKART_USAGE , 1, true , false}
@@ -2711,6 +3310,86 @@ static rc_t MainProcessArgs(Main *self, int argc, char *argv[]) {
             self->heartbeat = (uint64_t)f;
         }
 
+/* CONN_OPTION */
+        rc = ArgsOptionCount(self->args, CONN_OPTION, &pcount);
+        if (rc != 0) {
+            LOGERR(klogErr, rc, "Failure to get '" CONN_OPTION "' argument");
+            break;
+        }
+
+        if (pcount > 0) {
+            const char *val = NULL;
+            rc = ArgsOptionValue(self->args, CONN_OPTION, 0, &val);
+            if (rc != 0) {
+                LOGERR(klogErr, rc,
+                    "Failure to get '" CONN_OPTION "' argument value");
+                break;
+            }
+            if (!_countFromString(val, RANGES_MAX_CONNECTIONS,
+                &self->connections))
+            {
+                rc = RC(rcExe, rcArgv, rcParsing, rcParam, rcInvalid);
+                PLOGERR(klogErr, (klogErr, rc, "Number of connections '$(N)' "
+                    "is not a number from 1 to $(M)",
+                    "N=%s,M=%u", val, RANGES_MAX_CONNECTIONS));
+                break;
+            }
+        }
+
+/* JOBS_OPTION */
+        rc = ArgsOptionCount(self->args, JOBS_OPTION, &pcount);
+        if (rc != 0) {
+            LOGERR(klogErr, rc, "Failure to get '" JOBS_OPTION "' argument");
+            break;
+        }
+
+        if (pcount > 0) {
+            const char *val = NULL;
+            rc = ArgsOptionValue(self->args, JOBS_OPTION, 0, &val);
+            if (rc != 0) {
+                LOGERR(klogErr, rc,
+                    "Failure to get '" JOBS_OPTION "' argument value");
+                break;
+            }
+            if (!_countFromString(val, MAX_JOBS, &self->jobs)) {
+                rc = RC(rcExe, rcArgv, rcParsing, rcParam, rcInvalid);
+                PLOGERR(klogErr, (klogErr, rc, "Number of jobs '$(N)' "
+                    "is not a number from 1 to $(M)",
+                    "N=%s,M=%u", val, MAX_JOBS));
+                break;
+            }
+        }
+
+/* RATE_OPTION */
+        rc = ArgsOptionCount(self->args, RATE_OPTION, &pcount);
+        if (rc != 0) {
+            LOGERR(klogErr, rc, "Failure to get '" RATE_OPTION "' argument");
+            break;
+        }
+
+        if (pcount > 0) {
+            const char *val = NULL;
+            size_t rate = 0;
+            rc = ArgsOptionValue(self->args, RATE_OPTION, 0, &val);
+            if (rc != 0) {
+                LOGERR(klogErr, rc,
+                    "Failure to get '" RATE_OPTION "' argument value");
+                break;
+            }
+            if (!_rateFromString(val, &rate)) {
+                rc = RC(rcExe, rcArgv, rcParsing, rcParam, rcInvalid);
+                PLOGERR(klogErr, (klogErr, rc, "Download rate '$(R)' "
+                    "is not a number above 0 with an optional B, K, M or G suffix",
+                    "R=%s", val));
+                break;
+            }
+            rc = RateLimitMake(&self->rate, rate);
+            if (rc != 0) {
+                LOGERR(klogErr, rc, "Cannot limit download rate");
+                break;
+            }
+        }
+
 /* ORDR_OPTION */
         rc = ArgsOptionCount(self->args, ORDR_OPTION, &pcount);
         if (rc != 0) {
@@ -2901,6 +3580,7 @@ rc_t CC Usage(const Args *args) {
             }
             else if (strcmp(Options[i].aliases, FORCE_ALIAS) == 0 ||
                 strcmp(Options[i].aliases, HBEAT_ALIAS) == 0 ||
+                strcmp(Options[i].aliases, JOBS_ALIAS) == 0 ||
                 strcmp(Options[i].aliases, HBEAT_ALIAS) == 0 ||
                 strcmp(Options[i].aliases, ORDR_ALIAS) == 0 ||
                 strcmp(Options[i].aliases, TRASN_ALIAS) == 0)
@@ -2916,9 +3596,14 @@ rc_t CC Usage(const Args *args) {
                 param = "size";
             }
         }
-        else if (strcmp(Options[i].name, ASCP_PAR_OPTION) == 0) {
+        else if (strcmp(Options[i].name, ASCP_PAR_OPTION) == 0 ||
+            strcmp(Options[i].name, CONN_OPTION) == 0)
+        {
             param = "value";
         }
+        else if (strcmp(Options[i].name, RATE_OPTION) == 0) {
+            param = "size";
+        }
 #ifdef _DEBUGGING
         else if (strcmp(Options[i].name, TEXTKART_OPTION) == 0) {
             param = "value";
@@ -2970,16 +3655,22 @@ static int CC bstKrtSort(const BSTNode *item, const BSTNode *n) {
 }
 
 static void CC bstKrtDownload(BSTNode *n, void *data) {
-    rc_t rc = 0;
-
     const KartTreeNode *sn = (const KartTreeNode*) n;
     assert(sn && sn->i);
 
-    rc = ItemDownload(sn->i);
+    ItemDownloadResolved(sn->i, sn->i->number);
+}
 
-    if (rc == 0) {
-        rc = ItemPostDownload(sn->i, sn->i->number);
-    }
+static void CC bstKrtJob(BSTNode *n, void *data) {
+    const KartTreeNode *sn = (const KartTreeNode*) n;
+    Jobs *jobs = data;
+    Job *job = NULL;
+    assert(sn && sn->i && jobs);
+
+    job = &jobs->jobs[jobs->count++];
+    job->item = sn->i;
+    job->row = sn->i->number;
+    job->rc = 0;
 }
 
 /*********** Finalize Main object **********/
@@ -2998,6 +3689,13 @@ static rc_t MainFini(Main *self) {
     RELEASE(Args, self->args);
 
     BSTreeWhack(&self->downloaded, bstWhack, NULL);
+    BSTreeWhack(&self->refseqs, bstWhack, NULL);
+    RELEASE(KCondition, self->refseqDone);
+    BSTreeWhack(&self->downloading, bstWhack, NULL);
+    RELEASE(KCondition, self->downloadDone);
+    RELEASE(KLock, self->lock);
+    RELEASE(KLock, self->mgrLock);
+    RELEASE(RateLimit, self->rate);
 
     free(self->buffer);
 
@@ -3018,9 +3716,32 @@ static rc_t MainInit(int argc, char *argv[], Main *self) {
     memset(self, 0, sizeof *self);
 
     self->heartbeat = 60000;
+    self->connections = 4;
+    self->jobs = 1;
+    self->busy = 1; /* the main thread */
 /*  self->heartbeat = 69; */
 
     BSTreeInit(&self->downloaded);
+    BSTreeInit(&self->refseqs);
+    BSTreeInit(&self->downloading);
+
+    rc = KLockMake(&self->lock);
+    DISP_RC(rc, "KLockMake");
+
+    if (rc == 0) {
+        rc = KLockMake(&self->mgrLock);
+        DISP_RC(rc, "KLockMake");
+    }
+
+    if (rc == 0) {
+        rc = KConditionMake(&self->refseqDone);
+        DISP_RC(rc, "KConditionMake");
+    }
+
+    if (rc == 0) {
+        rc = KConditionMake(&self->downloadDone);
+        DISP_RC(rc, "KConditionMake");
+    }
 
     if (rc == 0) {
         rc = MainProcessArgs(self, argc, argv);
@@ -3091,11 +3812,55 @@ static rc_t MainInit(int argc, char *argv[], Main *self) {
 }
 
 /*********** Process one command line argument **********/
+/* after ItemProcess(): reports skipped items;
+   the ones to be downloaded by size are moved to trKrt */
+static rc_t MainItemProcessed(Main *self, Item **item, int64_t n,
+    ERunType type, size_t *total, BSTree *trKrt)
+{
+    assert(self && item && *item && total && trKrt);
+
+    if ((*item)->resolved.undersized && type == eRunTypeGetSize) {
+        STSMSG(STS_TOP,
+            ("%d) '%s' (%,zu KB) is smaller than minimum allowed: skipped\n",
+            n, (*item)->resolved.name, (*item)->resolved.remoteSz / 1024));
+    }
+    else if ((*item)->resolved.oversized && type == eRunTypeGetSize) {
+        STSMSG(STS_TOP,
+            ("%d) '%s' (%,zu KB) is larger than maximum allowed: skipped\n",
+            n, (*item)->resolved.name, (*item)->resolved.remoteSz / 1024));
+    }
+    else {
+        *total += (*item)->resolved.remoteSz;
+
+        if (type == eRunTypeGetSize) {
+            KartTreeNode *sn = calloc(1, sizeof *sn);
+            if (sn == NULL) {
+                return RC(rcExe, rcStorage,
+                    rcAllocating, rcMemory, rcExhausted);
+            }
+            if ((*item)->resolved.remoteSz == 0) {
+                /* remoteSz is unknown:
+                   add it to the end of download list preserving kart order */
+                (*item)->resolved.remoteSz = (~0ul >> 1) + n + 1;
+            }
+            sn->i = *item;
+            *item = NULL;
+            BSTreeInsert(trKrt, (BSTNode*)sn, bstKrtSort);
+        }
+    }
+
+    return 0;
+}
+
 static rc_t MainRun(Main *self, const char *arg, const char *realArg) {
     ERunType type = eRunTypeDownload;
     static bool maxSzPrntd = false;
     rc_t rc = 0;
     Iterator it;
+    Job *jobs = NULL; /* kart items to be processed concurrently */
+    uint32_t nJobs = 0;
+    uint32_t maxJobs = 0;
+    bool concurrent = false;
     assert(self && realArg);
     memset(&it, 0, sizeof it);
 
@@ -3118,6 +3883,11 @@ static rc_t MainRun(Main *self, const char *arg, const char *realArg) {
         type = eRunTypeDownload;
     }
 
+    concurrent = self->jobs > 1 && it.kart != NULL && type != eRunTypeList;
+    if (concurrent) {
+        MainUseAscp(self); /* before items are resolved concurrently */
+    }
+
     if (rc == 0) {
         BSTree trKrt;
         BSTreeInit(&trKrt);
@@ -3197,6 +3967,28 @@ static rc_t MainRun(Main *self, const char *arg, const char *realArg) {
                     item->main = self;
                     ResolvedReset(&item->resolved, type);
 
+                    if (concurrent) {
+                        /* processed when the whole kart is read */
+                        if (nJobs == maxJobs) {
+                            uint32_t max = maxJobs == 0 ? 64 : maxJobs * 2;
+                            Job *tmp = realloc(jobs, max * sizeof *jobs);
+                            if (tmp == NULL) {
+                                rc = RC(rcExe, rcStorage,
+                                    rcAllocating, rcMemory, rcExhausted);
+                                RELEASE(Item, item);
+                                break;
+                            }
+                            jobs = tmp;
+                            maxJobs = max;
+                        }
+                        jobs[nJobs].item = item;
+                        jobs[nJobs].row = (int32_t)n;
+                        jobs[nJobs].rc = 0;
+                        ++nJobs;
+                        item = NULL;
+                        continue;
+                    }
+
                     rc3 = ItemProcess(item, (int32_t)n);
                     if (rc3 != 0) {
                         if (rc == 0) {
@@ -3204,42 +3996,10 @@ static rc_t MainRun(Main *self, const char *arg, const char *realArg) {
                         }
                     }
                     else {
-                        if (item->resolved.undersized &&
-                            type == eRunTypeGetSize)
-                        {
-                            STSMSG(STS_TOP,
-               ("%d) '%s' (%,zu KB) is smaller than minimum allowed: skipped\n",
-                n, item->resolved.name, item->resolved.remoteSz / 1024));
-                        }
-                        else if (item->resolved.oversized &&
-                             type == eRunTypeGetSize)
-                        {
-                            STSMSG(STS_TOP,
-                ("%d) '%s' (%,zu KB) is larger than maximum allowed: skipped\n",
-                n, item->resolved.name, item->resolved.remoteSz / 1024));
-                        }
-                        else {
-                            total += item->resolved.remoteSz;
-
-                            if (item != NULL) {
-                                if (type == eRunTypeGetSize) {
-                                    KartTreeNode *sn = calloc(1, sizeof *sn);
-                                    if (sn == NULL) {
-                                        return RC(rcExe, rcStorage,
-                                           rcAllocating, rcMemory, rcExhausted);
-                                    }
-                                    if (item->resolved.remoteSz == 0) {
-                                        /* remoteSz is unknown:
-                     add it to the end of download list preserving kart order */
-                                        item->resolved.remoteSz
-                                            = (~0ul >> 1) + n + 1;
-                                    }
-                                    sn->i = item;
-                                    item = NULL;
-                                    BSTreeInsert(&trKrt, (BSTNode*)sn,
-                                        bstKrtSort);
-                                }
-                            }
+                        rc3 = MainItemProcessed(self, &item, n, type,
+                            &total, &trKrt);
+                        if (rc3 != 0) {
+                            return rc3;
                         }
                     }
                 }
@@ -3247,6 +4007,32 @@ static rc_t MainRun(Main *self, const char *arg, const char *realArg) {
                 RELEASE(Item, item);
             }
 
+            if (nJobs > 0) {
+                uint32_t i = 0;
+                rc_t rcq = 0;
+                Jobs j;
+
+                JobsInit(&j, self, jobs, nJobs, ItemProcess, false);
+                JobsRun(&j);
+
+                rcq = Quitting();
+                if (rcq != 0 && rc == 0) {
+                    rc = rcq;
+                }
+
+                for (i = 0; i < nJobs; ++i) {
+                    rc_t rc3 = jobs[i].rc;
+                    if (rc3 == 0 && rcq == 0) {
+                        rc3 = MainItemProcessed(self, &jobs[i].item,
+                            jobs[i].row, type, &total, &trKrt);
+                    }
+                    if (rc3 != 0 && rc == 0) {
+                        rc = rc3;
+                    }
+                    RELEASE(Item, jobs[i].item);
+                }
+            }
+
             if (type == eRunTypeList) {
                 if (it.kart != NULL && total > 0) {
                     OUTMSG(("--------------------\ntotal\t%,zuB\n\n", total));
@@ -3254,7 +4040,15 @@ static rc_t MainRun(Main *self, const char *arg, const char *realArg) {
             }
             else if (type == eRunTypeGetSize) {
                 OUTMSG(("\nDownloading the files...\n\n", realArg));
-                BSTreeForEach(&trKrt, false, bstKrtDownload, NULL);
+                if (concurrent && nJobs > 0) {
+                    Jobs j;
+                    JobsInit(&j, self, jobs, 0, ItemDownloadResolved, false);
+                    BSTreeForEach(&trKrt, false, bstKrtJob, &j);
+                    JobsRun(&j);
+                }
+                else {
+                    BSTreeForEach(&trKrt, false, bstKrtDownload, NULL);
+                }
             }
         }
         BSTreeWhack(&trKrt, bstKrtWhack, NULL);
@@ -3277,6 +4071,8 @@ static rc_t MainRun(Main *self, const char *arg, const char *realArg) {
     }
     IteratorFini(&it);
 
+    free(jobs);
+
     return rc;
 }
 
@@ -0,0 +1,116 @@
+/*==============================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "rate-limit.h"
+
+#include <kproc/lock.h> /* KLock */
+
+#include <klib/rc.h>
+#include <klib/time.h> /* KTimeMsStamp */
+
+#include <sysalloc.h>
+
+#include <assert.h>
+#include <stdlib.h> /* calloc */
+
+struct RateLimit {
+    KLock *lock;
+    uint64_t rate; /* bytes per second */
+    KTimeMs_t next; /* when the bandwidth taken so far is used up */
+    uint64_t remainder; /* of bytes * 1000 / rate, carried over to the next call */
+};
+
+rc_t RateLimitMake(RateLimit **self, uint64_t bytesPerSecond) {
+    rc_t rc = 0;
+    RateLimit *p = NULL;
+
+    assert(self && bytesPerSecond > 0);
+
+    *self = NULL;
+
+    p = calloc(1, sizeof *p);
+    if (p == NULL) {
+        return RC(rcExe, rcData, rcAllocating, rcMemory, rcExhausted);
+    }
+
+    rc = KLockMake(&p->lock);
+    if (rc != 0) {
+        free(p);
+        return rc;
+    }
+
+    p->rate = bytesPerSecond;
+    *self = p;
+
+    return rc;
+}
+
+rc_t RateLimitRelease(RateLimit *self) {
+    rc_t rc = 0;
+
+    if (self != NULL) {
+        rc = KLockRelease(self->lock);
+        free(self);
+    }
+
+    return rc;
+}
+
+rc_t RateLimitTake(RateLimit *self, uint64_t bytes) {
+    rc_t rc = 0;
+    KTimeMs_t now = 0;
+    KTimeMs_t wait = 0;
+    uint64_t taken = 0;
+
+    if (self == NULL || bytes == 0) {
+        return 0;
+    }
+
+    rc = KLockAcquire(self->lock);
+    if (rc != 0) {
+        return rc;
+    }
+
+    /* unused bandwidth is not saved up for later bursts */
+    now = KTimeMsStamp();
+    if (self->next < now) {
+        self->next = now;
+    }
+    wait = self->next - now;
+
+    /* small reads would add 0 ms each without the remainder */
+    taken = bytes * 1000 + self->remainder;
+    self->next += taken / self->rate;
+    self->remainder = taken % self->rate;
+
+    KLockUnlock(self->lock);
+
+    if (wait > 0) {
+        rc = KSleepMs((uint32_t)wait);
+    }
+
+    return rc;
+}
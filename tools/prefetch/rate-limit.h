@@ -0,0 +1,61 @@
+/*==============================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_prefetch_rate_limit_
+#define _h_prefetch_rate_limit_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* RateLimit
+ *  a bandwidth cap shared by all concurrent downloads
+ */
+typedef struct RateLimit RateLimit;
+
+/* Make
+ *  "bytesPerSecond" is the total download rate allowed
+ */
+rc_t RateLimitMake ( RateLimit **self, uint64_t bytesPerSecond );
+
+rc_t RateLimitRelease ( RateLimit *self );
+
+/* Take
+ *  account for "bytes" just received:
+ *  sleeps while the downloads are ahead of the allowed rate.
+ *  a NULL self is no limit at all
+ */
+rc_t RateLimitTake ( RateLimit *self, uint64_t bytes );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_prefetch_rate_limit_ */
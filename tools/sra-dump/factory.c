@@ -25,6 +25,8 @@
 */
 #include <klib/log.h>
 #include <klib/out.h>
+#include <klib/printf.h>
+#include <klib/text.h>
 #include <klib/container.h>
 #include <kfs/directory.h>
 #include <kfs/buffile.h>
@@ -45,6 +47,9 @@
 #define DUMPER_MAX_KEY_LENGTH 63
 #define DUMPER_MAX_TREE_DEPTH 100
 #define DUMPER_MAX_OPEN_FILES 100
+#define DUMPER_MAX_REJECTED_LENGTH 127
+/* joins keys of the splitters leading to a splitter, sorts before any key character */
+#define DUMPER_PATH_SEPARATOR '\x01'
 
 #define OUTPUT_BUFFER_SIZE ( 128 * 1024 )
 
@@ -63,9 +68,31 @@ typedef struct SRASplitterFile_struct {
     /* keep track of number of spots written to file */
     spotid_t curr_spot;
     uint64_t spot_qty;
+    /* capture only: path keys (w/o prefix) to find real file on replay and real file once found */
+    char* path_keys;
+    int path_qty;
+    struct SRASplitterFile_struct* real;
 } SRASplitterFile;
 
-typedef struct SRASplitterFiler_struct {
+/* capture journal record, data padded to JOURNAL_ALIGN follows */
+typedef struct SRASplitterJournal_struct {
+    SRASplitterFile* file;
+    spotid_t spot;
+    uint64_t size;
+} SRASplitterJournal;
+
+#define JOURNAL_ALIGN 8
+#define JOURNAL_PAD(sz) (((sz) + JOURNAL_ALIGN - 1) & ~((uint64_t)JOURNAL_ALIGN - 1))
+#define JOURNAL_INIT_SIZE ( 1024 * 1024 )
+
+/* rejection count of one splitter of the tree, a worker's tree has the same one under the same path */
+typedef struct SRASplitterRejected_struct {
+    char* path;
+    uint64_t qty;
+    char what[DUMPER_MAX_REJECTED_LENGTH + 1];
+} SRASplitterRejected;
+
+struct SRASplitterFiler_struct {
     /* TBD - reorder structure to avoid premature ageing of compiler and CPU */
     char* prefix;
     KFile* kf_stdout;
@@ -89,7 +116,18 @@ typedef struct SRASplitterFiler_struct {
     /* keep track of number of spots written to file */
     spotid_t curr_spot;
     uint64_t spot_qty;
-} SRASplitterFiler;
+
+    /* capture only: journal of writes and offset of last record in it */
+    bool capture;
+    KDataBuffer journal;
+    uint64_t journal_sz;
+    uint64_t journal_last;
+
+    /* rejection counts of released splitters of a capture, merged ones in global filer, sorted by path */
+    uint32_t rejected_qty;
+    uint32_t rejected_max;
+    SRASplitterRejected* rejected;
+};
 
 SRASplitterFiler* g_filer = NULL;
 
@@ -122,6 +160,16 @@ void CC SRASplitterFiler_WhackFile( SLNode *node, void *data )
     free(file);
 }
 
+static
+void CC SRASplitterFiler_WhackCaptureFile( SLNode *node, void *data )
+{
+    SRASplitterFile* file = (SRASplitterFile*)node;
+
+    free(file->key);
+    free(file->path_keys);
+    free(file);
+}
+
 static
 void CC SRASplitterFiler_StatFile( SLNode *node, void *data )
 {
@@ -133,12 +181,27 @@ void CC SRASplitterFiler_StatFile( SLNode *node, void *data )
     }
 }
 
+static
+void SRASplitterFiler_WhackRejected(SRASplitterFiler* self)
+{
+    uint32_t i;
+
+    for( i = 0; i < self->rejected_qty; i++ ) {
+        free(self->rejected[i].path);
+    }
+    free(self->rejected);
+    self->rejected = NULL;
+    self->rejected_qty = 0;
+    self->rejected_max = 0;
+}
+
 void SRASplitterFiler_Release(void)
 {
     if( g_filer != NULL ) {
         SLListWhack(&g_filer->files, SRASplitterFiler_WhackFile, &g_filer->keep_empty);
         KFileRelease(g_filer->kf_stdout);
         KDirectoryRelease(g_filer->dir);
+        SRASplitterFiler_WhackRejected(g_filer);
         free(g_filer->prefix);
         free(g_filer);
         g_filer = NULL;
@@ -158,78 +221,80 @@ void SRASplitterFactory_FilerReport(uint64_t* total, uint64_t* biggest_file)
 }
 
 static
-rc_t SRASplitterFiler_PushKey(const char* key)
+rc_t SRASplitterFiler_PushKey(SRASplitterFiler* self, const char* key)
 {
-    if( g_filer == NULL || key == NULL ) {
+    if( self == NULL || key == NULL ) {
         return RC(rcExe, rcFile, rcAttaching, rcParam, rcNull);
     }
-    if( g_filer->path_tail == sizeof(g_filer->path) - 1 ) {
+    if( self->path_tail == sizeof(self->path) - 1 ) {
         return RC(rcExe, rcFile, rcAttaching, rcDirEntry, rcTooLong);
     }
-    if( g_filer->key_as_dir ) {
+    if( self->key_as_dir ) {
         /* skip initial non-letters */
         while( !isalnum(*key) && *key != '\0' ) {
             ++key;
         }
     }
-    g_filer->path[g_filer->path_tail++] = key;
-    g_filer->path_len += strlen(key) + 1;
+    self->path[self->path_tail++] = key;
+    self->path_len += strlen(key) + 1;
     return 0;
 }
 
 static
-rc_t SRASplitterFiler_PopKey(void)
+rc_t SRASplitterFiler_PopKey(SRASplitterFiler* self)
 {
-    if( g_filer->path_tail == 0 ) {
+    if( self->path_tail == 0 ) {
         return RC(rcExe, rcFile, rcDetaching, rcDirEntry, rcTooShort);
     }
-    g_filer->path_len -= strlen(g_filer->path[--g_filer->path_tail]) + 1;
+    self->path_len -= strlen(self->path[--self->path_tail]) + 1;
     return 0;
 }
 
 static
-rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
+rc_t SRASplitterFiler_OpenFile(SRASplitterFiler* self, SRASplitterFile* file, bool initial)
 {
     rc_t rc = 0;
 
     if( file == NULL || (initial && file->file != NULL) ) {
         rc = RC(rcExe, rcFile, rcOpening, rcParam, rcInvalid);
+    } else if( self->capture ) {
+        /* nothing to open, data goes to journal */
     } else if( initial || file->file == NULL ) {
         int i, vacancy = -1;
         time_t oldest = 0;
 
         for(i = 0; i < DUMPER_MAX_OPEN_FILES; i++) {
-            if(g_filer->open[i] == NULL ) {
+            if(self->open[i] == NULL ) {
                 vacancy = i;
                 break;
             }
-            if(g_filer->open[i]->opened < oldest || oldest == 0 ) {
-                oldest = g_filer->open[i]->opened;
+            if(self->open[i]->opened < oldest || oldest == 0 ) {
+                oldest = self->open[i]->opened;
                 vacancy = i;
             }
         }
-        if( g_filer->open[vacancy] != NULL ) {
+        if( self->open[vacancy] != NULL ) {
             SRA_DUMP_DBG(5, ("Close file[%i]: %lu '%s%s'\n", vacancy,
-                g_filer->open[vacancy]->opened, g_filer->open[vacancy]->key, g_filer->arc_extension));
-            KFileRelease(g_filer->open[vacancy]->file);
-            g_filer->open[vacancy]->file = NULL;
-            g_filer->open[vacancy] = NULL;
+                self->open[vacancy]->opened, self->open[vacancy]->key, self->arc_extension));
+            KFileRelease(self->open[vacancy]->file);
+            self->open[vacancy]->file = NULL;
+            self->open[vacancy] = NULL;
         }
-        if( g_filer->kf_stdout ) {
+        if( self->kf_stdout ) {
             SRA_DUMP_DBG(5, ("attach to pre-opened stdout: '%s'\n", file->key));
-            rc = KFileAddRef(g_filer->kf_stdout);
-            file->file = g_filer->kf_stdout;
+            rc = KFileAddRef(self->kf_stdout);
+            file->file = self->kf_stdout;
         } else if( initial ) {
-            SRA_DUMP_DBG(5, ("Create file: '%s%s'\n", file->key, g_filer->arc_extension));
+            SRA_DUMP_DBG(5, ("Create file: '%s%s'\n", file->key, self->arc_extension));
             if( (rc = KDirectoryCreateFile(file->dir, &file->file, false, 0664, kcmInit,
-                                           "%s%s", file->name, g_filer->arc_extension)) == 0 ) {
-                if( g_filer->do_gzip ) {
+                                           "%s%s", file->name, self->arc_extension)) == 0 ) {
+                if( self->do_gzip ) {
                     KFile* gz;
                     if( (rc = KFileMakeGzipForWrite(&gz, file->file)) == 0 ) {
                         KFileRelease(file->file);
                         file->file = gz;
                     }
-                } else if( g_filer->do_bzip2 ) {
+                } else if( self->do_bzip2 ) {
                     KFile* bz;
                     if( (rc = KFileMakeBzip2ForWrite(&bz, file->file)) == 0 ) {
                         KFileRelease(file->file);
@@ -238,23 +303,23 @@ rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
                 }
             }
         } else if( file->file == NULL ) {
-            SRA_DUMP_DBG(5, ("Reopen file: '%s%s'\n", file->key, g_filer->arc_extension));
+            SRA_DUMP_DBG(5, ("Reopen file: '%s%s'\n", file->key, self->arc_extension));
             /* position is rememebered since last time */
             if( (rc = KDirectoryOpenFileWrite(file->dir, &file->file, false,
-                                              "%s%s", file->name, g_filer->arc_extension)) == 0 ) {
+                                              "%s%s", file->name, self->arc_extension)) == 0 ) {
 #if ! SUPPORT_MULTI_SESSION_GZIP_FILES
-                if( g_filer->do_gzip || g_filer->do_bzip2 ) {
+                if( self->do_gzip || self->do_bzip2 ) {
                     /* compressed files cannot (currently) be re-opened until we support multi-session compression */
                     rc = RC(rcExe, rcFile, rcOpening, rcConstraint, rcViolated);
                 }
 #else
-                if( g_filer->do_gzip ) {
+                if( self->do_gzip ) {
                     KFile* gz;
                     if( (rc = KFileMakeGzipForAppend(&gz, file->file)) == 0 ) {
                         KFileRelease(file->file);
                         file->file = gz;
                     }
-                } else if( g_filer->do_bzip2 ) {
+                } else if( self->do_bzip2 ) {
                     KFile* bz;
                     if( (rc = KFileMakeBzip2ForWrite(&bz, file->file)) == 0 ) {
                         KFileRelease(file->file);
@@ -265,7 +330,7 @@ rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
             }
         }
 #if OUTPUT_BUFFER_SIZE
-        if( rc == 0 && !g_filer->kf_stdout ) {
+        if( rc == 0 && !self->kf_stdout ) {
             /* attach buffer */
             KFile *buf = NULL;
             if( (rc = KBufFileMakeWrite(&buf, file->file, false, OUTPUT_BUFFER_SIZE)) == 0 ) {
@@ -275,7 +340,7 @@ rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
 #if _DEBUGGING
                 /* we only want to see this in debug */
                 PLOGERR(klogErr, (klogErr, rc, "creating buffer for file '$(s)$(e)'",
-                    PLOG_2(PLOG_S(s),PLOG_S(e)), file->key, g_filer->arc_extension));
+                    PLOG_2(PLOG_S(s),PLOG_S(e)), file->key, self->arc_extension));
 #else
                 rc = 0;
 #endif
@@ -283,23 +348,102 @@ rc_t SRASplitterFiler_OpenFile(SRASplitterFile* file, bool initial)
         }
 #endif
         if( rc == 0 ) {
-            g_filer->open[vacancy] = file;
+            self->open[vacancy] = file;
             file->opened = time(NULL);
             SRA_DUMP_DBG(5, ("Opened file[%i]: %lu '%s%s'\n",
-                vacancy, file->opened, file->key, g_filer->arc_extension));
+                vacancy, file->opened, file->key, self->arc_extension));
         }
     }
     return rc;
 }
 
+static
+rc_t SRASplitterFiler_CapturePath(SRASplitterFiler* self, SRASplitterFile* file)
+{
+    /* remember path below prefix as sequence of zero terminated keys */
+    int i;
+    size_t sz = 0;
+    char* p;
+
+    for(i = 1; i < self->path_tail; i++ ) {
+        sz += strlen(self->path[i]) + 1;
+    }
+    if( (file->path_keys = malloc(sz + 1)) == NULL ) {
+        return RC(rcExe, rcFile, rcResolving, rcMemory, rcExhausted);
+    }
+    for(p = file->path_keys, i = 1; i < self->path_tail; i++ ) {
+        size_t l = strlen(self->path[i]) + 1;
+        memcpy(p, self->path[i], l);
+        p += l;
+    }
+    file->path_qty = self->path_tail - 1;
+    return 0;
+}
+
+static
+rc_t SRASplitterFiler_Journal(SRASplitterFiler* self, SRASplitterFile* file, spotid_t spot, const void* buf, size_t size)
+{
+    rc_t rc = 0;
+    SRASplitterJournal* j = NULL;
+    uint64_t need, offset;
+
+    if( self->journal_sz > 0 ) {
+        j = (SRASplitterJournal*)&((uint8_t*)self->journal.base)[self->journal_last];
+        if( j->file != file || j->spot != spot ) {
+            j = NULL;
+        }
+    }
+    if( j != NULL ) {
+        /* same file and spot as last write: append to last record */
+        offset = self->journal_last + sizeof(*j) + j->size;
+        need = self->journal_last + sizeof(*j) + JOURNAL_PAD(j->size + size);
+    } else {
+        offset = self->journal_sz + sizeof(*j);
+        need = offset + JOURNAL_PAD(size);
+    }
+    if( need > KDataBufferBytes(&self->journal) ) {
+        uint64_t cap = KDataBufferBytes(&self->journal);
+        if( cap < JOURNAL_INIT_SIZE ) {
+            cap = JOURNAL_INIT_SIZE;
+        }
+        while( cap < need ) {
+            cap *= 2;
+        }
+        if( (rc = KDataBufferResize(&self->journal, cap)) != 0 ) {
+            return rc;
+        }
+    }
+    if( j == NULL ) {
+        self->journal_last = self->journal_sz;
+        j = (SRASplitterJournal*)&((uint8_t*)self->journal.base)[self->journal_last];
+        j->file = file;
+        j->spot = spot;
+        j->size = 0;
+    } else {
+        /* buffer could have moved */
+        j = (SRASplitterJournal*)&((uint8_t*)self->journal.base)[self->journal_last];
+    }
+    if( size > 0 ) {
+        memcpy(&((uint8_t*)self->journal.base)[offset], buf, size);
+        j->size += size;
+    }
+    self->journal_sz = need;
+    return rc;
+}
+
+typedef struct SRASplitterFiler_FindData_struct {
+    const char* key;
+    SRASplitterFile* file;
+} SRASplitterFiler_FindData;
+
 static
 bool CC SRASplitterFiler_GetCurrFile_FindByKey( SLNode *node, void *data )
 {
-    SRASplitterFile** d = (SRASplitterFile**)data;
+    SRASplitterFiler_FindData* d = (SRASplitterFiler_FindData*)data;
     SRASplitterFile* file = (SRASplitterFile*)node;
 
-    if( strcmp(file->key, g_filer->key_buf) == 0 ) {
-        *d = file;
+    if( strcmp(file->key, d->key) == 0 ) {
+        d->file = file;
         return true;
     }
     return false;
@@ -326,16 +470,17 @@ rc_t SRASplitterFiler_FixFSName(const char* name, char** fname)
 }
 
 static
-rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
+rc_t SRASplitterFiler_GetCurrFile(SRASplitterFiler* self, const SRASplitterFile** out_file)
 {
     rc_t rc = 0;
     int i;
-    char* key = g_filer->key_buf; /* shortcut */
+    char* key = self->key_buf; /* shortcut */
     SRASplitterFile* file = NULL;
+    SRASplitterFiler_FindData found;
 
     if( out_file == NULL ) {
         return RC(rcExe, rcFile, rcOpening, rcParam, rcInvalid);
-    } else if( g_filer->kf_stdout ) {
+    } else if( self->kf_stdout ) {
         strcpy(key, "stdout");
     } else {
         /* prepare the key
@@ -343,24 +488,29 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
            otherwise key will be prefix_path[i](_path[i+1]..)_?suffix
          */
         key[0] = '\0';
-        for(i = 0; i < g_filer->path_tail; i++ ) {
-            if( g_filer->path[i][0] == '\0' ) {
+        for(i = 0; i < self->path_tail; i++ ) {
+            if( self->path[i][0] == '\0' ) {
                 continue;
             }
-            if( g_filer->key_as_dir ) {
+            if( self->key_as_dir ) {
                 if( i != 0 ) {
                     strcat(key, "/");
                 }
-                strcat(key, g_filer->path[i]);
+                strcat(key, self->path[i]);
             } else {
-                if( i != 0 && isalnum(g_filer->path[i][0]) ) {
+                if( i != 0 && isalnum(self->path[i][0]) ) {
                     strcat(key, "_");
                 }
-                strcat(key, g_filer->path[i]);
+                strcat(key, self->path[i]);
             }
         }
     }
-    if( !SLListDoUntil( &g_filer->files, SRASplitterFiler_GetCurrFile_FindByKey, &file ) ) {
+    found.key = key;
+    found.file = NULL;
+    if( SLListDoUntil( &self->files, SRASplitterFiler_GetCurrFile_FindByKey, &found ) ) {
+        file = found.file;
+    }
+    if( file == NULL ) {
         SRA_DUMP_DBG(5, ("New file: '%s'\n", key));
         file = calloc(1, sizeof(*file));
         key = strdup(key);
@@ -368,14 +518,23 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
             free(file);
             free(key);
             rc = RC(rcExe, rcFile, rcResolving, rcMemory, rcExhausted);
+        } else if( self->capture ) {
+            file->key = key;
+            if( (rc = SRASplitterFiler_CapturePath(self, file)) == 0 ) {
+                SLListPushTail(&self->files, &file->dad);
+                /* empty record makes replay create the file at the same moment */
+                rc = SRASplitterFiler_Journal(self, file, 0, NULL, 0);
+            } else {
+                SRASplitterFiler_WhackCaptureFile(&file->dad, NULL);
+            }
         } else {
             file->key = key;
-            if( g_filer->key_as_dir ) {
-                KDirectory* sub = g_filer->dir;
-                for(i = 0; rc == 0 && i < (g_filer->path_tail - 1); i++ ) {
-                    if( g_filer->path[i][0] != '\0' ) {
+            if( self->key_as_dir ) {
+                KDirectory* sub = self->dir;
+                for(i = 0; rc == 0 && i < (self->path_tail - 1); i++ ) {
+                    if( self->path[i][0] != '\0' ) {
                         char* ndir = NULL;
-                        if( (rc = SRASplitterFiler_FixFSName(g_filer->path[i], &ndir)) == 0 ) {
+                        if( (rc = SRASplitterFiler_FixFSName(self->path[i], &ndir)) == 0 ) {
                             if( (rc = KDirectoryCreateDir(sub, 0775, kcmCreate, "%s", ndir)) == 0 ||
                                 (GetRCObject(rc) == ( enum RCObject )rcDirectory && GetRCState(rc) == rcExists) ) {
                                 if( (rc = KDirectoryOpenDirUpdate(sub, &file->dir, true, "%s", ndir)) == 0 ) {
@@ -387,20 +546,20 @@ rc_t SRASplitterFiler_GetCurrFile(const SRASplitterFile** out_file)
                         }
                     }
                 }
-                rc = SRASplitterFiler_FixFSName(&file->key[strlen(file->key) - strlen(g_filer->path[g_filer->path_tail - 1])], &file->name);
+                rc = SRASplitterFiler_FixFSName(&file->key[strlen(file->key) - strlen(self->path[self->path_tail - 1])], &file->name);
             } else {
-                file->dir = g_filer->dir;
+                file->dir = self->dir;
                 rc = SRASplitterFiler_FixFSName(file->key, &file->name);
             }
-            if( rc == 0 && (rc = SRASplitterFiler_OpenFile(file, true)) == 0 ) {
-                SLListPushTail(&g_filer->files, &file->dad);
+            if( rc == 0 && (rc = SRASplitterFiler_OpenFile(self, file, true)) == 0 ) {
+                SLListPushTail(&self->files, &file->dad);
             } else {
-                SRASplitterFiler_WhackFile(&file->dad, &g_filer->keep_empty);
+                SRASplitterFiler_WhackFile(&file->dad, &self->keep_empty);
             }
         }
     } else {
         SRA_DUMP_DBG(5, ("Curr file key '%s': '%s'\n", key, file->name));
-        rc = SRASplitterFiler_OpenFile(file, false);
+        rc = SRASplitterFiler_OpenFile(self, file, false);
     }
     *out_file = rc ? NULL : file;
     return rc;
@@ -413,13 +572,13 @@ rc_t SRASplitterFactory_FilerPrefix(const char* prefix)
     if( g_filer == NULL ) {
         rc = RC(rcExe, rcFile, rcUpdating, rcSelf, rcNotOpen);
     } else if( prefix == NULL || strcmp(prefix, g_filer->prefix) != 0 ) {
-        if( (rc = SRASplitterFiler_PopKey()) == 0 ) {
+        if( (rc = SRASplitterFiler_PopKey(g_filer)) == 0 ) {
             free(g_filer->prefix);
             g_filer->prefix = strdup(prefix ? prefix : "");
             if( g_filer->prefix == NULL ) {
                 rc = RC(rcExe, rcFile, rcConstructing, rcMemory, rcExhausted);
             } else {
-                rc = SRASplitterFiler_PushKey(g_filer->prefix);
+                rc = SRASplitterFiler_PushKey(g_filer, g_filer->prefix);
             }
         }
     }
@@ -445,7 +604,7 @@ rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool ke
         SLListInit(&g_filer->files);
         /* push empty prefix */
         g_filer->prefix = strdup("");
-        if( (rc = SRASplitterFiler_PushKey(g_filer->prefix)) == 0 &&
+        if( (rc = SRASplitterFiler_PushKey(g_filer, g_filer->prefix)) == 0 &&
             (rc = KDirectoryNativeDir(&g_filer->dir)) == 0 ) {
             if( to_stdout ) {
                 if( (rc = KFileMakeStdOut(&g_filer->kf_stdout)) == 0 ) {
@@ -497,12 +656,200 @@ rc_t SRASplitterFactory_FilerInit(bool to_stdout, bool gzip, bool bzip2, bool ke
         }
     }
     if( rc != 0 ) {
-        SRASplitterFiler_PopKey();
+        if( g_filer != NULL ) {
+            SRASplitterFiler_PopKey(g_filer);
+        }
         SRASplitterFiler_Release();
     }
     return rc;
 }
 
+rc_t SRASplitterFiler_MakeCapture(SRASplitterFiler** self)
+{
+    rc_t rc = 0;
+    SRASplitterFiler* obj = NULL;
+
+    if( self == NULL ) {
+        rc = RC(rcExe, rcFile, rcConstructing, rcParam, rcNull);
+    } else if( g_filer == NULL ) {
+        rc = RC(rcExe, rcFile, rcConstructing, rcSelf, rcNotOpen);
+    } else if( (obj = calloc(1, sizeof(*obj))) == NULL ) {
+        rc = RC(rcExe, rcFile, rcConstructing, rcMemory, rcExhausted);
+    } else {
+        obj->capture = true;
+        /* key must be built same way as in real filer */
+        obj->key_as_dir = g_filer->key_as_dir;
+        obj->arc_extension = g_filer->arc_extension;
+        SLListInit(&obj->files);
+        /* stands for prefix, which is not recorded */
+        if( (rc = SRASplitterFiler_PushKey(obj, "")) == 0 &&
+            (rc = KDataBufferMakeBytes(&obj->journal, 0)) == 0 ) {
+            *self = obj;
+        } else {
+            free(obj);
+        }
+    }
+    return rc;
+}
+
+void SRASplitterFiler_ReleaseCapture(SRASplitterFiler* self)
+{
+    if( self != NULL && self->capture ) {
+        SRASplitterFiler_WhackRejected(self);
+        SLListWhack(&self->files, SRASplitterFiler_WhackCaptureFile, NULL);
+        KDataBufferWhack(&self->journal);
+        free(self);
+    }
+}
+
+rc_t SRASplitterFiler_TakeCapture(SRASplitterFiler* self, KDataBuffer* journal)
+{
+    rc_t rc = 0;
+
+    if( self == NULL || journal == NULL ) {
+        rc = RC(rcExe, rcFile, rcReading, rcParam, rcNull);
+    } else if( !self->capture ) {
+        rc = RC(rcExe, rcFile, rcReading, rcSelf, rcInvalid);
+    } else if( (rc = KDataBufferResize(&self->journal, self->journal_sz)) == 0 ) {
+        *journal = self->journal;
+        self->journal_sz = 0;
+        self->journal_last = 0;
+        rc = KDataBufferMakeBytes(&self->journal, 0);
+    }
+    return rc;
+}
+
+static
+rc_t SRASplitterFiler_ReplayFindFile(SRASplitterFile* file)
+{
+    /* find or create real file using same keys path */
+    rc_t rc = 0, rc2;
+    int i, pushed = 0;
+    const char* key = file->path_keys;
+    const SRASplitterFile* real = NULL;
+
+    for(i = 0; rc == 0 && i < file->path_qty; i++ ) {
+        if( (rc = SRASplitterFiler_PushKey(g_filer, key)) == 0 ) {
+            pushed++;
+            key += strlen(key) + 1;
+        }
+    }
+    if( rc == 0 && (rc = SRASplitterFiler_GetCurrFile(g_filer, &real)) == 0 ) {
+        file->real = (SRASplitterFile*)real;
+    }
+    while( pushed-- > 0 ) {
+        rc2 = SRASplitterFiler_PopKey(g_filer);
+        rc = rc ? rc : rc2;
+    }
+    return rc;
+}
+
+static rc_t SRASplitterFiler_Write( SRASplitterFiler* self, SRASplitterFile* f,
+                                    spotid_t spot, const void* buf, size_t size );
+
+rc_t SRASplitterFiler_Replay(const KDataBuffer* journal)
+{
+    rc_t rc = 0;
+    uint64_t offset = 0;
+
+    if( journal == NULL ) {
+        return RC(rcExe, rcFile, rcWriting, rcParam, rcNull);
+    }
+    if( g_filer == NULL ) {
+        return RC(rcExe, rcFile, rcWriting, rcSelf, rcNotOpen);
+    }
+    while( rc == 0 && offset < KDataBufferBytes(journal) ) {
+        const SRASplitterJournal* j = (const SRASplitterJournal*)&((const uint8_t*)journal->base)[offset];
+        SRASplitterFile* f = j->file;
+
+        if( f->real == NULL ) {
+            rc = SRASplitterFiler_ReplayFindFile(f);
+        } else {
+            rc = SRASplitterFiler_OpenFile(g_filer, f->real, false);
+        }
+        if( rc == 0 && j->size > 0 ) {
+            rc = SRASplitterFiler_Write(g_filer, f->real, j->spot, &j[1], j->size);
+        }
+        offset += sizeof(*j) + JOURNAL_PAD(j->size);
+    }
+    return rc;
+}
+
+/* path "" is the root of the tree, children follow their parent sorted by key
+   which is the order the serial dump releases them in */
+static
+rc_t SRASplitterFiler_AddRejected(SRASplitterFiler* self, const char* path, const char* what, uint64_t qty)
+{
+    uint32_t i;
+    SRASplitterRejected* r;
+    char* dup;
+
+    for( i = 0; i < self->rejected_qty; i++ ) {
+        int cmp = strcmp(self->rejected[i].path, path);
+        if( cmp > 0 ) {
+            break;
+        }
+        if( cmp == 0 && strcmp(self->rejected[i].what, what) == 0 ) {
+            self->rejected[i].qty += qty;
+            return 0;
+        }
+    }
+    if( self->rejected_qty == self->rejected_max ) {
+        uint32_t max = self->rejected_max == 0 ? 16 : self->rejected_max * 2;
+        r = realloc(self->rejected, max * sizeof(self->rejected[0]));
+        if( r == NULL ) {
+            return RC(rcExe, rcFile, rcWriting, rcMemory, rcExhausted);
+        }
+        self->rejected = r;
+        self->rejected_max = max;
+    }
+    if( (dup = string_dup(path, strlen(path))) == NULL ) {
+        return RC(rcExe, rcFile, rcWriting, rcMemory, rcExhausted);
+    }
+    /* lines of the same splitter stay in order of first report */
+    r = &self->rejected[i];
+    memmove(r + 1, r, (self->rejected_qty - i) * sizeof(self->rejected[0]));
+    self->rejected_qty++;
+    r->path = dup;
+    r->qty = qty;
+    string_copy(r->what, sizeof(r->what), what, strlen(what));
+    return 0;
+}
+
+rc_t SRASplitterFiler_MergeRejected(const SRASplitterFiler* capture)
+{
+    rc_t rc = 0;
+    uint32_t i;
+
+    if( capture == NULL ) {
+        rc = RC(rcExe, rcFile, rcWriting, rcParam, rcNull);
+    } else if( g_filer == NULL ) {
+        rc = RC(rcExe, rcFile, rcWriting, rcSelf, rcNotOpen);
+    }
+    for( i = 0; rc == 0 && i < capture->rejected_qty; i++ ) {
+        const SRASplitterRejected* r = &capture->rejected[i];
+        rc = SRASplitterFiler_AddRejected(g_filer, r->path, r->what, r->qty);
+    }
+    return rc;
+}
+
+rc_t SRASplitterFiler_PrintRejected(void)
+{
+    rc_t rc = 0;
+    uint32_t i;
+
+    if( g_filer != NULL ) {
+        for( i = 0; rc == 0 && i < g_filer->rejected_qty; i++ ) {
+            const SRASplitterRejected* r = &g_filer->rejected[i];
+            if( r->qty > 0 ) {
+                rc = KOutMsg("Rejected %lu %s\n", r->qty, r->what);
+            }
+        }
+        SRASplitterFiler_WhackRejected(g_filer);
+    }
+    return rc;
+}
+
 /* ### Base splitter code ##################################################### */
 
 /* used to detect correct object pointers */
@@ -532,6 +879,10 @@ struct SRASplitter {
     SRASplitter_Release_Func* Release;
     BSTree children;
     SRASplitter_Child* last_found;
+    /* where output of this splitter and its children goes */
+    SRASplitterFiler* filer;
+    /* keys leading to this splitter joined by DUMPER_PATH_SEPARATOR, NULL for the root */
+    char* path;
 };
 
 struct SRASplitter_Child {
@@ -620,6 +971,25 @@ int CC SRASplitter_Child_Find(const void* item, const BSTNode* node)
     return strcmp(key, n->key);
 }
 
+static
+rc_t SRASplitter_ResolveSelf(const SRASplitter* self, enum RCContext ctx, SRASplitter** resolved);
+
+static /* not virtual, self is direct pointer to base type here !!! */
+rc_t SRASplitter_MakePath(SRASplitter* self, const char* parent, const char* key)
+{
+    size_t parent_len = parent == NULL ? 0 : strlen(parent);
+    size_t key_len = strlen(key);
+
+    self->path = malloc(parent_len + key_len + 2);
+    if( self->path == NULL ) {
+        return RC(rcExe, rcNode, rcConstructing, rcMemory, rcExhausted);
+    }
+    memmove(self->path, parent, parent_len);
+    self->path[parent_len] = DUMPER_PATH_SEPARATOR;
+    memmove(&self->path[parent_len + 1], key, key_len + 1);
+    return 0;
+}
+
 static /* not virtual, self is direct pointer to base type here !!! */
 rc_t SRASplitter_FindNextSplitter(SRASplitter* self, const char* key)
 {
@@ -632,7 +1002,16 @@ rc_t SRASplitter_FindNextSplitter(SRASplitter* self, const char* key)
             const SRASplitter* splitter = NULL;
             SRA_DUMP_DBG(5, ("New splitter on key '%s'\n", key));
             if( (rc = SRASplitterFactory_NewObj(self->next_fact, &splitter)) == 0 ) {
-                if( (rc = SRASplitter_Child_MakeSplitter(&self->last_found, key, splitter)) == 0 ) {
+                SRASplitter* sp = NULL;
+                if( (rc = SRASplitter_ResolveSelf(splitter, rcConstructing, &sp)) == 0 ) {
+                    /* children inherit filer */
+                    sp->filer = self->filer;
+                    rc = SRASplitter_MakePath(sp, self->path, key);
+                    if( rc == 0 ) {
+                        rc = SRASplitter_Child_MakeSplitter(&self->last_found, key, splitter);
+                    }
+                }
+                if( rc == 0 ) {
                     if( (rc = BSTreeInsertUnique(&self->children, &self->last_found->node, NULL, SRASplitter_Child_Cmp)) != 0 ) {
                         SRASplitter_Child_Whack(&self->last_found->node, NULL);
                         self->last_found = NULL;
@@ -657,7 +1036,7 @@ rc_t SRASplitter_FindNextFile(SRASplitter* self, const char* key)
             /* create new child using global filer */
             const SRASplitterFile* file = NULL;
             SRA_DUMP_DBG(5, ("New file on key '%s'\n", key));
-            if( (rc = SRASplitterFiler_GetCurrFile(&file)) == 0 ) {
+            if( (rc = SRASplitterFiler_GetCurrFile(self->filer, &file)) == 0 ) {
                 if( (rc = SRASplitter_Child_MakeFile(&self->last_found, key, file)) == 0 ) {
                     if( (rc = BSTreeInsertUnique(&self->children, &self->last_found->node, NULL, SRASplitter_Child_Cmp)) != 0 ) {
                         SRASplitter_Child_Whack(&self->last_found->node, NULL);
@@ -669,7 +1048,7 @@ rc_t SRASplitter_FindNextFile(SRASplitter* self, const char* key)
     }
     if( rc == 0 ) {
         /* make sure file is opened */
-        rc = SRASplitterFiler_OpenFile((SRASplitterFile*)(self->last_found->child.file), false);
+        rc = SRASplitterFiler_OpenFile(self->filer, (SRASplitterFile*)(self->last_found->child.file), false);
     }
     return rc;
 }
@@ -768,13 +1147,13 @@ rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t *
                         if ( rc == 0 )
                         {
                             /* push spot to next splitter in chain */
-                            rc = SRASplitterFiler_PushKey( self->last_found->key );
+                            rc = SRASplitterFiler_PushKey( self->filer, self->last_found->key );
                             if ( rc == 0 )
                             {
                                 /* here comes RECURSION!!! */
                                 rc_t rc2;
                                 rc = SRASplitter_AddSpot( self->last_found->child.splitter, spot, local_readmask );
-                                rc2 = SRASplitterFiler_PopKey();
+                                rc2 = SRASplitterFiler_PopKey( self->filer );
                                 rc = rc ? rc : rc2;
                             }
                         }
@@ -808,13 +1187,13 @@ rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t *
                     if ( rc == 0 )
                     {
                         /* push spot to next splitter in chain */
-                        rc = SRASplitterFiler_PushKey( self->last_found->key );
+                        rc = SRASplitterFiler_PushKey( self->filer, self->last_found->key );
                         if ( rc == 0 )
                         {
                             /* here comes RECURSION!!! */
                             rc_t rc2;
                             rc = SRASplitter_AddSpot( self->last_found->child.splitter, spot, readmask );
-                            rc2 = SRASplitterFiler_PopKey();
+                            rc2 = SRASplitterFiler_PopKey( self->filer );
                             rc = rc ? rc : rc2;
                         }
                     }
@@ -834,6 +1213,33 @@ rc_t SRASplitter_AddSpot( const SRASplitter * cself, spotid_t spot, readmask_t *
 }
 
 
+rc_t SRASplitter_Rejected(const SRASplitter* cself, uint64_t qty, const char* what, ...)
+{
+    rc_t rc = 0;
+    SRASplitter* self = NULL;
+
+    if( what == NULL ) {
+        rc = RC(rcExe, rcNode, rcReleasing, rcParam, rcNull);
+    } else if( (rc = SRASplitter_ResolveSelf(cself, rcReleasing, &self)) == 0 ) {
+        char buf[DUMPER_MAX_REJECTED_LENGTH + 1];
+        size_t num_writ = 0;
+        va_list args;
+
+        va_start(args, what);
+        rc = string_vprintf(buf, sizeof(buf), &num_writ, what, args);
+        va_end(args);
+        if( rc == 0 ) {
+            if( self->filer->capture ) {
+                rc = SRASplitterFiler_AddRejected(self->filer, self->path ? self->path : "", buf, qty);
+            } else if( qty > 0 ) {
+                /* serial dump prints the line of every splitter as it is released */
+                rc = KOutMsg("Rejected %lu %s\n", qty, buf);
+            }
+        }
+    }
+    return rc;
+}
+
 rc_t SRASplitter_Release(const SRASplitter* cself)
 {
     rc_t rc = 0;
@@ -845,6 +1251,7 @@ rc_t SRASplitter_Release(const SRASplitter* cself)
                 rc = self->Release(cself);
             }
             BSTreeWhack( &self->children, SRASplitter_Child_Whack, NULL );
+            free(self->path);
             free(self);
         }
     }
@@ -857,16 +1264,38 @@ rc_t SRASplitter_FileActivate(const SRASplitter* cself, const char* key)
     SRASplitter* self = NULL;
 
     if( (rc = SRASplitter_ResolveSelf(cself, rcExecuting, &self)) == 0 ) {
-        if( (rc = SRASplitterFiler_PushKey(key)) == 0 ) {
+        if( (rc = SRASplitterFiler_PushKey(self->filer, key)) == 0 ) {
             /* sets self->last_found */
             rc = SRASplitter_FindNextFile(self, key);
-            rc2 = SRASplitterFiler_PopKey();
+            rc2 = SRASplitterFiler_PopKey(self->filer);
             rc = rc ? rc : rc2;
         }
     }
     return rc;
 }
 
+static rc_t SRASplitterFiler_Write( SRASplitterFiler* self, SRASplitterFile* f,
+                                    spotid_t spot, const void* buf, size_t size )
+{
+    size_t writ = 0;
+    rc_t rc = KFileWrite( f->file, f->pos, buf, size, &writ );
+    if ( rc == 0 )
+    {
+        f->pos += writ;
+        if ( f->curr_spot != spot && spot != 0 )
+        {
+             f->curr_spot = spot;
+             f->spot_qty = f->spot_qty + 1;
+        }
+        if ( self->curr_spot != spot && spot != 0 )
+        {
+            self->curr_spot = spot;
+            self->spot_qty = self->spot_qty + 1;
+        }
+    }
+    return rc;
+}
+
 rc_t SRASplitter_FileWrite( const SRASplitter* cself, spotid_t spot, const void* buf, size_t size )
 {
     SRASplitter* self = NULL;
@@ -880,22 +1309,14 @@ rc_t SRASplitter_FileWrite( const SRASplitter* cself, spotid_t spot, const void*
         }
         else if ( buf != NULL && size > 0 )
         {
-            size_t writ = 0;
             SRASplitterFile* f = ( SRASplitterFile* )( self->last_found->child.file );
-            rc = KFileWrite( f->file, f->pos, buf, size, &writ );
-            if ( rc == 0 )
+            if ( self->filer->capture )
             {
-                f->pos += writ;
-                if ( f->curr_spot != spot && spot != 0 )
-                {
-                     f->curr_spot = spot;
-                     f->spot_qty = f->spot_qty + 1;
-                }
-                if ( g_filer->curr_spot != spot && spot != 0 )
-                {
-                    g_filer->curr_spot = spot;
-                    g_filer->spot_qty = g_filer->spot_qty + 1;
-                }
+                rc = SRASplitterFiler_Journal( self->filer, f, spot, buf, size );
+            }
+            else
+            {
+                rc = SRASplitterFiler_Write( self->filer, f, spot, buf, size );
             }
         }
     }
@@ -914,6 +1335,11 @@ rc_t SRASplitter_FileWritePos( const SRASplitter* cself, spotid_t spot,
         {
             rc = RC( rcExe, rcFile, rcWriting, rcDirEntry, rcUnknown );
         }
+        else if ( self->filer->capture )
+        {
+            /* journal is append only */
+            rc = RC( rcExe, rcFile, rcWriting, rcInterface, rcUnsupported );
+        }
         else if ( buf != NULL && size > 0 )
         {
             const SRASplitterFile* f = self->last_found->child.file;
@@ -1059,11 +1485,29 @@ rc_t SRASplitterFactory_NewObj(const SRASplitterFactory* cself, const SRASplitte
                     SRASplitter_Release(*splitter);
                     *splitter = NULL;
                     rc = RC(rcExe, rcType, rcAllocating, rcInterface, rcInvalid);
-                } else if(self->type != eSplitterFormat) {
-                    sp->next_fact = self->next;
+                } else {
+                    sp->filer = g_filer;
+                    if(self->type != eSplitterFormat) {
+                        sp->next_fact = self->next;
+                    }
                 }
             }
         }
     }
     return rc;
 }
+
+rc_t SRASplitterFactory_NewCaptureObj(const SRASplitterFactory* self, SRASplitterFiler* capture, const SRASplitter** splitter)
+{
+    rc_t rc = 0;
+
+    if( capture == NULL || !capture->capture ) {
+        rc = RC(rcExe, rcType, rcConstructing, rcParam, rcInvalid);
+    } else if( (rc = SRASplitterFactory_NewObj(self, splitter)) == 0 ) {
+        SRASplitter* sp = NULL;
+        if( (rc = SRASplitter_ResolveSelf(*splitter, rcConstructing, &sp)) == 0 ) {
+            sp->filer = capture;
+        }
+    }
+    return rc;
+}
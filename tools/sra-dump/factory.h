@@ -115,6 +115,14 @@ rc_t SRASplitter_Make(const SRASplitter** self, size_t type_size, /* sizeof(deri
   */
 rc_t SRASplitter_Release(const SRASplitter* self);
 
+/**
+  * Reports number of spots or reads rejected by a splitter, to be called from its release.
+  * Prints "Rejected <qty> <what>" right away, unless the splitter writes into a capture:
+  * there counts are kept per splitter of the tree, to be summed up over all captures by
+  * SRASplitterFiler_MergeRejected. Zero counts are kept too, they keep order of lines stable.
+  */
+rc_t SRASplitter_Rejected(const SRASplitter* self, uint64_t qty, const char* what, ...);
+
 /**
   * Add spot to processing chain
   */
@@ -154,6 +162,29 @@ rc_t SRASplitterFactory_FilerPrefix(const char* prefix);
 void SRASplitterFactory_FilerReport(uint64_t* total, uint64_t* biggest_file);
 void SRASplitterFiler_Release(void);
 
+/**
+  * Capture filer: lets several splitter chains run in parallel.
+  * A chain attached to a capture filer does not touch any files, every write is
+  * journaled in memory instead. The journal is later replayed into the files of the
+  * global filer by a single thread, which produces exactly the same output as if
+  * the chain had written directly. Must be made AFTER SRASplitterFactory_FilerInit.
+  * Positioned writes (SRASplitter_FileWritePos) are not supported in a capture.
+  */
+typedef struct SRASplitterFiler_struct SRASplitterFiler;
+
+rc_t SRASplitterFiler_MakeCapture(SRASplitterFiler** self);
+/* must not be released before all of its taken journals are replayed */
+void SRASplitterFiler_ReleaseCapture(SRASplitterFiler* self);
+/* hands over the journal written so far, capture restarts with an empty one,
+   caller must KDataBufferWhack the journal */
+rc_t SRASplitterFiler_TakeCapture(SRASplitterFiler* self, KDataBuffer* journal);
+/* replays journal into the files of the global filer, single thread only! */
+rc_t SRASplitterFiler_Replay(const KDataBuffer* journal);
+/* adds rejection counts of released splitters of capture to the global filer, single thread only! */
+rc_t SRASplitterFiler_MergeRejected(const SRASplitterFiler* capture);
+/* prints and clears merged rejection counts of global filer, in the order a serial dump prints them */
+rc_t SRASplitterFiler_PrintRejected(void);
+
 /**
   * Create factory object
   */
@@ -191,4 +222,9 @@ rc_t SRASplitterFactory_Init(const SRASplitterFactory* self);
   */
 rc_t SRASplitterFactory_NewObj(const SRASplitterFactory* self, const SRASplitter** splitter);
 
+/**
+  * Same as above but whole splitter tree started by new instance writes into capture
+  */
+rc_t SRASplitterFactory_NewCaptureObj(const SRASplitterFactory* self, SRASplitterFiler* capture, const SRASplitter** splitter);
+
 #endif /* _h_tools_dump_factory */
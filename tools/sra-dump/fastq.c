@@ -645,8 +645,8 @@ static rc_t AlignedFilter_Release( const SRASplitter* cself )
     }
     else
     {
-        if ( self->rejected_reads > 0 && !g_legacy_report )
-            rc = KOutMsg( "Rejected %lu READS because of aligned/unaligned filter\n", self->rejected_reads );
+        if ( !g_legacy_report )
+            rc = SRASplitter_Rejected( cself, self->rejected_reads, "READS because of aligned/unaligned filter" );
     }
     return rc;
 }
@@ -857,8 +857,8 @@ static rc_t AlignRegionFilter_Release( const SRASplitter* cself )
     }
     else
     {
-        if ( self->rejected_spots > 0 && !g_legacy_report )
-            rc = KOutMsg( "Rejected %lu SPOTS because of AlignRegionFilter\n", self->rejected_spots );
+        if ( !g_legacy_report )
+            rc = SRASplitter_Rejected( cself, self->rejected_spots, "SPOTS because of AlignRegionFilter" );
     }
     return rc;
 }
@@ -1087,8 +1087,8 @@ static rc_t AlignPairDistanceFilter_Release( const SRASplitter* cself )
     }
     else
     {
-        if ( self->rejected_reads > 0 && !g_legacy_report )
-            rc = KOutMsg( "Rejected %lu READS because of AlignPairDistanceFilter\n", self->rejected_reads );
+        if ( !g_legacy_report )
+            rc = SRASplitter_Rejected( cself, self->rejected_reads, "READS because of AlignPairDistanceFilter" );
     }
     return rc;
 }
@@ -1281,8 +1281,8 @@ static rc_t FastqBioFilter_Release( const SRASplitter * cself )
         rc = RC( rcExe, rcNode, rcExecuting, rcParam, rcInvalid );
     else
     {
-        if ( self->rejected_reads > 0 && !g_legacy_report )
-            rc = KOutMsg( "Rejected %lu READS because of filtering out non-biological READS\n", self->rejected_reads );
+        if ( !g_legacy_report )
+            rc = SRASplitter_Rejected( cself, self->rejected_reads, "READS because of filtering out non-biological READS" );
     }
     return rc;
 }
@@ -1451,8 +1451,8 @@ static rc_t FastqRNumberFilter_Release( const SRASplitter* cself )
     }
     else
     {
-        if ( self->rejected_reads > 0 && !g_legacy_report )
-            rc = KOutMsg( "Rejected %lu READS because of max. number of READS = %u\n", self->rejected_reads, FastqArgs.maxReads );
+        if ( !g_legacy_report )
+            rc = SRASplitter_Rejected( cself, self->rejected_reads, "READS because of max. number of READS = %u", FastqArgs.maxReads );
     }
     return rc;
 }
@@ -1769,10 +1769,9 @@ static rc_t FastqQFilter_Release( const SRASplitter * cself )
         rc = RC( rcExe, rcNode, rcExecuting, rcParam, rcInvalid );
     else if ( !g_legacy_report )
     {
-        if ( self->rejected_reads > 0 )
-            rc = KOutMsg( "Rejected %lu READS because of Quality-Filtering\n", self->rejected_reads );
-        if ( rc == 0 && self->rejected_spots > 0 )
-            rc = KOutMsg( "Rejected %lu SPOTS because of Quality-Filtering\n", self->rejected_spots );
+        rc = SRASplitter_Rejected( cself, self->rejected_reads, "READS because of Quality-Filtering" );
+        if ( rc == 0 )
+            rc = SRASplitter_Rejected( cself, self->rejected_spots, "SPOTS because of Quality-Filtering" );
 
     }
     return rc;
@@ -1973,10 +1972,9 @@ static rc_t FastqReadLenFilter_Release( const SRASplitter * cself )
         rc = RC( rcExe, rcNode, rcExecuting, rcParam, rcInvalid );
     else if ( !g_legacy_report )
     {
-        if ( self->rejected_reads > 0 )
-            rc = KOutMsg( "Rejected %lu READS because READLEN < %u\n", self->rejected_reads, FastqArgs.minReadLen );
-        if ( self->rejected_spots > 0 && rc == 0 )
-            rc = KOutMsg( "Rejected %lu SPOTS because SPOTLEN < %u\n", self->rejected_spots, FastqArgs.minReadLen );
+        rc = SRASplitter_Rejected( cself, self->rejected_reads, "READS because READLEN < %u", FastqArgs.minReadLen );
+        if ( rc == 0 )
+            rc = SRASplitter_Rejected( cself, self->rejected_spots, "SPOTS because SPOTLEN < %u", FastqArgs.minReadLen );
     }
     return rc;
 }
@@ -2075,12 +2073,49 @@ static rc_t FastqReadLenFilterFactory_Make( const SRASplitterFactory** cself,
 
 /* ============== FASTQ read splitter ============================ */
 
-char* FastqReadSplitter_key_buf = NULL;
+#define READ_KEY_OFFSET 5
+
+/* keys for all reads: "   1\0   2\0...\0   9\0  10\0  11\0...\08192\0",
+   one per factory, so splitter chains running in parallel do not share it */
+static rc_t FastqReadSplitter_MakeKeyBuf( char** key_buf )
+{
+    rc_t rc = 0;
+
+    if ( nreads_max > 9999 )
+    {
+        /* key_offset and sprintf format size are insufficient for keys longer than 4 digits */
+        rc = RC( rcExe, rcNode, rcConstructing, rcBuffer, rcInsufficient );
+    }
+    else
+    {
+        *key_buf = malloc( nreads_max * READ_KEY_OFFSET );
+        if ( *key_buf == NULL )
+        {
+            rc = RC( rcExe, rcNode, rcConstructing, rcMemory, rcExhausted );
+        }
+        else
+        {
+            /* fill buffer w/keys */
+            int i;
+            char* p = *key_buf;
+            for ( i = 1; rc == 0 && i <= nreads_max; i++ )
+            {
+                if ( sprintf( p, "%4u", i ) <= 0 )
+                {
+                    rc = RC( rcExe, rcNode, rcConstructing, rcTransfer, rcIncomplete );
+                }
+                p += READ_KEY_OFFSET;
+            }
+        }
+    }
+    return rc;
+}
 
 
 typedef struct FastqReadSplitter_struct
 {
     const FastqReader* reader;
+    const char* key_buf;
     SRASplitter_Keys* keys;
     uint32_t keys_max;
 } FastqReadSplitter;
@@ -2091,7 +2126,7 @@ static rc_t FastqReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpli
 {
     rc_t rc = 0;
     FastqReadSplitter* self = ( FastqReadSplitter* )cself;
-    const size_t key_offset = 5;
+    const size_t key_offset = READ_KEY_OFFSET;
 
     if ( self == NULL || key == NULL )
     {
@@ -2102,38 +2137,6 @@ static rc_t FastqReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpli
         uint32_t num_reads = 0;
 
         *keys = 0;
-        if ( FastqReadSplitter_key_buf == NULL )
-        {
-            /* initial alloc key_buf: "  1\0  2\0...\0  9\0 10\0 11\0...\03220..\08192\0" */
-            if ( nreads_max > 9999 )
-            {
-                /* key_offset and sprintf format size are insufficient for keys longer than 4 digits */
-                rc = RC( rcExe, rcNode, rcExecuting, rcBuffer, rcInsufficient );
-            }
-            else
-            {
-                FastqReadSplitter_key_buf = malloc( nreads_max * key_offset );
-                if ( FastqReadSplitter_key_buf == NULL )
-                {
-                    rc = RC( rcExe, rcNode, rcExecuting, rcMemory, rcExhausted );
-                }
-                else
-                {
-                    /* fill buffer w/keys */
-                    int i;
-                    char* p = FastqReadSplitter_key_buf;
-                    for ( i = 1; rc == 0 && i <= nreads_max; i++ )
-                    {
-                        if ( sprintf( p, "%4u", i ) <= 0 )
-                        {
-                            rc = RC( rcExe, rcNode, rcExecuting, rcTransfer, rcIncomplete );
-                        }
-                        p += key_offset;
-                    }
-                }
-            }
-        }
-
         if ( rc == 0 )
         {
             rc = FastqReaderSeekSpot( self->reader, spot );
@@ -2166,7 +2169,7 @@ static rc_t FastqReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpli
                                 self->keys_max = good + 1;
                             }
                         }
-                        self->keys[ good ].key = &FastqReadSplitter_key_buf[ readId * key_offset ];
+                        self->keys[ good ].key = &self->key_buf[ readId * key_offset ];
                         while ( self->keys[ good ].key[ 0 ] == ' ' && self->keys[ good ].key[0] != '\0' )
                         {
                             self->keys[ good ].key++;
@@ -2216,6 +2219,7 @@ typedef struct FastqReadSplitterFactory_struct
     const char* accession;
     const SRATable* table;
     const FastqReader* reader;
+    char* key_buf;
 } FastqReadSplitterFactory;
 
 
@@ -2235,6 +2239,10 @@ static rc_t FastqReadSplitterFactory_Init( const SRASplitterFactory* cself )
                               FastqArgs.is_platform_cs_native, false, FastqArgs.fasta > 0, false, 
                               false, !FastqArgs.applyClip, FastqArgs.SuppressQualForCSKey, 0,
                               FastqArgs.offset, '\0', 0, 0 );
+        if ( rc == 0 )
+        {
+            rc = FastqReadSplitter_MakeKeyBuf( &self->key_buf );
+        }
     }
     return rc;
 }
@@ -2256,6 +2264,7 @@ static rc_t FastqReadSplitterFactory_NewObj( const SRASplitterFactory* cself, co
         if ( rc == 0 )
         {
             ( (FastqReadSplitter*)(*splitter) )->reader = self->reader;
+            ( (FastqReadSplitter*)(*splitter) )->key_buf = self->key_buf;
         }
     }
     return rc;
@@ -2268,8 +2277,7 @@ static void FastqReadSplitterFactory_Release( const SRASplitterFactory* cself )
     {
         FastqReadSplitterFactory* self = ( FastqReadSplitterFactory* )cself;
         FastqReaderWhack( self->reader );
-        free( FastqReadSplitter_key_buf );
-        FastqReadSplitter_key_buf = NULL;
+        free( self->key_buf );
     }
 }
 
@@ -2303,11 +2311,10 @@ static rc_t FastqReadSplitterFactory_Make( const SRASplitterFactory** cself,
 
 /* ============== FASTQ 3 read splitter ============================ */
 
-char* Fastq3ReadSplitter_key_buf = NULL;
-
 typedef struct Fastq3ReadSplitter_struct
 {
     const FastqReader* reader;
+    const char* key_buf;
     SRASplitter_Keys keys[ 2 ];
 } Fastq3ReadSplitter;
 
@@ -2318,7 +2325,7 @@ static rc_t Fastq3ReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpl
 {
     rc_t rc = 0;
     Fastq3ReadSplitter* self = ( Fastq3ReadSplitter* )cself;
-    const size_t key_offset = 5;
+    const size_t key_offset = READ_KEY_OFFSET;
 
     if ( self == NULL || key == NULL )
     {
@@ -2329,38 +2336,6 @@ static rc_t Fastq3ReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpl
         uint32_t num_reads = 0;
 
         *keys = 0;
-        if ( Fastq3ReadSplitter_key_buf == NULL )
-        {
-            /* initial alloc key_buf: "  1\0  2\0...\0  9\0 10\0 11\0...\03220..\08192\0" */
-            if ( nreads_max > 9999 )
-            {
-                /* key_offset and sprintf format size are insufficient for keys longer than 4 digits */
-                rc = RC( rcExe, rcNode, rcExecuting, rcBuffer, rcInsufficient );
-            }
-            else
-            {
-                Fastq3ReadSplitter_key_buf = malloc( nreads_max * key_offset );
-                if ( Fastq3ReadSplitter_key_buf == NULL )
-                {
-                    rc = RC( rcExe, rcNode, rcExecuting, rcMemory, rcExhausted );
-                }
-                else
-                {
-                    /* fill buffer w/keys */
-                    int i;
-                    char* p = Fastq3ReadSplitter_key_buf;
-                    for ( i = 1; rc == 0 && i <= nreads_max; i++ )
-                    {
-                        if ( sprintf( p, "%4u", i ) <= 0 )
-                        {
-                            rc = RC( rcExe, rcNode, rcExecuting, rcTransfer, rcIncomplete );
-                        }
-                        p += key_offset;
-                    }
-                }
-            }
-        }
-
         if ( rc == 0 )
         {
             rc = FastqReaderSeekSpot( self->reader, spot );
@@ -2380,7 +2355,7 @@ static rc_t Fastq3ReadSplitter_GetKeySet( const SRASplitter* cself, const SRASpl
                         {
                             continue;
                         }
-                        self->keys[ good ].key = &Fastq3ReadSplitter_key_buf[ good * key_offset ];
+                        self->keys[ good ].key = &self->key_buf[ good * key_offset ];
                         while ( self->keys[ good ].key[ 0 ] == ' ' && self->keys[good].key[ 0 ] != '\0' )
                         {
                             self->keys[ good ].key++;
@@ -2429,6 +2404,7 @@ typedef struct Fastq3ReadSplitterFactory_struct
     const char* accession;
     const SRATable* table;
     const FastqReader* reader;
+    char* key_buf;
 } Fastq3ReadSplitterFactory;
 
 
@@ -2448,6 +2424,10 @@ static rc_t Fastq3ReadSplitterFactory_Init( const SRASplitterFactory* cself )
                               FastqArgs.is_platform_cs_native, false, FastqArgs.fasta > 0, false, 
                               false, !FastqArgs.applyClip, FastqArgs.SuppressQualForCSKey, 0,
                               FastqArgs.offset, '\0', 0, 0 );
+        if ( rc == 0 )
+        {
+            rc = FastqReadSplitter_MakeKeyBuf( &self->key_buf );
+        }
     }
     return rc;
 }
@@ -2469,6 +2449,7 @@ static rc_t Fastq3ReadSplitterFactory_NewObj( const SRASplitterFactory* cself, c
         if ( rc == 0 )
         {
             ( (Fastq3ReadSplitter*)(*splitter) )->reader = self->reader;
+            ( (Fastq3ReadSplitter*)(*splitter) )->key_buf = self->key_buf;
         }
     }
     return rc;
@@ -2481,7 +2462,7 @@ static void Fastq3ReadSplitterFactory_Release( const SRASplitterFactory* cself )
     {
         Fastq3ReadSplitterFactory* self = ( Fastq3ReadSplitterFactory* )cself;
         FastqReaderWhack( self->reader );
-        free( Fastq3ReadSplitter_key_buf );
+        free( self->key_buf );
     }
 }
 
@@ -3661,11 +3642,12 @@ rc_t FastqDumper_Factories( const SRADumperFmt* fmt, const SRASplitterFactory**
 
     if ( rc == 0 )
     {
-        if ( FastqArgs.b_deffmt != NULL )
+        /* factories are made once per parallel chain, parse deflines only once */
+        if ( FastqArgs.b_deffmt != NULL && FastqArgs.b_defline == NULL )
         {
             rc = Defline_Parse( &FastqArgs.b_defline, FastqArgs.b_deffmt );
         }
-        if ( FastqArgs.q_deffmt != NULL )
+        if ( rc == 0 && FastqArgs.q_deffmt != NULL && FastqArgs.q_defline == NULL )
         {
             rc = Defline_Parse( &FastqArgs.q_defline, FastqArgs.q_deffmt );
         }
@@ -3802,6 +3784,7 @@ rc_t SRADumper_Init( SRADumperFmt* fmt )
     fmt->gzip = true;
     fmt->bzip2 = true;
     fmt->split_files = false;
+    fmt->parallel = true;
 
     return 0;
 }
@@ -0,0 +1,476 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "bam_index.h"
+
+#include <klib/log.h>
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BAI_MAX_BIN     37450   /* the pseudo-bin holding the statistics */
+#define BAI_LIN_SHIFT   14      /* the linear index has 16 kb windows */
+
+/* all offsets are kept as offsets into the uncompressed stream,
+   they become virtual file-offsets in bam_index_write() */
+typedef struct bai_chunk
+{
+    uint64_t beg;
+    uint64_t end;
+} bai_chunk;
+
+typedef struct bai_bin
+{
+    uint32_t bin;
+    uint32_t n_chunks;
+    uint32_t cap;
+    bai_chunk * chunks;
+} bai_bin;
+
+typedef struct bai_ref
+{
+    bai_bin * bins;         /* used bins, ordered by bin-number */
+    uint32_t n_bins;
+    uint64_t * lin;
+    uint32_t n_lin;
+    uint64_t off_beg;
+    uint64_t off_end;
+    uint64_t n_mapped;
+    uint64_t n_unmapped;
+    bool used;
+} bai_ref;
+
+struct bam_index
+{
+    bai_ref * refs;
+    uint32_t n_refs;
+    size_t block_size;
+
+    /* the reference being collected: the bins are addressed directly */
+    int32_t cur_ref;
+    int32_t last_beg;
+    bai_bin * cur_bins;     /* BAI_MAX_BIN entries */
+    uint32_t lin_cap;
+
+    uint64_t n_no_coor;
+    bool unsorted;
+    rc_t rc;
+
+    /* compressed offset of every BGZF-block, one more for the end */
+    uint64_t * block_off;
+    size_t n_blocks;
+    size_t block_cap;
+};
+
+
+uint32_t bam_reg2bin( int32_t beg, int32_t end )
+{
+    --end;
+    if ( beg >> 14 == end >> 14 ) return ( ( 1 << 15 ) - 1 ) / 7 + ( beg >> 14 );
+    if ( beg >> 17 == end >> 17 ) return ( ( 1 << 12 ) - 1 ) / 7 + ( beg >> 17 );
+    if ( beg >> 20 == end >> 20 ) return ( ( 1 << 9 ) - 1 ) / 7 + ( beg >> 20 );
+    if ( beg >> 23 == end >> 23 ) return ( ( 1 << 6 ) - 1 ) / 7 + ( beg >> 23 );
+    if ( beg >> 26 == end >> 26 ) return ( ( 1 << 3 ) - 1 ) / 7 + ( beg >> 26 );
+    return 0;
+}
+
+
+static rc_t bai_add_chunk( bai_bin * bin, uint64_t beg, uint64_t end )
+{
+    /* records written back to back extend the last chunk */
+    if ( bin->n_chunks > 0 && bin->chunks[ bin->n_chunks - 1 ].end == beg )
+    {
+        bin->chunks[ bin->n_chunks - 1 ].end = end;
+        return 0;
+    }
+    if ( bin->n_chunks == bin->cap )
+    {
+        uint32_t cap = ( bin->cap == 0 ) ? 4 : bin->cap * 2;
+        bai_chunk * tmp = realloc( bin->chunks, cap * sizeof *tmp );
+        if ( tmp == NULL )
+            return RC( rcExe, rcIndex, rcInserting, rcMemory, rcExhausted );
+        bin->chunks = tmp;
+        bin->cap = cap;
+    }
+    bin->chunks[ bin->n_chunks ].beg = beg;
+    bin->chunks[ bin->n_chunks ].end = end;
+    bin->n_chunks++;
+    return 0;
+}
+
+
+/* moves the used bins of the current reference into its compact list */
+static rc_t bai_finish_ref( bam_index * self )
+{
+    bai_ref * ref;
+    uint32_t i, n;
+
+    if ( self->cur_ref < 0 )
+        return 0;
+    ref = &self->refs[ self->cur_ref ];
+
+    for ( i = 0, n = 0; i < BAI_MAX_BIN; ++i )
+        if ( self->cur_bins[ i ].n_chunks > 0 )
+            ++n;
+    if ( n > 0 )
+    {
+        ref->bins = calloc( n, sizeof *ref->bins );
+        if ( ref->bins == NULL )
+            return RC( rcExe, rcIndex, rcInserting, rcMemory, rcExhausted );
+        for ( i = 0; i < BAI_MAX_BIN; ++i )
+        {
+            bai_bin * bin = &self->cur_bins[ i ];
+            if ( bin->n_chunks > 0 )
+            {
+                ref->bins[ ref->n_bins ] = *bin;
+                ref->bins[ ref->n_bins ].bin = i;
+                ref->n_bins++;
+                memset( bin, 0, sizeof *bin );
+            }
+        }
+    }
+
+    /* empty windows point to where the one before them points */
+    for ( i = 1; i < ref->n_lin; ++i )
+        if ( ref->lin[ i ] == 0 )
+            ref->lin[ i ] = ref->lin[ i - 1 ];
+
+    self->cur_ref = -1;
+    return 0;
+}
+
+
+static rc_t bai_add_lin( bam_index * self, bai_ref * ref, int32_t beg, int32_t end, uint64_t ustart )
+{
+    uint32_t w, w_beg = beg >> BAI_LIN_SHIFT, w_end = ( end - 1 ) >> BAI_LIN_SHIFT;
+
+    if ( w_end >= ref->n_lin )
+    {
+        uint32_t cap = ( self->lin_cap == 0 ) ? 1024 : self->lin_cap;
+        while ( cap <= w_end )
+            cap *= 2;
+        if ( cap > self->lin_cap )
+        {
+            uint64_t * tmp = realloc( ref->lin, cap * sizeof *tmp );
+            if ( tmp == NULL )
+                return RC( rcExe, rcIndex, rcInserting, rcMemory, rcExhausted );
+            ref->lin = tmp;
+            self->lin_cap = cap;
+        }
+        memset( ref->lin + ref->n_lin, 0, ( w_end + 1 - ref->n_lin ) * sizeof *ref->lin );
+        ref->n_lin = w_end + 1;
+    }
+    for ( w = w_beg; w <= w_end; ++w )
+        if ( ref->lin[ w ] == 0 )
+            ref->lin[ w ] = ustart;
+    return 0;
+}
+
+
+static void bai_drop( bam_index * self, const char * why )
+{
+    if ( !self->unsorted )
+    {
+        PLOGMSG( klogWarn, ( klogWarn, "BAM-index not written: $(why)", "why=%s", why ) );
+        self->unsorted = true;
+    }
+}
+
+
+rc_t bam_index_add( bam_index * self, int32_t ref, int32_t beg, int32_t end,
+                    bool mapped, uint64_t ustart, uint64_t uend )
+{
+    rc_t rc = 0;
+    bai_ref * r;
+
+    if ( self == NULL )
+        return RC( rcExe, rcIndex, rcInserting, rcSelf, rcNull );
+    if ( self->unsorted || self->rc != 0 )
+        return self->rc;
+
+    if ( ref < 0 )
+    {
+        /* records without a reference come last */
+        rc = bai_finish_ref( self );
+        self->n_no_coor++;
+        self->cur_ref = -2;
+        self->rc = rc;
+        return rc;
+    }
+
+    if ( ref >= ( int32_t )self->n_refs )
+    {
+        bai_drop( self, "unknown reference" );
+        return 0;
+    }
+
+    if ( ref != self->cur_ref )
+    {
+        if ( self->cur_ref == -2 || self->refs[ ref ].used || ref < self->cur_ref )
+        {
+            bai_drop( self, "output is not sorted by reference" );
+            return 0;
+        }
+        rc = bai_finish_ref( self );
+        if ( rc != 0 )
+        {
+            self->rc = rc;
+            return rc;
+        }
+        self->cur_ref = ref;
+        self->last_beg = 0;
+        self->lin_cap = 0;
+        self->refs[ ref ].used = true;
+        self->refs[ ref ].off_beg = ustart;
+    }
+    else if ( beg < self->last_beg )
+    {
+        bai_drop( self, "output is not sorted by position" );
+        return 0;
+    }
+    self->last_beg = beg;
+
+    if ( end <= beg )
+        end = beg + 1;
+
+    r = &self->refs[ ref ];
+    r->off_end = uend;
+    if ( mapped )
+        r->n_mapped++;
+    else
+        r->n_unmapped++;
+
+    rc = bai_add_chunk( &self->cur_bins[ bam_reg2bin( beg, end ) ], ustart, uend );
+    if ( rc == 0 )
+        rc = bai_add_lin( self, r, beg, end, ustart );
+    self->rc = rc;
+    return rc;
+}
+
+
+rc_t bam_index_block( bam_index * self, size_t comp_len )
+{
+    if ( self == NULL )
+        return RC( rcExe, rcIndex, rcInserting, rcSelf, rcNull );
+
+    if ( self->n_blocks + 2 > self->block_cap )
+    {
+        size_t cap = ( self->block_cap == 0 ) ? 4096 : self->block_cap * 2;
+        uint64_t * tmp = realloc( self->block_off, cap * sizeof *tmp );
+        if ( tmp == NULL )
+            return RC( rcExe, rcIndex, rcInserting, rcMemory, rcExhausted );
+        if ( self->block_cap == 0 )
+            tmp[ 0 ] = 0;
+        self->block_off = tmp;
+        self->block_cap = cap;
+    }
+    self->block_off[ self->n_blocks + 1 ] = self->block_off[ self->n_blocks ] + comp_len;
+    self->n_blocks++;
+    return 0;
+}
+
+
+bool bam_index_sorted( const bam_index * self )
+{
+    return ( self != NULL && !self->unsorted );
+}
+
+
+/* uncompressed offset into virtual file-offset */
+static uint64_t bai_voffset( const bam_index * self, uint64_t u )
+{
+    size_t block = ( size_t )( u / self->block_size );
+    uint64_t within = u % self->block_size;
+
+    if ( block > self->n_blocks )
+    {
+        /* past the end, only with a truncated stream */
+        block = self->n_blocks;
+        within = 0;
+    }
+    return ( self->block_off[ block ] << 16 ) | within;
+}
+
+
+typedef struct bai_out
+{
+    KFile * dst;
+    uint64_t pos;
+    uint8_t buffer[ 64 * 1024 ];
+    size_t filled;
+    rc_t rc;
+} bai_out;
+
+
+static void bai_flush( bai_out * out )
+{
+    if ( out->rc == 0 && out->filled > 0 )
+    {
+        size_t num_writ;
+        out->rc = KFileWriteAll( out->dst, out->pos, out->buffer, out->filled, &num_writ );
+        out->pos += num_writ;
+    }
+    out->filled = 0;
+}
+
+
+static void bai_put( bai_out * out, uint64_t value, uint32_t size )
+{
+    uint32_t i;
+    if ( out->filled + size > sizeof out->buffer )
+        bai_flush( out );
+    for ( i = 0; i < size; ++i )
+        out->buffer[ out->filled++ ] = ( uint8_t )( value >> ( 8 * i ) );
+}
+
+
+rc_t bam_index_write( bam_index * self, KFile * dst )
+{
+    bai_out * out;
+    uint32_t i, j, k;
+    rc_t rc;
+
+    if ( self == NULL )
+        return RC( rcExe, rcIndex, rcWriting, rcSelf, rcNull );
+    if ( dst == NULL )
+        return RC( rcExe, rcIndex, rcWriting, rcParam, rcNull );
+    if ( self->rc != 0 || self->unsorted )
+        return self->rc;
+
+    rc = bai_finish_ref( self );
+    if ( rc == 0 && self->n_blocks == 0 )
+        rc = bam_index_block( self, 0 );
+    if ( rc != 0 )
+        return rc;
+
+    out = malloc( sizeof *out );
+    if ( out == NULL )
+        return RC( rcExe, rcIndex, rcWriting, rcMemory, rcExhausted );
+    out->dst = dst;
+    out->pos = 0;
+    out->filled = 0;
+    out->rc = 0;
+
+    bai_put( out, 'B', 1 );
+    bai_put( out, 'A', 1 );
+    bai_put( out, 'I', 1 );
+    bai_put( out, 1, 1 );
+    bai_put( out, self->n_refs, 4 );
+    for ( i = 0; i < self->n_refs; ++i )
+    {
+        const bai_ref * ref = &self->refs[ i ];
+        bai_put( out, ref->n_bins + ( ref->used ? 1 : 0 ), 4 );
+        for ( j = 0; j < ref->n_bins; ++j )
+        {
+            const bai_bin * bin = &ref->bins[ j ];
+            bai_put( out, bin->bin, 4 );
+            bai_put( out, bin->n_chunks, 4 );
+            for ( k = 0; k < bin->n_chunks; ++k )
+            {
+                bai_put( out, bai_voffset( self, bin->chunks[ k ].beg ), 8 );
+                bai_put( out, bai_voffset( self, bin->chunks[ k ].end ), 8 );
+            }
+        }
+        if ( ref->used )
+        {
+            bai_put( out, BAI_MAX_BIN, 4 );
+            bai_put( out, 2, 4 );
+            bai_put( out, bai_voffset( self, ref->off_beg ), 8 );
+            bai_put( out, bai_voffset( self, ref->off_end ), 8 );
+            bai_put( out, ref->n_mapped, 8 );
+            bai_put( out, ref->n_unmapped, 8 );
+        }
+        bai_put( out, ref->n_lin, 4 );
+        for ( j = 0; j < ref->n_lin; ++j )
+            bai_put( out, bai_voffset( self, ref->lin[ j ] ), 8 );
+    }
+    bai_put( out, self->n_no_coor, 8 );
+    bai_flush( out );
+
+    rc = out->rc;
+    free( out );
+    return rc;
+}
+
+
+void release_bam_index( bam_index * self )
+{
+    uint32_t i, j;
+
+    if ( self == NULL )
+        return;
+
+    if ( self->cur_bins != NULL )
+    {
+        for ( i = 0; i < BAI_MAX_BIN; ++i )
+            free( self->cur_bins[ i ].chunks );
+        free( self->cur_bins );
+    }
+    if ( self->refs != NULL )
+    {
+        for ( i = 0; i < self->n_refs; ++i )
+        {
+            for ( j = 0; j < self->refs[ i ].n_bins; ++j )
+                free( self->refs[ i ].bins[ j ].chunks );
+            free( self->refs[ i ].bins );
+            free( self->refs[ i ].lin );
+        }
+        free( self->refs );
+    }
+    free( self->block_off );
+    free( self );
+}
+
+
+rc_t make_bam_index( bam_index ** self, uint32_t n_refs, size_t block_size )
+{
+    bam_index * o;
+
+    if ( self == NULL )
+        return RC( rcExe, rcIndex, rcConstructing, rcSelf, rcNull );
+    *self = NULL;
+    if ( block_size == 0 )
+        return RC( rcExe, rcIndex, rcConstructing, rcParam, rcInvalid );
+
+    o = calloc( 1, sizeof *o );
+    if ( o == NULL )
+        return RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+
+    o->n_refs = n_refs;
+    o->block_size = block_size;
+    o->cur_ref = -1;
+    o->cur_bins = calloc( BAI_MAX_BIN, sizeof *o->cur_bins );
+    o->refs = calloc( n_refs + 1, sizeof *o->refs );
+    if ( o->cur_bins == NULL || o->refs == NULL )
+    {
+        release_bam_index( o );
+        return RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+    }
+
+    *self = o;
+    return 0;
+}
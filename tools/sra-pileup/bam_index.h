@@ -0,0 +1,69 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_bam_index_
+#define _h_bam_index_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/rc.h>
+#include <kfs/file.h>
+
+/* BAI-index of a BAM-stream which is written while the records are written:
+   records are given with their offsets in the uncompressed stream, the sizes
+   of the compressed BGZF-blocks are given as they are written; the virtual
+   file-offsets are computed from both when the index is written */
+typedef struct bam_index bam_index;
+
+/* the bin of the interval [ beg, end ) in the BAI-binning scheme */
+uint32_t bam_reg2bin( int32_t beg, int32_t end );
+
+/* block_size is the uncompressed size of every BGZF-block but the last */
+rc_t make_bam_index( bam_index ** self, uint32_t n_refs, size_t block_size );
+
+/* ref < 0 for records without a reference, end is exclusive,
+   records have to come sorted by ref and beg, otherwise the index is dropped */
+rc_t bam_index_add( bam_index * self, int32_t ref, int32_t beg, int32_t end,
+                    bool mapped, uint64_t ustart, uint64_t uend );
+
+/* compressed size of the next BGZF-block */
+rc_t bam_index_block( bam_index * self, size_t comp_len );
+
+bool bam_index_sorted( const bam_index * self );
+
+rc_t bam_index_write( bam_index * self, KFile * dst );
+
+void release_bam_index( bam_index * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1161 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "bam_out.h"
+#include "bam_index.h"
+#include "par_gzip.h"
+
+#include <klib/log.h>
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BAM_REC_FIXED   36      /* block_size and the fixed fields of a record */
+#define BAM_MAX_QNAME   254
+#define BAM_UNMAPPED_BIN 4680   /* reg2bin( -1, 0 ) */
+
+typedef struct bam_ref
+{
+    char * name;
+    size_t name_len;
+    uint32_t length;
+} bam_ref;
+
+struct bam_out
+{
+    par_gzip * pgz;
+    uint64_t upos;          /* bytes written into the uncompressed stream */
+    bam_index * idx;
+    KFile * idx_dst;
+
+    /* the SAM-header, references in the order of the @SQ-lines */
+    char * hdr;
+    size_t hdr_len, hdr_cap;
+    bam_ref * refs;
+    size_t refs_cap;
+    uint32_t n_refs;
+    uint32_t * by_name;     /* reference-ids sorted by name */
+    int32_t last_ref;
+    bool hdr_written;
+
+    /* SAM-text collected until the end of the line */
+    char * line;
+    size_t line_len, line_cap;
+
+    /* the record being encoded */
+    uint8_t * rec;
+    size_t rec_len, rec_cap;
+    int32_t ref_id, pos, ref_span, next_ref_id, next_pos, tlen, l_seq;
+    uint32_t flags, n_cigar;
+    uint8_t mapq, l_qname;
+    uint8_t fixed_zero[ BAM_REC_FIXED ];
+
+    /* a worker encodes with the references of its parent, the records go to sink */
+    bam_out * parent;
+    bam_out_sink sink;
+    void * sink_data;
+
+    rc_t rc;
+};
+
+static void set_u16( uint8_t * dst, uint32_t value )
+{
+    dst[ 0 ] = ( uint8_t )value;
+    dst[ 1 ] = ( uint8_t )( value >> 8 );
+}
+
+
+static void set_u32( uint8_t * dst, uint32_t value )
+{
+    set_u16( dst, value & 0xffff );
+    set_u16( dst + 2, value >> 16 );
+}
+
+
+static uint32_t get_u16( const uint8_t * src )
+{
+    return ( uint32_t )src[ 0 ] | ( ( uint32_t )src[ 1 ] << 8 );
+}
+
+
+static uint32_t get_u32( const uint8_t * src )
+{
+    return get_u16( src ) | ( get_u16( src + 2 ) << 16 );
+}
+
+
+static rc_t grow( void ** buffer, size_t * cap, size_t needed, size_t elem )
+{
+    if ( needed > *cap )
+    {
+        size_t n = ( *cap == 0 ) ? 256 : *cap;
+        void * tmp;
+        while ( n < needed )
+            n *= 2;
+        tmp = realloc( *buffer, n * elem );
+        if ( tmp == NULL )
+            return RC( rcExe, rcBuffer, rcResizing, rcMemory, rcExhausted );
+        *buffer = tmp;
+        *cap = n;
+    }
+    return 0;
+}
+
+
+static rc_t rec_append( bam_out * self, const void * data, size_t len )
+{
+    rc_t rc = grow( ( void ** )&self->rec, &self->rec_cap, self->rec_len + len, 1 );
+    if ( rc == 0 )
+    {
+        memmove( self->rec + self->rec_len, data, len );
+        self->rec_len += len;
+    }
+    return rc;
+}
+
+
+static rc_t rec_u8( bam_out * self, uint32_t value )
+{
+    uint8_t b = ( uint8_t )value;
+    return rec_append( self, &b, 1 );
+}
+
+
+static rc_t rec_u16( bam_out * self, uint32_t value )
+{
+    uint8_t b[ 2 ];
+    set_u16( b, value );
+    return rec_append( self, b, 2 );
+}
+
+
+static rc_t rec_u32( bam_out * self, uint32_t value )
+{
+    uint8_t b[ 4 ];
+    set_u32( b, value );
+    return rec_append( self, b, 4 );
+}
+
+
+static rc_t bam_write( bam_out * self, const void * data, size_t len )
+{
+    rc_t rc = par_gzip_write( self->pgz, data, len );
+    if ( rc == 0 )
+        self->upos += len;
+    else
+        self->rc = rc;
+    return rc;
+}
+
+
+/* ---------------------------------------------------------------------------------------------
+   the header
+--------------------------------------------------------------------------------------------- */
+
+static int cmp_name( const char * a, size_t a_len, const char * b, size_t b_len )
+{
+    int res = memcmp( a, b, a_len < b_len ? a_len : b_len );
+    if ( res == 0 )
+        res = ( a_len < b_len ) ? -1 : ( a_len > b_len ) ? 1 : 0;
+    return res;
+}
+
+
+static bam_out * sort_ctx;
+
+static int CC cmp_ref_ids( const void * a, const void * b )
+{
+    const bam_ref * ra = &sort_ctx->refs[ *( const uint32_t * )a ];
+    const bam_ref * rb = &sort_ctx->refs[ *( const uint32_t * )b ];
+    return cmp_name( ra->name, ra->name_len, rb->name, rb->name_len );
+}
+
+
+/* the id of the reference, -1 for '*', -2 if it is not in the header */
+static int32_t find_ref( bam_out * self, const char * name, size_t len )
+{
+    uint32_t lo = 0, hi = self->n_refs;
+
+    if ( name == NULL || len == 0 || ( len == 1 && name[ 0 ] == '*' ) )
+        return -1;
+
+    /* records come grouped by reference */
+    if ( self->last_ref >= 0 )
+    {
+        const bam_ref * r = &self->refs[ self->last_ref ];
+        if ( cmp_name( name, len, r->name, r->name_len ) == 0 )
+            return self->last_ref;
+    }
+
+    while ( lo < hi )
+    {
+        uint32_t mid = ( lo + hi ) / 2;
+        const bam_ref * r = &self->refs[ self->by_name[ mid ] ];
+        int cmp = cmp_name( name, len, r->name, r->name_len );
+        if ( cmp == 0 )
+        {
+            self->last_ref = self->by_name[ mid ];
+            return self->last_ref;
+        }
+        if ( cmp < 0 )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return -2;
+}
+
+
+static int32_t find_ref_checked( bam_out * self, const char * name, size_t len, rc_t * rc )
+{
+    int32_t id = find_ref( self, name, len );
+    if ( id == -2 )
+    {
+        *rc = RC( rcExe, rcFile, rcWriting, rcId, rcNotFound );
+        PLOGERR( klogErr, ( klogErr, *rc, "reference '$(name)' is not in the header",
+                            "name=%.*s", ( uint32_t )len, name ) );
+    }
+    return id;
+}
+
+
+/* picks SN and LN out of a @SQ-line */
+static rc_t header_sq( bam_out * self, const char * line, size_t len )
+{
+    const char * sn = NULL;
+    size_t sn_len = 0;
+    uint32_t ln = 0;
+    size_t i = 0;
+    rc_t rc;
+
+    while ( i < len )
+    {
+        size_t start = i;
+        while ( i < len && line[ i ] != '\t' )
+            ++i;
+        if ( i - start > 3 && line[ start ] == 'S' && line[ start + 1 ] == 'N' && line[ start + 2 ] == ':' )
+        {
+            sn = line + start + 3;
+            sn_len = i - start - 3;
+        }
+        else if ( i - start > 3 && line[ start ] == 'L' && line[ start + 1 ] == 'N' && line[ start + 2 ] == ':' )
+        {
+            size_t k;
+            for ( k = start + 3, ln = 0; k < i && line[ k ] >= '0' && line[ k ] <= '9'; ++k )
+                ln = ln * 10 + ( line[ k ] - '0' );
+        }
+        ++i;
+    }
+    if ( sn == NULL )
+        return 0;
+
+    rc = grow( ( void ** )&self->refs, &self->refs_cap, self->n_refs + 1, sizeof *self->refs );
+    if ( rc == 0 )
+    {
+        bam_ref * r = &self->refs[ self->n_refs ];
+        r->name = malloc( sn_len + 1 );
+        if ( r->name == NULL )
+            rc = RC( rcExe, rcBuffer, rcInserting, rcMemory, rcExhausted );
+        else
+        {
+            memmove( r->name, sn, sn_len );
+            r->name[ sn_len ] = 0;
+            r->name_len = sn_len;
+            r->length = ln;
+            self->n_refs++;
+        }
+    }
+    return rc;
+}
+
+
+static rc_t header_line( bam_out * self, const char * line, size_t len )
+{
+    rc_t rc;
+
+    if ( self->hdr_written )
+    {
+        PLOGMSG( klogWarn, ( klogWarn, "header-line after the first record dropped: '$(line)'",
+                             "line=%.*s", ( uint32_t )len, line ) );
+        return 0;
+    }
+
+    rc = grow( ( void ** )&self->hdr, &self->hdr_cap, self->hdr_len + len + 1, 1 );
+    if ( rc == 0 )
+    {
+        memmove( self->hdr + self->hdr_len, line, len );
+        self->hdr_len += len;
+        self->hdr[ self->hdr_len++ ] = '\n';
+        if ( len > 3 && line[ 1 ] == 'S' && line[ 2 ] == 'Q' && line[ 3 ] == '\t' )
+            rc = header_sq( self, line, len );
+    }
+    return rc;
+}
+
+
+static rc_t CC on_bgzf_block( void * data, size_t comp_len )
+{
+    bam_out * self = data;
+    return bam_index_block( self->idx, comp_len );
+}
+
+
+static rc_t write_header( bam_out * self )
+{
+    rc_t rc = 0;
+    uint8_t b[ 4 ];
+    uint32_t i;
+
+    self->hdr_written = true;
+
+    if ( self->n_refs > 0 )
+    {
+        self->by_name = malloc( self->n_refs * sizeof *self->by_name );
+        if ( self->by_name == NULL )
+            return RC( rcExe, rcBuffer, rcConstructing, rcMemory, rcExhausted );
+        for ( i = 0; i < self->n_refs; ++i )
+            self->by_name[ i ] = i;
+        sort_ctx = self;
+        qsort( self->by_name, self->n_refs, sizeof *self->by_name, cmp_ref_ids );
+        sort_ctx = NULL;
+    }
+
+    if ( self->idx_dst != NULL )
+    {
+        rc = make_bam_index( &self->idx, self->n_refs, PAR_GZIP_BGZF_BLOCK );
+        if ( rc == 0 )
+            rc = par_gzip_set_on_block( self->pgz, on_bgzf_block, self );
+        if ( rc != 0 )
+            return rc;
+    }
+
+    rc = bam_write( self, "BAM\1", 4 );
+    if ( rc == 0 )
+    {
+        set_u32( b, ( uint32_t )self->hdr_len );
+        rc = bam_write( self, b, 4 );
+    }
+    if ( rc == 0 && self->hdr_len > 0 )
+        rc = bam_write( self, self->hdr, self->hdr_len );
+    if ( rc == 0 )
+    {
+        set_u32( b, self->n_refs );
+        rc = bam_write( self, b, 4 );
+    }
+    for ( i = 0; rc == 0 && i < self->n_refs; ++i )
+    {
+        const bam_ref * r = &self->refs[ i ];
+        set_u32( b, ( uint32_t )r->name_len + 1 );
+        rc = bam_write( self, b, 4 );
+        if ( rc == 0 )
+            rc = bam_write( self, r->name, r->name_len + 1 );
+        if ( rc == 0 )
+        {
+            set_u32( b, r->length );
+            rc = bam_write( self, b, 4 );
+        }
+    }
+    return rc;
+}
+
+
+/* ---------------------------------------------------------------------------------------------
+   the record
+--------------------------------------------------------------------------------------------- */
+
+static rc_t rec_start( bam_out * self )
+{
+    if ( self->rc != 0 )
+        return self->rc;
+    if ( !self->hdr_written )
+    {
+        rc_t rc = write_header( self );
+        if ( rc != 0 )
+        {
+            self->rc = rc;
+            return rc;
+        }
+    }
+    self->rec_len = 0;
+    self->ref_id = -1;
+    self->pos = -1;
+    self->ref_span = 0;
+    self->next_ref_id = -1;
+    self->next_pos = -1;
+    self->tlen = 0;
+    self->l_seq = 0;
+    self->flags = 0;
+    self->n_cigar = 0;
+    self->mapq = 255;
+    self->l_qname = 0;
+    /* the fixed fields are filled in by rec_end() */
+    return rec_append( self, self->fixed_zero, BAM_REC_FIXED );
+}
+
+
+static rc_t rec_qname( bam_out * self, const char * name, size_t len )
+{
+    rc_t rc;
+    if ( len == 0 )
+    {
+        name = "*";
+        len = 1;
+    }
+    /* l_qname is one byte, with the terminating 0 */
+    if ( len > BAM_MAX_QNAME )
+    {
+        rc = RC( rcExe, rcFile, rcWriting, rcName, rcTooLong );
+        PLOGERR( klogErr, ( klogErr, rc, "QNAME '$(name)' is longer than $(max) characters",
+                            "name=%.*s,max=%u", ( uint32_t )len, name, BAM_MAX_QNAME ) );
+        return rc;
+    }
+    rc = rec_append( self, name, len );
+    if ( rc == 0 )
+        rc = rec_u8( self, 0 );
+    self->l_qname = ( uint8_t )( len + 1 );
+    return rc;
+}
+
+
+static rc_t rec_core( bam_out * self, uint32_t flags, const char * ref_name, size_t ref_name_len,
+                      int32_t pos, uint8_t mapq )
+{
+    rc_t rc = 0;
+    self->flags = flags;
+    self->ref_id = find_ref_checked( self, ref_name, ref_name_len, &rc );
+    self->pos = pos;
+    self->mapq = mapq;
+    return rc;
+}
+
+
+static rc_t rec_cigar( bam_out * self, const char * cigar, size_t len )
+{
+    static const char ops[] = "MIDNSHP=X";
+    rc_t rc = 0;
+    size_t i = 0;
+
+    if ( len == 1 && cigar[ 0 ] == '*' )
+        return 0;
+
+    while ( rc == 0 && i < len )
+    {
+        uint32_t n = 0;
+        const char * op;
+        while ( i < len && cigar[ i ] >= '0' && cigar[ i ] <= '9' )
+            n = n * 10 + ( cigar[ i++ ] - '0' );
+        op = ( i < len && cigar[ i ] != 0 ) ? strchr( ops, cigar[ i ] ) : NULL;
+        if ( op == NULL || self->n_cigar == 0xffff )
+        {
+            rc = RC( rcExe, rcData, rcConverting, rcData, rcInvalid );
+            PLOGERR( klogErr, ( klogErr, rc, "cannot encode cigar '$(cigar)'",
+                                "cigar=%.*s", ( uint32_t )len, cigar ) );
+        }
+        else
+        {
+            uint32_t code = ( uint32_t )( op - ops );
+            rc = rec_u32( self, ( n << 4 ) | code );
+            self->n_cigar++;
+            /* M D N = X consume the reference */
+            if ( code == 0 || code == 2 || code == 3 || code == 7 || code == 8 )
+                self->ref_span += n;
+            ++i;
+        }
+    }
+    return rc;
+}
+
+
+static rc_t rec_mate( bam_out * self, const char * name, size_t len, int32_t pos, int32_t tlen )
+{
+    rc_t rc = 0;
+    if ( len == 1 && name[ 0 ] == '=' )
+        self->next_ref_id = self->ref_id;
+    else
+        self->next_ref_id = find_ref_checked( self, name, len, &rc );
+    self->next_pos = pos;
+    self->tlen = tlen;
+    return rc;
+}
+
+
+/* "=ACMGRSVTWYHKDBN", made by make_bam_out() before there are workers */
+static uint8_t seq_code[ 256 ];
+
+static void make_seq_code( void )
+{
+    static const char nt16[] = "=ACMGRSVTWYHKDBN";
+    size_t i;
+    for ( i = 0; i < 256; ++i )
+        seq_code[ i ] = 15;
+    for ( i = 0; i < 16; ++i )
+    {
+        seq_code[ ( uint8_t )nt16[ i ] ] = ( uint8_t )i;
+        seq_code[ ( uint8_t )( nt16[ i ] | 0x20 ) ] = ( uint8_t )i;
+    }
+}
+
+
+static rc_t rec_seq( bam_out * self, const char * seq, size_t len )
+{
+    const uint8_t * code = seq_code;
+    rc_t rc;
+    size_t i;
+
+    if ( len == 1 && seq[ 0 ] == '*' )
+        len = 0;
+    self->l_seq = ( int32_t )len;
+
+    rc = grow( ( void ** )&self->rec, &self->rec_cap, self->rec_len + ( len + 1 ) / 2, 1 );
+    if ( rc == 0 )
+    {
+        uint8_t * dst = self->rec + self->rec_len;
+        for ( i = 0; i + 1 < len; i += 2 )
+            *dst++ = ( uint8_t )( ( code[ ( uint8_t )seq[ i ] ] << 4 ) | code[ ( uint8_t )seq[ i + 1 ] ] );
+        if ( i < len )
+            *dst++ = ( uint8_t )( code[ ( uint8_t )seq[ i ] ] << 4 );
+        self->rec_len += ( len + 1 ) / 2;
+    }
+    return rc;
+}
+
+
+static rc_t rec_qual( bam_out * self, const char * qual, size_t len, const uint8_t * quant_matrix )
+{
+    size_t i, n = ( size_t )self->l_seq;
+    rc_t rc = grow( ( void ** )&self->rec, &self->rec_cap, self->rec_len + n, 1 );
+    if ( rc == 0 )
+    {
+        uint8_t * dst = self->rec + self->rec_len;
+        if ( len != n || ( len == 1 && qual[ 0 ] == '*' ) )
+            memset( dst, 0xff, n );
+        else if ( quant_matrix != NULL )
+            for ( i = 0; i < n; ++i )
+                dst[ i ] = quant_matrix[ ( uint8_t )( qual[ i ] - 33 ) ];
+        else
+            for ( i = 0; i < n; ++i )
+                dst[ i ] = ( uint8_t )( qual[ i ] - 33 );
+        self->rec_len += n;
+    }
+    return rc;
+}
+
+
+static rc_t rec_tag( bam_out * self, const char * tag, char type )
+{
+    char b[ 3 ];
+    b[ 0 ] = tag[ 0 ];
+    b[ 1 ] = tag[ 1 ];
+    b[ 2 ] = type;
+    return rec_append( self, b, 3 );
+}
+
+
+static rc_t rec_tag_Z( bam_out * self, const char * tag, char type, const char * value, size_t len )
+{
+    rc_t rc = rec_tag( self, tag, type );
+    if ( rc == 0 )
+        rc = rec_append( self, value, len );
+    if ( rc == 0 )
+        rc = rec_u8( self, 0 );
+    return rc;
+}
+
+
+/* integers go into the smallest type holding them */
+static rc_t rec_tag_i( bam_out * self, const char * tag, int64_t value )
+{
+    rc_t rc;
+    if ( value < 0 )
+    {
+        if ( value >= -128 )
+        {
+            rc = rec_tag( self, tag, 'c' );
+            if ( rc == 0 ) rc = rec_u8( self, ( uint32_t )value );
+        }
+        else if ( value >= -32768 )
+        {
+            rc = rec_tag( self, tag, 's' );
+            if ( rc == 0 ) rc = rec_u16( self, ( uint32_t )value );
+        }
+        else
+        {
+            rc = rec_tag( self, tag, 'i' );
+            if ( rc == 0 ) rc = rec_u32( self, ( uint32_t )value );
+        }
+    }
+    else if ( value <= 0xff )
+    {
+        rc = rec_tag( self, tag, 'C' );
+        if ( rc == 0 ) rc = rec_u8( self, ( uint32_t )value );
+    }
+    else if ( value <= 0xffff )
+    {
+        rc = rec_tag( self, tag, 'S' );
+        if ( rc == 0 ) rc = rec_u16( self, ( uint32_t )value );
+    }
+    else
+    {
+        rc = rec_tag( self, tag, 'I' );
+        if ( rc == 0 ) rc = rec_u32( self, ( uint32_t )value );
+    }
+    return rc;
+}
+
+
+static int64_t text_int( const char * s, size_t len, size_t * used )
+{
+    int64_t value = 0;
+    bool neg = false;
+    size_t i = 0;
+
+    if ( i < len && ( s[ i ] == '-' || s[ i ] == '+' ) )
+        neg = ( s[ i++ ] == '-' );
+    while ( i < len && s[ i ] >= '0' && s[ i ] <= '9' )
+        value = value * 10 + ( s[ i++ ] - '0' );
+    if ( used != NULL )
+        *used = i;
+    return neg ? -value : value;
+}
+
+
+static rc_t rec_tag_f( bam_out * self, const char * value, size_t len )
+{
+    char tmp[ 64 ];
+    float f;
+    uint32_t u;
+
+    if ( len >= sizeof tmp )
+        len = sizeof tmp - 1;
+    memmove( tmp, value, len );
+    tmp[ len ] = 0;
+    f = ( float )strtod( tmp, NULL );
+    memmove( &u, &f, sizeof u );
+    return rec_u32( self, u );
+}
+
+
+/* B:t,v1,v2,... */
+static rc_t rec_tag_B( bam_out * self, const char * tag, const char * value, size_t len )
+{
+    char sub = ( len > 0 ) ? value[ 0 ] : 0;
+    size_t count_at, i = 1;
+    uint32_t count = 0;
+    rc_t rc;
+
+    if ( sub == 0 || strchr( "cCsSiIf", sub ) == NULL )
+        return rec_tag_Z( self, tag, 'Z', value, len );
+
+    rc = rec_tag( self, tag, 'B' );
+    if ( rc == 0 )
+        rc = rec_u8( self, sub );
+    count_at = self->rec_len;
+    if ( rc == 0 )
+        rc = rec_u32( self, 0 );
+    while ( rc == 0 && i < len && value[ i ] == ',' )
+    {
+        size_t start = ++i;
+        while ( i < len && value[ i ] != ',' )
+            ++i;
+        switch ( sub )
+        {
+            case 'c' :
+            case 'C' : rc = rec_u8( self, ( uint32_t )text_int( value + start, i - start, NULL ) ); break;
+            case 's' :
+            case 'S' : rc = rec_u16( self, ( uint32_t )text_int( value + start, i - start, NULL ) ); break;
+            case 'f' : rc = rec_tag_f( self, value + start, i - start ); break;
+            default  : rc = rec_u32( self, ( uint32_t )text_int( value + start, i - start, NULL ) ); break;
+        }
+        ++count;
+    }
+    if ( rc == 0 )
+        set_u32( self->rec + count_at, count );
+    return rc;
+}
+
+
+static rc_t rec_tags_text( bam_out * self, const char * text, size_t len )
+{
+    rc_t rc = 0;
+    size_t i = 0;
+
+    while ( rc == 0 && i < len )
+    {
+        size_t start = i, tag_len;
+        const char * tag = text + start;
+        while ( i < len && text[ i ] != '\t' )
+            ++i;
+        tag_len = i - start;
+        ++i;
+        if ( tag_len == 0 )
+            continue;
+        if ( tag_len < 5 || tag[ 2 ] != ':' || tag[ 4 ] != ':' )
+        {
+            rc = RC( rcExe, rcData, rcConverting, rcData, rcInvalid );
+            PLOGERR( klogErr, ( klogErr, rc, "cannot encode tag '$(tag)'",
+                                "tag=%.*s", ( uint32_t )tag_len, tag ) );
+            break;
+        }
+        switch ( tag[ 3 ] )
+        {
+            case 'A' : rc = rec_tag( self, tag, 'A' );
+                       if ( rc == 0 )
+                           rc = rec_u8( self, tag_len > 5 ? tag[ 5 ] : ' ' );
+                       break;
+            case 'i' : rc = rec_tag_i( self, tag, text_int( tag + 5, tag_len - 5, NULL ) ); break;
+            case 'f' : rc = rec_tag( self, tag, 'f' );
+                       if ( rc == 0 )
+                           rc = rec_tag_f( self, tag + 5, tag_len - 5 );
+                       break;
+            case 'H' : rc = rec_tag_Z( self, tag, 'H', tag + 5, tag_len - 5 ); break;
+            case 'B' : rc = rec_tag_B( self, tag, tag + 5, tag_len - 5 ); break;
+            default  : rc = rec_tag_Z( self, tag, 'Z', tag + 5, tag_len - 5 ); break;
+        }
+    }
+    return rc;
+}
+
+
+/* writes an encoded record, end is the end of its alignment on the reference */
+static rc_t rec_write( bam_out * self, const uint8_t * rec, size_t len,
+                       int32_t ref_id, int32_t pos, int32_t end, uint32_t flags )
+{
+    uint64_t ustart = self->upos;
+    rc_t rc = bam_write( self, rec, len );
+    if ( rc == 0 && self->idx != NULL )
+    {
+        if ( ref_id < 0 || pos < 0 )
+            rc = bam_index_add( self->idx, -1, 0, 1, false, ustart, self->upos );
+        else
+            rc = bam_index_add( self->idx, ref_id, pos, end, ( flags & 0x4 ) == 0, ustart, self->upos );
+        if ( rc != 0 )
+            self->rc = rc;
+    }
+    return rc;
+}
+
+
+static rc_t rec_end( bam_out * self )
+{
+    uint8_t * r = self->rec;
+    uint32_t bin;
+    int32_t end = self->pos + ( self->ref_span > 0 ? self->ref_span : 1 );
+
+    if ( self->ref_id < 0 || self->pos < 0 )
+        bin = BAM_UNMAPPED_BIN;
+    else
+        bin = bam_reg2bin( self->pos, end );
+
+    set_u32( r, ( uint32_t )( self->rec_len - 4 ) );
+    set_u32( r + 4, ( uint32_t )self->ref_id );
+    set_u32( r + 8, ( uint32_t )self->pos );
+    r[ 12 ] = self->l_qname;
+    r[ 13 ] = self->mapq;
+    set_u16( r + 14, bin );
+    set_u16( r + 16, self->n_cigar );
+    set_u16( r + 18, self->flags );
+    set_u32( r + 20, ( uint32_t )self->l_seq );
+    set_u32( r + 24, ( uint32_t )self->next_ref_id );
+    set_u32( r + 28, ( uint32_t )self->next_pos );
+    set_u32( r + 32, ( uint32_t )self->tlen );
+
+    if ( self->sink != NULL )
+        /* a worker: the parent writes and indexes it in bam_out_replay() */
+        return self->sink( self->sink_data, self->rec, self->rec_len );
+    return rec_write( self, self->rec, self->rec_len, self->ref_id, self->pos, end, self->flags );
+}
+
+
+/* ---------------------------------------------------------------------------------------------
+   SAM-text into BAM
+--------------------------------------------------------------------------------------------- */
+
+static rc_t text_record( bam_out * self, const char * line, size_t len )
+{
+    const char * f[ 11 ];
+    size_t f_len[ 11 ];
+    uint32_t n = 0;
+    size_t i = 0;
+    rc_t rc;
+
+    while ( n < 11 && i <= len )
+    {
+        size_t start = i;
+        while ( i < len && line[ i ] != '\t' )
+            ++i;
+        f[ n ] = line + start;
+        f_len[ n++ ] = i - start;
+        ++i;
+    }
+    if ( n < 11 )
+    {
+        rc = RC( rcExe, rcData, rcConverting, rcData, rcInvalid );
+        PLOGERR( klogErr, ( klogErr, rc, "cannot encode SAM-line '$(line)'",
+                            "line=%.*s", ( uint32_t )len, line ) );
+        return rc;
+    }
+
+    rc = rec_start( self );
+    if ( rc == 0 )
+        rc = rec_qname( self, f[ 0 ], f_len[ 0 ] );
+    if ( rc == 0 )
+        rc = rec_core( self, ( uint32_t )text_int( f[ 1 ], f_len[ 1 ], NULL ), f[ 2 ], f_len[ 2 ],
+                       ( int32_t )text_int( f[ 3 ], f_len[ 3 ], NULL ) - 1,
+                       ( uint8_t )text_int( f[ 4 ], f_len[ 4 ], NULL ) );
+    if ( rc == 0 )
+        rc = rec_cigar( self, f[ 5 ], f_len[ 5 ] );
+    if ( rc == 0 )
+        rc = rec_mate( self, f[ 6 ], f_len[ 6 ], ( int32_t )text_int( f[ 7 ], f_len[ 7 ], NULL ) - 1,
+                       ( int32_t )text_int( f[ 8 ], f_len[ 8 ], NULL ) );
+    if ( rc == 0 )
+        rc = rec_seq( self, f[ 9 ], f_len[ 9 ] );
+    if ( rc == 0 )
+        rc = rec_qual( self, f[ 10 ], f_len[ 10 ], NULL );
+    if ( rc == 0 && i < len )
+        rc = rec_tags_text( self, line + i, len - i );
+    if ( rc == 0 )
+        rc = rec_end( self );
+    return rc;
+}
+
+
+static rc_t text_line( bam_out * self, const char * line, size_t len )
+{
+    if ( len > 0 && line[ len - 1 ] == '\r' )
+        --len;
+    if ( len == 0 )
+        return 0;
+    if ( line[ 0 ] == '@' )
+        return header_line( self, line, len );
+    return text_record( self, line, len );
+}
+
+
+rc_t CC bam_out_text( void * data, const char * buffer, size_t bufsize, size_t * num_writ )
+{
+    bam_out * self = data;
+    rc_t rc = 0;
+    size_t done = 0;
+
+    *num_writ = 0;
+    while ( rc == 0 && done < bufsize )
+    {
+        const char * nl = memchr( buffer + done, '\n', bufsize - done );
+        size_t len = ( nl == NULL ) ? bufsize - done : ( size_t )( nl - ( buffer + done ) );
+
+        if ( nl != NULL && self->line_len == 0 )
+            /* a complete line, no need to copy it */
+            rc = text_line( self, buffer + done, len );
+        else
+        {
+            rc = grow( ( void ** )&self->line, &self->line_cap, self->line_len + len, 1 );
+            if ( rc == 0 )
+            {
+                memmove( self->line + self->line_len, buffer + done, len );
+                self->line_len += len;
+                if ( nl != NULL )
+                {
+                    rc = text_line( self, self->line, self->line_len );
+                    self->line_len = 0;
+                }
+            }
+        }
+        done += len + ( nl != NULL ? 1 : 0 );
+    }
+    if ( rc == 0 )
+        *num_writ = bufsize;
+    return rc;
+}
+
+
+/* ---------------------------------------------------------------------------------------------
+   direct encoding
+--------------------------------------------------------------------------------------------- */
+
+rc_t bam_rec_start( bam_out * self )
+{
+    if ( self == NULL )
+        return RC( rcExe, rcFile, rcWriting, rcSelf, rcNull );
+    return rec_start( self );
+}
+
+
+rc_t bam_rec_qname( bam_out * self, const char * name, size_t len )
+{
+    return rec_qname( self, name, len );
+}
+
+
+rc_t bam_rec_core( bam_out * self, uint32_t flags, const char * ref_name, size_t ref_name_len,
+                   int32_t pos, uint8_t mapq )
+{
+    return rec_core( self, flags, ref_name, ref_name_len, pos, mapq );
+}
+
+
+rc_t bam_rec_cigar( bam_out * self, const char * cigar, size_t len )
+{
+    return rec_cigar( self, cigar, len );
+}
+
+
+rc_t bam_rec_mate( bam_out * self, const char * mate_ref_name, size_t len, int32_t pos, int32_t tlen )
+{
+    return rec_mate( self, mate_ref_name, len, pos, tlen );
+}
+
+
+rc_t bam_rec_seq( bam_out * self, const char * seq, size_t len )
+{
+    return rec_seq( self, seq, len );
+}
+
+
+rc_t bam_rec_qual( bam_out * self, const char * qual, size_t len, const uint8_t * quant_matrix )
+{
+    return rec_qual( self, qual, len, quant_matrix );
+}
+
+
+rc_t bam_rec_tag_Z( bam_out * self, const char * tag, const char * value, size_t len )
+{
+    return rec_tag_Z( self, tag, 'Z', value, len );
+}
+
+
+rc_t bam_rec_tag_i( bam_out * self, const char * tag, int64_t value )
+{
+    return rec_tag_i( self, tag, value );
+}
+
+
+rc_t bam_rec_tag_A( bam_out * self, const char * tag, char value )
+{
+    rc_t rc = rec_tag( self, tag, 'A' );
+    if ( rc == 0 )
+        rc = rec_u8( self, ( uint8_t )value );
+    return rc;
+}
+
+
+rc_t bam_rec_tags_text( bam_out * self, const char * text, size_t len )
+{
+    return rec_tags_text( self, text, len );
+}
+
+
+rc_t bam_rec_end( bam_out * self )
+{
+    return rec_end( self );
+}
+
+
+/* ---------------------------------------------------------------------------------------------
+   records of workers
+--------------------------------------------------------------------------------------------- */
+
+/* the span of an encoded record on the reference, from its cigar */
+static int32_t record_span( const uint8_t * r, size_t len )
+{
+    size_t at = BAM_REC_FIXED + r[ 12 ];
+    uint32_t n_cigar = get_u16( r + 16 );
+    int32_t span = 0;
+
+    for ( ; n_cigar > 0 && at + 4 <= len; --n_cigar, at += 4 )
+    {
+        uint32_t op = get_u32( r + at );
+        uint32_t code = op & 0xf;
+        /* M D N = X consume the reference */
+        if ( code == 0 || code == 2 || code == 3 || code == 7 || code == 8 )
+            span += ( int32_t )( op >> 4 );
+    }
+    return span;
+}
+
+
+rc_t bam_out_replay( bam_out * self, const void * data, size_t len )
+{
+    const uint8_t * r = data;
+    bam_out * parent;
+    rc_t rc;
+
+    if ( self == NULL || self->parent == NULL )
+        return RC( rcExe, rcFile, rcWriting, rcSelf, rcNull );
+    parent = self->parent;
+    rc = parent->rc;
+
+    while ( rc == 0 && len > 0 )
+    {
+        size_t rec_len = ( len >= 4 ) ? get_u32( r ) + ( size_t )4 : 0;
+        if ( rec_len < BAM_REC_FIXED || rec_len > len )
+            rc = RC( rcExe, rcData, rcWriting, rcData, rcCorrupt );
+        else
+        {
+            int32_t ref_id = ( int32_t )get_u32( r + 4 );
+            int32_t pos = ( int32_t )get_u32( r + 8 );
+            int32_t span = record_span( r, rec_len );
+            rc = rec_write( parent, r, rec_len, ref_id, pos, pos + ( span > 0 ? span : 1 ), get_u16( r + 18 ) );
+            r += rec_len;
+            len -= rec_len;
+        }
+    }
+    return rc;
+}
+
+
+rc_t make_bam_out_worker( bam_out ** self, bam_out * parent, bam_out_sink sink, void * sink_data )
+{
+    rc_t rc;
+    bam_out * o;
+
+    if ( self == NULL )
+        return RC( rcExe, rcFile, rcConstructing, rcSelf, rcNull );
+    *self = NULL;
+    if ( parent == NULL || parent->parent != NULL || sink == NULL )
+        return RC( rcExe, rcFile, rcConstructing, rcParam, rcInvalid );
+
+    /* the references are known once the header is written */
+    rc = parent->rc;
+    if ( rc == 0 && !parent->hdr_written )
+    {
+        rc = write_header( parent );
+        if ( rc != 0 )
+            parent->rc = rc;
+    }
+    if ( rc != 0 )
+        return rc;
+
+    o = calloc( 1, sizeof *o );
+    if ( o == NULL )
+        return RC( rcExe, rcFile, rcConstructing, rcMemory, rcExhausted );
+
+    /* shared with the parent, read only from now on */
+    o->refs = parent->refs;
+    o->n_refs = parent->n_refs;
+    o->by_name = parent->by_name;
+    o->hdr_written = true;
+    o->last_ref = -1;
+    o->parent = parent;
+    o->sink = sink;
+    o->sink_data = sink_data;
+    *self = o;
+    return 0;
+}
+
+
+/* ---------------------------------------------------------------------------------------------
+   make / release
+--------------------------------------------------------------------------------------------- */
+
+rc_t release_bam_out( bam_out * self )
+{
+    rc_t rc;
+    uint32_t i;
+
+    if ( self == NULL )
+        return 0;
+
+    if ( self->parent != NULL )
+    {
+        /* a worker owns only what it encodes */
+        rc = self->rc;
+        free( self->line );
+        free( self->rec );
+        free( self );
+        return rc;
+    }
+
+    rc = self->rc;
+    if ( rc == 0 && self->line_len > 0 )
+        rc = text_line( self, self->line, self->line_len );
+    /* a BAM-file without records still has a header */
+    if ( rc == 0 && !self->hdr_written )
+        rc = write_header( self );
+    if ( rc != 0 )
+        self->rc = rc;
+
+    /* the last blocks are reported to the index while they are written */
+    {
+        rc_t rc2 = release_par_gzip( self->pgz );
+        if ( rc == 0 )
+            rc = rc2;
+    }
+
+    if ( rc == 0 && self->idx != NULL && bam_index_sorted( self->idx ) )
+    {
+        rc = bam_index_write( self->idx, self->idx_dst );
+        if ( rc != 0 )
+            LOGERR( klogErr, rc, "cannot write BAM-index" );
+    }
+
+    release_bam_index( self->idx );
+    KFileRelease( self->idx_dst );
+    for ( i = 0; i < self->n_refs; ++i )
+        free( self->refs[ i ].name );
+    free( self->refs );
+    free( self->by_name );
+    free( self->hdr );
+    free( self->line );
+    free( self->rec );
+    free( self );
+    return rc;
+}
+
+
+rc_t make_bam_out( bam_out ** self, KFile * dst, uint32_t num_threads, KFile * index_dst )
+{
+    rc_t rc;
+    bam_out * o;
+
+    if ( self == NULL )
+        return RC( rcExe, rcFile, rcConstructing, rcSelf, rcNull );
+    *self = NULL;
+
+    o = calloc( 1, sizeof *o );
+    if ( o == NULL )
+        return RC( rcExe, rcFile, rcConstructing, rcMemory, rcExhausted );
+
+    o->last_ref = -1;
+    make_seq_code();
+    rc = make_par_gzip( &o->pgz, dst, pgz_bgzf, num_threads );
+    if ( rc == 0 && index_dst != NULL )
+    {
+        rc = KFileAddRef( index_dst );
+        if ( rc == 0 )
+            o->idx_dst = index_dst;
+    }
+    if ( rc != 0 )
+    {
+        if ( o->pgz != NULL )
+            release_par_gzip( o->pgz );
+        free( o );
+        return rc;
+    }
+
+    *self = o;
+    return 0;
+}
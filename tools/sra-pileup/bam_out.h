@@ -0,0 +1,104 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_bam_out_
+#define _h_bam_out_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/rc.h>
+#include <kfs/file.h>
+
+/* writes BAM into 'dst' in BGZF-blocks compressed on 'num_threads' threads,
+   with 'index_dst' != NULL a BAI-index is written into it at the end,
+   if the records came sorted by position
+
+   the header is made from the SAM-header-lines given as text, it is written
+   before the first record ( the @SQ-lines define the references )
+
+   records can be encoded directly with the bam_rec_...() functions,
+   a QNAME longer than 254 characters is an error */
+typedef struct bam_out bam_out;
+
+rc_t make_bam_out( bam_out ** self, KFile * dst, uint32_t num_threads, KFile * index_dst );
+
+rc_t release_bam_out( bam_out * self );
+
+/* a KOut-writer: SAM-text ( header-lines and records ) is converted into BAM */
+rc_t CC bam_out_text( void * self, const char * buffer, size_t bufsize, size_t * num_writ );
+
+
+/* a worker encodes records ( directly or from SAM-text ) on another thread with the
+   references of 'parent', whose header is written now; instead of being written the
+   finished records are handed to 'sink', the parent writes them in bam_out_replay() */
+typedef rc_t ( CC * bam_out_sink )( void * data, const void * rec, size_t len );
+
+rc_t make_bam_out_worker( bam_out ** self, bam_out * parent, bam_out_sink sink, void * sink_data );
+
+/* writes records the worker 'self' handed to its sink into its parent,
+   on the thread that writes the parent */
+rc_t bam_out_replay( bam_out * self, const void * data, size_t len );
+
+
+/* encoding a record field by field, in the order of the SAM-fields */
+rc_t bam_rec_start( bam_out * self );
+
+rc_t bam_rec_qname( bam_out * self, const char * name, size_t len );
+
+/* pos is zero-based, ref_name == NULL or "*" for no reference */
+rc_t bam_rec_core( bam_out * self, uint32_t flags, const char * ref_name, size_t ref_name_len,
+                   int32_t pos, uint8_t mapq );
+
+rc_t bam_rec_cigar( bam_out * self, const char * cigar, size_t len );
+
+/* mate_ref_name "=" is the reference of the record, pos is zero-based */
+rc_t bam_rec_mate( bam_out * self, const char * mate_ref_name, size_t len, int32_t pos, int32_t tlen );
+
+rc_t bam_rec_seq( bam_out * self, const char * seq, size_t len );
+
+/* quality as SAM-text ( phred + 33 ), optionally mapped by quant_matrix */
+rc_t bam_rec_qual( bam_out * self, const char * qual, size_t len, const uint8_t * quant_matrix );
+
+rc_t bam_rec_tag_Z( bam_out * self, const char * tag, const char * value, size_t len );
+
+rc_t bam_rec_tag_i( bam_out * self, const char * tag, int64_t value );
+
+rc_t bam_rec_tag_A( bam_out * self, const char * tag, char value );
+
+/* tab-separated tags in SAM-text ( TG:T:value ) */
+rc_t bam_rec_tags_text( bam_out * self, const char * text, size_t len );
+
+rc_t bam_rec_end( bam_out * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
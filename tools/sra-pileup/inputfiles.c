@@ -341,6 +341,7 @@ rc_t discover_input_files( input_files **self, const VDBManager *mgr,
         {
             VectorInit( &( ipf->dbs ), 0, 5 );
             VectorInit( &( ipf->tabs ), 0, 5 );
+            ipf->reflist_options = reflist_options;
             rc = split_input_files( ipf, mgr, src, reflist_options );
         }
         if ( rc != 0 )
@@ -83,6 +83,7 @@ typedef struct input_files
     uint32_t database_count;
     uint32_t table_count;
     uint32_t not_found_count;
+    uint32_t reflist_options;   /* the reflists were made with, for making more of them */
 
     Vector dbs;
     Vector tabs;
@@ -27,6 +27,129 @@
 #include "matecache.h"
 #include <sysalloc.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define MATE_HASH_INITIAL_SLOTS 4096
+#define MATE_HASH_SLOT_BYTES ( sizeof( int64_t ) + sizeof( uint64_t ) + sizeof( uint16_t ) )
+
+
+static size_t mate_hash_bytes( size_t slots )
+{
+    return slots * MATE_HASH_SLOT_BYTES;
+}
+
+
+static void mate_hash_whack( mate_hash * self )
+{
+    free( self->key );
+    free( self->value );
+    free( self->flags );
+    memset( self, 0, sizeof * self );
+}
+
+
+static rc_t mate_hash_alloc( mate_hash * self, size_t slots )
+{
+    self->key = calloc( slots, sizeof self->key[ 0 ] );
+    self->value = malloc( slots * sizeof self->value[ 0 ] );
+    self->flags = malloc( slots * sizeof self->flags[ 0 ] );
+    self->mask = slots - 1;
+    self->count = 0;
+    if ( self->key == NULL || self->value == NULL || self->flags == NULL )
+    {
+        mate_hash_whack( self );
+        return RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    }
+    return 0;
+}
+
+
+/* the alignment-ids come in runs, a multiplicative hash spreads them */
+static size_t mate_hash_slot( const mate_hash * self, int64_t key )
+{
+    return ( size_t )( ( ( uint64_t )key * 0x9E3779B97F4A7C15ULL ) >> 32 ) & self->mask;
+}
+
+
+static size_t mate_hash_find( const mate_hash * self, int64_t key )
+{
+    size_t idx = mate_hash_slot( self, key );
+    while ( self->key[ idx ] != 0 && self->key[ idx ] != key )
+        idx = ( idx + 1 ) & self->mask;
+    return idx;
+}
+
+
+static void mate_hash_put( mate_hash * self, int64_t key, uint64_t value, uint16_t flags )
+{
+    size_t idx = mate_hash_find( self, key );
+    if ( self->key[ idx ] == 0 )
+    {
+        self->key[ idx ] = key;
+        self->count++;
+    }
+    self->value[ idx ] = value;
+    self->flags[ idx ] = flags;
+}
+
+
+static rc_t mate_hash_grow( mate_hash * self )
+{
+    mate_hash bigger;
+    rc_t rc = mate_hash_alloc( &bigger, ( self->mask + 1 ) * 2 );
+    if ( rc == 0 )
+    {
+        size_t idx;
+        for ( idx = 0; idx <= self->mask; ++idx )
+        {
+            if ( self->key[ idx ] != 0 )
+                mate_hash_put( &bigger, self->key[ idx ], self->value[ idx ], self->flags[ idx ] );
+        }
+        mate_hash_whack( self );
+        *self = bigger;
+    }
+    return rc;
+}
+
+
+/* shift the entries following the removed one back, so that no probe-sequence is broken */
+static bool mate_hash_remove( mate_hash * self, int64_t key )
+{
+    size_t hole = mate_hash_find( self, key );
+    size_t idx = hole;
+    if ( self->key[ hole ] == 0 )
+        return false;
+    for ( ;; )
+    {
+        size_t home;
+        idx = ( idx + 1 ) & self->mask;
+        if ( self->key[ idx ] == 0 )
+            break;
+        home = mate_hash_slot( self, self->key[ idx ] );
+        /* the entry at idx can move into the hole, if its home is not in ( hole, idx ] */
+        if ( ( ( idx - home ) & self->mask ) >= ( ( idx - hole ) & self->mask ) )
+        {
+            self->key[ hole ] = self->key[ idx ];
+            self->value[ hole ] = self->value[ idx ];
+            self->flags[ hole ] = self->flags[ idx ];
+            hole = idx;
+        }
+    }
+    self->key[ hole ] = 0;
+    self->count--;
+    return true;
+}
+
+
+static void mate_hash_clear( mate_hash * self )
+{
+    if ( self->count > 0 )
+    {
+        memset( self->key, 0, ( self->mask + 1 ) * sizeof self->key[ 0 ] );
+        self->count = 0;
+    }
+}
+
 
 void release_matecache( matecache * const self )
 {
@@ -37,10 +160,7 @@ void release_matecache( matecache * const self )
             uint32_t idx;
             for ( idx = 0; idx < self->count; ++idx )
             {
-                if ( self->per_file[ idx ].same_ref_64 != NULL )
-                    KVectorRelease( self->per_file[ idx ].same_ref_64 );
-                if ( self->per_file[ idx ].same_ref_16 != NULL )
-                    KVectorRelease( self->per_file[ idx ].same_ref_16 );
+                mate_hash_whack( &self->per_file[ idx ].same_ref );
 
                 if ( self->per_file[ idx ].unaligned_64_a != NULL )
                     KVectorRelease( self->per_file[ idx ].unaligned_64_a );
@@ -54,7 +174,7 @@ void release_matecache( matecache * const self )
 }
 
 
-rc_t make_matecache( matecache **self, uint32_t count )
+rc_t make_matecache( matecache **self, uint32_t count, size_t mem_limit )
 {
     rc_t rc = 0;
 
@@ -68,6 +188,7 @@ rc_t make_matecache( matecache **self, uint32_t count )
     else
     {
         mc->count = count;
+        mc->mem_limit = mem_limit;
         mc->per_file = calloc( sizeof *(mc->per_file), count );
         if ( mc->per_file == NULL )
         {
@@ -79,25 +200,20 @@ rc_t make_matecache( matecache **self, uint32_t count )
             uint32_t idx;
             for ( idx = 0; idx < count && rc == 0; ++idx )
             {
-                rc = KVectorMake( &( mc->per_file[ idx ].same_ref_64 ) );
+                rc = mate_hash_alloc( &( mc->per_file[ idx ].same_ref ), MATE_HASH_INITIAL_SLOTS );
                 if ( rc != 0 )
-                    (void)LOGERR( klogErr, rc, "cannot create KVector (same-ref) U64" );
+                    (void)LOGERR( klogErr, rc, "cannot create hash (same-ref)" );
                 else
                 {
-                    rc = KVectorMake( &( mc->per_file[ idx ].same_ref_16 ) );
+                    mc->per_file[ idx ].maxbytes_same_ref = mate_hash_bytes( MATE_HASH_INITIAL_SLOTS );
+                    rc = KVectorMake( &( mc->per_file[ idx ].unaligned_64_a ) );
                     if ( rc != 0 )
-                        (void)LOGERR( klogErr, rc, "cannot create KVector (same-ref) U16" );
+                        (void)LOGERR( klogErr, rc, "cannot create KVector (unaligned a) U64" );
                     else
                     {
-                        rc = KVectorMake( &( mc->per_file[ idx ].unaligned_64_a ) );
+                        rc = KVectorMake( &( mc->per_file[ idx ].unaligned_64_b ) );
                         if ( rc != 0 )
-                            (void)LOGERR( klogErr, rc, "cannot create KVector (unaligned a) U64" );
-                        else
-                        {
-                            rc = KVectorMake( &( mc->per_file[ idx ].unaligned_64_b ) );
-                            if ( rc != 0 )
-                                (void)LOGERR( klogErr, rc, "cannot create KVector (unaligned b) U64" );
-                        }
+                            (void)LOGERR( klogErr, rc, "cannot create KVector (unaligned b) U64" );
                     }
                 }
             }
@@ -172,25 +288,36 @@ rc_t matecache_insert_same_ref( matecache * const self,
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
+        mate_hash * h = &mcpf->same_ref;
         uint64_t ref_pos_and_tlen = ref_pos;
         ref_pos_and_tlen <<= 32;
         ref_pos_and_tlen |= tlen;
-        rc = KVectorSetU64( mcpf->same_ref_64, key, ref_pos_and_tlen );
-        if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot insert into KVector (same-ref) U64" );
-        else
+
+        /* keep the load below 1/2, grow as long as the memory-limit allows it */
+        if ( ( h->count + 1 ) * 2 > h->mask + 1 )
         {
-            rc = KVectorSetU16( mcpf->same_ref_16, key, flags );
+            size_t bytes = mate_hash_bytes( ( h->mask + 1 ) * 2 );
+            if ( bytes > self->mem_limit )
+            {
+                /* the mate will be read from the table, as if it were not cached */
+                mcpf->rejects_same_ref++;
+                return 0;
+            }
+            rc = mate_hash_grow( h );
             if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot insert into KVector (same-ref) U16" );
-        }
-        if ( rc == 0 )
-        {
-            mcpf->stat_same_ref.count++;
-            if ( mcpf->stat_same_ref.count > mcpf->maxcount_same_ref )
-                mcpf->maxcount_same_ref = mcpf->stat_same_ref.count;
-            mcpf->stat_same_ref.inserts++;
+            {
+                (void)LOGERR( klogErr, rc, "cannot grow hash (same-ref)" );
+                return rc;
+            }
+            if ( bytes > mcpf->maxbytes_same_ref )
+                mcpf->maxbytes_same_ref = bytes;
         }
+        mate_hash_put( h, key, ref_pos_and_tlen, ( uint16_t )flags );
+
+        mcpf->stat_same_ref.count = h->count;
+        if ( mcpf->stat_same_ref.count > mcpf->maxcount_same_ref )
+            mcpf->maxcount_same_ref = mcpf->stat_same_ref.count;
+        mcpf->stat_same_ref.inserts++;
     }
     return rc;
 }
@@ -203,30 +330,18 @@ rc_t matecache_lookup_same_ref( const matecache * const self, uint32_t db_idx, i
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        uint64_t value64;
+        const mate_hash * h = &mcpf->same_ref;
+        size_t idx = mate_hash_find( h, key );
         mcpf->stat_same_ref.lookups++;
-        rc = KVectorGetU64( mcpf->same_ref_64, key, &value64 );
-        if ( rc != 0 )
-        {
-            if ( GetRCState( rc ) != rcNotFound )
-                (void)LOGERR( klogErr, rc, "cannot retrieve value (same-ref) U64" );
-        }
+        if ( h->key[ idx ] == 0 )
+            rc = RC( rcApp, rcNoTarg, rcAccessing, rcItem, rcNotFound );
         else
         {
-            uint16_t value16;
-            rc = KVectorGetU16( mcpf->same_ref_16, key, &value16 );
-            if ( rc != 0 )
-            {
-                if ( GetRCState( rc ) != rcNotFound )
-                    (void)LOGERR( klogErr, rc, "cannot retrieve value (same-ref) U16" );
-            }
-            else
-            {
-                *ref_pos = ( value64 >> 32 );
-                *tlen = ( value64 & 0xFFFFFFFF );
-                *flags = value16;
-                mcpf->stat_same_ref.finds++;
-            }
+            uint64_t value64 = h->value[ idx ];
+            *ref_pos = ( value64 >> 32 );
+            *tlen = ( value64 & 0xFFFFFFFF );
+            *flags = h->flags[ idx ];
+            mcpf->stat_same_ref.finds++;
         }
     }
     return rc;
@@ -239,44 +354,8 @@ rc_t matecache_remove_same_ref( matecache * const self, uint32_t db_idx, int64_t
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        rc = KVectorUnset( mcpf->same_ref_64, key );
-        if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot remove from same-ref-cache (64bit)" );
-        else
-        {
-            rc = KVectorUnset( mcpf->same_ref_16, key );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot remove from same-ref-cache (16bit)" );
-        }
-        if ( rc == 0 && mcpf->stat_same_ref.count > 0 )
-            mcpf->stat_same_ref.count--;
-    }
-    return rc;
-}
-
-
-static rc_t matecache_clear_same_ref_per_file( matecache_per_file * const mcpf )
-{
-    rc_t rc = KVectorRelease( mcpf->same_ref_64 );
-    if ( rc != 0 )
-        (void)LOGERR( klogErr, rc, "cannot release same-ref-cache (64bit)" );
-    else
-    {
-        rc = KVectorRelease( mcpf->same_ref_16 );
-        if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot release same-ref-cache (16bit)" );
-        else
-        {
-            rc = KVectorMake( &mcpf->same_ref_64 );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot make same-ref-cache (64bit)" );
-            else
-            {
-                rc = KVectorMake( &mcpf->same_ref_16 );
-                if ( rc != 0 )
-                    (void)LOGERR( klogErr, rc, "cannot make same-ref-cache (16bit)" );
-            }
-        }
+        if ( mate_hash_remove( &mcpf->same_ref, key ) )
+            mcpf->stat_same_ref.count = mcpf->same_ref.count;
     }
     return rc;
 }
@@ -293,9 +372,10 @@ rc_t matecache_clear_same_ref( matecache * const self )
     else
     {
         uint32_t idx;
-        for ( idx = 0; idx < self->count && rc == 0; ++idx )
+        for ( idx = 0; idx < self->count; ++idx )
         {
-            rc = matecache_clear_same_ref_per_file( &self->per_file[ idx ] );
+            mate_hash_clear( &self->per_file[ idx ].same_ref );
+            self->per_file[ idx ].stat_same_ref.count = 0;
         }
         self->flashes++;
    }
@@ -325,6 +405,16 @@ rc_t matecache_report( const matecache * const self )
                 rc = KOutMsg( "matecache[ %u ].lookups = %,lu\n", idx, self->per_file[ idx ].stat_same_ref.lookups );
             if ( rc == 0 )
                 rc = KOutMsg( "matecache[ %u ].finds = %,lu\n", idx, self->per_file[ idx ].stat_same_ref.finds );
+            if ( rc == 0 )
+            {
+                const matecache_stat * st = &self->per_file[ idx ].stat_same_ref;
+                uint64_t permille = ( st->lookups > 0 ) ? ( st->finds * 1000 ) / st->lookups : 0;
+                rc = KOutMsg( "matecache[ %u ].hitrate = %lu.%lu %%\n", idx, permille / 10, permille % 10 );
+            }
+            if ( rc == 0 )
+                rc = KOutMsg( "matecache[ %u ].peak-bytes = %,lu\n", idx, ( uint64_t )self->per_file[ idx ].maxbytes_same_ref );
+            if ( rc == 0 )
+                rc = KOutMsg( "matecache[ %u ].rejected ( memory-limit ) = %,lu\n", idx, self->per_file[ idx ].rejects_same_ref );
             if ( rc == 0 )
                 rc = KOutMsg( "unaligned:\n" );
             if ( rc == 0 )
@@ -335,7 +425,7 @@ rc_t matecache_report( const matecache * const self )
                 rc = KOutMsg( "matecache[ %u ].finds = %,lu\n", idx, self->per_file[ idx ].stat_unaligned.finds );
         }
         if ( rc == 0 )
-            rc = KOutMsg( "matecache.flashes = %,lu\n", idx, self->flashes );
+            rc = KOutMsg( "matecache.flashes = %u\n", self->flashes );
     }
     return rc;
 }
@@ -437,3 +527,49 @@ rc_t foreach_unaligned_entry( const matecache * const self,
     }
     return rc;
 }
+
+
+typedef struct merge_ctx
+{
+    matecache_per_file * dst;
+    const matecache_per_file * src;
+} merge_ctx;
+
+
+static rc_t CC on_merge_unaligned( uint64_t key, uint64_t value, void *user_data )
+{
+    merge_ctx * mctx = user_data;
+    uint64_t seq_id;
+    rc_t rc = KVectorGetU64( mctx->src->unaligned_64_b, key, &seq_id );
+    if ( rc == 0 )
+        rc = KVectorSetU64( mctx->dst->unaligned_64_a, key, value );
+    if ( rc == 0 )
+        rc = KVectorSetU64( mctx->dst->unaligned_64_b, key, seq_id );
+    if ( rc == 0 )
+    {
+        mctx->dst->stat_unaligned.count++;
+        mctx->dst->stat_unaligned.inserts++;
+    }
+    return rc;
+}
+
+
+rc_t matecache_merge_unaligned( matecache * const self, const matecache * const src )
+{
+    rc_t rc = 0;
+    uint32_t idx;
+
+    if ( self == NULL || src == NULL )
+        return RC( rcApp, rcNoTarg, rcInserting, rcSelf, rcNull );
+
+    for ( idx = 0; idx < self->count && idx < src->count && rc == 0; ++idx )
+    {
+        merge_ctx mctx;
+        mctx.dst = &self->per_file[ idx ];
+        mctx.src = &src->per_file[ idx ];
+        rc = KVectorVisitU64( mctx.src->unaligned_64_a, false, on_merge_unaligned, &mctx );
+        if ( rc != 0 )
+            (void)LOGERR( klogErr, rc, "cannot merge (unaligned) caches" );
+    }
+    return rc;
+}
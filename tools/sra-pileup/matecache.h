@@ -50,10 +50,21 @@ typedef struct matecache_stat
 } matecache_stat;
 
 
+/* open-addressing hash, keyed by alignment-id ( 0 marks an empty slot ),
+   removes shift the following entries back, there are no tombstones */
+typedef struct mate_hash
+{
+    int64_t *key;
+    uint64_t *value;        /* ref-pos and tlen */
+    uint16_t *flags;
+    size_t mask;            /* number of slots - 1, a power of 2 */
+    size_t count;
+} mate_hash;
+
+
 typedef struct matecache_per_file
 {
-    KVector *same_ref_64;   /* ref-pos and ref-idx */
-    KVector *same_ref_16;   /* flags */
+    mate_hash same_ref;
 
     KVector *unaligned_64_a;  /* ref-pos and ref-idx */
     KVector *unaligned_64_b;  /* seq_spot_id */
@@ -61,6 +72,8 @@ typedef struct matecache_per_file
     matecache_stat stat_same_ref;
     matecache_stat stat_unaligned;
     uint64_t maxcount_same_ref;
+    uint64_t rejects_same_ref;      /* inserts not done because of the memory-limit */
+    size_t maxbytes_same_ref;
 } matecache_per_file;
 
 
@@ -69,12 +82,14 @@ typedef struct matecache
     matecache_per_file *per_file;
     uint32_t count;
     uint32_t flashes;
+    size_t mem_limit;   /* per file, for the same-ref-cache, the mates are read from the table above it */
 } matecache;
 
 
 /* general cache functions */
 
-rc_t make_matecache( matecache **self, uint32_t count );
+/* mem_limit ... bytes the same-ref-cache of one file may use */
+rc_t make_matecache( matecache **self, uint32_t count, size_t mem_limit );
 
 void release_matecache( matecache * const self );
 
@@ -115,5 +130,8 @@ rc_t foreach_unaligned_entry( const matecache * const self,
                               rc_t ( CC * f ) ( int64_t seq_id, int64_t al_id, void * user_data ),
                               void * user_data );
 
+/* copies the half aligned mates found by a worker-thread into the main cache */
+rc_t matecache_merge_unaligned( matecache * const self, const matecache * const src );
+
 
 #endif
@@ -29,38 +29,133 @@
 #include <kfs/directory.h>
 #include <kfs/buffile.h>
 #include <kfs/bzip.h>
-#include <kfs/gzip.h>
 #include <sysalloc.h>
 
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( _MSC_VER )
+#define OUT_THREAD_LOCAL __declspec( thread )
+#else
+#define OUT_THREAD_LOCAL __thread
+#endif
+
+/* the capture of the calling thread, NULL if it writes to the output */
+static OUT_THREAD_LOCAL out_capture * out_capture_current = NULL;
+
+
+static rc_t out_capture_append( out_capture * capture, const char * buffer, size_t bufsize )
+{
+    if ( capture->len + bufsize > capture->cap )
+    {
+        size_t cap = ( capture->cap == 0 ) ? 64 * 1024 : capture->cap;
+        char * tmp;
+        while ( cap < capture->len + bufsize )
+            cap *= 2;
+        tmp = realloc( capture->base, cap );
+        if ( tmp == NULL )
+            return RC( rcExe, rcBuffer, rcResizing, rcMemory, rcExhausted );
+        capture->base = tmp;
+        capture->cap = cap;
+    }
+    memmove( capture->base + capture->len, buffer, bufsize );
+    capture->len += bufsize;
+    return 0;
+}
+
+
 static rc_t CC out_redir_callback( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
 {
     out_redir * redir = ( out_redir * )self;
-    rc_t rc = KFileWriteAll( redir->kfile, redir->pos, buffer, bufsize, num_writ );
+    rc_t rc;
+    if ( out_capture_current != NULL )
+    {
+        if ( out_capture_current->bam != NULL )
+            /* text of a bam-worker is encoded, the records come back through the sink */
+            return bam_out_text( out_capture_current->bam, buffer, bufsize, num_writ );
+        rc = out_capture_append( out_capture_current, buffer, bufsize );
+        *num_writ = ( rc == 0 ) ? bufsize : 0;
+        return rc;
+    }
+    if ( redir->bam != NULL )
+        return bam_out_text( redir->bam, buffer, bufsize, num_writ );
+    if ( redir->pgz != NULL )
+    {
+        rc = par_gzip_write( redir->pgz, buffer, bufsize );
+        *num_writ = ( rc == 0 ) ? bufsize : 0;
+        return rc;
+    }
+    rc = KFileWriteAll( redir->kfile, redir->pos, buffer, bufsize, num_writ );
     if ( rc == 0 )
         redir->pos += *num_writ;
     return rc;
 }
 
 
-rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename, size_t bufsize )
+static rc_t out_redir_create( KFile ** f, const char * filename, const char * ext )
+{
+    KDirectory *dir;
+    rc_t rc = KDirectoryNativeDir( &dir );
+    if ( rc != 0 )
+        LOGERR( klogInt, rc, "KDirectoryNativeDir() failed" );
+    else
+    {
+        rc = KDirectoryCreateFile ( dir, f, false, 0664, kcmInit, "%s%s", filename, ext );
+        KDirectoryRelease( dir );
+    }
+    return rc;
+}
+
+
+rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename,
+                     size_t bufsize, uint32_t num_threads, bool bam_index )
 {
     rc_t rc;
     KFile *output_file;
 
     if ( filename != NULL )
+        rc = out_redir_create( &output_file, filename, "" );
+    else
+        rc = KFileMakeStdOut ( &output_file );
+
+    self->pgz = NULL;
+    self->bam = NULL;
+    if ( rc == 0 && mode == orm_bam )
     {
-        KDirectory *dir;
-        rc = KDirectoryNativeDir( &dir );
-        if ( rc != 0 )
-            LOGERR( klogInt, rc, "KDirectoryNativeDir() failed" );
+        /* the SAM-text is encoded into BAM, compressed like bgzf */
+        KFile *index_file = NULL;
+        if ( bam_index && filename != NULL )
+            rc = out_redir_create( &index_file, filename, ".bai" );
+        if ( rc == 0 )
+            rc = make_bam_out( &self->bam, output_file, num_threads, index_file );
+        KFileRelease( index_file );
+        if ( rc == 0 )
+        {
+            self->kfile = output_file;
+            self->org_writer = KOutWriterGet();
+            self->org_data = KOutDataGet();
+            self->pos = 0;
+            rc = KOutHandlerSet( out_redir_callback, self );
+            if ( rc != 0 )
+                LOGERR( klogInt, rc, "KOutHandlerSet() failed" );
+        }
         else
+            KFileRelease( output_file );
+        return rc;
+    }
+
+    if ( rc == 0 && ( mode == orm_gzip || mode == orm_bgzf ) )
+    {
+        /* blocks are compressed in parallel and written by the thread doing the output */
+        rc = make_par_gzip( &self->pgz, output_file, mode == orm_bgzf ? pgz_bgzf : pgz_gzip, num_threads );
+        if ( rc == 0 )
         {
-            rc = KDirectoryCreateFile ( dir, &output_file, false, 0664, kcmInit, "%s", filename );
-            KDirectoryRelease( dir );
+            mode = orm_uncompressed;
+            bufsize = 0;
         }
+        else
+            KFileRelease( output_file );
     }
-    else
-        rc = KFileMakeStdOut ( &output_file );
 
     if ( rc == 0 )
     {
@@ -69,9 +164,8 @@ rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * fi
         /* wrap the output-file in compression, if requested */
         switch ( mode )
         {
-            case orm_gzip  : rc = KFileMakeGzipForWrite( &temp_file, output_file ); break;
             case orm_bzip2 : rc = KFileMakeBzip2ForWrite( &temp_file, output_file ); break;
-            case orm_uncompressed : break;
+            default : break;
         }
         if ( rc == 0 )
         {
@@ -110,6 +204,20 @@ rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * fi
 
 void release_out_redir( out_redir * self )
 {
+    if ( self->bam != NULL )
+    {
+        rc_t rc = release_bam_out( self->bam );
+        if ( rc != 0 )
+            LOGERR( klogErr, rc, "failed to finish BAM output" );
+        self->bam = NULL;
+    }
+    if ( self->pgz != NULL )
+    {
+        rc_t rc = release_par_gzip( self->pgz );
+        if ( rc != 0 )
+            LOGERR( klogErr, rc, "failed to finish compressed output" );
+        self->pgz = NULL;
+    }
     KFileRelease( self->kfile );
     if( self->org_writer != NULL )
     {
@@ -118,3 +226,55 @@ void release_out_redir( out_redir * self )
     self->org_writer = NULL;
 }
 
+
+void out_redir_capture( out_capture * capture )
+{
+    out_capture_current = capture;
+}
+
+
+bool out_redir_capturing( void )
+{
+    return ( out_capture_current != NULL );
+}
+
+
+bam_out * out_redir_capture_bam( void )
+{
+    return ( out_capture_current != NULL ) ? out_capture_current->bam : NULL;
+}
+
+
+rc_t CC out_redir_capture_sink( void * data, const void * rec, size_t len )
+{
+    if ( out_capture_current == NULL )
+        return RC( rcExe, rcFile, rcWriting, rcSelf, rcNull );
+    return out_capture_append( out_capture_current, rec, len );
+}
+
+
+rc_t out_redir_replay( const out_capture * capture )
+{
+    rc_t rc = 0;
+    if ( capture->len > 0 && capture->bam != NULL )
+        rc = bam_out_replay( capture->bam, capture->base, capture->len );
+    else if ( capture->len > 0 )
+    {
+        size_t num_writ;
+        KWrtHandler * handler = KOutHandlerGet();
+        if ( handler == NULL || handler->writer == NULL )
+            rc = RC( rcExe, rcFile, rcWriting, rcInterface, rcNull );
+        else
+            rc = handler->writer( handler->data, capture->base, capture->len, &num_writ );
+    }
+    return rc;
+}
+
+
+void out_capture_whack( out_capture * capture )
+{
+    free( capture->base );
+    capture->base = NULL;
+    capture->len = 0;
+    capture->cap = 0;
+}
@@ -39,11 +39,16 @@ extern "C" {
 
 #include <kfs/file.h>
 
+#include "par_gzip.h"
+#include "bam_out.h"
+
 enum out_redir_mode
 {
     orm_uncompressed = 0,
     orm_gzip,
-    orm_bzip2
+    orm_bzip2,
+    orm_bgzf,
+    orm_bam
 };
 
 
@@ -54,11 +59,43 @@ typedef struct out_redir
     void* org_data;
     KFile* kfile;
     uint64_t pos;
+    par_gzip * pgz;     /* gzip and bgzf go through it instead of kfile */
+    bam_out * bam;      /* bam: the SAM-text is encoded into it */
 } out_redir;
 
 
-rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename, size_t bufsize );
+/* output of worker-threads is captured per thread and written later,
+   in the order the output would have had without threads */
+typedef struct out_capture
+{
+    char * base;
+    size_t len;
+    size_t cap;
+    bam_out * bam;      /* bam: a worker of the bam-output, base holds its encoded records */
+} out_capture;
+
+
+/* gzip, bgzf and bam output is compressed on 'num_threads' threads,
+   bufsize does not apply to them, bam_index writes 'filename'.bai */
+rc_t init_out_redir( out_redir * self, enum out_redir_mode mode, const char * filename,
+                     size_t bufsize, uint32_t num_threads, bool bam_index );
 
 void release_out_redir( out_redir * self );
 
+/* KOutMsg() on the calling thread goes into 'capture', until called with NULL */
+void out_redir_capture( out_capture * capture );
+
+bool out_redir_capturing( void );
+
+/* the bam-worker of the capture of the calling thread, NULL if it captures text */
+bam_out * out_redir_capture_bam( void );
+
+/* a bam_out_sink for workers: appends to the capture of the calling thread */
+rc_t CC out_redir_capture_sink( void * data, const void * rec, size_t len );
+
+/* writes what was captured to where KOutMsg() writes */
+rc_t out_redir_replay( const out_capture * capture );
+
+void out_capture_whack( out_capture * capture );
+
 #endif
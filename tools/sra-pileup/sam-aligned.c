@@ -27,6 +27,10 @@
 #include <align/manager.h>
 #include <align/iterator.h>
 #include <kapp/main.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <klib/printf.h>
 #include <ctype.h>
 #include <sysalloc.h>
 
@@ -34,6 +38,8 @@
 #include "cg_tools.h"
 #include "rna_splice_log.h"
 #include "sam-aligned.h"
+#include "bam_out.h"
+#include "out_redir.h"
 
 const char * PRIM_TABLE = "PRIMARY_ALIGNMENT";
 const char * SEC_TABLE = "SECONDARY_ALIGNMENT";
@@ -1358,6 +1364,25 @@ static rc_t print_alignment_sam_ev( const samdump_opts * const opts,
 }
 
 
+/* QNAME for SAM-text or BAM */
+static rc_t print_qname( const samdump_opts * const opts, bam_out * bam, int64_t seq_spot_id,
+                         const char * spot_group, uint32_t spot_group_len )
+{
+    rc_t rc;
+    if ( bam != NULL )
+    {
+        char buffer[ 4096 ];
+        size_t written;
+        rc = dump_name_to( opts, buffer, sizeof buffer, &written, seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
+        if ( rc == 0 )
+            rc = bam_rec_qname( bam, buffer, written ); /* bam_out.c */
+    }
+    else
+        rc = dump_name( opts, seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
+    return rc;
+}
+
+
 static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                                     const char * ref_name,
                                     INSDC_coord_zero pos,
@@ -1376,6 +1401,8 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     cg_cigar_output cgc_output;
     rna_splice_candidates candidates; /* in cg_tools.h */
     bool rna_not_homogeneous_flag = false;
+    /* encode the record directly into BAM, bam_out.c - worker-threads have their own encoder */
+    bam_out * bam = out_redir_capturing() ? out_redir_capture_bam() : opts->bam;
 
     /* SAM-FIELD: NONE      SRA-column: MATE_ALIGN_ID ( int64 ) ... for cache lookup's */
     rc_t rc = read_int64( id, cursor, atx->mate_align_id_idx, &mate_align_id, 0, "MATE_ALIGN_ID" );
@@ -1487,6 +1514,9 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     if ( rc == 0 && opts->use_matepair_filter && !filter_by_matepair_dist( opts, tlen ) )
         return 0;
 
+    if ( rc == 0 && bam )
+        rc = bam_rec_start( bam );
+
     /* SAM-FIELD: QNAME     SRA-column: SEQ_SPOT_ID ( int64 ) */
     if ( rc == 0 )
     {
@@ -1498,16 +1528,16 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                 uint32_t spot_group_len;
                 rc = read_char_ptr( id, cursor, atx->cmn.seq_spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
                 if ( rc == 0 )
-                    rc = dump_name( opts, *seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
+                    rc = print_qname( opts, bam, *seq_spot_id, spot_group, spot_group_len );
             }
             else
-                rc = dump_name( opts, *seq_spot_id, NULL, 0 ); /* sam-dump-opts.c */
+                rc = print_qname( opts, bam, *seq_spot_id, NULL, 0 );
         }
         else
-            rc = KOutMsg( "*" );
+            rc = bam ? bam_rec_qname( bam, "*", 1 ) : KOutMsg( "*" );
     }
 
-    if ( rc == 0 )
+    if ( rc == 0 && !bam )
         rc = KOutMsg( "\t" );
 
     /* massage the sam-flag if we are not dumping unaligned reads... */
@@ -1523,7 +1553,12 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     /* SAM-FIELD: POS       SRA-column: REF_POS + 1 */
     /* SAM-FIELD: MAPQ      SRA-column: MAPQ */
     if ( rc == 0 )
-        rc = KOutMsg( "%u\t%s\t%u\t%d\t", sam_flags, ref_name, pos + 1, rec->mapq );
+    {
+        if ( bam )
+            rc = bam_rec_core( bam, sam_flags, ref_name, string_size( ref_name ), pos, ( uint8_t )rec->mapq );
+        else
+            rc = KOutMsg( "%u\t%s\t%u\t%d\t", sam_flags, ref_name, pos + 1, rec->mapq );
+    }
 
     /* get READ, QUALITY and EIDT_DIST before cigar manipulation because we need/change these values */
     if ( rc == 0 )
@@ -1607,7 +1642,12 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                 free( ( void * ) candidates.cigops );
         }
         if ( rc == 0 )
-            rc = KOutMsg( "%.*s\t", cgc_output.p_cigar.len, cgc_output.p_cigar.ptr );
+        {
+            if ( bam )
+                rc = bam_rec_cigar( bam, cgc_output.p_cigar.ptr, cgc_output.p_cigar.len );
+            else
+                rc = KOutMsg( "%.*s\t", cgc_output.p_cigar.len, cgc_output.p_cigar.ptr );
+        }
 
         if ( temp_cigar != NULL )
             free( temp_cigar );
@@ -1616,7 +1656,14 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     /* SAM-FIELD: RNEXT     SRA-column: MATE_REF_NAME ( !!! row_len can be zero !!! ) */
     /* SAM-FIELD: PNEXT     SRA-column: MATE_REF_POS + 1 ( !!! row_len can be zero !!! ) */
     /* SAM-FIELD: TLEN      SRA-column: TEMPLATE_LEN ( !!! row_len can be zero !!! ) */
-    if ( rc == 0 )
+    if ( rc == 0 && bam )
+    {
+        if ( mate_ref_name_len > 0 )
+            rc = bam_rec_mate( bam, mate_ref_name, mate_ref_name_len, mate_ref_pos, tlen );
+        else
+            rc = bam_rec_mate( bam, "*", 1, ( int32_t )( mate_ref_pos_len == 0 ? 0 : mate_ref_pos ) - 1, tlen );
+    }
+    else if ( rc == 0 )
     {
         if ( mate_ref_name_len > 0 )
         {
@@ -1633,10 +1680,23 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
 
     /* SAM-FIELD: SEQ       SRA-column: READ */
     if ( rc == 0 )
-        rc = KOutMsg( "%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
+    {
+        if ( bam )
+            rc = bam_rec_seq( bam, cgc_output.p_read.ptr, cgc_output.p_read.len );
+        else
+            rc = KOutMsg( "%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
+    }
 
     /* SAM-FIELD: QUAL      SRA-column: SAM_QUALITY */
-    if ( rc == 0 )
+    if ( rc == 0 && bam )
+    {
+        if ( cgc_output.p_quality.len > 0 )
+            rc = bam_rec_qual( bam, cgc_output.p_quality.ptr, cgc_output.p_quality.len,
+                               opts->qual_quant != NULL ? opts->qual_quant_matrix : NULL );
+        else
+            rc = bam_rec_qual( bam, "*", 1, NULL );
+    }
+    else if ( rc == 0 )
     {
         if ( cgc_output.p_quality.len > 0 )
             rc = dump_quality_33( opts, cgc_output.p_quality.ptr, cgc_output.p_quality.len, false );
@@ -1651,15 +1711,20 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
         uint32_t spot_grp_len;
         rc = read_char_ptr( id, cursor, atx->cmn.seq_spot_group_idx, &spot_grp, &spot_grp_len, "SPOT_GROUP" );
         if ( rc == 0 && spot_grp_len > 0 )
-            rc = KOutMsg( "\tRG:Z:%.*s", spot_grp_len, spot_grp );
+            rc = bam ? bam_rec_tag_Z( bam, "RG", spot_grp, spot_grp_len ) : KOutMsg( "\tRG:Z:%.*s", spot_grp_len, spot_grp );
     }
 
     if ( rc == 0 && cgc_output.p_tags.len > 0 )
-        rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+    {
+        if ( bam )
+            rc = bam_rec_tags_text( bam, cgc_output.p_tags.ptr, cgc_output.p_tags.len );
+        else
+            rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+    }
 
     /* OPT SAM-FIELD: XI     SRA-column: ALIGN_ID */
     if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-        rc = KOutMsg( "\tXI:i:%u", id );
+        rc = bam ? bam_rec_tag_i( bam, "XI", ( uint32_t )id ) : KOutMsg( "\tXI:i:%u", id );
 
     /* to match sam-tools output: in case we are dumping this in CG-mode.... */
     if ( rc == 0 && ( opts->cigar_treatment != ct_unchanged ) && ( atx->al_group_idx != COL_NOT_AVAILABLE ) )
@@ -1674,7 +1739,16 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
             {
                 if ( align_grp[ i ] == '_' )
                 {
-                    rc = KOutMsg( "\tZI:i:%.*s\tZA:i:%.1s", i, align_grp, align_grp + i + 1 );
+                    if ( bam )
+                    {
+                        char tags[ 256 ];
+                        size_t tags_len;
+                        rc = string_printf( tags, sizeof tags, &tags_len, "ZI:i:%.*s\tZA:i:%.1s", i, align_grp, align_grp + i + 1 );
+                        if ( rc == 0 )
+                            rc = bam_rec_tags_text( bam, tags, tags_len );
+                    }
+                    else
+                        rc = KOutMsg( "\tZI:i:%.*s\tZA:i:%.1s", i, align_grp, align_grp + i + 1 );
                     break;
                 }
             }
@@ -1688,12 +1762,17 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
         uint32_t al_count_len;
         rc = read_uint8_ptr( id, cursor, atx->cmn.al_count_idx, &al_count, &al_count_len, "ALIGNMENT_COUNT" );
         if ( rc == 0 && al_count_len > 0 )
-            rc = KOutMsg( "\tNH:i:%u", *al_count );
+            rc = bam ? bam_rec_tag_i( bam, "NH", *al_count ) : KOutMsg( "\tNH:i:%u", *al_count );
     }
 
     /* OPT SAM-FIELD: NM     SRA-column: EDIT_DISTANCE */
     if ( rc == 0 )
-        rc = KOutMsg( "\tNM:i:%u", ( cgc_output.edit_dist - NM_adjustments ) );
+    {
+        if ( bam )
+            rc = bam_rec_tag_i( bam, "NM", ( uint32_t )( cgc_output.edit_dist - NM_adjustments ) );
+        else
+            rc = KOutMsg( "\tNM:i:%u", ( cgc_output.edit_dist - NM_adjustments ) );
+    }
 
     /* OPT SAM-FIELD: XS:A:+/-  SRA-column: RNA-SPLICING detected via computation, or from the RNA_ORIENTATION - column */
     if ( rc == 0 )
@@ -1703,10 +1782,8 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
             /* analysis of rna-splicing explicitly requested at the commandline */
             if ( candidates.fwd_matched > 0 || candidates.rev_matched > 0 )
             {
-                if ( candidates.fwd_matched > 0 )
-                    rc = KOutMsg( "\tXS:A:+" );
-                else 
-                    rc = KOutMsg( "\tXS:A:-" );
+                char xs = ( candidates.fwd_matched > 0 ) ? '+' : '-';
+                rc = bam ? bam_rec_tag_A( bam, "XS", xs ) : KOutMsg( "\tXS:A:%c", xs );
             }
 /*
             uint32_t i;
@@ -1730,7 +1807,8 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                                     &rna_orientation, &rna_orientation_len, "RNA_ORIENTATION" );
                 if ( rc == 0 && rna_orientation_len > 0 )
                 {
-                    rc = KOutMsg( "\tXS:A:%c", rna_orientation[ 0 ] );
+                    rc = bam ? bam_rec_tag_A( bam, "XS", rna_orientation[ 0 ] )
+                             : KOutMsg( "\tXS:A:%c", rna_orientation[ 0 ] );
                 }
             }
         }
@@ -1745,7 +1823,7 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
 	}
 	
     if ( rc == 0 )
-        rc = KOutMsg( "\n" );
+        rc = bam ? bam_rec_end( bam ) : KOutMsg( "\n" );
 
     /* print a log-info if have to because RNA-splicing is requested and we have not homogeneous bits */
     if ( rna_not_homogeneous_flag )
@@ -1888,7 +1966,8 @@ static rc_t walk_position( const samdump_opts * const opts,
                            matecache * const mc,
                            struct rna_splice_dict * splice_dict,
                            INSDC_coord_zero first_pos,
-                           INSDC_coord_len len )
+                           INSDC_coord_len len,
+                           const range * window )
 {
     rc_t rc = 0;
     while ( rc == 0 )
@@ -1916,7 +1995,8 @@ static rc_t walk_position( const samdump_opts * const opts,
                 /* We have to do this here, becasue the nature of the iterator is to return all alignments that
                    touch ( stick into ) the requested interval. But: sam-dump has to dump alignments that
                    !! start !! in the requested interval. */
-                if ( pos >= first_pos )
+                if ( pos >= first_pos &&
+                     ( window == NULL || ( ( uint64_t )pos >= window->start && ( uint64_t )pos < window->end ) ) )
                 {
                     align_table_context * atx = PlacementRecord_get_ext_data_ptr( rec, placementRecordExtension0 );
                     if ( atx == NULL )
@@ -1954,7 +2034,8 @@ static rc_t walk_window( const samdump_opts * const opts,
                          matecache * const mc,
                          struct rna_splice_dict * splice_dict,
                          INSDC_coord_zero first_pos,
-                         INSDC_coord_len len )
+                         INSDC_coord_len len,
+                         const range * window )
 {
     rc_t rc = 0;
     while ( rc == 0 )
@@ -1973,7 +2054,7 @@ static rc_t walk_window( const samdump_opts * const opts,
             }
             else
             {
-                rc = walk_position( opts, set_iter, ref_name, pos, mc, splice_dict, first_pos, len );
+                rc = walk_position( opts, set_iter, ref_name, pos, mc, splice_dict, first_pos, len, window );
             }
         }
     }
@@ -1986,7 +2067,8 @@ static rc_t walk_reference( const samdump_opts * const opts,
                             PlacementSetIterator * const set_iter,
                             struct ReferenceObj const * ref_obj,
                             const char * ref_name,
-                            matecache * const mc )
+                            matecache * const mc,
+                            const range * window )
 {
     rc_t rc = 0;
     struct rna_splice_dict * splice_dict = NULL;
@@ -2015,7 +2097,7 @@ static rc_t walk_reference( const samdump_opts * const opts,
                 }
             }
             else
-                rc = walk_window( opts, set_iter, ref_name, mc, splice_dict, first_pos, len );
+                rc = walk_window( opts, set_iter, ref_name, mc, splice_dict, first_pos, len, window );
         }
     }
     if ( GetRCState( rc ) == rcDone ) rc = 0;
@@ -2035,9 +2117,11 @@ static rc_t walk_reference( const samdump_opts * const opts,
 }
 
 
+/* window != NULL: print only the alignments starting in [ window->start, window->end ) */
 static rc_t walk_placements( const samdump_opts * const opts,
                              PlacementSetIterator * const set_iter,
-                             matecache * const mc )
+                             matecache * const mc,
+                             const range * window )
 {
     rc_t rc = 0;
     while ( rc == 0 )
@@ -2062,7 +2146,7 @@ static rc_t walk_placements( const samdump_opts * const opts,
                         perf_log_start_sub_section( opts->perf_log, ref_name );
 #endif
 
-                    rc = walk_reference( opts, set_iter, ref_obj, ref_name, mc );
+                    rc = walk_reference( opts, set_iter, ref_obj, ref_name, mc, window );
 
 #if _DEBUGGING
                     if ( opts->perf_log != NULL )
@@ -2102,11 +2186,13 @@ static void CC destroy_align_table_context( void *item, void *data )
 }
 
 
+/* window != NULL: only the alignments starting in this window of the reference */
 static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * const opts,
                                                        const input_database * const ids,
                                                        matecache * const mc,
                                                        const AlignMgr * const a_mgr,
-                                                       const ReferenceObj * const ref_obj )
+                                                       const ReferenceObj * const ref_obj,
+                                                       const range * window )
 {
     PlacementSetIterator * set_iter;
     /* the we ask the alignment-manager to produce a placement-set-iterator... */
@@ -2123,17 +2209,20 @@ static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * cons
 
         VectorInit ( &context_list, 0, 5 );
 
-        rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
+        if ( window != NULL )
+            ref_len = ( INSDC_coord_len )( window->end - window->start );
+        else
+            rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
         if ( rc == 0 )
         {
             rc = add_pl_iters( opts, set_iter, ref_obj, ids,
-                0,                  /* where it starts on the reference */
-                ref_len,            /* the whole length of this reference/chromosome */
+                window != NULL ? ( INSDC_coord_zero )window->start : 0, /* where it starts on the reference */
+                ref_len,            /* the whole length of this reference/chromosome ( or window ) */
                 NULL,               /* no spotgroup re-grouping (yet) */
                 &context_list
                 );
             if ( rc == 0 )
-                rc = walk_placements( opts, set_iter, mc );
+                rc = walk_placements( opts, set_iter, mc, window );
         }
 
         /* walk the context_list to free the align_table_context records, close/free the cursors... */
@@ -2174,7 +2263,7 @@ static rc_t print_all_aligned_spots_0( const samdump_opts * const opts,
                     rc = ReferenceList_Get( ids->reflist, &ref_obj, ref_idx );
                     if ( rc == 0 && ref_obj != NULL )
                     {
-                        rc = print_all_aligned_spots_of_this_reference( opts, ids, mc, a_mgr, ref_obj );
+                        rc = print_all_aligned_spots_of_this_reference( opts, ids, mc, a_mgr, ref_obj, NULL );
                         ReferenceObj_Release( ref_obj );
                     }
                 }
@@ -2185,6 +2274,359 @@ static rc_t print_all_aligned_spots_0( const samdump_opts * const opts,
 }
 
 
+/*
+   strategy #0 on more than one thread: the references are cut into tasks, a whole
+   reference or a fixed-size window of a large one. Every worker has its own
+   alignment-manager, reference-lists ( cursors ) and mate-cache, its output is
+   captured and written by the calling thread strictly in task-order, that is the
+   order strategy #0 prints in. With BAM-output the workers encode the records, the
+   calling thread only writes them.
+*/
+
+#define SAM_MT_WINDOW ( 4 * 1024 * 1024 )
+/* limits memory: tasks done but not written yet per thread */
+#define SAM_MT_TASKS_PER_THREAD 2
+#define SAM_MT_MAX_THREADS 64
+
+typedef struct sam_mt_task
+{
+    uint32_t db_idx;
+    uint32_t ref_idx;
+    range window;
+} sam_mt_task;
+
+
+typedef struct sam_mt_slot
+{
+    out_capture capture;
+    rc_t rc;
+    bool done;
+} sam_mt_slot;
+
+
+typedef struct sam_mt_pool
+{
+    KLock * lock;
+    KCondition * done_cond;     /* a worker finished a task */
+    KCondition * free_cond;     /* the writer released a slot */
+    const samdump_opts * opts;
+    const input_files * ifs;
+    sam_mt_task * task;
+    uint64_t qty;               /* tasks total */
+    uint64_t next;              /* next task to be taken by a worker */
+    uint64_t written;           /* tasks written so far */
+    uint32_t window;            /* size of slot ring */
+    sam_mt_slot * slot;
+    uint32_t running;           /* workers not finished yet */
+    bool quitting;
+} sam_mt_pool;
+
+
+typedef struct sam_mt_worker
+{
+    sam_mt_pool * pool;
+    const AlignMgr * a_mgr;
+    const ReferenceList ** reflist;     /* one per input-database */
+    matecache * mc;
+    bam_out * bam;                      /* encodes its records, NULL for text */
+    KThread * thread;
+} sam_mt_worker;
+
+
+static rc_t sam_mt_plan( sam_mt_pool * pool )
+{
+    rc_t rc = 0;
+    uint64_t cap = 0;
+    uint32_t db_idx;
+    for ( db_idx = 0; db_idx < pool->ifs->database_count && rc == 0; ++db_idx )
+    {
+        const input_database * ids = VectorGet( &pool->ifs->dbs, db_idx );
+        if ( ids != NULL )
+        {
+            uint32_t refobj_count;
+            rc = ReferenceList_Count( ids->reflist, &refobj_count );
+            if ( rc == 0 && refobj_count > 0 )
+            {
+                uint32_t ref_idx;
+                for ( ref_idx = 0; ref_idx < refobj_count && rc == 0; ++ref_idx )
+                {
+                    const ReferenceObj * ref_obj;
+                    rc = ReferenceList_Get( ids->reflist, &ref_obj, ref_idx );
+                    if ( rc == 0 && ref_obj != NULL )
+                    {
+                        INSDC_coord_len ref_len;
+                        rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
+                        ReferenceObj_Release( ref_obj );
+                        if ( rc == 0 )
+                        {
+                            uint64_t start = 0;
+                            do
+                            {
+                                sam_mt_task * t;
+                                if ( pool->qty == cap )
+                                {
+                                    void * tmp;
+                                    cap = ( cap == 0 ) ? 256 : cap * 2;
+                                    tmp = realloc( pool->task, cap * sizeof pool->task[ 0 ] );
+                                    if ( tmp == NULL )
+                                    {
+                                        rc = RC( rcExe, rcThread, rcConstructing, rcMemory, rcExhausted );
+                                        break;
+                                    }
+                                    pool->task = tmp;
+                                }
+                                t = &pool->task[ pool->qty++ ];
+                                t->db_idx = db_idx;
+                                t->ref_idx = ref_idx;
+                                t->window.start = start;
+                                t->window.end = ( ref_len - start > SAM_MT_WINDOW ) ? start + SAM_MT_WINDOW : ref_len;
+                                start = t->window.end;
+                            } while ( start < ref_len );
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return rc;
+}
+
+
+static rc_t sam_mt_run_task( sam_mt_worker * self, const sam_mt_task * t )
+{
+    const input_database * ids = VectorGet( &self->pool->ifs->dbs, t->db_idx );
+    input_database wids = *ids;     /* the same database, but the cursors of this worker */
+    const ReferenceObj * ref_obj;
+    rc_t rc;
+
+    wids.reflist = self->reflist[ t->db_idx ];
+    rc = ReferenceList_Get( wids.reflist, &ref_obj, t->ref_idx );
+    if ( rc == 0 && ref_obj != NULL )
+    {
+        rc = print_all_aligned_spots_of_this_reference( self->pool->opts, &wids, self->mc,
+                                                        self->a_mgr, ref_obj, &t->window );
+        ReferenceObj_Release( ref_obj );
+    }
+    return rc;
+}
+
+
+static rc_t CC sam_mt_worker_main( const KThread * thread, void * data )
+{
+    sam_mt_worker * self = data;
+    sam_mt_pool * pool = self->pool;
+    rc_t rc = 0;
+
+    while ( rc == 0 )
+    {
+        uint64_t t;
+        sam_mt_slot * slot;
+
+        rc = KLockAcquire( pool->lock );
+        if ( rc != 0 )
+            break;
+        while ( !pool->quitting && pool->next < pool->qty && pool->next >= pool->written + pool->window )
+            KConditionWait( pool->free_cond, pool->lock );
+        if ( pool->quitting || pool->next >= pool->qty )
+        {
+            KLockUnlock( pool->lock );
+            break;
+        }
+        t = pool->next++;
+        KLockUnlock( pool->lock );
+
+        /* slot is ours until it is marked done */
+        slot = &pool->slot[ t % pool->window ];
+        slot->capture.bam = self->bam;
+        out_redir_capture( &slot->capture );
+        rc = sam_mt_run_task( self, &pool->task[ t ] );
+        out_redir_capture( NULL );
+        slot->rc = rc;
+
+        KLockAcquire( pool->lock );
+        slot->done = true;
+        KConditionBroadcast( pool->done_cond );
+        KLockUnlock( pool->lock );
+    }
+
+    KLockAcquire( pool->lock );
+    if ( rc != 0 )
+        pool->quitting = true;
+    pool->running--;
+    KConditionBroadcast( pool->done_cond );
+    KConditionBroadcast( pool->free_cond );
+    KLockUnlock( pool->lock );
+    return rc;
+}
+
+
+static rc_t make_sam_mt_worker( sam_mt_worker * self, sam_mt_pool * pool )
+{
+    const input_files * ifs = pool->ifs;
+    rc_t rc = AlignMgrMakeRead( &self->a_mgr );
+    self->pool = pool;
+    if ( rc != 0 )
+        (void)LOGERR( klogErr, rc, "cannot create alignment-manager" );
+    else
+    {
+        self->reflist = calloc( ifs->database_count, sizeof self->reflist[ 0 ] );
+        if ( self->reflist == NULL )
+            rc = RC( rcExe, rcThread, rcConstructing, rcMemory, rcExhausted );
+    }
+    if ( rc == 0 )
+    {
+        uint32_t db_idx;
+        for ( db_idx = 0; db_idx < ifs->database_count && rc == 0; ++db_idx )
+        {
+            const input_database * ids = VectorGet( &ifs->dbs, db_idx );
+            if ( ids != NULL )
+            {
+                rc = ReferenceList_MakeDatabase( &self->reflist[ db_idx ], ids->db, ifs->reflist_options, 0, NULL, 0 );
+                if ( rc != 0 )
+                    (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create reflist for '$(t)'", "t=%s", ids->path ) );
+            }
+        }
+    }
+    if ( rc == 0 && pool->opts->use_mate_cache )
+        /* the workers share the memory-limit */
+        rc = make_matecache( &self->mc, ifs->database_count,
+                             ( ( size_t )pool->opts->mate_cache_mem * 1024 * 1024 ) / pool->opts->num_threads );
+    if ( rc == 0 && pool->opts->bam != NULL )
+        /* the records are encoded on the worker, the writer only writes them */
+        rc = make_bam_out_worker( &self->bam, pool->opts->bam, out_redir_capture_sink, NULL ); /* bam_out.c */
+    return rc;
+}
+
+
+static void release_sam_mt_worker( sam_mt_worker * self, uint32_t database_count )
+{
+    if ( self->reflist != NULL )
+    {
+        uint32_t db_idx;
+        for ( db_idx = 0; db_idx < database_count; ++db_idx )
+            ReferenceList_Release( self->reflist[ db_idx ] );
+        free( self->reflist );
+    }
+    if ( self->mc != NULL )
+        release_matecache( self->mc );
+    release_bam_out( self->bam );
+    AlignMgrRelease( self->a_mgr );
+}
+
+
+static rc_t print_all_aligned_spots_0_mt( const samdump_opts * const opts,
+                                          const input_files * const ifs,
+                                          matecache * const mc,
+                                          uint32_t threads )
+{
+    rc_t rc, rc2;
+    uint32_t i;
+    sam_mt_pool pool;
+    sam_mt_worker worker[ SAM_MT_MAX_THREADS ];
+
+    if ( threads > SAM_MT_MAX_THREADS )
+        threads = SAM_MT_MAX_THREADS;
+
+    memset( &pool, 0, sizeof pool );
+    memset( worker, 0, sizeof worker );
+    pool.opts = opts;
+    pool.ifs = ifs;
+    pool.window = threads * SAM_MT_TASKS_PER_THREAD;
+    rc = sam_mt_plan( &pool );
+    if ( rc == 0 )
+    {
+        pool.slot = calloc( pool.window, sizeof pool.slot[ 0 ] );
+        if ( pool.slot == NULL )
+            rc = RC( rcExe, rcThread, rcConstructing, rcMemory, rcExhausted );
+    }
+    if ( rc == 0 )
+        rc = KLockMake( &pool.lock );
+    if ( rc == 0 )
+        rc = KConditionMake( &pool.done_cond );
+    if ( rc == 0 )
+        rc = KConditionMake( &pool.free_cond );
+    for ( i = 0; rc == 0 && i < threads; ++i )
+        rc = make_sam_mt_worker( &worker[ i ], &pool );
+    if ( rc == 0 )
+    {
+        /* workers only touch pool under lock, hold it till all are started */
+        rc = KLockAcquire( pool.lock );
+        if ( rc == 0 )
+        {
+            for ( i = 0; rc == 0 && i < threads; ++i )
+            {
+                rc = KThreadMake( &worker[ i ].thread, sam_mt_worker_main, &worker[ i ] );
+                if ( rc == 0 )
+                    pool.running++;
+            }
+            if ( rc != 0 )
+                pool.quitting = true;
+            KLockUnlock( pool.lock );
+        }
+    }
+
+    while ( rc == 0 && pool.written < pool.qty )
+    {
+        sam_mt_slot * slot = &pool.slot[ pool.written % pool.window ];
+
+        rc = KLockAcquire( pool.lock );
+        if ( rc != 0 )
+            break;
+        while ( !slot->done && pool.running > 0 && !( pool.quitting && pool.written >= pool.next ) )
+            KConditionWait( pool.done_cond, pool.lock );
+        KLockUnlock( pool.lock );
+        if ( !slot->done )
+            break;  /* workers gave up, their status tells why */
+
+        rc = slot->rc;
+        if ( rc == 0 )
+            rc = out_redir_replay( &slot->capture );
+        slot->capture.len = 0;
+
+        KLockAcquire( pool.lock );
+        slot->done = false;
+        pool.written++;
+        KConditionBroadcast( pool.free_cond );
+        KLockUnlock( pool.lock );
+    }
+
+    if ( pool.lock != NULL )
+    {
+        KLockAcquire( pool.lock );
+        pool.quitting = true;
+        KConditionBroadcast( pool.free_cond );
+        KLockUnlock( pool.lock );
+    }
+    for ( i = 0; i < threads; ++i )
+    {
+        if ( worker[ i ].thread != NULL )
+        {
+            if ( KThreadWait( worker[ i ].thread, &rc2 ) == 0 && rc == 0 )
+                rc = rc2;
+            KThreadRelease( worker[ i ].thread );
+        }
+    }
+    if ( rc == 0 && pool.written < pool.qty )
+        rc = RC( rcExe, rcThread, rcExecuting, rcData, rcIncomplete );
+
+    /* the half aligned mates are printed later by the unaligned part */
+    for ( i = 0; i < threads; ++i )
+    {
+        if ( rc == 0 && mc != NULL && worker[ i ].mc != NULL )
+            rc = matecache_merge_unaligned( mc, worker[ i ].mc );
+        release_sam_mt_worker( &worker[ i ], ifs->database_count );
+    }
+    for ( i = 0; pool.slot != NULL && i < pool.window; ++i )
+        out_capture_whack( &pool.slot[ i ].capture );
+    KConditionRelease( pool.free_cond );
+    KConditionRelease( pool.done_cond );
+    KLockRelease( pool.lock );
+    free( pool.slot );
+    free( pool.task );
+    return rc;
+}
+
+
 /*
    the user did not specify regions, print all alignments from all input-files
    this is strategy #2 to do this, throw all iterators for all input-files and all there references
@@ -2215,7 +2657,7 @@ static rc_t print_all_aligned_spots_1( const samdump_opts * const opts,
         rc = prepare_whole_files( opts, ifs, set_iter, &context_list );
 
         if ( rc == 0 )
-            rc = walk_placements( opts, set_iter, mc );
+            rc = walk_placements( opts, set_iter, mc, NULL );
 
         /* walk the context_list to free the align_table_context records, close/free the cursors... */
         VectorWhack ( &context_list, destroy_align_table_context, NULL );
@@ -2250,7 +2692,7 @@ static rc_t print_selected_aligned_spots( const samdump_opts * const opts,
         rc = prepare_regions( opts, ifs, set_iter, &context_list );
 
         if ( rc == 0 )
-            rc = walk_placements( opts, set_iter, mc );
+            rc = walk_placements( opts, set_iter, mc, NULL );
 
         /* walk the context_list to free the align_table_context records, close/free the cursors... */
         VectorWhack ( &context_list, destroy_align_table_context, NULL );
@@ -2261,6 +2703,14 @@ static rc_t print_selected_aligned_spots( const samdump_opts * const opts,
 }
 
 
+/* the per-reference state of rna-splicing and the timing-log do not survive being cut into tasks */
+static bool parallel_possible( const samdump_opts * const opts )
+{
+    return ( opts->num_threads > 1 && !opts->no_mt && !opts->rna_splicing &&
+             opts->rna_splice_log == NULL && opts->perf_log == NULL );
+}
+
+
 /*
    this is called from sam-dump3.c, it prepares the iterators and then walks them
    ---> only entry into this module <--- 
@@ -2290,7 +2740,11 @@ rc_t print_aligned_spots( const samdump_opts * const opts,
             /* the user did not specify regions to be printed ==> print all alignments */
             switch( opts->dump_mode )
             {
-                case dm_one_ref_at_a_time : rc = print_all_aligned_spots_0( opts, ifs, mc, a_mgr ); break;
+                case dm_one_ref_at_a_time : if ( parallel_possible( opts ) )
+                                                rc = print_all_aligned_spots_0_mt( opts, ifs, mc, opts->num_threads );
+                                            else
+                                                rc = print_all_aligned_spots_0( opts, ifs, mc, a_mgr );
+                                            break;
                 case dm_prepare_all_refs  : rc = print_all_aligned_spots_1( opts, ifs, mc, a_mgr ); break;
             }
         }
@@ -27,11 +27,15 @@
 
 #include "sam-dump-opts.h"
 #include "perf_log.h"
+#include "par_gzip.h"
 
 #include <klib/time.h>
+#include <klib/printf.h>
 #include <align/quality-quantizer.h>
 #include <sysalloc.h>
 
+#include <ctype.h>
+
 #define CURSOR_CACHE_SIZE 256*1024*1024
 
 /* =========================================================================================== */
@@ -725,7 +729,7 @@ static rc_t gather_flag_options( Args * args, samdump_opts * opts )
     }
 
     {
-        bool gzip, bzip2;
+        bool gzip, bzip2, bgzf;
 
         /* do we have to compress the output with gzip ? */
         /* do we have to compress the output with bzip2 ? */
@@ -735,6 +739,34 @@ static rc_t gather_flag_options( Args * args, samdump_opts * opts )
             opts->output_compression = oc_gzip;
         if ( bzip2 )
             opts->output_compression = oc_bzip2;
+
+        /* do we have to compress the output in BGZF-blocks ? */
+        rc = get_bool_option( args, OPT_BGZF, &bgzf );
+        if ( rc != 0 ) return rc;
+        if ( bgzf )
+            opts->output_compression = oc_bgzf;
+    }
+
+    {
+        bool bam;
+
+        /* do we have to encode the output as BAM ? */
+        rc = get_bool_option( args, OPT_BAM, &bam );
+        if ( rc != 0 ) return rc;
+        if ( bam )
+        {
+            opts->output_compression = oc_bam;
+            /* BAM cannot be without the references of the header */
+            if ( opts->header_mode == hm_none )
+            {
+                (void)LOGMSG( klogWarn, "BAM-output needs a header, the header is recalculated" );
+                opts->header_mode = hm_recalc;
+            }
+        }
+
+        /* do we have to write an index for the BAM-output ? */
+        rc = get_bool_option( args, OPT_BAM_INDEX, &opts->write_bam_index );
+        if ( rc != 0 ) return rc;
     }
 
 
@@ -749,6 +781,13 @@ static rc_t gather_flag_options( Args * args, samdump_opts * opts )
             opts->output_format = of_fasta;
         if ( fastq )
             opts->output_format = of_fastq;
+
+        if ( ( fasta || fastq ) && opts->output_compression == oc_bam )
+        {
+            rc = RC( rcExe, rcArgv, rcParsing, rcParam, rcInvalid );
+            (void)LOGERR( klogErr, rc, "BAM-output cannot be combined with FASTA/FASTQ" );
+            return rc;
+        }
     }
 
 
@@ -865,6 +904,29 @@ static rc_t get_uint32_option( Args * args, const char * name, uint32_t def, uin
 }
 
 
+/* digits only, from 0 ( compress on the calling thread ) to PAR_GZIP_MAX_THREADS */
+static rc_t get_zthreads_option( Args * args, const char * name, uint32_t * value )
+{
+    const char * s;
+    rc_t rc = get_str_option( args, name, &s );
+    *value = PAR_GZIP_DEFAULT_THREADS;
+    if ( rc == 0 && s != NULL )
+    {
+        char *endp;
+        unsigned long v = strtoul( s, &endp, 10 );
+        if ( !isdigit( ( unsigned char )s[ 0 ] ) || *endp != '\0' || v > PAR_GZIP_MAX_THREADS )
+        {
+            rc = RC( rcExe, rcArgv, rcProcessing, rcParam, rcInvalid );
+            (void)PLOGERR( klogErr, ( klogErr, rc, "Parameter for $(t) [$(v)] is invalid: must be a number from 0 to $(m)",
+                                      "t=%s,v=%s,m=%u", name, s, PAR_GZIP_MAX_THREADS ) );
+        }
+        else
+            *value = ( uint32_t )v;
+    }
+    return rc;
+}
+
+
 static rc_t get_int32_options( Args * args, const char * name, int32_t * value, bool * used )
 {
     const char * s;
@@ -915,6 +977,15 @@ static rc_t gather_int_options( Args * args, samdump_opts * opts )
     if ( rc == 0 )
         rc = get_uint32_option( args, OPT_OUTBUFSIZE, 1024 * 32, &opts->output_buffer_size, false );
 
+    if ( rc == 0 )
+        rc = get_zthreads_option( args, OPT_ZTHREADS, &opts->compress_threads );
+
+    if ( rc == 0 )
+        rc = get_uint32_option( args, OPT_THREADS, 1, &opts->num_threads, false );
+
+    if ( rc == 0 )
+        rc = get_uint32_option( args, OPT_MATE_CACHE_MEM, 1024, &opts->mate_cache_mem, false );
+
     if ( rc == 0 )
     {
         uint32_t cs;
@@ -1242,6 +1313,8 @@ void report_options( const samdump_opts * opts )
         case oc_none  : KOutMsg( "output-compression    : none\n" ); break;
         case oc_gzip  : KOutMsg( "output-compression    : gzip\n" ); break;
         case oc_bzip2 : KOutMsg( "output-compression    : bzip2\n" ); break;
+        case oc_bgzf  : KOutMsg( "output-compression    : bgzf\n" ); break;
+        case oc_bam   : KOutMsg( "output-compression    : bam\n" ); break;
         default       : KOutMsg( "output-compression    : unknown\n" ); break;
     }
 
@@ -1327,9 +1400,13 @@ void report_options( const samdump_opts * opts )
     KOutMsg( "mate-gap-cache-limit  : %u\n",  opts->mape_gap_cache_limit );
     KOutMsg( "outputfile            : %s\n",  opts->outputfile );
     KOutMsg( "outputbuffer-size     : %u\n",  opts->output_buffer_size );
+    KOutMsg( "compress-threads      : %u\n",  opts->compress_threads );
+    KOutMsg( "threads               : %u\n",  opts->num_threads );
+    KOutMsg( "bam-index             : %s\n",  opts->write_bam_index ? "YES" : "NO" );
     KOutMsg( "cursor-cache-size     : %u\n",  opts->cursor_cache_size );
 
     KOutMsg( "use mate-cache        : %s\n",  opts->use_mate_cache ? "YES" : "NO" );
+    KOutMsg( "mate-cache-mem        : %u MB\n",  opts->mate_cache_mem );
     KOutMsg( "force legacy code     : %s\n",  opts->force_legacy ? "YES" : "NO" );
     KOutMsg( "use min-mapq          : %s\n",  opts->use_min_mapq ? "YES" : "NO" );
     KOutMsg( "min-mapq              : %i\n",  opts->min_mapq );
@@ -1427,17 +1504,17 @@ bool is_this_alignment_requested( const samdump_opts * opts, const char *refname
 }
 
 
-rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
-                const char * spot_group, uint32_t spot_group_len )
+rc_t dump_name_to( const samdump_opts * opts, char * buffer, size_t bufsize, size_t * written,
+                   int64_t seq_spot_id, const char * spot_group, uint32_t spot_group_len )
 {
     rc_t rc;
 
     if ( opts->print_cg_names )
     {
         if ( spot_group != NULL && spot_group_len != 0 )
-            rc = KOutMsg( "%.*s-1:%lu", spot_group_len, spot_group, seq_spot_id );
+            rc = string_printf( buffer, bufsize, written, "%.*s-1:%lu", spot_group_len, spot_group, seq_spot_id );
         else
-            rc = KOutMsg( "%lu", seq_spot_id );
+            rc = string_printf( buffer, bufsize, written, "%lu", seq_spot_id );
     }
     else
     {
@@ -1445,19 +1522,45 @@ rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
         {
             /* we do have to print a prefix */
             if ( opts->print_spot_group_in_name && spot_group != NULL && spot_group_len > 0 )
-                rc = KOutMsg( "%s.%lu.%.*s", opts->qname_prefix, seq_spot_id, spot_group_len, spot_group );
+                rc = string_printf( buffer, bufsize, written, "%s.%lu.%.*s", opts->qname_prefix, seq_spot_id, spot_group_len, spot_group );
             else
             /* we do NOT have to append the spot-group */
-                rc = KOutMsg( "%s.%lu", opts->qname_prefix, seq_spot_id );
+                rc = string_printf( buffer, bufsize, written, "%s.%lu", opts->qname_prefix, seq_spot_id );
         }
         else
         {
             /* we do NOT have to print a prefix */
             if ( opts->print_spot_group_in_name && spot_group != NULL && spot_group_len > 0 )
-                rc = KOutMsg( "%lu.%.*s", seq_spot_id, spot_group_len, spot_group );
+                rc = string_printf( buffer, bufsize, written, "%lu.%.*s", seq_spot_id, spot_group_len, spot_group );
             else
             /* we do NOT have to append the spot-group */
-                rc = KOutMsg( "%lu", seq_spot_id );
+                rc = string_printf( buffer, bufsize, written, "%lu", seq_spot_id );
+        }
+    }
+    return rc;
+}
+
+
+rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
+                const char * spot_group, uint32_t spot_group_len )
+{
+    char buffer[ 4096 ];
+    size_t written = 0;
+    rc_t rc = dump_name_to( opts, buffer, sizeof buffer, &written, seq_spot_id, spot_group, spot_group_len );
+    if ( rc == 0 )
+        rc = KOutMsg( "%.*s", ( uint32_t )written, buffer );
+    else if ( GetRCState( rc ) == rcInsufficient && written >= sizeof buffer )
+    {
+        /* a very long prefix or spot-group, written tells how long */
+        char * name = malloc( written + 1 );
+        if ( name == NULL )
+            rc = RC( rcApp, rcNoTarg, rcAllocating, rcMemory, rcExhausted );
+        else
+        {
+            rc = dump_name_to( opts, name, written + 1, &written, seq_spot_id, spot_group, spot_group_len );
+            if ( rc == 0 )
+                rc = KOutMsg( "%.*s", ( uint32_t )written, name );
+            free( name );
         }
     }
     return rc;
@@ -76,6 +76,11 @@ extern "C" {
 #define OPT_Q_QUANT     "qual-quant"
 #define OPT_GZIP        "gzip"
 #define OPT_BZIP2       "bzip2"
+#define OPT_BGZF        "bgzf"
+#define OPT_ZTHREADS    "compress-threads"
+#define OPT_THREADS     "threads"
+#define OPT_BAM         "bam"
+#define OPT_BAM_INDEX   "bam-index"
 #define OPT_FASTQ       "fastq"
 #define OPT_FASTA       "fasta"
 #define OPT_HDR_COMMENT "header-comment"
@@ -91,6 +96,7 @@ extern "C" {
 #define OPT_DUMP_MODE   "dump-mode"
 #define OPT_MIN_MAPQ    "min-mapq"
 #define OPT_NO_MATE_CACHE "no-mate-cache"
+#define OPT_MATE_CACHE_MEM "mate-cache-mem"
 #define OPT_LEGACY      "legacy"
 #define OPT_NEW         "new"
 #define OPT_RNA_SPLICE  "rna-splicing"
@@ -134,7 +140,9 @@ enum output_compression
 {
     oc_none = 0,    /* do not compress output */
     oc_gzip,        /* compress output with gzip */
-    oc_bzip2        /* compress output with bzip2 */
+    oc_bzip2,       /* compress output with bzip2 */
+    oc_bgzf,        /* compress output with gzip in BGZF-blocks */
+    oc_bam          /* encode output as BAM ( in BGZF-blocks ) */
 };
 
 enum cigar_treatment
@@ -194,6 +202,9 @@ typedef struct samdump_opts
     /* logging of rna-splicing on reqest */
     struct rna_splice_log * rna_splice_log;
 
+    /* BAM-output of the run, records are encoded directly into it */
+    struct bam_out * bam;
+
     uint32_t region_count;
     uint32_t input_file_count;
     uint32_t rna_splice_level;  /* can be 0 || 1 || 2 */
@@ -203,9 +214,18 @@ typedef struct samdump_opts
     /* how much buffering on the output-buffer, of OFF if zero */
     uint32_t output_buffer_size;
 
+    /* how many threads compress the output ( gzip, bgzf, bam ) */
+    uint32_t compress_threads;
+
+    /* how many threads dump references / windows of references in parallel */
+    uint32_t num_threads;
+
     /* mate's farther apart than this are not cached */
     uint32_t mape_gap_cache_limit;
 
+    /* MB the mate-cache of one input-file may use, mates are read from the table above it */
+    uint32_t mate_cache_mem;
+
     size_t cursor_cache_size;
 
     /* how the sam-headers are treated */
@@ -262,6 +282,9 @@ typedef struct samdump_opts
 
     /* option to disable multi-threading */
     bool no_mt;
+
+    /* write a BAI-index next to the BAM-output */
+    bool write_bam_index;
     
 	bool with_md_flag;
 	
@@ -296,6 +319,10 @@ bool is_this_alignment_requested( const samdump_opts * opts, const char *refname
 rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
                 const char * spot_group, uint32_t spot_group_len );
 
+/* the same name as dump_name() prints, into a buffer */
+rc_t dump_name_to( const samdump_opts * opts, char * buffer, size_t bufsize, size_t * written,
+                   int64_t seq_spot_id, const char * spot_group, uint32_t spot_group_len );
+
 rc_t dump_name_legacy( const samdump_opts * opts, const char * name, size_t name_len,
                        const char * spot_group, uint32_t spot_group_len );
 
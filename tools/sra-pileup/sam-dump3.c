@@ -99,6 +99,23 @@ char const *sd_gzip_usage[]           = { "Compress output using gzip",
 char const *sd_bzip2_usage[]          = { "Compress output using bzip2",
                                        NULL };
 
+char const *sd_bgzf_usage[]           = { "Compress output using gzip in BGZF-blocks ( indexable )",
+                                       NULL };
+
+char const *sd_zthreads_usage[]       = { "number of threads compressing gzip/bgzf/bam-output, 0 to 64 (dflt:4, 0...off)",
+                                       NULL };
+
+char const *sd_threads_usage[]        = { "number of threads dumping references or windows of",
+                                          "references in parallel (dflt:1)",
+                                       NULL };
+
+char const *sd_bam_usage[]            = { "Output BAM instead of SAM ( compressed in BGZF-blocks )",
+                                       NULL };
+
+char const *sd_bam_index_usage[]      = { "Write a BAI-index 'output-file'.bai for the BAM-output",
+                                       "( needs --output-file, output has to be sorted )",
+                                       NULL };
+
 char const *sd_qname_usage[]          = { "Add .SPOT_GROUP to QNAME",
                                        NULL };
 
@@ -151,6 +168,10 @@ char const *sd_min_mapq_usage[]       = { "min. mapq an alignment has to have, t
 char const *sd_no_mate_cache_usage[]  = { "do not use a mate-cache, slower but less memory usage",
                                        NULL };
 
+char const *sd_mate_cache_mem_usage[] = { "memory-limit of the mate-cache per input in MB (dflt:1024),",
+                                          "above it mates are read from the table",
+                                       NULL };
+
 char const *rna_splice_usage[]        = { "modify cigar-string (replace .D. with .N.) and add output flags (XS:A:+/-) ",
                                            "when rna-splicing is detected by match to spliceosome recognition sites",
                                        NULL };
@@ -183,6 +204,11 @@ OptDef SamDumpArgs[] =
     { OPT_HIDE_IDENT,    "=", NULL, sd_identicalbases_usage, 0, false, false },  /* replace bases that match the reference with '=' */
     { OPT_GZIP,         NULL, NULL, sd_gzip_usage,           0, false, false },  /* compress the output with gzip */
     { OPT_BZIP2,        NULL, NULL, sd_bzip2_usage,          0, false, false },  /* compress the output with bzip2 */
+    { OPT_BGZF,         NULL, NULL, sd_bgzf_usage,           0, false, false },  /* compress the output with gzip in BGZF-blocks */
+    { OPT_ZTHREADS,     NULL, NULL, sd_zthreads_usage,       0, true,  false },  /* number of compressing threads */
+    { OPT_THREADS,      NULL, NULL, sd_threads_usage,        0, true,  false },  /* number of dumping threads */
+    { OPT_BAM,          NULL, NULL, sd_bam_usage,            0, false, false },  /* output BAM instead of SAM */
+    { OPT_BAM_INDEX,    NULL, NULL, sd_bam_index_usage,      0, false, false },  /* write a BAI-index for the BAM-output */
     { OPT_SPOTGRP,       "g", NULL, sd_qname_usage,          0, false, false },  /* add spotgroup to qname */
     { OPT_FASTQ,        NULL, NULL, sd_fastq_usage,          0, false, false },  /* output-format = fastq ( instead of SAM ) */
     { OPT_FASTA,        NULL, NULL, sd_fasta_usage,          0, false, false },  /* output-format = fasta ( instead of SAM ) */
@@ -205,6 +231,7 @@ OptDef SamDumpArgs[] =
     { OPT_CURSOR_CACHE, NULL, NULL, sd_cur_cache_usage,      0, true,  false },  /* size of cursor cache */
     { OPT_MIN_MAPQ,     NULL, NULL, sd_min_mapq_usage,       0, true,  false },  /* minimal mapping quality */
     { OPT_NO_MATE_CACHE,NULL, NULL, sd_no_mate_cache_usage,  0, false, false },  /* do not use mate-cache */
+    { OPT_MATE_CACHE_MEM,NULL, NULL, sd_mate_cache_mem_usage, 0, true,  false }, /* memory-limit of mate-cache */
     { OPT_RNA_SPLICE,   NULL, NULL, rna_splice_usage,        0, false, false },  /* detect rna-splicing in sequence */
     { OPT_RNA_SPLICEL,  NULL, NULL, rna_splicel_usage,       0, true,  false },  /* level of rna-splicing detection */
     { OPT_RNA_SPLICE_LOG,  NULL, NULL, rna_splice_log_usage, 0, true,  false },  /* filename to log rna-splice events into */
@@ -233,6 +260,11 @@ char const *sd_usage_params[] =
     NULL,                       /* identical-bases */
     NULL,                       /* gzip */
     NULL,                       /* bzip2 */
+    NULL,                       /* bgzf */
+    "count",                    /* compress-threads */
+    "count",                    /* threads */
+    NULL,                       /* bam */
+    NULL,                       /* bam-index */
     NULL,                       /* qname */
     NULL,                       /* fasta */
     NULL,                       /* fastq */
@@ -255,6 +287,7 @@ char const *sd_usage_params[] =
     NULL,                       /* cursor cache */
     NULL,                       /* min_mapq */
     NULL,                       /* no mate-cache */
+    "MB",                       /* mate-cache-mem */
     NULL,                       /* detect rna-splicing in sequence */
     NULL,                       /* level of rna-splicing detection */
     NULL,                       /* file to log rna-splice-events into */
@@ -390,7 +423,8 @@ static rc_t print_samdump( const samdump_opts * const opts )
                         matecache * mc = NULL;
 
                         if ( opts->use_mate_cache )
-                            rc = make_matecache( &mc, ifs->database_count );
+                            rc = make_matecache( &mc, ifs->database_count,
+                                                 ( size_t )opts->mate_cache_mem * 1024 * 1024 ); /* matecache.c */
 
                         if ( rc == 0 )
                         {
@@ -467,7 +501,7 @@ static rc_t perform_cigar_test( const samdump_opts * const opts )
 
 /* =========================================================================================== */
 
-static rc_t samdump_main( Args * args, const samdump_opts * const opts )
+static rc_t samdump_main( Args * args, samdump_opts * const opts )
 {
     rc_t rc = 0;
     out_redir redir; /* from out_redir.h */
@@ -478,11 +512,23 @@ static rc_t samdump_main( Args * args, const samdump_opts * const opts )
         case oc_none  : mode = orm_uncompressed; break;
         case oc_gzip  : mode = orm_gzip; break;
         case oc_bzip2 : mode = orm_bzip2; break;
+        case oc_bgzf  : mode = orm_bgzf; break;
+        case oc_bam   : mode = orm_bam; break;
     }
 
-    rc = init_out_redir( &redir, mode, opts->outputfile, opts->output_buffer_size ); /* from out_redir.c */
+    /* reporting options or testing cigars does not produce SAM */
+    if ( mode == orm_bam && ( opts->report_options || opts->cigar_test != NULL ) )
+        mode = orm_uncompressed;
+
+    if ( mode == orm_bam && opts->write_bam_index && opts->outputfile == NULL )
+        (void)LOGMSG( klogWarn, "BAM-index needs --output-file, no index written" );
+
+    rc = init_out_redir( &redir, mode, opts->outputfile, opts->output_buffer_size,
+                         opts->no_mt ? 0 : opts->compress_threads,
+                         opts->write_bam_index ); /* from out_redir.c */
     if ( rc == 0 )
     {
+        opts->bam = redir.bam;
         if ( opts->report_options )
         {
             report_options( opts ); /* from sam-dump-opts.c */
@@ -506,6 +552,7 @@ static rc_t samdump_main( Args * args, const samdump_opts * const opts )
             /* ------------------------------------------------------ */
             }
         }
+        opts->bam = NULL;
         release_out_redir( &redir ); /* from out_redir.c */
     }
     return rc;
@@ -42,6 +42,7 @@
 #include "pileup_indels.h"
 #include "pileup_stat.h"
 #include "pileup_v2.h"
+#include "par_gzip.h"
 
 #include <kapp/main.h>
 
@@ -53,7 +54,6 @@
 #include <kfs/file.h>
 #include <kfs/buffile.h>
 #include <kfs/bzip.h>
-#include <kfs/gzip.h>
 
 #include <insdc/sra.h>
 
@@ -338,6 +338,7 @@ struct {
     void* org_data;
     KFile* kfile;
     uint64_t pos;
+    par_gzip* pgz;      /* gzip goes through it instead of kfile */
 } g_out_writer = { NULL };
 
 const char UsageDefaultName[] = "sra-pileup";
@@ -417,6 +418,13 @@ static rc_t CC BufferedWriter ( void* self, const char* buffer, size_t bufsize,
     assert( buffer != NULL );
     assert( num_writ != NULL );
 
+    if ( g_out_writer.pgz != NULL )
+    {
+        rc = par_gzip_write( g_out_writer.pgz, buffer, bufsize );
+        *num_writ = ( rc == 0 ) ? bufsize : 0;
+        return rc;
+    }
+
     do {
         rc = KFileWrite( g_out_writer.kfile, g_out_writer.pos, buffer, bufsize, num_writ );
         if ( rc == 0 )
@@ -430,7 +438,8 @@ static rc_t CC BufferedWriter ( void* self, const char* buffer, size_t bufsize,
 }
 
 
-static rc_t set_stdout_to( bool gzip, bool bzip2, const char * filename, size_t bufsize )
+static rc_t set_stdout_to( bool gzip, bool bzip2, const char * filename, size_t bufsize,
+                           uint32_t num_threads )
 {
     rc_t rc = 0;
     if ( gzip && bzip2 )
@@ -451,29 +460,33 @@ static rc_t set_stdout_to( bool gzip, bool bzip2, const char * filename, size_t
             rc = KDirectoryCreateFile ( dir, &of, false, 0664, kcmInit, "%s", filename );
             if ( rc == 0 )
             {
-                KFile *buf;
+                KFile *buf = NULL;
                 if ( gzip )
                 {
-                    KFile *gz;
-                    rc = KFileMakeGzipForWrite( &gz, of );
+                    /* blocks are compressed in parallel and written by the thread doing the output,
+                       par_gzip buffers by itself */
+                    rc = make_par_gzip( &g_out_writer.pgz, of, pgz_gzip, num_threads );
                     if ( rc == 0 )
                     {
-                        KFileRelease( of );
-                        of = gz;
+                        buf = of;
+                        KFileAddRef( buf );
                     }
                 }
-                if ( bzip2 )
+                else
                 {
-                    KFile *bz;
-                    rc = KFileMakeBzip2ForWrite( &bz, of );
-                    if ( rc == 0 )
+                    if ( bzip2 )
                     {
-                        KFileRelease( of );
-                        of = bz;
+                        KFile *bz;
+                        rc = KFileMakeBzip2ForWrite( &bz, of );
+                        if ( rc == 0 )
+                        {
+                            KFileRelease( of );
+                            of = bz;
+                        }
                     }
+                    if ( rc == 0 )
+                        rc = KBufFileMakeWrite( &buf, of, false, bufsize );
                 }
-
-                rc = KBufFileMakeWrite( &buf, of, false, bufsize );
                 if ( rc == 0 )
                 {
                     g_out_writer.kfile = buf;
@@ -496,6 +509,15 @@ static rc_t set_stdout_to( bool gzip, bool bzip2, const char * filename, size_t
 
 static void release_stdout_redirection( void )
 {
+    if ( g_out_writer.pgz != NULL )
+    {
+        rc_t rc = release_par_gzip( g_out_writer.pgz );
+        if ( rc != 0 )
+        {
+            LOGERR( klogErr, rc, "failed to finish compressed output" );
+        }
+        g_out_writer.pgz = NULL;
+    }
     KFileRelease( g_out_writer.kfile );
     if( g_out_writer.org_writer != NULL )
     {
@@ -1551,7 +1573,8 @@ rc_t CC KMain( int argc, char *argv [] )
                         rc = set_stdout_to( options.cmn.gzip_output,
                                             options.cmn.bzip_output,
                                             options.cmn.output_file,
-                                            32 * 1024 );
+                                            32 * 1024,
+                                            options.cmn.no_mt ? 0 : PAR_GZIP_DEFAULT_THREADS );
                     }
 
                     if ( rc == 0 )
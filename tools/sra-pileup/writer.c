@@ -32,7 +32,6 @@
 #include <kfs/file.h>
 #include <kfs/directory.h>
 #include <kfs/buffile.h>
-#include <kfs/gzip.h>
 #include <kfs/bzip.h>
 #include <kapp/main.h>
 #include <kapp/args.h>
@@ -41,12 +40,14 @@
 
 #include "cmdline_cmn.h"
 #include "writer.h"
+#include "par_gzip.h"
 
 struct {
     KWrtWriter writer;
     void* data;
     KFile* kfile;
     uint64_t pos;
+    par_gzip* pgz;      /* gzip goes through it instead of kfile */
 } g_out_writer = {NULL};
 
 static
@@ -57,6 +58,12 @@ rc_t CC BufferedWriter(void* self, const char* buffer, size_t bufsize, size_t* n
     assert(buffer != NULL);
     assert(num_writ != NULL);
 
+    if( g_out_writer.pgz != NULL ) {
+        rc = par_gzip_write(g_out_writer.pgz, buffer, bufsize);
+        *num_writ = rc == 0 ? bufsize : 0;
+        return rc;
+    }
+
     do {
         if( (rc = KFileWrite(g_out_writer.kfile, g_out_writer.pos, buffer, bufsize, num_writ)) == 0 ) {
             buffer += *num_writ;
@@ -98,11 +105,14 @@ rc_t BufferedWriterMake(const common_options* opt)
     if( rc == 0 ) {
         g_out_writer.pos = 0;
         if( opt->gzip_output ) {
-            KFile* gz;
-            if( (rc = KFileMakeGzipForWrite(&gz, g_out_writer.kfile)) == 0 ) {
-                KFileRelease(g_out_writer.kfile);
-                g_out_writer.kfile = gz;
+            /* compressed on worker threads, par_gzip buffers by itself */
+            if( (rc = make_par_gzip(&g_out_writer.pgz, g_out_writer.kfile, pgz_gzip,
+                                    opt->no_mt ? 0 : PAR_GZIP_DEFAULT_THREADS)) == 0 ) {
+                g_out_writer.writer = KOutWriterGet();
+                g_out_writer.data = KOutDataGet();
+                rc = KOutHandlerSet(BufferedWriter, &g_out_writer);
             }
+            return rc;
         } else if( opt->bzip_output ) {
             KFile* bz;
             if( (rc = KFileMakeBzip2ForWrite(&bz, g_out_writer.kfile)) == 0 ) {
@@ -126,6 +136,15 @@ rc_t BufferedWriterMake(const common_options* opt)
 
 void BufferedWriterRelease( bool flush )
 {
+    if( g_out_writer.pgz != NULL ) {
+        if( flush ) {
+            rc_t rc = release_par_gzip(g_out_writer.pgz);
+            if( rc != 0 ) {
+                LOGERR(klogErr, rc, "failed to finish compressed output");
+            }
+        }
+        g_out_writer.pgz = NULL;
+    }
     if( flush ) {
         /* avoid flushing buffered data after failure */
         KFileRelease(g_out_writer.kfile);
@@ -0,0 +1,187 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _hpp_interval_index_
+#define _hpp_interval_index_
+
+#include <vector>
+#include <algorithm>
+
+namespace seq_ranges {
+
+/* -----------------------------------------------------------------------
+	a static index of closed intervals [ start .. end ]:
+
+	the intervals are sorted by start, the sorted array is an implicit
+	balanced binary tree ( the node at index i has level k, if the lowest
+	k bits of i are set and bit k is clear ), each node knows the largest
+	end of its subtree. a query visits only subtrees that can overlap:
+	O( log( n ) + number of hits ).
+
+	the intervals are identified by the order they were added in.
+   ----------------------------------------------------------------------- */
+
+class interval_index
+{
+	private :
+		struct node
+		{
+			long start;
+			long end;
+			long max_end;	/* the largest end in the subtree of this node */
+			size_t id;
+			
+			bool operator< ( const node &other ) const { return ( start < other.start ); }
+		};
+
+		struct frame
+		{
+			int level;
+			size_t idx;
+			bool left_done;
+		};
+
+		std::vector< node > nodes;
+		int root_level;
+		bool built;
+
+	public :
+		interval_index( void ) : root_level( -1 ), built( false ) {}
+
+		void add( long start, long end )
+		{
+			node n;
+			n.start = start;
+			n.end = end;
+			n.max_end = end;
+			n.id = nodes.size();
+			nodes.push_back( n );
+			built = false;
+		}
+
+		size_t size( void ) const { return nodes.size(); }
+
+		/* has to be called once after the last add() and before query() */
+		void build( void )
+		{
+			size_t n = nodes.size();
+			size_t i, last_i = 0;
+			long last = 0;
+			int k;
+
+			/* stable: equal starts keep the order they were added in */
+			std::stable_sort( nodes.begin(), nodes.end() );
+			built = true;
+			root_level = -1;
+			if ( n == 0 ) return;
+
+			for ( i = 0; i < n; i += 2 )
+			{
+				last_i = i;
+				last = nodes[ i ].max_end = nodes[ i ].end;		/* the leaves, level 0 */
+			}
+			for ( k = 1; ( ( size_t )1 << k ) <= n; ++k )
+			{
+				size_t x = ( size_t )1 << ( k - 1 );
+				size_t step = x << 2;
+				for ( i = ( x << 1 ) - 1; i < n; i += step )
+				{
+					long left = nodes[ i - x ].max_end;
+					long right = ( i + x < n ) ? nodes[ i + x ].max_end : last;
+					long e = nodes[ i ].end;
+					if ( left > e ) e = left;
+					if ( right > e ) e = right;
+					nodes[ i ].max_end = e;
+				}
+				/* last_i moves to its parent, which may be out of range */
+				last_i = ( ( last_i >> k ) & 1 ) ? last_i - x : last_i + x;
+				if ( last_i < n && nodes[ last_i ].max_end > last )
+					last = nodes[ last_i ].max_end;
+			}
+			root_level = k - 1;
+		}
+
+		/* appends the ids of all intervals overlapping [ start .. end ] to hits,
+		   in the order of their start */
+		void query( long start, long end, std::vector< size_t > &hits ) const
+		{
+			frame stack[ 64 ];
+			int t = 0;
+			size_t n = nodes.size();
+
+			if ( !built || root_level < 0 ) return;
+
+			stack[ t ].level = root_level;
+			stack[ t ].idx = ( ( size_t )1 << root_level ) - 1;
+			stack[ t ].left_done = false;
+			t++;
+			while ( t > 0 )
+			{
+				frame z = stack[ --t ];
+				if ( z.level <= 3 )
+				{
+					/* small subtree: scan it */
+					size_t i = ( z.idx >> z.level ) << z.level;
+					size_t i1 = i + ( ( size_t )1 << ( z.level + 1 ) ) - 1;
+					if ( i1 > n ) i1 = n;
+					for ( ; i < i1 && nodes[ i ].start <= end; ++i )
+					{
+						if ( start <= nodes[ i ].end )
+							hits.push_back( nodes[ i ].id );
+					}
+				}
+				else if ( !z.left_done )
+				{
+					/* the left child may be out of range, if the tree is not complete */
+					size_t left = z.idx - ( ( size_t )1 << ( z.level - 1 ) );
+					stack[ t ].level = z.level;
+					stack[ t ].idx = z.idx;
+					stack[ t ].left_done = true;
+					t++;
+					if ( left >= n || nodes[ left ].max_end >= start )
+					{
+						stack[ t ].level = z.level - 1;
+						stack[ t ].idx = left;
+						stack[ t ].left_done = false;
+						t++;
+					}
+				}
+				else if ( z.idx < n && nodes[ z.idx ].start <= end )
+				{
+					if ( start <= nodes[ z.idx ].end )
+						hits.push_back( nodes[ z.idx ].id );
+					stack[ t ].level = z.level - 1;
+					stack[ t ].idx = z.idx + ( ( size_t )1 << ( z.level - 1 ) );
+					stack[ t ].left_done = false;
+					t++;
+				}
+			}
+		}
+};
+
+};  // namespace seq_ranges
+
+#endif // _hpp_interval_index_
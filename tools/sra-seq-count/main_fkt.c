@@ -34,33 +34,40 @@
 #include <klib/rc.h>
 #include <klib/out.h>
 #include <klib/text.h>
+#include <klib/log.h>
 
 #include <os-native.h>
 #include <sysalloc.h>
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #define OPTION_ID_ATTR         	"id_attr"
 #define OPTION_FEATURE_TYPE    	"feature_type"
 #define OPTION_MODE            	"mode"
+#define OPTION_THREADS         	"threads"
 
 #define ALIAS_ID_ATTR          	"i"
 #define ALIAS_FEATURE_TYPE     	"f"
 #define ALIAS_MODE     			"m"
+#define ALIAS_THREADS  			"t"
 
 #define DEFAULT_ID_ATTR         "gene_id"
 #define DEFAULT_FEATURE_TYPE    "exon"
+#define DEFAULT_THREADS         1
 
 static const char * id_attr_usage[] 		= { "id-attr (default gene_id)", NULL };
 static const char * feature_type_usage[] 	= { "feature-type (default exon)", NULL };
 static const char * mode_usage[] 			= { "output-mode (norm, debug)", NULL };
+static const char * threads_usage[] 		= { "number of threads counting references (default 1)", NULL };
 
 OptDef sra_seq_count_options[] =
 {
     { OPTION_ID_ATTR, 		ALIAS_ID_ATTR,			NULL, id_attr_usage,		1, true, false },
     { OPTION_FEATURE_TYPE, 	ALIAS_FEATURE_TYPE, 	NULL, feature_type_usage, 	1, true, false },
-    { OPTION_MODE, 			ALIAS_MODE, 			NULL, mode_usage, 			1, true, false }	
+    { OPTION_MODE, 			ALIAS_MODE, 			NULL, mode_usage, 			1, true, false },
+    { OPTION_THREADS, 		ALIAS_THREADS, 			NULL, threads_usage, 		1, true, false }
 };
 
 const char UsageDefaultName[] = "sra-seq-count";
@@ -93,6 +100,7 @@ rc_t CC Usage ( const Args * args )
     HelpOptionLine ( ALIAS_ID_ATTR,			OPTION_ID_ATTR,			NULL, 		id_attr_usage );
     HelpOptionLine ( ALIAS_FEATURE_TYPE, 	OPTION_FEATURE_TYPE, 	NULL, 		feature_type_usage );
     HelpOptionLine ( ALIAS_MODE, 			OPTION_MODE, 			NULL, 		mode_usage );
+    HelpOptionLine ( ALIAS_THREADS, 		OPTION_THREADS, 		"count", 	threads_usage );
 
     KOutMsg ( "\n" );	
     HelpOptionsStandard ();
@@ -119,6 +127,37 @@ static rc_t get_str_option( const Args * args, const char * option_name, const c
 }
 
 
+static rc_t get_uint_option( const Args * args, const char * option_name, uint32_t * dst, uint32_t default_value )
+{
+    uint32_t count;
+    rc_t rc = ArgsOptionCount( args, option_name, &count );
+    (*dst) = default_value;
+    if ( ( rc == 0 )&&( count > 0 ) )
+    {
+        const char * s;
+        rc = ArgsOptionValue( args, option_name, 0, &s );
+        if ( rc == 0 )
+        {
+            /* only digits, no sign, no trailing garbage, no overflow and not zero */
+            char * end = NULL;
+            unsigned long value = 0;
+            errno = 0;
+            if ( s[ 0 ] >= '0' && s[ 0 ] <= '9' )
+                value = strtoul( s, &end, 10 );
+            if ( end == NULL || *end != 0 || errno != 0 || value == 0 || value > UINT32_MAX )
+            {
+                rc = RC( rcApp, rcArgv, rcParsing, rcParam, rcInvalid );
+                PLOGERR( klogErr, ( klogErr, rc, "invalid value '$(value)' for --$(name)",
+                                    "value=%s,name=%s", s, option_name ) );
+            }
+            else
+                (*dst) = ( uint32_t )value;
+        }
+    }
+    return rc;
+}
+
+
 static rc_t gather_options( const Args * args, struct sra_seq_count_options * options )
 {
 	rc_t rc;
@@ -141,6 +180,9 @@ static rc_t gather_options( const Args * args, struct sra_seq_count_options * op
 		}
 	}
 	
+	if ( rc == 0 )
+		rc = get_uint_option( args, OPTION_THREADS, &options->threads, DEFAULT_THREADS );
+	
 	if ( rc == 0 )
 	{
 		uint32_t count;
@@ -174,6 +216,8 @@ static rc_t report_options( const struct sra_seq_count_options * options )
 		rc =  KOutMsg( "id-attr      : %s\n", options->id_attrib );
 	if ( rc == 0 )
 		rc =  KOutMsg( "feature-type : %s\n", options->feature_type );
+	if ( rc == 0 )
+		rc =  KOutMsg( "threads      : %u\n", options->threads );
 	if ( rc == 0 )
 	{
 		switch ( options->output_mode )
@@ -28,6 +28,7 @@
 #define _h_sra_seq_count_options_
 
 #include <os-native.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -43,6 +44,7 @@ struct sra_seq_count_options
     const char * id_attrib;
     const char * feature_type;
 	int output_mode;
+	uint32_t threads;	/* references are counted in parallel on this many threads */
 	bool valid;
 };
 
@@ -27,7 +27,8 @@
 #ifndef _hpp_seq_ranges_
 #define _hpp_seq_ranges_
 
-#include <list>
+#include <vector>
+#include <algorithm>
 
 namespace seq_ranges {
 
@@ -191,9 +192,9 @@ class range
 };
 
 
-bool compare_ranges ( const range * first, const range * second )
+inline bool compare_ranges ( const range &first, const range &second )
 {
-	return ( first -> get_start() < second -> get_start() );
+	return ( first.get_start() < second.get_start() );
 }
 
 
@@ -214,45 +215,31 @@ struct ranges_relation
 };
 
 
+/* the ranges are stored by value, a feature can be copied/moved around as a whole */
 class ranges
 {
 	private :
-		std::list< range * > range_list;
-		long count;
+		std::vector< range > range_list;
 		
 	public :
-		ranges( void ) : count( 0 ) {}
-		~ranges( void ) { clear(); }
+		ranges( void ) {}
 		
-		void clear( void )
-		{
-			while ( !range_list.empty() )
-			{
-				range * r = range_list.front();
-				range_list.pop_front();
-				if ( r != NULL ) delete r;
-			}
-			count = 0;
-		}
+		void clear( void ) { range_list.clear(); }
 		
-		void add( range * r ){ if ( r != NULL ) { range_list.push_back( r ); count++; } }
-		void add( const range &r ){ add( new range( r ) ); }
+		void add( range * r ) { if ( r != NULL ) { range_list.push_back( *r ); delete r; } }
+		void add( const range &r ) { range_list.push_back( r ); }
 
 		void merge( const range &r1 )
 		{
 			bool merged = false;
-			std::list< range * >::iterator it;
+			std::vector< range >::iterator it;
 			for ( it = range_list.begin(); it != range_list.end() && !merged; ++it )
-			{
-				range * r = *it;
-				if ( r != NULL )
-					merged = r -> merge( r1 );
-			}
+				merged = it -> merge( r1 );
 			if ( !merged ) add( r1 );
 		}
 		
-		void sort( void ) { range_list.sort( compare_ranges ); }
-		long get_count( void ) { return count; }
+		void sort( void ) { std::sort( range_list.begin(), range_list.end(), compare_ranges ); }
+		long get_count( void ) const { return ( long )range_list.size(); }
 		
 		void compare_sample( const ranges &sample, ranges_relation &res ) const
 		{
@@ -260,15 +247,13 @@ class ranges
 			bool done = false;
 			
 			// we take each range of the sample and compare it against each range of self
-			std::list< range * >::const_iterator sample_it;
+			std::vector< range >::const_iterator sample_it;
 			for ( sample_it = sample.range_list.begin(); sample_it != sample.range_list.end() && !done; ++sample_it )
 			{
-				const range * sample_range = *sample_it;
-				std::list< range * >::const_iterator pattern_it;
+				std::vector< range >::const_iterator pattern_it;
 				for ( pattern_it = range_list.begin(); pattern_it != range_list.end() && !done; ++pattern_it )	
 				{
-					const range * pattern_range( *pattern_it );
-					enum e_range_relation rr = pattern_range -> range_relation( *sample_range );
+					enum e_range_relation rr = pattern_it -> range_relation( *sample_it );
 					switch( rr )
 					{
 						case rr_before 	: break;
@@ -285,12 +270,9 @@ class ranges
 		
 		void print( std::ostream &stream ) const
 		{
-			std::list< range * >::const_iterator it;
+			std::vector< range >::const_iterator it;
 			for ( it = range_list.begin(); it != range_list.end(); ++it )
-			{
-				range * r = *it;
-				if ( r != NULL ) stream << *r << " ";
-			}
+				stream << *it << " ";
 		}		
 
 		friend std::ostream& operator<< ( std::ostream &stream, const ranges &other )
@@ -36,11 +36,15 @@
 #include <string>
 #include <stdexcept>
 #include <vector>
-#include <list>
+#include <map>
 #include <algorithm>
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+
 #include "options.h"
 #include "range.hpp"
+#include "interval_index.hpp"
 
 using namespace seq_ranges;
 
@@ -59,18 +63,18 @@ struct feature_range
 };
 
 
+/* the features live by value in the vector of their reference, the reference-name is there too */
 class feature
 {
 	private :
-		const std::string ref_name;
-		const std::string feature_id;
-		const char strand;		
+		std::string feature_id;
+		char strand;
 		ranges feature_ranges;
 		range outer;
 		long counter;
 
 	public :
-		feature( const feature_range &fr ) : ref_name( fr.ref_name ), feature_id( fr.feature_id ),
+		feature( const feature_range &fr ) : feature_id( fr.feature_id ),
 				strand( fr.strand ), outer( fr.ft_range ), counter( 0 )
 		{
 			feature_ranges.add( fr.ft_range );
@@ -87,7 +91,7 @@ class feature
 			return res;
 		}
 
-		void debug_report ( void )
+		void debug_report ( const std::string &ref_name )
 		{
 			std::cout << "FEATURE: " << feature_id << " ( refname: " << ref_name << " ) strand = '" << strand << "' " << outer << std::endl;
 			std::cout << feature_ranges << std::endl;
@@ -95,7 +99,7 @@ class feature
 			std::cout << std::endl;
 		}
 
-		void report ( int output_mode )
+		void report ( const std::string &ref_name, int output_mode )
 		{
 			if ( counter > 0 )
 			{
@@ -112,15 +116,11 @@ class feature
 		}
 
 		void sort_ranges( void ) { feature_ranges.sort(); }		
-		void get_ref_name( std::string &s ) { s = ref_name; }
-		void get_outer_range( range &r ) { r = outer; }
-
-		/* does this feature end before the given range */
-		bool ends_before( const range &r ) const { return outer.ends_before( r ); }
-		bool is_ref( const std::string &r_name ) { return ( ref_name == r_name ); }
-		long start( void ) { return outer.get_start(); }
+		const range &get_outer_range( void ) const { return outer; }
+		long start( void ) const { return outer.get_start(); }
+		long end( void ) const { return outer.get_end(); }
 		
-		void check( const range &r ) { if ( outer.intersect( r ) ) counter++; }
+		void inc( void ) { counter++; }
 };
 
 
@@ -213,139 +213,95 @@ bool split_line( const std::string &line, const std::string feature_type, const
 }
 
 
-class gtf_iter
+/* the features of one reference in the order of the gtf-file, indexed by their outer range */
+struct ref_features
 {
-	private :
-		const std::string filename;
-		const std::string idattr;
-		const std::string feature_type;
-		feature_range * stored_feature_range;
-		feature * stored_next_feature;
-		std::ifstream inputstream;
-		
-		feature_range * read_next_feature_range( void )
+	std::string ref_name;
+	std::vector< feature > features;
+	interval_index index;
+	long max_end;
+
+	/* set by the thread that counts this reference */
+	bool processed;
+	bool failed;
+	std::string error;
+
+	ref_features( const std::string &ref_name_ )
+		: ref_name( ref_name_ ), max_end( 0 ), processed( false ), failed( false ) {}
+
+	void build_index( void )
+	{
+		std::vector< feature >::iterator it;
+		for ( it = features.begin(); it != features.end(); ++it )
 		{
-			feature_range * res = NULL;
-			if ( inputstream.good() )
-			{
-				std::string line;
-				if ( std::getline( inputstream, line ) )
-				{
-					std::string ref_name, feature_id;
-					long start, end;
-					char strand;
-					if ( split_line( line, feature_type, idattr,
-									  ref_name, feature_id, start, end, strand ) )
-					{
-						res = new feature_range( ref_name, feature_id, start, end, strand );
-					}
-				}
-			}
-			return res;
+			it -> sort_ranges();
+			index.add( it -> start(), it -> end() );
+			if ( it -> end() > max_end ) max_end = it -> end();
 		}
+		index.build();
+	}
+};
 
-		feature_range * next_feature_range( void )
+
+/* reads the whole gtf-file once: consecutive lines with the same feature-id make one feature */
+class gtf_features
+{
+	private :
+		std::vector< ref_features * > refs;		/* in the order of their first appearance */
+		std::map< std::string, size_t > ref_lookup;
+		long feature_count;
+
+		ref_features * get_ref( const std::string &ref_name )
 		{
-			feature_range * res = NULL;
-			if ( stored_feature_range != NULL )
-			{
-				res = stored_feature_range;
-				stored_feature_range = NULL;
-			}
-			else while ( inputstream.good() && res == NULL )
-			{
-				/* because read_next_feature_range can return NULL if the line contains the wrong feature_type */
-				res = read_next_feature_range();
-			}
-			return res;
+			std::map< std::string, size_t >::iterator it = ref_lookup.find( ref_name );
+			if ( it != ref_lookup.end() )
+				return refs[ it -> second ];
+			ref_lookup[ ref_name ] = refs.size();
+			refs.push_back( new ref_features( ref_name ) );
+			return refs.back();
 		}
 
-		feature * read_next_feature( void )
+	public :
+		gtf_features( const char * filename, const std::string &idattr, const std::string &feature_type )
+			: feature_count( 0 )
 		{
-			feature * res = NULL;
-			feature_range * fr = next_feature_range();
-			if ( fr != NULL )
+			std::ifstream inputstream( filename );
+			std::string line;
+			ref_features * current = NULL;
+			while ( std::getline( inputstream, line ) )
 			{
-				res = new feature( *fr );
-				delete fr;
-				bool done = ( res == NULL );
-				while ( !done )
+				std::string ref_name, feature_id;
+				long start, end;
+				char strand;
+				if ( split_line( line, feature_type, idattr,
+								 ref_name, feature_id, start, end, strand ) )
 				{
-					fr = next_feature_range();
-					done = ( fr == NULL );
-					if ( !done )
+					feature_range fr( ref_name, feature_id, start, end, strand );
+					if ( current == NULL || current -> ref_name != ref_name ||
+						 !current -> features.back().add( fr ) )
 					{
-						done = !( res -> add( *fr ) );
-						if ( done )
-							stored_feature_range = fr;
-						else
-							delete fr;
+						current = get_ref( ref_name );
+						current -> features.push_back( feature( fr ) );
+						feature_count++;
 					}
 				}
-				if ( done ) res->sort_ranges();
 			}
-			return res;
-		}
-		
-	public :
-		gtf_iter( const char * filename_, const std::string &idattr_, const std::string &feature_type_  ) :
-			filename( filename_ ), idattr( idattr_ ), feature_type( feature_type_ ),
-			stored_feature_range( NULL ), inputstream( filename_ )
-			{
-				stored_next_feature = read_next_feature();
-			}
-		
-		bool good( void ) { return ( stored_next_feature != NULL ); }
-		
-		feature * next_feature( void )
-		{
-			feature * res = stored_next_feature;
-			if ( res != NULL )
-				stored_next_feature = read_next_feature();
-			return res;
-		}
 
-		feature * forward_to_next_ref( const std::string & ref )
-		{
-			feature * res = NULL;
-			bool done = false;
-			while ( !done )
-			{
-				res = next_feature();
-				done = ( res == NULL );
-				if ( !done )
-				{
-					if ( res -> is_ref( ref ) )
-						delete res;
-					else
-						done = true;
-				}
-			}
-			return res;
-		}
-		
-		long peek_next_feature_start( void )
-		{
-			if ( stored_next_feature != NULL )
-				return stored_next_feature -> start();
-			else
-				return 0;
+			std::vector< ref_features * >::iterator it;
+			for ( it = refs.begin(); it != refs.end(); ++it )
+				( *it ) -> build_index();
 		}
 
-		bool peek_next_feature_range( range &r )
-		{
-			bool res = ( stored_next_feature != NULL );
-			if ( res ) stored_next_feature -> get_outer_range( r );
-			return res;
-		}
-		
-		bool peek_next_feature_is_ref( const std::string &ref_name )
+		~gtf_features( void )
 		{
-			if ( stored_next_feature != NULL )
-				return stored_next_feature -> is_ref( ref_name );
-			else
-				return false;
+			std::vector< ref_features * >::iterator it;
+			for ( it = refs.begin(); it != refs.end(); ++it )
+				delete *it;
 		}
+
+		size_t ref_count( void ) const { return refs.size(); }
+		ref_features * get( size_t idx ) { return refs[ idx ]; }
+		long get_feature_count( void ) const { return feature_count; }
 };
 
 
@@ -371,6 +327,17 @@ class global_counter
 		void inc_too_low_qual( void ) { too_low_qual++; }
 		void inc_not_aligned( void ) { not_aligned++; }
 		void inc_not_unique( void ) { not_unique++; }
+
+		void add( const global_counter &other )
+		{
+			refs += other.refs;
+			total_alignments += other.total_alignments;
+			no_feature += other.no_feature;
+			ambiguous += other.ambiguous;
+			too_low_qual += other.too_low_qual;
+			not_aligned += other.not_aligned;
+			not_unique += other.not_unique;
+		}
 		
 		void report( void )
 		{
@@ -387,176 +354,135 @@ class global_counter
 };
 
 
-class feature_list
+/* the run is opened once up front for the calling thread, every other thread opens it for itself,
+   takes the next reference not yet taken and counts the alignments on it into the features
+   of this reference, no other thread touches them */
+class count_worker
 {
 	private :
-		const std::string &ref_name;
-		int output_mode;
-		std::list< feature * > flist;
-
-		void clear( void )
-		{
-			while ( !flist.empty() )
-			{
-				feature * f = flist.front();
-				flist.pop_front();
-				if ( f != NULL ) delete f;
-			}
-		}
-
-		void add( feature * f )
-		{
-			flist.push_back( f );
-		}
-		
-	public :
-		feature_list( const std::string &ref_name_, int output_mode_, feature * f )
-			: ref_name( ref_name_ ), output_mode( output_mode_ ) { add( f ); }
-		~feature_list( void ) { clear(); }
+		const char * accession;
+		gtf_features &gtf;
+		KLock * lock;
+		size_t &next_ref;
+		global_counter counter;
+		std::vector< size_t > hits;
+		bool open_failed;
+		std::string error;
 
-		bool empty( void ) { return flist.empty(); }
-		
-		void remove_all_features_before( const range &al_range )
+		bool take_ref( size_t &idx )
 		{
-			bool done = flist.empty();
-			while ( !done )
+			bool res = false;
+			if ( KLockAcquire( lock ) == 0 )
 			{
-				feature * f = flist.front();
-				if ( f -> ends_before( al_range ) )
-				{
-					flist.pop_front();
-					f -> report( output_mode );
-					done = flist.empty();
-					delete f;
-				}
-				else
-					done = true;
+				res = ( next_ref < gtf.ref_count() );
+				if ( res ) idx = next_ref++;
+				KLockUnlock( lock );
 			}
+			return res;
 		}
 
-		void load_all_features_starting_inside( const range &al_range, gtf_iter &gtf_it )
+		void count_ref( ngs::ReadCollection &run, ref_features &rf )
 		{
-			bool done = false;
-			while ( !done )
+			try
 			{
-				done = !gtf_it.peek_next_feature_is_ref( ref_name );
-				if ( !done )
+				ngs::Reference ref = run.getReference ( rf.ref_name );
+				try
 				{
-					range r;
-					done = !gtf_it.peek_next_feature_range( r );
-					if ( !done )
+					bool done = false;
+					ngs::AlignmentIterator al_iter = ref.getAlignments( ngs::Alignment::primaryAlignment );
+
+					rf.processed = true;
+					counter.inc_refs();
+					
+					/* now walk all alignments of this al_iter */
+					while ( !done && al_iter.nextAlignment() )
 					{
-						if ( r.ends_before( al_range ) )
-						{
-							/* we can skip this feature! */
-							feature * f = gtf_it.next_feature();
-							delete f;
-						}
-						else if ( r.starts_after( al_range ) )
-						{
-							/* we are done, this feature if for alignments that come later */
-							done = true;
-						}
-						else
+						int64_t  pos = al_iter.getAlignmentPosition() + 1; /* al_iter returns 0-based ! */
+						uint64_t len = al_iter.getAlignmentLength();
+						
+						/* the alignments come sorted by position, no feature is beyond this one */
+						done = ( pos > rf.max_end );
+						if ( !done )
 						{
-							feature * f = gtf_it.next_feature();
-							if ( f != NULL ) add( f );
+							std::vector< size_t >::const_iterator it;
+							hits.clear();
+							rf.index.query( ( long )pos, ( long )( pos + len - 1 ), hits );
+							for ( it = hits.begin(); it != hits.end(); ++it )
+								rf.features[ *it ].inc();
+							counter.inc_total_alignments();
 						}
 					}
 				}
+				catch ( ngs::ErrorMsg e )
+				{
+					rf.failed = true;
+					rf.error = e.what();
+				}
+			}
+			catch ( ngs::ErrorMsg e )
+			{
+				/* the reference is not in the run: nothing to count */
 			}
 		}
-		
-		void count_matches_between_alignment_and_features( const range &al_range )
+
+	public :
+		count_worker( const char * accession_, gtf_features &gtf_, KLock * lock_, size_t &next_ref_ )
+			: accession( accession_ ), gtf( gtf_ ), lock( lock_ ), next_ref( next_ref_ ), open_failed( false ) {}
+
+		void run( ngs::ReadCollection &run )
 		{
-			std::list< feature * >::iterator it;
-			for ( it = flist.begin(); it != flist.end(); ++it )
+			size_t idx;
+			while ( take_ref( idx ) )
+				count_ref( run, *gtf.get( idx ) );
+		}
+
+		void run( void )
+		{
+			try
 			{
-				feature * f = *it;
-				if ( f != NULL )
-				{
-					f -> check( al_range );
-				}
+				ngs::ReadCollection run ( ncbi::NGS::openReadCollection( accession ) );
+				this -> run( run );
+			}
+			catch ( ngs::ErrorMsg e )
+			{
+				open_failed = true;
+				error = e.what();
 			}
 		}
+
+		const global_counter &get_counter( void ) const { return counter; }
+		bool failed( void ) const { return open_failed; }
+		const std::string &get_error( void ) const { return error; }
 };
 
 
-class iter_window
+static rc_t CC count_thread( const KThread * self, void * data )
 {
-	private :
-		ngs::ReadCollection &run;	
-		gtf_iter &gtf_it;
-		int output_mode;
-		global_counter counter;
-		
-	public :
-		iter_window( ngs::ReadCollection &run_, gtf_iter &gtf_it_, int output_mode_ )
-			: run( run_ ), gtf_it( gtf_it_ ), output_mode( output_mode_ ) {}
-
-		void walk( void )
-		{
-			feature * f = gtf_it.next_feature();
-			while ( f != NULL )
-			{
-				/* get the name of the reference of the fist feature in here... */
-				std::string ref_name;
-				f -> get_ref_name( ref_name );
-				try
-				{
-					ngs::Reference ref = run.getReference ( ref_name );
-					try
-					{
-						bool done = false;
-						feature_list flist( ref_name, output_mode, f );
-						ngs::AlignmentIterator al_iter = ref.getAlignments( ngs::Alignment::primaryAlignment );
+	count_worker * w = ( count_worker * )data;
+	w -> run();
+	return 0;
+}
 
-						std::cout << std::endl << "processing ref: " << ref_name << std::endl;
-						std::cout << "-------------------------------------------" << std::endl;
-						counter.inc_refs();
-						
-						/* now walk all alignments of this al_iter */
-						while ( al_iter.nextAlignment() && !done )
-						{
-							int64_t  pos = al_iter.getAlignmentPosition() + 1; /* al_iter returns 0-based ! */
-							uint64_t len = al_iter.getAlignmentLength();
-							
-							const range al_range( pos, pos + len - 1 );
-							
-							/* remove and report all features that end before this alignment */
-							flist.remove_all_features_before( al_range );
-							flist.load_all_features_starting_inside( al_range, gtf_it );
-							
-							/* now we can count matches between the feature-list and this alignment */
-							flist.count_matches_between_alignment_and_features( al_range );
-							
-							/* look if we have to cancel the loop if the feature-list is empty
-							   and we have no more features in this reference */
-							if ( flist.empty() )
-							{
-								done = ( gtf_it.peek_next_feature_start() == 0 );
-								if ( !done )
-									done = !gtf_it.peek_next_feature_is_ref( ref_name );
-							}
-							counter.inc_total_alignments();
-						}
-						f = gtf_it.forward_to_next_ref( ref_name );
-					}
-					catch ( ngs::ErrorMsg e )
-					{
-						std::cout << "error in ref " << ref_name << " : " << e.what() << std::endl;
-						f = NULL;
-					}
-				}
-				catch ( ngs::ErrorMsg e )
-				{
-					f = gtf_it.forward_to_next_ref( ref_name );
-				}
 
-			}
-			counter.report();
+/* the references in the order of the gtf-file, after all of them are counted */
+static void report_refs( gtf_features &gtf, int output_mode )
+{
+	size_t idx;
+	for ( idx = 0; idx < gtf.ref_count(); ++idx )
+	{
+		ref_features * rf = gtf.get( idx );
+		if ( rf -> processed )
+		{
+			std::cout << std::endl << "processing ref: " << rf -> ref_name << std::endl;
+			std::cout << "-------------------------------------------" << std::endl;
+			std::vector< feature >::iterator it;
+			for ( it = rf -> features.begin(); it != rf -> features.end(); ++it )
+				it -> report( rf -> ref_name, output_mode );
+			if ( rf -> failed )
+				std::cout << "error in ref " << rf -> ref_name << " : " << rf -> error << std::endl;
 		}
-};
+	}
+}
 
 
 int matching( const struct sra_seq_count_options * options )
@@ -566,65 +492,91 @@ int matching( const struct sra_seq_count_options * options )
 	std::string id_attr( options->id_attrib );
 	std::string feature_type( options->feature_type );
 
-	/* create the ngs-iterator, which delivers references and alignments */
+	/* a run that cannot be opened fails before any thread is started */
+	ngs::ReadCollection * first_run;
 	try
 	{
-		ngs::ReadCollection run ( ncbi::NGS::openReadCollection( options->sra_accession ) );
-		
-		/* create the gtf-iterator, which delivers gtf-features */		
-		gtf_iter gtf_it( options->gtf_file, id_attr, feature_type );
-		
-		/* create a iterator window that walks both iterators to count alignments for the features */
-		iter_window window( run, gtf_it, options->output_mode );
-		
-		/* walk the window... */
-		window.walk();
+		first_run = new ngs::ReadCollection( ncbi::NGS::openReadCollection( options->sra_accession ) );
 	}
 	catch ( ngs::ErrorMsg e )
 	{
-		std::cout << "cannot open " << options->sra_accession << " because " << e.what() << std::endl;
+		std::cerr << "cannot open " << options->sra_accession << " because " << e.what() << std::endl;
+		return -1;
+	}
+
+	/* read all features of the gtf-file, indexed per reference */
+	gtf_features gtf( options->gtf_file, id_attr, feature_type );
+
+	KLock * lock;
+	if ( KLockMake( &lock ) != 0 )
+	{
+		delete first_run;
+		return -1;
+	}
+
+	size_t next_ref = 0;
+	uint32_t num_threads = options->threads > 0 ? options->threads : 1;
+	if ( num_threads > gtf.ref_count() && gtf.ref_count() > 0 )
+		num_threads = ( uint32_t )gtf.ref_count();
+
+	std::vector< count_worker * > workers;
+	std::vector< KThread * > threads;
+	uint32_t i;
+	for ( i = 0; i < num_threads; ++i )
+		workers.push_back( new count_worker( options->sra_accession, gtf, lock, next_ref ) );
+
+	/* the calling thread is the first worker, on the run opened above */
+	for ( i = 1; i < num_threads; ++i )
+	{
+		KThread * t;
+		if ( KThreadMake( &t, count_thread, workers[ i ] ) == 0 )
+			threads.push_back( t );
 	}
+	workers[ 0 ] -> run( *first_run );
+	for ( i = 0; i < threads.size(); ++i )
+	{
+		rc_t rc_thread;
+		KThreadWait( threads[ i ], &rc_thread );
+		KThreadRelease( threads[ i ] );
+	}
+	KLockRelease( lock );
+	delete first_run;
+
+	/* a thread that could not open the run took no reference, the others counted them all */
+	for ( i = 0; i < workers.size(); ++i )
+	{
+		if ( workers[ i ] -> failed() )
+			std::cerr << "thread #" << i << " cannot open " << options->sra_accession << " because "
+					  << workers[ i ] -> get_error() << std::endl;
+	}
+
+	report_refs( gtf, options->output_mode );
+
+	global_counter counter;
+	for ( i = 0; i < workers.size(); ++i )
+	{
+		counter.add( workers[ i ] -> get_counter() );
+		delete workers[ i ];
+	}
+	counter.report();
 	return res;
 }
 
 
-int list_refs_in_gtf( const char * gtf )
+int list_refs_in_gtf( const char * gtf_file )
 {
 	int res = 0;
-	long feature_count = 0;
-	long feature_ref_count = 0;
-	std::string ref_name;
 	std::string id_attr( "gene_id" );
 	std::string feature_type( "exon" );
 
-	/* create the gtf-iterator, which delivers gtf-features */		
-	gtf_iter gtf_it( gtf, id_attr, feature_type );
-	
-	feature * f = gtf_it.next_feature();
-	while ( f != NULL )
+	gtf_features gtf( gtf_file, id_attr, feature_type );
+	size_t idx;
+	for ( idx = 0; idx < gtf.ref_count(); ++idx )
 	{
-		/* count feature */
-		feature_count ++;
-
-		if ( f -> is_ref( ref_name ) )
-		{
-			feature_ref_count++;
-		}
-		else
-		{
-			if ( feature_ref_count > 0 )
-			{
-				std::cout << ref_name << "\t" << feature_ref_count << std::endl;
-				feature_ref_count = 0;
-			}
-			f -> get_ref_name( ref_name );
-		}
-
-		/* dispose feature */
-		delete f;
-		f = gtf_it.next_feature();	
+		ref_features * rf = gtf.get( idx );
+		std::cout << rf -> ref_name << "\t" << rf -> features.size() << std::endl;
 	}
-	std::cout << feature_count << " features" << std::endl;
+	std::cout << gtf.get_feature_count() << " features" << std::endl;
 	
 	return res;
 }
@@ -631,6 +631,8 @@ ColumnPair *TablePairMakeColumnPair ( TablePair *self, const ctx_t *ctx,
                 col -> is_mapped = writer -> mapped;
                 col -> presorted = reader -> presorted;
                 col -> large = large;
+                col -> self_contained = reader -> vt == & SimpleColumnReader_vt &&
+                                        writer -> vt == & SimpleColumnWriter_vt;
 
                 rc = string_printf ( col -> full_spec, full_spec_size + 1, NULL,
                     "%s.%s", self -> full_spec, colspec );
@@ -756,7 +758,7 @@ void ColumnPairCopy ( ColumnPair *self, const ctx_t *ctx, RowSet *rs )
             while ( ! FAILED () )
             {
                 rc_t rc;
-                size_t i, count;
+                size_t count;
                 int64_t row_ids [ 8 * 1024 ];
 
                 ON_FAIL ( count = RowSetNext ( rs, ctx, row_ids, sizeof row_ids / sizeof row_ids [ 0 ] ) )
@@ -771,16 +773,7 @@ void ColumnPairCopy ( ColumnPair *self, const ctx_t *ctx, RowSet *rs )
                     break;
                 }
 
-                for ( i = 0; ! FAILED () && i < count; ++ i )
-                {
-                    const void *base;
-                    uint32_t elem_bits, boff, row_len;
-                    
-                    TRY ( base = ColumnReaderRead ( self -> reader, ctx, row_ids [ i ], & elem_bits, & boff, & row_len ) )
-                    {
-                        ColumnWriterWrite ( self -> writer, ctx, elem_bits, base, boff, row_len );
-                    }
-                }
+                ColumnPairCopyRows ( self, ctx, row_ids, count );
             }
 
             ColumnPairPostCopy ( self, ctx );
@@ -789,6 +782,27 @@ void ColumnPairCopy ( ColumnPair *self, const ctx_t *ctx, RowSet *rs )
 }
 
 
+/* CopyRows
+ *  copy a set of rows from source to destination column
+ */
+void ColumnPairCopyRows ( ColumnPair *self, const ctx_t *ctx, const int64_t *row_ids, size_t count )
+{
+    FUNC_ENTRY ( ctx );
+
+    size_t i;
+    for ( i = 0; ! FAILED () && i < count; ++ i )
+    {
+        const void *base;
+        uint32_t elem_bits, boff, row_len;
+
+        TRY ( base = ColumnReaderRead ( self -> reader, ctx, row_ids [ i ], & elem_bits, & boff, & row_len ) )
+        {
+            ColumnWriterWrite ( self -> writer, ctx, elem_bits, base, boff, row_len );
+        }
+    }
+}
+
+
 /* CopyStatic
  *  copy static column from source to destination
  */
@@ -275,6 +275,10 @@ struct ColumnPair
 
     bool large;
 
+    /* reader and writer keep to their own cursors,
+       sharing no state with other columns */
+    bool self_contained;
+
     char full_spec [ 1 ];
 };
 
@@ -314,6 +318,13 @@ void ColumnPairPostCopy ( const ColumnPair *self, const ctx_t *ctx );
 void ColumnPairCopy ( ColumnPair *self, const ctx_t *ctx, struct RowSet *rs );
 
 
+/* CopyRows
+ *  copy a set of rows from source to destination column
+ *  does not bracket the copy with PreCopy and PostCopy
+ */
+void ColumnPairCopyRows ( ColumnPair *self, const ctx_t *ctx, const int64_t *row_ids, size_t count );
+
+
 /* CopyStatic
  *  copy static column from source to destination
  */
@@ -26,9 +26,17 @@
 
 #include "idx-mapping.h"
 #include "ctx.h"
+#include "caps.h"
+#include "except.h"
+#include "status.h"
+#include "mem.h"
+#include "sra-sort.h"
 
+#include <kproc/thread.h>
 #include <klib/sort.h>
 
+#include <string.h>
+
 FILE_ENTRY ( idx-mapping );
 
 
@@ -66,7 +74,7 @@ int CC IdxMappingCmpNew ( const void *a, const void *b, void *data )
 #define SWAP( a, b, off, size ) KSORT_TSWAP ( IdxMapping, a, b )
 
 
-void IdxMappingSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
+void IdxMappingKSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
 {
 #define CMP( a, b ) \
     ( ( T ( a ) -> old_id < T ( b ) -> old_id ) ? -1 : ( T ( a ) -> old_id > T ( b ) -> old_id ) )
@@ -76,7 +84,7 @@ void IdxMappingSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
 #undef CMP
 }
 
-void IdxMappingSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
+void IdxMappingKSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
 {
 #define CMP( a, b ) \
     ( ( T ( a ) -> new_id < T ( b ) -> new_id ) ? -1 : ( T ( a ) -> new_id > T ( b ) -> new_id ) )
@@ -89,4 +97,270 @@ void IdxMappingSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
 #undef T
 #undef SWAP
 
+
+/* RadixSort
+ *  LSD radix sort on 8-bit digits of ( id - min_id )
+ *
+ *  the array is cut into one slice per thread. every pass
+ *  histograms each slice, turns the histograms into scatter
+ *  positions ordered by digit and then by slice, and scatters
+ *  each slice into a scratch array, which keeps the sort stable.
+ *  only the digits that vary between min_id and max_id are
+ *  visited, and a pass in which all ids share a digit is skipped,
+ *  so dense row-ids take few passes.
+ */
+#define RADIX_BITS 8
+#define RADIX_BUCKETS ( 1 << RADIX_BITS )
+#define RADIX_MAX_THREADS 16
+
+/* sorts shorter than this are left to ksort */
+#define RADIX_MIN_COUNT ( 64 * 1024 )
+
+/* elements per thread below which threads don't pay off */
+#define RADIX_MIN_SLICE ( 256 * 1024 )
+
+enum { radixMinMax, radixCount, radixScatter };
+
+typedef struct IdxMappingRadixSlice IdxMappingRadixSlice;
+struct IdxMappingRadixSlice
+{
+    const IdxMapping *src;
+    IdxMapping *dst;
+    size_t start, end;
+
+    /* id selected by byte offset within IdxMapping */
+    size_t key_off;
+
+    int64_t min_id, max_id;
+    uint32_t shift;
+    uint32_t phase;
+
+    /* histogram, then scatter positions */
+    size_t pos [ RADIX_BUCKETS ];
+};
+
+#define RADIX_KEY( rec, off ) \
+    ( * ( const int64_t* ) ( ( const char* ) ( rec ) + ( off ) ) )
+
+#define RADIX_DIGIT( rec, s ) \
+    ( ( size_t ) ( ( ( uint64_t ) RADIX_KEY ( rec, s -> key_off ) - ( uint64_t ) s -> min_id ) >> s -> shift ) & ( RADIX_BUCKETS - 1 ) )
+
+static
+rc_t CC IdxMappingRadixRun ( const KThread *t, void *data )
+{
+    size_t i;
+    IdxMappingRadixSlice *s = data;
+    const IdxMapping *src = s -> src;
+
+    switch ( s -> phase )
+    {
+    case radixMinMax:
+        if ( s -> start < s -> end )
+        {
+            int64_t min_id, max_id;
+            min_id = max_id = RADIX_KEY ( & src [ s -> start ], s -> key_off );
+            for ( i = s -> start + 1; i < s -> end; ++ i )
+            {
+                int64_t id = RADIX_KEY ( & src [ i ], s -> key_off );
+                if ( id < min_id )
+                    min_id = id;
+                else if ( id > max_id )
+                    max_id = id;
+            }
+            s -> min_id = min_id;
+            s -> max_id = max_id;
+        }
+        break;
+
+    case radixCount:
+        memset ( s -> pos, 0, sizeof s -> pos );
+        for ( i = s -> start; i < s -> end; ++ i )
+            ++ s -> pos [ RADIX_DIGIT ( & src [ i ], s ) ];
+        break;
+
+    case radixScatter:
+        for ( i = s -> start; i < s -> end; ++ i )
+            s -> dst [ s -> pos [ RADIX_DIGIT ( & src [ i ], s ) ] ++ ] = src [ i ];
+        break;
+    }
+
+    return 0;
+}
+
+static
+void IdxMappingRadixPhase ( IdxMappingRadixSlice *slices, uint32_t num_slices, uint32_t phase )
+{
+    uint32_t i;
+    KThread *t [ RADIX_MAX_THREADS ];
+
+    for ( i = 0; i < num_slices; ++ i )
+        slices [ i ] . phase = phase;
+
+    /* the calling thread takes the first slice */
+    for ( i = 1; i < num_slices; ++ i )
+    {
+        if ( KThreadMake ( & t [ i ], IdxMappingRadixRun, & slices [ i ] ) != 0 )
+        {
+            t [ i ] = NULL;
+            IdxMappingRadixRun ( NULL, & slices [ i ] );
+        }
+    }
+
+    IdxMappingRadixRun ( NULL, & slices [ 0 ] );
+
+    for ( i = 1; i < num_slices; ++ i )
+    {
+        if ( t [ i ] != NULL )
+        {
+            KThreadWait ( t [ i ], NULL );
+            KThreadRelease ( t [ i ] );
+        }
+    }
+}
+
+static
+bool IdxMappingRadixSort ( IdxMapping *self, const ctx_t *ctx, size_t count, size_t key_off )
+{
+    FUNC_ENTRY ( ctx );
+
+    IdxMapping *scratch;
+    IdxMapping *src, *dst;
+    int64_t min_id, max_id;
+    uint64_t span;
+    uint32_t i, num_slices, shift;
+    IdxMappingRadixSlice slices [ RADIX_MAX_THREADS ];
+
+    const Tool *tp = ctx -> caps -> tool;
+
+    if ( count < 2 )
+        return true;
+
+    /* the scratch array is subject to the MemBank quota */
+    ON_FAIL ( scratch = MemAlloc ( ctx, sizeof * self * count, false ) )
+    {
+        CLEAR ();
+        return false;
+    }
+
+    num_slices = ( tp == NULL || tp -> sort_threads == 0 ) ? 1 : tp -> sort_threads;
+    if ( num_slices > RADIX_MAX_THREADS )
+        num_slices = RADIX_MAX_THREADS;
+    if ( ( size_t ) num_slices > count / RADIX_MIN_SLICE )
+        num_slices = ( uint32_t ) ( count / RADIX_MIN_SLICE );
+    if ( num_slices == 0 )
+        num_slices = 1;
+
+    for ( i = 0; i < num_slices; ++ i )
+    {
+        slices [ i ] . start = count * i / num_slices;
+        slices [ i ] . end = count * ( i + 1 ) / num_slices;
+        slices [ i ] . key_off = key_off;
+        slices [ i ] . src = self;
+    }
+
+    STATUS ( 4, "radix sorting %,zu ( old_id, new_id ) pairs on %u threads", count, num_slices );
+
+    IdxMappingRadixPhase ( slices, num_slices, radixMinMax );
+    min_id = slices [ 0 ] . min_id;
+    max_id = slices [ 0 ] . max_id;
+    for ( i = 1; i < num_slices; ++ i )
+    {
+        if ( slices [ i ] . min_id < min_id )
+            min_id = slices [ i ] . min_id;
+        if ( slices [ i ] . max_id > max_id )
+            max_id = slices [ i ] . max_id;
+    }
+    span = ( uint64_t ) max_id - ( uint64_t ) min_id;
+
+    src = self;
+    dst = scratch;
+    for ( shift = 0; shift < 64 && ( span >> shift ) != 0; shift += RADIX_BITS )
+    {
+        size_t b, pos;
+
+        for ( i = 0; i < num_slices; ++ i )
+        {
+            slices [ i ] . src = src;
+            slices [ i ] . dst = dst;
+            slices [ i ] . min_id = min_id;
+            slices [ i ] . shift = shift;
+        }
+
+        IdxMappingRadixPhase ( slices, num_slices, radixCount );
+
+        /* turn the counts into positions,
+           detecting a digit that all ids share */
+        for ( pos = 0, b = 0; b < RADIX_BUCKETS; ++ b )
+        {
+            size_t start = pos;
+            for ( i = 0; i < num_slices; ++ i )
+            {
+                size_t n = slices [ i ] . pos [ b ];
+                slices [ i ] . pos [ b ] = pos;
+                pos += n;
+            }
+            if ( pos - start == count )
+                break;
+        }
+        if ( b < RADIX_BUCKETS )
+            continue;
+
+        IdxMappingRadixPhase ( slices, num_slices, radixScatter );
+
+        src = dst;
+        dst = ( src == self ) ? scratch : self;
+    }
+
+    if ( src != self )
+        memcpy ( self, src, sizeof * self * count );
+
+    MemFree ( ctx, scratch, sizeof * self * count );
+    return true;
+}
+
+#undef RADIX_DIGIT
+#undef RADIX_KEY
+
+
+/* SortOld
+ * SortNew
+ *  radix sort when there is room for it, ksort otherwise
+ */
+void IdxMappingSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
+{
+    FUNC_ENTRY ( ctx );
+
+    if ( count < RADIX_MIN_COUNT ||
+         ! IdxMappingRadixSort ( self, ctx, count, offsetof ( IdxMapping, old_id ) ) )
+    {
+        IdxMappingKSortOld ( self, ctx, count );
+    }
+}
+
+void IdxMappingSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
+{
+    FUNC_ENTRY ( ctx );
+
+    if ( count < RADIX_MIN_COUNT ||
+         ! IdxMappingRadixSort ( self, ctx, count, offsetof ( IdxMapping, new_id ) ) )
+    {
+        IdxMappingKSortNew ( self, ctx, count );
+    }
+}
+
+/* RadixSortOld
+ * RadixSortNew
+ */
+bool IdxMappingRadixSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
+{
+    FUNC_ENTRY ( ctx );
+    return IdxMappingRadixSort ( self, ctx, count, offsetof ( IdxMapping, old_id ) );
+}
+
+bool IdxMappingRadixSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
+{
+    FUNC_ENTRY ( ctx );
+    return IdxMappingRadixSort ( self, ctx, count, offsetof ( IdxMapping, new_id ) );
+}
+
 #endif /* USE_OLD_KSORT */
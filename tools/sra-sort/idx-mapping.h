@@ -50,10 +50,27 @@ int CC IdxMappingCmpNew ( const void *a, const void *b, void *data );
 
 #else
 
-/* ksort_inlines */
+/* SortOld
+ * SortNew
+ *  sort on old or new id
+ *  uses a parallel radix sort when the MemBank has room
+ *  for its scratch array, and ksort otherwise
+ */
 void IdxMappingSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count );
 void IdxMappingSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count );
 
+/* ksort_inlines */
+void IdxMappingKSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count );
+void IdxMappingKSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count );
+
+/* RadixSortOld
+ * RadixSortNew
+ *  returns false without sorting
+ *  if the scratch array cannot be allocated
+ */
+bool IdxMappingRadixSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count );
+bool IdxMappingRadixSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count );
+
 #endif
 
 #endif /* _h_sra_sort_idx_mapping_ */
@@ -0,0 +1,251 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+
+#include "idx-mapping.h"
+#include "ctx.h"
+#include "caps.h"
+#include "except.h"
+#include "mem.h"
+#include "sra-sort.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+FILE_ENTRY ( idx-sort-bench );
+
+
+/*--------------------------------------------------------------------------
+ * idx-sort-bench
+ *  times ksort against the radix sort of IdxMapping
+ *  over a few synthetic old-id distributions
+ */
+
+enum
+{
+    distShuffled,       /* a permutation of 1 .. count */
+    distDense,          /* random ids within 1 .. count, with repeats */
+    distSparse,         /* random 63-bit ids */
+    distNearlySorted,   /* 1 .. count with 1% of the ids swapped */
+    distCount
+};
+
+static const char *dist_names [ distCount ] =
+{
+    "shuffled",
+    "dense",
+    "sparse",
+    "nearly-sorted"
+};
+
+static
+uint64_t next_rand ( uint64_t *state )
+{
+    /* xorshift64* */
+    uint64_t x = * state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    * state = x;
+    return x * 2685821657736338717ULL;
+}
+
+static
+void fill_ids ( IdxMapping *ids, size_t count, int dist, uint64_t *state )
+{
+    size_t i, j;
+    IdxMapping tmp;
+
+    for ( i = 0; i < count; ++ i )
+    {
+        ids [ i ] . new_id = ( int64_t ) i + 1;
+        switch ( dist )
+        {
+        case distDense:
+            ids [ i ] . old_id = ( int64_t ) ( next_rand ( state ) % count ) + 1;
+            break;
+        case distSparse:
+            ids [ i ] . old_id = ( int64_t ) ( next_rand ( state ) >> 1 );
+            break;
+        default:
+            ids [ i ] . old_id = ( int64_t ) i + 1;
+        }
+    }
+
+    if ( dist == distShuffled )
+    {
+        for ( i = count; i > 1; -- i )
+        {
+            j = ( size_t ) ( next_rand ( state ) % i );
+            tmp = ids [ i - 1 ];
+            ids [ i - 1 ] = ids [ j ];
+            ids [ j ] = tmp;
+        }
+    }
+    else if ( dist == distNearlySorted )
+    {
+        for ( i = 0; i < count / 100; ++ i )
+        {
+            size_t a = ( size_t ) ( next_rand ( state ) % count );
+            size_t b = ( size_t ) ( next_rand ( state ) % count );
+            tmp = ids [ a ];
+            ids [ a ] = ids [ b ];
+            ids [ b ] = tmp;
+        }
+    }
+}
+
+static
+double elapsed_ms ( const struct timespec *start )
+{
+    struct timespec end;
+    clock_gettime ( CLOCK_MONOTONIC, & end );
+    return ( end . tv_sec - start -> tv_sec ) * 1000.0 +
+        ( end . tv_nsec - start -> tv_nsec ) / 1000000.0;
+}
+
+static
+bool same_order ( const IdxMapping *a, const IdxMapping *b, size_t count )
+{
+    size_t i;
+    for ( i = 0; i < count; ++ i )
+    {
+        if ( a [ i ] . old_id != b [ i ] . old_id )
+            return false;
+        if ( i != 0 && a [ i - 1 ] . old_id > a [ i ] . old_id )
+            return false;
+    }
+    return true;
+}
+
+/* returns the number of distributions the radix sort got wrong */
+static
+uint32_t run_bench ( const ctx_t *ctx, size_t count )
+{
+    FUNC_ENTRY ( ctx );
+
+    uint32_t mismatches = 0;
+    IdxMapping *orig, *by_ksort, *by_radix;
+    size_t bytes = sizeof orig [ 0 ] * count;
+
+    TRY ( orig = MemAlloc ( ctx, bytes, false ) )
+    {
+        TRY ( by_ksort = MemAlloc ( ctx, bytes, false ) )
+        {
+            TRY ( by_radix = MemAlloc ( ctx, bytes, false ) )
+            {
+                int dist;
+                uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+                printf ( "%zu ( old_id, new_id ) pairs, %u sort threads\n",
+                         count, ctx -> caps -> tool -> sort_threads );
+
+                for ( dist = 0; ! FAILED () && dist < distCount; ++ dist )
+                {
+                    bool radix;
+                    struct timespec start;
+                    double ksort_ms, radix_ms;
+
+                    fill_ids ( orig, count, dist, & state );
+
+                    memcpy ( by_ksort, orig, bytes );
+                    clock_gettime ( CLOCK_MONOTONIC, & start );
+                    IdxMappingKSortOld ( by_ksort, ctx, count );
+                    ksort_ms = elapsed_ms ( & start );
+
+                    memcpy ( by_radix, orig, bytes );
+                    clock_gettime ( CLOCK_MONOTONIC, & start );
+                    ON_FAIL ( radix = IdxMappingRadixSortOld ( by_radix, ctx, count ) )
+                        break;
+                    radix_ms = elapsed_ms ( & start );
+
+                    if ( ! radix )
+                        printf ( "  %-14s ksort %9.1f ms  radix: no room for scratch array\n",
+                                 dist_names [ dist ], ksort_ms );
+                    else
+                    {
+                        bool same = same_order ( by_radix, by_ksort, count );
+                        if ( ! same )
+                            ++ mismatches;
+                        printf ( "  %-14s ksort %9.1f ms  radix %9.1f ms  %5.1fx%s\n",
+                                 dist_names [ dist ], ksort_ms, radix_ms,
+                                 radix_ms > 0 ? ksort_ms / radix_ms : 0.0,
+                                 same ? "" : "  MISMATCH" );
+                    }
+                }
+
+                MemFree ( ctx, by_radix, bytes );
+            }
+
+            MemFree ( ctx, by_ksort, bytes );
+        }
+
+        MemFree ( ctx, orig, bytes );
+    }
+
+    return mismatches;
+}
+
+int main ( int argc, char *argv [] )
+{
+    DECLARE_CTX_INFO ();
+
+    Caps caps;
+    Tool tp;
+    uint32_t mismatches = 0;
+    size_t count = 16 * 1024 * 1024;
+    ctx_t main_ctx = { & caps, NULL, & ctx_info };
+    const ctx_t *ctx = & main_ctx;
+
+    memset ( & caps, 0, sizeof caps );
+    memset ( & tp, 0, sizeof tp );
+    tp . sort_threads = 4;
+    caps . tool = & tp;
+
+    if ( argc > 3 || ( argc > 1 && strcmp ( argv [ 1 ], "-h" ) == 0 ) )
+    {
+        printf ( "Usage: %s [ num-ids [ sort-threads ] ]\n", argv [ 0 ] );
+        return 1;
+    }
+
+    if ( argc > 1 )
+        count = ( size_t ) strtoull ( argv [ 1 ], NULL, 0 );
+    if ( argc > 2 )
+        tp . sort_threads = ( uint32_t ) strtoul ( argv [ 2 ], NULL, 0 );
+
+    /* unlimited quota */
+    TRY ( caps . mem = MemBankMake ( ctx, -1 ) )
+    {
+        mismatches = run_bench ( ctx, count );
+        MemBankRelease ( caps . mem, ctx );
+    }
+
+    if ( FAILED () )
+        return 2;
+    /* a sort regression must not pass as a benchmark */
+    return mismatches != 0 ? 3 : 0;
+}
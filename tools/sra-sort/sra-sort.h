@@ -95,6 +95,12 @@ struct Tool
     /* the number of missing SEQUENCE ids to gather at a time */
     size_t max_missing_ids;
 
+    /* the number of threads copying columns of a row-set */
+    uint32_t column_threads;
+
+    /* the number of threads sorting id maps */
+    uint32_t sort_threads;
+
     /* pid of tool */
     int pid;
 
@@ -47,6 +47,8 @@ typedef struct TablePair StdTblPair;
 #include <klib/text.h>
 #include <klib/namelist.h>
 #include <klib/rc.h>
+#include <kproc/thread.h>
+#include <atomic32.h>
 
 #include <string.h>
 
@@ -215,6 +217,268 @@ void CC TablePairReleaseColumnPair ( void *item, void *data )
 }
 
 
+/* ColumnCopyJob
+ *  copies the self-contained columns of a RowSet on several threads
+ *
+ *  row-ids are gathered from the RowSet a chunk at a time
+ *  into a buffer that the threads only read, and each thread
+ *  claims the next column not yet copied. every column keeps
+ *  its own cursors, so the threads share nothing else.
+ */
+#define COPY_JOB_MAX_CHUNK_IDS ( 4 * 1024 * 1024 )
+#define COPY_JOB_MIN_CHUNK_IDS ( 64 * 1024 )
+
+typedef struct ColumnCopyJob ColumnCopyJob;
+struct ColumnCopyJob
+{
+    ColumnPair **cols;
+    uint32_t num_cols;
+
+    /* the next column to claim */
+    atomic32_t next_col;
+
+    const int64_t *row_ids;
+    size_t num_ids;
+};
+
+typedef struct ColumnCopyThread ColumnCopyThread;
+struct ColumnCopyThread
+{
+    Caps caps;
+    ColumnCopyJob *job;
+    KThread *t;
+};
+
+static
+rc_t CC ColumnCopyThreadRun ( const KThread *self, void *data )
+{
+    ColumnCopyThread *pb = data;
+    ColumnCopyJob *job = pb -> job;
+
+    DECLARE_CTX_INFO ();
+    ctx_t thread_ctx = { & pb -> caps, NULL, & ctx_info };
+    const ctx_t *ctx = & thread_ctx;
+
+    while ( ! FAILED () )
+    {
+        uint32_t i = atomic32_read_and_add ( & job -> next_col, 1 );
+        if ( i >= job -> num_cols )
+            break;
+
+        ColumnPairCopyRows ( job -> cols [ i ], ctx, job -> row_ids, job -> num_ids );
+    }
+
+    return ctx -> rc;
+}
+
+static
+void ColumnCopyJobRun ( ColumnCopyJob *self, const ctx_t *ctx,
+    ColumnCopyThread *threads, uint32_t num_threads )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    uint32_t i, started;
+
+    atomic32_set ( & self -> next_col, 0 );
+
+    for ( started = 0; started < num_threads; ++ started )
+    {
+        rc = KThreadMake ( & threads [ started ] . t, ColumnCopyThreadRun, & threads [ started ] );
+        if ( rc != 0 )
+            break;
+    }
+
+    /* whatever could not be handed out is copied here */
+    while ( ! FAILED () )
+    {
+        i = atomic32_read_and_add ( & self -> next_col, 1 );
+        if ( i >= self -> num_cols )
+            break;
+
+        ColumnPairCopyRows ( self -> cols [ i ], ctx, self -> row_ids, self -> num_ids );
+    }
+
+    /* keep columns from being claimed after a failure */
+    atomic32_set ( & self -> next_col, self -> num_cols );
+
+    for ( i = 0; i < started; ++ i )
+    {
+        rc_t status;
+        rc = KThreadWait ( threads [ i ] . t, & status );
+        if ( rc == 0 )
+            rc = status;
+        if ( rc != 0 && ! FAILED () )
+            ERROR ( rc, "failed to copy columns on background thread" );
+        KThreadRelease ( threads [ i ] . t );
+    }
+}
+
+static
+void TablePairCopyColumnsParallel ( TablePair *self, const ctx_t *ctx,
+    ColumnPair **cols, uint32_t num_cols, RowSet *rs )
+{
+    FUNC_ENTRY ( ctx );
+
+    int64_t *row_ids;
+    size_t max_ids = COPY_JOB_MAX_CHUNK_IDS;
+    uint32_t i, num_threads = ctx -> caps -> tool -> column_threads;
+
+    /* the calling thread copies too */
+    if ( num_threads > num_cols )
+        num_threads = num_cols;
+    -- num_threads;
+
+    /* try to allocate the id buffer
+       this may be limited by the MemBank
+
+       only this buffer is counted: the blob and page caches of
+       the cursors of columns copied at the same time are not
+       allocated from the MemBank and are not limited by it */
+    do
+    {
+        CLEAR ();
+        TRY ( row_ids = MemAlloc ( ctx, sizeof row_ids [ 0 ] * max_ids, false ) )
+        {
+            break;
+        }
+        max_ids >>= 1;
+    }
+    while ( max_ids >= COPY_JOB_MIN_CHUNK_IDS );
+
+    if ( FAILED () )
+    {
+        /* fall back to copying one column after another */
+        CLEAR ();
+        for ( i = 0; i < num_cols; ++ i )
+        {
+            ON_FAIL ( ColumnPairCopy ( cols [ i ], ctx, rs ) )
+                break;
+        }
+        return;
+    }
+
+    STATUS ( 3, "copying %u columns on %u threads", num_cols, num_threads + 1 );
+
+    TRY ( RowSetReset ( rs, ctx, false ) )
+    {
+        ColumnCopyThread *threads;
+        TRY ( threads = MemAlloc ( ctx, sizeof threads [ 0 ] * num_threads, true ) )
+        {
+            uint32_t caps_made;
+            for ( caps_made = 0; caps_made < num_threads; ++ caps_made )
+            {
+                ON_FAIL ( CapsInit ( & threads [ caps_made ] . caps, ctx ) )
+                    break;
+            }
+
+            for ( i = 0; ! FAILED () && i < num_cols; ++ i )
+                ColumnPairPreCopy ( cols [ i ], ctx );
+
+            if ( ! FAILED () )
+            {
+                ColumnCopyJob job;
+                job . cols = cols;
+                job . num_cols = num_cols;
+                job . row_ids = row_ids;
+
+                for ( i = 0; i < caps_made; ++ i )
+                    threads [ i ] . job = & job;
+
+                while ( ! FAILED () )
+                {
+                    rc_t rc;
+
+                    ON_FAIL ( job . num_ids = RowSetNext ( rs, ctx, row_ids, max_ids ) )
+                        break;
+                    if ( job . num_ids == 0 )
+                        break;
+
+                    rc = Quitting ();
+                    if ( rc != 0 )
+                    {
+                        INFO_ERROR ( rc, "quitting" );
+                        break;
+                    }
+
+                    ColumnCopyJobRun ( & job, ctx, threads, caps_made );
+                }
+
+                for ( i = 0; i < num_cols; ++ i )
+                    ColumnPairPostCopy ( cols [ i ], ctx );
+            }
+
+            for ( i = 0; i < caps_made; ++ i )
+                CapsWhack ( & threads [ i ] . caps, ctx );
+
+            MemFree ( ctx, threads, sizeof threads [ 0 ] * num_threads );
+        }
+    }
+
+    MemFree ( ctx, row_ids, sizeof row_ids [ 0 ] * max_ids );
+}
+
+/* CopyRowSet
+ *  copies a RowSet into every column of a vector
+ *
+ *  columns whose reader and writer are self-contained are copied
+ *  in parallel when more than one thread is allowed. the others
+ *  reach into the table's RowSetIterator, which is reset by every
+ *  column, and are copied one after another.
+ */
+static
+void TablePairCopyRowSet ( TablePair *self, const ctx_t *ctx, Vector *cols, RowSet *rs )
+{
+    FUNC_ENTRY ( ctx );
+
+    uint32_t i, num_parallel;
+    ColumnPair **parallel = NULL;
+    uint32_t count = VectorLength ( cols );
+
+    if ( ctx -> caps -> tool -> column_threads > 1 && count > 1 )
+    {
+        ON_FAIL ( parallel = MemAlloc ( ctx, sizeof parallel [ 0 ] * count, false ) )
+        {
+            /* copy serially without the list */
+            CLEAR ();
+            parallel = NULL;
+        }
+        else
+        {
+            for ( num_parallel = i = 0; i < count; ++ i )
+            {
+                ColumnPair *col = VectorGet ( cols, i );
+                assert ( col != NULL );
+                if ( col -> self_contained )
+                    parallel [ num_parallel ++ ] = col;
+            }
+
+            if ( num_parallel > 1 )
+                TablePairCopyColumnsParallel ( self, ctx, parallel, num_parallel, rs );
+            else
+            {
+                MemFree ( ctx, parallel, sizeof parallel [ 0 ] * count );
+                parallel = NULL;
+            }
+        }
+    }
+
+    for ( i = 0; ! FAILED () && i < count; ++ i )
+    {
+        ColumnPair *col = VectorGet ( cols, i );
+        assert ( col != NULL );
+        if ( parallel == NULL || ! col -> self_contained )
+        {
+            ON_FAIL ( ColumnPairCopy ( col, ctx, rs ) )
+                break;
+        }
+    }
+
+    if ( parallel != NULL )
+        MemFree ( ctx, parallel, sizeof parallel [ 0 ] * count );
+}
+
+
 /* Copy
  *  the table has to obtain a RowSetIterator
  *  which it walks vertically
@@ -356,21 +620,13 @@ void TablePairCopyMappedColumns ( TablePair *self, const ctx_t *ctx )
 
             while ( ! FAILED () )
             {
-                uint32_t i;
-
                 RowSet *rs;
                 ON_FAIL ( rs = RowSetIteratorNext ( rsi, ctx ) )
                     break;
                 if ( rs == NULL )
                     break;
 
-                for ( i = 0; i < count; ++ i )
-                {
-                    ColumnPair *col = VectorGet ( & self -> mapped_cols, i );
-                    assert ( col != NULL );
-                    ON_FAIL ( ColumnPairCopy ( col, ctx, rs ) )
-                        break;
-                }
+                TablePairCopyRowSet ( self, ctx, & self -> mapped_cols, rs );
 
                 RowSetRelease ( rs, ctx );
             }
@@ -409,21 +665,13 @@ void TablePairCopyLargeColumns ( TablePair *self, const ctx_t *ctx )
 
             while ( ! FAILED () )
             {
-                uint32_t i;
-
                 RowSet *rs;
                 ON_FAIL ( rs = RowSetIteratorNext ( rsi, ctx ) )
                     break;
                 if ( rs == NULL )
                     break;
 
-                for ( i = 0; i < count; ++ i )
-                {
-                    ColumnPair *col = VectorGet ( & self -> large_cols, i );
-                    assert ( col != NULL );
-                    ON_FAIL ( ColumnPairCopy ( col, ctx, rs ) )
-                        break;
-                }
+                TablePairCopyRowSet ( self, ctx, & self -> large_cols, rs );
 
                 RowSetRelease ( rs, ctx );
             }
@@ -462,21 +710,13 @@ void TablePairCopyLargeMappedColumns ( TablePair *self, const ctx_t *ctx )
 
             while ( ! FAILED () )
             {
-                uint32_t i;
-
                 RowSet *rs;
                 ON_FAIL ( rs = RowSetIteratorNext ( rsi, ctx ) )
                     break;
                 if ( rs == NULL )
                     break;
 
-                for ( i = 0; i < count; ++ i )
-                {
-                    ColumnPair *col = VectorGet ( & self -> large_mapped_cols, i );
-                    assert ( col != NULL );
-                    ON_FAIL ( ColumnPairCopy ( col, ctx, rs ) )
-                        break;
-                }
+                TablePairCopyRowSet ( self, ctx, & self -> large_mapped_cols, rs );
 
                 RowSetRelease ( rs, ctx );
             }
@@ -515,21 +755,13 @@ void TablePairCopyNormalColumns ( TablePair *self, const ctx_t *ctx )
 
             while ( ! FAILED () )
             {
-                uint32_t i;
-
                 RowSet *rs;
                 ON_FAIL ( rs = RowSetIteratorNext ( rsi, ctx ) )
                     break;
                 if ( rs == NULL )
                     break;
 
-                for ( i = 0; i < count; ++ i )
-                {
-                    ColumnPair *col = VectorGet ( & self -> normal_cols, i );
-                    assert ( col != NULL );
-                    ON_FAIL ( ColumnPairCopy ( col, ctx, rs ) )
-                        break;
-                }
+                TablePairCopyRowSet ( self, ctx, & self -> normal_cols, rs );
 
                 RowSetRelease ( rs, ctx );
             }
@@ -0,0 +1,227 @@
+/*==============================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*  Base composition counters.
+*  Vector kernels count codes 0..3 with byte-wide compares into byte
+*  accumulators, which are folded into 64-bit totals every 255 vectors;
+*  code 4 is whatever is left. A vector block holding a code above 4 is
+*  recounted by the scalar loop which finds the offending base.
+*/
+
+#include "base-count.h"
+
+#include <assert.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE_COUNT_X86 1
+#include <immintrin.h>
+#endif
+
+/* the longest run of vectors byte accumulators can count without overflow */
+#define MAX_VECTORS 255
+
+typedef size_t (CC *BaseCountFn)(uint64_t *cnt, const uint8_t *bases,
+    size_t size);
+
+static size_t CC BaseCountScalar(uint64_t cnt[5],
+    const uint8_t *bases, size_t size)
+{
+    size_t i = 0;
+
+    for (i = 0; i < size; ++i) {
+        uint8_t base = bases[i];
+        if (base > 4) {
+            break;
+        }
+        ++cnt[base];
+    }
+
+    return i;
+}
+
+#ifdef BASE_COUNT_X86
+
+__attribute__((target("sse2")))
+static uint64_t SumSSE2(__m128i a) {
+    __m128i s = _mm_sad_epu8(a, _mm_setzero_si128());
+    return (uint64_t)_mm_cvtsi128_si32(s)
+         + (uint64_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(s, s));
+}
+
+__attribute__((target("sse2")))
+static size_t CC BaseCountSSE2(uint64_t cnt[5],
+    const uint8_t *bases, size_t size)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi8(2);
+    const __m128i three = _mm_set1_epi8(3);
+    const __m128i four = _mm_set1_epi8(4);
+
+    size_t i = 0;
+
+    while (size - i >= sizeof(__m128i)) {
+        __m128i a0 = zero, a1 = zero, a2 = zero, a3 = zero, bad = zero;
+        size_t n = (size - i) / sizeof(__m128i);
+        size_t k = 0;
+        uint64_t c0, c1, c2, c3;
+
+        if (n > MAX_VECTORS) {
+            n = MAX_VECTORS;
+        }
+
+        for (k = 0; k < n; ++k) {
+            __m128i x = _mm_loadu_si128
+                ((const __m128i*)(bases + i + k * sizeof(__m128i)));
+            bad = _mm_or_si128(bad, _mm_subs_epu8(x, four));
+            a0 = _mm_sub_epi8(a0, _mm_cmpeq_epi8(x, zero));
+            a1 = _mm_sub_epi8(a1, _mm_cmpeq_epi8(x, one));
+            a2 = _mm_sub_epi8(a2, _mm_cmpeq_epi8(x, two));
+            a3 = _mm_sub_epi8(a3, _mm_cmpeq_epi8(x, three));
+        }
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, zero)) != 0xFFFF) {
+            break;
+        }
+
+        c0 = SumSSE2(a0);
+        c1 = SumSSE2(a1);
+        c2 = SumSSE2(a2);
+        c3 = SumSSE2(a3);
+        cnt[0] += c0;
+        cnt[1] += c1;
+        cnt[2] += c2;
+        cnt[3] += c3;
+        cnt[4] += n * sizeof(__m128i) - c0 - c1 - c2 - c3;
+        i += n * sizeof(__m128i);
+    }
+
+    return i + BaseCountScalar(cnt, bases + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t SumAVX2(__m256i a) {
+    __m256i s = _mm256_sad_epu8(a, _mm256_setzero_si256());
+    __m128i h = _mm_add_epi64(_mm256_castsi256_si128(s),
+                              _mm256_extracti128_si256(s, 1));
+    return (uint64_t)_mm_cvtsi128_si32(h)
+         + (uint64_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(h, h));
+}
+
+__attribute__((target("avx2")))
+static size_t CC BaseCountAVX2(uint64_t cnt[5],
+    const uint8_t *bases, size_t size)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+    const __m256i three = _mm256_set1_epi8(3);
+    const __m256i four = _mm256_set1_epi8(4);
+
+    size_t i = 0;
+
+    while (size - i >= sizeof(__m256i)) {
+        __m256i a0 = zero, a1 = zero, a2 = zero, a3 = zero, bad = zero;
+        size_t n = (size - i) / sizeof(__m256i);
+        size_t k = 0;
+        uint64_t c0, c1, c2, c3;
+
+        if (n > MAX_VECTORS) {
+            n = MAX_VECTORS;
+        }
+
+        for (k = 0; k < n; ++k) {
+            __m256i x = _mm256_loadu_si256
+                ((const __m256i*)(bases + i + k * sizeof(__m256i)));
+            bad = _mm256_or_si256(bad, _mm256_subs_epu8(x, four));
+            a0 = _mm256_sub_epi8(a0, _mm256_cmpeq_epi8(x, zero));
+            a1 = _mm256_sub_epi8(a1, _mm256_cmpeq_epi8(x, one));
+            a2 = _mm256_sub_epi8(a2, _mm256_cmpeq_epi8(x, two));
+            a3 = _mm256_sub_epi8(a3, _mm256_cmpeq_epi8(x, three));
+        }
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(bad, zero)) != -1) {
+            break;
+        }
+
+        c0 = SumAVX2(a0);
+        c1 = SumAVX2(a1);
+        c2 = SumAVX2(a2);
+        c3 = SumAVX2(a3);
+        cnt[0] += c0;
+        cnt[1] += c1;
+        cnt[2] += c2;
+        cnt[3] += c3;
+        cnt[4] += n * sizeof(__m256i) - c0 - c1 - c2 - c3;
+        i += n * sizeof(__m256i);
+    }
+
+    /* the tail and a block with a bad base are left to SSE2 and scalar */
+    return i + BaseCountSSE2(cnt, bases + i, size - i);
+}
+
+#endif /* BASE_COUNT_X86 */
+
+static BaseCountFn kernel = NULL;
+static const char *kernel_name = NULL;
+
+static void BaseCountSelect(void) {
+    kernel = BaseCountScalar;
+    kernel_name = "scalar";
+
+#ifdef BASE_COUNT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = BaseCountAVX2;
+        kernel_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        kernel = BaseCountSSE2;
+        kernel_name = "sse2";
+    }
+#endif
+}
+
+size_t CC BaseCountAdd(uint64_t cnt[5], const uint8_t *bases, size_t size) {
+    assert(cnt);
+
+    if (kernel == NULL) {
+        BaseCountSelect();
+    }
+
+    if (size == 0) {
+        return 0;
+    }
+
+    assert(bases);
+
+    return kernel(cnt, bases, size);
+}
+
+const char* CC BaseCountKernel(void) {
+    if (kernel == NULL) {
+        BaseCountSelect();
+    }
+
+    return kernel_name;
+}
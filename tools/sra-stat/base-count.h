@@ -0,0 +1,47 @@
+#ifndef _h_sra_stat_base_count_
+#define _h_sra_stat_base_count_
+
+/*==============================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <klib/defs.h> /* CC */
+
+/* BaseCountAdd
+ *  adds the composition of 'size' bases coded 0..4 (x2na or x2cs) to 'cnt'
+ *  uses AVX2 or SSE2 when the CPU has it, plain C otherwise
+ *
+ *  returns the number of bases counted:
+ *  less than 'size' means bases[ return value ] is not a valid code,
+ *  bases from that one on are not counted
+ */
+size_t CC BaseCountAdd(uint64_t cnt[5], const uint8_t *bases, size_t size);
+
+/* BaseCountKernel
+ *  name of the kernel BaseCountAdd uses: "avx2", "sse2" or "scalar"
+ */
+const char* CC BaseCountKernel(void);
+
+#endif /* _h_sra_stat_base_count_ */
@@ -27,6 +27,7 @@
 #include "sra-stat.vers.h"
 
 #include "sra-stat.h" /* VTableMakeSingleFileArchive_ */
+#include "base-count.h" /* BaseCountAdd */
 
 #include <insdc/sra.h> /* SRA_READ_TYPE_BIOLOGICAL */
 
@@ -56,6 +57,7 @@
 
 #include <sra/sraschema.h> /* VDBManagerMakeSRASchema */
 
+#include <vdb/blob.h> /* VBlob */
 #include <vdb/cursor.h> /* VCursor */
 #include <vdb/database.h> /* VDatabaseRelease */
 #include <vdb/dependencies.h> /* VDBDependencies */
@@ -312,6 +314,17 @@ typedef struct {
     const VCursor   *curs;
     uint32_t         idx;
 
+    /* READ blob of the current spot */
+    const VBlob     *blob;
+    int64_t          blob_first;
+    uint64_t         blob_count;
+
+    /* bases of adjacent cells of the blob which are not counted yet */
+    const uint8_t   *run;
+    size_t           run_len;
+    int64_t          run_spot;  /* first spot of the run */
+    int64_t          run_last;  /* last spot of the run */
+
     bool finalized;
 } Bases;
 static rc_t BasesInit(Bases *self, const VTable *vtbl) {
@@ -389,39 +402,117 @@ static rc_t BasesInit(Bases *self, const VTable *vtbl) {
                     "type=%s,name=%s", datatype, name));
             }
         }
+        if (rc == 0) {
+            DBGMSG(DBG_APP, DBG_COND_1, ("Bases are counted by %s kernel\n",
+                BaseCountKernel()));
+        }
     }
 
     return rc;
 }
 
-static void BasesFinalize(Bases *self) {
+static rc_t BasesRelease(Bases *self) {
+    rc_t rc = 0;
+
     assert(self);
 
-    if (self->curs == NULL) {
-        LOGMSG(klogInfo, "Bases statistics will not be printed : "
-            "READ cursor was not opened during BasesFinalize()");
+    RELEASE(VBlob    , self->blob);
+    RELEASE(VCursor  , self->curs);
+
+    self->run = NULL;
+    self->run_len = 0;
+
+    return rc;
+}
+
+/* find the spot of the run which has base number 'pos' of the run:
+   cells of the run follow each other, so spots are walked in order
+   summing up their lengths */
+static void BasesLocate(const Bases *self, size_t pos,
+    int64_t *spotid, size_t *offset)
+{
+    int64_t spot = 0;
+
+    assert(self && spotid && offset);
+
+    *spotid = self->run_spot;
+    *offset = pos;
+
+    for (spot = self->run_spot; spot <= self->run_last; ++spot) {
+        const void *base = NULL;
+        uint32_t elem_bits = 0, boff = 0, row_len = 0;
+        size_t len = 0;
+
+        if (VBlobCellData(self->blob, spot,
+            &elem_bits, &base, &boff, &row_len) != 0)
+        {
+            return;
+        }
+
+        len = (size_t)((uint64_t)row_len * elem_bits / 8);
+        if (pos < len) {
+            *spotid = spot;
+            *offset = pos;
+            return;
+        }
+        pos -= len;
+    }
+}
+
+/* count the pending run of bases in one go */
+static void BasesFlush(Bases *self) {
+    size_t counted = 0;
+
+    assert(self);
+
+    if (self->run_len == 0) {
         return;
     }
 
-    self->finalized = true;
-}
+    counted = BaseCountAdd(self->cnt, self->run, self->run_len);
+    if (counted < self->run_len) {
+        rc_t rc = RC(rcExe, rcColumn, rcReading, rcData, rcInvalid);
+        int64_t spotid = 0;
+        size_t offset = 0;
+        BasesLocate(self, counted, &spotid, &offset);
+        PLOGERR(klogInt, (klogErr, rc,
+            "Invalid READ column value '$(base) while VBlobCellData"
+            "($(type), spotid=$(spotid), offset=$(i))",
+            "base=%d,type=%s,spotid=%lu,offset=%lu",
+            self->run[counted],
+            self->CS_NATIVE ? "CS_NATIVE" : "not CS_NATIVE",
+            spotid, offset));
+        BasesRelease(self);
+        return;
+    }
 
-static rc_t BasesRelease(Bases *self) {
-    rc_t rc = 0;
+    self->run = NULL;
+    self->run_len = 0;
+}
 
+static void BasesFinalize(Bases *self) {
     assert(self);
 
-    RELEASE(VCursor  , self->curs);
+    BasesFlush(self);
 
-    return rc;
+    if (self->curs == NULL) {
+        LOGMSG(klogInfo, "Bases statistics will not be printed : "
+            "READ cursor was not opened during BasesFinalize()");
+        return;
+    }
+
+    self->finalized = true;
 }
 
+/* Bases of a spot are not counted right away: cells which follow each other
+   in the blob are collected into a run, so that whole blobs are counted
+   by the vector kernel instead of single spots */
 static void BasesAdd(Bases *self, int64_t spotid) {
     rc_t rc = 0;
     const void *base = NULL;
-    bitsz_t row_bits = ~0;
-    bitsz_t i = ~0;
-    const unsigned char *bases = NULL;
+    uint32_t elem_bits = 0, boff = 0, row_len = 0;
+    uint64_t row_bits = 0;
+    const uint8_t *bases = NULL;
 
     assert(self);
 
@@ -429,47 +520,68 @@ static void BasesAdd(Bases *self, int64_t spotid) {
         return;
     }
 
+    if (self->blob == NULL || spotid < self->blob_first
+        || (uint64_t)(spotid - self->blob_first) >= self->blob_count)
     {
-        uint32_t elem_bits = 0, elem_off = 0, elem_cnt = 0;
-        rc = VCursorCellDataDirect(self->curs, spotid, self->idx,
-            &elem_bits, &base, &elem_off, &elem_cnt);
+        BasesFlush(self);
+        if (self->curs == NULL) {
+            return;
+        }
+
+        RELEASE(VBlob, self->blob);
+
+        rc = VCursorGetBlobDirect(self->curs, &self->blob, spotid, self->idx);
+        if (rc == 0) {
+            rc = VBlobIdRange(self->blob,
+                &self->blob_first, &self->blob_count);
+        }
         if (rc != 0) {
             PLOGERR(klogInt, (klogErr, rc,
-                "while VCursorCellDataDirect(READ, $(type))",
-                "type=%s", self->CS_NATIVE ? "CS_NATIVE" : "not CS_NATIVE"));
+                "while VCursorGetBlobDirect(READ, $(type), spotid=$(spotid))",
+                "type=%s,spotid=%lu",
+                self->CS_NATIVE ? "CS_NATIVE" : "not CS_NATIVE", spotid));
             BasesRelease(self);
             return;
         }
+    }
 
-        row_bits = elem_cnt * elem_bits;
+    rc = VBlobCellData(self->blob, spotid,
+        &elem_bits, &base, &boff, &row_len);
+    if (rc != 0) {
+        PLOGERR(klogInt, (klogErr, rc,
+            "while VBlobCellData(READ, $(type))",
+            "type=%s", self->CS_NATIVE ? "CS_NATIVE" : "not CS_NATIVE"));
+        BasesRelease(self);
+        return;
     }
 
-    if ((row_bits % 8) != 0) {
+    row_bits = (uint64_t)row_len * elem_bits;
+
+    if ((row_bits % 8) != 0 || (boff % 8) != 0) {
         rc = RC(rcExe, rcColumn, rcReading, rcData, rcInvalid);
         PLOGERR(klogInt, (klogErr, rc, "Invalid row_bits '$(row_bits) "
-            "while VCursorCellDataDirect(READ, $(type), spotid=$(spotid))",
+            "while VBlobCellData(READ, $(type), spotid=$(spotid))",
             "row_bits=%lu,type=%s,spotid=%lu",
             row_bits, self->CS_NATIVE ? "CS_NATIVE" : "not CS_NATIVE", spotid));
         BasesRelease(self);
         return;
     }
 
-    row_bits /= 8;
-    bases = base;
-    for (i = 0; i < row_bits; ++i) {
-        unsigned char base = bases[i];
-        if (base > 4) {
-            rc = RC(rcExe, rcColumn, rcReading, rcData, rcInvalid);
-            PLOGERR(klogInt, (klogErr, rc,
-                "Invalid READ column value '$(base) while VCursorCellDataDirect"
-                "($(type), spotid=$(spotid), index=$(i))",
-                "base=%d,type=%s,spotid=%lu,index=%lu",
-                base, self->CS_NATIVE ? "CS_NATIVE" : "not CS_NATIVE",
-                spotid, i));
-            BasesRelease(self);
+    bases = (const uint8_t*)base + boff / 8;
+
+    if (self->run_len != 0 && bases == self->run + self->run_len) {
+        self->run_len += row_bits / 8;
+        self->run_last = spotid;
+    }
+    else {
+        BasesFlush(self);
+        if (self->curs == NULL) {
             return;
         }
-        ++self->cnt[base];
+
+        self->run = bases;
+        self->run_len = row_bits / 8;
+        self->run_spot = self->run_last = spotid;
     }
 }
 
@@ -26,6 +26,7 @@
 
 #include "vdb-dump-context.h"
 #include "vdb-dump-helper.h"
+#include "par_gzip.h"
 
 #include <klib/rc.h>
 #include <klib/log.h>
@@ -42,6 +43,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <ctype.h>
 
 /********************************************************************
 the dump context contains all informations needed to execute the dump
@@ -563,8 +565,11 @@ static void vdco_evaluate_options( const Args *my_args,
         ctx->compress_mode = orm_gzip;
     else if ( vdco_get_bool_option( my_args, OPTION_BZIP2, false ) )
         ctx->compress_mode = orm_bzip2;
+    else if ( vdco_get_bool_option( my_args, OPTION_BGZF, false ) )
+        ctx->compress_mode = orm_bgzf;
     else
         ctx->compress_mode = orm_uncompressed;
+    ctx->compress_threads = ( uint32_t )vdco_get_size_t_option( my_args, OPTION_ZTHREADS, DEF_OPTION_ZTHREADS );
 	
     vdco_set_table( ctx, vdco_get_str_option( my_args, OPTION_TABLE ) );
 	ctx->table_defined = ( ctx->table != NULL );
@@ -585,6 +590,26 @@ static void vdco_evaluate_options( const Args *my_args,
         ctx->without_sra_types = true;
 }
 
+/* vdco_get_size_t_option() takes whatever strtou64() makes of it,
+   the number of compressing threads has to be digits only and in range */
+static rc_t vdco_check_zthreads( const Args *my_args )
+{
+    const char *s = vdco_get_str_option( my_args, OPTION_ZTHREADS );
+    rc_t rc = 0;
+    if ( s != NULL )
+    {
+        char *endp;
+        unsigned long v = strtoul( s, &endp, 10 );
+        if ( !isdigit( ( unsigned char )s[ 0 ] ) || *endp != '\0' || v > PAR_GZIP_MAX_THREADS )
+        {
+            rc = RC( rcExe, rcArgv, rcProcessing, rcParam, rcInvalid );
+            (void)PLOGERR( klogErr, ( klogErr, rc, "Parameter for $(t) [$(v)] is invalid: must be a number from 0 to $(m)",
+                                      "t=%s,v=%s,m=%u", OPTION_ZTHREADS, s, PAR_GZIP_MAX_THREADS ) );
+        }
+    }
+    return rc;
+}
+
 rc_t vdco_capture_arguments_and_options( const Args * args, dump_context *ctx)
 {
     rc_t rc;
@@ -593,5 +618,7 @@ rc_t vdco_capture_arguments_and_options( const Args * args, dump_context *ctx)
 
     rc = ArgsHandleLogLevel( args );
     DISP_RC( rc, "ArgsHandleLogLevel() failed" );
+    if ( rc == 0 )
+        rc = vdco_check_zthreads( args );
     return rc;
 }
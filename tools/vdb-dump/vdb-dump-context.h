@@ -77,6 +77,8 @@ extern "C" {
 #define OPTION_PHASE             "phase"
 #define OPTION_GZIP              "gzip"
 #define OPTION_BZIP2             "bzip2"
+#define OPTION_BGZF              "bgzf"
+#define OPTION_ZTHREADS          "compress-threads"
 #define OPTION_OUT_BUF_SIZE      "output-buffer-size"
 #define OPTION_NO_MULTITHREAD    "disable-multithreading"
 #define OPTION_INFO              "info"
@@ -111,6 +113,7 @@ extern "C" {
 #define USE_PATHTYPE_TO_DETECT_DB_OR_TAB 1
 #define CURSOR_CACHE_SIZE 256*1024*1024
 #define DEF_OPTION_OUT_BUF_SIZE 1024*1024
+#define DEF_OPTION_ZTHREADS 4
 
 typedef enum dump_format_t
 {
@@ -153,6 +156,7 @@ typedef struct dump_context
     size_t output_buffer_size;
     dump_format_t format;
     out_redir_mode_t compress_mode;
+    uint32_t compress_threads;
     char c_boolean;
 
     bool print_column_names;
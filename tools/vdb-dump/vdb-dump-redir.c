@@ -29,20 +29,27 @@
 #include <kfs/directory.h>
 #include <kfs/buffile.h>
 #include <kfs/bzip.h>
-#include <kfs/gzip.h>
 #include <sysalloc.h>
 
 static rc_t CC out_redir_callback( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
 {
     out_redir * redir = ( out_redir * )self;
-    rc_t rc = KFileWriteAll( redir->kfile, redir->pos, buffer, bufsize, num_writ );
+    rc_t rc;
+    if ( redir->pgz != NULL )
+    {
+        rc = par_gzip_write( redir->pgz, buffer, bufsize );
+        *num_writ = ( rc == 0 ) ? bufsize : 0;
+        return rc;
+    }
+    rc = KFileWriteAll( redir->kfile, redir->pos, buffer, bufsize, num_writ );
     if ( rc == 0 )
         redir->pos += *num_writ;
     return rc;
 }
 
 
-rc_t init_out_redir( out_redir * self, out_redir_mode_t mode, const char * filename, size_t bufsize )
+rc_t init_out_redir( out_redir * self, out_redir_mode_t mode, const char * filename,
+                     size_t bufsize, uint32_t num_threads )
 {
     rc_t rc;
     KFile *output_file;
@@ -62,6 +69,20 @@ rc_t init_out_redir( out_redir * self, out_redir_mode_t mode, const char * filen
     else
         rc = KFileMakeStdOut ( &output_file );
 
+    self->pgz = NULL;
+    if ( rc == 0 && ( mode == orm_gzip || mode == orm_bgzf ) )
+    {
+        /* blocks are compressed in parallel and written by the thread doing the output */
+        rc = make_par_gzip( &self->pgz, output_file, mode == orm_bgzf ? pgz_bgzf : pgz_gzip, num_threads );
+        if ( rc == 0 )
+        {
+            mode = orm_uncompressed;
+            bufsize = 0;
+        }
+        else
+            KFileRelease( output_file );
+    }
+
     if ( rc == 0 )
     {
         KFile *temp_file;
@@ -69,9 +90,8 @@ rc_t init_out_redir( out_redir * self, out_redir_mode_t mode, const char * filen
         /* wrap the output-file in compression, if requested */
         switch ( mode )
         {
-            case orm_gzip  : rc = KFileMakeGzipForWrite( &temp_file, output_file ); break;
             case orm_bzip2 : rc = KFileMakeBzip2ForWrite( &temp_file, output_file ); break;
-            case orm_uncompressed : break;
+            default : break;
         }
         if ( rc == 0 )
         {
@@ -110,6 +130,13 @@ rc_t init_out_redir( out_redir * self, out_redir_mode_t mode, const char * filen
 
 void release_out_redir( out_redir * self )
 {
+    if ( self->pgz != NULL )
+    {
+        rc_t rc = release_par_gzip( self->pgz );
+        if ( rc != 0 )
+            LOGERR( klogErr, rc, "failed to finish compressed output" );
+        self->pgz = NULL;
+    }
     KFileRelease( self->kfile );
     if( self->org_writer != NULL )
     {
@@ -39,11 +39,14 @@ extern "C" {
 
 #include <kfs/file.h>
 
+#include "par_gzip.h"
+
 typedef enum out_redir_mode
 {
     orm_uncompressed = 0,
     orm_gzip,
-    orm_bzip2
+    orm_bzip2,
+    orm_bgzf
 } out_redir_mode_t;
 
 
@@ -54,10 +57,14 @@ typedef struct out_redir
     void* org_data;
     KFile* kfile;
     uint64_t pos;
+    par_gzip * pgz;     /* gzip and bgzf go through it instead of kfile */
 } out_redir;
 
 
-rc_t init_out_redir( out_redir * self, out_redir_mode_t mode, const char * filename, size_t bufsize );
+/* gzip and bgzf output is compressed on 'num_threads' threads,
+   bufsize does not apply to them */
+rc_t init_out_redir( out_redir * self, out_redir_mode_t mode, const char * filename,
+                     size_t bufsize, uint32_t num_threads );
 
 void release_out_redir( out_redir * self );
 
@@ -112,6 +112,8 @@ static const char * out_file_usage[] = { "write output to this file", NULL };
 static const char * out_path_usage[] = { "write output to this directory", NULL };
 static const char * gzip_usage[] = { "compress output using gzip", NULL };
 static const char * bzip2_usage[] = { "compress output using bzip2", NULL };
+static const char * bgzf_usage[] = { "compress output using gzip in BGZF-blocks", NULL };
+static const char * zthreads_usage[] = { "number of threads compressing gzip/bgzf-output, 0 to 64, 0...none", NULL };
 static const char * outbuf_size_usage[] = { "size of output-buffer, 0...none", NULL };
 static const char * disable_mt_usage[] = { "disable multithreading", NULL };
 static const char * info_usage[] = { "print info about run", NULL };
@@ -157,6 +159,8 @@ OptDef DumpOptions[] =
     { OPTION_PHASE, NULL, NULL, NULL, 1, true, false },
     { OPTION_GZIP, NULL, NULL, gzip_usage, 1, false, false },
     { OPTION_BZIP2, NULL, NULL, bzip2_usage, 1, false, false },
+    { OPTION_BGZF, NULL, NULL, bgzf_usage, 1, false, false },
+    { OPTION_ZTHREADS, NULL, NULL, zthreads_usage, 1, true, false },
     { OPTION_OUT_BUF_SIZE, NULL, NULL, outbuf_size_usage, 1, true, false },
     { OPTION_NO_MULTITHREAD, NULL, NULL, disable_mt_usage, 1, false, false },
     { OPTION_INFO, NULL, NULL, info_usage, 1, false, false }
@@ -228,6 +232,8 @@ rc_t CC Usage ( const Args * args )
     HelpOptionLine ( NULL, OPTION_OUT_PATH, NULL, out_path_usage );
     HelpOptionLine ( NULL, OPTION_GZIP, NULL, gzip_usage );
     HelpOptionLine ( NULL, OPTION_BZIP2, NULL, bzip2_usage );
+    HelpOptionLine ( NULL, OPTION_BGZF, NULL, bgzf_usage );
+    HelpOptionLine ( NULL, OPTION_ZTHREADS, "count", zthreads_usage );
     HelpOptionLine ( NULL, OPTION_OUT_BUF_SIZE, NULL, outbuf_size_usage );
     HelpOptionLine ( NULL, OPTION_NO_MULTITHREAD, NULL, disable_mt_usage );
     HelpOptionLine ( NULL, OPTION_INFO, NULL, info_usage );
@@ -1878,7 +1884,8 @@ rc_t CC KMain ( int argc, char *argv [] )
                 rc = init_out_redir( &redir,
                                      ctx->compress_mode,
                                      ctx->output_file,
-                                     ctx->output_buffer_size ); /* vdb-dump-redir.c */
+                                     ctx->output_buffer_size,
+                                     ctx->disable_multithreading ? 0 : ctx->compress_threads ); /* vdb-dump-redir.c */
                 if ( rc == 0 )
                 {
                     if ( ctx->phase > 0 )
@@ -73,6 +73,9 @@
 #include <klib/data-buffer.h>
 #include <klib/sort.h>
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+
 #include <sysalloc.h>
 
 #include <stdio.h>
@@ -91,6 +94,7 @@ static bool md5_required;
 static bool ref_int_check;
 static bool s_IndexOnly;
 static size_t memory_suggestion = (2ull * 1024ull * 1024ull * 1024ull);
+static unsigned ric_threads = 4;
 
 typedef struct node_s {
     int parent;
@@ -1145,40 +1149,96 @@ typedef struct id_pair_s {
     int64_t second;
 } id_pair_t;
 
-static size_t work_chunk(uint64_t const count)
+#define RIC_THREADS_MAX 64
+/* slices handed out per worker, evens out the load */
+#define RIC_SLICES_PER_THREAD 4
+#define RIC_MIN_SLICE (64u * 1024u)
+
+/* number of rows a worker checks at once; every worker holds that many pairs
+   plus as many again for sorting them */
+static size_t work_chunk(uint64_t const count, unsigned const threads)
 {
-    size_t const max = memory_suggestion / (sizeof(id_pair_t));
-    size_t chunk = (size_t)count;
+    size_t const max = memory_suggestion / (2 * sizeof(id_pair_t) * threads);
+    uint64_t chunk = count;
+
+    if (threads > 1) {
+        uint64_t const slices = RIC_SLICES_PER_THREAD * threads;
 
-#if 1
-    /* do as many as possible at once */
+        chunk = (count + slices - 1) / slices;
+        if (chunk < RIC_MIN_SLICE)
+            chunk = RIC_MIN_SLICE;
+        if (chunk > count)
+            chunk = count;
+    }
     if (chunk > max)
         chunk = max;
-#else
-    /* break it up into chunks of about equal size */
-    while (chunk > max)
-        chunk /= 2;
-#endif
-    return chunk;
+    if (chunk == 0)
+        chunk = 1;
+
+    return (size_t)chunk;
 }
 
-static void sort_key_pairs(size_t const N, id_pair_t array[/* N */])
+/* LSD radix sort on the foreign key; pairs are loaded in ascending row
+   order, so sorting stably on the key alone orders them by (first, second).
+   Digits that are the same in every key are skipped, which after taking away
+   the smallest key leaves only a few passes for typical row ids. */
+static void sort_key_pairs(size_t const N,
+                           id_pair_t array[/* N */],
+                           id_pair_t temp[/* N */])
 {
-    id_pair_t a;
-    id_pair_t b;
-    
-#define GET(P, V) ((void)(V = ((id_pair_t const *)(P))[0]))
-#define SET(P, V) ((void)((((id_pair_t *)(P))[0]) = V))
-#define CMP(A, B) (((GET(A, a)),(GET(B, b))), (a.first  < b.first  ? -1 :      \
-                                               b.first  < a.first  ?  1 :      \
-                                               a.second < b.second ? -1 :      \
-                                               b.second < a.second ?  1 : 0))
-#define SWAP(A, B, C, D) do{GET(A, a); GET(B, b); SET(A, b); SET(B, a);}while(0)
-    KSORT(array, N, sizeof(array[0]), 0, 0);
-#undef SWAP
-#undef CMP
-#undef SET
-#undef GET
+    size_t count[sizeof(uint64_t)][256];
+    int64_t base;
+    id_pair_t *src = array;
+    id_pair_t *dst = temp;
+    unsigned digit;
+    size_t i;
+
+    if (N < 2)
+        return;
+
+    base = array[0].first;
+    for (i = 1; i < N; ++i) {
+        if (base > array[i].first)
+            base = array[i].first;
+    }
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < N; ++i) {
+        uint64_t const key = (uint64_t)array[i].first - (uint64_t)base;
+
+        for (digit = 0; digit < sizeof(uint64_t); ++digit)
+            ++count[digit][(key >> (digit * 8)) & 0xFF];
+    }
+
+    for (digit = 0; digit < sizeof(uint64_t); ++digit) {
+        size_t *const bucket = count[digit];
+        unsigned const shift = digit * 8;
+        size_t offset = 0;
+        unsigned b;
+
+        if (bucket[(((uint64_t)src[0].first - (uint64_t)base) >> shift) & 0xFF] == N)
+            continue;
+
+        for (b = 0; b < 256; ++b) {
+            size_t const n = bucket[b];
+
+            bucket[b] = offset;
+            offset += n;
+        }
+        for (i = 0; i < N; ++i) {
+            uint64_t const key = (uint64_t)src[i].first - (uint64_t)base;
+
+            dst[bucket[(key >> shift) & 0xFF]++] = src[i];
+        }
+        {
+            id_pair_t *const t = src;
+
+            src = dst;
+            dst = t;
+        }
+    }
+    if (src != array)
+        memcpy(array, src, N * sizeof(array[0]));
 }
 
 static void sort_keys(size_t const N, int64_t array[/* N */])
@@ -1198,13 +1258,16 @@ static void sort_keys(size_t const N, int64_t array[/* N */])
 
 #define CHECK_QUITTING do { rc_t const rc = Quitting(); if (rc) return rc; } while(0);
 
+/* loads up to 'pairs' (foreign key, row) pairs starting at row 'startId';
+   pnext receives the first row not loaded */
 static size_t load_key_pairs(int64_t const startId,
                              int64_t const endId,
                              size_t const pairs,
                              id_pair_t pair[/* pairs */],
+                             id_pair_t temp[/* pairs */],
                              VCursor const *const acurs,
                              ColumnInfo *const aci,
-                             int64_t plast[],
+                             int64_t pnext[],
                              rc_t Rc[])
 {
     int64_t last_fkey = INT64_MIN;
@@ -1212,7 +1275,8 @@ static size_t load_key_pairs(int64_t const startId,
     size_t j = 0;
     bool ordered = true;
     
-    while (row < endId) {
+    pnext[0] = startId;
+    while (row < endId && j < pairs) {
         int64_t first;
         int64_t maybe_last;
         rc_t const rc1 = VCursorPageIdRange(acurs, aci->idx, row, &first, &maybe_last);
@@ -1229,7 +1293,6 @@ static size_t load_key_pairs(int64_t const startId,
             first = row;
         if (row != startId && pairs < count + j)
             break;
-        plast[0] = last;
         
         for ( ; j < pairs && row <= last; ++row) {
             rc_t const rc = VCursorCellDataDirect(acurs, row, aci->idx,
@@ -1256,9 +1319,10 @@ static size_t load_key_pairs(int64_t const startId,
             }
             /* row not found might be an error but that won't be decided here */
         }
+        pnext[0] = row;
     }
     if (!ordered)
-        sort_key_pairs(j, pair);
+        sort_key_pairs(j, pair, temp);
     
     Rc[0] = 0;
     return j;
@@ -1284,7 +1348,9 @@ static rc_t ric_align_generic(int64_t const startId,
                               uint64_t const count,
                               size_t const pairs,
                               id_pair_t pair[/* pairs */],
+                              id_pair_t temp[/* pairs */],
                               void *scratch[],
+                              size_t scratch_size[],
                               VCursor const *const acurs,
                               ColumnInfo *const aci,
                               VCursor const *const bcurs,
@@ -1293,12 +1359,12 @@ static rc_t ric_align_generic(int64_t const startId,
 {
     int64_t chunk;
     int64_t const endId = startId + count;
-    size_t scratch_size = 0;
 
     for (chunk = startId; chunk < endId; ) {
         rc_t rc = 0;
-        int64_t last;
-        size_t const n = load_key_pairs(chunk, endId, pairs, pair, acurs, aci, &last, &rc);
+        int64_t next;
+        size_t const n = load_key_pairs(chunk, endId, pairs, pair, temp,
+                                        acurs, aci, &next, &rc);
         size_t i;
         int64_t cur_fkey = 0;
         uint32_t elem_count = 0;
@@ -1306,17 +1372,9 @@ static rc_t ric_align_generic(int64_t const startId,
         int64_t const *id = 0;
 
         if (rc) return rc;
-        if (chunk == last)
+        if (chunk == next)
             break;
-        if (chunk != startId) {
-            (void)PLOGMSG(klogInfo, (klogInfo, "Referential Integrity: "
-                                     "$(aname) <-> $(bname)"
-                                     " $(pct)% complete",
-                                     "aname=%s,bname=%s,pct=%5.1f",
-                                     aci->name, bci->name,
-                                     (100.0 * (chunk - startId)) / count));
-        }
-        chunk = last;
+        chunk = next;
         for (i = 0; i < n; ++i) {
             int64_t const fkey = pair[i].first;
             int64_t const row = pair[i].second;
@@ -1336,14 +1394,14 @@ static rc_t ric_align_generic(int64_t const startId,
                     return rc;
                 
                 if (!is_sorted(elem_count, id)) {
-                    if (scratch_size < elem_count) {
+                    if (scratch_size[0] < elem_count) {
                         void *const temp = realloc(scratch[0], elem_count * sizeof(id[0]));
                         
                         if (temp == NULL)
                             return RC(rcExe, rcDatabase, rcValidating, rcMemory, rcExhausted);
                         
                         scratch[0] = temp;
-                        scratch_size = elem_count;
+                        scratch_size[0] = elem_count;
                     }
                     memcpy(scratch[0], id, elem_count * sizeof(id[0]));
                     sort_keys(elem_count, scratch[0]);
@@ -1363,6 +1421,211 @@ static rc_t ric_align_generic(int64_t const startId,
     return 0;
 }
 
+/* the alignment table row range is cut into slices, which are checked by a
+   pool of workers; every worker has its own pair of cursors */
+typedef struct ric_pool_s {
+    KLock *lock;
+    char const *aname;
+    char const *bname;
+    int64_t startId;
+    int64_t endId;
+    int64_t next;       /* first row of the next slice to hand out */
+    uint64_t done;      /* rows checked so far */
+    unsigned reported;  /* progress logged so far, in 10% steps */
+    size_t pairs;       /* rows per slice */
+    rc_t rc;            /* first failure, stops the other workers */
+} ric_pool_t;
+
+typedef struct ric_worker_s {
+    ric_pool_t *pool;
+    KThread *thread;
+    VCursor const *acurs;
+    VCursor const *bcurs;
+    ColumnInfo aci;
+    ColumnInfo bci;
+    id_pair_t *pair;    /* pool->pairs pairs followed by the sort buffer */
+    void *scratch;
+    size_t scratch_size;
+    bool own_cursors;
+} ric_worker_t;
+
+static rc_t ric_worker_run(ric_worker_t *const self)
+{
+    ric_pool_t *const pool = self->pool;
+    rc_t rc = 0;
+
+    while (rc == 0) {
+        int64_t first = 0;
+        uint64_t count = 0;
+        unsigned progress = 0;
+
+        rc = KLockAcquire(pool->lock);
+        if (rc)
+            break;
+        if (pool->rc == 0 && pool->next < pool->endId) {
+            first = pool->next;
+            count = pool->endId - first;
+            if (count > pool->pairs)
+                count = pool->pairs;
+            pool->next += count;
+        }
+        KLockUnlock(pool->lock);
+
+        if (count == 0)
+            break;
+
+        rc = ric_align_generic(first, count, pool->pairs,
+                               self->pair, self->pair + pool->pairs,
+                               &self->scratch, &self->scratch_size,
+                               self->acurs, &self->aci,
+                               self->bcurs, &self->bci);
+
+        if (KLockAcquire(pool->lock) == 0) {
+            if (rc) {
+                if (pool->rc == 0)
+                    pool->rc = rc;
+            }
+            else {
+                uint64_t const total = pool->endId - pool->startId;
+
+                pool->done += count;
+                progress = (unsigned)((10 * pool->done) / total);
+                if (progress <= pool->reported || pool->done == total)
+                    progress = 0;
+                else
+                    pool->reported = progress;
+            }
+            KLockUnlock(pool->lock);
+        }
+        if (progress) {
+            (void)PLOGMSG(klogInfo, (klogInfo, "Referential Integrity: "
+                                     "$(aname) <-> $(bname)"
+                                     " $(pct)% complete",
+                                     "aname=%s,bname=%s,pct=%5.1f",
+                                     pool->aname, pool->bname,
+                                     10.0 * progress));
+        }
+    }
+    return rc;
+}
+
+static rc_t CC ric_worker_thread(KThread const *self, void *data)
+{
+    return ric_worker_run(data);
+}
+
+static rc_t ric_open_cursor(VTable const *tbl, VCursor const **curs,
+                            ColumnInfo *const ci)
+{
+    rc_t rc = VTableCreateCursorRead(tbl, curs);
+
+    if (rc == 0)
+        rc = VCursorAddColumn(*curs, &ci->idx, "%s", ci->name);
+    if (rc == 0)
+        rc = VCursorOpen(*curs);
+    return rc;
+}
+
+/* acurs and bcurs are opened by the caller and used by the first worker,
+   the others open their own */
+static rc_t ric_align_pool(int64_t const startId,
+                           uint64_t const count,
+                           VTable const *atbl,
+                           VCursor const *const acurs,
+                           ColumnInfo const *const aci,
+                           VTable const *btbl,
+                           VCursor const *const bcurs,
+                           ColumnInfo const *const bci)
+{
+    ric_pool_t pool;
+    ric_worker_t worker[RIC_THREADS_MAX];
+    unsigned threads = ric_threads;
+    uint64_t slices;
+    unsigned i;
+    rc_t rc;
+
+    if (threads == 0)
+        threads = 1;
+    else if (threads > RIC_THREADS_MAX)
+        threads = RIC_THREADS_MAX;
+
+    memset(&pool, 0, sizeof(pool));
+    memset(worker, 0, sizeof(worker));
+
+    pool.aname = aci->name;
+    pool.bname = bci->name;
+    pool.startId = pool.next = startId;
+    pool.endId = startId + count;
+    pool.pairs = work_chunk(count, threads);
+
+    slices = (count + pool.pairs - 1) / pool.pairs;
+    if (threads > slices)
+        threads = slices > 0 ? (unsigned)slices : 1;
+
+    rc = KLockMake(&pool.lock);
+    for (i = 0; i < threads && rc == 0; ++i) {
+        ric_worker_t *const w = &worker[i];
+
+        w->pool = &pool;
+        w->aci = *aci;
+        w->bci = *bci;
+        if (i == 0) {
+            w->acurs = acurs;
+            w->bcurs = bcurs;
+        }
+        else {
+            w->own_cursors = true;
+            rc = ric_open_cursor(atbl, &w->acurs, &w->aci);
+            if (rc == 0)
+                rc = ric_open_cursor(btbl, &w->bcurs, &w->bci);
+        }
+        if (rc == 0) {
+            w->pair = malloc(2 * sizeof(id_pair_t) * pool.pairs);
+            if (w->pair == NULL)
+                rc = RC(rcExe, rcDatabase, rcValidating, rcMemory, rcExhausted);
+        }
+    }
+    if (rc == 0) {
+        if (threads == 1)
+            rc = ric_worker_run(&worker[0]);
+        else {
+            for (i = 0; i < threads && rc == 0; ++i)
+                rc = KThreadMake(&worker[i].thread, ric_worker_thread, &worker[i]);
+            if (rc) {
+                /* stop the workers which did start */
+                KLockAcquire(pool.lock);
+                pool.rc = rc;
+                KLockUnlock(pool.lock);
+            }
+            for (i = 0; i < threads; ++i) {
+                if (worker[i].thread) {
+                    rc_t rc2 = 0;
+                    rc_t const rc3 = KThreadWait(worker[i].thread, &rc2);
+
+                    if (rc == 0)
+                        rc = rc3 ? rc3 : rc2;
+                    KThreadRelease(worker[i].thread);
+                }
+            }
+            if (pool.rc != 0)
+                rc = pool.rc;
+        }
+    }
+    for (i = 0; i < threads; ++i) {
+        ric_worker_t *const w = &worker[i];
+
+        if (w->own_cursors) {
+            VCursorRelease(w->acurs);
+            VCursorRelease(w->bcurs);
+        }
+        free(w->pair);
+        free(w->scratch);
+    }
+    KLockRelease(pool.lock);
+
+    return rc;
+}
+
 static rc_t ric_align_ref_and_align(char const dbname[],
                                     VTable const *ref,
                                     VTable const *align,
@@ -1405,17 +1668,13 @@ static rc_t ric_align_ref_and_align(char const dbname[],
                 "reference table can not be read", "name=%s", dbname));
     }
     if (rc == 0) {
-        size_t const chunk = work_chunk(count);
-        id_pair_t *const pair = malloc(sizeof(id_pair_t) * chunk);
-
-        if (pair) {
-            void *scratch = NULL;
-            
-            rc = ric_align_generic(startId, count, chunk, pair, &scratch,
-                                   acurs, &aci, bcurs, &bci);
-            if (scratch)
-                free(scratch);
-
+        rc = ric_align_pool(startId, count, align, acurs, &aci,
+                            ref, bcurs, &bci);
+        if (GetRCObject(rc) == rcMemory && GetRCState(rc) == rcExhausted)
+            (void)PLOGERR(klogWarn, (klogWarn, rc = 0, "Database '$(name)':"
+                         " referential integrity could not be checked, skipped",
+                         "name=%s", dbname));
+        else {
             if (GetRCObject(rc) == (enum RCObject)rcData && GetRCState(rc) == rcUnexpected)
                 (void)PLOGERR(klogErr, (klogErr, rc,
                     "Database '$(name)': failed referential "
@@ -1433,17 +1692,6 @@ static rc_t ric_align_ref_and_align(char const dbname[],
             else if (rc)
                 (void)PLOGERR(klogErr, (klogErr, rc,
 "Database '$(name)': reference table can not be read", "name=%s", dbname));
-
-            free(pair);
-        }
-        else
-            rc = RC(rcExe, rcDatabase, rcValidating, rcMemory, rcExhausted);
-        
-        if (GetRCObject(rc) == rcMemory && GetRCState(rc) == rcExhausted) {
-            rc = 0;
-            (void)PLOGERR(klogWarn, (klogWarn, rc, "Database '$(name)':"
-                " referential integrity could not be checked, skipped",
-                "name=%s", dbname));
         }
     }
     VCursorRelease(acurs);
@@ -1487,17 +1735,13 @@ static rc_t ric_align_seq_and_pri(char const dbname[],
                 "sequence table can not be read", "name=%s", dbname));
     }
     if (rc == 0) {
-        size_t const chunk = work_chunk(count);
-        id_pair_t *const pair = malloc((sizeof(id_pair_t)+sizeof(int64_t)) * chunk);
-
-        if (pair) {
-            void *scratch = NULL;
-            
-            rc = ric_align_generic(startId, count, chunk, pair, &scratch,
-                                   acurs, &aci, bcurs, &bci);
-            if (scratch)
-                free(scratch);
-            
+        rc = ric_align_pool(startId, count, pri, acurs, &aci,
+                            seq, bcurs, &bci);
+        if (GetRCObject(rc) == rcMemory && GetRCState(rc) == rcExhausted)
+            (void)PLOGERR(klogWarn, (klogWarn, rc = 0, "Database '$(name)':"
+                         " referential integrity could not be checked, skipped",
+                         "name=%s", dbname));
+        else {
             if (GetRCObject(rc) == (enum RCObject)rcData && GetRCState(rc) == rcUnexpected)
                 (void)PLOGERR(klogErr, (klogErr, rc,
                     "Database '$(name)': failed referential "
@@ -1515,13 +1759,7 @@ static rc_t ric_align_seq_and_pri(char const dbname[],
             else if (rc)
                 (void)PLOGERR(klogErr, (klogErr, rc,
 "Database '$(name)': sequence table can not be read", "name=%s", dbname));
-
-            free(pair);
         }
-        else
-            (void)PLOGERR(klogWarn, (klogWarn, rc = 0, "Database '$(name)':"
-                         " referential integrity could not be checked, skipped",
-                         "name=%s", dbname));
     }
     VCursorRelease(acurs);
     VCursorRelease(bcurs);
@@ -2197,6 +2435,10 @@ static const char *USAGE_REF_INT[] =
 static const char *USAGE_DRI[] =
 { "Do not check data referential integrity for databases", NULL };
 
+#define OPTION_THREADS "threads"
+static const char *USAGE_THREADS[] =
+{ "Number of threads checking referential integrity, from 1 to 64 (default: 4)", NULL };
+
 static const char *USAGE_IND_ONLY[] =
 { "Check index-only with blobs CRC32 (default: no)", NULL };
 
@@ -2211,6 +2453,7 @@ static OptDef options [] =
                    ALIAS_EXHAUSTIVE, NULL, USAGE_EXHAUSTIVE, 1, false, false }
   , { OPTION_REF_INT , ALIAS_REF_INT , NULL, USAGE_REF_INT , 1, true , false }
   , { OPTION_CNS_CHK , ALIAS_CNS_CHK , NULL, USAGE_CNS_CHK , 1, true , false }
+  , { OPTION_THREADS , NULL          , NULL, USAGE_THREADS , 1, true , false }
 
     /* not printed by --help */
   , { "dri"          , NULL          , NULL, USAGE_DRI     , 1, false, false }
@@ -2263,6 +2506,7 @@ rc_t CC Usage ( const Args * args )
     HelpOptionLine(ALIAS_REF_INT , OPTION_REF_INT , "yes | no", USAGE_REF_INT);
     HelpOptionLine(ALIAS_CNS_CHK , OPTION_CNS_CHK , "yes | no", USAGE_CNS_CHK);
     HelpOptionLine(ALIAS_EXHAUSTIVE, OPTION_EXHAUSTIVE, NULL, USAGE_EXHAUSTIVE);
+    HelpOptionLine(NULL          , OPTION_THREADS , "count"   , USAGE_THREADS);
 
 /*
 #define NUM_LISTABLE_OPTIONS \
@@ -2342,6 +2586,35 @@ rc_t parse_args ( vdb_validate_params *pb, Args *args )
         }
     }
   }
+  {
+    rc = ArgsOptionCount(args, OPTION_THREADS, &cnt);
+    if (rc != 0) {
+        LOGERR(klogErr, rc, "Failure to get '" OPTION_THREADS "' argument");
+        return rc;
+    }
+    if (cnt != 0) {
+        rc = ArgsOptionValue(args, OPTION_THREADS, 0, &dummy);
+        if (rc != 0) {
+            LOGERR(klogErr, rc,
+                "Failure to get '" OPTION_THREADS "' argument");
+            return rc;
+        }
+        {
+            char *end = NULL;
+            unsigned long value = strtoul(dummy, &end, 10);
+            if (!isdigit(dummy[0]) || *end != '\0'
+                || value == 0 || value > RIC_THREADS_MAX)
+            {
+                rc = RC(rcExe, rcArgv, rcParsing, rcParam, rcInvalid);
+                PLOGERR(klogErr, (klogErr, rc, "Parameter for '" OPTION_THREADS
+                    "' [$(value)] is invalid: must be a number from 1 to $(max)",
+                    "value=%s,max=%u", dummy, RIC_THREADS_MAX));
+                return rc;
+            }
+            ric_threads = (unsigned)value;
+        }
+    }
+  }
   {
     rc = ArgsOptionCount ( args, "dri", & cnt );
     if ( rc != 0 )